@@ -39,12 +39,142 @@ extern "C" {
 
 #define UPIPE_AVCDEC_SIGNATURE UBASE_FOURCC('a', 'v', 'c', 'd')
 
+/** @hidden */
+struct umutex;
+
+/** @This defines which coded pictures are dropped before decoding. */
+enum upipe_avcdec_skip {
+    /** decode all pictures */
+    UPIPE_AVCDEC_SKIP_NONE = 0,
+    /** drop pictures that are not used as reference */
+    UPIPE_AVCDEC_SKIP_NONREF,
+    /** only decode key pictures */
+    UPIPE_AVCDEC_SKIP_NONKEY,
+};
+
+/** @This extends upipe_command with specific commands for avcdec. */
+enum upipe_avcdec_command {
+    UPIPE_AVCDEC_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns the skip mode and the minimum interval between key pictures
+     * (int *, uint64_t *) */
+    UPIPE_AVCDEC_GET_SKIP,
+    /** sets the skip mode and the minimum interval between key pictures
+     * (int, uint64_t) */
+    UPIPE_AVCDEC_SET_SKIP,
+};
+
+/** @This returns the current skip mode.
+ *
+ * @param upipe description structure of the pipe
+ * @param skip_p filled in with the skip mode
+ * @param interval_p filled in with the minimum interval between decoded key
+ * pictures, in clock units
+ * @return an error code
+ */
+static inline int upipe_avcdec_get_skip(struct upipe *upipe,
+                                        enum upipe_avcdec_skip *skip_p,
+                                        uint64_t *interval_p)
+{
+    int skip;
+    UBASE_RETURN(upipe_control(upipe, UPIPE_AVCDEC_GET_SKIP,
+                               UPIPE_AVCDEC_SIGNATURE, &skip, interval_p))
+    if (skip_p != NULL)
+        *skip_p = skip;
+    return UBASE_ERR_NONE;
+}
+
+/** @This sets the skip mode, typically for monitoring purposes. Pictures
+ * flagged by the framers as not used for reference
+ * (@ref uref_pic_get_discardable) or as not key (@ref uref_pic_get_key) are
+ * dropped before being sent to avcodec, which is also told to discard them
+ * if the input doesn't carry these attributes. In
+ * @ref UPIPE_AVCDEC_SKIP_NONKEY mode, key pictures less than interval apart
+ * from the last decoded one are dropped as well.
+ *
+ * Decoded pictures keep their own dates and duration, so the output is not
+ * continuous.
+ *
+ * @param upipe description structure of the pipe
+ * @param skip skip mode
+ * @param interval minimum interval between decoded key pictures, in clock
+ * units, or 0
+ * @return an error code
+ */
+static inline int upipe_avcdec_set_skip(struct upipe *upipe,
+                                        enum upipe_avcdec_skip skip,
+                                        uint64_t interval)
+{
+    return upipe_control(upipe, UPIPE_AVCDEC_SET_SKIP, UPIPE_AVCDEC_SIGNATURE,
+                         (int)skip, interval);
+}
+
 /** @This returns the management structure for all avcodec decode pipes.
  *
  * @return pointer to manager
  */
 struct upipe_mgr *upipe_avcdec_mgr_alloc(void);
 
+/** @This extends upipe_mgr_command with specific commands for avcdec. */
+enum upipe_avcdec_mgr_command {
+    UPIPE_AVCDEC_MGR_SENTINEL = UPIPE_MGR_CONTROL_LOCAL,
+
+    /** returns the maximum number of warm contexts (unsigned int *) */
+    UPIPE_AVCDEC_MGR_GET_POOL_DEPTH,
+    /** sets the pool of warm contexts (unsigned int, struct umutex *) */
+    UPIPE_AVCDEC_MGR_SET_POOL,
+    /** returns the current number of warm contexts (unsigned int *) */
+    UPIPE_AVCDEC_MGR_GET_POOL_SIZE,
+};
+
+/** @This returns the maximum number of warm contexts kept by the manager.
+ *
+ * @param mgr pointer to manager
+ * @param pool_depth_p filled in with the maximum number of warm contexts
+ * @return an error code
+ */
+static inline int upipe_avcdec_mgr_get_pool_depth(struct upipe_mgr *mgr,
+                                                  unsigned int *pool_depth_p)
+{
+    return upipe_mgr_control(mgr, UPIPE_AVCDEC_MGR_GET_POOL_DEPTH,
+                             UPIPE_AVCDEC_SIGNATURE, pool_depth_p);
+}
+
+/** @This returns the number of warm contexts currently kept by the manager.
+ *
+ * @param mgr pointer to manager
+ * @param pool_size_p filled in with the number of warm contexts
+ * @return an error code
+ */
+static inline int upipe_avcdec_mgr_get_pool_size(struct upipe_mgr *mgr,
+                                                 unsigned int *pool_size_p)
+{
+    return upipe_mgr_control(mgr, UPIPE_AVCDEC_MGR_GET_POOL_SIZE,
+                             UPIPE_AVCDEC_SIGNATURE, pool_size_p);
+}
+
+/** @This sets the pool of warm contexts. When a pipe dies, its opened
+ * avcodec context is flushed and kept in the pool, along with the ubuf
+ * manager used to allocate frames. A new pipe with the same codec, global
+ * headers and options then reuses it instead of opening a new context,
+ * which avoids the deferred avcodec_open2() on flow changes.
+ *
+ * The pool is disabled by default. The mutex is only required if pipes of
+ * this manager are allocated or released from several threads.
+ *
+ * @param mgr pointer to manager
+ * @param pool_depth maximum number of warm contexts, or 0 to disable
+ * @param mutex mutex protecting the pool, or NULL
+ * @return an error code
+ */
+static inline int upipe_avcdec_mgr_set_pool(struct upipe_mgr *mgr,
+                                            unsigned int pool_depth,
+                                            struct umutex *mutex)
+{
+    return upipe_mgr_control(mgr, UPIPE_AVCDEC_MGR_SET_POOL,
+                             UPIPE_AVCDEC_SIGNATURE, pool_depth, mutex);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -45,6 +45,10 @@ enum uprobe_avfsink_event {
 
     /** offset between Upipe timestamp and avformat timestamp (uint64_t) */
     UPROBE_AVFSINK_TS_OFFSET,
+    /** the I/O thread can't keep up, packets are queued (void) */
+    UPROBE_AVFSINK_STALLED,
+    /** the I/O thread caught up (void) */
+    UPROBE_AVFSINK_RESUMED,
 };
 
 /** @This extends upipe_command with specific commands for avformat sink. */
@@ -69,6 +73,10 @@ enum upipe_avfsink_command {
     UPIPE_AVFSINK_GET_TS_OFFSET,
     /** sets the timestamp offset (uint64_t) */
     UPIPE_AVFSINK_SET_TS_OFFSET,
+    /** returns the size of the I/O buffer (uint64_t *) */
+    UPIPE_AVFSINK_GET_IO_BUFFER,
+    /** sets the size of the I/O buffer (uint64_t) */
+    UPIPE_AVFSINK_SET_IO_BUFFER,
 };
 
 /** @This returns the management structure for all avformat sinks.
@@ -195,6 +203,37 @@ static inline int upipe_avfsink_set_ts_offset(struct upipe *upipe,
                          UPIPE_AVFSINK_SIGNATURE, ts_offset);
 }
 
+/** @This returns the size of the I/O buffer.
+ *
+ * @param upipe description structure of the pipe
+ * @param size_p filled in with the size of the buffer, in octets
+ * @return an error code
+ */
+static inline int upipe_avfsink_get_io_buffer(struct upipe *upipe,
+                                              uint64_t *size_p)
+{
+    return upipe_control(upipe, UPIPE_AVFSINK_GET_IO_BUFFER,
+                         UPIPE_AVFSINK_SIGNATURE, size_p);
+}
+
+/** @This sets the size of the I/O buffer. If it is not 0, the output is
+ * written by a dedicated thread, and the pipe throws
+ * @ref UPROBE_AVFSINK_STALLED instead of blocking when the buffer is full.
+ * While stalled, each input buffers up to @ref upipe_set_max_length packets
+ * (128 by default) before blocking its upstream pump.
+ * It only takes effect after the next call to @ref upipe_set_uri.
+ *
+ * @param upipe description structure of the pipe
+ * @param size size of the buffer, in octets, or 0 for blocking I/O
+ * @return an error code
+ */
+static inline int upipe_avfsink_set_io_buffer(struct upipe *upipe,
+                                              uint64_t size)
+{
+    return upipe_control(upipe, UPIPE_AVFSINK_SET_IO_BUFFER,
+                         UPIPE_AVFSINK_SIGNATURE, size);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -39,6 +39,16 @@ extern "C" {
 #define UPIPE_AVFSRC_SIGNATURE UBASE_FOURCC('a','v','f','r')
 #define UPIPE_AVFSRC_OUTPUT_SIGNATURE UBASE_FOURCC('a','v','f','o')
 
+/** @This extends uprobe_event with specific events for avformat source. */
+enum uprobe_avfsrc_event {
+    UPROBE_AVFSRC_SENTINEL = UPROBE_LOCAL,
+
+    /** the I/O thread can't keep up, reading is suspended (void) */
+    UPROBE_AVFSRC_STALLED,
+    /** the I/O thread caught up (void) */
+    UPROBE_AVFSRC_RESUMED,
+};
+
 /** @This extends upipe_command with specific commands for avformat source. */
 enum upipe_avfsrc_command {
     UPIPE_AVFSRC_SENTINEL = UPIPE_CONTROL_LOCAL,
@@ -47,7 +57,11 @@ enum upipe_avfsrc_command {
      * (uint64_t *) */
     UPIPE_AVFSRC_GET_TIME,
     /** asks to read at the given time (uint64_t) */
-    UPIPE_AVFSRC_SET_TIME
+    UPIPE_AVFSRC_SET_TIME,
+    /** returns the size of the I/O buffer (uint64_t *) */
+    UPIPE_AVFSRC_GET_IO_BUFFER,
+    /** sets the size of the I/O buffer (uint64_t) */
+    UPIPE_AVFSRC_SET_IO_BUFFER
 };
 
 /** @deprecated @This returns the content of an avformat option.
@@ -103,6 +117,35 @@ static inline int upipe_avfsrc_set_time(struct upipe *upipe, uint64_t time)
                          time);
 }
 
+/** @This returns the size of the I/O buffer.
+ *
+ * @param upipe description structure of the pipe
+ * @param size_p filled in with the size of the buffer, in octets
+ * @return an error code
+ */
+static inline int upipe_avfsrc_get_io_buffer(struct upipe *upipe,
+                                             uint64_t *size_p)
+{
+    return upipe_control(upipe, UPIPE_AVFSRC_GET_IO_BUFFER,
+                         UPIPE_AVFSRC_SIGNATURE, size_p);
+}
+
+/** @This sets the size of the I/O buffer. If it is not 0, the input is read
+ * ahead by a dedicated thread, and the pipe throws
+ * @ref UPROBE_AVFSRC_STALLED instead of blocking when the buffer runs dry.
+ * It only takes effect after the next call to @ref upipe_set_uri.
+ *
+ * @param upipe description structure of the pipe
+ * @param size size of the buffer, in octets, or 0 for blocking I/O
+ * @return an error code
+ */
+static inline int upipe_avfsrc_set_io_buffer(struct upipe *upipe,
+                                             uint64_t size)
+{
+    return upipe_control(upipe, UPIPE_AVFSRC_SET_IO_BUFFER,
+                         UPIPE_AVFSRC_SIGNATURE, size);
+}
+
 /** @This returns the management structure for all avformat sources.
  *
  * @return pointer to manager
@@ -37,19 +37,63 @@ extern "C" {
 #include <upipe/upipe.h>
 #include <upipe/uref_attr.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 UREF_ATTR_FLOAT(ebur128, momentary, "ebur128.momentary", momentary loudness)
 UREF_ATTR_FLOAT(ebur128, lra, "ebur128.lra", loudness range)
 UREF_ATTR_FLOAT(ebur128, global, "ebur128.global", global integrated loudness)
+UREF_ATTR_FLOAT(ebur128, shortterm, "ebur128.shortterm", short-term loudness)
+UREF_ATTR_FLOAT(ebur128, truepeak, "ebur128.truepeak", maximum true peak)
 
 #define UPIPE_EBUR128_SIGNATURE UBASE_FOURCC('r', '1', '2', '8')
 
+/** @This extends upipe_command with specific commands for ebur128. */
+enum upipe_ebur128_command {
+    UPIPE_EBUR128_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** get true peak measurement (int *) **/
+    UPIPE_EBUR128_GET_TRUE_PEAK,
+    /** set true peak measurement (int) **/
+    UPIPE_EBUR128_SET_TRUE_PEAK,
+};
+
 /** @This returns the management structure for all avformat sources.
  *
  * @return pointer to manager
  */
 struct upipe_mgr *upipe_ebur128_mgr_alloc(void);
 
+/** @This returns whether the oversampled true peak is measured.
+ *
+ * @param upipe description structure of the pipe
+ * @param enabled_p filled in with true if the true peak is measured
+ * @return an error code
+ */
+static inline int upipe_ebur128_get_true_peak(struct upipe *upipe,
+                                              bool *enabled_p)
+{
+    int enabled;
+    UBASE_RETURN(upipe_control(upipe, UPIPE_EBUR128_GET_TRUE_PEAK,
+                               UPIPE_EBUR128_SIGNATURE, &enabled))
+    *enabled_p = !!enabled;
+    return UBASE_ERR_NONE;
+}
+
+/** @This enables or disables the measurement of the oversampled true peak
+ * (ITU-R BS.1770-4 annex 2). When disabled, the sample peak is reported.
+ * The measurement restarts if it was already running.
+ *
+ * @param upipe description structure of the pipe
+ * @param enabled true to measure the true peak
+ * @return an error code
+ */
+static inline int upipe_ebur128_set_true_peak(struct upipe *upipe,
+                                              bool enabled)
+{
+    return upipe_control(upipe, UPIPE_EBUR128_SET_TRUE_PEAK,
+                         UPIPE_EBUR128_SIGNATURE, enabled ? 1 : 0);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe filter detecting black pictures, frozen video and scene
+ * changes
+ *
+ * The statistics are computed on the luma plane of decoded pictures, which
+ * may be low resolution or thumbnail outputs, on one line out of a
+ * configurable step. Each picture is tagged with its statistics, and events
+ * are thrown when a condition lasts longer than the configured duration.
+ */
+
+#ifndef _UPIPE_FILTERS_UPIPE_VIDEO_DETECT_H_
+/** @hidden */
+#define _UPIPE_FILTERS_UPIPE_VIDEO_DETECT_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/upipe.h>
+#include <upipe/uref_attr.h>
+#include <stdint.h>
+
+UREF_ATTR_UNSIGNED(vdet, luma, "vdet.luma", average luma)
+UREF_ATTR_UNSIGNED(vdet, sad, "vdet.sad",
+        average absolute difference with the previous picture in 1/256)
+UREF_ATTR_UNSIGNED(vdet, hist, "vdet.hist",
+        histogram difference with the previous picture in 1/1000)
+
+#define UPIPE_VIDEO_DETECT_SIGNATURE UBASE_FOURCC('v','d','e','t')
+
+/** @This extends uprobe_event with specific events for video detect. */
+enum uprobe_vdet_event {
+    UPROBE_VDET_SENTINEL = UPROBE_LOCAL,
+
+    /** black picture started (1) or ended (0) (struct uref *, int) */
+    UPROBE_VDET_BLACK,
+    /** frozen video started (1) or ended (0) (struct uref *, int) */
+    UPROBE_VDET_FREEZE,
+    /** scene change (struct uref *) */
+    UPROBE_VDET_SCENE_CHANGE,
+};
+
+/** @This converts an event to a string.
+ *
+ * @param event event to convert
+ * @return a string or NULL if invalid
+ */
+static inline const char *uprobe_vdet_event_str(int event)
+{
+    switch ((enum uprobe_vdet_event)event) {
+    UBASE_CASE_TO_STR(UPROBE_VDET_BLACK);
+    UBASE_CASE_TO_STR(UPROBE_VDET_FREEZE);
+    UBASE_CASE_TO_STR(UPROBE_VDET_SCENE_CHANGE);
+    case UPROBE_VDET_SENTINEL: break;
+    }
+    return NULL;
+}
+
+/** @This extends upipe_command with specific commands for video detect. */
+enum upipe_vdet_command {
+    UPIPE_VDET_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** sets the black detection parameters (unsigned int, unsigned int,
+     * uint64_t) */
+    UPIPE_VDET_SET_BLACK,
+    /** sets the freeze detection parameters (unsigned int, uint64_t) */
+    UPIPE_VDET_SET_FREEZE,
+    /** sets the scene change threshold (unsigned int) */
+    UPIPE_VDET_SET_SCENE,
+    /** sets the vertical subsampling step (unsigned int) */
+    UPIPE_VDET_SET_STEP,
+};
+
+/** @This sets the black detection parameters. A picture is black if the
+ * given ratio of its pixels is below the given luma level.
+ *
+ * @param upipe description structure of the pipe
+ * @param level maximum luma of black pixels (default 32)
+ * @param ratio minimum ratio of black pixels in 1/1000 (default 980)
+ * @param duration minimum duration before the event is thrown, in units of
+ * a 27 MHz clock (default 2 s)
+ * @return an error code
+ */
+static inline int upipe_vdet_set_black(struct upipe *upipe,
+                                       unsigned int level, unsigned int ratio,
+                                       uint64_t duration)
+{
+    return upipe_control(upipe, UPIPE_VDET_SET_BLACK,
+                         UPIPE_VIDEO_DETECT_SIGNATURE, level, ratio,
+                         duration);
+}
+
+/** @This sets the freeze detection parameters. A picture is frozen if its
+ * average absolute difference with the previous picture is below the given
+ * threshold. Black pictures are not considered frozen.
+ *
+ * @param upipe description structure of the pipe
+ * @param sad maximum average absolute difference in 1/256 (default 128)
+ * @param duration minimum duration before the event is thrown, in units of
+ * a 27 MHz clock (default 2 s)
+ * @return an error code
+ */
+static inline int upipe_vdet_set_freeze(struct upipe *upipe, unsigned int sad,
+                                        uint64_t duration)
+{
+    return upipe_control(upipe, UPIPE_VDET_SET_FREEZE,
+                         UPIPE_VIDEO_DETECT_SIGNATURE, sad, duration);
+}
+
+/** @This sets the scene change threshold, on the difference between the
+ * luma histograms of consecutive pictures.
+ *
+ * @param upipe description structure of the pipe
+ * @param threshold minimum histogram difference in 1/1000 (default 400)
+ * @return an error code
+ */
+static inline int upipe_vdet_set_scene(struct upipe *upipe,
+                                       unsigned int threshold)
+{
+    return upipe_control(upipe, UPIPE_VDET_SET_SCENE,
+                         UPIPE_VIDEO_DETECT_SIGNATURE, threshold);
+}
+
+/** @This sets the vertical subsampling step: only one line out of step is
+ * analyzed.
+ *
+ * @param upipe description structure of the pipe
+ * @param step vertical subsampling step (default 4)
+ * @return an error code
+ */
+static inline int upipe_vdet_set_step(struct upipe *upipe, unsigned int step)
+{
+    return upipe_control(upipe, UPIPE_VDET_SET_STEP,
+                         UPIPE_VIDEO_DETECT_SIGNATURE, step);
+}
+
+/** @This returns the management structure for video detect pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_vdet_mgr_alloc(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe filter measuring the PSNR and SSIM of pictures
+ *
+ * The pipe receives distorted pictures on its input, and reference pictures
+ * on subpipes allocated with @ref upipe_void_alloc_sub. Pictures are matched
+ * by their program PTS, so the reference must reach the pipe before the
+ * distorted picture, which is the case when the distorted pictures come
+ * from an encoder and a decoder. The PSNR and SSIM of each 8-bit plane are
+ * computed and the distorted pictures are output, tagged with the values
+ * for the picture and their averages over the current window.
+ */
+
+#ifndef _UPIPE_FILTERS_UPIPE_VIDEO_QUALITY_H_
+/** @hidden */
+#define _UPIPE_FILTERS_UPIPE_VIDEO_QUALITY_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/upipe.h>
+#include <upipe/uref_attr.h>
+#include <stdint.h>
+
+UREF_ATTR_FLOAT_VA(vqual, psnr, "vqual.psnr[%" PRIu8"]", PSNR in dB,
+        uint8_t plane, plane)
+UREF_ATTR_FLOAT_VA(vqual, ssim, "vqual.ssim[%" PRIu8"]", SSIM,
+        uint8_t plane, plane)
+UREF_ATTR_FLOAT_VA(vqual, psnr_avg, "vqual.psnr_avg[%" PRIu8"]",
+        average PSNR over the window in dB, uint8_t plane, plane)
+UREF_ATTR_FLOAT_VA(vqual, ssim_avg, "vqual.ssim_avg[%" PRIu8"]",
+        average SSIM over the window, uint8_t plane, plane)
+
+#define UPIPE_VIDEO_QUALITY_SIGNATURE UBASE_FOURCC('v','q','a','l')
+#define UPIPE_VIDEO_QUALITY_SUB_SIGNATURE UBASE_FOURCC('v','q','a','r')
+
+/** @This extends uprobe_event with specific events for video quality. */
+enum uprobe_vqual_event {
+    UPROBE_VQUAL_SENTINEL = UPROBE_LOCAL,
+
+    /** a window of measurements is complete, the averages are attached to
+     * the last picture (struct uref *) */
+    UPROBE_VQUAL_WINDOW,
+};
+
+/** @This converts an event to a string.
+ *
+ * @param event event to convert
+ * @return a string or NULL if invalid
+ */
+static inline const char *uprobe_vqual_event_str(int event)
+{
+    switch ((enum uprobe_vqual_event)event) {
+    UBASE_CASE_TO_STR(UPROBE_VQUAL_WINDOW);
+    case UPROBE_VQUAL_SENTINEL: break;
+    }
+    return NULL;
+}
+
+/** @This extends upipe_command with specific commands for video quality. */
+enum upipe_vqual_command {
+    UPIPE_VQUAL_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** sets the number of measured pictures in a window (unsigned int) */
+    UPIPE_VQUAL_SET_WINDOW,
+    /** sets the subsampling step (unsigned int) */
+    UPIPE_VQUAL_SET_STEP,
+};
+
+/** @This sets the number of measured pictures in a window. The averages are
+ * reset and @ref UPROBE_VQUAL_WINDOW is thrown at the end of each window.
+ *
+ * @param upipe description structure of the pipe
+ * @param window number of pictures (default 25)
+ * @return an error code
+ */
+static inline int upipe_vqual_set_window(struct upipe *upipe,
+                                         unsigned int window)
+{
+    return upipe_control(upipe, UPIPE_VQUAL_SET_WINDOW,
+                         UPIPE_VIDEO_QUALITY_SIGNATURE, window);
+}
+
+/** @This sets the subsampling step: the PSNR is computed on one line out of
+ * step, and the SSIM on one row of windows out of step.
+ *
+ * @param upipe description structure of the pipe
+ * @param step subsampling step (default 1)
+ * @return an error code
+ */
+static inline int upipe_vqual_set_step(struct upipe *upipe, unsigned int step)
+{
+    return upipe_control(upipe, UPIPE_VQUAL_SET_STEP,
+                         UPIPE_VIDEO_QUALITY_SIGNATURE, step);
+}
+
+/** @This returns the management structure for video quality pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_vqual_mgr_alloc(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -31,16 +31,62 @@ extern "C" {
 
 #include <upipe/upipe.h>
 
+#include <stdbool.h>
+
 #define UPIPE_H264F_SIGNATURE UBASE_FOURCC('2','6','4','f')
 /** We only accept the ISO 14496-10 annex B elementary stream. */
 #define UPIPE_H264F_EXPECTED_FLOW_DEF "block.h264."
 
+/** @This extends upipe_command with specific commands for h264f pipes. */
+enum upipe_h264f_command {
+    UPIPE_H264F_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns whether captions are extracted (int *) */
+    UPIPE_H264F_GET_CAPTIONS,
+    /** sets whether captions are extracted (int) */
+    UPIPE_H264F_SET_CAPTIONS,
+};
+
 /** @This returns the management structure for all h264f pipes.
  *
  * @return pointer to manager
  */
 struct upipe_mgr *upipe_h264f_mgr_alloc(void);
 
+/** @This returns whether A/53 captions are extracted.
+ *
+ * @param upipe description structure of the pipe
+ * @param captions_p filled in with true if captions are extracted
+ * @return an error code
+ */
+static inline int upipe_h264f_get_captions(struct upipe *upipe,
+                                           bool *captions_p)
+{
+    int captions;
+    UBASE_RETURN(upipe_control(upipe, UPIPE_H264F_GET_CAPTIONS,
+                               UPIPE_H264F_SIGNATURE, &captions))
+    *captions_p = !!captions;
+    return UBASE_ERR_NONE;
+}
+
+/** @This enables or disables the extraction of A/53 captions. The cc_data
+ * carried in registered user data SEIs is attached to the output access
+ * units as the p.cea_708 attribute, so that captions may be monitored or
+ * reinserted without decoding. Access units are output in decoding order,
+ * whereas cc_data is meant to be presented in display order: consumers
+ * needing a continuous caption stream must reorder the access units by PTS,
+ * as a decoder does on pictures.
+ *
+ * @param upipe description structure of the pipe
+ * @param captions true to extract captions
+ * @return an error code
+ */
+static inline int upipe_h264f_set_captions(struct upipe *upipe, bool captions)
+{
+    return upipe_control(upipe, UPIPE_H264F_SET_CAPTIONS,
+                         UPIPE_H264F_SIGNATURE, captions ? 1 : 0);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -42,6 +42,10 @@ enum uref_h26x_encaps;
 /** @This translates the h26x aspect_ratio_idc to urational */
 extern const struct urational upipe_h26xf_sar_from_idc[17];
 
+/** @This is the maximum size of the cc_data extracted from the SEIs of an
+ * access unit. */
+#define UPIPE_H26XF_CC_DATA_MAX (4 * 31 * 3)
+
 /** @This allows to skip escape words from NAL units. */
 struct upipe_h26xf_stream {
     /** positions of the 0s in the previous octets */
@@ -87,6 +91,21 @@ uint32_t upipe_h26xf_stream_ue(struct ubuf_block_stream *s);
  */
 int32_t upipe_h26xf_stream_se(struct ubuf_block_stream *s);
 
+/** @This extracts the cc_data triplets of ATSC A/53 captions from the
+ * registered user data messages of a SEI NAL unit, in the format of the
+ * p.cea_708 attribute.
+ *
+ * @param ubuf ubuf containing the NAL unit
+ * @param offset offset of the first SEI message in the ubuf
+ * @param end offset of the end of the NAL unit in the ubuf
+ * @param cc_data buffer of @ref UPIPE_H26XF_CC_DATA_MAX octets, appended with
+ * the cc_data triplets
+ * @param cc_size_p size of the data in the buffer, updated
+ * @return an error code
+ */
+int upipe_h26xf_extract_a53(struct ubuf *ubuf, size_t offset, size_t end,
+                            uint8_t *cc_data, size_t *cc_size_p);
+
 /** @This allocates a ubuf containing an annex B header.
  *
  * @param ubuf_mgr pointer to ubuf manager
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe module reassembling SDI frames from SMPTE 2022-6 RTP datagrams
+ */
+
+#ifndef _UPIPE_HBRMT_UPIPE_HBRMT_UNPACK_H_
+/** @hidden */
+#define _UPIPE_HBRMT_UPIPE_HBRMT_UNPACK_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/upipe.h>
+
+#define UPIPE_HBRMT_UNPACK_SIGNATURE UBASE_FOURCC('h','b','r','u')
+
+/** @This returns the management structure for hbrmt_unpack pipes. These pipes
+ * reassemble packed 10 bits SDI frames from SMPTE 2022-6 RTP datagrams,
+ * dropping frames affected by packet loss.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_hbrmt_unpack_mgr_alloc(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
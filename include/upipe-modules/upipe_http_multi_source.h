@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe source module downloading an http object over several
+ * connections
+ *
+ * The object is split into ranges which are fetched in parallel by inner
+ * http sources, and output in order. The number of parallel connections is
+ * adapted to the measured throughput.
+ */
+
+#ifndef _UPIPE_MODULES_UPIPE_HTTP_MULTI_SOURCE_H_
+/** @hidden */
+#define _UPIPE_MODULES_UPIPE_HTTP_MULTI_SOURCE_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/upipe.h>
+
+#define UPIPE_HTTP_MSRC_SIGNATURE UBASE_FOURCC('h','t','m','s')
+
+/** @This extends upipe_command with specific commands for http multi
+ * source. */
+enum upipe_http_msrc_command {
+    UPIPE_HTTP_MSRC_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** get the size of the ranges (uint64_t *) */
+    UPIPE_HTTP_MSRC_GET_CHUNK_SIZE,
+    /** set the size of the ranges (uint64_t) */
+    UPIPE_HTTP_MSRC_SET_CHUNK_SIZE,
+    /** get the maximum number of connections (unsigned int *) */
+    UPIPE_HTTP_MSRC_GET_MAX_STREAMS,
+    /** set the maximum number of connections (unsigned int) */
+    UPIPE_HTTP_MSRC_SET_MAX_STREAMS,
+    /** get the current number of connections (unsigned int *) */
+    UPIPE_HTTP_MSRC_GET_STREAMS,
+};
+
+/** @This converts an enum upipe_http_msrc_command to a string.
+ *
+ * @param cmd the enum to convert
+ * @return a string
+ */
+static inline const char *upipe_http_msrc_command_str(int cmd)
+{
+    switch ((enum upipe_http_msrc_command)cmd) {
+    UBASE_CASE_TO_STR(UPIPE_HTTP_MSRC_GET_CHUNK_SIZE);
+    UBASE_CASE_TO_STR(UPIPE_HTTP_MSRC_SET_CHUNK_SIZE);
+    UBASE_CASE_TO_STR(UPIPE_HTTP_MSRC_GET_MAX_STREAMS);
+    UBASE_CASE_TO_STR(UPIPE_HTTP_MSRC_SET_MAX_STREAMS);
+    UBASE_CASE_TO_STR(UPIPE_HTTP_MSRC_GET_STREAMS);
+    case UPIPE_HTTP_MSRC_SENTINEL: break;
+    }
+    return NULL;
+}
+
+/** @This returns the size of the ranges fetched by each connection.
+ *
+ * @param upipe description structure of the pipe
+ * @param chunk_size_p filled in with the size in octets
+ * @return an error code
+ */
+static inline int upipe_http_msrc_get_chunk_size(struct upipe *upipe,
+                                                 uint64_t *chunk_size_p)
+{
+    return upipe_control(upipe, UPIPE_HTTP_MSRC_GET_CHUNK_SIZE,
+                         UPIPE_HTTP_MSRC_SIGNATURE, chunk_size_p);
+}
+
+/** @This sets the size of the ranges fetched by each connection. The
+ * memory used to reorder the data is bounded by twice the maximum number
+ * of connections times this size. It applies to the next URI.
+ *
+ * @param upipe description structure of the pipe
+ * @param chunk_size size in octets
+ * @return an error code
+ */
+static inline int upipe_http_msrc_set_chunk_size(struct upipe *upipe,
+                                                 uint64_t chunk_size)
+{
+    return upipe_control(upipe, UPIPE_HTTP_MSRC_SET_CHUNK_SIZE,
+                         UPIPE_HTTP_MSRC_SIGNATURE, chunk_size);
+}
+
+/** @This returns the maximum number of parallel connections.
+ *
+ * @param upipe description structure of the pipe
+ * @param max_streams_p filled in with the maximum number of connections
+ * @return an error code
+ */
+static inline int upipe_http_msrc_get_max_streams(struct upipe *upipe,
+                                                  unsigned int *max_streams_p)
+{
+    return upipe_control(upipe, UPIPE_HTTP_MSRC_GET_MAX_STREAMS,
+                         UPIPE_HTTP_MSRC_SIGNATURE, max_streams_p);
+}
+
+/** @This sets the maximum number of parallel connections.
+ *
+ * @param upipe description structure of the pipe
+ * @param max_streams maximum number of connections
+ * @return an error code
+ */
+static inline int upipe_http_msrc_set_max_streams(struct upipe *upipe,
+                                                  unsigned int max_streams)
+{
+    return upipe_control(upipe, UPIPE_HTTP_MSRC_SET_MAX_STREAMS,
+                         UPIPE_HTTP_MSRC_SIGNATURE, max_streams);
+}
+
+/** @This returns the number of parallel connections currently targeted.
+ *
+ * @param upipe description structure of the pipe
+ * @param streams_p filled in with the number of connections
+ * @return an error code
+ */
+static inline int upipe_http_msrc_get_streams(struct upipe *upipe,
+                                              unsigned int *streams_p)
+{
+    return upipe_control(upipe, UPIPE_HTTP_MSRC_GET_STREAMS,
+                         UPIPE_HTTP_MSRC_SIGNATURE, streams_p);
+}
+
+/** @This returns the management structure for http multi sources.
+ *
+ * @param http_src_mgr manager of the inner http sources
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_http_msrc_mgr_alloc(struct upipe_mgr *http_src_mgr);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe statistical multiplexing controller
+ *
+ * The statmux pipe shares a pool octetrate (normally the octetrate of the
+ * TS mux minus audio, PSI and padding reservations) between the video
+ * encoders feeding the mux. A subpipe is inserted between each encoder and
+ * its mux input; it passes the coded pictures through and measures, for
+ * each GOP, the octetrate and the quantizer exported by the encoder with
+ * @ref uref_pic_get_qp. At the end of each GOP, octetrates are reallocated
+ * in proportion of the complexity of the services, and each subpipe whose
+ * allocation changed throws @ref UPROBE_STATMUX_SUB_REALLOC so that the
+ * application may reconfigure its encoder, for instance with:
+ *
+ * @code
+ * upipe_set_option(x264, "bitrate", kbits);
+ * upipe_set_option(x264, "vbv-maxrate", kbits);
+ * upipe_set_option(x264, "vbv-bufsize", buffer_kbits);
+ * upipe_x264_reconfigure(x264);
+ * @endcode
+ *
+ * On reallocation, the subpipe also outputs a flow definition with the new
+ * octetrate and buffer size, so that the reservation of the TS mux input
+ * follows the allocation. Allocations are lowered before others are raised,
+ * so that the sum of the reservations stays within the pool octetrate. The
+ * buffering delay of the input flow definition is kept, and the buffer size
+ * is capped so that the T-STD retention delay is never exceeded.
+ */
+
+#ifndef _UPIPE_MODULES_UPIPE_STATMUX_H_
+/** @hidden */
+#define _UPIPE_MODULES_UPIPE_STATMUX_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/upipe.h>
+
+#define UPIPE_STATMUX_SIGNATURE UBASE_FOURCC('s','t','m','x')
+#define UPIPE_STATMUX_SUB_SIGNATURE UBASE_FOURCC('s','t','m','s')
+
+/** @This extends @ref uprobe_event with specific statmux subpipe events. */
+enum uprobe_statmux_sub_event {
+    UPROBE_STATMUX_SUB_SENTINEL = UPROBE_LOCAL,
+
+    /** the encoder must be reconfigured to a new octetrate and buffer size
+     * (uint64_t, uint64_t) */
+    UPROBE_STATMUX_SUB_REALLOC,
+};
+
+/** @This converts @ref uprobe_statmux_sub_event to a string.
+ *
+ * @param event event to convert
+ * @return a string or NULL if invalid
+ */
+static inline const char *upipe_statmux_sub_event_str(int event)
+{
+    switch ((enum uprobe_statmux_sub_event)event) {
+    UBASE_CASE_TO_STR(UPROBE_STATMUX_SUB_REALLOC);
+    case UPROBE_STATMUX_SUB_SENTINEL: break;
+    }
+    return NULL;
+}
+
+/** @This describes the statistics of a statmux subpipe. */
+struct upipe_statmux_stats {
+    /** allocated octetrate */
+    uint64_t octetrate;
+    /** allocated buffer size */
+    uint64_t buffer_size;
+    /** octetrate measured over the last GOP */
+    uint64_t measured_octetrate;
+    /** average quantizer over the last GOP (0/1 if unknown) */
+    struct urational qp;
+    /** smoothed complexity of the service */
+    uint64_t complexity;
+    /** number of GOPs seen */
+    uint64_t gops;
+};
+
+/** @This extends upipe_command with specific commands for statmux pipes. */
+enum upipe_statmux_command {
+    UPIPE_STATMUX_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns the pool octetrate (uint64_t *) */
+    UPIPE_STATMUX_GET_OCTETRATE,
+    /** sets the pool octetrate (uint64_t) */
+    UPIPE_STATMUX_SET_OCTETRATE,
+    /** returns the measured padding (uint64_t *, struct urational *) */
+    UPIPE_STATMUX_GET_PADDING,
+};
+
+/** @This extends upipe_command with specific commands for statmux
+ * subpipes. */
+enum upipe_statmux_sub_command {
+    UPIPE_STATMUX_SUB_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** returns the octetrate range (uint64_t *, uint64_t *) */
+    UPIPE_STATMUX_SUB_GET_OCTETRATE_RANGE,
+    /** sets the octetrate range (uint64_t, uint64_t) */
+    UPIPE_STATMUX_SUB_SET_OCTETRATE_RANGE,
+    /** returns the maximum T-STD retention delay (uint64_t *) */
+    UPIPE_STATMUX_SUB_GET_MAX_DELAY,
+    /** sets the maximum T-STD retention delay (uint64_t) */
+    UPIPE_STATMUX_SUB_SET_MAX_DELAY,
+    /** returns the statistics of the service (struct upipe_statmux_stats *) */
+    UPIPE_STATMUX_SUB_GET_STATS,
+};
+
+/** @This returns the pool octetrate.
+ *
+ * @param upipe description structure of the pipe
+ * @param octetrate_p filled in with the octetrate
+ * @return an error code
+ */
+static inline int upipe_statmux_get_octetrate(struct upipe *upipe,
+                                              uint64_t *octetrate_p)
+{
+    return upipe_control(upipe, UPIPE_STATMUX_GET_OCTETRATE,
+                         UPIPE_STATMUX_SIGNATURE, octetrate_p);
+}
+
+/** @This sets the pool octetrate, shared by all subpipes.
+ *
+ * @param upipe description structure of the pipe
+ * @param octetrate new octetrate
+ * @return an error code
+ */
+static inline int upipe_statmux_set_octetrate(struct upipe *upipe,
+                                              uint64_t octetrate)
+{
+    return upipe_control(upipe, UPIPE_STATMUX_SET_OCTETRATE,
+                         UPIPE_STATMUX_SIGNATURE, octetrate);
+}
+
+/** @This returns the part of the pool octetrate that was not used by the
+ * services during their last GOP, and will be filled with padding by the
+ * mux.
+ *
+ * @param upipe description structure of the pipe
+ * @param octetrate_p filled in with the padding octetrate (may be NULL)
+ * @param ratio_p filled in with the padding ratio (may be NULL)
+ * @return an error code
+ */
+static inline int upipe_statmux_get_padding(struct upipe *upipe,
+                                            uint64_t *octetrate_p,
+                                            struct urational *ratio_p)
+{
+    return upipe_control(upipe, UPIPE_STATMUX_GET_PADDING,
+                         UPIPE_STATMUX_SIGNATURE, octetrate_p, ratio_p);
+}
+
+/** @This returns the octetrate range of a service.
+ *
+ * @param upipe description structure of the subpipe
+ * @param min_p filled in with the minimum octetrate
+ * @param max_p filled in with the maximum octetrate (0 means the pool
+ * octetrate)
+ * @return an error code
+ */
+static inline int upipe_statmux_sub_get_octetrate_range(struct upipe *upipe,
+                                                        uint64_t *min_p,
+                                                        uint64_t *max_p)
+{
+    return upipe_control(upipe, UPIPE_STATMUX_SUB_GET_OCTETRATE_RANGE,
+                         UPIPE_STATMUX_SUB_SIGNATURE, min_p, max_p);
+}
+
+/** @This sets the octetrate range of a service.
+ *
+ * @param upipe description structure of the subpipe
+ * @param min minimum octetrate
+ * @param max maximum octetrate (0 means the pool octetrate)
+ * @return an error code
+ */
+static inline int upipe_statmux_sub_set_octetrate_range(struct upipe *upipe,
+                                                        uint64_t min,
+                                                        uint64_t max)
+{
+    return upipe_control(upipe, UPIPE_STATMUX_SUB_SET_OCTETRATE_RANGE,
+                         UPIPE_STATMUX_SUB_SIGNATURE, min, max);
+}
+
+/** @This returns the maximum T-STD retention delay of a service.
+ *
+ * @param upipe description structure of the subpipe
+ * @param delay_p filled in with the delay
+ * @return an error code
+ */
+static inline int upipe_statmux_sub_get_max_delay(struct upipe *upipe,
+                                                  uint64_t *delay_p)
+{
+    return upipe_control(upipe, UPIPE_STATMUX_SUB_GET_MAX_DELAY,
+                         UPIPE_STATMUX_SUB_SIGNATURE, delay_p);
+}
+
+/** @This sets the maximum T-STD retention delay of a service. It should be
+ * set to the value used by the TS mux for the elementary stream.
+ *
+ * @param upipe description structure of the subpipe
+ * @param delay new delay
+ * @return an error code
+ */
+static inline int upipe_statmux_sub_set_max_delay(struct upipe *upipe,
+                                                  uint64_t delay)
+{
+    return upipe_control(upipe, UPIPE_STATMUX_SUB_SET_MAX_DELAY,
+                         UPIPE_STATMUX_SUB_SIGNATURE, delay);
+}
+
+/** @This returns the statistics of a service.
+ *
+ * @param upipe description structure of the subpipe
+ * @param stats filled in with the statistics
+ * @return an error code
+ */
+static inline int upipe_statmux_sub_get_stats(struct upipe *upipe,
+                                              struct upipe_statmux_stats *stats)
+{
+    return upipe_control(upipe, UPIPE_STATMUX_SUB_GET_STATS,
+                         UPIPE_STATMUX_SUB_SIGNATURE, stats);
+}
+
+/** @This returns the management structure for all statmux pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_statmux_mgr_alloc(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
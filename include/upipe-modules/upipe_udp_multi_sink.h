@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe sink module sending udp datagrams to several destinations
+ *
+ * All destinations share one socket, and every buffer is sent to all of
+ * them with as few system calls as possible.
+ */
+
+#ifndef _UPIPE_MODULES_UPIPE_UDP_MULTI_SINK_H_
+/** @hidden */
+#define _UPIPE_MODULES_UPIPE_UDP_MULTI_SINK_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/upipe.h>
+
+#define UPIPE_UDPMSINK_SIGNATURE UBASE_FOURCC('u','m','s','k')
+
+/** @This extends upipe_command with specific commands for udp multi sink. */
+enum upipe_udpmsink_command {
+    UPIPE_UDPMSINK_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** get socket fd (int *) **/
+    UPIPE_UDPMSINK_GET_FD,
+    /** set socket fd (int) **/
+    UPIPE_UDPMSINK_SET_FD,
+    /** add or update a destination (const char *) **/
+    UPIPE_UDPMSINK_ADD_DEST,
+    /** remove a destination (const char *) **/
+    UPIPE_UDPMSINK_DEL_DEST,
+    /** iterate over destinations (const char **) **/
+    UPIPE_UDPMSINK_ITERATE_DEST,
+};
+
+/** @This returns the management structure for all udp multi sinks.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_udpmsink_mgr_alloc(void);
+
+/** @This returns the socket shared by all destinations.
+ *
+ * @param upipe description structure of the pipe
+ * @param fd_p filled in with the fd of the socket, or -1
+ * @return an error code
+ */
+static inline int upipe_udpmsink_get_fd(struct upipe *upipe, int *fd_p)
+{
+    return upipe_control(upipe, UPIPE_UDPMSINK_GET_FD,
+                         UPIPE_UDPMSINK_SIGNATURE, fd_p);
+}
+
+/** @This sets the socket shared by all destinations. It must not be
+ * connected. By default a socket is opened with the address family of the
+ * first destination.
+ *
+ * @param upipe description structure of the pipe
+ * @param fd file descriptor, or -1
+ * @return an error code
+ */
+static inline int upipe_udpmsink_set_fd(struct upipe *upipe, int fd)
+{
+    return upipe_control(upipe, UPIPE_UDPMSINK_SET_FD,
+                         UPIPE_UDPMSINK_SIGNATURE, fd);
+}
+
+/** @This adds a destination, or updates the options of an existing
+ * destination with the same address. The URI is of the form
+ * host:port[/option...], with the options ttl=, tos=, dscp=, ifindex= and
+ * ifname=. Other destinations are not disturbed.
+ *
+ * @param upipe description structure of the pipe
+ * @param uri destination URI
+ * @return an error code
+ */
+static inline int upipe_udpmsink_add_dest(struct upipe *upipe,
+                                          const char *uri)
+{
+    return upipe_control(upipe, UPIPE_UDPMSINK_ADD_DEST,
+                         UPIPE_UDPMSINK_SIGNATURE, uri);
+}
+
+/** @This removes the destination with the address of the given URI. Options
+ * in the URI are ignored.
+ *
+ * @param upipe description structure of the pipe
+ * @param uri destination URI
+ * @return an error code
+ */
+static inline int upipe_udpmsink_del_dest(struct upipe *upipe,
+                                          const char *uri)
+{
+    return upipe_control(upipe, UPIPE_UDPMSINK_DEL_DEST,
+                         UPIPE_UDPMSINK_SIGNATURE, uri);
+}
+
+/** @This iterates over the URIs of the destinations.
+ *
+ * @param upipe description structure of the pipe
+ * @param uri_p filled in with the next URI, or NULL at the end; must be
+ * initialized to NULL to get the first URI
+ * @return an error code
+ */
+static inline int upipe_udpmsink_iterate_dest(struct upipe *upipe,
+                                              const char **uri_p)
+{
+    return upipe_control(upipe, UPIPE_UDPMSINK_ITERATE_DEST,
+                         UPIPE_UDPMSINK_SIGNATURE, uri_p);
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
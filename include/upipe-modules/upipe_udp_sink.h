@@ -51,6 +51,16 @@ enum upipe_udpsink_command {
     UPIPE_UDPSINK_SET_FD,
     /** set remote address (const struct sockaddr *, socklen_t) **/
     UPIPE_UDPSINK_SET_PEER,
+    /** get kernel pacing horizon (uint64_t *) **/
+    UPIPE_UDPSINK_GET_TXTIME,
+    /** set kernel pacing horizon, 0 to disable (uint64_t) **/
+    UPIPE_UDPSINK_SET_TXTIME,
+    /** get zero-copy mode (int *) **/
+    UPIPE_UDPSINK_GET_ZEROCOPY,
+    /** set zero-copy mode (int) **/
+    UPIPE_UDPSINK_SET_ZEROCOPY,
+    /** get zero-copy statistics (uint64_t *, uint64_t *) **/
+    UPIPE_UDPSINK_GET_ZEROCOPY_STATS,
 };
 
 /** @This returns the management structure for all udp sinks.
@@ -96,6 +106,85 @@ static inline int upipe_udpsink_set_peer(struct upipe *upipe,
     return upipe_control(upipe, UPIPE_UDPSINK_SET_PEER, UPIPE_UDPSINK_SIGNATURE,
             addr, addrlen);
 }
+
+/** @This returns the kernel pacing horizon.
+ *
+ * @param upipe description structure of the pipe
+ * @param horizon_p filled in with the horizon in units of the 27 MHz clock
+ * @return an error code
+ */
+static inline int upipe_udpsink_get_txtime(struct upipe *upipe,
+                                           uint64_t *horizon_p)
+{
+    return upipe_control(upipe, UPIPE_UDPSINK_GET_TXTIME,
+                         UPIPE_UDPSINK_SIGNATURE, horizon_p);
+}
+
+/** @This sets the kernel pacing horizon. When it is not 0, packets due
+ * less than horizon in the future are handed to the kernel at once with their
+ * departure time (SO_TXTIME), and the fq or etf qdisc enforces the timing
+ * instead of a timer. The pipe is only woken up once per horizon. This
+ * requires a uclock to be attached.
+ *
+ * @param upipe description structure of the pipe
+ * @param horizon horizon in units of the 27 MHz clock, or 0 to disable
+ * @return an error code
+ */
+static inline int upipe_udpsink_set_txtime(struct upipe *upipe,
+                                           uint64_t horizon)
+{
+    return upipe_control(upipe, UPIPE_UDPSINK_SET_TXTIME,
+                         UPIPE_UDPSINK_SIGNATURE, horizon);
+}
+
+/** @This returns whether zero-copy transmission is enabled.
+ *
+ * @param upipe description structure of the pipe
+ * @param zerocopy_p filled in with true if MSG_ZEROCOPY is used
+ * @return an error code
+ */
+static inline int upipe_udpsink_get_zerocopy(struct upipe *upipe,
+                                             bool *zerocopy_p)
+{
+    int zerocopy;
+    int err = upipe_control(upipe, UPIPE_UDPSINK_GET_ZEROCOPY,
+                            UPIPE_UDPSINK_SIGNATURE, &zerocopy);
+    if (ubase_check(err))
+        *zerocopy_p = !!zerocopy;
+    return err;
+}
+
+/** @This enables or disables zero-copy transmission (MSG_ZEROCOPY). Buffers
+ * are then kept until the kernel reports their completion on the socket error
+ * queue.
+ *
+ * @param upipe description structure of the pipe
+ * @param zerocopy true to enable MSG_ZEROCOPY
+ * @return an error code
+ */
+static inline int upipe_udpsink_set_zerocopy(struct upipe *upipe,
+                                             bool zerocopy)
+{
+    return upipe_control(upipe, UPIPE_UDPSINK_SET_ZEROCOPY,
+                         UPIPE_UDPSINK_SIGNATURE, zerocopy ? 1 : 0);
+}
+
+/** @This returns the number of zero-copy sends, and the number of them
+ * whose completion was reported by the kernel.
+ *
+ * @param upipe description structure of the pipe
+ * @param sent_p filled in with the number of zero-copy sends
+ * @param completed_p filled in with the number of completions
+ * @return an error code
+ */
+static inline int upipe_udpsink_get_zerocopy_stats(struct upipe *upipe,
+                                                   uint64_t *sent_p,
+                                                   uint64_t *completed_p)
+{
+    return upipe_control(upipe, UPIPE_UDPSINK_GET_ZEROCOPY_STATS,
+                         UPIPE_UDPSINK_SIGNATURE, sent_p, completed_p);
+}
+
 #ifdef __cplusplus
 }
 #endif
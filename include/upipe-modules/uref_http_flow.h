@@ -30,6 +30,8 @@ extern "C" {
 #include <upipe/uref_attr.h>
 
 UREF_ATTR_STRING(http, content_type, "http.content_type", http content type);
+UREF_ATTR_UNSIGNED(http, complete_length, "http.complete_length",
+        complete length of the object of a partial content);
 
 #ifdef __cplusplus
 }
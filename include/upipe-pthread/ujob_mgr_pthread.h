@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe ujob manager implementation using a pool of pthreads
+ */
+
+#ifndef _UPIPE_PTHREAD_UJOB_MGR_PTHREAD_H_
+/** @hidden */
+#define _UPIPE_PTHREAD_UJOB_MGR_PTHREAD_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/ujob.h>
+
+/** @This allocates a new ujob manager backed by a pool of threads. The
+ * thread calling @ref ujob_mgr_run also processes jobs, so nb_threads - 1
+ * threads are created. The manager may be shared by pipes running in
+ * different threads; their batches are then processed in order of
+ * submission.
+ *
+ * @param nb_threads total number of threads processing jobs, or 0 to use
+ * the number of online processors
+ * @return pointer to ujob manager, or NULL in case of error
+ */
+struct ujob_mgr *ujob_mgr_pthread_alloc(unsigned int nb_threads);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
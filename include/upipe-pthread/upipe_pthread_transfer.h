@@ -40,10 +40,48 @@ extern "C" {
 #include <upipe/upump.h>
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sched.h>
 #include <pthread.h>
 
 /** @hidden */
 struct umutex;
+/** @hidden */
+struct umem_mgr;
+/** @hidden */
+struct uref_mgr;
+
+/** @This describes the real-time profile applied by a pthread transfer
+ * manager to its thread, before entering the event loop. */
+struct upipe_pthread_rt {
+    /** scheduling policy (typically SCHED_FIFO or SCHED_RR) */
+    int policy;
+    /** scheduling priority, or 0 to keep the default scheduling */
+    int priority;
+    /** lock all current and future pages of the process in memory */
+    bool mlock;
+    /** number of bytes of stack to pre-fault, or 0 */
+    size_t stack_prefault;
+    /** umem manager whose pools are filled before running, or NULL */
+    struct umem_mgr *umem_mgr;
+    /** uref manager whose pools are filled before running, or NULL */
+    struct uref_mgr *uref_mgr;
+    /** maximum duration of a loop iteration, in units of a 27 MHz clock,
+     * above which a warning is thrown, or 0 to disable the watchdog */
+    uint64_t budget;
+};
+
+/** @This initializes a real-time profile with default values (no
+ * scheduling change, no memory locking, no pre-allocation, no watchdog).
+ *
+ * @param rt pointer to real-time profile
+ */
+static inline void upipe_pthread_rt_init(struct upipe_pthread_rt *rt)
+{
+    memset(rt, 0, sizeof(struct upipe_pthread_rt));
+    rt->policy = SCHED_FIFO;
+}
 
 /** @This returns a management structure for transfer pipes, using a new
  * pthread. You would need one management structure per target thread.
@@ -67,6 +105,33 @@ struct upipe_mgr *upipe_pthread_xfer_mgr_alloc(uint8_t queue_length,
         uint16_t upump_blocker_pool_depth, struct umutex *mutex,
         pthread_t *pthread_id_p, const pthread_attr_t *restrict attr);
 
+/** @This returns a management structure for transfer pipes, using a new
+ * pthread running with the given real-time profile. This allows to give
+ * real-time treatment to selected upipe_worker threads only (typically
+ * output threads), by passing the returned manager to the upipe_w* manager
+ * allocators.
+ *
+ * @param queue_length maximum length of the internal queue of commands
+ * @param msg_pool_depth maximum number of messages in the pool
+ * @param uprobe_pthread_upump_mgr pointer to optional probe, that will be set
+ * with the created upump_mgr
+ * @param upump_mgr_alloc alloc function provided by the upump manager
+ * @param upump_pool_depth maximum number of upump structures in the pool
+ * @param upump_blocker_pool_depth maximum number of upump_blocker structures in
+ * the pool
+ * @param mutex mutual exclusion pimitives to access the event loop, or NULL
+ * @param pthread_id_p reference to created thread ID (may be NULL)
+ * @param attr pthread attributes
+ * @param rt real-time profile (copied), or NULL
+ * @return pointer to xfer manager
+ */
+struct upipe_mgr *upipe_pthread_xfer_mgr_alloc_rt(uint8_t queue_length,
+        uint16_t msg_pool_depth, struct uprobe *uprobe_pthread_upump_mgr,
+        upump_mgr_alloc upump_mgr_alloc, uint16_t upump_pool_depth,
+        uint16_t upump_blocker_pool_depth, struct umutex *mutex,
+        pthread_t *pthread_id_p, const pthread_attr_t *restrict attr,
+        const struct upipe_pthread_rt *rt);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe module remultiplexing TS packets without PES reassembly
+ *
+ * This pipe expects aligned TS packets, one per uref, as output by
+ * @ref upipe_ts_check_mgr_alloc. It selects services, filters and remaps
+ * PIDs, and forwards the payload packets untouched. The PAT, the PMTs of
+ * the selected services, the CAT, the SDT and the EIT are reassembled and
+ * rewritten accordingly; other PSI PIDs are dropped. The ECM and EMM PIDs
+ * referenced by CA descriptors are forwarded, and PIDs no longer
+ * referenced by a new table version are dropped. Continuity counters are
+ * renumbered on all output PIDs, and PCRs may optionally be restamped
+ * against the system clock.
+ */
+
+#ifndef _UPIPE_TS_UPIPE_TS_REMUX_H_
+/** @hidden */
+#define _UPIPE_TS_UPIPE_TS_REMUX_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/upipe.h>
+
+#define UPIPE_TS_REMUX_SIGNATURE UBASE_FOURCC('t','s','r','x')
+
+/** @This extends upipe_command with specific commands for ts_remux pipes. */
+enum upipe_ts_remux_command {
+    UPIPE_TS_REMUX_SENTINEL = UPIPE_CONTROL_LOCAL,
+
+    /** selects a service (unsigned int) */
+    UPIPE_TS_REMUX_ADD_SERVICE,
+    /** deselects a service (unsigned int) */
+    UPIPE_TS_REMUX_DEL_SERVICE,
+    /** returns the output PID of an input PID (unsigned int,
+     * unsigned int *) */
+    UPIPE_TS_REMUX_GET_PID_MAP,
+    /** sets the output PID of an input PID (unsigned int, unsigned int) */
+    UPIPE_TS_REMUX_SET_PID_MAP,
+    /** returns the output transport stream ID (int *) */
+    UPIPE_TS_REMUX_GET_TSID,
+    /** sets the output transport stream ID (int) */
+    UPIPE_TS_REMUX_SET_TSID,
+    /** returns the PCR restamping mode (int *) */
+    UPIPE_TS_REMUX_GET_RESTAMP,
+    /** sets the PCR restamping mode (int) */
+    UPIPE_TS_REMUX_SET_RESTAMP,
+};
+
+/** @This selects a service. If no service is selected, all services are
+ * forwarded.
+ *
+ * @param upipe description structure of the pipe
+ * @param sid service ID (program number)
+ * @return an error code
+ */
+static inline int upipe_ts_remux_add_service(struct upipe *upipe,
+                                             unsigned int sid)
+{
+    return upipe_control(upipe, UPIPE_TS_REMUX_ADD_SERVICE,
+                         UPIPE_TS_REMUX_SIGNATURE, sid);
+}
+
+/** @This deselects a service.
+ *
+ * @param upipe description structure of the pipe
+ * @param sid service ID (program number)
+ * @return an error code
+ */
+static inline int upipe_ts_remux_del_service(struct upipe *upipe,
+                                             unsigned int sid)
+{
+    return upipe_control(upipe, UPIPE_TS_REMUX_DEL_SERVICE,
+                         UPIPE_TS_REMUX_SIGNATURE, sid);
+}
+
+/** @This returns the output PID of an input PID.
+ *
+ * @param upipe description structure of the pipe
+ * @param pid input PID
+ * @param out_pid_p filled in with the output PID (8191 if dropped)
+ * @return an error code
+ */
+static inline int upipe_ts_remux_get_pid_map(struct upipe *upipe,
+                                             unsigned int pid,
+                                             unsigned int *out_pid_p)
+{
+    return upipe_control(upipe, UPIPE_TS_REMUX_GET_PID_MAP,
+                         UPIPE_TS_REMUX_SIGNATURE, pid, out_pid_p);
+}
+
+/** @This sets the output PID of an input PID. The PMTs are rewritten
+ * accordingly. An output PID of 8191 drops the PID. The call fails if
+ * another input PID is already mapped to the same output PID. If a PID
+ * that is not remapped would still be output on the PID of another
+ * forwarded PID, only the first one is forwarded.
+ *
+ * @param upipe description structure of the pipe
+ * @param pid input PID
+ * @param out_pid output PID
+ * @return an error code
+ */
+static inline int upipe_ts_remux_set_pid_map(struct upipe *upipe,
+                                             unsigned int pid,
+                                             unsigned int out_pid)
+{
+    return upipe_control(upipe, UPIPE_TS_REMUX_SET_PID_MAP,
+                         UPIPE_TS_REMUX_SIGNATURE, pid, out_pid);
+}
+
+/** @This returns the output transport stream ID.
+ *
+ * @param upipe description structure of the pipe
+ * @param tsid_p filled in with the TSID, or -1 if the input one is kept
+ * @return an error code
+ */
+static inline int upipe_ts_remux_get_tsid(struct upipe *upipe, int *tsid_p)
+{
+    return upipe_control(upipe, UPIPE_TS_REMUX_GET_TSID,
+                         UPIPE_TS_REMUX_SIGNATURE, tsid_p);
+}
+
+/** @This sets the output transport stream ID.
+ *
+ * @param upipe description structure of the pipe
+ * @param tsid new TSID, or -1 to keep the input one
+ * @return an error code
+ */
+static inline int upipe_ts_remux_set_tsid(struct upipe *upipe, int tsid)
+{
+    return upipe_control(upipe, UPIPE_TS_REMUX_SET_TSID,
+                         UPIPE_TS_REMUX_SIGNATURE, tsid);
+}
+
+/** @This returns the PCR restamping mode.
+ *
+ * @param upipe description structure of the pipe
+ * @param restamp_p filled in with true if PCRs are restamped
+ * @return an error code
+ */
+static inline int upipe_ts_remux_get_restamp(struct upipe *upipe,
+                                             bool *restamp_p)
+{
+    int restamp;
+    UBASE_RETURN(upipe_control(upipe, UPIPE_TS_REMUX_GET_RESTAMP,
+                               UPIPE_TS_REMUX_SIGNATURE, &restamp))
+    if (restamp_p != NULL)
+        *restamp_p = !!restamp;
+    return UBASE_ERR_NONE;
+}
+
+/** @This sets the PCR restamping mode. When enabled, PCRs are rewritten
+ * from the cr_sys date of the packets, which removes the network jitter
+ * of the input.
+ *
+ * @param upipe description structure of the pipe
+ * @param restamp true to restamp PCRs
+ * @return an error code
+ */
+static inline int upipe_ts_remux_set_restamp(struct upipe *upipe,
+                                             bool restamp)
+{
+    return upipe_control(upipe, UPIPE_TS_REMUX_SET_RESTAMP,
+                         UPIPE_TS_REMUX_SIGNATURE, restamp ? 1 : 0);
+}
+
+/** @This returns the management structure for all ts_remux pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_ts_remux_mgr_alloc(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -127,6 +127,8 @@ enum ubuf_command {
     UBUF_ITERATE_SOUND_PLANE,
     /** split an interlaced picture into its two fields */
     UBUF_PICTURE_SPLIT_FIELDS,
+    /** switch the memory area to thread-safe reference counting (void) */
+    UBUF_UNCONFINE,
 
     /** non-standard commands implemented by a ubuf manager can start from
      * there */
@@ -140,6 +142,8 @@ enum ubuf_mgr_command {
     UBUF_MGR_CHECK,
     /** release all buffers kept in pools (void) */
     UBUF_MGR_VACUUM,
+    /** allocate thread-confined buffers from now on (void) */
+    UBUF_MGR_CONFINE,
 
     /** non-standard commands implemented by a ubuf manager can start from
      * there */
@@ -245,6 +249,20 @@ static inline void ubuf_free(struct ubuf *ubuf)
     ubuf->mgr->ubuf_free(ubuf);
 }
 
+/** @This switches a ubuf allocated by a thread-confined manager to
+ * thread-safe reference counting. It must be called before the ubuf or any
+ * of its duplicates is handed over to another thread, from the thread
+ * holding all the references. Other ubufs are left untouched.
+ *
+ * @param ubuf pointer to ubuf
+ * @return an error code
+ */
+static inline int ubuf_unconfine(struct ubuf *ubuf)
+{
+    int err = ubuf_control(ubuf, UBUF_UNCONFINE);
+    return err == UBASE_ERR_UNHANDLED ? UBASE_ERR_NONE : err;
+}
+
 /** @This increments the reference count of a ubuf manager.
  *
  * @param mgr pointer to ubuf manager
@@ -327,6 +345,21 @@ static inline int ubuf_mgr_vacuum(struct ubuf_mgr *mgr)
     return ubuf_mgr_control(mgr, UBUF_MGR_VACUUM);
 }
 
+/** @This instructs an existing ubuf manager to allocate thread-confined
+ * buffers, whose reference counts are maintained without atomic operations.
+ * Such buffers may only be duplicated and freed from the thread which
+ * allocated them, until they are passed to @ref ubuf_unconfine (this is done
+ * by the queue sink before data crosses threads, and by @ref upipe_unconfine
+ * for the buffers held by pipes moved with upipe_xfer).
+ *
+ * @param mgr pointer to ubuf manager
+ * @return an error code
+ */
+static inline int ubuf_mgr_confine(struct ubuf_mgr *mgr)
+{
+    return ubuf_mgr_control(mgr, UBUF_MGR_CONFINE);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -46,6 +46,11 @@ extern "C" {
 struct ubuf_mem_shared {
     /** number of blocks pointing to the memory area */
     uatomic_uint32_t refcount;
+    /** number of blocks pointing to the memory area, while confined */
+    uint32_t confined_refcount;
+    /** true if the memory area is only referenced from a single thread, in
+     * which case confined_refcount is used without atomic operations */
+    bool confined;
     /** pointer to origin pool */
     struct upool *pool;
     /** umem structure pointing to buffer */
@@ -60,7 +65,10 @@ struct ubuf_mem_shared {
 static inline struct ubuf_mem_shared *
     ubuf_mem_shared_use(struct ubuf_mem_shared *shared)
 {
-    uatomic_fetch_add(&shared->refcount, 1);
+    if (shared->confined)
+        shared->confined_refcount++;
+    else
+        uatomic_fetch_add(&shared->refcount, 1);
     return shared;
 }
 
@@ -71,6 +79,8 @@ static inline struct ubuf_mem_shared *
  */
 static inline bool ubuf_mem_shared_release(struct ubuf_mem_shared *shared)
 {
+    if (shared->confined)
+        return --shared->confined_refcount == 0;
     return uatomic_fetch_sub(&shared->refcount, 1) == 1;
 }
 
@@ -81,9 +91,25 @@ static inline bool ubuf_mem_shared_release(struct ubuf_mem_shared *shared)
  */
 static inline bool ubuf_mem_shared_single(struct ubuf_mem_shared *shared)
 {
+    if (shared->confined)
+        return shared->confined_refcount == 1;
     return uatomic_load(&shared->refcount) == 1;
 }
 
+/** @This switches a confined shared buffer to atomic reference counting,
+ * before it is handed over to another thread. It must be called from the
+ * thread holding all the references.
+ *
+ * @param shared pointer to shared buffer
+ */
+static inline void ubuf_mem_shared_unconfine(struct ubuf_mem_shared *shared)
+{
+    if (shared->confined) {
+        shared->confined = false;
+        uatomic_store(&shared->refcount, shared->confined_refcount);
+    }
+}
+
 /** @This returns the shared buffer.
  *
  * @param shared pointer to shared buffer
@@ -186,8 +212,11 @@ void ubuf_mem_shared_free_inner(struct upool *upool, void *_shared);
  * @param SHARED_POOL name of the shared pool in your private ubuf_mgr structure
  * @param SHARED name of the @tt{struct ubuf_mem_shared} field of your private
  * ubuf structure
+ * @param CONFINED name of the @tt{bool} field of your private ubuf_mgr
+ * structure, true if new shared buffers are thread-confined
  */
-#define UBUF_MEM_MGR_HELPER_POOL(STRUCTURE, UBUF_POOL, SHARED_POOL, SHARED) \
+#define UBUF_MEM_MGR_HELPER_POOL(STRUCTURE, UBUF_POOL, SHARED_POOL, SHARED, \
+                                 CONFINED)                                  \
 /** @internal @This allocates the data structure or fetches it from the     \
  * pool.                                                                    \
  *                                                                          \
@@ -218,7 +247,11 @@ static struct ubuf_mem_shared                                               \
                                                  struct ubuf_mem_shared *); \
     if (unlikely(shared == NULL))                                           \
         return NULL;                                                        \
-    uatomic_store(&shared->refcount, 1);                                    \
+    shared->confined = mem_mgr->CONFINED;                                   \
+    if (shared->confined)                                                   \
+        shared->confined_refcount = 1;                                      \
+    else                                                                    \
+        uatomic_store(&shared->refcount, 1);                                \
     return shared;                                                          \
 }                                                                           \
 /** @internal @This deallocates a data structure or places it back into     \
@@ -44,6 +44,7 @@ extern "C" {
 #include <upipe/upump.h>
 
 #include <assert.h>
+#include <sched.h>
 
 /** @This is the implementation of a structure that deals access to a
  * non-reentrant resource. */
@@ -126,6 +127,31 @@ static inline bool udeal_grab(struct udeal *udeal)
     return true;
 }
 
+/** @This waits until the resource may be exclusively used. It is meant for
+ * callers without an event loop, and the access must be given back with
+ * @ref udeal_release.
+ *
+ * @param udeal pointer to a udeal structure
+ */
+static inline void udeal_wait(struct udeal *udeal)
+{
+    uatomic_fetch_add(&udeal->waiters, 1);
+    while (unlikely(!udeal_grab(udeal)))
+        sched_yield();
+}
+
+/** @This gives back access to an exclusive resource previously acquired from
+ * @ref udeal_wait, or from @ref udeal_grab after @ref udeal_start.
+ *
+ * @param udeal pointer to a udeal structure
+ */
+static inline void udeal_release(struct udeal *udeal)
+{
+    uatomic_fetch_sub(&udeal->access, 1);
+    if (uatomic_fetch_sub(&udeal->waiters, 1) > 1)
+        ueventfd_write(&udeal->event);
+}
+
 /** @This yields access to an exclusive resource previously acquired from
  * @ref udeal_grab, and stops the watcher.
  *
@@ -134,9 +160,7 @@ static inline bool udeal_grab(struct udeal *udeal)
  */
 static inline void udeal_yield(struct udeal *udeal, struct upump *upump)
 {
-    uatomic_fetch_sub(&udeal->access, 1);
-    if (uatomic_fetch_sub(&udeal->waiters, 1) > 1)
-        ueventfd_write(&udeal->event);
+    udeal_release(udeal);
     upump_stop(upump);
 }
 
@@ -197,6 +197,8 @@ struct udict {
 enum udict_mgr_command {
     /** release all buffers kept in pools (void) */
     UDICT_MGR_VACUUM,
+    /** fill pools up to their configured depth (void) */
+    UDICT_MGR_PREALLOC,
 
     /** non-standard manager commands implemented by a module type can start
      * from there (first arg = signature) */
@@ -1012,6 +1014,18 @@ static inline int udict_mgr_vacuum(struct udict_mgr *mgr)
     return udict_mgr_control(mgr, UDICT_MGR_VACUUM);
 }
 
+/** @This instructs an existing udict manager to fill its pools up to their
+ * configured depth, so that the first allocations do not hit the system
+ * allocator (typically before entering a real-time section).
+ *
+ * @param mgr pointer to udict manager
+ * @return an error code
+ */
+static inline int udict_mgr_prealloc(struct udict_mgr *mgr)
+{
+    return udict_mgr_control(mgr, UDICT_MGR_PREALLOC);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe structure running jobs in parallel
+ * A ujob manager executes a batch of independent jobs, possibly on several
+ * threads, and returns once all of them are done. Pictures are typically
+ * processed by splitting them into bands of lines.
+ */
+
+#ifndef _UPIPE_UJOB_H_
+/** @hidden */
+#define _UPIPE_UJOB_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/ubase.h>
+#include <upipe/urefcount.h>
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** minimum number of lines in a band, below which threading costs more
+ * than it saves */
+#define UJOB_BAND_MIN_LINES 16
+
+/** @This is the call-back type for a job.
+ *
+ * @param opaque opaque given to @ref ujob_mgr_run
+ * @param job index of the job, between 0 and nb_jobs - 1
+ * @param nb_jobs total number of jobs in the batch
+ */
+typedef void (*ujob_cb)(void *opaque, unsigned int job, unsigned int nb_jobs);
+
+/** @This is the call-back type for a band of lines.
+ *
+ * @param opaque opaque given to @ref ujob_mgr_run_bands
+ * @param line first line of the band
+ * @param lines number of lines in the band
+ */
+typedef void (*ujob_band_cb)(void *opaque, size_t line, size_t lines);
+
+/** @This is a structure running batches of jobs in parallel. */
+struct ujob_mgr {
+    /** pointer to refcount management structure */
+    struct urefcount *refcount;
+    /** number of threads running jobs, including the calling thread */
+    unsigned int nb_threads;
+
+    /** function running a batch of jobs and returning when they are done */
+    int (*ujob_mgr_run)(struct ujob_mgr *, ujob_cb, void *, unsigned int);
+};
+
+/** @This runs a batch of jobs and waits for their completion. If no manager
+ * is given, the jobs are run sequentially in the calling thread.
+ *
+ * @param ujob_mgr pointer to ujob manager, or NULL
+ * @param cb function to call for each job
+ * @param opaque opaque passed to the function
+ * @param nb_jobs number of jobs in the batch
+ * @return an error code
+ */
+static inline int ujob_mgr_run(struct ujob_mgr *ujob_mgr, ujob_cb cb,
+                               void *opaque, unsigned int nb_jobs)
+{
+    if (ujob_mgr == NULL || ujob_mgr->nb_threads <= 1 || nb_jobs <= 1) {
+        for (unsigned int i = 0; i < nb_jobs; i++)
+            cb(opaque, i, nb_jobs);
+        return UBASE_ERR_NONE;
+    }
+    return ujob_mgr->ujob_mgr_run(ujob_mgr, cb, opaque, nb_jobs);
+}
+
+/** @internal @This is the context of a batch of bands. */
+struct ujob_bands {
+    /** function to call for each band */
+    ujob_band_cb cb;
+    /** opaque passed to the function */
+    void *opaque;
+    /** total number of lines */
+    size_t lines;
+    /** bands start on a multiple of this number of lines */
+    size_t align;
+};
+
+/** @internal @This runs a band of lines.
+ *
+ * @param opaque pointer to struct ujob_bands
+ * @param job index of the band
+ * @param nb_jobs total number of bands
+ */
+static inline void ujob_bands_run(void *opaque, unsigned int job,
+                                  unsigned int nb_jobs)
+{
+    struct ujob_bands *bands = (struct ujob_bands *)opaque;
+    size_t units = (bands->lines + bands->align - 1) / bands->align;
+    size_t start = units * job / nb_jobs * bands->align;
+    size_t end = units * (job + 1) / nb_jobs * bands->align;
+    if (end > bands->lines)
+        end = bands->lines;
+    if (end > start)
+        bands->cb(bands->opaque, start, end - start);
+}
+
+/** @This splits a picture of the given height into bands of lines, and
+ * processes them in parallel. Bands start on a multiple of align lines, so
+ * that subsampled planes are not shared between bands.
+ *
+ * @param ujob_mgr pointer to ujob manager, or NULL
+ * @param lines total number of lines
+ * @param align alignment of the first line of each band (typically vsub)
+ * @param cb function to call for each band
+ * @param opaque opaque passed to the function
+ * @return an error code
+ */
+static inline int ujob_mgr_run_bands(struct ujob_mgr *ujob_mgr, size_t lines,
+                                     size_t align, ujob_band_cb cb,
+                                     void *opaque)
+{
+    struct ujob_bands bands = {
+        .cb = cb, .opaque = opaque, .lines = lines,
+        .align = align ? align : 1
+    };
+    unsigned int nb_jobs = 1;
+    if (ujob_mgr != NULL && ujob_mgr->nb_threads > 1) {
+        size_t max_jobs = lines / UJOB_BAND_MIN_LINES;
+        nb_jobs = ujob_mgr->nb_threads;
+        if (nb_jobs > max_jobs)
+            nb_jobs = max_jobs ? max_jobs : 1;
+    }
+    return ujob_mgr_run(ujob_mgr, ujob_bands_run, &bands, nb_jobs);
+}
+
+/** @This increments the reference count of a ujob manager.
+ *
+ * @param ujob_mgr pointer to ujob manager
+ * @return same pointer to ujob manager
+ */
+static inline struct ujob_mgr *ujob_mgr_use(struct ujob_mgr *ujob_mgr)
+{
+    if (ujob_mgr == NULL)
+        return NULL;
+    urefcount_use(ujob_mgr->refcount);
+    return ujob_mgr;
+}
+
+/** @This decrements the reference count of a ujob manager or frees it.
+ *
+ * @param ujob_mgr pointer to ujob manager
+ */
+static inline void ujob_mgr_release(struct ujob_mgr *ujob_mgr)
+{
+    if (ujob_mgr != NULL)
+        urefcount_release(ujob_mgr->refcount);
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -80,6 +80,18 @@ static inline size_t umem_size(struct umem *umem)
     return umem->size;
 }
 
+/** @This holds statistics about a size class of a memory allocator. The
+ * counters wrap around, so only differences between two readings are
+ * meaningful. */
+struct umem_stats {
+    /** size (in octets) of the buffers of the size class */
+    size_t size;
+    /** number of allocations served from the pool */
+    uint32_t hits;
+    /** number of allocations forwarded to the system allocator */
+    uint32_t misses;
+};
+
 /** @This defines a memory allocator management structure.
  */
 struct umem_mgr {
@@ -95,6 +107,11 @@ struct umem_mgr {
 
     /** function to release all buffers kept in pools */
     void (*umem_mgr_vacuum)(struct umem_mgr *);
+    /** function to fill all pools with buffers */
+    void (*umem_mgr_prealloc)(struct umem_mgr *);
+    /** function to get statistics about a size class (may be NULL) */
+    bool (*umem_mgr_stats)(struct umem_mgr *, unsigned int,
+                           struct umem_stats *);
 };
 
 /** @This allocates a new umem buffer space.
@@ -151,6 +168,38 @@ static inline void umem_mgr_vacuum(struct umem_mgr *mgr)
         mgr->umem_mgr_vacuum(mgr);
 }
 
+/** @This instructs an existing umem manager to fill all its pools with
+ * buffers, mapped into memory, so that the first allocations do not page
+ * fault.
+ *
+ * @param mgr pointer to umem manager
+ */
+static inline void umem_mgr_prealloc(struct umem_mgr *mgr)
+{
+    assert(mgr != NULL);
+    if (likely(mgr->umem_mgr_prealloc != NULL))
+        mgr->umem_mgr_prealloc(mgr);
+}
+
+/** @This retrieves statistics about a size class of a umem manager. A
+ * manager may only start counting on the first call, so it should be called
+ * once before the allocations to watch.
+ *
+ * @param mgr pointer to umem manager
+ * @param index index of the size class, starting from 0
+ * @param stats filled in with the statistics of the size class
+ * @return false if the manager has no such size class
+ */
+static inline bool umem_mgr_stats(struct umem_mgr *mgr, unsigned int index,
+                                  struct umem_stats *stats)
+{
+    assert(mgr != NULL);
+    assert(stats != NULL);
+    if (mgr->umem_mgr_stats == NULL)
+        return false;
+    return mgr->umem_mgr_stats(mgr, index, stats);
+}
+
 /** @This increments the reference count of a umem manager.
  *
  * @param mgr pointer to umem manager
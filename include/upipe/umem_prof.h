@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe accounting memory allocator
+ * This memory allocator forwards all requests to another umem manager, and
+ * accounts the allocations, the number of live buffers and their lifetimes.
+ * It is typically allocated for each consumer whose memory usage needs to
+ * be profiled.
+ */
+
+#ifndef _UPIPE_UMEM_PROF_H_
+/** @hidden */
+#define _UPIPE_UMEM_PROF_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/umem.h>
+
+/** @hidden */
+struct uclock;
+/** @hidden */
+struct umutex;
+
+/** @This is the number of size classes of @ref umem_prof_stats. */
+#define UMEM_PROF_SIZES 16
+/** @This is the upper bound (in octets) of the first size class. */
+#define UMEM_PROF_SIZE0 32
+
+/** @This holds the statistics of an accounting umem manager. */
+struct umem_prof_stats {
+    /** number of allocations */
+    uint64_t allocs;
+    /** number of reallocations */
+    uint64_t reallocs;
+    /** number of octets requested, including growing reallocations */
+    uint64_t bytes;
+    /** number of live buffers */
+    uint64_t live;
+    /** number of octets in live buffers */
+    uint64_t live_bytes;
+    /** maximum number of octets in live buffers */
+    uint64_t peak_bytes;
+    /** cumulated lifetime of all buffers, including the age of live buffers,
+     * in units of a 27 MHz clock (0 if no clock was given) */
+    uint64_t lifetime;
+    /** number of allocations by size class, the upper bound of the class n
+     * being UMEM_PROF_SIZE0 << n, and the last class having no bound */
+    uint64_t sizes[UMEM_PROF_SIZES];
+};
+
+/** @This allocates a new instance of the accounting umem manager.
+ *
+ * @param umem_mgr umem manager to which requests are forwarded
+ * @param uclock clock used to compute buffer lifetimes, or NULL
+ * @param mutex mutex protecting the statistics, or NULL if all buffers are
+ * allocated and released in the same thread
+ * @return pointer to manager, or NULL in case of error
+ */
+struct umem_mgr *umem_prof_mgr_alloc(struct umem_mgr *umem_mgr,
+                                     struct uclock *uclock,
+                                     struct umutex *mutex);
+
+/** @This retrieves the statistics of an accounting umem manager.
+ *
+ * @param mgr pointer to a manager allocated by @ref umem_prof_mgr_alloc
+ * @param stats filled in with the statistics
+ */
+void umem_prof_mgr_get_stats(struct umem_mgr *mgr,
+                             struct umem_prof_stats *stats);
+
+/** @This retrieves the statistics of an accounting umem manager, when the
+ * caller already holds the mutex given to @ref umem_prof_mgr_alloc.
+ *
+ * @param mgr pointer to a manager allocated by @ref umem_prof_mgr_alloc
+ * @param stats filled in with the statistics
+ */
+void umem_prof_mgr_get_stats_locked(struct umem_mgr *mgr,
+                                    struct umem_prof_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -39,6 +39,8 @@ extern "C" {
 #include <upipe/uprobe.h>
 #include <upipe/urequest.h>
 #include <upipe/udict_dump.h>
+#include <upipe/utrace.h>
+#include <upipe/upipe_prof.h>
 
 #include <stdint.h>
 #include <stdarg.h>
@@ -56,6 +58,8 @@ struct uref_mgr;
 /** @hidden */
 struct upump_mgr;
 /** @hidden */
+struct ujob_mgr;
+/** @hidden */
 struct ubuf_mgr;
 /** @hidden */
 struct upipe_mgr;
@@ -161,6 +165,13 @@ enum upipe_command {
      * in octets (uint64_t *, uint64_t *) */
     UPIPE_SRC_GET_RANGE,
 
+    /*
+     * Thread-related commands
+     */
+    /** switches the buffers held by the pipe to thread-safe reference
+     * counting, before the pipe is moved to another thread (void) */
+    UPIPE_UNCONFINE,
+
     /** non-standard commands implemented by a module type can start from
      * there (first arg = signature) */
     UPIPE_CONTROL_LOCAL = 0x8000
@@ -358,6 +369,7 @@ static inline const char *upipe_command_str(struct upipe *upipe, int cmd)
     UBASE_CASE_TO_STR(UPIPE_SRC_SET_POSITION);
     UBASE_CASE_TO_STR(UPIPE_SRC_GET_RANGE);
     UBASE_CASE_TO_STR(UPIPE_SRC_SET_RANGE);
+    UBASE_CASE_TO_STR(UPIPE_UNCONFINE);
     case UPIPE_CONTROL_LOCAL: break;
     }
     return NULL;
@@ -395,6 +407,8 @@ static inline struct upipe *upipe_alloc_va(struct upipe_mgr *mgr,
                                            struct uprobe *uprobe,
                                            uint32_t signature, va_list args)
 {
+    if (unlikely(upipe_prof_uprobe != NULL))
+        return upipe_prof_alloc_va(mgr, uprobe, signature, args);
     return mgr->upipe_alloc(mgr, uprobe, signature, args);
 }
 
@@ -462,7 +476,9 @@ static inline struct upipe *upipe_use(struct upipe *upipe)
  */
 static inline void upipe_release(struct upipe *upipe)
 {
-    if (upipe != NULL)
+    if (unlikely(upipe_prof_uprobe != NULL))
+        upipe_prof_release(upipe);
+    else if (upipe != NULL)
         urefcount_release(upipe->refcount);
 }
 
@@ -887,6 +903,24 @@ static inline int upipe_throw_need_upump_mgr(struct upipe *upipe,
     return err;
 }
 
+/** @This throws an event asking for a ujob manager. Note that all parameters
+ * belong to the caller, so there is no need to @ref ujob_mgr_use the given
+ * manager.
+ *
+ * @param upipe description structure of the pipe
+ * @param ujob_mgr_p filled in with a pointer to the ujob manager
+ * @return an error code
+ */
+static inline int upipe_throw_need_ujob_mgr(struct upipe *upipe,
+        struct ujob_mgr **ujob_mgr_p)
+{
+    upipe_dbg(upipe, "throw need ujob mgr");
+    int err = upipe_throw(upipe, UPROBE_NEED_UJOB_MGR, ujob_mgr_p);
+    if (ubase_check(err))
+        upipe_dbg_va(upipe, "got ujob_mgr %p", *ujob_mgr_p);
+    return err;
+}
+
 /** @This throws an event asking to freeze the upump manager of the current
  * thread. This allows to prepare pipes that will be deported later.
  * @see upipe_throw_thaw_upump_mgr
@@ -1056,8 +1090,10 @@ static inline void upipe_input(struct upipe *upipe, struct uref *uref,
         uref_free(uref);
         return;
     }
+    uint64_t trace_id = utrace_input_enter(upipe, uref);
     upipe_use(upipe);
     upipe->mgr->upipe_input(upipe, uref, upump_p);
+    utrace_input_exit(upipe, trace_id);
     upipe_release(upipe);
 }
 
@@ -1082,7 +1118,10 @@ static inline int upipe_control_nodbg_va(struct upipe *upipe,
 
     int err;
     upipe_use(upipe);
-    err = upipe->mgr->upipe_control(upipe, command, args);
+    if (unlikely(upipe_prof_uprobe != NULL))
+        err = upipe_prof_control_va(upipe, command, args);
+    else
+        err = upipe->mgr->upipe_control(upipe, command, args);
     upipe_release(upipe);
     return err;
 }
@@ -1311,6 +1350,19 @@ static inline int upipe_flush(struct upipe *upipe)
     return upipe_control(upipe, UPIPE_FLUSH);
 }
 
+/** @This switches the buffers held by a pipe to thread-safe reference
+ * counting (see @ref ubuf_unconfine), before the pipe is moved to another
+ * thread. Pipes which do not hold buffers do not handle it.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static inline int upipe_unconfine(struct upipe *upipe)
+{
+    int err = upipe_control(upipe, UPIPE_UNCONFINE);
+    return err == UBASE_ERR_UNHANDLED ? UBASE_ERR_NONE : err;
+}
+
 /** @This ends the preroll period in a pipe.
  *
  * @param upipe description structure of the pipe
@@ -1455,7 +1507,7 @@ static inline int upipe_src_get_size(struct upipe *upipe, uint64_t *size_p)
  * @return an error code
  */
 static inline int upipe_src_get_position(struct upipe *upipe,
-                                         uint64_t position_p)
+                                         uint64_t *position_p)
 {
     return upipe_control(upipe, UPIPE_SRC_GET_POSITION, position_p);
 }
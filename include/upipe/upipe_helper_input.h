@@ -276,6 +276,20 @@ static UBASE_UNUSED bool STRUCTURE##_output_input(struct upipe *upipe)      \
     }                                                                       \
     return true;                                                            \
 }                                                                           \
+/** @internal @This switches the held urefs to thread-safe reference       \
+ * counting, before the pipe is moved to another thread.                    \
+ *                                                                          \
+ * @param upipe description structure of the pipe                           \
+ * @return an error code                                                    \
+ */                                                                         \
+static UBASE_UNUSED int STRUCTURE##_unconfine_input(struct upipe *upipe)    \
+{                                                                           \
+    struct STRUCTURE *s = STRUCTURE##_from_upipe(upipe);                    \
+    struct uchain *uchain;                                                  \
+    ulist_foreach (&s->UREFS, uchain)                                       \
+        UBASE_RETURN(uref_unconfine(uref_from_uchain(uchain)))              \
+    return UBASE_ERR_NONE;                                                  \
+}                                                                           \
 /** @internal @This gets the current max length of the internal queue.      \
  *                                                                          \
  * @param upipe description structure of the pipe                           \
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe helper functions for ujob manager
+ */
+
+#ifndef _UPIPE_UPIPE_HELPER_UJOB_MGR_H_
+/** @hidden */
+#define _UPIPE_UPIPE_HELPER_UJOB_MGR_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/ubase.h>
+#include <upipe/ujob.h>
+#include <upipe/upipe.h>
+
+#include <stdbool.h>
+
+/** @This declares four functions dealing with the ujob manager, which
+ * allows a pipe to process a picture in bands of lines on several threads.
+ * If no ujob manager is provided, bands are processed sequentially.
+ *
+ * You must add one pointer to your private upipe structure, for instance:
+ * @code
+ *  struct ujob_mgr *ujob_mgr;
+ * @end code
+ *
+ * You must also declare @ref #UPIPE_HELPER_UPIPE prior to using this macro.
+ *
+ * Supposing the name of your structure is upipe_foo, it declares:
+ * @list
+ * @item @code
+ *  void upipe_foo_init_ujob_mgr(struct upipe *upipe)
+ * @end code
+ * Typically called in your upipe_foo_alloc() function.
+ *
+ * @item @code
+ *  int upipe_foo_check_ujob_mgr(struct upipe *upipe)
+ * @end code
+ * Checks if the ujob manager is available, and asks for it otherwise.
+ * Typically called when a new flow definition is received, so that the
+ * event is not thrown for every picture.
+ *
+ * @item @code
+ *  int upipe_foo_run_bands(struct upipe *upipe, size_t lines, size_t align,
+ *                          ujob_band_cb cb, void *opaque)
+ * @end code
+ * Calls cb for bands of lines covering the picture, and waits for all of
+ * them to complete.
+ *
+ * @item @code
+ *  void upipe_foo_clean_ujob_mgr(struct upipe *upipe)
+ * @end code
+ * Typically called from your upipe_foo_free() function.
+ * @end list
+ *
+ * @param STRUCTURE name of your private upipe structure
+ * @param UJOB_MGR name of the @tt {struct ujob_mgr *} field of
+ * your private upipe structure
+ */
+#define UPIPE_HELPER_UJOB_MGR(STRUCTURE, UJOB_MGR)                          \
+/** @internal @This initializes the private members for this helper.        \
+ *                                                                          \
+ * @param upipe description structure of the pipe                           \
+ */                                                                         \
+static void STRUCTURE##_init_ujob_mgr(struct upipe *upipe)                  \
+{                                                                           \
+    struct STRUCTURE *s = STRUCTURE##_from_upipe(upipe);                    \
+    s->UJOB_MGR = NULL;                                                     \
+}                                                                           \
+/** @internal @This checks if the ujob manager is available, and asks       \
+ * for it otherwise.                                                        \
+ *                                                                          \
+ * @param upipe description structure of the pipe                           \
+ * @return an error code                                                    \
+ */                                                                         \
+static UBASE_UNUSED int STRUCTURE##_check_ujob_mgr(struct upipe *upipe)     \
+{                                                                           \
+    struct STRUCTURE *s = STRUCTURE##_from_upipe(upipe);                    \
+    if (unlikely(s->UJOB_MGR == NULL))                                      \
+        return upipe_throw_need_ujob_mgr(upipe, &s->UJOB_MGR);              \
+    return UBASE_ERR_NONE;                                                  \
+}                                                                           \
+/** @internal @This processes a picture in bands of lines, and waits for    \
+ * their completion.                                                        \
+ *                                                                          \
+ * @param upipe description structure of the pipe                           \
+ * @param lines total number of lines                                       \
+ * @param align alignment of the first line of each band                    \
+ * @param cb function to call for each band                                 \
+ * @param opaque opaque passed to the function                              \
+ * @return an error code                                                    \
+ */                                                                         \
+static UBASE_UNUSED int STRUCTURE##_run_bands(struct upipe *upipe,          \
+                                              size_t lines, size_t align,   \
+                                              ujob_band_cb cb,              \
+                                              void *opaque)                 \
+{                                                                           \
+    struct STRUCTURE *s = STRUCTURE##_from_upipe(upipe);                    \
+    return ujob_mgr_run_bands(s->UJOB_MGR, lines, align, cb, opaque);       \
+}                                                                           \
+/** @internal @This cleans up the private members for this helper.          \
+ *                                                                          \
+ * @param upipe description structure of the pipe                           \
+ */                                                                         \
+static void STRUCTURE##_clean_ujob_mgr(struct upipe *upipe)                 \
+{                                                                           \
+    struct STRUCTURE *s = STRUCTURE##_from_upipe(upipe);                    \
+    ujob_mgr_release(s->UJOB_MGR);                                          \
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
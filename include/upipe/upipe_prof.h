@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe hooks timing the allocation, control commands and release of
+ * pipes
+ *
+ * The hooks are enabled by @ref uprobe_prof_set_pipes, and only cost a test
+ * otherwise.
+ */
+
+#ifndef _UPIPE_UPIPE_PROF_H_
+/** @hidden */
+#define _UPIPE_UPIPE_PROF_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/ubase.h>
+
+#include <stdint.h>
+#include <stdarg.h>
+
+/** @hidden */
+struct upipe;
+/** @hidden */
+struct upipe_mgr;
+/** @hidden */
+struct uprobe;
+
+/** @internal @This is the profiling probe accounting the cost of pipes, or
+ * NULL if disabled. */
+extern struct uprobe *upipe_prof_uprobe;
+
+/** @internal @This allocates a pipe and accounts the time spent.
+ *
+ * @param mgr management structure for this pipe type
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to allocated pipe, or NULL in case of failure
+ */
+struct upipe *upipe_prof_alloc_va(struct upipe_mgr *mgr,
+                                  struct uprobe *uprobe,
+                                  uint32_t signature, va_list args);
+
+/** @internal @This sends a control command to a pipe and accounts the time
+ * spent.
+ *
+ * @param upipe description structure of the pipe
+ * @param command control command to send
+ * @param args optional read or write parameters
+ * @return an error code
+ */
+int upipe_prof_control_va(struct upipe *upipe, int command, va_list args);
+
+/** @internal @This releases a pipe and accounts the time spent if it is
+ * freed.
+ *
+ * @param upipe description structure of the pipe
+ */
+void upipe_prof_release(struct upipe *upipe);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
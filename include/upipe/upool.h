@@ -141,6 +141,23 @@ static inline void upool_free(struct upool *upool, void *obj)
     upool_release(upool);
 }
 
+/** @This fills the pool up to its configured depth, so that the first
+ * allocations do not hit the system allocator. Like freed elements, parked
+ * elements do not hold a reference to the pool.
+ *
+ * @param upool pointer to upool
+ */
+static inline void upool_prealloc(struct upool *upool)
+{
+    void *obj;
+    while ((obj = upool->alloc_cb(upool)) != NULL) {
+        if (unlikely(!ulifo_push(&upool->lifo, obj))) {
+            upool->free_cb(upool, obj);
+            break;
+        }
+    }
+}
+
 /** @This empties a upool.
  *
  * @param upool pointer to a upool structure
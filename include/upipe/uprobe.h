@@ -107,6 +107,9 @@ enum uprobe_event {
     /** a pipe signals that a uref contains a UTC clock reference
      * (struct uref *, uint64_t) */
     UPROBE_CLOCK_UTC,
+    /** a ujob manager may be used to process in parallel
+     * (struct ujob_mgr **) */
+    UPROBE_NEED_UJOB_MGR,
 
     /** non-standard events implemented by a module type can start from
      * there (first arg = signature) */
@@ -142,6 +145,7 @@ static inline const char *uprobe_event_str(int event)
     case UPROBE_CLOCK_REF: return "UPROBE_CLOCK_REF";
     case UPROBE_CLOCK_TS: return "UPROBE_CLOCK_TS";
     case UPROBE_CLOCK_UTC: return "UPROBE_CLOCK_UTC";
+    case UPROBE_NEED_UJOB_MGR: return "UPROBE_NEED_UJOB_MGR";
     case UPROBE_LOCAL: break;
     }
     return NULL;
@@ -150,6 +154,20 @@ static inline const char *uprobe_event_str(int event)
 /** @This is the call-back type for uprobe events. */
 typedef int (*uprobe_throw_func)(struct uprobe *, struct upipe *, int, va_list);
 
+/** @This is the mask of all events. */
+#define UPROBE_EVENTS_ALL UINT64_MAX
+
+/** @This returns the bit of an event in a mask of events. Local events, and
+ * standard events above 62, share the last bit.
+ *
+ * @param event event
+ * @return mask with the bit of the event set
+ */
+static inline uint64_t uprobe_event_mask(int event)
+{
+    return UINT64_C(1) << (event >= 0 && event < 63 ? event : 63);
+}
+
 /** @This is a structure passed to a module upon initializing a new pipe. */
 struct uprobe {
     /** pointer to refcount management structure */
@@ -159,6 +177,9 @@ struct uprobe {
     uprobe_throw_func uprobe_throw;
     /** pointer to next probe, to be used by the uprobe_throw function */
     struct uprobe *next;
+    /** mask of events handled by uprobe_throw; other events are directly
+     * passed to the next interested probe */
+    uint64_t events;
 };
 
 /** @This increments the reference count of a uprobe.
@@ -225,6 +246,22 @@ static inline void uprobe_init(struct uprobe *uprobe,
     uprobe->refcount = NULL;
     uprobe->uprobe_throw = uprobe_throw;
     uprobe->next = next;
+    uprobe->events = UPROBE_EVENTS_ALL;
+}
+
+/** @This declares the events handled by a probe. The function throwing
+ * events of the probe will no longer be called for other events, which go
+ * straight to the next probe. The mask must therefore cover every event
+ * caught by that function. Probes typically list their events next to
+ * the function with @ref #UPROBE_HELPER_EVENTS, which computes the mask.
+ *
+ * @param uprobe pointer to probe
+ * @param events mask of handled events, built with @ref uprobe_event_mask
+ */
+static inline void uprobe_set_events(struct uprobe *uprobe, uint64_t events)
+{
+    assert(uprobe != NULL);
+    uprobe->events = events;
 }
 
 /** @This cleans up a uprobe structure. It is typically called by the
@@ -260,6 +297,9 @@ struct uprobe *uprobe_alloc(uprobe_throw_func func, struct uprobe *next);
 static inline int uprobe_throw_va(struct uprobe *uprobe, struct upipe *upipe,
                                   int event, va_list args)
 {
+    uint64_t mask = uprobe_event_mask(event);
+    while (uprobe != NULL && !(uprobe->events & mask))
+        uprobe = uprobe->next;
     if (unlikely(uprobe == NULL))
         return UBASE_ERR_UNHANDLED;
     return uprobe->uprobe_throw(uprobe, upipe, event, args);
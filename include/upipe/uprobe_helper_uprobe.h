@@ -84,6 +84,41 @@ static UBASE_UNUSED inline struct STRUCTURE *                               \
     return uprobe ? container_of(uprobe, struct STRUCTURE, UPROBE) : NULL;  \
 }
 
+/** @This declares a function setting the mask of the events handled by
+ * the function throwing events of the probe, from the list of these events.
+ *
+ * Supposing the name of your structure is uprobe_foo, and the probe only
+ * catches log events, you would write:
+ * @code
+ *  UPROBE_HELPER_EVENTS(uprobe_foo, UPROBE_LOG)
+ * @end code
+ * next to the function throwing events, which declares:
+ * @list
+ * @item @code
+ *  void uprobe_foo_init_events(struct uprobe *uprobe)
+ * @end code
+ * Typically called from your uprobe_foo_init() function, after
+ * @ref uprobe_init.
+ * @end list
+ *
+ * @param STRUCTURE name of your private uprobe structure
+ * @param ... events handled by the probe
+ */
+#define UPROBE_HELPER_EVENTS(STRUCTURE, ...)                                \
+/** @internal @This declares the events handled by the probe.               \
+ *                                                                          \
+ * @param uprobe public description structure of the probe                  \
+ */                                                                         \
+static UBASE_UNUSED inline void                                             \
+    STRUCTURE##_init_events(struct uprobe *uprobe)                          \
+{                                                                           \
+    static const int events[] = { __VA_ARGS__ };                            \
+    uint64_t mask = 0;                                                      \
+    for (unsigned int i = 0; i < UBASE_ARRAY_SIZE(events); i++)             \
+        mask |= uprobe_event_mask(events[i]);                               \
+    uprobe_set_events(uprobe, mask);                                        \
+}
+
 #ifdef __cplusplus
 }
 #endif
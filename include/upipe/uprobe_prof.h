@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short probe attributing the time spent in the probe hierarchy to pipe
+ * types and events, to profile the construction and teardown of pipelines
+ *
+ * The probe may also account the time spent in the allocation, control
+ * commands and release of pipes by type (see @ref uprobe_prof_set_pipes),
+ * to find out which pipes are costly to set up.
+ */
+
+#ifndef _UPIPE_UPROBE_PROF_H_
+/** @hidden */
+#define _UPIPE_UPROBE_PROF_H_
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_helper_uprobe.h>
+#include <upipe/ulist.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @hidden */
+struct uclock;
+
+/** @This is a super-set of the uprobe structure with additional local
+ * members. */
+struct uprobe_prof {
+    /** pointer to uclock used to timestamp events */
+    struct uclock *uclock;
+    /** list of counters */
+    struct uchain counters;
+    /** time spent in events thrown while processing the current event */
+    uint64_t nested;
+
+    /** structure exported to modules */
+    struct uprobe uprobe;
+};
+
+UPROBE_HELPER_UPROBE(uprobe_prof, uprobe)
+
+/** @This initializes an already allocated uprobe_prof structure.
+ *
+ * Please note that this probe is not thread-safe, and must only be used by
+ * pipes running in the same thread.
+ *
+ * @param uprobe_prof pointer to the already allocated structure
+ * @param next next probe to test if this one doesn't catch the event
+ * @param uclock clock used to timestamp events
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_prof_init(struct uprobe_prof *uprobe_prof,
+                                struct uprobe *next, struct uclock *uclock);
+
+/** @This cleans a uprobe_prof structure.
+ *
+ * @param uprobe_prof structure to clean
+ */
+void uprobe_prof_clean(struct uprobe_prof *uprobe_prof);
+
+/** @This allocates a new uprobe_prof structure.
+ *
+ * @param next next probe to test if this one doesn't catch the event
+ * @param uclock clock used to timestamp events
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_prof_alloc(struct uprobe *next, struct uclock *uclock);
+
+/** @This logs the accumulated counters, by pipe type and event, with the
+ * notice level.
+ *
+ * @param uprobe pointer to probe
+ */
+void uprobe_prof_report(struct uprobe *uprobe);
+
+/** @This resets the accumulated counters.
+ *
+ * @param uprobe pointer to probe
+ */
+void uprobe_prof_reset(struct uprobe *uprobe);
+
+/** @This enables or disables the accounting of the allocation, control
+ * commands and release of all pipes, whatever their probe, by this probe.
+ * Time spent in nested operations, such as events thrown to this probe or
+ * inner pipes, is excluded from the enclosing operation.
+ *
+ * Only one probe may account pipes at a time, and as the probe is not
+ * thread-safe, this must only be enabled when all pipes run in the thread
+ * of the probe.
+ *
+ * @param uprobe pointer to probe
+ * @param enable true to enable the accounting
+ * @return an error code
+ */
+int uprobe_prof_set_pipes(struct uprobe *uprobe, bool enable);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
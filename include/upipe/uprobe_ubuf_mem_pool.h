@@ -54,6 +54,8 @@ struct uprobe_ubuf_mem_pool {
 
     /** chained list of ubuf managers, elements are never removed */
     uatomic_ptr_t first;
+    /** last element that satisfied a request, checked first */
+    uatomic_ptr_t last;
 
     /** structure exported to modules */
     struct uprobe uprobe;
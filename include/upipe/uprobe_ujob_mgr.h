@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short probe catching need_ujob_mgr events and providing a given ujob
+ * manager
+ */
+
+#ifndef _UPIPE_UPROBE_UJOB_MGR_H_
+/** @hidden */
+#define _UPIPE_UPROBE_UJOB_MGR_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_helper_uprobe.h>
+
+/** @hidden */
+struct ujob_mgr;
+
+/** @This is a super-set of the uprobe structure with additional local
+ * members. */
+struct uprobe_ujob_mgr {
+    /** pointer to ujob_mgr to provide */
+    struct ujob_mgr *ujob_mgr;
+
+    /** structure exported to modules */
+    struct uprobe uprobe;
+};
+
+UPROBE_HELPER_UPROBE(uprobe_ujob_mgr, uprobe);
+
+/** @This initializes an already allocated uprobe_ujob_mgr structure.
+ *
+ * @param uprobe_ujob_mgr pointer to the already allocated structure
+ * @param next next probe to test if this one doesn't catch the event
+ * @param ujob_mgr ujob manager to provide to pipes
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_ujob_mgr_init(struct uprobe_ujob_mgr *uprobe_ujob_mgr,
+                                    struct uprobe *next,
+                                    struct ujob_mgr *ujob_mgr);
+
+/** @This cleans a uprobe_ujob_mgr structure.
+ *
+ * @param uprobe_ujob_mgr structure to clean
+ */
+void uprobe_ujob_mgr_clean(struct uprobe_ujob_mgr *uprobe_ujob_mgr);
+
+/** @This allocates a new uprobe_ujob_mgr structure.
+ *
+ * @param next next probe to test if this one doesn't catch the event
+ * @param ujob_mgr ujob manager to provide to pipes
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_ujob_mgr_alloc(struct uprobe *next,
+                                     struct ujob_mgr *ujob_mgr);
+
+/** @This changes the ujob_mgr set by this probe.
+ *
+ * @param uprobe pointer to probe
+ * @param ujob_mgr new ujob manager to provide to pipes
+ */
+void uprobe_ujob_mgr_set(struct uprobe *uprobe, struct ujob_mgr *ujob_mgr);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short probe catching provide_request events asking for a ubuf manager,
+ * and attributing the buffer allocations to the requesting pipes
+ */
+
+#ifndef _UPIPE_UPROBE_UMEM_PROF_H_
+/** @hidden */
+#define _UPIPE_UPROBE_UMEM_PROF_H_
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_helper_uprobe.h>
+#include <upipe/ulist.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @hidden */
+struct umem_mgr;
+/** @hidden */
+struct umem_stats;
+/** @hidden */
+struct uclock;
+/** @hidden */
+struct umutex;
+/** @hidden */
+struct upump_mgr;
+/** @hidden */
+struct upump;
+
+/** @This is a super-set of the uprobe structure with additional local
+ * members. */
+struct uprobe_umem_prof {
+    /** pointer to umem_mgr to use to allocate buffers */
+    struct umem_mgr *umem_mgr;
+    /** depth of the ubuf pool */
+    uint16_t ubuf_pool_depth;
+    /** depth of the shared object pool */
+    uint16_t shared_pool_depth;
+    /** pointer to uclock used to compute buffer lifetimes, or NULL */
+    struct uclock *uclock;
+    /** mutex protecting the statistics and the accounts, or NULL */
+    struct umutex *mutex;
+
+    /** list of accounts, one per requesting pipe */
+    struct uchain accounts;
+    /** pool statistics at the time of the last report */
+    struct umem_stats *pools;
+    /** number of elements in pools */
+    unsigned int nb_pools;
+    /** timer triggering periodic reports, or NULL */
+    struct upump *upump;
+
+    /** structure exported to modules */
+    struct uprobe uprobe;
+};
+
+UPROBE_HELPER_UPROBE(uprobe_umem_prof, uprobe)
+
+/** @This initializes an already allocated uprobe_umem_prof structure.
+ *
+ * Please note that this probe is not thread-safe by itself. If pipes run,
+ * or buffers are allocated or released, in other threads, a mutex must be
+ * given to protect the statistics and the accounts.
+ *
+ * Accounts of dead pipes are kept until all their buffers are released, and
+ * reported a last time.
+ *
+ * @param uprobe_umem_prof pointer to the already allocated structure
+ * @param next next probe to test if this one doesn't catch the event
+ * @param umem_mgr memory allocator to use for buffers
+ * @param ubuf_pool_depth maximum number of ubuf structures in the pool
+ * @param shared_pool_depth maximum number of shared structures in the pool
+ * @param uclock clock used to compute buffer lifetimes, or NULL
+ * @param mutex mutex protecting the statistics, or NULL
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_umem_prof_init(struct uprobe_umem_prof *uprobe_umem_prof,
+                                     struct uprobe *next,
+                                     struct umem_mgr *umem_mgr,
+                                     uint16_t ubuf_pool_depth,
+                                     uint16_t shared_pool_depth,
+                                     struct uclock *uclock,
+                                     struct umutex *mutex);
+
+/** @This cleans a uprobe_umem_prof structure.
+ *
+ * @param uprobe_umem_prof structure to clean
+ */
+void uprobe_umem_prof_clean(struct uprobe_umem_prof *uprobe_umem_prof);
+
+/** @This allocates a new uprobe_umem_prof structure.
+ *
+ * @param next next probe to test if this one doesn't catch the event
+ * @param umem_mgr memory allocator to use for buffers
+ * @param ubuf_pool_depth maximum number of ubuf structures in the pool
+ * @param shared_pool_depth maximum number of shared structures in the pool
+ * @param uclock clock used to compute buffer lifetimes, or NULL
+ * @param mutex mutex protecting the statistics, or NULL
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_umem_prof_alloc(struct uprobe *next,
+                                      struct umem_mgr *umem_mgr,
+                                      uint16_t ubuf_pool_depth,
+                                      uint16_t shared_pool_depth,
+                                      struct uclock *uclock,
+                                      struct umutex *mutex);
+
+/** @This logs the allocations attributed to each pipe, and the hit ratio of
+ * each pool of the memory allocator since the last report, with the notice
+ * level.
+ *
+ * @param uprobe pointer to probe
+ */
+void uprobe_umem_prof_report(struct uprobe *uprobe);
+
+/** @This starts logging a report periodically.
+ *
+ * @param uprobe pointer to probe
+ * @param upump_mgr pump manager of the thread of the probe, or NULL to stop
+ * the periodic reports
+ * @param period period of the reports, in units of a 27 MHz clock
+ * @return an error code
+ */
+int uprobe_umem_prof_set_period(struct uprobe *uprobe,
+                                struct upump_mgr *upump_mgr, uint64_t period);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
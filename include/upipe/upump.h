@@ -92,12 +92,27 @@ enum upump_command {
     UPUMP_FREE_BLOCKER,
     /** restarts the pump (void) */
     UPUMP_RESTART,
+    /** gets the pump priority (int *) */
+    UPUMP_GET_PRIORITY,
+    /** sets the pump priority (int) */
+    UPUMP_SET_PRIORITY,
 
     /** non-standard commands implemented by a upump handler can start
      * from there (first arg = signature) */
     UPUMP_CONTROL_LOCAL = 0x8000
 };
 
+/** @This defines the priority classes of pumps. */
+enum upump_priority {
+    /** bulk work which may be postponed */
+    UPUMP_PRIORITY_LOW = -1,
+    /** default priority */
+    UPUMP_PRIORITY_NORMAL = 0,
+    /** timing-sensitive work, such as output pacing; when such a timer is
+     * overdue, the pumps of lower classes are postponed */
+    UPUMP_PRIORITY_HIGH = 1
+};
+
 /** function called when a pump is triggered */
 typedef void (*upump_cb)(struct upump *);
 
@@ -396,6 +411,30 @@ static inline void upump_set_status(struct upump *upump, bool status)
     upump_control(upump, UPUMP_SET_STATUS, i);
 }
 
+/** @This gets the priority class of a pump.
+ *
+ * @param upump description structure of the pump
+ * @param priority_p filled in with the priority (@ref upump_priority)
+ * @return an error code
+ */
+static inline int upump_get_priority(struct upump *upump, int *priority_p)
+{
+    return upump_control(upump, UPUMP_GET_PRIORITY, priority_p);
+}
+
+/** @This sets the priority class of a pump. Pumps of higher classes are
+ * dispatched first when several pumps are ready at the same time.
+ *
+ * @param upump description structure of the pump
+ * @param priority priority (@ref upump_priority)
+ * @return an error code, including @ref UBASE_ERR_UNHANDLED if the manager
+ * does not order pumps
+ */
+static inline int upump_set_priority(struct upump *upump, int priority)
+{
+    return upump_control(upump, UPUMP_SET_PRIORITY, priority);
+}
+
 /** @This gets the opaque structure with a cast.
  *
  * @param upump description structure of the pump
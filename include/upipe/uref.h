@@ -86,6 +86,10 @@ static inline const char *uref_date_type_str(int dt)
 #define UREF_FLAG_BLOCK_END 0x10
 /** the block contains a clock reference */
 #define UREF_FLAG_CLOCK_REF 0x20
+/** the uref is traced (see @ref uref_trace.h) */
+#define UREF_FLAG_TRACE 0x40
+/** the trace sampling decision was taken for the uref */
+#define UREF_FLAG_TRACE_SEEN 0x80
 
 /** position of the bitfield for the type of sys date */
 #define UREF_FLAG_DATE_SYS 0x0400000000000000
@@ -137,6 +141,8 @@ UBASE_FROM_TO(uref, uchain, uchain, uchain)
 enum uref_mgr_command {
     /** release all buffers kept in pools (void) */
     UREF_MGR_VACUUM,
+    /** fill pools up to their configured depth (void) */
+    UREF_MGR_PREALLOC,
 
     /** non-standard manager commands implemented by a module type can start
      * from there (first arg = signature) */
@@ -336,6 +342,19 @@ static inline struct ubuf *uref_detach_ubuf(struct uref *uref)
     return ubuf;
 }
 
+/** @This switches the ubuf attached to a uref to thread-safe reference
+ * counting, before the uref is handed over to another thread.
+ *
+ * @param uref pointer to uref structure
+ * @return an error code
+ */
+static inline int uref_unconfine(struct uref *uref)
+{
+    if (uref->ubuf == NULL)
+        return UBASE_ERR_NONE;
+    return ubuf_unconfine(uref->ubuf);
+}
+
 /** @This duplicates a uref and attaches a new ubuf to the copy.
  *
  * @param uref source structure to duplicate
@@ -421,6 +440,18 @@ static inline int uref_mgr_vacuum(struct uref_mgr *mgr)
     return uref_mgr_control(mgr, UREF_MGR_VACUUM);
 }
 
+/** @This instructs an existing uref manager to fill its pools up to their
+ * configured depth, so that the first allocations do not hit the system
+ * allocator (typically before entering a real-time section).
+ *
+ * @param mgr pointer to uref manager
+ * @return an error code
+ */
+static inline int uref_mgr_prealloc(struct uref_mgr *mgr)
+{
+    return uref_mgr_control(mgr, UREF_MGR_PREALLOC);
+}
+
 #ifdef __cplusplus
 }
 #endif
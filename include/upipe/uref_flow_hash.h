@@ -0,0 +1,320 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe hashed representation of flow definition strings
+ * A flow definition such as "block.mpeg2video.pic." is split once into its
+ * dot-separated components, and the hash of each component and of each
+ * prefix is kept. Prefix and component lookups are then integer
+ * comparisons, confirmed by a single string comparison on a hit.
+ *
+ * The hashes may be cached in the flow definition packet itself, so that
+ * they are computed once by the first pipe or probe that owns the packet,
+ * and are then carried by @ref uref_dup to the pipes downstream. The cache
+ * records the flow definition string it was computed from, and is ignored
+ * once the definition is changed.
+ */
+
+#ifndef _UPIPE_UREF_FLOW_HASH_H_
+/** @hidden */
+#define _UPIPE_UREF_FLOW_HASH_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/ubase.h>
+#include <upipe/uref.h>
+#include <upipe/uref_attr.h>
+#include <upipe/uref_flow.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/** maximum number of hashed components of a flow definition; deeper
+ * components are compared as strings */
+#define UREF_FLOW_HASH_DEPTH 8
+
+/** @This is the hashed representation of a flow definition string. */
+struct uref_flow_hash {
+    /** flow definition string (not copied) */
+    const char *def;
+    /** number of hashed components */
+    uint8_t depth;
+    /** hash of the prefix ending with each component, including dots */
+    uint64_t prefix[UREF_FLOW_HASH_DEPTH];
+    /** hash of each component, without dot */
+    uint64_t component[UREF_FLOW_HASH_DEPTH];
+    /** offset of the end of each component, including its dot */
+    uint16_t end[UREF_FLOW_HASH_DEPTH];
+};
+
+/** @This is a pre-hashed prefix ("block.h264.") or component ("pic") to
+ * look up in flow definitions. */
+struct uref_flow_hash_key {
+    /** key string (not copied) */
+    const char *str;
+    /** length of the key string */
+    size_t len;
+    /** number of components of the prefix */
+    uint8_t depth;
+    /** hash of the key string */
+    uint64_t hash;
+};
+
+/** @internal size of the cached hashes, followed in the attribute by the
+ * flow definition string they were computed from */
+#define UREF_FLOW_HASH_CACHE_SIZE                                           \
+    (sizeof(uint64_t) * UREF_FLOW_HASH_DEPTH * 2 +                          \
+     sizeof(uint16_t) * UREF_FLOW_HASH_DEPTH + 1)
+
+UREF_ATTR_OPAQUE(flow, hash, "f.hash", cached flow definition hashes)
+
+/** FNV-1a offset basis */
+#define UREF_FLOW_HASH_INIT UINT64_C(0xcbf29ce484222325)
+
+/** @internal @This adds a character to a FNV-1a hash.
+ *
+ * @param hash current hash
+ * @param c character
+ * @return new hash
+ */
+static inline uint64_t uref_flow_hash_char(uint64_t hash, char c)
+{
+    return (hash ^ (uint8_t)c) * UINT64_C(0x100000001b3);
+}
+
+/** @This hashes a flow definition string.
+ *
+ * @param hash pointer to the hashed representation
+ * @param def flow definition string, which must outlive the representation
+ */
+static inline void uref_flow_hash_init(struct uref_flow_hash *hash,
+                                       const char *def)
+{
+    uint64_t prefix = UREF_FLOW_HASH_INIT;
+    uint64_t component = UREF_FLOW_HASH_INIT;
+    hash->def = def;
+    hash->depth = 0;
+    for (const char *c = def; *c && hash->depth < UREF_FLOW_HASH_DEPTH &&
+                              c - def < UINT16_MAX; c++) {
+        prefix = uref_flow_hash_char(prefix, *c);
+        if (*c != '.') {
+            component = uref_flow_hash_char(component, *c);
+            continue;
+        }
+        hash->prefix[hash->depth] = prefix;
+        hash->component[hash->depth] = component;
+        hash->end[hash->depth] = c + 1 - def;
+        hash->depth++;
+        component = UREF_FLOW_HASH_INIT;
+    }
+}
+
+/** @internal @This loads cached hashes.
+ *
+ * @param hash pointer to the hashed representation
+ * @param def flow definition string
+ * @param cache cached hashes
+ */
+static inline void uref_flow_hash_load(struct uref_flow_hash *hash,
+                                       const char *def, const uint8_t *cache)
+{
+    hash->def = def;
+    memcpy(hash->prefix, cache, sizeof(hash->prefix));
+    cache += sizeof(hash->prefix);
+    memcpy(hash->component, cache, sizeof(hash->component));
+    cache += sizeof(hash->component);
+    memcpy(hash->end, cache, sizeof(hash->end));
+    cache += sizeof(hash->end);
+    hash->depth = *cache;
+}
+
+/** @internal @This saves hashes to be cached.
+ *
+ * @param hash pointer to the hashed representation
+ * @param cache filled in with the hashes, followed by the flow definition
+ * string
+ * @param len length of the flow definition string
+ */
+static inline void uref_flow_hash_save(const struct uref_flow_hash *hash,
+                                       uint8_t *cache, size_t len)
+{
+    memcpy(cache, hash->prefix, sizeof(hash->prefix));
+    cache += sizeof(hash->prefix);
+    memcpy(cache, hash->component, sizeof(hash->component));
+    cache += sizeof(hash->component);
+    memcpy(cache, hash->end, sizeof(hash->end));
+    cache += sizeof(hash->end);
+    *cache++ = hash->depth;
+    memcpy(cache, hash->def, len);
+}
+
+/** @internal @This returns the hashes cached in a uref, if they were
+ * computed from the given flow definition.
+ *
+ * @param flow_def flow definition packet
+ * @param def flow definition string of the packet
+ * @return pointer to the cached hashes, or NULL
+ */
+static inline const uint8_t *uref_flow_hash_cached(struct uref *flow_def,
+                                                   const char *def)
+{
+    const uint8_t *cache;
+    size_t size;
+    if (!ubase_check(uref_flow_get_hash(flow_def, &cache, &size)) ||
+        size != UREF_FLOW_HASH_CACHE_SIZE + strlen(def) ||
+        memcmp(cache + UREF_FLOW_HASH_CACHE_SIZE, def,
+               size - UREF_FLOW_HASH_CACHE_SIZE))
+        return NULL;
+    return cache;
+}
+
+/** @This hashes the flow definition of a uref, or loads the hashes cached
+ * in the uref if they were computed from the same flow definition.
+ *
+ * @param hash pointer to the hashed representation
+ * @param flow_def flow definition packet, which must outlive the
+ * representation
+ * @return an error code
+ */
+static inline int uref_flow_hash_init_uref(struct uref_flow_hash *hash,
+                                           struct uref *flow_def)
+{
+    const char *def;
+    UBASE_RETURN(uref_flow_get_def(flow_def, &def))
+    const uint8_t *cache = uref_flow_hash_cached(flow_def, def);
+    if (cache != NULL)
+        uref_flow_hash_load(hash, def, cache);
+    else
+        uref_flow_hash_init(hash, def);
+    return UBASE_ERR_NONE;
+}
+
+/** @This hashes the flow definition of a uref like
+ * @ref uref_flow_hash_init_uref, and caches the hashes in the uref for the
+ * next users. As the attributes of the uref may be moved, the uref must be
+ * owned by the caller, and previously retrieved attribute pointers must no
+ * longer be used.
+ *
+ * @param hash pointer to the hashed representation
+ * @param flow_def flow definition packet, which must outlive the
+ * representation
+ * @return an error code
+ */
+static inline int uref_flow_hash_cache_uref(struct uref_flow_hash *hash,
+                                            struct uref *flow_def)
+{
+    const char *def;
+    UBASE_RETURN(uref_flow_get_def(flow_def, &def))
+    const uint8_t *cache = uref_flow_hash_cached(flow_def, def);
+    if (cache != NULL) {
+        uref_flow_hash_load(hash, def, cache);
+        return UBASE_ERR_NONE;
+    }
+
+    uref_flow_hash_init(hash, def);
+    size_t len = strlen(def);
+    uint8_t buffer[UREF_FLOW_HASH_CACHE_SIZE + len];
+    uref_flow_hash_save(hash, buffer, len);
+    UBASE_RETURN(uref_flow_set_hash(flow_def, buffer, sizeof(buffer)))
+    /* the flow definition string may have moved */
+    return uref_flow_get_def(flow_def, &hash->def);
+}
+
+/** @This pre-hashes a key. A key ending with a dot is a prefix, otherwise
+ * it is a component.
+ *
+ * @param key pointer to the key
+ * @param str key string, which must outlive the key
+ */
+static inline void uref_flow_hash_key_init(struct uref_flow_hash_key *key,
+                                           const char *str)
+{
+    key->str = str;
+    key->len = strlen(str);
+    key->depth = 0;
+    key->hash = UREF_FLOW_HASH_INIT;
+    for (const char *c = str; *c; c++) {
+        key->hash = uref_flow_hash_char(key->hash, *c);
+        if (*c == '.')
+            key->depth++;
+    }
+}
+
+/** @This checks if a flow definition starts with a prefix.
+ *
+ * @param hash pointer to the hashed flow definition
+ * @param key pointer to a prefix key, ending with a dot
+ * @return true if the flow definition starts with the prefix
+ */
+static inline bool uref_flow_hash_match(const struct uref_flow_hash *hash,
+                                        const struct uref_flow_hash_key *key)
+{
+    if (unlikely(!key->depth))
+        return false;
+    if (unlikely(key->depth > UREF_FLOW_HASH_DEPTH))
+        return !ubase_ncmp(hash->def, key->str);
+    return key->depth <= hash->depth &&
+           hash->prefix[key->depth - 1] == key->hash &&
+           hash->end[key->depth - 1] == key->len &&
+           !memcmp(hash->def, key->str, key->len);
+}
+
+/** @This finds a component in a flow definition.
+ *
+ * @param hash pointer to the hashed flow definition
+ * @param key pointer to a component key, without dot
+ * @param from index of the first component to consider
+ * @return index of the first matching component, or -1
+ */
+static inline int uref_flow_hash_find(const struct uref_flow_hash *hash,
+                                      const struct uref_flow_hash_key *key,
+                                      int from)
+{
+    for (int i = from; i < hash->depth; i++) {
+        size_t start = i ? hash->end[i - 1] : 0;
+        if (hash->component[i] == key->hash &&
+            hash->end[i] - start - 1 == key->len &&
+            !memcmp(hash->def + start, key->str, key->len))
+            return i;
+    }
+    return -1;
+}
+
+/** @This checks if all the components of a flow definition were hashed.
+ *
+ * @param hash pointer to the hashed flow definition
+ * @return false if the flow definition is deeper than
+ * @ref UREF_FLOW_HASH_DEPTH, or has trailing characters after the last dot
+ */
+static inline bool uref_flow_hash_complete(const struct uref_flow_hash *hash)
+{
+    size_t end = hash->depth ? hash->end[hash->depth - 1] : 0;
+    return hash->def[end] == '\0';
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -58,6 +58,8 @@ UREF_ATTR_VOID_SH(pic, tff, UDICT_TYPE_PIC_TFF, top field first)
 UREF_ATTR_SMALL_UNSIGNED_SH(pic, afd, UDICT_TYPE_PIC_AFD, active format description)
 UREF_ATTR_OPAQUE_SH(pic, cea_708, UDICT_TYPE_PIC_CEA_708, cea-708 captions)
 UREF_ATTR_UNSIGNED(pic, original_height, "p.original_height", original picture height before chunking)
+UREF_ATTR_SMALL_UNSIGNED(pic, qp, "p.qp", average quantizer of the coded picture)
+UREF_ATTR_VOID(pic, discardable, "p.discardable", coded picture not used as reference)
 
 /** @This returns a new uref pointing to a new ubuf pointing to a picture.
  * This is equivalent to the two operations sequentially, and is a shortcut.
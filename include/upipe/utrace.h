@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe sampled tracing of urefs across pipes and threads
+ *
+ * When tracing is started, one uref in N entering @ref upipe_input is
+ * tagged with a trace ID (see @ref uref_trace.h), which is kept by
+ * @ref uref_dup. The entry into and exit from @ref upipe_input of tagged
+ * urefs, and their hops through queues, are timestamped into per-thread
+ * ring buffers without locking, and may be exported in the Chrome trace
+ * event format.
+ */
+
+#ifndef _UPIPE_UTRACE_H_
+/** @hidden */
+#define _UPIPE_UTRACE_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <upipe/ubase.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+/** @hidden */
+struct upipe;
+/** @hidden */
+struct uref;
+
+/** @This defines the types of trace events. */
+enum utrace_event {
+    /** a tagged uref enters a pipe */
+    UTRACE_INPUT_ENTER,
+    /** a tagged uref has been processed by a pipe */
+    UTRACE_INPUT_EXIT,
+    /** a tagged uref was pushed into a queue */
+    UTRACE_QUEUE_PUSH,
+    /** a tagged uref was popped from a queue */
+    UTRACE_QUEUE_POP
+};
+
+/** @internal @This is the sampling period of tracing, or 0 if tracing is
+ * disabled. */
+extern unsigned int utrace_sampling;
+
+/** @internal @This decides whether a uref entering a pipe is traced, and
+ * records the entry.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref entering the pipe
+ * @return trace ID, or 0 if the uref is not traced
+ */
+uint64_t utrace_input_sample(struct upipe *upipe, struct uref *uref);
+
+/** @internal @This returns the trace ID of a uref.
+ *
+ * @param uref uref structure
+ * @return trace ID, or 0 if the uref is not traced
+ */
+uint64_t utrace_uref_id(struct uref *uref);
+
+/** @internal @This records a trace event in the buffer of the current
+ * thread.
+ *
+ * @param upipe description structure of the pipe
+ * @param id trace ID
+ * @param event type of event
+ */
+void utrace_record(struct upipe *upipe, uint64_t id, enum utrace_event event);
+
+/** @This is called when a uref enters a pipe. When tracing is disabled, it
+ * only costs a test.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref entering the pipe
+ * @return trace ID, or 0 if the uref is not traced
+ */
+static inline uint64_t utrace_input_enter(struct upipe *upipe,
+                                          struct uref *uref)
+{
+    if (likely(!utrace_sampling))
+        return 0;
+    return utrace_input_sample(upipe, uref);
+}
+
+/** @This is called when a pipe has processed a uref.
+ *
+ * @param upipe description structure of the pipe
+ * @param id trace ID returned by @ref utrace_input_enter
+ */
+static inline void utrace_input_exit(struct upipe *upipe, uint64_t id)
+{
+    if (unlikely(id))
+        utrace_record(upipe, id, UTRACE_INPUT_EXIT);
+}
+
+/** @This returns the trace ID of a uref before it is handed over to
+ * another thread.
+ *
+ * @param uref uref structure
+ * @return trace ID, or 0 if the uref is not traced
+ */
+static inline uint64_t utrace_get_id(struct uref *uref)
+{
+    if (likely(!utrace_sampling))
+        return 0;
+    return utrace_uref_id(uref);
+}
+
+/** @This records the hop of a traced uref through a queue.
+ *
+ * @param upipe description structure of the pipe
+ * @param id trace ID returned by @ref utrace_get_id
+ * @param event @ref UTRACE_QUEUE_PUSH or @ref UTRACE_QUEUE_POP
+ */
+static inline void utrace_queue(struct upipe *upipe, uint64_t id,
+                                enum utrace_event event)
+{
+    if (unlikely(id))
+        utrace_record(upipe, id, event);
+}
+
+/** @This starts tracing. It should be called before the threads are
+ * started, as the change may be seen late by other threads.
+ *
+ * @param sampling one uref in sampling is traced (must not be 0)
+ * @param size number of events kept in the buffer of each thread, or 0 for
+ * the default
+ * @return an error code
+ */
+int utrace_start(unsigned int sampling, unsigned int size);
+
+/** @This stops tracing. Events already recorded are kept until
+ * @ref utrace_clean.
+ */
+void utrace_stop(void);
+
+/** @This writes the recorded events to a file in the Chrome trace event
+ * JSON format, which may also be opened by Perfetto. It may be called while
+ * tracing, in which case events overwritten during the export are dropped.
+ *
+ * @param file file to write to
+ * @return an error code
+ */
+int utrace_export(FILE *file);
+
+/** @This frees the buffers of all threads. It must only be called when no
+ * thread is tracing anymore.
+ */
+void utrace_clean(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -425,6 +425,7 @@ static bool upipe_alsink_open(struct upipe *upipe)
         upipe_err(upipe, "can't create timer");
         goto open_error;
     }
+    upump_set_priority(timer, UPUMP_PRIORITY_HIGH);
     upipe_alsink_set_upump(upipe, timer);
     upump_start(timer);
 
@@ -0,0 +1,587 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short avio contexts served by an I/O thread
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ueventfd.h>
+
+#include "upipe_av_aio.h"
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <libavutil/mem.h>
+#include <libavformat/avformat.h>
+
+/** size of the buffer of the avio context */
+#define AIO_CONTEXT_SIZE 32768
+/** maximum size of a single read or write by the I/O thread */
+#define AIO_CHUNK_SIZE 65536
+
+/** @This is the private context of an avio context served by a thread. */
+struct upipe_av_aio {
+    /** mutex protecting the fields below */
+    pthread_mutex_t mutex;
+    /** condition signalled on every change of state */
+    pthread_cond_t cond;
+    /** I/O thread */
+    pthread_t thread;
+    /** event triggered on changes of state */
+    struct ueventfd event;
+
+    /** URL */
+    char *url;
+    /** AVIO_FLAG_READ or AVIO_FLAG_WRITE */
+    int flags;
+    /** avformat options */
+    AVDictionary *options;
+    /** avio context exported to avformat */
+    AVIOContext *context;
+
+    /** ring buffer */
+    uint8_t *buffer;
+    /** size of the ring buffer */
+    size_t size;
+    /** offset of the first buffered octet */
+    size_t head;
+    /** number of buffered octets */
+    size_t fill;
+    /** position of the avio context in the stream */
+    int64_t pos;
+    /** size of the stream, or negative if unknown */
+    int64_t stream_size;
+    /** seekable flags of the underlying avio context */
+    int seekable;
+    /** position requested by a seek, or -1 */
+    int64_t seek;
+    /** result of the last seek */
+    int64_t seek_ret;
+    /** incremented on every seek in read mode */
+    unsigned int gen;
+
+    /** true when the I/O thread has tried to open the URL */
+    bool opened;
+    /** true when the end of file is reached */
+    bool eof;
+    /** true when the I/O thread must exit */
+    bool closing;
+    /** last error, or 0 */
+    int error;
+    /** true if the caller was told to wait (only used by the caller) */
+    bool stalled;
+};
+
+/** @internal @This signals a change of state to both sides.
+ *
+ * @param aio pointer to aio structure
+ */
+static void upipe_av_aio_signal(struct upipe_av_aio *aio)
+{
+    pthread_cond_broadcast(&aio->cond);
+    ueventfd_write(&aio->event);
+}
+
+/** @internal @This performs a pending seek in the I/O thread, with the
+ * mutex held.
+ *
+ * @param aio pointer to aio structure
+ * @param pb underlying avio context
+ */
+static void upipe_av_aio_do_seek(struct upipe_av_aio *aio, AVIOContext *pb)
+{
+    int64_t offset = aio->seek;
+    pthread_mutex_unlock(&aio->mutex);
+    int64_t ret = avio_seek(pb, offset, SEEK_SET);
+    pthread_mutex_lock(&aio->mutex);
+    aio->seek_ret = ret;
+    aio->seek = -1;
+    if (aio->flags & AVIO_FLAG_READ)
+        aio->eof = false;
+}
+
+/** @internal @This writes buffered data in the I/O thread, with the mutex
+ * held.
+ *
+ * @param aio pointer to aio structure
+ * @param pb underlying avio context
+ */
+static void upipe_av_aio_do_write(struct upipe_av_aio *aio, AVIOContext *pb)
+{
+    size_t size = aio->fill;
+    if (size > aio->size - aio->head)
+        size = aio->size - aio->head;
+    if (size > AIO_CHUNK_SIZE)
+        size = AIO_CHUNK_SIZE;
+    uint8_t *buffer = aio->buffer + aio->head;
+    bool last = size == aio->fill;
+
+    pthread_mutex_unlock(&aio->mutex);
+    avio_write(pb, buffer, size);
+    if (last)
+        avio_flush(pb);
+    int error = pb->error;
+    pthread_mutex_lock(&aio->mutex);
+
+    aio->head = (aio->head + size) % aio->size;
+    aio->fill -= size;
+    if (error < 0)
+        aio->error = error;
+}
+
+/** @internal @This reads data in the I/O thread, with the mutex held.
+ *
+ * @param aio pointer to aio structure
+ * @param pb underlying avio context
+ */
+static void upipe_av_aio_do_read(struct upipe_av_aio *aio, AVIOContext *pb)
+{
+    size_t tail = (aio->head + aio->fill) % aio->size;
+    size_t size = aio->size - aio->fill;
+    if (size > aio->size - tail)
+        size = aio->size - tail;
+    if (size > AIO_CHUNK_SIZE)
+        size = AIO_CHUNK_SIZE;
+    unsigned int gen = aio->gen;
+
+    /* the caller never touches the free part of the buffer */
+    pthread_mutex_unlock(&aio->mutex);
+    int ret = avio_read(pb, aio->buffer + tail, size);
+    pthread_mutex_lock(&aio->mutex);
+
+    if (gen != aio->gen)
+        return; /* seeked in the meantime */
+    if (ret > 0)
+        aio->fill += ret;
+    else if (ret == 0 || ret == AVERROR_EOF)
+        aio->eof = true;
+    else
+        aio->error = ret;
+}
+
+/** @internal @This aborts blocking reads when the I/O thread must exit.
+ * Writes are never aborted so that no data is lost.
+ *
+ * @param opaque pointer to aio structure
+ * @return 1 if the current operation must be aborted
+ */
+static int upipe_av_aio_interrupt(void *opaque)
+{
+    struct upipe_av_aio *aio = (struct upipe_av_aio *)opaque;
+    if (aio->flags & AVIO_FLAG_WRITE)
+        return 0;
+    pthread_mutex_lock(&aio->mutex);
+    int ret = aio->closing;
+    pthread_mutex_unlock(&aio->mutex);
+    return ret;
+}
+
+/** @internal @This is the main loop of the I/O thread.
+ *
+ * @param _aio pointer to aio structure
+ * @return NULL
+ */
+static void *upipe_av_aio_thread(void *_aio)
+{
+    struct upipe_av_aio *aio = (struct upipe_av_aio *)_aio;
+    AVIOContext *pb = NULL;
+    const AVIOInterruptCB int_cb = { upipe_av_aio_interrupt, aio };
+    int error = avio_open2(&pb, aio->url, aio->flags, &int_cb,
+                           &aio->options);
+    int64_t stream_size = error >= 0 ? avio_size(pb) : -1;
+
+    pthread_mutex_lock(&aio->mutex);
+    aio->opened = true;
+    aio->stream_size = stream_size;
+    aio->seekable = error >= 0 ? pb->seekable : 0;
+    if (error < 0)
+        aio->error = error;
+    upipe_av_aio_signal(aio);
+
+    for ( ; ; ) {
+        if (aio->error < 0) {
+            if (aio->closing)
+                break;
+            if (aio->seek >= 0) {
+                aio->seek = -1;
+                upipe_av_aio_signal(aio);
+            }
+            pthread_cond_wait(&aio->cond, &aio->mutex);
+            continue;
+        }
+
+        if (aio->seek >= 0 && (aio->flags & AVIO_FLAG_READ || !aio->fill))
+            upipe_av_aio_do_seek(aio, pb);
+        else if (aio->flags & AVIO_FLAG_WRITE && aio->fill)
+            upipe_av_aio_do_write(aio, pb);
+        else if (aio->closing)
+            break;
+        else if (aio->flags & AVIO_FLAG_READ && !aio->eof &&
+                 aio->fill < aio->size)
+            upipe_av_aio_do_read(aio, pb);
+        else {
+            pthread_cond_wait(&aio->cond, &aio->mutex);
+            continue;
+        }
+        upipe_av_aio_signal(aio);
+    }
+    pthread_mutex_unlock(&aio->mutex);
+
+    if (pb != NULL)
+        avio_close(pb);
+    return NULL;
+}
+
+/** @internal @This is the read callback of the avio context.
+ *
+ * @param opaque pointer to aio structure
+ * @param buf buffer to fill in
+ * @param size size of the buffer
+ * @return number of octets read, or an avutil error code
+ */
+static int upipe_av_aio_read(void *opaque, uint8_t *buf, int size)
+{
+    struct upipe_av_aio *aio = (struct upipe_av_aio *)opaque;
+    pthread_mutex_lock(&aio->mutex);
+    /* only happens if the caller didn't check upipe_av_aio_stalled */
+    while (!aio->fill && !aio->eof && aio->error >= 0)
+        pthread_cond_wait(&aio->cond, &aio->mutex);
+
+    if (!aio->fill) {
+        int error = aio->error < 0 ? aio->error : AVERROR_EOF;
+        pthread_mutex_unlock(&aio->mutex);
+        return error;
+    }
+
+    if ((size_t)size > aio->fill)
+        size = aio->fill;
+    size_t first = aio->size - aio->head;
+    if (first > (size_t)size)
+        first = size;
+    memcpy(buf, aio->buffer + aio->head, first);
+    memcpy(buf + first, aio->buffer, size - first);
+    aio->head = (aio->head + size) % aio->size;
+    aio->fill -= size;
+    aio->pos += size;
+    pthread_cond_broadcast(&aio->cond);
+    pthread_mutex_unlock(&aio->mutex);
+    return size;
+}
+
+/** @internal @This is the write callback of the avio context.
+ *
+ * @param opaque pointer to aio structure
+ * @param buf buffer to write
+ * @param size size of the buffer
+ * @return number of octets written, or an avutil error code
+ */
+static int upipe_av_aio_write(void *opaque, uint8_t *buf, int size)
+{
+    struct upipe_av_aio *aio = (struct upipe_av_aio *)opaque;
+    int done = 0;
+    pthread_mutex_lock(&aio->mutex);
+    while (done < size && aio->error >= 0) {
+        if (aio->fill == aio->size) {
+            /* only happens if a packet is larger than the buffer */
+            pthread_cond_wait(&aio->cond, &aio->mutex);
+            continue;
+        }
+
+        size_t tail = (aio->head + aio->fill) % aio->size;
+        size_t chunk = aio->size - aio->fill;
+        if (chunk > aio->size - tail)
+            chunk = aio->size - tail;
+        if (chunk > (size_t)(size - done))
+            chunk = size - done;
+        memcpy(aio->buffer + tail, buf + done, chunk);
+        aio->fill += chunk;
+        done += chunk;
+        pthread_cond_broadcast(&aio->cond);
+    }
+    int ret = aio->error < 0 ? aio->error : size;
+    aio->pos += size;
+    pthread_mutex_unlock(&aio->mutex);
+    return ret;
+}
+
+/** @internal @This is the seek callback of the avio context. Seeking
+ * backwards waits for the I/O thread.
+ *
+ * @param opaque pointer to aio structure
+ * @param offset offset to seek to
+ * @param whence SEEK_SET, SEEK_CUR, SEEK_END or AVSEEK_SIZE
+ * @return new position, or an avutil error code
+ */
+static int64_t upipe_av_aio_seek(void *opaque, int64_t offset, int whence)
+{
+    struct upipe_av_aio *aio = (struct upipe_av_aio *)opaque;
+    int64_t ret;
+    pthread_mutex_lock(&aio->mutex);
+    while (!aio->opened)
+        pthread_cond_wait(&aio->cond, &aio->mutex);
+
+    whence &= ~AVSEEK_FORCE;
+    switch (whence) {
+        case AVSEEK_SIZE:
+            ret = aio->stream_size >= 0 ? aio->stream_size : AVERROR(ENOSYS);
+            goto unlock;
+        case SEEK_SET:
+            break;
+        case SEEK_CUR:
+            offset += aio->pos;
+            break;
+        case SEEK_END:
+            if (aio->stream_size < 0) {
+                ret = AVERROR(ENOSYS);
+                goto unlock;
+            }
+            offset += aio->stream_size;
+            break;
+        default:
+            ret = AVERROR(EINVAL);
+            goto unlock;
+    }
+    if (offset < 0) {
+        ret = AVERROR(EINVAL);
+        goto unlock;
+    }
+
+    if (aio->flags & AVIO_FLAG_READ) {
+        if (offset >= aio->pos && (size_t)(offset - aio->pos) <= aio->fill) {
+            /* still in the buffer */
+            size_t skip = offset - aio->pos;
+            aio->head = (aio->head + skip) % aio->size;
+            aio->fill -= skip;
+            aio->pos = offset;
+            ret = offset;
+            pthread_cond_broadcast(&aio->cond);
+            goto unlock;
+        }
+        aio->head = aio->fill = 0;
+        aio->gen++;
+    }
+
+    aio->seek = offset;
+    pthread_cond_broadcast(&aio->cond);
+    while (aio->seek >= 0)
+        pthread_cond_wait(&aio->cond, &aio->mutex);
+    ret = aio->error < 0 ? aio->error : aio->seek_ret;
+    if (ret >= 0)
+        aio->pos = ret;
+
+unlock:
+    pthread_mutex_unlock(&aio->mutex);
+    return ret;
+}
+
+/** @This allocates an avio context and starts the I/O thread, which opens
+ * the given URL with avio_open2().
+ *
+ * @param url URL to open
+ * @param flags AVIO_FLAG_READ or AVIO_FLAG_WRITE
+ * @param options avformat options passed to avio_open2(), copied
+ * @param size size of the ring buffer, in octets
+ * @return pointer to the allocated structure, or NULL in case of error
+ */
+struct upipe_av_aio *upipe_av_aio_alloc(const char *url, int flags,
+                                        AVDictionary *options, size_t size)
+{
+    struct upipe_av_aio *aio = malloc(sizeof(struct upipe_av_aio));
+    if (unlikely(aio == NULL))
+        return NULL;
+    aio->url = strdup(url);
+    aio->buffer = malloc(size);
+    uint8_t *context_buffer = av_malloc(AIO_CONTEXT_SIZE);
+    if (unlikely(aio->url == NULL || aio->buffer == NULL ||
+                 context_buffer == NULL))
+        goto fail_alloc;
+
+    aio->context = avio_alloc_context(context_buffer, AIO_CONTEXT_SIZE,
+                                      flags & AVIO_FLAG_WRITE ? 1 : 0, aio,
+                                      upipe_av_aio_read, upipe_av_aio_write,
+                                      upipe_av_aio_seek);
+    if (unlikely(aio->context == NULL))
+        goto fail_alloc;
+    /* only local files are known to be seekable without opening them */
+    const char *protocol = avio_find_protocol_name(url);
+    if (flags & AVIO_FLAG_READ ||
+        (protocol != NULL && !strcmp(protocol, "file")))
+        aio->context->seekable = AVIO_SEEKABLE_NORMAL;
+    else
+        aio->context->seekable = 0;
+
+    if (unlikely(!ueventfd_init(&aio->event, false)))
+        goto fail_event;
+
+    aio->flags = flags;
+    aio->options = NULL;
+    av_dict_copy(&aio->options, options, 0);
+    aio->size = size;
+    aio->head = aio->fill = 0;
+    aio->pos = 0;
+    aio->stream_size = -1;
+    aio->seekable = 0;
+    aio->seek = -1;
+    aio->seek_ret = 0;
+    aio->gen = 0;
+    aio->opened = aio->eof = aio->closing = false;
+    aio->error = 0;
+    aio->stalled = false;
+    pthread_mutex_init(&aio->mutex, NULL);
+    pthread_cond_init(&aio->cond, NULL);
+
+    if (unlikely(pthread_create(&aio->thread, NULL, upipe_av_aio_thread,
+                                aio) != 0)) {
+        pthread_cond_destroy(&aio->cond);
+        pthread_mutex_destroy(&aio->mutex);
+        av_dict_free(&aio->options);
+        ueventfd_clean(&aio->event);
+        goto fail_event;
+    }
+    return aio;
+
+fail_event:
+    context_buffer = aio->context->buffer;
+    av_free(aio->context);
+fail_alloc:
+    av_free(context_buffer);
+    free(aio->buffer);
+    free(aio->url);
+    free(aio);
+    return NULL;
+}
+
+/** @This waits for the I/O thread to open the URL. This is only useful in
+ * read mode, before the context is probed by avformat.
+ *
+ * @param aio pointer to aio structure
+ * @return 0 or an avutil error code
+ */
+int upipe_av_aio_wait_open(struct upipe_av_aio *aio)
+{
+    pthread_mutex_lock(&aio->mutex);
+    while (!aio->opened)
+        pthread_cond_wait(&aio->cond, &aio->mutex);
+    int error = aio->error;
+    aio->context->seekable = aio->seekable;
+    pthread_mutex_unlock(&aio->mutex);
+    return error;
+}
+
+/** @This returns the avio context to pass to avformat.
+ *
+ * @param aio pointer to aio structure
+ * @return pointer to the avio context
+ */
+AVIOContext *upipe_av_aio_context(struct upipe_av_aio *aio)
+{
+    return aio->context;
+}
+
+/** @This checks whether the caller should wait for the I/O thread before
+ * using the context.
+ *
+ * @param aio pointer to aio structure
+ * @return true if the caller should wait
+ */
+bool upipe_av_aio_stalled(struct upipe_av_aio *aio)
+{
+    pthread_mutex_lock(&aio->mutex);
+    /* octets still in the buffer of the avio context count as well */
+    size_t fill = aio->fill;
+    if (aio->flags & AVIO_FLAG_WRITE)
+        fill += aio->context->buf_ptr - aio->context->buffer;
+
+    if (aio->error < 0)
+        aio->stalled = false;
+    else if (aio->flags & AVIO_FLAG_READ)
+        aio->stalled = !aio->eof &&
+            fill < (aio->stalled ? aio->size / 2 : aio->size / 4);
+    else
+        aio->stalled =
+            fill > (aio->stalled ? aio->size / 2 : aio->size / 4 * 3);
+    bool stalled = aio->stalled;
+    pthread_mutex_unlock(&aio->mutex);
+    return stalled;
+}
+
+/** @This allocates a watcher triggering when the state of the I/O thread
+ * changes.
+ *
+ * @param aio pointer to aio structure
+ * @param upump_mgr management structure for this event loop
+ * @param cb function to call when the watcher triggers
+ * @param opaque pointer to the module's internal structure
+ * @param refcount pointer to urefcount structure to increment during
+ * callback, or NULL
+ * @return pointer to allocated watcher, or NULL in case of failure
+ */
+struct upump *upipe_av_aio_upump_alloc(struct upipe_av_aio *aio,
+                                       struct upump_mgr *upump_mgr,
+                                       upump_cb cb, void *opaque,
+                                       struct urefcount *refcount)
+{
+    return ueventfd_upump_alloc(&aio->event, upump_mgr, cb, opaque, refcount);
+}
+
+/** @This acknowledges the triggering of the watcher.
+ *
+ * @param aio pointer to aio structure
+ */
+void upipe_av_aio_ack(struct upipe_av_aio *aio)
+{
+    ueventfd_read(&aio->event);
+}
+
+/** @This stops the I/O thread and frees the structure.
+ *
+ * @param aio pointer to aio structure
+ */
+void upipe_av_aio_free(struct upipe_av_aio *aio)
+{
+    if (aio->flags & AVIO_FLAG_WRITE)
+        avio_flush(aio->context);
+
+    pthread_mutex_lock(&aio->mutex);
+    aio->closing = true;
+    pthread_cond_broadcast(&aio->cond);
+    pthread_mutex_unlock(&aio->mutex);
+    pthread_join(aio->thread, NULL);
+
+    av_free(aio->context->buffer);
+    av_free(aio->context);
+    pthread_cond_destroy(&aio->cond);
+    pthread_mutex_destroy(&aio->mutex);
+    ueventfd_clean(&aio->event);
+    av_dict_free(&aio->options);
+    free(aio->buffer);
+    free(aio->url);
+    free(aio);
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short internal interface to avio contexts served by an I/O thread
+ *
+ * The avio context returned by @ref upipe_av_aio_context never performs
+ * I/O itself: data goes through a ring buffer which is filled (read mode)
+ * or drained (write mode) by a dedicated thread, so that a slow device does
+ * not block the event loop. The caller is expected to check
+ * @ref upipe_av_aio_stalled before using the context, and to wait for the
+ * watcher allocated by @ref upipe_av_aio_upump_alloc if it returns true.
+ */
+
+#ifndef _UPIPE_AV_UPIPE_AV_AIO_H_
+/** @hidden */
+#define _UPIPE_AV_UPIPE_AV_AIO_H_
+
+#include <upipe/upump.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <libavutil/dict.h>
+#include <libavformat/avio.h>
+
+/** @hidden */
+struct upipe_av_aio;
+
+/** @This allocates an avio context and starts the I/O thread, which opens
+ * the given URL with avio_open2().
+ *
+ * @param url URL to open
+ * @param flags AVIO_FLAG_READ or AVIO_FLAG_WRITE
+ * @param options avformat options passed to avio_open2(), copied
+ * @param size size of the ring buffer, in octets
+ * @return pointer to the allocated structure, or NULL in case of error
+ */
+struct upipe_av_aio *upipe_av_aio_alloc(const char *url, int flags,
+                                        AVDictionary *options, size_t size);
+
+/** @This waits for the I/O thread to open the URL. This is only useful in
+ * read mode, before the context is probed by avformat.
+ *
+ * @param aio pointer to aio structure
+ * @return 0 or an avutil error code
+ */
+int upipe_av_aio_wait_open(struct upipe_av_aio *aio);
+
+/** @This returns the avio context to pass to avformat.
+ *
+ * @param aio pointer to aio structure
+ * @return pointer to the avio context
+ */
+AVIOContext *upipe_av_aio_context(struct upipe_av_aio *aio);
+
+/** @This checks whether the caller should wait for the I/O thread before
+ * using the context. In read mode, it returns true when less than a quarter
+ * of the buffer is filled, and false again when half of it is filled or the
+ * end of file is reached. In write mode, it returns true when more than
+ * three quarters of the buffer are filled, and false again when half of it
+ * has been written.
+ *
+ * @param aio pointer to aio structure
+ * @return true if the caller should wait
+ */
+bool upipe_av_aio_stalled(struct upipe_av_aio *aio);
+
+/** @This allocates a watcher triggering when the state of the I/O thread
+ * changes. The callback must call @ref upipe_av_aio_ack.
+ *
+ * @param aio pointer to aio structure
+ * @param upump_mgr management structure for this event loop
+ * @param cb function to call when the watcher triggers
+ * @param opaque pointer to the module's internal structure
+ * @param refcount pointer to urefcount structure to increment during
+ * callback, or NULL
+ * @return pointer to allocated watcher, or NULL in case of failure
+ */
+struct upump *upipe_av_aio_upump_alloc(struct upipe_av_aio *aio,
+                                       struct upump_mgr *upump_mgr,
+                                       upump_cb cb, void *opaque,
+                                       struct urefcount *refcount);
+
+/** @This acknowledges the triggering of the watcher.
+ *
+ * @param aio pointer to aio structure
+ */
+void upipe_av_aio_ack(struct upipe_av_aio *aio);
+
+/** @This stops the I/O thread and frees the structure. In write mode, the
+ * data remaining in the buffer is written before the URL is closed, which
+ * may block.
+ *
+ * @param aio pointer to aio structure
+ */
+void upipe_av_aio_free(struct upipe_av_aio *aio);
+
+#endif
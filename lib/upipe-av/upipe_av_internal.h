@@ -95,6 +95,22 @@ static inline void upipe_av_deal_yield(struct upump *upump)
     udeal_yield(&upipe_av_deal, upump);
 }
 
+/** @This waits for exclusive access to avcodec_open(), without an event
+ * loop. It must be given back with @ref upipe_av_deal_release.
+ */
+static inline void upipe_av_deal_wait(void)
+{
+    udeal_wait(&upipe_av_deal);
+}
+
+/** @This gives back exclusive access to avcodec_open() previously acquired
+ * from @ref upipe_av_deal_wait.
+ */
+static inline void upipe_av_deal_release(void)
+{
+    udeal_release(&upipe_av_deal);
+}
+
 /** @This aborts the watcher before it has had a chance to run. It must only
  * be called in case of abort, otherwise @ref upipe_av_deal_yield does the
  * same job.
@@ -29,6 +29,8 @@
  */
 
 #include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/umutex.h>
 #include <upipe/uprobe.h>
 #include <upipe/uclock.h>
 #include <upipe/ubuf.h>
@@ -77,6 +79,53 @@
 
 #define EXPECTED_FLOW_DEF "block."
 
+/** @internal @This is an opened avcodec context kept in the manager pool. */
+struct upipe_avcdec_warm {
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** flow definition check the context was opened with */
+    struct uref *flow_def_check;
+    /** options the context was opened with, or NULL */
+    struct uref *options;
+    /** flushed avcodec context */
+    AVCodecContext *context;
+    /** ubuf manager used by get_buffer2 */
+    struct ubuf_mgr *ubuf_mgr;
+    /** flow format of the ubuf manager */
+    struct uref *flow_def_format;
+    /** flow format provided by the ubuf manager request */
+    struct uref *flow_def_provided;
+    /** pixel format used for the ubuf manager */
+    enum AVPixelFormat pix_fmt;
+    /** sample format used for the ubuf manager */
+    enum AVSampleFormat sample_fmt;
+    /** number of channels used for the ubuf manager */
+    unsigned int channels;
+};
+
+UBASE_FROM_TO(upipe_avcdec_warm, uchain, uchain, uchain)
+
+/** @internal @This is the private context of an avcdec manager. */
+struct upipe_avcdec_mgr {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** mutex protecting the pool, or NULL */
+    struct umutex *mutex;
+    /** maximum number of warm contexts */
+    unsigned int pool_depth;
+    /** number of warm contexts */
+    unsigned int pool_size;
+    /** list of warm contexts */
+    struct uchain pool;
+
+    /** public upipe_mgr structure */
+    struct upipe_mgr mgr;
+};
+
+UBASE_FROM_TO(upipe_avcdec_mgr, upipe_mgr, upipe_mgr, mgr)
+UBASE_FROM_TO(upipe_avcdec_mgr, urefcount, urefcount, urefcount)
+
 /** @hidden */
 static int upipe_avcdec_check(struct upipe *upipe, struct uref *flow_format);
 /** @hidden */
@@ -166,8 +215,16 @@ struct upipe_avcdec {
     AVCodecContext *context;
     /** avcodec frame */
     AVFrame *frame;
+    /** options set on the context, or NULL */
+    struct uref *options;
     /** true if the context will be closed */
     bool close;
+    /** skip mode */
+    enum upipe_avcdec_skip skip;
+    /** minimum interval between decoded key pictures */
+    uint64_t skip_interval;
+    /** date of the last decoded key picture */
+    uint64_t skip_last;
 
     /** public upipe structure */
     struct upipe upipe;
@@ -562,6 +619,166 @@ static int upipe_avcdec_get_buffer_sound(struct AVCodecContext *context,
     return 0; /* success */
 }
 
+/** @internal @This frees a warm context. As the pool is trimmed outside of
+ * any event loop, the exclusive access to avcodec_close() is waited for.
+ *
+ * @param warm warm context
+ */
+static void upipe_avcdec_warm_free(struct upipe_avcdec_warm *warm)
+{
+    upipe_av_deal_wait();
+    avcodec_close(warm->context);
+    upipe_av_deal_release();
+    free(warm->context->extradata);
+    av_free(warm->context);
+    ubuf_mgr_release(warm->ubuf_mgr);
+    uref_free(warm->flow_def_check);
+    uref_free(warm->options);
+    uref_free(warm->flow_def_format);
+    uref_free(warm->flow_def_provided);
+    free(warm);
+}
+
+/** @internal @This checks if a warm context may be used by the pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param warm warm context
+ * @return true if the context was opened with the same parameters
+ */
+static bool upipe_avcdec_warm_match(struct upipe *upipe,
+                                    struct upipe_avcdec_warm *warm)
+{
+    struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
+    if (warm->context->codec != upipe_avcdec->context->codec ||
+        udict_cmp(warm->flow_def_check->udict,
+                  upipe_avcdec->flow_def_check->udict))
+        return false;
+    if (warm->options == NULL || upipe_avcdec->options == NULL)
+        return warm->options == upipe_avcdec->options;
+    return !udict_cmp(warm->options->udict, upipe_avcdec->options->udict);
+}
+
+/** @internal @This replaces the unopened context of the pipe with a matching
+ * warm context from the manager pool, if any.
+ *
+ * @param upipe description structure of the pipe
+ * @return true if a warm context was found
+ */
+static bool upipe_avcdec_take_warm(struct upipe *upipe)
+{
+    struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
+    struct upipe_avcdec_mgr *avcdec_mgr =
+        upipe_avcdec_mgr_from_upipe_mgr(upipe->mgr);
+    if (!avcdec_mgr->pool_depth || upipe_avcdec->flow_def_check == NULL)
+        return false;
+
+    struct upipe_avcdec_warm *warm = NULL;
+    struct uchain *uchain, *uchain_tmp;
+    umutex_lock(avcdec_mgr->mutex);
+    ulist_delete_foreach(&avcdec_mgr->pool, uchain, uchain_tmp) {
+        struct upipe_avcdec_warm *w = upipe_avcdec_warm_from_uchain(uchain);
+        if (upipe_avcdec_warm_match(upipe, w)) {
+            ulist_delete(uchain);
+            avcdec_mgr->pool_size--;
+            warm = w;
+            break;
+        }
+    }
+    umutex_unlock(avcdec_mgr->mutex);
+    if (warm == NULL)
+        return false;
+
+    free(upipe_avcdec->context->extradata);
+    av_free(upipe_avcdec->context);
+    upipe_avcdec->context = warm->context;
+    upipe_avcdec->context->opaque = upipe;
+
+    ubuf_mgr_release(upipe_avcdec->ubuf_mgr);
+    upipe_avcdec->ubuf_mgr = warm->ubuf_mgr;
+    uref_free(upipe_avcdec->flow_def_format);
+    upipe_avcdec->flow_def_format = warm->flow_def_format;
+    uref_free(upipe_avcdec->flow_def_provided);
+    upipe_avcdec->flow_def_provided = warm->flow_def_provided;
+    upipe_avcdec->pix_fmt = warm->pix_fmt;
+    upipe_avcdec->sample_fmt = warm->sample_fmt;
+    upipe_avcdec->channels = warm->channels;
+
+    uref_free(warm->flow_def_check);
+    uref_free(warm->options);
+    free(warm);
+
+    upipe_notice_va(upipe, "codec %s (%s) %d reused",
+                    upipe_avcdec->context->codec->name,
+                    upipe_avcdec->context->codec->long_name,
+                    upipe_avcdec->context->codec->id);
+    return true;
+}
+
+/** @internal @This flushes the opened context of the pipe and gives it to
+ * the manager pool, if there is room.
+ *
+ * @param upipe description structure of the pipe
+ * @return true if the context was kept in the pool
+ */
+static bool upipe_avcdec_give_warm(struct upipe *upipe)
+{
+    struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
+    struct upipe_avcdec_mgr *avcdec_mgr =
+        upipe_avcdec_mgr_from_upipe_mgr(upipe->mgr);
+    if (!avcdec_mgr->pool_depth || upipe_avcdec->flow_def_check == NULL ||
+        upipe_avcdec->upump_av_deal != NULL ||
+        !avcodec_is_open(upipe_avcdec->context))
+        return false;
+
+    struct uref *flow_def_check = uref_dup(upipe_avcdec->flow_def_check);
+    struct uref *options = NULL;
+    if (upipe_avcdec->options != NULL)
+        options = uref_dup(upipe_avcdec->options);
+    struct upipe_avcdec_warm *warm = malloc(sizeof(struct upipe_avcdec_warm));
+    if (unlikely(warm == NULL || flow_def_check == NULL ||
+                 (upipe_avcdec->options != NULL && options == NULL))) {
+        free(warm);
+        uref_free(flow_def_check);
+        uref_free(options);
+        return false;
+    }
+
+    umutex_lock(avcdec_mgr->mutex);
+    if (avcdec_mgr->pool_size >= avcdec_mgr->pool_depth) {
+        umutex_unlock(avcdec_mgr->mutex);
+        free(warm);
+        uref_free(flow_def_check);
+        uref_free(options);
+        return false;
+    }
+
+    avcodec_flush_buffers(upipe_avcdec->context);
+    upipe_avcdec->context->opaque = NULL;
+
+    uchain_init(&warm->uchain);
+    warm->flow_def_check = flow_def_check;
+    warm->options = options;
+    warm->context = upipe_avcdec->context;
+    warm->ubuf_mgr = upipe_avcdec->ubuf_mgr;
+    warm->flow_def_format = upipe_avcdec->flow_def_format;
+    warm->flow_def_provided = upipe_avcdec->flow_def_provided;
+    warm->pix_fmt = upipe_avcdec->pix_fmt;
+    warm->sample_fmt = upipe_avcdec->sample_fmt;
+    warm->channels = upipe_avcdec->channels;
+    ulist_add(&avcdec_mgr->pool, upipe_avcdec_warm_to_uchain(warm));
+    avcdec_mgr->pool_size++;
+    umutex_unlock(avcdec_mgr->mutex);
+
+    upipe_notice_va(upipe, "codec %s (%s) %d kept warm",
+                    warm->context->codec->name, warm->context->codec->long_name,
+                    warm->context->codec->id);
+    upipe_avcdec->context = NULL;
+    upipe_avcdec->ubuf_mgr = NULL;
+    upipe_avcdec->flow_def_format = NULL;
+    upipe_avcdec->flow_def_provided = NULL;
+    return true;
+}
+
 /** @This aborts and frees an existing upump watching for exclusive access to
  * avcodec_open().
  *
@@ -744,6 +961,11 @@ static void upipe_avcdec_close(struct upipe *upipe)
         avpkt.data = NULL;
         while (upipe_avcdec_decode_avpkt(upipe, &avpkt, NULL));
     }
+
+    if (upipe_avcdec_give_warm(upipe)) {
+        upipe_avcdec_free(upipe);
+        return;
+    }
     upipe_avcdec->close = true;
     upipe_avcdec_start_av_deal(upipe);
 }
@@ -1295,6 +1517,48 @@ static void upipe_avcdec_store_uref(struct upipe *upipe, struct uref *uref)
     upipe_avcdec->uref = uref;
 }
 
+/** @internal @This checks whether a coded picture must be dropped before
+ * being decoded, and tells avcodec to discard the same pictures.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @return true if the picture must be dropped
+ */
+static bool upipe_avcdec_check_skip(struct upipe *upipe, struct uref *uref)
+{
+    struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
+    AVCodecContext *context = upipe_avcdec->context;
+    if (context->codec_type != AVMEDIA_TYPE_VIDEO)
+        return false;
+
+    switch (upipe_avcdec->skip) {
+        case UPIPE_AVCDEC_SKIP_NONE:
+            context->skip_frame = AVDISCARD_DEFAULT;
+            return false;
+        case UPIPE_AVCDEC_SKIP_NONREF:
+            context->skip_frame = AVDISCARD_NONREF;
+            return ubase_check(uref_pic_get_discardable(uref));
+        case UPIPE_AVCDEC_SKIP_NONKEY:
+            context->skip_frame = AVDISCARD_NONKEY;
+            break;
+    }
+
+    if (!ubase_check(uref_pic_get_key(uref)))
+        return true;
+
+    uint64_t date;
+    if (upipe_avcdec->skip_interval &&
+        (ubase_check(uref_clock_get_pts_prog(uref, &date)) ||
+         ubase_check(uref_clock_get_dts_prog(uref, &date)))) {
+        if (upipe_avcdec->skip_last != UINT64_MAX &&
+            date >= upipe_avcdec->skip_last &&
+            date < upipe_avcdec->skip_last + upipe_avcdec->skip_interval)
+            return true;
+        upipe_avcdec->skip_last = date;
+    }
+    return false;
+}
+
 /** @internal @This decodes packets.
  *
  * @param upipe description structure of the pipe
@@ -1309,6 +1573,12 @@ static bool upipe_avcdec_decode(struct upipe *upipe, struct uref *uref,
     assert(uref);
 
     struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
+    if (upipe_avcdec_check_skip(upipe, uref)) {
+        upipe_verbose(upipe, "skipping picture");
+        uref_free(uref);
+        return true;
+    }
+
     AVPacket avpkt;
     memset(&avpkt, 0, sizeof(AVPacket));
     av_init_packet(&avpkt);
@@ -1373,6 +1643,8 @@ static void upipe_avcdec_input(struct upipe *upipe, struct uref *uref,
             return;
         }
 
+        if (upipe_avcdec_take_warm(upipe))
+            break;
         upipe_avcdec_open(upipe);
     }
 
@@ -1533,6 +1805,61 @@ static int upipe_avcdec_set_option(struct upipe *upipe,
                      buf);
         return UBASE_ERR_EXTERNAL;
     }
+
+    /* Options are part of the key of warm contexts. */
+    if (upipe_avcdec->options == NULL) {
+        upipe_avcdec->options =
+            uref_sibling_alloc_control(upipe_avcdec->flow_def_check);
+        UBASE_ALLOC_RETURN(upipe_avcdec->options)
+    }
+    if (content != NULL)
+        return uref_attr_set_string(upipe_avcdec->options, content,
+                                    UDICT_TYPE_STRING, option);
+    uref_attr_delete(upipe_avcdec->options, UDICT_TYPE_STRING, option);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This returns the current skip mode.
+ *
+ * @param upipe description structure of the pipe
+ * @param skip_p filled in with the skip mode
+ * @param interval_p filled in with the minimum interval between decoded key
+ * pictures
+ * @return an error code
+ */
+static int _upipe_avcdec_get_skip(struct upipe *upipe, int *skip_p,
+                                  uint64_t *interval_p)
+{
+    struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
+    if (skip_p != NULL)
+        *skip_p = upipe_avcdec->skip;
+    if (interval_p != NULL)
+        *interval_p = upipe_avcdec->skip_interval;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the skip mode.
+ *
+ * @param upipe description structure of the pipe
+ * @param skip skip mode
+ * @param interval minimum interval between decoded key pictures, or 0
+ * @return an error code
+ */
+static int _upipe_avcdec_set_skip(struct upipe *upipe, int skip,
+                                  uint64_t interval)
+{
+    struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
+    switch (skip) {
+        case UPIPE_AVCDEC_SKIP_NONE:
+        case UPIPE_AVCDEC_SKIP_NONREF:
+        case UPIPE_AVCDEC_SKIP_NONKEY:
+            break;
+        default:
+            return UBASE_ERR_INVALID;
+    }
+    upipe_avcdec->skip = skip;
+    upipe_avcdec->skip_interval = interval;
+    upipe_avcdec->skip_last = UINT64_MAX;
     return UBASE_ERR_NONE;
 }
 
@@ -1580,6 +1907,18 @@ static int upipe_avcdec_control(struct upipe *upipe, int command, va_list args)
             const char *content = va_arg(args, const char *);
             return upipe_avcdec_set_option(upipe, option, content);
         }
+        case UPIPE_AVCDEC_GET_SKIP: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVCDEC_SIGNATURE)
+            int *skip_p = va_arg(args, int *);
+            uint64_t *interval_p = va_arg(args, uint64_t *);
+            return _upipe_avcdec_get_skip(upipe, skip_p, interval_p);
+        }
+        case UPIPE_AVCDEC_SET_SKIP: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVCDEC_SIGNATURE)
+            int skip = va_arg(args, int);
+            uint64_t interval = va_arg(args, uint64_t);
+            return _upipe_avcdec_set_skip(upipe, skip, interval);
+        }
 
         default:
             return UBASE_ERR_UNHANDLED;
@@ -1602,6 +1941,7 @@ static void upipe_avcdec_free(struct upipe *upipe)
 
     upipe_throw_dead(upipe);
     uref_free(upipe_avcdec->uref);
+    uref_free(upipe_avcdec->options);
     uref_free(upipe_avcdec->flow_def_format);
     uref_free(upipe_avcdec->flow_def_provided);
     upipe_avcdec_abort_av_deal(upipe);
@@ -1649,8 +1989,12 @@ static struct upipe *upipe_avcdec_alloc(struct upipe_mgr *mgr,
     struct upipe_avcdec *upipe_avcdec = upipe_avcdec_from_upipe(upipe);
     upipe_avcdec->context = NULL;
     upipe_avcdec->frame = frame;
+    upipe_avcdec->options = NULL;
     upipe_avcdec->counter = 0;
     upipe_avcdec->close = false;
+    upipe_avcdec->skip = UPIPE_AVCDEC_SKIP_NONE;
+    upipe_avcdec->skip_interval = 0;
+    upipe_avcdec->skip_last = UINT64_MAX;
     upipe_avcdec->pix_fmt = AV_PIX_FMT_NONE;
     upipe_avcdec->sample_fmt = AV_SAMPLE_FMT_NONE;
     upipe_avcdec->channels = 0;
@@ -1673,17 +2017,96 @@ static struct upipe *upipe_avcdec_alloc(struct upipe_mgr *mgr,
     return upipe;
 }
 
-/** module manager static descriptor */
-static struct upipe_mgr upipe_avcdec_mgr = {
-    .refcount = NULL,
-    .signature = UPIPE_AVCDEC_SIGNATURE,
+/** @internal @This frees the warm contexts in excess of the given number.
+ *
+ * @param mgr pointer to manager
+ * @param pool_depth number of warm contexts to keep
+ */
+static void upipe_avcdec_mgr_trim(struct upipe_mgr *mgr,
+                                  unsigned int pool_depth)
+{
+    struct upipe_avcdec_mgr *avcdec_mgr =
+        upipe_avcdec_mgr_from_upipe_mgr(mgr);
+    struct uchain list;
+    ulist_init(&list);
+
+    umutex_lock(avcdec_mgr->mutex);
+    while (avcdec_mgr->pool_size > pool_depth) {
+        ulist_add(&list, ulist_pop(&avcdec_mgr->pool));
+        avcdec_mgr->pool_size--;
+    }
+    umutex_unlock(avcdec_mgr->mutex);
 
-    .upipe_alloc = upipe_avcdec_alloc,
-    .upipe_input = upipe_avcdec_input,
-    .upipe_control = upipe_avcdec_control,
+    struct uchain *uchain;
+    while ((uchain = ulist_pop(&list)) != NULL)
+        upipe_avcdec_warm_free(upipe_avcdec_warm_from_uchain(uchain));
+}
 
-    .upipe_mgr_control = NULL
-};
+/** @This processes control commands on an avcdec manager.
+ *
+ * @param mgr pointer to manager
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_avcdec_mgr_control(struct upipe_mgr *mgr,
+                                    int command, va_list args)
+{
+    struct upipe_avcdec_mgr *avcdec_mgr =
+        upipe_avcdec_mgr_from_upipe_mgr(mgr);
+
+    switch (command) {
+        case UPIPE_MGR_VACUUM:
+            upipe_avcdec_mgr_trim(mgr, 0);
+            return UBASE_ERR_NONE;
+
+        case UPIPE_AVCDEC_MGR_GET_POOL_DEPTH: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVCDEC_SIGNATURE)
+            unsigned int *pool_depth_p = va_arg(args, unsigned int *);
+            *pool_depth_p = avcdec_mgr->pool_depth;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_AVCDEC_MGR_GET_POOL_SIZE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVCDEC_SIGNATURE)
+            unsigned int *pool_size_p = va_arg(args, unsigned int *);
+            umutex_lock(avcdec_mgr->mutex);
+            *pool_size_p = avcdec_mgr->pool_size;
+            umutex_unlock(avcdec_mgr->mutex);
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_AVCDEC_MGR_SET_POOL: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVCDEC_SIGNATURE)
+            unsigned int pool_depth = va_arg(args, unsigned int);
+            struct umutex *mutex = va_arg(args, struct umutex *);
+            if (mutex != avcdec_mgr->mutex &&
+                !urefcount_single(&avcdec_mgr->urefcount))
+                return UBASE_ERR_BUSY;
+            upipe_avcdec_mgr_trim(mgr, pool_depth);
+            avcdec_mgr->pool_depth = pool_depth;
+            umutex_release(avcdec_mgr->mutex);
+            avcdec_mgr->mutex = umutex_use(mutex);
+            return UBASE_ERR_NONE;
+        }
+
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This frees an avcdec manager.
+ *
+ * @param urefcount pointer to urefcount structure
+ */
+static void upipe_avcdec_mgr_free(struct urefcount *urefcount)
+{
+    struct upipe_avcdec_mgr *avcdec_mgr =
+        upipe_avcdec_mgr_from_urefcount(urefcount);
+    upipe_avcdec_mgr_trim(upipe_avcdec_mgr_to_upipe_mgr(avcdec_mgr), 0);
+    umutex_release(avcdec_mgr->mutex);
+
+    urefcount_clean(urefcount);
+    free(avcdec_mgr);
+}
 
 /** @This returns the management structure for avcodec decoders.
  *
@@ -1691,5 +2114,24 @@ static struct upipe_mgr upipe_avcdec_mgr = {
  */
 struct upipe_mgr *upipe_avcdec_mgr_alloc(void)
 {
-    return &upipe_avcdec_mgr;
+    struct upipe_avcdec_mgr *avcdec_mgr =
+        malloc(sizeof(struct upipe_avcdec_mgr));
+    if (unlikely(avcdec_mgr == NULL))
+        return NULL;
+
+    memset(avcdec_mgr, 0, sizeof(*avcdec_mgr));
+    avcdec_mgr->mutex = NULL;
+    avcdec_mgr->pool_depth = 0;
+    avcdec_mgr->pool_size = 0;
+    ulist_init(&avcdec_mgr->pool);
+
+    urefcount_init(upipe_avcdec_mgr_to_urefcount(avcdec_mgr),
+                   upipe_avcdec_mgr_free);
+    avcdec_mgr->mgr.refcount = upipe_avcdec_mgr_to_urefcount(avcdec_mgr);
+    avcdec_mgr->mgr.signature = UPIPE_AVCDEC_SIGNATURE;
+    avcdec_mgr->mgr.upipe_alloc = upipe_avcdec_alloc;
+    avcdec_mgr->mgr.upipe_input = upipe_avcdec_input;
+    avcdec_mgr->mgr.upipe_control = upipe_avcdec_control;
+    avcdec_mgr->mgr.upipe_mgr_control = upipe_avcdec_mgr_control;
+    return upipe_avcdec_mgr_to_upipe_mgr(avcdec_mgr);
 }
@@ -72,6 +72,7 @@
 #include <libavutil/avutil.h>
 #include <libavutil/pixdesc.h>
 #include <libavutil/opt.h>
+#include <libavutil/intreadwrite.h>
 #include <upipe-av/upipe_av_pixfmt.h>
 #include <upipe-av/upipe_av_samplefmt.h>
 #include "upipe_av_internal.h"
@@ -523,6 +524,14 @@ static bool upipe_avcenc_encode_frame(struct upipe *upipe,
     int64_t pkt_pts = avpkt.pts, pkt_dts = avpkt.dts;
     bool keyframe = avpkt.flags & AV_PKT_FLAG_KEY;
 
+    /* quantizer reported by the encoder, for rate control (statmux) */
+    int qp = -1;
+    int stats_size = 0;
+    uint8_t *stats = av_packet_get_side_data(&avpkt,
+            AV_PKT_DATA_QUALITY_STATS, &stats_size);
+    if (stats != NULL && stats_size >= 4)
+        qp = AV_RL32(stats) / FF_QP2LAMBDA;
+
     av_packet_unref(&avpkt);
 
     /* find uref corresponding to avpkt */
@@ -614,6 +623,8 @@ static bool upipe_avcenc_encode_frame(struct upipe *upipe,
 
     if (codec->type == AVMEDIA_TYPE_VIDEO && keyframe)
         uref_flow_set_random(uref);
+    if (codec->type == AVMEDIA_TYPE_VIDEO && qp >= 0 && qp <= UINT8_MAX)
+        uref_pic_set_qp(uref, qp);
 
     if (upipe_avcenc->flow_def == NULL)
         upipe_avcenc_build_flow_def(upipe);
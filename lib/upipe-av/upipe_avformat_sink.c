@@ -39,16 +39,21 @@
 #include <upipe/uref_pic_flow.h>
 #include <upipe/uref_sound_flow.h>
 #include <upipe/uref_clock.h>
+#include <upipe/upump.h>
+#include <upipe/upump_blocker.h>
 #include <upipe/upipe.h>
 #include <upipe/upipe_helper_upipe.h>
 #include <upipe/upipe_helper_urefcount.h>
 #include <upipe/upipe_helper_void.h>
+#include <upipe/upipe_helper_upump_mgr.h>
+#include <upipe/upipe_helper_upump.h>
 #include <upipe/upipe_helper_flow_def_check.h>
 #include <upipe/upipe_helper_subpipe.h>
 #include <upipe-framers/uref_mpga_flow.h>
 #include <upipe-av/upipe_avformat_sink.h>
 
 #include "upipe_av_internal.h"
+#include "upipe_av_aio.h"
 
 #include <stdlib.h>
 #include <stdbool.h>
@@ -66,6 +71,10 @@
 #include <libavutil/dict.h>
 #include <libavformat/avformat.h>
 
+/** default number of urefs buffered per input while the I/O thread is
+ * stalled, before the upstream pump is blocked */
+#define UPIPE_AVFSINK_SUB_MAX_UREFS 128
+
 /** @internal @This is the private context of an avformat source pipe. */
 struct upipe_avfsink {
     /** refcount management structure */
@@ -89,6 +98,17 @@ struct upipe_avfsink {
     AVFormatContext *context;
     /** true if the header has already been written */
     bool opened;
+
+    /** upump manager */
+    struct upump_mgr *upump_mgr;
+    /** watcher on the I/O thread */
+    struct upump *upump;
+    /** size of the I/O buffer, or 0 for blocking I/O */
+    uint64_t io_buffer;
+    /** avio context served by the I/O thread */
+    struct upipe_av_aio *aio;
+    /** true if the I/O thread can't keep up */
+    bool stalled;
     /** offset between Upipe timestamp and avformat timestamp */
     uint64_t ts_offset;
     /** first DTS */
@@ -106,6 +126,8 @@ struct upipe_avfsink {
 UPIPE_HELPER_UPIPE(upipe_avfsink, upipe, UPIPE_AVFSINK_SIGNATURE)
 UPIPE_HELPER_UREFCOUNT(upipe_avfsink, urefcount, upipe_avfsink_free)
 UPIPE_HELPER_VOID(upipe_avfsink)
+UPIPE_HELPER_UPUMP_MGR(upipe_avfsink, upump_mgr)
+UPIPE_HELPER_UPUMP(upipe_avfsink, upump, upump_mgr)
 
 /** @internal @This is the private context of an output of an avformat source
  * pipe. */
@@ -123,6 +145,12 @@ struct upipe_avfsink_sub {
 
     /** buffered urefs */
     struct uchain urefs;
+    /** number of buffered urefs */
+    unsigned int nb_urefs;
+    /** maximum number of urefs buffered while the I/O thread is stalled */
+    unsigned int max_urefs;
+    /** list of blockers on the upstream pumps */
+    struct uchain blockers;
     /** next DTS that is supposed to be dequeued */
     uint64_t next_dts;
 
@@ -141,6 +169,59 @@ UPIPE_HELPER_SUBPIPE(upipe_avfsink, upipe_avfsink_sub, sub, sub_mgr,
 /** @hidden */
 static void upipe_avfsink_mux(struct upipe *upipe, struct upump **upump_p);
 
+/** @internal @This is called when an upstream pump is released by its owner.
+ *
+ * @param blocker description structure of the blocker
+ */
+static void upipe_avfsink_sub_block_cb(struct upump_blocker *blocker)
+{
+    ulist_delete(upump_blocker_to_uchain(blocker));
+    upump_blocker_free(blocker);
+}
+
+/** @internal @This blocks the upstream pump if too many urefs are buffered
+ * while the I/O thread is stalled.
+ *
+ * @param upipe description structure of the pipe
+ * @param upump_p reference to pump that generated the last buffer
+ */
+static void upipe_avfsink_sub_block(struct upipe *upipe,
+                                    struct upump **upump_p)
+{
+    struct upipe_avfsink_sub *upipe_avfsink_sub =
+        upipe_avfsink_sub_from_upipe(upipe);
+    struct upipe_avfsink *upipe_avfsink =
+        upipe_avfsink_from_sub_mgr(upipe->mgr);
+    if (upump_p == NULL || *upump_p == NULL || !upipe_avfsink->stalled ||
+        upipe_avfsink_sub->nb_urefs < upipe_avfsink_sub->max_urefs ||
+        upump_blocker_find(&upipe_avfsink_sub->blockers, *upump_p) != NULL)
+        return;
+
+    struct upump_blocker *blocker =
+        upump_blocker_alloc(*upump_p, upipe_avfsink_sub_block_cb, upipe,
+                            upipe->refcount);
+    if (unlikely(blocker == NULL)) {
+        upipe_throw_fatal(upipe, UBASE_ERR_UPUMP);
+        return;
+    }
+    ulist_add(&upipe_avfsink_sub->blockers, upump_blocker_to_uchain(blocker));
+}
+
+/** @internal @This unblocks all upstream pumps.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_avfsink_sub_unblock(struct upipe *upipe)
+{
+    struct upipe_avfsink_sub *upipe_avfsink_sub =
+        upipe_avfsink_sub_from_upipe(upipe);
+    struct uchain *uchain, *uchain_tmp;
+    ulist_delete_foreach (&upipe_avfsink_sub->blockers, uchain, uchain_tmp) {
+        ulist_delete(uchain);
+        upump_blocker_free(upump_blocker_from_uchain(uchain));
+    }
+}
+
 /** @internal @This allocates an output subpipe of an avfsink pipe.
  *
  * @param mgr common management structure
@@ -168,6 +249,9 @@ static struct upipe *upipe_avfsink_sub_alloc(struct upipe_mgr *mgr,
     upipe_avfsink_sub_init_sub(upipe);
     upipe_avfsink_sub->id = -1;
     ulist_init(&upipe_avfsink_sub->urefs);
+    upipe_avfsink_sub->nb_urefs = 0;
+    upipe_avfsink_sub->max_urefs = UPIPE_AVFSINK_SUB_MAX_UREFS;
+    ulist_init(&upipe_avfsink_sub->blockers);
     upipe_avfsink_sub->next_dts = UINT64_MAX;
 
     upipe_throw_ready(upipe);
@@ -200,6 +284,7 @@ static void upipe_avfsink_sub_input(struct upipe *upipe, struct uref *uref,
 
     bool was_empty = ulist_empty(&upipe_avfsink_sub->urefs);
     ulist_add(&upipe_avfsink_sub->urefs, uref_to_uchain(uref));
+    upipe_avfsink_sub->nb_urefs++;
     if (was_empty) {
         upipe_use(upipe);
         upipe_avfsink_sub->next_dts = dts;
@@ -208,6 +293,7 @@ static void upipe_avfsink_sub_input(struct upipe *upipe, struct uref *uref,
     struct upipe_avfsink *upipe_avfsink =
         upipe_avfsink_from_sub_mgr(upipe->mgr);
     upipe_avfsink_mux(upipe_avfsink_to_upipe(upipe_avfsink), upump_p);
+    upipe_avfsink_sub_block(upipe, upump_p);
 }
 
 /** @internal @This sets the input flow definition.
@@ -455,6 +541,22 @@ static int upipe_avfsink_sub_control(struct upipe *upipe,
             struct uref *flow_def = va_arg(args, struct uref *);
             return upipe_avfsink_sub_set_flow_def(upipe, flow_def);
         }
+        case UPIPE_GET_MAX_LENGTH: {
+            struct upipe_avfsink_sub *upipe_avfsink_sub =
+                upipe_avfsink_sub_from_upipe(upipe);
+            unsigned int *p = va_arg(args, unsigned int *);
+            *p = upipe_avfsink_sub->max_urefs;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_SET_MAX_LENGTH: {
+            struct upipe_avfsink_sub *upipe_avfsink_sub =
+                upipe_avfsink_sub_from_upipe(upipe);
+            unsigned int max_length = va_arg(args, unsigned int);
+            if (unlikely(!max_length))
+                return UBASE_ERR_INVALID;
+            upipe_avfsink_sub->max_urefs = max_length;
+            return UBASE_ERR_NONE;
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -470,6 +572,7 @@ static void upipe_avfsink_sub_free(struct upipe *upipe)
         upipe_avfsink_from_sub_mgr(upipe->mgr);
     upipe_throw_dead(upipe);
 
+    upipe_avfsink_sub_unblock(upipe);
     upipe_avfsink_sub_clean_flow_def_check(upipe);
     upipe_avfsink_sub_clean_sub(upipe);
     upipe_avfsink_mux(upipe_avfsink_to_upipe(upipe_avfsink), NULL);
@@ -523,6 +626,11 @@ static struct upipe *upipe_avfsink_alloc(struct upipe_mgr *mgr,
     upipe_avfsink->options = NULL;
     upipe_avfsink->context = NULL;
     upipe_avfsink->opened = false;
+    upipe_avfsink_init_upump_mgr(upipe);
+    upipe_avfsink_init_upump(upipe);
+    upipe_avfsink->io_buffer = 0;
+    upipe_avfsink->aio = NULL;
+    upipe_avfsink->stalled = false;
     upipe_avfsink->ts_offset = UINT64_MAX;
     upipe_avfsink->first_dts = 0;
     upipe_avfsink->highest_next_dts = 0;
@@ -565,12 +673,25 @@ static int upipe_avfsink_avio_open(struct upipe *upipe, struct upipe_avfsink_sub
     if (upipe_avfsink->context->oformat->flags & AVFMT_NOFILE)
         return UBASE_ERR_NONE;
 
-    AVDictionary *options = NULL;
-    av_dict_copy(&options, upipe_avfsink->options, 0);
-    int error = avio_open2(&upipe_avfsink->context->pb,
+    int error;
+    if (upipe_avfsink->io_buffer) {
+        upipe_avfsink->aio = upipe_av_aio_alloc(
+                upipe_avfsink->context->filename, AVIO_FLAG_WRITE,
+                upipe_avfsink->options, upipe_avfsink->io_buffer);
+        if (likely(upipe_avfsink->aio != NULL)) {
+            upipe_avfsink->context->pb =
+                upipe_av_aio_context(upipe_avfsink->aio);
+            error = 0;
+        } else
+            error = AVERROR(ENOMEM);
+    } else {
+        AVDictionary *options = NULL;
+        av_dict_copy(&options, upipe_avfsink->options, 0);
+        error = avio_open2(&upipe_avfsink->context->pb,
                            upipe_avfsink->context->filename,
                            AVIO_FLAG_WRITE, NULL, &options);
-    av_dict_free(&options);
+        av_dict_free(&options);
+    }
     if (error < 0) {
         upipe_av_strerror(error, buf);
         upipe_err_va(upipe, "couldn't open file %s (%s)",
@@ -579,6 +700,7 @@ static int upipe_avfsink_avio_open(struct upipe *upipe, struct upipe_avfsink_sub
         while (!ulist_empty(&input->urefs)) {
             uref_free(uref_from_uchain(ulist_pop(&input->urefs)));
         }
+        input->nb_urefs = 0;
         upipe_release(upipe_avfsink_sub_to_upipe(input));
         return UBASE_ERR_EXTERNAL;
     }
@@ -586,6 +708,109 @@ static int upipe_avfsink_avio_open(struct upipe *upipe, struct upipe_avfsink_sub
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This unblocks the upstream pumps of all inputs once the I/O
+ * thread has caught up.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_avfsink_unblock(struct upipe *upipe)
+{
+    struct upipe_avfsink *upipe_avfsink = upipe_avfsink_from_upipe(upipe);
+    struct uchain *uchain;
+    ulist_foreach (&upipe_avfsink->subs, uchain) {
+        struct upipe_avfsink_sub *input =
+            upipe_avfsink_sub_from_uchain(uchain);
+        upipe_avfsink_sub_unblock(upipe_avfsink_sub_to_upipe(input));
+    }
+}
+
+/** @internal @This closes the output of the avformat context.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_avfsink_avio_close(struct upipe *upipe)
+{
+    struct upipe_avfsink *upipe_avfsink = upipe_avfsink_from_upipe(upipe);
+
+    if (upipe_avfsink->context->oformat->flags & AVFMT_NOFILE)
+        return;
+
+    if (upipe_avfsink->aio != NULL) {
+        upipe_avfsink_set_upump(upipe, NULL);
+        upipe_av_aio_free(upipe_avfsink->aio);
+        upipe_avfsink->aio = NULL;
+        upipe_avfsink->context->pb = NULL;
+        if (upipe_avfsink->stalled) {
+            upipe_avfsink->stalled = false;
+            upipe_avfsink_unblock(upipe);
+            upipe_throw(upipe, UPROBE_AVFSINK_RESUMED,
+                        UPIPE_AVFSINK_SIGNATURE);
+        }
+    } else
+        avio_close(upipe_avfsink->context->pb);
+}
+
+/** @hidden */
+static bool upipe_avfsink_check_aio(struct upipe *upipe);
+
+/** @internal @This is called when the state of the I/O thread changes.
+ *
+ * @param upump description structure of the watcher
+ */
+static void upipe_avfsink_aio_cb(struct upump *upump)
+{
+    struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
+    struct upipe_avfsink *upipe_avfsink = upipe_avfsink_from_upipe(upipe);
+    upipe_av_aio_ack(upipe_avfsink->aio);
+    if (upipe_avfsink_check_aio(upipe))
+        upipe_avfsink_mux(upipe, NULL);
+}
+
+/** @internal @This checks whether the I/O thread is able to take more data,
+ * and otherwise waits for it.
+ *
+ * @param upipe description structure of the pipe
+ * @return false if the pipe must wait for the I/O thread
+ */
+static bool upipe_avfsink_check_aio(struct upipe *upipe)
+{
+    struct upipe_avfsink *upipe_avfsink = upipe_avfsink_from_upipe(upipe);
+    if (upipe_avfsink->aio == NULL)
+        return true;
+
+    if (!upipe_av_aio_stalled(upipe_avfsink->aio)) {
+        if (upipe_avfsink->stalled) {
+            upipe_avfsink_set_upump(upipe, NULL);
+            upipe_avfsink->stalled = false;
+            upipe_avfsink_unblock(upipe);
+            upipe_throw(upipe, UPROBE_AVFSINK_RESUMED,
+                        UPIPE_AVFSINK_SIGNATURE);
+        }
+        return true;
+    }
+    if (upipe_avfsink->upump != NULL)
+        return false;
+
+    upipe_avfsink_check_upump_mgr(upipe);
+    if (unlikely(upipe_avfsink->upump_mgr == NULL))
+        return true; /* no event loop, fall back to blocking */
+
+    struct upump *upump = upipe_av_aio_upump_alloc(upipe_avfsink->aio,
+            upipe_avfsink->upump_mgr, upipe_avfsink_aio_cb, upipe,
+            upipe->refcount);
+    if (unlikely(upump == NULL)) {
+        upipe_throw_fatal(upipe, UBASE_ERR_UPUMP);
+        return true;
+    }
+    upipe_avfsink_set_upump(upipe, upump);
+    upump_start(upump);
+    if (!upipe_avfsink->stalled) {
+        upipe_avfsink->stalled = true;
+        upipe_throw(upipe, UPROBE_AVFSINK_STALLED, UPIPE_AVFSINK_SIGNATURE);
+    }
+    return false;
+}
+
 /** @internal @This asks avformat to multiplex some data.
  *
  * @param upipe description structure of the pipe
@@ -596,6 +821,9 @@ static void upipe_avfsink_mux(struct upipe *upipe, struct upump **upump_p)
     struct upipe_avfsink *upipe_avfsink = upipe_avfsink_from_upipe(upipe);
     struct upipe_avfsink_sub *input;
     while ((input = upipe_avfsink_find_input(upipe)) != NULL) {
+        if (!upipe_avfsink_check_aio(upipe))
+            return;
+
         if (unlikely(!upipe_avfsink->opened)) {
             upipe_dbg(upipe, "writing header");
             /* avformat dts for formats other than mpegts should start at 0 */
@@ -626,6 +854,7 @@ static void upipe_avfsink_mux(struct upipe *upipe, struct upump **upump_p)
                 while (!ulist_empty(&input->urefs)) {
                     uref_free(uref_from_uchain(ulist_pop(&input->urefs)));
                 }
+                input->nb_urefs = 0;
                 upipe_release(upipe_avfsink_sub_to_upipe(input));
                 return;
             }
@@ -646,8 +875,7 @@ static void upipe_avfsink_mux(struct upipe *upipe, struct upump **upump_p)
                 }
                 upipe_notice_va(upipe, "closing init URI %s",
                                 upipe_avfsink->init_uri);
-                if (!(upipe_avfsink->context->oformat->flags & AVFMT_NOFILE))
-                    avio_close(upipe_avfsink->context->pb);
+                upipe_avfsink_avio_close(upipe);
                 snprintf(upipe_avfsink->context->filename,
                          sizeof (upipe_avfsink->context->filename),
                          "%s", upipe_avfsink->uri);
@@ -661,6 +889,7 @@ static void upipe_avfsink_mux(struct upipe *upipe, struct upump **upump_p)
         AVStream *stream = upipe_avfsink->context->streams[input->id];
         struct uchain *uchain = ulist_pop(&input->urefs);
         struct uref *uref = uref_from_uchain(uchain);
+        input->nb_urefs--;
 
         upipe_use(upipe_avfsink_sub_to_upipe(input));
         if (ulist_empty(&input->urefs)) {
@@ -919,9 +1148,9 @@ static int upipe_avfsink_set_uri(struct upipe *upipe, const char *uri)
         if (upipe_avfsink->opened) {
             upipe_dbg(upipe, "writing trailer");
             av_write_trailer(upipe_avfsink->context);
-            if (!(upipe_avfsink->context->oformat->flags & AVFMT_NOFILE))
-                avio_close(upipe_avfsink->context->pb);
-        }
+            upipe_avfsink_avio_close(upipe);
+        } else if (upipe_avfsink->aio != NULL)
+            upipe_avfsink_avio_close(upipe);
         avformat_free_context(upipe_avfsink->context);
     }
     ubase_clean_str(&upipe_avfsink->uri);
@@ -1005,6 +1234,36 @@ static int _upipe_avfsink_set_ts_offset(struct upipe *upipe, uint64_t ts_offset)
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This returns the size of the I/O buffer.
+ *
+ * @param upipe description structure of the pipe
+ * @param size_p filled in with the size of the buffer, in octets
+ * @return an error code
+ */
+static int _upipe_avfsink_get_io_buffer(struct upipe *upipe, uint64_t *size_p)
+{
+    struct upipe_avfsink *upipe_avfsink = upipe_avfsink_from_upipe(upipe);
+    assert(size_p != NULL);
+    *size_p = upipe_avfsink->io_buffer;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the size of the I/O buffer. It only takes effect
+ * after the next call to @ref upipe_set_uri.
+ *
+ * @param upipe description structure of the pipe
+ * @param size size of the buffer, in octets, or 0 for blocking I/O
+ * @return an error code
+ */
+static int _upipe_avfsink_set_io_buffer(struct upipe *upipe, uint64_t size)
+{
+    struct upipe_avfsink *upipe_avfsink = upipe_avfsink_from_upipe(upipe);
+    if (size > SIZE_MAX)
+        return UBASE_ERR_INVALID;
+    upipe_avfsink->io_buffer = size;
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This processes control commands on an avformat source pipe.
  *
  * @param upipe description structure of the pipe
@@ -1020,6 +1279,16 @@ static int upipe_avfsink_control(struct upipe *upipe, int command, va_list args)
         case UPIPE_REGISTER_REQUEST:
         case UPIPE_UNREGISTER_REQUEST:
             return upipe_control_provide_request(upipe, command, args);
+        case UPIPE_ATTACH_UPUMP_MGR: {
+            struct upipe_avfsink *upipe_avfsink =
+                upipe_avfsink_from_upipe(upipe);
+            upipe_avfsink_set_upump(upipe, NULL);
+            UBASE_RETURN(upipe_avfsink_attach_upump_mgr(upipe))
+            if (upipe_avfsink->stalled)
+                /* wait again with the new manager */
+                upipe_avfsink_mux(upipe, NULL);
+            return UBASE_ERR_NONE;
+        }
 
         case UPIPE_SET_FLOW_DEF: {
             struct uref *flow_def = va_arg(args, struct uref *);
@@ -1080,6 +1349,16 @@ static int upipe_avfsink_control(struct upipe *upipe, int command, va_list args)
             uint64_t ts_offset = va_arg(args, uint64_t);
             return _upipe_avfsink_set_ts_offset(upipe, ts_offset);
         }
+        case UPIPE_AVFSINK_GET_IO_BUFFER: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVFSINK_SIGNATURE)
+            uint64_t *size_p = va_arg(args, uint64_t *);
+            return _upipe_avfsink_get_io_buffer(upipe, size_p);
+        }
+        case UPIPE_AVFSINK_SET_IO_BUFFER: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVFSINK_SIGNATURE)
+            uint64_t size = va_arg(args, uint64_t);
+            return _upipe_avfsink_set_io_buffer(upipe, size);
+        }
 
         case UPIPE_GET_URI: {
             const char **uri_p = va_arg(args, const char **);
@@ -1112,6 +1391,8 @@ static void upipe_avfsink_free(struct upipe *upipe)
 
     av_dict_free(&upipe_avfsink->options);
 
+    upipe_avfsink_clean_upump(upipe);
+    upipe_avfsink_clean_upump_mgr(upipe);
     upipe_avfsink_clean_urefcount(upipe);
     upipe_avfsink_free_void(upipe);
 }
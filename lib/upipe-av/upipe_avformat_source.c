@@ -63,6 +63,7 @@
 #include <upipe-av/upipe_avformat_source.h>
 
 #include "upipe_av_internal.h"
+#include "upipe_av_aio.h"
 
 #include <stdlib.h>
 #include <stdbool.h>
@@ -152,6 +153,15 @@ struct upipe_avfsrc {
     /** true if the URL has already been probed by avformat */
     bool probed;
 
+    /** size of the I/O buffer, or 0 for blocking I/O */
+    uint64_t io_buffer;
+    /** avio context served by the I/O thread */
+    struct upipe_av_aio *aio;
+    /** watcher on the I/O thread */
+    struct upump *upump_aio;
+    /** true if the I/O thread can't keep up */
+    bool stalled;
+
     /** manager to create subs */
     struct upipe_mgr sub_mgr;
 
@@ -171,6 +181,7 @@ UPIPE_HELPER_UCLOCK(upipe_avfsrc, uclock, uclock_request, NULL,
 
 UPIPE_HELPER_UPUMP_MGR(upipe_avfsrc, upump_mgr)
 UPIPE_HELPER_UPUMP(upipe_avfsrc, upump, upump_mgr)
+UPIPE_HELPER_UPUMP(upipe_avfsrc, upump_aio, upump_mgr)
 
 UBASE_FROM_TO(upipe_avfsrc, urefcount, urefcount_real, urefcount_real)
 
@@ -478,6 +489,7 @@ static struct upipe *upipe_avfsrc_alloc(struct upipe_mgr *mgr,
     upipe_avfsrc_init_uref_mgr(upipe);
     upipe_avfsrc_init_upump_mgr(upipe);
     upipe_avfsrc_init_upump(upipe);
+    upipe_avfsrc_init_upump_aio(upipe);
     upipe_avfsrc_init_uclock(upipe);
     upipe_avfsrc->timestamp_offset = 0;
     upipe_avfsrc->timestamp_highest = AV_CLOCK_MIN;
@@ -489,6 +501,9 @@ static struct upipe *upipe_avfsrc_alloc(struct upipe_mgr *mgr,
     upipe_avfsrc->options = NULL;
     upipe_avfsrc->context = NULL;
     upipe_avfsrc->probed = false;
+    upipe_avfsrc->io_buffer = 0;
+    upipe_avfsrc->aio = NULL;
+    upipe_avfsrc->stalled = false;
     upipe_throw_ready(upipe);
     return upipe;
 }
@@ -527,6 +542,83 @@ static struct upipe_avfsrc_sub *upipe_avfsrc_find_output(struct upipe *upipe,
     return NULL;
 }
 
+/** @internal @This closes the I/O thread, if any.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_avfsrc_close_aio(struct upipe *upipe)
+{
+    struct upipe_avfsrc *upipe_avfsrc = upipe_avfsrc_from_upipe(upipe);
+    if (upipe_avfsrc->aio == NULL)
+        return;
+
+    upipe_avfsrc_set_upump_aio(upipe, NULL);
+    upipe_av_aio_free(upipe_avfsrc->aio);
+    upipe_avfsrc->aio = NULL;
+    if (upipe_avfsrc->stalled) {
+        upipe_avfsrc->stalled = false;
+        upipe_throw(upipe, UPROBE_AVFSRC_RESUMED, UPIPE_AVFSRC_SIGNATURE);
+    }
+}
+
+/** @hidden */
+static bool upipe_avfsrc_check_aio(struct upipe *upipe);
+
+/** @internal @This is called when the state of the I/O thread changes.
+ *
+ * @param upump description structure of the watcher
+ */
+static void upipe_avfsrc_aio_cb(struct upump *upump)
+{
+    struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
+    struct upipe_avfsrc *upipe_avfsrc = upipe_avfsrc_from_upipe(upipe);
+    upipe_av_aio_ack(upipe_avfsrc->aio);
+    upipe_avfsrc_check_aio(upipe);
+}
+
+/** @internal @This checks whether the I/O thread has buffered enough data,
+ * and otherwise suspends the worker until it has.
+ *
+ * @param upipe description structure of the pipe
+ * @return false if the worker must wait for the I/O thread
+ */
+static bool upipe_avfsrc_check_aio(struct upipe *upipe)
+{
+    struct upipe_avfsrc *upipe_avfsrc = upipe_avfsrc_from_upipe(upipe);
+    if (upipe_avfsrc->aio == NULL)
+        return true;
+
+    if (!upipe_av_aio_stalled(upipe_avfsrc->aio)) {
+        if (upipe_avfsrc->stalled) {
+            upipe_avfsrc_set_upump_aio(upipe, NULL);
+            if (upipe_avfsrc->upump != NULL)
+                upump_start(upipe_avfsrc->upump);
+            upipe_avfsrc->stalled = false;
+            upipe_throw(upipe, UPROBE_AVFSRC_RESUMED, UPIPE_AVFSRC_SIGNATURE);
+        }
+        return true;
+    }
+
+    if (upipe_avfsrc->upump_aio == NULL) {
+        struct upump *upump = upipe_av_aio_upump_alloc(upipe_avfsrc->aio,
+                upipe_avfsrc->upump_mgr, upipe_avfsrc_aio_cb, upipe,
+                upipe->refcount);
+        if (unlikely(upump == NULL)) {
+            upipe_throw_fatal(upipe, UBASE_ERR_UPUMP);
+            return true;
+        }
+        upipe_avfsrc_set_upump_aio(upipe, upump);
+        upump_start(upump);
+    }
+    if (upipe_avfsrc->upump != NULL)
+        upump_stop(upipe_avfsrc->upump);
+    if (!upipe_avfsrc->stalled) {
+        upipe_avfsrc->stalled = true;
+        upipe_throw(upipe, UPROBE_AVFSRC_STALLED, UPIPE_AVFSRC_SIGNATURE);
+    }
+    return false;
+}
+
 /** @internal @This reads data from the source and outputs it.
  * It is called either when the idler triggers (permanent storage mode) or
  * when data is available on the file descriptor (live stream mode).
@@ -539,6 +631,9 @@ static void upipe_avfsrc_worker(struct upump *upump)
     struct upipe_avfsrc *upipe_avfsrc = upipe_avfsrc_from_upipe(upipe);
     AVPacket pkt;
 
+    if (!upipe_avfsrc_check_aio(upipe))
+        return;
+
     int error = av_read_frame(upipe_avfsrc->context, &pkt);
     if (unlikely(error < 0)) {
         upipe_av_strerror(error, buf);
@@ -1022,6 +1117,7 @@ static int upipe_avfsrc_set_uri(struct upipe *upipe, const char *url)
         avformat_close_input(&upipe_avfsrc->context);
         upipe_avfsrc->context = NULL;
         upipe_avfsrc_set_upump(upipe, NULL);
+        upipe_avfsrc_close_aio(upipe);
         upipe_avfsrc_abort_av_deal(upipe);
         upipe_avfsrc_throw_sub_subs(upipe, UPROBE_SOURCE_END);
     }
@@ -1041,14 +1137,39 @@ static int upipe_avfsrc_set_uri(struct upipe *upipe, const char *url)
     struct uref *uref = uref_alloc(upipe_avfsrc->uref_mgr);
     upipe_avfsrc_output(upipe, uref, NULL);
 
-    AVDictionary *options = NULL;
-    av_dict_copy(&options, upipe_avfsrc->options, 0);
-    int error = avformat_open_input(&upipe_avfsrc->context, url, NULL,
+    int error;
+    if (upipe_avfsrc->io_buffer) {
+        /* the URL is opened by the I/O thread */
+        upipe_avfsrc->aio = upipe_av_aio_alloc(url, AVIO_FLAG_READ,
+                                               upipe_avfsrc->options,
+                                               upipe_avfsrc->io_buffer);
+        if (unlikely(upipe_avfsrc->aio == NULL)) {
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return UBASE_ERR_ALLOC;
+        }
+        error = upipe_av_aio_wait_open(upipe_avfsrc->aio);
+        if (likely(error >= 0)) {
+            upipe_avfsrc->context = avformat_alloc_context();
+            if (unlikely(upipe_avfsrc->context == NULL))
+                error = AVERROR(ENOMEM);
+            else
+                upipe_avfsrc->context->pb =
+                    upipe_av_aio_context(upipe_avfsrc->aio);
+        }
+    } else
+        error = 0;
+
+    if (likely(error >= 0)) {
+        AVDictionary *options = NULL;
+        av_dict_copy(&options, upipe_avfsrc->options, 0);
+        error = avformat_open_input(&upipe_avfsrc->context, url, NULL,
                                     &options);
-    av_dict_free(&options);
+        av_dict_free(&options);
+    }
     if (unlikely(error < 0)) {
         upipe_av_strerror(error, buf);
         upipe_err_va(upipe, "can't open URL %s (%s)", url, buf);
+        upipe_avfsrc_close_aio(upipe);
         return UBASE_ERR_EXTERNAL;
     }
 
@@ -1091,6 +1212,36 @@ static int _upipe_avfsrc_set_time(struct upipe *upipe, uint64_t time)
     return UBASE_ERR_UNHANDLED;
 }
 
+/** @internal @This returns the size of the I/O buffer.
+ *
+ * @param upipe description structure of the pipe
+ * @param size_p filled in with the size of the buffer, in octets
+ * @return an error code
+ */
+static int _upipe_avfsrc_get_io_buffer(struct upipe *upipe, uint64_t *size_p)
+{
+    struct upipe_avfsrc *upipe_avfsrc = upipe_avfsrc_from_upipe(upipe);
+    assert(size_p != NULL);
+    *size_p = upipe_avfsrc->io_buffer;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the size of the I/O buffer. It only takes effect
+ * after the next call to @ref upipe_set_uri.
+ *
+ * @param upipe description structure of the pipe
+ * @param size size of the buffer, in octets, or 0 for blocking I/O
+ * @return an error code
+ */
+static int _upipe_avfsrc_set_io_buffer(struct upipe *upipe, uint64_t size)
+{
+    struct upipe_avfsrc *upipe_avfsrc = upipe_avfsrc_from_upipe(upipe);
+    if (size > SIZE_MAX)
+        return UBASE_ERR_INVALID;
+    upipe_avfsrc->io_buffer = size;
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This processes control commands on an avformat source pipe.
  *
  * @param upipe description structure of the pipe
@@ -1106,6 +1257,7 @@ static int _upipe_avfsrc_control(struct upipe *upipe,
     switch (command) {
         case UPIPE_ATTACH_UPUMP_MGR:
             upipe_avfsrc_set_upump(upipe, NULL);
+            upipe_avfsrc_set_upump_aio(upipe, NULL);
             upipe_avfsrc_abort_av_deal(upipe);
             return upipe_avfsrc_attach_upump_mgr(upipe);
         case UPIPE_ATTACH_UCLOCK:
@@ -1151,6 +1303,16 @@ static int _upipe_avfsrc_control(struct upipe *upipe,
             uint64_t time = va_arg(args, uint64_t);
             return _upipe_avfsrc_set_time(upipe, time);
         }
+        case UPIPE_AVFSRC_GET_IO_BUFFER: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVFSRC_SIGNATURE)
+            uint64_t *size_p = va_arg(args, uint64_t *);
+            return _upipe_avfsrc_get_io_buffer(upipe, size_p);
+        }
+        case UPIPE_AVFSRC_SET_IO_BUFFER: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_AVFSRC_SIGNATURE)
+            uint64_t size = va_arg(args, uint64_t);
+            return _upipe_avfsrc_set_io_buffer(upipe, size);
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -1215,12 +1377,14 @@ static void upipe_avfsrc_free(struct urefcount *urefcount_real)
 
         avformat_close_input(&upipe_avfsrc->context);
     }
+    upipe_avfsrc_close_aio(upipe);
     upipe_throw_dead(upipe);
 
     av_dict_free(&upipe_avfsrc->options);
     free(upipe_avfsrc->url);
 
     upipe_avfsrc_clean_uclock(upipe);
+    upipe_avfsrc_clean_upump_aio(upipe);
     upipe_avfsrc_clean_upump(upipe);
     upipe_avfsrc_clean_upump_mgr(upipe);
     upipe_avfsrc_clean_uref_mgr(upipe);
@@ -0,0 +1,633 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short loudness measurement engine (EBU R128, ITU-R BS.1770-4)
+ */
+
+#include <upipe/ubase.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "loudness.h"
+
+/** number of channels processed in parallel, 128-bit vectors are native on
+ * all SIMD targets (SSE2, NEON, AltiVec).
+ *
+ * Lanes are filled with the channels of a single stream, and more than two
+ * channels use several groups. Each upipe_ebur128 pipe owns its measurement
+ * and is fed from its own pump, so packing several streams in one vector
+ * would require a shared engine synchronizing unrelated pipes, whose
+ * samples arrive at different times and in different formats. A stereo
+ * stream already fills a 128-bit vector of doubles, and 5.1 fills three,
+ * which keeps the lanes busy without coupling pipes. */
+#define LANES 2
+/** maximum number of frames converted at once */
+#define CHUNK 64
+/** number of 100 ms sub-blocks in the short-term window */
+#define SHORTTERM_SUBBLOCKS 30
+/** number of 100 ms sub-blocks in the momentary window */
+#define MOMENTARY_SUBBLOCKS 4
+/** lowest loudness of the histograms, also the absolute gate, in LUFS */
+#define HIST_MIN -70.
+/** number of histogram bins, one per 0.1 LU */
+#define HIST_BINS 1000
+/** relative gate of the integrated loudness, in LU */
+#define GLOBAL_GATE -10.
+/** relative gate of the loudness range, in LU */
+#define RANGE_GATE -20.
+/** oversampling factor of the true-peak interpolator */
+#define TP_PHASES 4
+/** number of taps per phase of the true-peak interpolator */
+#define TP_TAPS 12
+/** sampling rate above which the true peak is not oversampled */
+#define TP_MAX_RATE 96000
+
+/** @This is a vector of channels, compiled to SIMD instructions. */
+typedef double lanes_t __attribute__((vector_size(LANES * sizeof(double))));
+/** @This is a comparison mask of a vector of channels. */
+typedef int64_t lanes_mask_t
+    __attribute__((vector_size(LANES * sizeof(int64_t))));
+
+/** polyphase interpolator from ITU-R BS.1770-4 annex 2 */
+static const double tp_coefs[TP_PHASES][TP_TAPS] = {
+    {  0.0017089843750,  0.0109863281250, -0.0196533203125,
+       0.0332031250000, -0.0594482421875,  0.1373291015625,
+       0.9721679687500, -0.1022949218750,  0.0476074218750,
+      -0.0266113281250,  0.0148925781250, -0.0083007812500 },
+    { -0.0291748046875,  0.0292968750000, -0.0517578125000,
+       0.0891113281250, -0.1665039062500,  0.4650878906250,
+       0.7797851562500, -0.2003173828125,  0.1015625000000,
+      -0.0582275390625,  0.0330810546875, -0.0189208984375 },
+    { -0.0189208984375,  0.0330810546875, -0.0582275390625,
+       0.1015625000000, -0.2003173828125,  0.7797851562500,
+       0.4650878906250, -0.1665039062500,  0.0891113281250,
+      -0.0517578125000,  0.0292968750000, -0.0291748046875 },
+    { -0.0083007812500,  0.0148925781250, -0.0266113281250,
+       0.0476074218750, -0.1022949218750,  0.9721679687500,
+       0.1373291015625, -0.0594482421875,  0.0332031250000,
+      -0.0196533203125,  0.0109863281250,  0.0017089843750 }
+};
+
+/** @internal @This is the state of a group of channels. */
+struct loudness_group {
+    /** K-weighting filter states (transposed direct form II) */
+    lanes_t z[4];
+    /** sum of the squares of filtered samples in the current sub-block */
+    lanes_t sum;
+    /** channel weights */
+    lanes_t weight;
+    /** square of the highest peak */
+    lanes_t peak;
+    /** interpolator history, stored twice to avoid wrapping */
+    lanes_t history[2 * TP_TAPS];
+};
+
+/** @internal @This is a histogram of block energies. */
+struct loudness_hist {
+    /** number of blocks per bin */
+    uint64_t count[HIST_BINS];
+    /** sum of the energies of the blocks per bin */
+    double energy[HIST_BINS];
+};
+
+/** @internal @This is the state of a loudness measurement. */
+struct loudness {
+    /** number of channels */
+    uint8_t channels;
+    /** number of groups of channels */
+    unsigned int groups;
+    /** true if the true peak is oversampled */
+    bool true_peak;
+
+    /** first stage of K-weighting (high shelf) */
+    lanes_t b[3];
+    /** first stage of K-weighting, recursive part */
+    lanes_t a[2];
+    /** second stage of K-weighting (high pass), recursive part */
+    lanes_t c[2];
+    /** interpolator coefficients */
+    lanes_t tp[TP_PHASES][TP_TAPS];
+    /** current position in the interpolator history */
+    unsigned int tp_idx;
+
+    /** number of frames in a sub-block */
+    size_t subblock_frames;
+    /** number of frames in the current sub-block */
+    size_t frames;
+    /** ring of the energies of the last sub-blocks */
+    double subblocks[SHORTTERM_SUBBLOCKS];
+    /** index of the next sub-block in the ring */
+    unsigned int subblock_idx;
+    /** total number of sub-blocks */
+    uint64_t nb_subblocks;
+
+    /** histogram of 400 ms blocks */
+    struct loudness_hist blocks;
+    /** histogram of 3 s blocks */
+    struct loudness_hist shortterms;
+
+    /** converted samples, CHUNK * groups vectors */
+    lanes_t *scratch;
+    /** groups of channels */
+    struct loudness_group group[];
+};
+
+/** @internal @This broadcasts a scalar to all lanes.
+ *
+ * @param v scalar
+ * @return vector
+ */
+static inline lanes_t lanes_set(double v)
+{
+    lanes_t r;
+    for (int l = 0; l < LANES; l++)
+        r[l] = v;
+    return r;
+}
+
+/** @internal @This returns the lane-wise maximum of two vectors.
+ *
+ * @param a first vector
+ * @param b second vector
+ * @return vector
+ */
+static inline lanes_t lanes_max(lanes_t a, lanes_t b)
+{
+    lanes_mask_t m = (lanes_mask_t)(a > b);
+    return (lanes_t)(((lanes_mask_t)a & m) | ((lanes_mask_t)b & ~m));
+}
+
+/** @internal @This converts an energy to a loudness.
+ *
+ * @param energy mean square of the weighted samples
+ * @return loudness in LUFS
+ */
+static inline double loudness_lufs(double energy)
+{
+    if (energy <= 0.)
+        return -HUGE_VAL;
+    return -0.691 + 10. * log10(energy);
+}
+
+/** @internal @This returns the weight of a channel. The channel layouts
+ * are the default channel maps of libebur128, so that measurements do not
+ * change with the engine: L R Ls Rs for 4 channels, L R C Ls Rs for 5
+ * channels, and L R C LFE Ls Rs otherwise, extra channels being ignored.
+ *
+ * @param channels number of channels
+ * @param channel index of the channel
+ * @return weight
+ */
+static double loudness_weight(uint8_t channels, uint8_t channel)
+{
+    if (channels == 4)
+        return channel < 2 ? 1. : 1.41;
+    if (channels == 5)
+        return channel < 3 ? 1. : 1.41;
+    switch (channel) {
+        case 0:
+        case 1:
+        case 2:
+            return 1.;
+        case 4:
+        case 5:
+            return 1.41;
+        default:
+            return 0.;
+    }
+}
+
+/** @This allocates a loudness measurement.
+ *
+ * @param channels number of channels
+ * @param rate sampling rate in Hz
+ * @param true_peak true to measure the oversampled true peak
+ * @return pointer to the state, or NULL in case of error
+ */
+struct loudness *loudness_alloc(uint8_t channels, uint64_t rate,
+                                bool true_peak)
+{
+    if (!channels || rate < 10)
+        return NULL;
+
+    unsigned int groups = (channels + LANES - 1) / LANES;
+    struct loudness *loudness;
+    if (posix_memalign((void **)&loudness, sizeof(lanes_t),
+                       sizeof(struct loudness) +
+                       groups * sizeof(struct loudness_group)))
+        return NULL;
+    memset(loudness, 0, sizeof(struct loudness) +
+           groups * sizeof(struct loudness_group));
+    if (posix_memalign((void **)&loudness->scratch, sizeof(lanes_t),
+                       CHUNK * groups * sizeof(lanes_t))) {
+        free(loudness);
+        return NULL;
+    }
+    /* unused lanes are never written and stay at 0 */
+    memset(loudness->scratch, 0, CHUNK * groups * sizeof(lanes_t));
+
+    loudness->channels = channels;
+    loudness->groups = groups;
+    loudness->true_peak = true_peak && rate < TP_MAX_RATE;
+    loudness->subblock_frames = (rate + 5) / 10;
+
+    /* high shelf, modelling the acoustic effect of the head */
+    double f0 = 1681.974450955533;
+    double gain = 3.999843853973347;
+    double q = 0.7071752369554196;
+    double k = tan(M_PI * f0 / rate);
+    double vh = pow(10., gain / 20.);
+    double vb = pow(vh, 0.4996667741545416);
+    double a0 = 1. + k / q + k * k;
+    loudness->b[0] = lanes_set((vh + vb * k / q + k * k) / a0);
+    loudness->b[1] = lanes_set(2. * (k * k - vh) / a0);
+    loudness->b[2] = lanes_set((vh - vb * k / q + k * k) / a0);
+    loudness->a[0] = lanes_set(2. * (k * k - 1.) / a0);
+    loudness->a[1] = lanes_set((1. - k / q + k * k) / a0);
+
+    /* RLB high pass */
+    f0 = 38.13547087602444;
+    q = 0.5003270373238773;
+    k = tan(M_PI * f0 / rate);
+    a0 = 1. + k / q + k * k;
+    loudness->c[0] = lanes_set(2. * (k * k - 1.) / a0);
+    loudness->c[1] = lanes_set((1. - k / q + k * k) / a0);
+
+    for (int p = 0; p < TP_PHASES; p++)
+        for (int t = 0; t < TP_TAPS; t++)
+            loudness->tp[p][t] = lanes_set(tp_coefs[p][t]);
+
+    for (unsigned int g = 0; g < groups; g++)
+        for (int l = 0; l < LANES; l++)
+            if (g * LANES + l < channels)
+                loudness->group[g].weight[l] =
+                    loudness_weight(channels, g * LANES + l);
+    return loudness;
+}
+
+/** @This frees a loudness measurement.
+ *
+ * @param loudness pointer to the state
+ */
+void loudness_free(struct loudness *loudness)
+{
+    if (loudness == NULL)
+        return;
+    free(loudness->scratch);
+    free(loudness);
+}
+
+/** @internal @This declares a function converting samples of a given type
+ * to the scratch buffer.
+ *
+ * @param NAME suffix of the function
+ * @param TYPE type of the samples
+ * @param SCALE divider to normalize the samples to [-1, 1]
+ */
+#define LOUDNESS_CONVERT(NAME, TYPE, SCALE)                                 \
+static void loudness_convert_##NAME(struct loudness *loudness,              \
+                                    const void *const *planes,              \
+                                    uint8_t nb_planes,                      \
+                                    size_t offset, size_t frames)           \
+{                                                                           \
+    double *dst = (double *)loudness->scratch;                              \
+    size_t dst_stride = loudness->groups * LANES;                           \
+    for (uint8_t c = 0; c < loudness->channels; c++) {                      \
+        const TYPE *src;                                                    \
+        size_t src_stride;                                                  \
+        if (nb_planes == 1) {                                               \
+            src = (const TYPE *)planes[0] + offset * loudness->channels + c;\
+            src_stride = loudness->channels;                                \
+        } else {                                                            \
+            src = (const TYPE *)planes[c] + offset;                         \
+            src_stride = 1;                                                 \
+        }                                                                   \
+        for (size_t f = 0; f < frames; f++)                                 \
+            dst[f * dst_stride + c] = src[f * src_stride] / (SCALE);        \
+    }                                                                       \
+}
+
+LOUDNESS_CONVERT(s16, int16_t, 32768.)
+LOUDNESS_CONVERT(s32, int32_t, 2147483648.)
+LOUDNESS_CONVERT(float, float, 1.)
+LOUDNESS_CONVERT(double, double, 1.)
+
+/** @internal @This filters a group of channels from the scratch buffer.
+ *
+ * @param loudness pointer to the state
+ * @param g index of the group
+ * @param frames number of frames in the scratch buffer
+ */
+static void loudness_filter(struct loudness *loudness, unsigned int g,
+                            size_t frames)
+{
+    struct loudness_group *group = &loudness->group[g];
+    const lanes_t *src = loudness->scratch + g;
+    unsigned int stride = loudness->groups;
+    lanes_t b0 = loudness->b[0], b1 = loudness->b[1], b2 = loudness->b[2];
+    lanes_t a1 = loudness->a[0], a2 = loudness->a[1];
+    lanes_t c1 = loudness->c[0], c2 = loudness->c[1];
+    lanes_t z0 = group->z[0], z1 = group->z[1];
+    lanes_t z2 = group->z[2], z3 = group->z[3];
+    lanes_t sum = group->sum;
+    lanes_t peak = group->peak;
+    lanes_t two = lanes_set(2.);
+
+    for (size_t f = 0; f < frames; f++) {
+        lanes_t x = src[f * stride];
+        lanes_t y = b0 * x + z0;
+        z0 = b1 * x - a1 * y + z1;
+        z1 = b2 * x - a2 * y;
+        lanes_t w = y + z2;
+        z2 = z3 - two * y - c1 * w;
+        z3 = y - c2 * w;
+        sum += w * w;
+    }
+
+    if (loudness->true_peak) {
+        unsigned int idx = loudness->tp_idx;
+        for (size_t f = 0; f < frames; f++) {
+            lanes_t x = src[f * stride];
+            group->history[idx] = group->history[idx + TP_TAPS] = x;
+            idx = (idx + 1) % TP_TAPS;
+            const lanes_t *h = group->history + idx + TP_TAPS - 1;
+            for (int p = 0; p < TP_PHASES; p++) {
+                lanes_t v = lanes_set(0.);
+                for (int t = 0; t < TP_TAPS; t++)
+                    v += loudness->tp[p][t] * h[-t];
+                peak = lanes_max(peak, v * v);
+            }
+        }
+    }
+    /* the sample peak is a lower bound of the true peak */
+    for (size_t f = 0; f < frames; f++) {
+        lanes_t x = src[f * stride];
+        peak = lanes_max(peak, x * x);
+    }
+
+    group->z[0] = z0;
+    group->z[1] = z1;
+    group->z[2] = z2;
+    group->z[3] = z3;
+    group->sum = sum;
+    group->peak = peak;
+}
+
+/** @internal @This adds a block energy to a histogram.
+ *
+ * @param hist pointer to the histogram
+ * @param energy energy of the block
+ */
+static void loudness_hist_add(struct loudness_hist *hist, double energy)
+{
+    double lufs = loudness_lufs(energy);
+    if (lufs < HIST_MIN)
+        return;
+    int bin = (lufs - HIST_MIN) * 10.;
+    if (bin >= HIST_BINS)
+        bin = HIST_BINS - 1;
+    hist->count[bin]++;
+    hist->energy[bin] += energy;
+}
+
+/** @internal @This returns the first bin above a relative gate.
+ *
+ * @param hist pointer to the histogram
+ * @param gate relative gate in LU
+ * @param count_p filled in with the number of blocks above the gate
+ * @param energy_p filled in with the sum of the energies above the gate
+ * @return index of the first bin above the gate, or -1 if empty
+ */
+static int loudness_hist_gate(const struct loudness_hist *hist, double gate,
+                              uint64_t *count_p, double *energy_p)
+{
+    uint64_t count = 0;
+    double energy = 0.;
+    for (int i = 0; i < HIST_BINS; i++) {
+        count += hist->count[i];
+        energy += hist->energy[i];
+    }
+    if (!count)
+        return -1;
+
+    double threshold = loudness_lufs(energy / count) + gate;
+    int start = threshold > HIST_MIN ? (threshold - HIST_MIN) * 10. : 0;
+    count = 0;
+    energy = 0.;
+    for (int i = start; i < HIST_BINS; i++) {
+        count += hist->count[i];
+        energy += hist->energy[i];
+    }
+    *count_p = count;
+    *energy_p = energy;
+    return count ? start : -1;
+}
+
+/** @internal @This returns the mean energy of the last sub-blocks.
+ *
+ * @param loudness pointer to the state
+ * @param nb number of sub-blocks
+ * @return mean energy
+ */
+static double loudness_window(struct loudness *loudness, unsigned int nb)
+{
+    if (nb > loudness->nb_subblocks)
+        nb = loudness->nb_subblocks;
+    if (!nb)
+        return 0.;
+    double energy = 0.;
+    for (unsigned int i = 0; i < nb; i++)
+        energy += loudness->subblocks[(loudness->subblock_idx +
+                    SHORTTERM_SUBBLOCKS - 1 - i) % SHORTTERM_SUBBLOCKS];
+    return energy / nb;
+}
+
+/** @internal @This closes a 100 ms sub-block and updates the gating
+ * histograms.
+ *
+ * @param loudness pointer to the state
+ */
+static void loudness_subblock(struct loudness *loudness)
+{
+    double energy = 0.;
+    for (unsigned int g = 0; g < loudness->groups; g++) {
+        struct loudness_group *group = &loudness->group[g];
+        lanes_t weighted = group->sum * group->weight;
+        for (int l = 0; l < LANES; l++)
+            energy += weighted[l];
+        group->sum = lanes_set(0.);
+    }
+    loudness->subblocks[loudness->subblock_idx] =
+        energy / loudness->subblock_frames;
+    loudness->subblock_idx = (loudness->subblock_idx + 1) %
+                             SHORTTERM_SUBBLOCKS;
+    loudness->nb_subblocks++;
+
+    /* 400 ms blocks overlap by 75 %, 3 s blocks are sampled at 10 Hz */
+    if (loudness->nb_subblocks >= MOMENTARY_SUBBLOCKS)
+        loudness_hist_add(&loudness->blocks,
+                loudness_window(loudness, MOMENTARY_SUBBLOCKS));
+    if (loudness->nb_subblocks >= SHORTTERM_SUBBLOCKS)
+        loudness_hist_add(&loudness->shortterms,
+                loudness_window(loudness, SHORTTERM_SUBBLOCKS));
+}
+
+/** @This feeds samples to a loudness measurement.
+ *
+ * @param loudness pointer to the state
+ * @param fmt sample format
+ * @param planes array of planes, either one interleaved plane or one plane
+ * per channel
+ * @param nb_planes number of planes
+ * @param frames number of samples per channel
+ */
+void loudness_add(struct loudness *loudness, enum loudness_fmt fmt,
+                  const void *const *planes, uint8_t nb_planes,
+                  size_t frames)
+{
+    size_t offset = 0;
+    while (frames) {
+        size_t chunk = loudness->subblock_frames - loudness->frames;
+        if (chunk > CHUNK)
+            chunk = CHUNK;
+        if (chunk > frames)
+            chunk = frames;
+
+        switch (fmt) {
+            case LOUDNESS_S16:
+                loudness_convert_s16(loudness, planes, nb_planes,
+                                     offset, chunk);
+                break;
+            case LOUDNESS_S32:
+                loudness_convert_s32(loudness, planes, nb_planes,
+                                     offset, chunk);
+                break;
+            case LOUDNESS_FLOAT:
+                loudness_convert_float(loudness, planes, nb_planes,
+                                       offset, chunk);
+                break;
+            case LOUDNESS_DOUBLE:
+                loudness_convert_double(loudness, planes, nb_planes,
+                                        offset, chunk);
+                break;
+            default:
+                return;
+        }
+
+        for (unsigned int g = 0; g < loudness->groups; g++)
+            loudness_filter(loudness, g, chunk);
+        loudness->tp_idx = (loudness->tp_idx + chunk) % TP_TAPS;
+
+        offset += chunk;
+        frames -= chunk;
+        loudness->frames += chunk;
+        if (loudness->frames == loudness->subblock_frames) {
+            loudness_subblock(loudness);
+            loudness->frames = 0;
+        }
+    }
+}
+
+/** @This returns the momentary loudness (400 ms window).
+ *
+ * @param loudness pointer to the state
+ * @return loudness in LUFS, or -HUGE_VAL if silent
+ */
+double loudness_momentary(struct loudness *loudness)
+{
+    return loudness_lufs(loudness_window(loudness, MOMENTARY_SUBBLOCKS));
+}
+
+/** @This returns the short-term loudness (3 s window).
+ *
+ * @param loudness pointer to the state
+ * @return loudness in LUFS, or -HUGE_VAL if silent
+ */
+double loudness_shortterm(struct loudness *loudness)
+{
+    return loudness_lufs(loudness_window(loudness, SHORTTERM_SUBBLOCKS));
+}
+
+/** @This returns the gated integrated loudness since the beginning.
+ *
+ * @param loudness pointer to the state
+ * @return loudness in LUFS, or -HUGE_VAL if silent
+ */
+double loudness_global(struct loudness *loudness)
+{
+    uint64_t count;
+    double energy;
+    if (loudness_hist_gate(&loudness->blocks, GLOBAL_GATE,
+                           &count, &energy) < 0)
+        return -HUGE_VAL;
+    return loudness_lufs(energy / count);
+}
+
+/** @This returns the loudness range (EBU Tech 3342) since the beginning.
+ *
+ * @param loudness pointer to the state
+ * @return loudness range in LU
+ */
+double loudness_range(struct loudness *loudness)
+{
+    const struct loudness_hist *hist = &loudness->shortterms;
+    uint64_t count;
+    double energy;
+    int start = loudness_hist_gate(hist, RANGE_GATE, &count, &energy);
+    if (start < 0)
+        return 0.;
+
+    uint64_t low = (count - 1) * 0.10 + 0.5;
+    uint64_t high = (count - 1) * 0.95 + 0.5;
+    int low_bin = -1, high_bin = -1;
+    uint64_t seen = 0;
+    for (int i = start; i < HIST_BINS && high_bin < 0; i++) {
+        seen += hist->count[i];
+        if (low_bin < 0 && seen > low)
+            low_bin = i;
+        if (seen > high)
+            high_bin = i;
+    }
+    return (high_bin - low_bin) / 10.;
+}
+
+/** @This returns the maximum true peak since the beginning, over all
+ * channels. If true peak was not requested, the sample peak is returned.
+ *
+ * @param loudness pointer to the state
+ * @return peak in dBTP, or -HUGE_VAL if silent
+ */
+double loudness_true_peak(struct loudness *loudness)
+{
+    double peak = 0.;
+    for (unsigned int g = 0; g < loudness->groups; g++)
+        for (int l = 0; l < LANES; l++)
+            if (loudness->group[g].peak[l] > peak)
+                peak = loudness->group[g].peak[l];
+    if (peak <= 0.)
+        return -HUGE_VAL;
+    return 10. * log10(peak);
+}
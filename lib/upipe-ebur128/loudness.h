@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short loudness measurement engine (EBU R128, ITU-R BS.1770-4)
+ * The K-weighting filters run channels in SIMD lanes, and the gating
+ * histograms make the integrated loudness and loudness range O(1) in
+ * memory whatever the duration of the measurement.
+ */
+
+#ifndef _UPIPE_EBUR128_LOUDNESS_H_
+/** @hidden */
+#define _UPIPE_EBUR128_LOUDNESS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/** @This is the opaque state of a loudness measurement. */
+struct loudness;
+
+/** @This enumerates the supported sample formats. */
+enum loudness_fmt {
+    /** signed 16 bits */
+    LOUDNESS_S16,
+    /** signed 32 bits */
+    LOUDNESS_S32,
+    /** 32 bits floating point */
+    LOUDNESS_FLOAT,
+    /** 64 bits floating point */
+    LOUDNESS_DOUBLE
+};
+
+/** @This allocates a loudness measurement.
+ *
+ * @param channels number of channels
+ * @param rate sampling rate in Hz
+ * @param true_peak true to measure the oversampled true peak
+ * @return pointer to the state, or NULL in case of error
+ */
+struct loudness *loudness_alloc(uint8_t channels, uint64_t rate,
+                                bool true_peak);
+
+/** @This frees a loudness measurement.
+ *
+ * @param loudness pointer to the state
+ */
+void loudness_free(struct loudness *loudness);
+
+/** @This feeds samples to a loudness measurement.
+ *
+ * @param loudness pointer to the state
+ * @param fmt sample format
+ * @param planes array of planes, either one interleaved plane or one plane
+ * per channel
+ * @param nb_planes number of planes
+ * @param frames number of samples per channel
+ */
+void loudness_add(struct loudness *loudness, enum loudness_fmt fmt,
+                  const void *const *planes, uint8_t nb_planes,
+                  size_t frames);
+
+/** @This returns the momentary loudness (400 ms window).
+ *
+ * @param loudness pointer to the state
+ * @return loudness in LUFS, or -HUGE_VAL if silent
+ */
+double loudness_momentary(struct loudness *loudness);
+
+/** @This returns the short-term loudness (3 s window).
+ *
+ * @param loudness pointer to the state
+ * @return loudness in LUFS, or -HUGE_VAL if silent
+ */
+double loudness_shortterm(struct loudness *loudness);
+
+/** @This returns the gated integrated loudness since the beginning.
+ *
+ * @param loudness pointer to the state
+ * @return loudness in LUFS, or -HUGE_VAL if silent
+ */
+double loudness_global(struct loudness *loudness);
+
+/** @This returns the loudness range (EBU Tech 3342) since the beginning.
+ *
+ * @param loudness pointer to the state
+ * @return loudness range in LU
+ */
+double loudness_range(struct loudness *loudness);
+
+/** @This returns the maximum true peak since the beginning, over all
+ * channels. If true peak was not requested, the sample peak is returned.
+ *
+ * @param loudness pointer to the state
+ * @return peak in dBTP, or -HUGE_VAL if silent
+ */
+double loudness_true_peak(struct loudness *loudness);
+
+#endif
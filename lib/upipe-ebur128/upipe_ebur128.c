@@ -46,15 +46,7 @@
 #include <stdint.h>
 #include <stdio.h>
 
-#include <ebur128.h>
-
-/** @internal supported sample formats */
-enum upipe_ebur128_fmt {
-    UPIPE_EBUR128_SHORT,
-    UPIPE_EBUR128_INT,
-    UPIPE_EBUR128_FLOAT,
-    UPIPE_EBUR128_DOUBLE
-};
+#include "loudness.h"
 
 /** @internal upipe_ebur128 private structure */
 struct upipe_ebur128 {
@@ -70,14 +62,18 @@ struct upipe_ebur128 {
     /** list of output requests */
     struct uchain request_list;
 
-    /** ebur128 state */
-    ebur128_state *st;
+    /** loudness measurement state */
+    struct loudness *st;
     /** number of channels */
     uint8_t channels;
     /** number of planes */
     uint8_t planes;
+    /** sampling rate */
+    uint64_t rate;
     /** sample format */
-    enum upipe_ebur128_fmt fmt;
+    enum loudness_fmt fmt;
+    /** true if the true peak is measured */
+    bool true_peak;
 
     /** public structure */
     struct upipe upipe;
@@ -108,6 +104,8 @@ static struct upipe *upipe_ebur128_alloc(struct upipe_mgr *mgr,
         return NULL;
     struct upipe_ebur128 *upipe_ebur128 = upipe_ebur128_from_upipe(upipe);
     upipe_ebur128->st = NULL;
+    upipe_ebur128->rate = 0;
+    upipe_ebur128->true_peak = false;
 
     upipe_ebur128_init_urefcount(upipe);
     upipe_ebur128_init_output(upipe);
@@ -125,9 +123,8 @@ static void upipe_ebur128_input(struct upipe *upipe, struct uref *uref,
                                 struct upump **upump_p)
 {
     struct upipe_ebur128 *upipe_ebur128 = upipe_ebur128_from_upipe(upipe);
-    double loud = 0, lra = 0, global = 0;
 
-    if (unlikely(upipe_ebur128->output_flow == NULL)) {
+    if (unlikely(upipe_ebur128->st == NULL)) {
         upipe_err_va(upipe, "invalid input");
         uref_free(uref);
         return;
@@ -141,82 +138,59 @@ static void upipe_ebur128_input(struct upipe *upipe, struct uref *uref,
         return;
     }
 
-    void *buf = NULL;
-    const char *channel = NULL;
-    if (upipe_ebur128->planes == 1) {
-        if (ubase_check(uref_sound_iterate_plane(uref, &channel)) && channel) {
-            if (unlikely(!ubase_check(uref_sound_plane_read_void(uref,
-                    channel, 0, -1, (const void **)&buf)))) {
-                upipe_warn(upipe, "error mapping sound buffer");
-                uref_free(uref);
-                return;
-            }
-        }
-
-    } else {
-        buf = malloc(sample_size * upipe_ebur128->channels * samples);
-        if (buf == NULL) {
-            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
-            uref_free(uref);
-            return;
-        }
-        if (!ubase_check(uref_sound_interleave(uref, (uint8_t *)buf, 0,
-                                               samples, sample_size,
-                                               upipe_ebur128->planes))) {
-            upipe_warn(upipe, "error mapping sound buffer");
-            uref_free(uref);
-            return;
-        }
-    }
-
-    if (unlikely((uintptr_t)buf & 1))
-        upipe_warn(upipe, "unaligned buffer");
-
-    switch (upipe_ebur128->fmt) {
-        case UPIPE_EBUR128_SHORT:
-            ebur128_add_frames_short(upipe_ebur128->st, (short *)buf,
-                                     samples);
-            break;
-
-        case UPIPE_EBUR128_INT:
-            ebur128_add_frames_int(upipe_ebur128->st, (int *)buf,
-                                   samples);
-            break;
-
-        case UPIPE_EBUR128_FLOAT:
-            ebur128_add_frames_float(upipe_ebur128->st, (float *)buf,
-                                     samples);
-            break;
-
-        case UPIPE_EBUR128_DOUBLE:
-            ebur128_add_frames_double(upipe_ebur128->st, (double *)buf,
-                                      samples);
-            break;
-
-        default:
-            upipe_warn_va(upipe, "unknown sample format %d",
-                          upipe_ebur128->fmt);
-            break;
+    const void *buffers[upipe_ebur128->planes];
+    if (unlikely(!ubase_check(uref_sound_read_void(uref, 0, -1, buffers,
+                                                   upipe_ebur128->planes)))) {
+        upipe_warn(upipe, "error mapping sound buffer");
+        uref_free(uref);
+        return;
     }
 
-    if (upipe_ebur128->planes == 1)
-        uref_sound_plane_unmap(uref, channel, 0, -1);
-    else
-        free(buf);
+    loudness_add(upipe_ebur128->st, upipe_ebur128->fmt, buffers,
+                 upipe_ebur128->planes, samples);
+    uref_sound_unmap(uref, 0, -1, upipe_ebur128->planes);
 
-    ebur128_loudness_momentary(upipe_ebur128->st, &loud);
-    ebur128_loudness_range(upipe_ebur128->st, &lra);
-    ebur128_loudness_global(upipe_ebur128->st, &global);
+    double loud = loudness_momentary(upipe_ebur128->st);
+    double shortterm = loudness_shortterm(upipe_ebur128->st);
+    double lra = loudness_range(upipe_ebur128->st);
+    double global = loudness_global(upipe_ebur128->st);
+    double peak = loudness_true_peak(upipe_ebur128->st);
 
     uref_ebur128_set_momentary(uref, loud);
+    uref_ebur128_set_shortterm(uref, shortterm);
     uref_ebur128_set_lra(uref, lra);
     uref_ebur128_set_global(uref, global);
+    uref_ebur128_set_truepeak(uref, peak);
 
-    upipe_verbose_va(upipe, "loud %f lra %f global %f", loud, lra, global);
+    upipe_verbose_va(upipe, "loud %f short %f lra %f global %f peak %f",
+                     loud, shortterm, lra, global, peak);
 
     upipe_ebur128_output(upipe, uref, upump_p);
 }
 
+/** @internal @This restarts the measurement.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static int upipe_ebur128_reset(struct upipe *upipe)
+{
+    struct upipe_ebur128 *upipe_ebur128 = upipe_ebur128_from_upipe(upipe);
+    loudness_free(upipe_ebur128->st);
+    upipe_ebur128->st = NULL;
+    if (!upipe_ebur128->rate)
+        return UBASE_ERR_NONE;
+
+    upipe_ebur128->st = loudness_alloc(upipe_ebur128->channels,
+                                       upipe_ebur128->rate,
+                                       upipe_ebur128->true_peak);
+    if (unlikely(upipe_ebur128->st == NULL)) {
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return UBASE_ERR_ALLOC;
+    }
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This sets the input flow definition.
  *
  * @param upipe description structure of the pipe
@@ -230,26 +204,27 @@ static int upipe_ebur128_set_flow_def(struct upipe *upipe,
     if (flow == NULL)
         return UBASE_ERR_INVALID;
 
-    enum upipe_ebur128_fmt fmt;
+    enum loudness_fmt fmt;
     const char *def;
     UBASE_RETURN(uref_flow_get_def(flow, &def))
     if (!ubase_ncmp(def, "sound.s16."))
-        fmt = UPIPE_EBUR128_SHORT;
+        fmt = LOUDNESS_S16;
     else if (!ubase_ncmp(def, "sound.s32."))
-        fmt = UPIPE_EBUR128_INT;
+        fmt = LOUDNESS_S32;
     else if (!ubase_ncmp(def, "sound.f32."))
-        fmt = UPIPE_EBUR128_FLOAT;
+        fmt = LOUDNESS_FLOAT;
     else if (!ubase_ncmp(def, "sound.f64."))
-        fmt = UPIPE_EBUR128_DOUBLE;
+        fmt = LOUDNESS_DOUBLE;
     else
         return UBASE_ERR_INVALID;
 
     uint64_t rate;
+    uint8_t channels, planes;
     if (unlikely(!ubase_check(uref_sound_flow_get_rate(flow, &rate)) ||
                  !ubase_check(uref_sound_flow_get_channels(flow,
-                     &upipe_ebur128->channels)) ||
-                 !ubase_check(uref_sound_flow_get_planes(flow,
-                     &upipe_ebur128->planes))))
+                     &channels)) ||
+                 !ubase_check(uref_sound_flow_get_planes(flow, &planes)) ||
+                 (planes != 1 && planes != channels)))
         return UBASE_ERR_INVALID;
 
     struct uref *flow_dup;
@@ -258,15 +233,18 @@ static int upipe_ebur128_set_flow_def(struct upipe *upipe,
         return UBASE_ERR_ALLOC;
     }
     upipe_ebur128->fmt = fmt;
-
-    if (unlikely(upipe_ebur128->st)) {
-        //ebur128_destroy(&upipe_ebur128->st);
-        ebur128_change_parameters(upipe_ebur128->st,
-                                  upipe_ebur128->channels, rate);
-    } else {
-        upipe_ebur128->st =
-            ebur128_init(upipe_ebur128->channels, rate,
-            EBUR128_MODE_LRA | EBUR128_MODE_I | EBUR128_MODE_HISTOGRAM);
+    upipe_ebur128->planes = planes;
+
+    /* the measurement goes on as long as the parameters do not change */
+    if (upipe_ebur128->st == NULL || upipe_ebur128->channels != channels ||
+        upipe_ebur128->rate != rate) {
+        upipe_ebur128->channels = channels;
+        upipe_ebur128->rate = rate;
+        int err = upipe_ebur128_reset(upipe);
+        if (unlikely(!ubase_check(err))) {
+            uref_free(flow_dup);
+            return err;
+        }
     }
 
     upipe_ebur128_store_flow_def(upipe, flow_dup);
@@ -322,6 +300,25 @@ static int upipe_ebur128_control(struct upipe *upipe,
         case UPIPE_GET_OUTPUT:
         case UPIPE_SET_OUTPUT:
             return upipe_ebur128_control_output(upipe, command, args);
+
+        case UPIPE_EBUR128_GET_TRUE_PEAK: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_EBUR128_SIGNATURE)
+            struct upipe_ebur128 *upipe_ebur128 =
+                upipe_ebur128_from_upipe(upipe);
+            int *enabled_p = va_arg(args, int *);
+            *enabled_p = upipe_ebur128->true_peak ? 1 : 0;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_EBUR128_SET_TRUE_PEAK: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_EBUR128_SIGNATURE)
+            struct upipe_ebur128 *upipe_ebur128 =
+                upipe_ebur128_from_upipe(upipe);
+            bool enabled = !!va_arg(args, int);
+            if (enabled == upipe_ebur128->true_peak)
+                return UBASE_ERR_NONE;
+            upipe_ebur128->true_peak = enabled;
+            return upipe_ebur128_reset(upipe);
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -334,9 +331,7 @@ static int upipe_ebur128_control(struct upipe *upipe,
 static void upipe_ebur128_free(struct upipe *upipe)
 {
     struct upipe_ebur128 *upipe_ebur128 = upipe_ebur128_from_upipe(upipe);
-    if (likely(upipe_ebur128->st)) {
-        ebur128_destroy(&upipe_ebur128->st);
-    }
+    loudness_free(upipe_ebur128->st);
     upipe_throw_dead(upipe);
 
     upipe_ebur128_clean_output(upipe);
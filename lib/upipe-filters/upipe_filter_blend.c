@@ -44,6 +44,7 @@
 #include <upipe/upipe_helper_ubuf_mgr.h>
 #include <upipe/upipe_helper_output.h>
 #include <upipe/upipe_helper_input.h>
+#include <upipe/upipe_helper_ujob_mgr.h>
 #include <upipe-filters/upipe_filter_blend.h>
 
 #include <stdlib.h>
@@ -88,6 +89,9 @@ struct upipe_filter_blend {
     /** list of blockers (used during udeal) */
     struct uchain blockers;
 
+    /** ujob manager to blend bands of lines in parallel */
+    struct ujob_mgr *ujob_mgr;
+
     /** public structure */
     struct upipe upipe;
 };
@@ -101,6 +105,7 @@ UPIPE_HELPER_UBUF_MGR(upipe_filter_blend, ubuf_mgr, flow_format,
                       upipe_filter_blend_register_output_request,
                       upipe_filter_blend_unregister_output_request)
 UPIPE_HELPER_INPUT(upipe_filter_blend, urefs, nb_urefs, max_urefs, blockers, upipe_filter_blend_handle)
+UPIPE_HELPER_UJOB_MGR(upipe_filter_blend, ujob_mgr)
 
 /** @internal @This allocates a filter pipe.
  *
@@ -123,6 +128,7 @@ static struct upipe *upipe_filter_blend_alloc(struct upipe_mgr *mgr,
     upipe_filter_blend_init_ubuf_mgr(upipe);
     upipe_filter_blend_init_output(upipe);
     upipe_filter_blend_init_input(upipe);
+    upipe_filter_blend_init_ujob_mgr(upipe);
     upipe_throw_ready(upipe);
     return upipe;
 }
@@ -168,25 +174,44 @@ static void upipe_filter_merge8bit( void *_dest, const void *_s1,
         *dest++ = ( *s1++ + *s2++ ) >> 1;
 }
 
-/** @internal @This processes a picture plane
+/** @internal @This is the context of a picture plane being processed. */
+struct upipe_filter_blend_plane {
+    /** input buffer */
+    const uint8_t *in;
+    /** output buffer */
+    uint8_t *out;
+    /** stride length of input buffer */
+    size_t stride_in;
+    /** stride length of output buffer */
+    size_t stride_out;
+    /** size of a macropixel in octets */
+    uint8_t macropixel_size;
+};
+
+/** @internal @This processes a band of lines of a picture plane
  * Adapted from VLC.
  * - modules/video_filter/deinterlace/algo_basic.c
  *
- * @param in input buffer
- * @param out output buffer
- * @param stride_in stride length of input buffer
- * @param stride_out stride length of output buffer
- * @param height picture height
+ * @param opaque pointer to struct upipe_filter_blend_plane
+ * @param line first line of the band
+ * @param lines number of lines in the band
  */
-static void upipe_filter_blend_plane(const uint8_t *in, uint8_t *out,
-                                     size_t stride_in, size_t stride_out,
-                                     size_t height, uint8_t macropixel_size)
+static void upipe_filter_blend_plane(void *opaque, size_t line, size_t lines)
 {
-    uint8_t *out_end = out + stride_out * height;
-
-    // Copy first line
-    memcpy(out, in, stride_in);
-    out += stride_out;
+    struct upipe_filter_blend_plane *plane = opaque;
+    size_t stride_in = plane->stride_in;
+    size_t stride_out = plane->stride_out;
+    uint8_t macropixel_size = plane->macropixel_size;
+    uint8_t *out = plane->out + stride_out * line;
+    uint8_t *out_end = out + stride_out * lines;
+
+    if (line == 0) {
+        // Copy first line
+        memcpy(out, plane->in, stride_in);
+        out += stride_out;
+        line++;
+    }
+    const uint8_t *in = plane->in + stride_in * (line - 1);
 
     // Compute mean value for remaining lines
     while (out < out_end) {
@@ -216,6 +241,7 @@ static bool upipe_filter_blend_handle(struct upipe *upipe, struct uref *uref,
     const char *def;
     if (unlikely(ubase_check(uref_flow_get_def(uref, &def)))) {
         upipe_filter_blend_store_flow_def(upipe, NULL);
+        upipe_filter_blend_check_ujob_mgr(upipe);
         upipe_filter_blend_require_ubuf_mgr(upipe, uref);
         return true;
     }
@@ -223,10 +249,9 @@ static bool upipe_filter_blend_handle(struct upipe *upipe, struct uref *uref,
     if (upipe_filter_blend->flow_def == NULL)
         return false;
 
-    const uint8_t *in;
-    uint8_t *out;
-    uint8_t hsub, vsub, macropixel_size;
-    size_t stride_in = 0, stride_out = 0, width, height;
+    struct upipe_filter_blend_plane plane;
+    uint8_t hsub, vsub;
+    size_t width, height;
     struct ubuf *ubuf_deint = NULL;
 
     // Now process frames
@@ -244,21 +269,22 @@ static bool upipe_filter_blend_handle(struct upipe *upipe, struct uref *uref,
     const char *chroma;
     uref_pic_foreach_plane(uref, chroma) {
         // map all
-        if (unlikely(!ubase_check(uref_pic_plane_size(uref, chroma, &stride_in,
-                                                &hsub, &vsub, &macropixel_size)))) {
+        if (unlikely(!ubase_check(uref_pic_plane_size(uref, chroma, &plane.stride_in,
+                                                &hsub, &vsub, &plane.macropixel_size)))) {
             upipe_err_va(upipe, "Could not read origin chroma %s", chroma);
             goto error;
         }
-        if (unlikely(!ubase_check(ubuf_pic_plane_size(ubuf_deint, chroma, &stride_out,
+        if (unlikely(!ubase_check(ubuf_pic_plane_size(ubuf_deint, chroma, &plane.stride_out,
                                                   NULL, NULL, NULL)))) {
             upipe_err_va(upipe, "Could not read dest chroma %s", chroma);
             goto error;
         }
-        uref_pic_plane_read(uref, chroma, 0, 0, -1, -1, &in);
-        ubuf_pic_plane_write(ubuf_deint, chroma, 0, 0, -1, -1, &out);
+        uref_pic_plane_read(uref, chroma, 0, 0, -1, -1, &plane.in);
+        ubuf_pic_plane_write(ubuf_deint, chroma, 0, 0, -1, -1, &plane.out);
 
         // process plane
-        upipe_filter_blend_plane(in, out, stride_in, stride_out, (size_t) height/vsub, macropixel_size);
+        upipe_filter_blend_run_bands(upipe, (size_t) height/vsub, 1,
+                                     upipe_filter_blend_plane, &plane);
 
         // unmap all
         uref_pic_plane_unmap(uref, chroma, 0, 0, -1, -1);
@@ -399,6 +425,7 @@ static void upipe_filter_blend_free(struct upipe *upipe)
     upipe_throw_dead(upipe);
 
     upipe_filter_blend_clean_input(upipe);
+    upipe_filter_blend_clean_ujob_mgr(upipe);
     upipe_filter_blend_clean_ubuf_mgr(upipe);
     upipe_filter_blend_clean_output(upipe);
     upipe_filter_blend_clean_urefcount(upipe);
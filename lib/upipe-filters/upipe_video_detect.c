@@ -0,0 +1,513 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe filter detecting black pictures, frozen video and scene
+ * changes
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/uprobe.h>
+#include <upipe/uclock.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_pic.h>
+#include <upipe/uref_pic_flow.h>
+#include <upipe/ubuf.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_void.h>
+#include <upipe/upipe_helper_output.h>
+#include <upipe-filters/upipe_video_detect.h>
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+/** we only accept pictures */
+#define EXPECTED_FLOW_DEF "pic."
+/** analyzed plane */
+#define LUMA_CHROMA "y8"
+/** number of pixels processed at once by the kernels, so that the compiler
+ * vectorizes the inner loops */
+#define KERNEL_BLOCK 16
+/** number of bins of the histogram */
+#define HIST_BINS 256
+/** number of bins grouped for the histogram difference */
+#define HIST_GROUP 4
+/** only one pixel out of this is accounted in the histogram */
+#define HIST_HSTEP 4
+/** default frame duration if unknown */
+#define DEFAULT_FRAME_DURATION (UCLOCK_FREQ / 25)
+
+/** @internal upipe_vdet private structure */
+struct upipe_vdet {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** output */
+    struct upipe *output;
+    /** output flow */
+    struct uref *flow_def;
+    /** output state */
+    enum upipe_helper_output_state output_state;
+    /** list of output requests */
+    struct uchain request_list;
+
+    /** duration of a frame, from the flow definition */
+    uint64_t frame_duration;
+
+    /** maximum luma of black pixels */
+    unsigned int black_level;
+    /** minimum ratio of black pixels in 1/1000 */
+    unsigned int black_ratio;
+    /** minimum duration of black pictures */
+    uint64_t black_duration;
+    /** maximum average absolute difference of frozen pictures in 1/256 */
+    unsigned int freeze_sad;
+    /** minimum duration of frozen pictures */
+    uint64_t freeze_duration;
+    /** minimum histogram difference of a scene change in 1/1000 */
+    unsigned int scene;
+    /** vertical subsampling step */
+    unsigned int step;
+
+    /** compared luma lines of the previous picture, kept in a private
+     * buffer so that the output pictures are not shared */
+    uint8_t *prev;
+    /** allocated size of the previous lines */
+    size_t prev_size;
+    /** horizontal size of the previous lines, or 0 if there are none */
+    size_t prev_hsize;
+    /** vertical size of the previous picture */
+    size_t prev_vsize;
+    /** vertical subsampling step of the previous lines */
+    unsigned int prev_step;
+    /** histogram of the previous picture */
+    uint32_t prev_hist[HIST_BINS];
+    /** number of pixels in the histogram of the previous picture */
+    uint64_t prev_hist_pixels;
+
+    /** current duration of black pictures */
+    uint64_t black_time;
+    /** true if a black picture was signaled */
+    bool black;
+    /** current duration of frozen pictures */
+    uint64_t freeze_time;
+    /** true if a frozen picture was signaled */
+    bool freeze;
+
+    /** public structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_vdet, upipe, UPIPE_VIDEO_DETECT_SIGNATURE);
+UPIPE_HELPER_UREFCOUNT(upipe_vdet, urefcount, upipe_vdet_free)
+UPIPE_HELPER_VOID(upipe_vdet)
+UPIPE_HELPER_OUTPUT(upipe_vdet, output, flow_def, output_state, request_list)
+
+/** @internal @This sums the pixels of a line.
+ *
+ * @param line pointer to the line
+ * @param width number of pixels
+ * @return sum of the pixels
+ */
+static uint64_t upipe_vdet_sum(const uint8_t *line, size_t width)
+{
+    uint64_t sum = 0;
+    size_t i = 0;
+    for ( ; i + KERNEL_BLOCK <= width; i += KERNEL_BLOCK) {
+        uint16_t block = 0;
+        for (int j = 0; j < KERNEL_BLOCK; j++)
+            block += line[i + j];
+        sum += block;
+    }
+    for ( ; i < width; i++)
+        sum += line[i];
+    return sum;
+}
+
+/** @internal @This computes the sum of absolute differences of two lines.
+ *
+ * @param line pointer to the line
+ * @param prev pointer to the line of the previous picture
+ * @param width number of pixels
+ * @return sum of absolute differences
+ */
+static uint64_t upipe_vdet_sad(const uint8_t *line, const uint8_t *prev,
+                               size_t width)
+{
+    uint64_t sad = 0;
+    size_t i = 0;
+    for ( ; i + KERNEL_BLOCK <= width; i += KERNEL_BLOCK) {
+        uint16_t block = 0;
+        for (int j = 0; j < KERNEL_BLOCK; j++)
+            block += abs(line[i + j] - prev[i + j]);
+        sad += block;
+    }
+    for ( ; i < width; i++)
+        sad += abs(line[i] - prev[i]);
+    return sad;
+}
+
+/** @internal @This accounts the pixels of a line in a histogram.
+ *
+ * @param line pointer to the line
+ * @param width number of pixels
+ * @param hist histogram
+ * @return number of accounted pixels
+ */
+static size_t upipe_vdet_hist(const uint8_t *line, size_t width,
+                              uint32_t *hist)
+{
+    size_t i;
+    for (i = 0; i < width; i += HIST_HSTEP)
+        hist[line[i]]++;
+    return (width + HIST_HSTEP - 1) / HIST_HSTEP;
+}
+
+/** @internal @This throws a detection event.
+ *
+ * @param upipe description structure of the pipe
+ * @param event event to throw
+ * @param uref picture triggering the event
+ * @param state 1 if the condition starts, 0 if it ends
+ * @return an error code
+ */
+static int upipe_vdet_throw_state(struct upipe *upipe, int event,
+                                  struct uref *uref, int state)
+{
+    upipe_notice_va(upipe, "%s %s", event == UPROBE_VDET_BLACK ?
+                    "black picture" : "frozen video",
+                    state ? "started" : "ended");
+    return upipe_throw(upipe, event, UPIPE_VIDEO_DETECT_SIGNATURE, uref,
+                       state);
+}
+
+/** @internal @This updates the state of a condition.
+ *
+ * @param upipe description structure of the pipe
+ * @param event event to throw
+ * @param uref current picture
+ * @param detected true if the condition is met by the current picture
+ * @param duration duration of the current picture
+ * @param min_duration minimum duration of the condition
+ * @param time_p pointer to the current duration of the condition
+ * @param state_p pointer to the signaled state
+ */
+static void upipe_vdet_update(struct upipe *upipe, int event,
+                              struct uref *uref, bool detected,
+                              uint64_t duration, uint64_t min_duration,
+                              uint64_t *time_p, bool *state_p)
+{
+    if (!detected) {
+        *time_p = 0;
+        if (*state_p) {
+            *state_p = false;
+            upipe_vdet_throw_state(upipe, event, uref, 0);
+        }
+        return;
+    }
+
+    *time_p += duration;
+    if (!*state_p && *time_p >= min_duration) {
+        *state_p = true;
+        upipe_vdet_throw_state(upipe, event, uref, 1);
+    }
+}
+
+/** @internal @This handles input.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to upump structure
+ */
+static void upipe_vdet_input(struct upipe *upipe, struct uref *uref,
+                             struct upump **upump_p)
+{
+    struct upipe_vdet *upipe_vdet = upipe_vdet_from_upipe(upipe);
+    size_t hsize, vsize, stride;
+    const uint8_t *luma;
+    if (unlikely(upipe_vdet->flow_def == NULL || uref->ubuf == NULL ||
+                 !ubase_check(uref_pic_size(uref, &hsize, &vsize, NULL)) ||
+                 !ubase_check(uref_pic_plane_size(uref, LUMA_CHROMA, &stride,
+                                                  NULL, NULL, NULL)) ||
+                 !ubase_check(uref_pic_plane_read(uref, LUMA_CHROMA, 0, 0,
+                                                  -1, -1, &luma)))) {
+        upipe_warn(upipe, "invalid picture received");
+        uref_free(uref);
+        return;
+    }
+    if (unlikely(!hsize || !vsize)) {
+        uref_pic_plane_unmap(uref, LUMA_CHROMA, 0, 0, -1, -1);
+        upipe_warn(upipe, "empty picture received");
+        uref_free(uref);
+        return;
+    }
+
+    /* the previous lines are only compared if they have the same size */
+    unsigned int step = upipe_vdet->step;
+    size_t lines_size = (vsize + step - 1) / step * hsize;
+    bool has_prev = upipe_vdet->prev_hsize == hsize &&
+                    upipe_vdet->prev_vsize == vsize &&
+                    upipe_vdet->prev_step == step;
+    if (!has_prev && upipe_vdet->prev_size < lines_size) {
+        uint8_t *prev = realloc(upipe_vdet->prev, lines_size);
+        if (unlikely(prev == NULL)) {
+            uref_pic_plane_unmap(uref, LUMA_CHROMA, 0, 0, -1, -1);
+            uref_free(uref);
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+        upipe_vdet->prev = prev;
+        upipe_vdet->prev_size = lines_size;
+    }
+
+    uint32_t hist[HIST_BINS];
+    memset(hist, 0, sizeof(hist));
+    uint64_t sum = 0, sad = 0, pixels = 0, hist_pixels = 0;
+    uint8_t *prev = upipe_vdet->prev;
+    for (size_t y = 0; y < vsize; y += step) {
+        const uint8_t *line = luma + y * stride;
+        sum += upipe_vdet_sum(line, hsize);
+        if (has_prev)
+            sad += upipe_vdet_sad(line, prev, hsize);
+        memcpy(prev, line, hsize);
+        prev += hsize;
+        hist_pixels += upipe_vdet_hist(line, hsize, hist);
+        pixels += hsize;
+    }
+    uref_pic_plane_unmap(uref, LUMA_CHROMA, 0, 0, -1, -1);
+    upipe_vdet->prev_hsize = hsize;
+    upipe_vdet->prev_vsize = vsize;
+    upipe_vdet->prev_step = step;
+
+    uint64_t black_pixels = 0;
+    for (unsigned int i = 0; i <= upipe_vdet->black_level && i < HIST_BINS;
+         i++)
+        black_pixels += hist[i];
+    bool black = black_pixels * 1000 >= upipe_vdet->black_ratio * hist_pixels;
+
+    uint64_t hist_diff = 0;
+    bool has_hist_diff = upipe_vdet->prev_hist_pixels != 0;
+    if (has_hist_diff) {
+        /* compare the normalized histograms, on groups of bins */
+        for (unsigned int i = 0; i < HIST_BINS; i += HIST_GROUP) {
+            int64_t cur = 0, prev_cur = 0;
+            for (unsigned int j = 0; j < HIST_GROUP; j++) {
+                cur += hist[i + j];
+                prev_cur += upipe_vdet->prev_hist[i + j];
+            }
+            int64_t diff = cur * upipe_vdet->prev_hist_pixels -
+                           prev_cur * hist_pixels;
+            hist_diff += diff < 0 ? -diff : diff;
+        }
+        hist_diff = hist_diff * 1000 / 2 /
+                    (hist_pixels * upipe_vdet->prev_hist_pixels);
+    }
+
+    uref_vdet_set_luma(uref, sum / pixels);
+    if (has_prev)
+        uref_vdet_set_sad(uref, sad * 256 / pixels);
+    if (has_hist_diff)
+        uref_vdet_set_hist(uref, hist_diff);
+
+    uint64_t duration;
+    if (!ubase_check(uref_clock_get_duration(uref, &duration)))
+        duration = upipe_vdet->frame_duration;
+
+    upipe_vdet_update(upipe, UPROBE_VDET_BLACK, uref, black, duration,
+                      upipe_vdet->black_duration, &upipe_vdet->black_time,
+                      &upipe_vdet->black);
+    upipe_vdet_update(upipe, UPROBE_VDET_FREEZE, uref,
+                      !black && has_prev &&
+                      sad * 256 <= upipe_vdet->freeze_sad * pixels,
+                      duration, upipe_vdet->freeze_duration,
+                      &upipe_vdet->freeze_time, &upipe_vdet->freeze);
+    if (has_hist_diff && hist_diff >= upipe_vdet->scene) {
+        upipe_verbose_va(upipe, "scene change (%"PRIu64"/1000)", hist_diff);
+        upipe_throw(upipe, UPROBE_VDET_SCENE_CHANGE,
+                    UPIPE_VIDEO_DETECT_SIGNATURE, uref);
+    }
+
+    memcpy(upipe_vdet->prev_hist, hist, sizeof(hist));
+    upipe_vdet->prev_hist_pixels = hist_pixels;
+
+    upipe_vdet_output(upipe, uref, upump_p);
+}
+
+/** @internal @This sets the input flow definition.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_def flow definition packet
+ * @return an error code
+ */
+static int upipe_vdet_set_flow_def(struct upipe *upipe, struct uref *flow_def)
+{
+    struct upipe_vdet *upipe_vdet = upipe_vdet_from_upipe(upipe);
+    if (flow_def == NULL)
+        return UBASE_ERR_INVALID;
+
+    uint8_t plane;
+    UBASE_RETURN(uref_flow_match_def(flow_def, EXPECTED_FLOW_DEF))
+    UBASE_RETURN(uref_pic_flow_find_chroma(flow_def, LUMA_CHROMA, &plane))
+
+    struct urational fps;
+    if (ubase_check(uref_pic_flow_get_fps(flow_def, &fps)) && fps.num)
+        upipe_vdet->frame_duration = UCLOCK_FREQ * fps.den / fps.num;
+    else
+        upipe_vdet->frame_duration = DEFAULT_FRAME_DURATION;
+
+    struct uref *flow_def_dup = uref_dup(flow_def);
+    UBASE_ALLOC_RETURN(flow_def_dup);
+    upipe_vdet_store_flow_def(upipe, flow_def_dup);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands on the pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_vdet_control(struct upipe *upipe, int command, va_list args)
+{
+    struct upipe_vdet *upipe_vdet = upipe_vdet_from_upipe(upipe);
+    UBASE_HANDLED_RETURN(upipe_vdet_control_output(upipe, command, args));
+
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            return upipe_vdet_set_flow_def(upipe, flow_def);
+        }
+        case UPIPE_VDET_SET_BLACK: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_VIDEO_DETECT_SIGNATURE)
+            upipe_vdet->black_level = va_arg(args, unsigned int);
+            upipe_vdet->black_ratio = va_arg(args, unsigned int);
+            upipe_vdet->black_duration = va_arg(args, uint64_t);
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_VDET_SET_FREEZE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_VIDEO_DETECT_SIGNATURE)
+            upipe_vdet->freeze_sad = va_arg(args, unsigned int);
+            upipe_vdet->freeze_duration = va_arg(args, uint64_t);
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_VDET_SET_SCENE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_VIDEO_DETECT_SIGNATURE)
+            upipe_vdet->scene = va_arg(args, unsigned int);
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_VDET_SET_STEP: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_VIDEO_DETECT_SIGNATURE)
+            unsigned int step = va_arg(args, unsigned int);
+            if (!step)
+                return UBASE_ERR_INVALID;
+            upipe_vdet->step = step;
+            return UBASE_ERR_NONE;
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @internal @This allocates a video detect pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_vdet_alloc(struct upipe_mgr *mgr,
+                                      struct uprobe *uprobe,
+                                      uint32_t signature, va_list args)
+{
+    struct upipe *upipe = upipe_vdet_alloc_void(mgr, uprobe, signature, args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_vdet *upipe_vdet = upipe_vdet_from_upipe(upipe);
+    upipe_vdet_init_urefcount(upipe);
+    upipe_vdet_init_output(upipe);
+    upipe_vdet->frame_duration = DEFAULT_FRAME_DURATION;
+    upipe_vdet->black_level = 32;
+    upipe_vdet->black_ratio = 980;
+    upipe_vdet->black_duration = 2 * UCLOCK_FREQ;
+    upipe_vdet->freeze_sad = 128;
+    upipe_vdet->freeze_duration = 2 * UCLOCK_FREQ;
+    upipe_vdet->scene = 400;
+    upipe_vdet->step = 4;
+    upipe_vdet->prev = NULL;
+    upipe_vdet->prev_size = 0;
+    upipe_vdet->prev_hsize = 0;
+    upipe_vdet->prev_vsize = 0;
+    upipe_vdet->prev_step = 0;
+    upipe_vdet->prev_hist_pixels = 0;
+    upipe_vdet->black_time = 0;
+    upipe_vdet->black = false;
+    upipe_vdet->freeze_time = 0;
+    upipe_vdet->freeze = false;
+
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @This frees a upipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_vdet_free(struct upipe *upipe)
+{
+    struct upipe_vdet *upipe_vdet = upipe_vdet_from_upipe(upipe);
+    upipe_throw_dead(upipe);
+
+    free(upipe_vdet->prev);
+    upipe_vdet_clean_output(upipe);
+    upipe_vdet_clean_urefcount(upipe);
+    upipe_vdet_free_void(upipe);
+}
+
+/** module manager static descriptor */
+static struct upipe_mgr upipe_vdet_mgr = {
+    .refcount = NULL,
+    .signature = UPIPE_VIDEO_DETECT_SIGNATURE,
+
+    .upipe_alloc = upipe_vdet_alloc,
+    .upipe_input = upipe_vdet_input,
+    .upipe_control = upipe_vdet_control,
+
+    .upipe_mgr_control = NULL
+};
+
+/** @This returns the management structure for video detect pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_vdet_mgr_alloc(void)
+{
+    return &upipe_vdet_mgr;
+}
@@ -0,0 +1,735 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe filter measuring the PSNR and SSIM of pictures
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/uprobe.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_pic.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_void.h>
+#include <upipe/upipe_helper_output.h>
+#include <upipe/upipe_helper_subpipe.h>
+#include <upipe-filters/upipe_video_quality.h>
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+/** we only accept pictures */
+#define EXPECTED_FLOW_DEF "pic."
+/** maximum number of measured planes */
+#define MAX_PLANES 4
+/** number of pixels processed at once by the PSNR kernel, so that the
+ * compiler vectorizes the inner loop */
+#define KERNEL_BLOCK 16
+/** size of the blocks of the SSIM kernel; SSIM windows are made of 2x2
+ * blocks and overlap by one block */
+#define SSIM_BLOCK 4
+/** SSIM stabilizing constants, scaled for the sums over 8x8 windows */
+#define SSIM_C1 (.01 * .01 * 255 * 255 * 64)
+/** SSIM stabilizing constants, scaled for the sums over 8x8 windows */
+#define SSIM_C2 (.03 * .03 * 255 * 255 * 64 * 63)
+/** PSNR of identical planes */
+#define PSNR_MAX 100.
+/** default number of pictures in a window */
+#define DEFAULT_WINDOW 25
+/** default maximum number of buffered reference pictures */
+#define DEFAULT_MAX_REFS 64
+
+/** @internal @This holds the statistics of a plane over a window. */
+struct upipe_vqual_stats {
+    /** sum of the PSNR */
+    double psnr;
+    /** number of PSNR measurements */
+    unsigned int nb_psnr;
+    /** sum of the SSIM */
+    double ssim;
+    /** number of SSIM measurements */
+    unsigned int nb_ssim;
+};
+
+/** @internal upipe_vqual private structure */
+struct upipe_vqual {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** output */
+    struct upipe *output;
+    /** output flow */
+    struct uref *flow_def;
+    /** output state */
+    enum upipe_helper_output_state output_state;
+    /** list of output requests */
+    struct uchain request_list;
+
+    /** number of measured pictures in a window */
+    unsigned int window;
+    /** subsampling step */
+    unsigned int step;
+    /** number of measured pictures in the current window */
+    unsigned int nb_measured;
+    /** statistics of the current window */
+    struct upipe_vqual_stats stats[MAX_PLANES];
+
+    /** SSIM sums of two rows of blocks */
+    uint32_t (*ssim_sums)[4];
+    /** number of blocks in a row of SSIM sums */
+    size_t ssim_blocks;
+
+    /** list of reference subpipes */
+    struct uchain subs;
+    /** manager to create reference subpipes */
+    struct upipe_mgr sub_mgr;
+
+    /** public structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_vqual, upipe, UPIPE_VIDEO_QUALITY_SIGNATURE);
+UPIPE_HELPER_UREFCOUNT(upipe_vqual, urefcount, upipe_vqual_free)
+UPIPE_HELPER_VOID(upipe_vqual)
+UPIPE_HELPER_OUTPUT(upipe_vqual, output, flow_def, output_state, request_list)
+
+/** @internal upipe_vqual_sub private structure */
+struct upipe_vqual_sub {
+    /** refcount management structure */
+    struct urefcount urefcount;
+    /** structure for double-linked lists */
+    struct uchain uchain;
+
+    /** buffered reference pictures, by increasing PTS */
+    struct uchain refs;
+    /** number of buffered reference pictures */
+    unsigned int nb_refs;
+    /** maximum number of buffered reference pictures */
+    unsigned int max_refs;
+
+    /** public structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_vqual_sub, upipe, UPIPE_VIDEO_QUALITY_SUB_SIGNATURE);
+UPIPE_HELPER_UREFCOUNT(upipe_vqual_sub, urefcount, upipe_vqual_sub_free)
+UPIPE_HELPER_VOID(upipe_vqual_sub)
+
+UPIPE_HELPER_SUBPIPE(upipe_vqual, upipe_vqual_sub, sub, sub_mgr, subs, uchain)
+
+/** @internal @This computes the sum of squared errors of two lines.
+ *
+ * @param line pointer to the line
+ * @param ref pointer to the line of the reference picture
+ * @param width number of pixels
+ * @return sum of squared errors
+ */
+static uint64_t upipe_vqual_sse(const uint8_t *line, const uint8_t *ref,
+                                size_t width)
+{
+    uint64_t sse = 0;
+    size_t i = 0;
+    for ( ; i + KERNEL_BLOCK <= width; i += KERNEL_BLOCK) {
+        uint32_t block = 0;
+        for (int j = 0; j < KERNEL_BLOCK; j++) {
+            int diff = line[i + j] - ref[i + j];
+            block += diff * diff;
+        }
+        sse += block;
+    }
+    for ( ; i < width; i++) {
+        int diff = line[i] - ref[i];
+        sse += diff * diff;
+    }
+    return sse;
+}
+
+/** @internal @This computes the SSIM sums of a row of blocks.
+ *
+ * @param line pointer to the first line of the row
+ * @param stride stride of the picture
+ * @param ref pointer to the first line of the row in the reference picture
+ * @param ref_stride stride of the reference picture
+ * @param blocks number of blocks in the row
+ * @param sums filled in with the sum of the reference pixels, the sum of
+ * the pixels, the sum of the squares and the sum of the products
+ */
+static void upipe_vqual_ssim_row(const uint8_t *line, size_t stride,
+                                 const uint8_t *ref, size_t ref_stride,
+                                 size_t blocks, uint32_t (*sums)[4])
+{
+    for (size_t b = 0; b < blocks; b++) {
+        uint32_t s1 = 0, s2 = 0, ss = 0, s12 = 0;
+        for (int y = 0; y < SSIM_BLOCK; y++) {
+            const uint8_t *p1 = ref + y * ref_stride + b * SSIM_BLOCK;
+            const uint8_t *p2 = line + y * stride + b * SSIM_BLOCK;
+            for (int x = 0; x < SSIM_BLOCK; x++) {
+                uint32_t a = p1[x], c = p2[x];
+                s1 += a;
+                s2 += c;
+                ss += a * a + c * c;
+                s12 += a * c;
+            }
+        }
+        sums[b][0] = s1;
+        sums[b][1] = s2;
+        sums[b][2] = ss;
+        sums[b][3] = s12;
+    }
+}
+
+/** @internal @This computes the SSIM of a window of 2x2 blocks.
+ *
+ * @param top SSIM sums of the top left block, followed by the top right one
+ * @param bottom SSIM sums of the bottom left block, followed by the bottom
+ * right one
+ * @return SSIM of the window
+ */
+static double upipe_vqual_ssim_window(const uint32_t (*top)[4],
+                                      const uint32_t (*bottom)[4])
+{
+    int64_t s[4];
+    for (int i = 0; i < 4; i++)
+        s[i] = (int64_t)top[0][i] + top[1][i] + bottom[0][i] + bottom[1][i];
+    int64_t vars = s[2] * 64 - s[0] * s[0] - s[1] * s[1];
+    int64_t covar = s[3] * 64 - s[0] * s[1];
+    return (2 * s[0] * s[1] + SSIM_C1) * (2 * covar + SSIM_C2) /
+           ((s[0] * s[0] + s[1] * s[1] + SSIM_C1) * (vars + SSIM_C2));
+}
+
+/** @internal @This computes the PSNR of a plane.
+ *
+ * @param upipe description structure of the pipe
+ * @param line pointer to the plane
+ * @param stride stride of the plane
+ * @param ref pointer to the plane of the reference picture
+ * @param ref_stride stride of the plane of the reference picture
+ * @param width width of the plane in pixels
+ * @param height height of the plane in lines
+ * @return PSNR in dB
+ */
+static double upipe_vqual_psnr(struct upipe *upipe,
+                               const uint8_t *line, size_t stride,
+                               const uint8_t *ref, size_t ref_stride,
+                               size_t width, size_t height)
+{
+    struct upipe_vqual *upipe_vqual = upipe_vqual_from_upipe(upipe);
+    uint64_t sse = 0, pixels = 0;
+    for (size_t y = 0; y < height; y += upipe_vqual->step) {
+        sse += upipe_vqual_sse(line + y * stride, ref + y * ref_stride,
+                               width);
+        pixels += width;
+    }
+    if (!sse)
+        return PSNR_MAX;
+    double psnr = 10. * log10(255. * 255. * pixels / sse);
+    return psnr < PSNR_MAX ? psnr : PSNR_MAX;
+}
+
+/** @internal @This computes the SSIM of a plane.
+ *
+ * @param upipe description structure of the pipe
+ * @param line pointer to the plane
+ * @param stride stride of the plane
+ * @param ref pointer to the plane of the reference picture
+ * @param ref_stride stride of the plane of the reference picture
+ * @param width width of the plane in pixels
+ * @param height height of the plane in lines
+ * @param ssim_p filled in with the SSIM
+ * @return an error code
+ */
+static int upipe_vqual_ssim(struct upipe *upipe,
+                            const uint8_t *line, size_t stride,
+                            const uint8_t *ref, size_t ref_stride,
+                            size_t width, size_t height, double *ssim_p)
+{
+    struct upipe_vqual *upipe_vqual = upipe_vqual_from_upipe(upipe);
+    size_t blocks = width / SSIM_BLOCK;
+    size_t rows = height / SSIM_BLOCK;
+    if (blocks < 2 || rows < 2)
+        return UBASE_ERR_INVALID;
+
+    if (blocks > upipe_vqual->ssim_blocks) {
+        uint32_t (*sums)[4] = realloc(upipe_vqual->ssim_sums,
+                                      2 * blocks * sizeof(*sums));
+        UBASE_ALLOC_RETURN(sums);
+        upipe_vqual->ssim_sums = sums;
+        upipe_vqual->ssim_blocks = blocks;
+    }
+
+    uint32_t (*top)[4] = upipe_vqual->ssim_sums;
+    uint32_t (*bottom)[4] = upipe_vqual->ssim_sums + blocks;
+    size_t top_row = SIZE_MAX;
+    double ssim = 0.;
+    uint64_t windows = 0;
+    for (size_t row = 0; row + 1 < rows; row += upipe_vqual->step) {
+        /* the bottom row is reused as the next top row if not subsampled */
+        if (top_row != row)
+            upipe_vqual_ssim_row(line + row * SSIM_BLOCK * stride, stride,
+                                 ref + row * SSIM_BLOCK * ref_stride,
+                                 ref_stride, blocks, top);
+        upipe_vqual_ssim_row(line + (row + 1) * SSIM_BLOCK * stride, stride,
+                             ref + (row + 1) * SSIM_BLOCK * ref_stride,
+                             ref_stride, blocks, bottom);
+        for (size_t b = 0; b + 1 < blocks; b++)
+            ssim += upipe_vqual_ssim_window(top + b,
+                    (const uint32_t (*)[4])bottom + b);
+        windows += blocks - 1;
+
+        uint32_t (*tmp)[4] = top;
+        top = bottom;
+        bottom = tmp;
+        top_row = row + 1;
+    }
+
+    *ssim_p = ssim / windows;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This measures a plane of a picture and tags the picture.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref distorted picture
+ * @param ref reference picture
+ * @param chroma chroma type of the plane
+ * @param plane index of the plane
+ * @return an error code
+ */
+static int upipe_vqual_measure_plane(struct upipe *upipe, struct uref *uref,
+                                     struct uref *ref, const char *chroma,
+                                     uint8_t plane)
+{
+    struct upipe_vqual *upipe_vqual = upipe_vqual_from_upipe(upipe);
+    size_t hsize, vsize, stride, ref_stride;
+    uint8_t hsub, vsub, mpixel_size, ref_hsub, ref_vsub, ref_mpixel_size;
+    UBASE_RETURN(uref_pic_size(uref, &hsize, &vsize, NULL))
+    UBASE_RETURN(uref_pic_plane_size(uref, chroma, &stride, &hsub, &vsub,
+                                     &mpixel_size))
+    UBASE_RETURN(uref_pic_plane_size(ref, chroma, &ref_stride, &ref_hsub,
+                                     &ref_vsub, &ref_mpixel_size))
+    if (mpixel_size != 1 || ref_mpixel_size != 1 ||
+        hsub != ref_hsub || vsub != ref_vsub)
+        return UBASE_ERR_INVALID;
+
+    const uint8_t *line, *ref_line;
+    UBASE_RETURN(uref_pic_plane_read(uref, chroma, 0, 0, -1, -1, &line))
+    if (unlikely(!ubase_check(uref_pic_plane_read(ref, chroma, 0, 0, -1, -1,
+                                                  &ref_line)))) {
+        uref_pic_plane_unmap(uref, chroma, 0, 0, -1, -1);
+        return UBASE_ERR_INVALID;
+    }
+
+    size_t width = hsize / hsub, height = vsize / vsub;
+    struct upipe_vqual_stats *stats = &upipe_vqual->stats[plane];
+    double psnr = upipe_vqual_psnr(upipe, line, stride, ref_line, ref_stride,
+                                   width, height);
+    uref_vqual_set_psnr(uref, psnr, plane);
+    stats->psnr += psnr;
+    stats->nb_psnr++;
+    uref_vqual_set_psnr_avg(uref, stats->psnr / stats->nb_psnr, plane);
+
+    double ssim;
+    if (ubase_check(upipe_vqual_ssim(upipe, line, stride, ref_line,
+                                     ref_stride, width, height, &ssim))) {
+        uref_vqual_set_ssim(uref, ssim, plane);
+        stats->ssim += ssim;
+        stats->nb_ssim++;
+        uref_vqual_set_ssim_avg(uref, stats->ssim / stats->nb_ssim, plane);
+    }
+
+    uref_pic_plane_unmap(uref, chroma, 0, 0, -1, -1);
+    uref_pic_plane_unmap(ref, chroma, 0, 0, -1, -1);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This measures a picture against its reference.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref distorted picture
+ * @param ref reference picture
+ */
+static void upipe_vqual_measure(struct upipe *upipe, struct uref *uref,
+                                struct uref *ref)
+{
+    struct upipe_vqual *upipe_vqual = upipe_vqual_from_upipe(upipe);
+    size_t hsize, vsize, ref_hsize, ref_vsize;
+    uint8_t macropixel, ref_macropixel;
+    if (unlikely(!ubase_check(uref_pic_size(uref, &hsize, &vsize,
+                                            &macropixel)) ||
+                 !ubase_check(uref_pic_size(ref, &ref_hsize, &ref_vsize,
+                                            &ref_macropixel)) ||
+                 hsize != ref_hsize || vsize != ref_vsize ||
+                 macropixel != 1 || ref_macropixel != 1)) {
+        upipe_warn(upipe, "incompatible reference picture");
+        return;
+    }
+
+    const char *chroma = NULL;
+    uint8_t plane = 0;
+    bool measured = false;
+    while (plane < MAX_PLANES &&
+           ubase_check(uref_pic_iterate_plane(uref, &chroma)) &&
+           chroma != NULL) {
+        if (ubase_check(upipe_vqual_measure_plane(upipe, uref, ref, chroma,
+                                                  plane)))
+            measured = true;
+        plane++;
+    }
+    if (!measured) {
+        upipe_warn(upipe, "no plane could be measured");
+        return;
+    }
+
+    if (++upipe_vqual->nb_measured < upipe_vqual->window)
+        return;
+
+    for (uint8_t i = 0; i < plane; i++) {
+        struct upipe_vqual_stats *stats = &upipe_vqual->stats[i];
+        if (stats->nb_psnr)
+            upipe_dbg_va(upipe, "plane %"PRIu8": PSNR %.2f dB, SSIM %.4f",
+                         i, stats->psnr / stats->nb_psnr,
+                         stats->nb_ssim ? stats->ssim / stats->nb_ssim : 0.);
+    }
+    upipe_throw(upipe, UPROBE_VQUAL_WINDOW, UPIPE_VIDEO_QUALITY_SIGNATURE,
+                uref);
+    upipe_vqual->nb_measured = 0;
+    memset(upipe_vqual->stats, 0, sizeof(upipe_vqual->stats));
+}
+
+/** @internal @This looks for the reference of a picture, and drops older
+ * reference pictures.
+ *
+ * @param upipe description structure of the pipe
+ * @param pts program PTS of the distorted picture
+ * @return reference picture, or NULL
+ */
+static struct uref *upipe_vqual_find_ref(struct upipe *upipe, uint64_t pts)
+{
+    struct upipe_vqual *upipe_vqual = upipe_vqual_from_upipe(upipe);
+    struct uchain *uchain;
+    ulist_foreach (&upipe_vqual->subs, uchain) {
+        struct upipe_vqual_sub *sub = upipe_vqual_sub_from_uchain(uchain);
+        struct uchain *ref_uchain;
+        while ((ref_uchain = ulist_peek(&sub->refs)) != NULL) {
+            struct uref *ref = uref_from_uchain(ref_uchain);
+            uint64_t ref_pts = 0;
+            uref_clock_get_pts_prog(ref, &ref_pts);
+            if (ref_pts > pts)
+                break;
+
+            ulist_pop(&sub->refs);
+            sub->nb_refs--;
+            if (ref_pts == pts)
+                return ref;
+            upipe_verbose_va(upipe_vqual_sub_to_upipe(sub),
+                             "dropping unmatched reference picture");
+            uref_free(ref);
+        }
+    }
+    return NULL;
+}
+
+/** @internal @This handles input.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to upump structure
+ */
+static void upipe_vqual_input(struct upipe *upipe, struct uref *uref,
+                              struct upump **upump_p)
+{
+    uint64_t pts;
+    struct uref *ref = NULL;
+    if (likely(uref->ubuf != NULL &&
+               ubase_check(uref_clock_get_pts_prog(uref, &pts))))
+        ref = upipe_vqual_find_ref(upipe, pts);
+
+    if (ref != NULL) {
+        upipe_vqual_measure(upipe, uref, ref);
+        uref_free(ref);
+    } else
+        upipe_verbose(upipe, "no reference picture");
+
+    upipe_vqual_output(upipe, uref, upump_p);
+}
+
+/** @internal @This sets the input flow definition.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_def flow definition packet
+ * @return an error code
+ */
+static int upipe_vqual_set_flow_def(struct upipe *upipe, struct uref *flow_def)
+{
+    if (flow_def == NULL)
+        return UBASE_ERR_INVALID;
+    UBASE_RETURN(uref_flow_match_def(flow_def, EXPECTED_FLOW_DEF))
+
+    struct uref *flow_def_dup = uref_dup(flow_def);
+    UBASE_ALLOC_RETURN(flow_def_dup);
+    upipe_vqual_store_flow_def(upipe, flow_def_dup);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands on the pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_vqual_control(struct upipe *upipe, int command, va_list args)
+{
+    struct upipe_vqual *upipe_vqual = upipe_vqual_from_upipe(upipe);
+    UBASE_HANDLED_RETURN(upipe_vqual_control_output(upipe, command, args));
+    UBASE_HANDLED_RETURN(upipe_vqual_control_subs(upipe, command, args));
+
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            return upipe_vqual_set_flow_def(upipe, flow_def);
+        }
+        case UPIPE_VQUAL_SET_WINDOW: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_VIDEO_QUALITY_SIGNATURE)
+            unsigned int window = va_arg(args, unsigned int);
+            if (!window)
+                return UBASE_ERR_INVALID;
+            upipe_vqual->window = window;
+            upipe_vqual->nb_measured = 0;
+            memset(upipe_vqual->stats, 0, sizeof(upipe_vqual->stats));
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_VQUAL_SET_STEP: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_VIDEO_QUALITY_SIGNATURE)
+            unsigned int step = va_arg(args, unsigned int);
+            if (!step)
+                return UBASE_ERR_INVALID;
+            upipe_vqual->step = step;
+            return UBASE_ERR_NONE;
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @internal @This allocates a reference subpipe of a video quality pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_vqual_sub_alloc(struct upipe_mgr *mgr,
+                                           struct uprobe *uprobe,
+                                           uint32_t signature, va_list args)
+{
+    struct upipe *upipe = upipe_vqual_sub_alloc_void(mgr, uprobe, signature,
+                                                     args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_vqual_sub *sub = upipe_vqual_sub_from_upipe(upipe);
+    upipe_vqual_sub_init_urefcount(upipe);
+    upipe_vqual_sub_init_sub(upipe);
+    ulist_init(&sub->refs);
+    sub->nb_refs = 0;
+    sub->max_refs = DEFAULT_MAX_REFS;
+
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @internal @This buffers a reference picture.
+ *
+ * @param upipe description structure of the subpipe
+ * @param uref uref structure
+ * @param upump_p reference to upump structure
+ */
+static void upipe_vqual_sub_input(struct upipe *upipe, struct uref *uref,
+                                  struct upump **upump_p)
+{
+    struct upipe_vqual_sub *sub = upipe_vqual_sub_from_upipe(upipe);
+    if (unlikely(uref->ubuf == NULL ||
+                 !ubase_check(uref_clock_get_pts_prog(uref, NULL)))) {
+        upipe_warn(upipe, "dropping non-dated reference picture");
+        uref_free(uref);
+        return;
+    }
+
+    if (sub->nb_refs >= sub->max_refs) {
+        upipe_warn(upipe, "too many reference pictures, dropping");
+        uref_free(uref_from_uchain(ulist_pop(&sub->refs)));
+        sub->nb_refs--;
+    }
+    ulist_add(&sub->refs, uref_to_uchain(uref));
+    sub->nb_refs++;
+}
+
+/** @internal @This processes control commands on a reference subpipe.
+ *
+ * @param upipe description structure of the subpipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_vqual_sub_control(struct upipe *upipe, int command,
+                                   va_list args)
+{
+    struct upipe_vqual_sub *sub = upipe_vqual_sub_from_upipe(upipe);
+    UBASE_HANDLED_RETURN(upipe_vqual_sub_control_super(upipe, command, args));
+
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            if (flow_def == NULL)
+                return UBASE_ERR_INVALID;
+            return uref_flow_match_def(flow_def, EXPECTED_FLOW_DEF);
+        }
+        case UPIPE_GET_MAX_LENGTH: {
+            unsigned int *p = va_arg(args, unsigned int *);
+            *p = sub->max_refs;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_SET_MAX_LENGTH: {
+            unsigned int max_refs = va_arg(args, unsigned int);
+            if (!max_refs)
+                return UBASE_ERR_INVALID;
+            sub->max_refs = max_refs;
+            return UBASE_ERR_NONE;
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This frees a reference subpipe.
+ *
+ * @param upipe description structure of the subpipe
+ */
+static void upipe_vqual_sub_free(struct upipe *upipe)
+{
+    struct upipe_vqual_sub *sub = upipe_vqual_sub_from_upipe(upipe);
+    upipe_throw_dead(upipe);
+
+    struct uchain *uchain;
+    while ((uchain = ulist_pop(&sub->refs)) != NULL)
+        uref_free(uref_from_uchain(uchain));
+    upipe_vqual_sub_clean_sub(upipe);
+    upipe_vqual_sub_clean_urefcount(upipe);
+    upipe_vqual_sub_free_void(upipe);
+}
+
+/** @internal @This initializes the reference subpipe manager.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_vqual_init_sub_mgr(struct upipe *upipe)
+{
+    struct upipe_vqual *upipe_vqual = upipe_vqual_from_upipe(upipe);
+    struct upipe_mgr *sub_mgr = &upipe_vqual->sub_mgr;
+    sub_mgr->refcount = upipe_vqual_to_urefcount(upipe_vqual);
+    sub_mgr->signature = UPIPE_VIDEO_QUALITY_SUB_SIGNATURE;
+    sub_mgr->upipe_alloc = upipe_vqual_sub_alloc;
+    sub_mgr->upipe_input = upipe_vqual_sub_input;
+    sub_mgr->upipe_control = upipe_vqual_sub_control;
+    sub_mgr->upipe_mgr_control = NULL;
+}
+
+/** @internal @This allocates a video quality pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_vqual_alloc(struct upipe_mgr *mgr,
+                                       struct uprobe *uprobe,
+                                       uint32_t signature, va_list args)
+{
+    struct upipe *upipe = upipe_vqual_alloc_void(mgr, uprobe, signature,
+                                                 args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_vqual *upipe_vqual = upipe_vqual_from_upipe(upipe);
+    upipe_vqual_init_urefcount(upipe);
+    upipe_vqual_init_output(upipe);
+    upipe_vqual_init_sub_mgr(upipe);
+    upipe_vqual_init_sub_subs(upipe);
+    upipe_vqual->window = DEFAULT_WINDOW;
+    upipe_vqual->step = 1;
+    upipe_vqual->nb_measured = 0;
+    memset(upipe_vqual->stats, 0, sizeof(upipe_vqual->stats));
+    upipe_vqual->ssim_sums = NULL;
+    upipe_vqual->ssim_blocks = 0;
+
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @This frees a upipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_vqual_free(struct upipe *upipe)
+{
+    struct upipe_vqual *upipe_vqual = upipe_vqual_from_upipe(upipe);
+    upipe_throw_dead(upipe);
+
+    free(upipe_vqual->ssim_sums);
+    upipe_vqual_clean_sub_subs(upipe);
+    upipe_vqual_clean_output(upipe);
+    upipe_vqual_clean_urefcount(upipe);
+    upipe_vqual_free_void(upipe);
+}
+
+/** module manager static descriptor */
+static struct upipe_mgr upipe_vqual_mgr = {
+    .refcount = NULL,
+    .signature = UPIPE_VIDEO_QUALITY_SIGNATURE,
+
+    .upipe_alloc = upipe_vqual_alloc,
+    .upipe_input = upipe_vqual_input,
+    .upipe_control = upipe_vqual_control,
+
+    .upipe_mgr_control = NULL
+};
+
+/** @This returns the management structure for video quality pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_vqual_mgr_alloc(void)
+{
+    return &upipe_vqual_mgr;
+}
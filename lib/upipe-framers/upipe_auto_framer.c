@@ -28,6 +28,7 @@
 #include <upipe/uprobe_prefix.h>
 #include <upipe/uref.h>
 #include <upipe/uref_flow.h>
+#include <upipe/uref_flow_hash.h>
 #include <upipe/upipe.h>
 #include <upipe/upipe_helper_upipe.h>
 #include <upipe/upipe_helper_void.h>
@@ -54,6 +55,19 @@
 #include <string.h>
 #include <assert.h>
 
+/** @internal maximum number of flow definition prefixes */
+#define UPIPE_AUTOF_MAX_FRAMERS 16
+
+/** @internal @This associates a flow definition prefix with a framer. */
+struct upipe_autof_framer {
+    /** pre-hashed flow definition prefix */
+    struct uref_flow_hash_key key;
+    /** pointer to the field of the framer manager */
+    struct upipe_mgr **mgr_p;
+    /** name of the framer in logs */
+    const char *name;
+};
+
 /** @internal @This is the private context of an autof manager. */
 struct upipe_autof_mgr {
     /** refcount management structure */
@@ -82,6 +96,11 @@ struct upipe_autof_mgr {
     /** pointer to s302f manager */
     struct upipe_mgr *s302f_mgr;
 
+    /** flow definition prefixes */
+    struct upipe_autof_framer framers[UPIPE_AUTOF_MAX_FRAMERS];
+    /** number of flow definition prefixes */
+    unsigned int nb_framers;
+
     /** public upipe_mgr structure */
     struct upipe_mgr mgr;
 };
@@ -162,85 +181,30 @@ static struct upipe *upipe_autof_alloc(struct upipe_mgr *mgr,
 /** @internal @This allocates the framer.
  *
  * @param upipe description structure of the pipe
- * @param def flow definition string
+ * @param flow_def flow definition packet
  * @return pointer to framer
  */
 static struct upipe *upipe_autof_alloc_framer(struct upipe *upipe,
-                                              const char *def)
+                                              struct uref *flow_def)
 {
     struct upipe_autof_mgr *autof_mgr =
         upipe_autof_mgr_from_upipe_mgr(upipe->mgr);
     struct upipe_autof *autof = upipe_autof_from_upipe(upipe);
 
-    if ((!ubase_ncmp(def, "block.mp2.") ||
-         !ubase_ncmp(def, "block.mp3.") ||
-         !ubase_ncmp(def, "block.aac.") ||
-         !ubase_ncmp(def, "block.aac_latm.")) &&
-        autof_mgr->mpgaf_mgr != NULL)
-        return upipe_void_alloc(autof_mgr->mpgaf_mgr,
-                uprobe_pfx_alloc(
-                    uprobe_use(&autof->last_inner_probe),
-                    UPROBE_LOG_VERBOSE, "mpgaf"));
-
-    if ((!ubase_ncmp(def, "block.ac3.") ||
-         !ubase_ncmp(def, "block.eac3.")) &&
-        autof_mgr->a52f_mgr != NULL)
-        return upipe_void_alloc(autof_mgr->a52f_mgr,
-                uprobe_pfx_alloc(
-                    uprobe_use(&autof->last_inner_probe),
-                    UPROBE_LOG_VERBOSE, "a52f"));
-
-    if ((!ubase_ncmp(def, "block.mpeg2video.") ||
-         !ubase_ncmp(def, "block.mpeg1video.")) &&
-        autof_mgr->mpgvf_mgr != NULL)
-        return upipe_void_alloc(autof_mgr->mpgvf_mgr,
-                uprobe_pfx_alloc(
-                    uprobe_use(&autof->last_inner_probe),
-                    UPROBE_LOG_VERBOSE, "mpgvf"));
-
-    if (!ubase_ncmp(def, "block.h264.") &&
-        autof_mgr->h264f_mgr != NULL)
-        return upipe_void_alloc(autof_mgr->h264f_mgr,
-                uprobe_pfx_alloc(
-                    uprobe_use(&autof->last_inner_probe),
-                    UPROBE_LOG_VERBOSE, "h264f"));
-
-    if (!ubase_ncmp(def, "block.hevc.") &&
-        autof_mgr->h265f_mgr != NULL)
-        return upipe_void_alloc(autof_mgr->h265f_mgr,
-                uprobe_pfx_alloc(
-                    uprobe_use(&autof->last_inner_probe),
-                    UPROBE_LOG_VERBOSE, "h265f"));
-
-    if (!ubase_ncmp(def, "block.dvb_teletext.") &&
-        autof_mgr->telxf_mgr != NULL)
-        return upipe_void_alloc(autof_mgr->telxf_mgr,
-                uprobe_pfx_alloc(
-                    uprobe_use(&autof->last_inner_probe),
-                    UPROBE_LOG_VERBOSE, "telxf"));
-
-    if (!ubase_ncmp(def, "block.dvb_subtitle.") &&
-        autof_mgr->dvbsubf_mgr != NULL)
-        return upipe_void_alloc(autof_mgr->dvbsubf_mgr,
-                uprobe_pfx_alloc(
-                    uprobe_use(&autof->last_inner_probe),
-                    UPROBE_LOG_VERBOSE, "dvbsubf"));
-
-    if (!ubase_ncmp(def, "block.opus.") &&
-        autof_mgr->opusf_mgr != NULL)
-        return upipe_void_alloc(autof_mgr->opusf_mgr,
-                uprobe_pfx_alloc(
-                    uprobe_use(&autof->last_inner_probe),
-                    UPROBE_LOG_VERBOSE, "opusf"));
-
-    if (!ubase_ncmp(def, "block.s302m.") &&
-        autof_mgr->s302f_mgr != NULL)
-        return upipe_void_alloc(autof_mgr->s302f_mgr,
-                uprobe_pfx_alloc(
-                    uprobe_use(&autof->last_inner_probe),
-                    UPROBE_LOG_VERBOSE, "s302f"));
-
-    upipe_warn_va(upipe, "unframed inner flow definition: %s", def);
+    struct uref_flow_hash hash;
+    if (unlikely(!ubase_check(uref_flow_hash_init_uref(&hash, flow_def))))
+        return NULL;
+    for (unsigned int i = 0; i < autof_mgr->nb_framers; i++) {
+        struct upipe_autof_framer *framer = &autof_mgr->framers[i];
+        if (*framer->mgr_p != NULL &&
+            uref_flow_hash_match(&hash, &framer->key))
+            return upipe_void_alloc(*framer->mgr_p,
+                    uprobe_pfx_alloc(
+                        uprobe_use(&autof->last_inner_probe),
+                        UPROBE_LOG_VERBOSE, framer->name));
+    }
+
+    upipe_warn_va(upipe, "unframed inner flow definition: %s", hash.def);
     return upipe_void_alloc(autof_mgr->idem_mgr,
             uprobe_pfx_alloc(
                 uprobe_use(&autof->last_inner_probe),
@@ -276,7 +240,7 @@ static int upipe_autof_set_flow_def(struct upipe *upipe, struct uref *flow_def)
     upipe_autof_store_bin_input(upipe, NULL);
     upipe_autof_store_bin_output(upipe, NULL);
 
-    struct upipe *inner = upipe_autof_alloc_framer(upipe, def);
+    struct upipe *inner = upipe_autof_alloc_framer(upipe, flow_def);
     if (unlikely(inner == NULL)) {
         upipe_err_va(upipe, "couldn't allocate framer");
         return UBASE_ERR_ALLOC;
@@ -416,6 +380,26 @@ static int upipe_autof_mgr_control(struct upipe_mgr *mgr,
     }
 }
 
+/** @internal @This registers a flow definition prefix.
+ *
+ * @param autof_mgr private context of the autof manager
+ * @param prefix flow definition prefix
+ * @param mgr_p pointer to the field of the framer manager
+ * @param name name of the framer in logs
+ */
+static void upipe_autof_mgr_add_framer(struct upipe_autof_mgr *autof_mgr,
+                                       const char *prefix,
+                                       struct upipe_mgr **mgr_p,
+                                       const char *name)
+{
+    assert(autof_mgr->nb_framers < UPIPE_AUTOF_MAX_FRAMERS);
+    struct upipe_autof_framer *framer =
+        &autof_mgr->framers[autof_mgr->nb_framers++];
+    uref_flow_hash_key_init(&framer->key, prefix);
+    framer->mgr_p = mgr_p;
+    framer->name = name;
+}
+
 /** @This returns the management structure for all auto framers.
  *
  * @return pointer to manager
@@ -438,6 +422,35 @@ struct upipe_mgr *upipe_autof_mgr_alloc(void)
     autof_mgr->opusf_mgr = upipe_opusf_mgr_alloc();
     autof_mgr->s302f_mgr = upipe_s302f_mgr_alloc();
 
+    upipe_autof_mgr_add_framer(autof_mgr, "block.mp2.",
+                               &autof_mgr->mpgaf_mgr, "mpgaf");
+    upipe_autof_mgr_add_framer(autof_mgr, "block.mp3.",
+                               &autof_mgr->mpgaf_mgr, "mpgaf");
+    upipe_autof_mgr_add_framer(autof_mgr, "block.aac.",
+                               &autof_mgr->mpgaf_mgr, "mpgaf");
+    upipe_autof_mgr_add_framer(autof_mgr, "block.aac_latm.",
+                               &autof_mgr->mpgaf_mgr, "mpgaf");
+    upipe_autof_mgr_add_framer(autof_mgr, "block.ac3.",
+                               &autof_mgr->a52f_mgr, "a52f");
+    upipe_autof_mgr_add_framer(autof_mgr, "block.eac3.",
+                               &autof_mgr->a52f_mgr, "a52f");
+    upipe_autof_mgr_add_framer(autof_mgr, "block.mpeg2video.",
+                               &autof_mgr->mpgvf_mgr, "mpgvf");
+    upipe_autof_mgr_add_framer(autof_mgr, "block.mpeg1video.",
+                               &autof_mgr->mpgvf_mgr, "mpgvf");
+    upipe_autof_mgr_add_framer(autof_mgr, "block.h264.",
+                               &autof_mgr->h264f_mgr, "h264f");
+    upipe_autof_mgr_add_framer(autof_mgr, "block.hevc.",
+                               &autof_mgr->h265f_mgr, "h265f");
+    upipe_autof_mgr_add_framer(autof_mgr, "block.dvb_teletext.",
+                               &autof_mgr->telxf_mgr, "telxf");
+    upipe_autof_mgr_add_framer(autof_mgr, "block.dvb_subtitle.",
+                               &autof_mgr->dvbsubf_mgr, "dvbsubf");
+    upipe_autof_mgr_add_framer(autof_mgr, "block.opus.",
+                               &autof_mgr->opusf_mgr, "opusf");
+    upipe_autof_mgr_add_framer(autof_mgr, "block.s302m.",
+                               &autof_mgr->s302f_mgr, "s302f");
+
     urefcount_init(upipe_autof_mgr_to_urefcount(autof_mgr),
                    upipe_autof_mgr_free);
     autof_mgr->mgr.refcount = upipe_autof_mgr_to_urefcount(autof_mgr);
@@ -90,6 +90,12 @@ struct upipe_h264f {
     enum uref_h26x_encaps encaps_output;
     /** complete input */
     bool complete_input;
+    /** true if A/53 captions are extracted */
+    bool captions;
+    /** cc_data extracted from the SEIs of the current access unit */
+    uint8_t cc_data[UPIPE_H26XF_CC_DATA_MAX];
+    /** size of the extracted cc_data */
+    size_t cc_size;
 
     /** flow format request */
     struct urequest request;
@@ -191,6 +197,8 @@ struct upipe_h264f {
     uint32_t frame_num;
     /** slice type */
     uint32_t slice_type;
+    /** true if the slices are used for reference (nal_ref_idc != 0) */
+    bool nal_ref;
     /** field pic */
     bool field_pic;
     /** bottom field */
@@ -322,6 +330,8 @@ static struct upipe *upipe_h264f_alloc(struct upipe_mgr *mgr,
     upipe_h264f->encaps_input = upipe_h264f->encaps_output =
         UREF_H26X_ENCAPS_ANNEXB;
     upipe_h264f->complete_input = false;
+    upipe_h264f->captions = false;
+    upipe_h264f->cc_size = 0;
     upipe_h264f->uref_output = NULL;
     upipe_h264f->annexb_header = NULL;
     upipe_h264f->annexb_aud = NULL;
@@ -355,6 +365,7 @@ static struct upipe *upipe_h264f_alloc(struct upipe_mgr *mgr,
         upipe_h264f->sps_ext[i] = NULL;
     }
     upipe_h264f->active_sps = -1;
+    upipe_h264f->nal_ref = true;
 
     for (i = 0; i < H264PPS_ID_MAX; i++)
         upipe_h264f->pps[i] = NULL;
@@ -1314,6 +1325,29 @@ static int upipe_h264f_handle_sei_pic_timing(struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This extracts the A/53 captions of a supplemental enhancement
+ * information, if enabled.
+ *
+ * @param upipe description structure of the pipe
+ * @param ubuf ubuf containing the NAL unit
+ * @param offset offset of the NAL unit in the ubuf
+ * @param size size of the NAL unit, in octets
+ */
+static void upipe_h264f_handle_sei_captions(struct upipe *upipe,
+                                            struct ubuf *ubuf,
+                                            size_t offset, size_t size)
+{
+    struct upipe_h264f *upipe_h264f = upipe_h264f_from_upipe(upipe);
+    if (!upipe_h264f->captions)
+        return;
+
+    int err = upipe_h26xf_extract_a53(ubuf, offset + 1, offset + size,
+                                      upipe_h264f->cc_data,
+                                      &upipe_h264f->cc_size);
+    if (unlikely(!ubase_check(err)))
+        upipe_warn(upipe, "invalid captions in SEI");
+}
+
 /** @internal @This handles a supplemental enhancement information.
  *
  * @param upipe description structure of the pipe
@@ -1434,6 +1468,7 @@ static int upipe_h264f_handle_slice(struct upipe *upipe, struct ubuf *ubuf,
     }
     upipe_h264f->frame_num = frame_num;
     upipe_h264f->slice_type = slice_type;
+    upipe_h264f->nal_ref = h264nalst_get_ref(nal) != 0;
     upipe_h264f->field_pic = field_pic;
     upipe_h264f->bf = bf;
     upipe_h264f->idr_pic_id = idr_pic_id;
@@ -1500,6 +1535,7 @@ static int upipe_h264f_handle_nal(struct upipe *upipe, struct ubuf *ubuf,
     upipe_verbose_va(upipe, "handling NAL %"PRIu8, h264nalst_get_type(nal));
     switch (h264nalst_get_type(nal)) {
         case H264NAL_TYPE_SEI:
+            upipe_h264f_handle_sei_captions(upipe, ubuf, offset, size);
             return upipe_h264f_handle_sei(upipe, ubuf, offset, size);
         case H264NAL_TYPE_SPS:
             return upipe_h264f_handle_sps(upipe, ubuf, offset, size);
@@ -1917,6 +1953,16 @@ static int upipe_h264f_prepare_au(struct upipe *upipe, struct uref *uref)
         default:
             break;
     }
+    /* AUs are split when nal_ref_idc switches from or to 0 */
+    if (!upipe_h264f->nal_ref)
+        UBASE_RETURN(uref_pic_set_discardable(uref))
+
+    if (upipe_h264f->cc_size) {
+        int err = uref_pic_set_cea_708(uref, upipe_h264f->cc_data,
+                                       upipe_h264f->cc_size);
+        upipe_h264f->cc_size = 0;
+        UBASE_RETURN(err)
+    }
 
     if (upipe_h264f->iframe_rap != UINT64_MAX)
         if (!ubase_check(uref_clock_set_rap_sys(uref, upipe_h264f->iframe_rap)))
@@ -2448,6 +2494,8 @@ static void upipe_h264f_work_annexb(struct upipe *upipe, struct upump **upump_p)
        return;
 
     upipe_h264f_end_annexb(upipe, upump_p);
+    /* the whole access unit is output, the next input starts afresh */
+    upipe_h264f->au_last_nal_offset = -1;
     struct uref *uref = upipe_h264f_prepare_annexb(upipe);
 
     if (uref == NULL)
@@ -2861,6 +2909,20 @@ static int upipe_h264f_control(struct upipe *upipe, int command, va_list args)
             struct uref *flow_def = va_arg(args, struct uref *);
             return upipe_h264f_set_flow_def(upipe, flow_def);
         }
+        case UPIPE_H264F_GET_CAPTIONS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_H264F_SIGNATURE)
+            struct upipe_h264f *upipe_h264f = upipe_h264f_from_upipe(upipe);
+            int *captions_p = va_arg(args, int *);
+            *captions_p = upipe_h264f->captions ? 1 : 0;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_H264F_SET_CAPTIONS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_H264F_SIGNATURE)
+            struct upipe_h264f *upipe_h264f = upipe_h264f_from_upipe(upipe);
+            upipe_h264f->captions = !!va_arg(args, int);
+            upipe_h264f->cc_size = 0;
+            return UBASE_ERR_NONE;
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
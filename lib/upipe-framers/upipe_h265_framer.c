@@ -90,6 +90,12 @@ struct upipe_h265f {
     enum uref_h26x_encaps encaps_output;
     /** complete input */
     bool complete_input;
+    /** true if A/53 captions are extracted */
+    bool captions;
+    /** cc_data extracted from the SEIs of the current access unit */
+    uint8_t cc_data[UPIPE_H26XF_CC_DATA_MAX];
+    /** size of the extracted cc_data */
+    size_t cc_size;
 
     /** flow format request */
     struct urequest request;
@@ -185,6 +191,11 @@ struct upipe_h265f {
     int pic_struct;
     /** slice type */
     uint32_t slice_type;
+    /** sps_max_sub_layers_minus1 of the active SPS */
+    uint8_t max_subl_1;
+    /** true if the picture is a sub-layer non-reference picture of the
+     * highest sub-layer */
+    bool discardable;
 
     /* octet stream stuff */
     /** next uref to be processed */
@@ -299,6 +310,8 @@ static struct upipe *upipe_h265f_alloc(struct upipe_mgr *mgr,
     upipe_h265f->encaps_input = upipe_h265f->encaps_output =
         UREF_H26X_ENCAPS_ANNEXB;
     upipe_h265f->complete_input = false;
+    upipe_h265f->captions = false;
+    upipe_h265f->cc_size = 0;
     upipe_h265f->uref_output = NULL;
     upipe_h265f->annexb_header = NULL;
     upipe_h265f->annexb_aud = NULL;
@@ -338,6 +351,8 @@ static struct upipe *upipe_h265f_alloc(struct upipe_mgr *mgr,
     for (i = 0; i < H265SPS_ID_MAX; i++)
         upipe_h265f->sps[i] = NULL;
     upipe_h265f->active_sps = -1;
+    upipe_h265f->max_subl_1 = 0;
+    upipe_h265f->discardable = false;
 
     for (i = 0; i < H265PPS_ID_MAX; i++)
         upipe_h265f->pps[i] = NULL;
@@ -1188,6 +1203,7 @@ static bool upipe_h265f_activate_sps(struct upipe *upipe, uint32_t sps_id)
     }
 
     upipe_h265f->active_sps = sps_id;
+    upipe_h265f->max_subl_1 = max_subl_1;
     ubuf_block_stream_clean(s);
 
     upipe_h265f_store_flow_def(upipe, NULL);
@@ -1428,6 +1444,29 @@ static int upipe_h265f_handle_sei_pic_timing(struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** @internal @This extracts the A/53 captions of a supplemental enhancement
+ * information, if enabled.
+ *
+ * @param upipe description structure of the pipe
+ * @param ubuf ubuf containing the NAL unit
+ * @param offset offset of the NAL unit in the ubuf
+ * @param size size of the NAL unit, in octets
+ */
+static void upipe_h265f_handle_sei_captions(struct upipe *upipe,
+                                            struct ubuf *ubuf,
+                                            size_t offset, size_t size)
+{
+    struct upipe_h265f *upipe_h265f = upipe_h265f_from_upipe(upipe);
+    if (!upipe_h265f->captions)
+        return;
+
+    int err = upipe_h26xf_extract_a53(ubuf, offset + 2, offset + size,
+                                      upipe_h265f->cc_data,
+                                      &upipe_h265f->cc_size);
+    if (unlikely(!ubase_check(err)))
+        upipe_warn(upipe, "invalid captions in SEI");
+}
+
 /** @internal @This handles a supplemental enhancement information.
  *
  * @param upipe description structure of the pipe
@@ -1528,6 +1567,14 @@ static int upipe_h265f_handle_slice(struct upipe *upipe, struct ubuf *ubuf,
         ubuf_block_stream_skip_bits(s,
                 upipe_h265f->num_extra_slice_header_bits);
         upipe_h265f->slice_type = upipe_h26xf_stream_ue(s);
+
+        /* sub-layer non-reference pictures (even VCL types below 16) are
+         * only referenced by higher sub-layers */
+        uint8_t tid_plus1 = 0;
+        if (last_nal_type < H265NAL_TYPE_BLA_W_LP && !(last_nal_type % 2))
+            ubuf_block_extract(ubuf, offset + 1, 1, &tid_plus1);
+        upipe_h265f->discardable =
+            (tid_plus1 & 0x7) == upipe_h265f->max_subl_1 + 1;
     }
 
     *au_slice_p = true;
@@ -1561,6 +1608,7 @@ static int upipe_h265f_handle_nal(struct upipe *upipe, struct ubuf *ubuf,
 
     switch (h265nalst_get_type(nal)) {
         case H265NAL_TYPE_PREF_SEI:
+            upipe_h265f_handle_sei_captions(upipe, ubuf, offset, size);
             return upipe_h265f_handle_sei(upipe, ubuf, offset, size);
             break;
         case H265NAL_TYPE_VPS:
@@ -1989,6 +2037,15 @@ static int upipe_h265f_prepare_au(struct upipe *upipe, struct uref *uref)
         default:
             break;
     }
+    if (upipe_h265f->discardable)
+        UBASE_FATAL(upipe, uref_pic_set_discardable(uref))
+
+    if (upipe_h265f->cc_size) {
+        int err = uref_pic_set_cea_708(uref, upipe_h265f->cc_data,
+                                       upipe_h265f->cc_size);
+        upipe_h265f->cc_size = 0;
+        UBASE_FATAL(upipe, err)
+    }
 
     if (upipe_h265f->iframe_rap != UINT64_MAX)
         if (!ubase_check(uref_clock_set_rap_sys(uref, upipe_h265f->iframe_rap)))
@@ -2484,6 +2541,8 @@ static void upipe_h265f_work_annexb(struct upipe *upipe, struct upump **upump_p)
        return;
 
     upipe_h265f_end_annexb(upipe, upump_p);
+    /* the whole access unit is output, the next input starts afresh */
+    upipe_h265f->au_last_nal_offset = -1;
     struct uref *uref = upipe_h265f_prepare_annexb(upipe);
 
     if (uref == NULL)
@@ -2843,6 +2902,20 @@ static int upipe_h265f_control(struct upipe *upipe, int command, va_list args)
             struct uref *flow_def = va_arg(args, struct uref *);
             return upipe_h265f_set_flow_def(upipe, flow_def);
         }
+        case UPIPE_H265F_GET_CAPTIONS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_H265F_SIGNATURE)
+            struct upipe_h265f *upipe_h265f = upipe_h265f_from_upipe(upipe);
+            int *captions_p = va_arg(args, int *);
+            *captions_p = upipe_h265f->captions ? 1 : 0;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_H265F_SET_CAPTIONS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_H265F_SIGNATURE)
+            struct upipe_h265f *upipe_h265f = upipe_h265f_from_upipe(upipe);
+            upipe_h265f->captions = !!va_arg(args, int);
+            upipe_h265f->cc_size = 0;
+            return UBASE_ERR_NONE;
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
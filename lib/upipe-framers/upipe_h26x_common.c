@@ -33,8 +33,16 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <inttypes.h>
 
+/** SEI payload type of registered user data (ITU-T T.35) */
+#define SEI_USER_DATA_REGISTERED 4
+/** size of the header of A/53 user data, up to em_data */
+#define A53_HEADER_SIZE 10
+/** maximum size of A/53 user data */
+#define A53_MAX_SIZE (A53_HEADER_SIZE + 31 * 3 + 1)
+
 /** @This translates the h26x aspect_ratio_idc to urational */
 const struct urational upipe_h26xf_sar_from_idc[17] = {
     { .num = 1, .den = 1 }, /* unspecified - treat as square */
@@ -136,6 +144,111 @@ int32_t upipe_h26xf_stream_se(struct ubuf_block_stream *s)
     return (v & 1) ? (v + 1) / 2 : -(v / 2);
 }
 
+/** @internal @This reads a SEI payload type or payload size.
+ *
+ * @param s ubuf block stream
+ * @param value_p filled in with the value
+ * @return an error code
+ */
+static int upipe_h26xf_stream_sei_value(struct ubuf_block_stream *s,
+                                        uint32_t *value_p)
+{
+    uint8_t octet;
+    *value_p = 0;
+    do {
+        UBASE_RETURN(upipe_h26xf_stream_get(s, &octet))
+        *value_p += octet;
+    } while (octet == UINT8_MAX);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This parses A/53 user data and appends its cc_data.
+ *
+ * @param p pointer to the registered user data
+ * @param size size of the registered user data
+ * @param cc_data buffer appended with the cc_data triplets
+ * @param cc_size_p size of the data in the buffer, updated
+ * @return an error code
+ */
+static int upipe_h26xf_parse_a53(const uint8_t *p, size_t size,
+                                 uint8_t *cc_data, size_t *cc_size_p)
+{
+    /* USA country code, ATSC provider code, GA94 identifier and cc_data
+     * type code */
+    static const uint8_t a53_header[] = {
+        0xb5, 0x00, 0x31, 'G', 'A', '9', '4', 0x03
+    };
+    if (size < A53_HEADER_SIZE ||
+        memcmp(p, a53_header, sizeof(a53_header)))
+        return UBASE_ERR_NONE;
+
+    /* process_cc_data_flag */
+    if (!(p[8] & 0x40))
+        return UBASE_ERR_NONE;
+    size_t cc_size = (p[8] & 0x1f) * 3;
+    if (A53_HEADER_SIZE + cc_size > size)
+        return UBASE_ERR_INVALID;
+    if (*cc_size_p + cc_size > UPIPE_H26XF_CC_DATA_MAX)
+        return UBASE_ERR_NOSPC;
+
+    memcpy(cc_data + *cc_size_p, p + A53_HEADER_SIZE, cc_size);
+    *cc_size_p += cc_size;
+    return UBASE_ERR_NONE;
+}
+
+/** @This extracts the cc_data triplets of ATSC A/53 captions from the
+ * registered user data messages of a SEI NAL unit, in the format of the
+ * p.cea_708 attribute.
+ *
+ * @param ubuf ubuf containing the NAL unit
+ * @param offset offset of the first SEI message in the ubuf
+ * @param end offset of the end of the NAL unit in the ubuf
+ * @param cc_data buffer of @ref UPIPE_H26XF_CC_DATA_MAX octets, appended with
+ * the cc_data triplets
+ * @param cc_size_p size of the data in the buffer, updated
+ * @return an error code
+ */
+int upipe_h26xf_extract_a53(struct ubuf *ubuf, size_t offset, size_t end,
+                            uint8_t *cc_data, size_t *cc_size_p)
+{
+    struct upipe_h26xf_stream f;
+    upipe_h26xf_stream_init(&f);
+    struct ubuf_block_stream *s = &f.s;
+    UBASE_RETURN(ubuf_block_stream_init(s, ubuf, offset))
+
+    int err = UBASE_ERR_NONE;
+    /* the last octet contains the RBSP trailing bits */
+    while (ubase_check(err) && ubuf_block_stream_position(s) / 8 + 1 < end) {
+        uint32_t type, size;
+        if (!ubase_check(upipe_h26xf_stream_sei_value(s, &type)) ||
+            !ubase_check(upipe_h26xf_stream_sei_value(s, &size)))
+            break;
+        if (ubuf_block_stream_position(s) / 8 + size > end) {
+            err = UBASE_ERR_INVALID;
+            break;
+        }
+
+        uint8_t payload[A53_MAX_SIZE];
+        uint32_t i;
+        for (i = 0; i < size; i++) {
+            uint8_t octet;
+            if (!ubase_check(upipe_h26xf_stream_get(s, &octet)))
+                break;
+            if (type == SEI_USER_DATA_REGISTERED && i < sizeof(payload))
+                payload[i] = octet;
+        }
+        if (i < size)
+            err = UBASE_ERR_INVALID;
+        else if (type == SEI_USER_DATA_REGISTERED)
+            err = upipe_h26xf_parse_a53(payload,
+                    size < sizeof(payload) ? size : sizeof(payload),
+                    cc_data, cc_size_p);
+    }
+
+    ubuf_block_stream_clean(s);
+    return err;
+}
+
 /** @This allocates a ubuf containing an annex B header.
  *
  * @param ubuf_mgr pointer to ubuf manager
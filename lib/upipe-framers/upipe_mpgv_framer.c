@@ -984,6 +984,7 @@ static bool upipe_mpgvf_handle_picture(struct upipe *upipe, struct uref *uref,
         case MP2VPIC_TYPE_B:
             if (upipe_mpgvf->ref_rap != UINT64_MAX)
                 uref_clock_set_rap_sys(uref, upipe_mpgvf->ref_rap);
+            UBASE_FATAL(upipe, uref_pic_set_discardable(uref))
             break;
 
         default:
@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short SMPTE 2022-6 (HBRMT) payload header and video source formats
+ */
+
+#ifndef _UPIPE_HBRMT_HBRMT_H_
+/** @hidden */
+#define _UPIPE_HBRMT_HBRMT_H_
+
+#include <upipe/ubase.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** size of the HBRMT payload header, without video timestamp */
+#define HBRMT_HEADER_SIZE 8
+/** size of the SDI data carried in each datagram */
+#define HBRMT_DATA_SIZE 1376
+/** default dynamic RTP payload type */
+#define HBRMT_RTP_TYPE 98
+/** 4:2:2 10 bits sampling */
+#define HBRMT_SAMPLE_422_10 0x1
+
+/** @This initializes an HBRMT header: no extension, primary stream, no
+ * scrambling, no FEC and no video timestamp.
+ *
+ * @param p pointer to the header
+ */
+static inline void hbrmt_set_hdr(uint8_t *p)
+{
+    p[0] = p[1] = p[2] = p[3] = 0;
+    p[4] = p[5] = p[6] = p[7] = 0;
+}
+
+static inline uint8_t hbrmt_get_ext(const uint8_t *p)
+{
+    return p[0] >> 4;
+}
+
+static inline void hbrmt_set_video_source_format(uint8_t *p)
+{
+    p[0] |= 0x08;
+}
+
+static inline bool hbrmt_check_video_source_format(const uint8_t *p)
+{
+    return !!(p[0] & 0x08);
+}
+
+static inline void hbrmt_set_frcount(uint8_t *p, uint8_t frcount)
+{
+    p[1] = frcount;
+}
+
+static inline uint8_t hbrmt_get_frcount(const uint8_t *p)
+{
+    return p[1];
+}
+
+static inline uint8_t hbrmt_get_clock_frequency(const uint8_t *p)
+{
+    return ((p[2] & 0x1) << 3) | (p[3] >> 5);
+}
+
+static inline void hbrmt_set_frame(uint8_t *p, uint8_t frame)
+{
+    p[4] = (p[4] & 0xf0) | (frame >> 4);
+    p[5] = (p[5] & 0x0f) | (frame << 4);
+}
+
+static inline uint8_t hbrmt_get_frame(const uint8_t *p)
+{
+    return (p[4] << 4) | (p[5] >> 4);
+}
+
+static inline void hbrmt_set_frate(uint8_t *p, uint8_t frate)
+{
+    p[5] = (p[5] & 0xf0) | (frate >> 4);
+    p[6] = (p[6] & 0x0f) | (frate << 4);
+}
+
+static inline uint8_t hbrmt_get_frate(const uint8_t *p)
+{
+    return (p[5] << 4) | (p[6] >> 4);
+}
+
+static inline void hbrmt_set_sample(uint8_t *p, uint8_t sample)
+{
+    p[6] = (p[6] & 0xf0) | (sample & 0xf);
+}
+
+static inline uint8_t hbrmt_get_sample(const uint8_t *p)
+{
+    return p[6] & 0xf;
+}
+
+/** @This describes an SDI video source format. */
+struct hbrmt_format {
+    /** FRAME code */
+    uint8_t frame;
+    /** FRATE code */
+    uint8_t frate;
+    /** active width */
+    uint16_t hsize;
+    /** active height */
+    uint16_t vsize;
+    /** true for progressive formats */
+    bool progressive;
+    /** frames per second */
+    struct urational fps;
+    /** total number of samples per line */
+    uint16_t total_hsize;
+    /** total number of lines */
+    uint16_t total_vsize;
+};
+
+/** @This is the list of supported video source formats; the FRATE code
+ * describes the frame rate, including for interlaced formats. */
+static const struct hbrmt_format hbrmt_formats[] = {
+    { 0x10, 0x16, 720, 486, false, { 30000, 1001 }, 858, 525 },
+    { 0x11, 0x17, 720, 576, false, { 25, 1 }, 864, 625 },
+    { 0x20, 0x15, 1920, 1080, false, { 30, 1 }, 2200, 1125 },
+    { 0x20, 0x16, 1920, 1080, false, { 30000, 1001 }, 2200, 1125 },
+    { 0x20, 0x17, 1920, 1080, false, { 25, 1 }, 2640, 1125 },
+    { 0x21, 0x10, 1920, 1080, true, { 60, 1 }, 2200, 1125 },
+    { 0x21, 0x11, 1920, 1080, true, { 60000, 1001 }, 2200, 1125 },
+    { 0x21, 0x12, 1920, 1080, true, { 50, 1 }, 2640, 1125 },
+    { 0x21, 0x15, 1920, 1080, true, { 30, 1 }, 2200, 1125 },
+    { 0x21, 0x16, 1920, 1080, true, { 30000, 1001 }, 2200, 1125 },
+    { 0x21, 0x17, 1920, 1080, true, { 25, 1 }, 2640, 1125 },
+    { 0x21, 0x18, 1920, 1080, true, { 24, 1 }, 2750, 1125 },
+    { 0x21, 0x19, 1920, 1080, true, { 24000, 1001 }, 2750, 1125 },
+    { 0x30, 0x10, 1280, 720, true, { 60, 1 }, 1650, 750 },
+    { 0x30, 0x11, 1280, 720, true, { 60000, 1001 }, 1650, 750 },
+    { 0x30, 0x12, 1280, 720, true, { 50, 1 }, 1980, 750 },
+};
+
+/** @This returns the size of a packed 4:2:2 10 bits frame.
+ *
+ * @param format video source format
+ * @return size in octets
+ */
+static inline size_t hbrmt_frame_size(const struct hbrmt_format *format)
+{
+    /* one luma and one chroma word of 10 bits per sample */
+    return (size_t)format->total_hsize * format->total_vsize * 2 * 10 / 8;
+}
+
+/** @This finds a video source format from its codes.
+ *
+ * @param frame FRAME code
+ * @param frate FRATE code
+ * @return pointer to the format, or NULL
+ */
+static inline const struct hbrmt_format *hbrmt_find_codes(uint8_t frame,
+                                                           uint8_t frate)
+{
+    for (unsigned i = 0; i < UBASE_ARRAY_SIZE(hbrmt_formats); i++)
+        if (hbrmt_formats[i].frame == frame &&
+            hbrmt_formats[i].frate == frate)
+            return &hbrmt_formats[i];
+    return NULL;
+}
+
+/** @This finds a video source format from picture parameters.
+ *
+ * @param hsize active width
+ * @param vsize active height
+ * @param fps frames per second
+ * @param progressive true for progressive pictures
+ * @return pointer to the format, or NULL
+ */
+static inline const struct hbrmt_format *
+    hbrmt_find_format(uint64_t hsize, uint64_t vsize,
+                      struct urational fps, bool progressive)
+{
+    for (unsigned i = 0; i < UBASE_ARRAY_SIZE(hbrmt_formats); i++)
+        if (hbrmt_formats[i].hsize == hsize &&
+            hbrmt_formats[i].vsize == vsize &&
+            hbrmt_formats[i].progressive == progressive &&
+            !urational_cmp(&hbrmt_formats[i].fps, &fps))
+            return &hbrmt_formats[i];
+    return NULL;
+}
+
+#endif
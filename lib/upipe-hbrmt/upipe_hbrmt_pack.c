@@ -0,0 +1,467 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe module packing SDI frames into SMPTE 2022-6 RTP datagrams
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/uprobe.h>
+#include <upipe/uref.h>
+#include <upipe/ubuf.h>
+#include <upipe/upipe.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_pic.h>
+#include <upipe/uref_pic_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/uref_block.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_void.h>
+#include <upipe/upipe_helper_ubuf_mgr.h>
+#include <upipe/upipe_helper_output.h>
+#include <upipe/upipe_helper_input.h>
+
+#include <upipe-hbrmt/upipe_hbrmt_pack.h>
+
+#include <string.h>
+
+#include <bitstream/ietf/rtp.h>
+
+#include "hbrmt.h"
+
+/** we only accept blocks */
+#define EXPECTED_FLOW_DEF "block."
+/** we output RTP datagrams */
+#define OUTPUT_FLOW_DEF "block.rtp.hbrmt."
+/** size of the RTP and HBRMT headers */
+#define HEADER_SIZE (RTP_HEADER_SIZE + HBRMT_HEADER_SIZE)
+
+/** upipe_hbrmt_pack structure */
+struct upipe_hbrmt_pack {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** ubuf manager */
+    struct ubuf_mgr *ubuf_mgr;
+    /** flow format packet */
+    struct uref *flow_format;
+    /** ubuf manager request */
+    struct urequest ubuf_mgr_request;
+
+    /** output pipe */
+    struct upipe *output;
+    /** flow_definition packet */
+    struct uref *flow_def;
+    /** output state */
+    enum upipe_helper_output_state output_state;
+    /** list of output requests */
+    struct uchain request_list;
+
+    /** temporary uref storage (used during urequest) */
+    struct uchain urefs;
+    /** nb urefs in storage */
+    unsigned int nb_urefs;
+    /** max urefs in storage */
+    unsigned int max_urefs;
+    /** list of blockers (used during udeal) */
+    struct uchain blockers;
+
+    /** video source format, or NULL if unknown */
+    const struct hbrmt_format *format;
+    /** RTP sequence number of the next datagram */
+    uint16_t seqnum;
+    /** frame counter */
+    uint8_t frcount;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+/** @hidden */
+static bool upipe_hbrmt_pack_handle(struct upipe *upipe, struct uref *uref,
+                                    struct upump **upump_p);
+/** @hidden */
+static int upipe_hbrmt_pack_check(struct upipe *upipe,
+                                  struct uref *flow_format);
+
+UPIPE_HELPER_UPIPE(upipe_hbrmt_pack, upipe, UPIPE_HBRMT_PACK_SIGNATURE);
+UPIPE_HELPER_UREFCOUNT(upipe_hbrmt_pack, urefcount, upipe_hbrmt_pack_free);
+UPIPE_HELPER_VOID(upipe_hbrmt_pack);
+UPIPE_HELPER_OUTPUT(upipe_hbrmt_pack, output, flow_def, output_state,
+                    request_list)
+UPIPE_HELPER_UBUF_MGR(upipe_hbrmt_pack, ubuf_mgr, flow_format,
+                      ubuf_mgr_request, upipe_hbrmt_pack_check,
+                      upipe_hbrmt_pack_register_output_request,
+                      upipe_hbrmt_pack_unregister_output_request)
+UPIPE_HELPER_INPUT(upipe_hbrmt_pack, urefs, nb_urefs, max_urefs, blockers,
+                   upipe_hbrmt_pack_handle)
+
+/** @internal @This finds the video source format of a flow definition.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_def flow definition packet
+ */
+static void upipe_hbrmt_pack_parse_flow_def(struct upipe *upipe,
+                                            struct uref *flow_def)
+{
+    struct upipe_hbrmt_pack *upipe_hbrmt_pack =
+        upipe_hbrmt_pack_from_upipe(upipe);
+    uint64_t hsize, vsize;
+    struct urational fps;
+
+    upipe_hbrmt_pack->format = NULL;
+    if (ubase_check(uref_pic_flow_get_hsize(flow_def, &hsize)) &&
+        ubase_check(uref_pic_flow_get_vsize(flow_def, &vsize)) &&
+        ubase_check(uref_pic_flow_get_fps(flow_def, &fps)))
+        upipe_hbrmt_pack->format =
+            hbrmt_find_format(hsize, vsize, fps,
+                              ubase_check(uref_pic_get_progressive(flow_def)));
+
+    if (upipe_hbrmt_pack->format == NULL)
+        upipe_warn(upipe, "unknown video source format");
+}
+
+/** @internal @This outputs one datagram.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure describing the frame
+ * @param offset offset of the payload in the frame
+ * @param size size of the payload
+ * @param last true for the last datagram of the frame
+ * @param timestamp RTP timestamp
+ * @param upump_p reference to pump that generated the buffer
+ * @return an error code
+ */
+static int upipe_hbrmt_pack_output_datagram(struct upipe *upipe,
+                                            struct uref *uref, int offset,
+                                            int size, bool last,
+                                            uint32_t timestamp,
+                                            struct upump **upump_p)
+{
+    struct upipe_hbrmt_pack *upipe_hbrmt_pack =
+        upipe_hbrmt_pack_from_upipe(upipe);
+    const struct hbrmt_format *format = upipe_hbrmt_pack->format;
+
+    struct ubuf *payload = ubuf_block_splice(uref->ubuf, offset, size);
+    UBASE_ALLOC_RETURN(payload);
+    if (size < HBRMT_DATA_SIZE) {
+        /* the last datagram of the frame is padded */
+        struct ubuf *padding = ubuf_block_alloc(upipe_hbrmt_pack->ubuf_mgr,
+                                                HBRMT_DATA_SIZE - size);
+        uint8_t *buffer;
+        int padding_size = -1;
+        if (unlikely(padding == NULL ||
+                     !ubase_check(ubuf_block_write(padding, 0, &padding_size,
+                                                   &buffer)))) {
+            if (padding != NULL)
+                ubuf_free(padding);
+            ubuf_free(payload);
+            return UBASE_ERR_ALLOC;
+        }
+        memset(buffer, 0, padding_size);
+        ubuf_block_unmap(padding, 0);
+        ubuf_block_append(payload, padding);
+    }
+
+    struct ubuf *ubuf = ubuf_block_alloc(upipe_hbrmt_pack->ubuf_mgr,
+                                         HEADER_SIZE);
+    if (unlikely(ubuf == NULL)) {
+        ubuf_free(payload);
+        return UBASE_ERR_ALLOC;
+    }
+
+    uint8_t *buffer;
+    int buffer_size = -1;
+    if (unlikely(!ubase_check(ubuf_block_write(ubuf, 0, &buffer_size,
+                                               &buffer)))) {
+        ubuf_free(ubuf);
+        ubuf_free(payload);
+        return UBASE_ERR_INVALID;
+    }
+    memset(buffer, 0, HEADER_SIZE);
+    rtp_set_hdr(buffer);
+    rtp_set_type(buffer, HBRMT_RTP_TYPE);
+    rtp_set_seqnum(buffer, upipe_hbrmt_pack->seqnum++);
+    rtp_set_timestamp(buffer, timestamp);
+    if (last)
+        rtp_set_marker(buffer);
+
+    uint8_t *hbrmt = buffer + RTP_HEADER_SIZE;
+    hbrmt_set_hdr(hbrmt);
+    hbrmt_set_frcount(hbrmt, upipe_hbrmt_pack->frcount);
+    if (format != NULL) {
+        hbrmt_set_video_source_format(hbrmt);
+        hbrmt_set_frame(hbrmt, format->frame);
+        hbrmt_set_frate(hbrmt, format->frate);
+        hbrmt_set_sample(hbrmt, HBRMT_SAMPLE_422_10);
+    }
+    ubuf_block_unmap(ubuf, 0);
+    ubuf_block_append(ubuf, payload);
+
+    struct uref *output = uref_fork(uref, ubuf);
+    if (unlikely(output == NULL)) {
+        ubuf_free(ubuf);
+        return UBASE_ERR_ALLOC;
+    }
+    upipe_hbrmt_pack_output(upipe, output, upump_p);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This handles data.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure describing the frame
+ * @param upump_p reference to pump that generated the buffer
+ * @return false if the input must be blocked
+ */
+static bool upipe_hbrmt_pack_handle(struct upipe *upipe, struct uref *uref,
+                                    struct upump **upump_p)
+{
+    struct upipe_hbrmt_pack *upipe_hbrmt_pack =
+        upipe_hbrmt_pack_from_upipe(upipe);
+    const char *def;
+    if (unlikely(ubase_check(uref_flow_get_def(uref, &def)))) {
+        upipe_hbrmt_pack_parse_flow_def(upipe, uref);
+        upipe_hbrmt_pack_store_flow_def(upipe, NULL);
+        upipe_hbrmt_pack_require_ubuf_mgr(upipe, uref);
+        return true;
+    }
+
+    if (upipe_hbrmt_pack->flow_def == NULL)
+        return false;
+
+    size_t size;
+    if (unlikely(!ubase_check(uref_block_size(uref, &size)) || !size)) {
+        upipe_warn(upipe, "invalid frame received");
+        uref_free(uref);
+        return true;
+    }
+    const struct hbrmt_format *format = upipe_hbrmt_pack->format;
+    if (unlikely(format != NULL && size != hbrmt_frame_size(format)))
+        upipe_warn_va(upipe, "invalid frame size %zu (expected %zu)",
+                      size, hbrmt_frame_size(format));
+
+    uint64_t date = 0;
+    if (!ubase_check(uref_clock_get_pts_prog(uref, &date)))
+        uref_clock_get_cr_sys(uref, &date);
+
+    /* the payloads are spliced from the frame, only the headers are
+     * allocated */
+    for (size_t offset = 0; offset < size; offset += HBRMT_DATA_SIZE) {
+        size_t payload_size = size - offset;
+        if (payload_size > HBRMT_DATA_SIZE)
+            payload_size = HBRMT_DATA_SIZE;
+        int err = upipe_hbrmt_pack_output_datagram(upipe, uref, offset,
+                payload_size, offset + payload_size >= size, date, upump_p);
+        if (unlikely(!ubase_check(err))) {
+            upipe_throw_fatal(upipe, err);
+            break;
+        }
+    }
+    upipe_hbrmt_pack->frcount++;
+    uref_free(uref);
+    return true;
+}
+
+/** @internal @This receives incoming uref.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure describing the frame
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_hbrmt_pack_input(struct upipe *upipe, struct uref *uref,
+                                   struct upump **upump_p)
+{
+    if (!upipe_hbrmt_pack_check_input(upipe)) {
+        upipe_hbrmt_pack_hold_input(upipe, uref);
+        upipe_hbrmt_pack_block_input(upipe, upump_p);
+    } else if (!upipe_hbrmt_pack_handle(upipe, uref, upump_p)) {
+        upipe_hbrmt_pack_hold_input(upipe, uref);
+        upipe_hbrmt_pack_block_input(upipe, upump_p);
+        /* Increment upipe refcount to avoid disappearing before all packets
+         * have been sent. */
+        upipe_use(upipe);
+    }
+}
+
+/** @internal @This receives a provided ubuf manager.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_format amended flow format
+ * @return an error code
+ */
+static int upipe_hbrmt_pack_check(struct upipe *upipe,
+                                  struct uref *flow_format)
+{
+    struct upipe_hbrmt_pack *upipe_hbrmt_pack =
+        upipe_hbrmt_pack_from_upipe(upipe);
+    if (flow_format != NULL)
+        upipe_hbrmt_pack_store_flow_def(upipe, flow_format);
+
+    if (upipe_hbrmt_pack->flow_def == NULL)
+        return UBASE_ERR_NONE;
+
+    bool was_buffered = !upipe_hbrmt_pack_check_input(upipe);
+    upipe_hbrmt_pack_output_input(upipe);
+    upipe_hbrmt_pack_unblock_input(upipe);
+    if (was_buffered && upipe_hbrmt_pack_check_input(upipe)) {
+        /* All packets have been output, release again the pipe that has been
+         * used in @ref upipe_hbrmt_pack_input. */
+        upipe_release(upipe);
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the input flow definition.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_def flow definition packet
+ * @return an error code
+ */
+static int upipe_hbrmt_pack_set_flow_def(struct upipe *upipe,
+                                         struct uref *flow_def)
+{
+    if (flow_def == NULL)
+        return UBASE_ERR_INVALID;
+
+    UBASE_RETURN(uref_flow_match_def(flow_def, EXPECTED_FLOW_DEF))
+
+    struct uref *flow_def_dup = uref_dup(flow_def);
+    UBASE_ALLOC_RETURN(flow_def_dup);
+    if (unlikely(!ubase_check(uref_flow_set_def(flow_def_dup,
+                                                OUTPUT_FLOW_DEF)))) {
+        uref_free(flow_def_dup);
+        return UBASE_ERR_ALLOC;
+    }
+
+    upipe_input(upipe, flow_def_dup, NULL);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands on a hbrmt_pack pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_hbrmt_pack_control(struct upipe *upipe, int command,
+                                    va_list args)
+{
+    switch (command) {
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            if (request->type == UREQUEST_UBUF_MGR ||
+                request->type == UREQUEST_FLOW_FORMAT)
+                return upipe_throw_provide_request(upipe, request);
+            return upipe_hbrmt_pack_alloc_output_proxy(upipe, request);
+        }
+        case UPIPE_UNREGISTER_REQUEST: {
+            struct urequest *request = va_arg(args, struct urequest *);
+            if (request->type == UREQUEST_UBUF_MGR ||
+                request->type == UREQUEST_FLOW_FORMAT)
+                return UBASE_ERR_NONE;
+            return upipe_hbrmt_pack_free_output_proxy(upipe, request);
+        }
+
+        case UPIPE_GET_OUTPUT:
+        case UPIPE_SET_OUTPUT:
+        case UPIPE_GET_FLOW_DEF:
+            return upipe_hbrmt_pack_control_output(upipe, command, args);
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            return upipe_hbrmt_pack_set_flow_def(upipe, flow_def);
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @internal @This allocates a hbrmt_pack pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_hbrmt_pack_alloc(struct upipe_mgr *mgr,
+                                            struct uprobe *uprobe,
+                                            uint32_t signature, va_list args)
+{
+    struct upipe *upipe = upipe_hbrmt_pack_alloc_void(mgr, uprobe, signature,
+                                                      args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_hbrmt_pack *upipe_hbrmt_pack =
+        upipe_hbrmt_pack_from_upipe(upipe);
+    upipe_hbrmt_pack->format = NULL;
+    upipe_hbrmt_pack->seqnum = 0;
+    upipe_hbrmt_pack->frcount = 0;
+
+    upipe_hbrmt_pack_init_urefcount(upipe);
+    upipe_hbrmt_pack_init_ubuf_mgr(upipe);
+    upipe_hbrmt_pack_init_output(upipe);
+    upipe_hbrmt_pack_init_input(upipe);
+
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @This frees a upipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_hbrmt_pack_free(struct upipe *upipe)
+{
+    upipe_throw_dead(upipe);
+    upipe_hbrmt_pack_clean_input(upipe);
+    upipe_hbrmt_pack_clean_output(upipe);
+    upipe_hbrmt_pack_clean_ubuf_mgr(upipe);
+    upipe_hbrmt_pack_clean_urefcount(upipe);
+    upipe_hbrmt_pack_free_void(upipe);
+}
+
+/** module manager static descriptor */
+static struct upipe_mgr upipe_hbrmt_pack_mgr = {
+    .refcount = NULL,
+    .signature = UPIPE_HBRMT_PACK_SIGNATURE,
+
+    .upipe_alloc = upipe_hbrmt_pack_alloc,
+    .upipe_input = upipe_hbrmt_pack_input,
+    .upipe_control = upipe_hbrmt_pack_control,
+
+    .upipe_mgr_control = NULL
+};
+
+/** @This returns the management structure for hbrmt_pack pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_hbrmt_pack_mgr_alloc(void)
+{
+    return &upipe_hbrmt_pack_mgr;
+}
@@ -0,0 +1,438 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe module reassembling SDI frames from SMPTE 2022-6 RTP datagrams
+ *
+ * The payloads are not copied: the header of each datagram is skipped and
+ * its buffer is chained to the frame being reassembled.
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/uprobe.h>
+#include <upipe/uref.h>
+#include <upipe/ubuf.h>
+#include <upipe/upipe.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_pic.h>
+#include <upipe/uref_pic_flow.h>
+#include <upipe/uref_block.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_void.h>
+#include <upipe/upipe_helper_output.h>
+
+#include <upipe-hbrmt/upipe_hbrmt_unpack.h>
+
+#include <bitstream/ietf/rtp.h>
+
+#include "hbrmt.h"
+
+/** we only accept blocks */
+#define EXPECTED_FLOW_DEF "block."
+/** we output packed SDI frames */
+#define OUTPUT_FLOW_DEF "block."
+/** size of the RTP and HBRMT headers */
+#define HEADER_SIZE (RTP_HEADER_SIZE + HBRMT_HEADER_SIZE)
+
+/** upipe_hbrmt_unpack structure */
+struct upipe_hbrmt_unpack {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** output pipe */
+    struct upipe *output;
+    /** flow_definition packet */
+    struct uref *flow_def;
+    /** output state */
+    enum upipe_helper_output_state output_state;
+    /** list of output requests */
+    struct uchain request_list;
+
+    /** input flow definition packet */
+    struct uref *flow_def_input;
+    /** FRAME and FRATE codes of the output flow definition, or -1 */
+    int codes;
+    /** video source format, or NULL if unknown */
+    const struct hbrmt_format *format;
+
+    /** frame being reassembled */
+    struct uref *next_uref;
+    /** frame counter of the frame being reassembled */
+    uint8_t frcount;
+    /** expected sequence number, or -1 */
+    int expected_seqnum;
+    /** true if datagrams are discarded until the next marker */
+    bool discard;
+    /** true if the next frame follows a discontinuity */
+    bool discontinuity;
+    /** number of lost datagrams */
+    uint64_t lost;
+    /** number of dropped frames */
+    uint64_t dropped;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_hbrmt_unpack, upipe, UPIPE_HBRMT_UNPACK_SIGNATURE);
+UPIPE_HELPER_UREFCOUNT(upipe_hbrmt_unpack, urefcount, upipe_hbrmt_unpack_free);
+UPIPE_HELPER_VOID(upipe_hbrmt_unpack);
+UPIPE_HELPER_OUTPUT(upipe_hbrmt_unpack, output, flow_def, output_state,
+                    request_list)
+
+/** @internal @This drops the frame being reassembled.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_hbrmt_unpack_drop(struct upipe *upipe)
+{
+    struct upipe_hbrmt_unpack *upipe_hbrmt_unpack =
+        upipe_hbrmt_unpack_from_upipe(upipe);
+    if (upipe_hbrmt_unpack->next_uref != NULL) {
+        uref_free(upipe_hbrmt_unpack->next_uref);
+        upipe_hbrmt_unpack->next_uref = NULL;
+        upipe_hbrmt_unpack->dropped++;
+    }
+    upipe_hbrmt_unpack->discontinuity = true;
+}
+
+/** @internal @This drops the frame being reassembled, and discards the
+ * following datagrams up to the next marker, as the position of the
+ * following datagrams in their frame is unknown.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_hbrmt_unpack_resync(struct upipe *upipe)
+{
+    struct upipe_hbrmt_unpack *upipe_hbrmt_unpack =
+        upipe_hbrmt_unpack_from_upipe(upipe);
+    upipe_hbrmt_unpack_drop(upipe);
+    upipe_hbrmt_unpack->discard = true;
+}
+
+/** @internal @This builds the output flow definition.
+ *
+ * @param upipe description structure of the pipe
+ * @param codes FRAME and FRATE codes, or -1
+ * @return an error code
+ */
+static int upipe_hbrmt_unpack_build_flow_def(struct upipe *upipe, int codes)
+{
+    struct upipe_hbrmt_unpack *upipe_hbrmt_unpack =
+        upipe_hbrmt_unpack_from_upipe(upipe);
+    const struct hbrmt_format *format = NULL;
+    if (codes != -1) {
+        format = hbrmt_find_codes(codes >> 8, codes & 0xff);
+        if (format == NULL)
+            upipe_warn_va(upipe, "unknown video source format %02x/%02x",
+                          codes >> 8, codes & 0xff);
+    }
+
+    struct uref *flow_def = uref_dup(upipe_hbrmt_unpack->flow_def_input);
+    UBASE_ALLOC_RETURN(flow_def);
+    UBASE_RETURN(uref_flow_set_def(flow_def, OUTPUT_FLOW_DEF))
+    if (format != NULL) {
+        UBASE_RETURN(uref_pic_flow_set_hsize(flow_def, format->hsize))
+        UBASE_RETURN(uref_pic_flow_set_vsize(flow_def, format->vsize))
+        UBASE_RETURN(uref_pic_flow_set_fps(flow_def, format->fps))
+        if (format->progressive)
+            UBASE_RETURN(uref_pic_set_progressive(flow_def))
+    }
+
+    upipe_hbrmt_unpack->codes = codes;
+    upipe_hbrmt_unpack->format = format;
+    upipe_hbrmt_unpack_store_flow_def(upipe, flow_def);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This outputs the reassembled frame.
+ *
+ * @param upipe description structure of the pipe
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_hbrmt_unpack_output_frame(struct upipe *upipe,
+                                            struct upump **upump_p)
+{
+    struct upipe_hbrmt_unpack *upipe_hbrmt_unpack =
+        upipe_hbrmt_unpack_from_upipe(upipe);
+    struct uref *uref = upipe_hbrmt_unpack->next_uref;
+    upipe_hbrmt_unpack->next_uref = NULL;
+
+    const struct hbrmt_format *format = upipe_hbrmt_unpack->format;
+    if (format != NULL) {
+        size_t size = 0, frame_size = hbrmt_frame_size(format);
+        uref_block_size(uref, &size);
+        if (unlikely(size < frame_size)) {
+            upipe_warn_va(upipe, "dropping truncated frame (%zu < %zu)",
+                          size, frame_size);
+            uref_free(uref);
+            upipe_hbrmt_unpack->dropped++;
+            upipe_hbrmt_unpack->discontinuity = true;
+            return;
+        }
+        /* strip the padding of the last datagram */
+        uref_block_resize(uref, 0, frame_size);
+    }
+
+    if (upipe_hbrmt_unpack->discontinuity) {
+        uref_flow_set_discontinuity(uref);
+        upipe_hbrmt_unpack->discontinuity = false;
+    }
+    upipe_hbrmt_unpack_output(upipe, uref, upump_p);
+}
+
+/** @internal @This receives an RTP datagram.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_hbrmt_unpack_input(struct upipe *upipe, struct uref *uref,
+                                     struct upump **upump_p)
+{
+    struct upipe_hbrmt_unpack *upipe_hbrmt_unpack =
+        upipe_hbrmt_unpack_from_upipe(upipe);
+    uint8_t header_buffer[HEADER_SIZE];
+    const uint8_t *header = uref_block_peek(uref, 0, HEADER_SIZE,
+                                            header_buffer);
+    if (unlikely(header == NULL)) {
+        upipe_warn(upipe, "invalid buffer received");
+        uref_free(uref);
+        return;
+    }
+
+    bool valid = rtp_check_hdr(header) && !rtp_check_extension(header) &&
+                 !rtp_get_cc(header);
+    bool marker = rtp_check_marker(header);
+    uint16_t seqnum = rtp_get_seqnum(header);
+    const uint8_t *hbrmt = header + RTP_HEADER_SIZE;
+    uint8_t frcount = hbrmt_get_frcount(hbrmt);
+    int codes = -1;
+    if (hbrmt_check_video_source_format(hbrmt) &&
+        hbrmt_get_sample(hbrmt) == HBRMT_SAMPLE_422_10)
+        codes = (hbrmt_get_frame(hbrmt) << 8) | hbrmt_get_frate(hbrmt);
+    size_t offset = HEADER_SIZE + 4 * hbrmt_get_ext(hbrmt) +
+                    (hbrmt_get_clock_frequency(hbrmt) ? 4 : 0);
+    uref_block_peek_unmap(uref, 0, header_buffer, header);
+
+    if (unlikely(!valid)) {
+        upipe_warn(upipe, "invalid RTP header");
+        uref_free(uref);
+        return;
+    }
+
+    if (unlikely(upipe_hbrmt_unpack->expected_seqnum != -1 &&
+                 seqnum != upipe_hbrmt_unpack->expected_seqnum)) {
+        unsigned lost = (seqnum + UINT16_MAX + 1 -
+                         upipe_hbrmt_unpack->expected_seqnum) & UINT16_MAX;
+        upipe_warn_va(upipe, "lost %u datagrams, got %u expected %d",
+                      lost, seqnum, upipe_hbrmt_unpack->expected_seqnum);
+        upipe_hbrmt_unpack->lost += lost;
+        upipe_hbrmt_unpack_resync(upipe);
+    }
+    upipe_hbrmt_unpack->expected_seqnum = (seqnum + 1) & UINT16_MAX;
+
+    if (unlikely(upipe_hbrmt_unpack->discard)) {
+        /* the datagram following the marker starts a frame */
+        if (marker)
+            upipe_hbrmt_unpack->discard = false;
+        uref_free(uref);
+        return;
+    }
+
+    if (unlikely(upipe_hbrmt_unpack->next_uref != NULL &&
+                 frcount != upipe_hbrmt_unpack->frcount)) {
+        /* no datagram is missing, so this one starts a frame */
+        upipe_warn(upipe, "missing end of frame");
+        upipe_hbrmt_unpack_drop(upipe);
+    }
+
+    if (unlikely(!ubase_check(uref_block_resize(uref, offset, -1)))) {
+        upipe_warn(upipe, "invalid buffer received");
+        uref_free(uref);
+        if (marker)
+            upipe_hbrmt_unpack_drop(upipe);
+        else
+            upipe_hbrmt_unpack_resync(upipe);
+        return;
+    }
+
+    if (upipe_hbrmt_unpack->next_uref == NULL) {
+        if (unlikely(upipe_hbrmt_unpack->flow_def == NULL ||
+                     codes != upipe_hbrmt_unpack->codes)) {
+            int err = upipe_hbrmt_unpack_build_flow_def(upipe, codes);
+            if (unlikely(!ubase_check(err))) {
+                upipe_throw_fatal(upipe, err);
+                uref_free(uref);
+                return;
+            }
+        }
+        upipe_hbrmt_unpack->next_uref = uref;
+        upipe_hbrmt_unpack->frcount = frcount;
+    } else {
+        struct ubuf *ubuf = uref_detach_ubuf(uref);
+        uref_free(uref);
+        if (unlikely(!ubase_check(uref_block_append(
+                            upipe_hbrmt_unpack->next_uref, ubuf)))) {
+            upipe_warn(upipe, "invalid buffer received");
+            ubuf_free(ubuf);
+            if (marker)
+                upipe_hbrmt_unpack_drop(upipe);
+            else
+                upipe_hbrmt_unpack_resync(upipe);
+            return;
+        }
+    }
+
+    if (marker)
+        upipe_hbrmt_unpack_output_frame(upipe, upump_p);
+}
+
+/** @internal @This sets the input flow definition.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_def flow definition packet
+ * @return an error code
+ */
+static int upipe_hbrmt_unpack_set_flow_def(struct upipe *upipe,
+                                           struct uref *flow_def)
+{
+    struct upipe_hbrmt_unpack *upipe_hbrmt_unpack =
+        upipe_hbrmt_unpack_from_upipe(upipe);
+    if (flow_def == NULL)
+        return UBASE_ERR_INVALID;
+
+    UBASE_RETURN(uref_flow_match_def(flow_def, EXPECTED_FLOW_DEF))
+
+    struct uref *flow_def_dup = uref_dup(flow_def);
+    UBASE_ALLOC_RETURN(flow_def_dup);
+    uref_free(upipe_hbrmt_unpack->flow_def_input);
+    upipe_hbrmt_unpack->flow_def_input = flow_def_dup;
+    /* the output flow definition is built from the next datagram */
+    upipe_hbrmt_unpack_store_flow_def(upipe, NULL);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands on a hbrmt_unpack pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_hbrmt_unpack_control(struct upipe *upipe, int command,
+                                      va_list args)
+{
+    UBASE_HANDLED_RETURN(upipe_hbrmt_unpack_control_output(upipe, command,
+                                                           args));
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            return upipe_hbrmt_unpack_set_flow_def(upipe, flow_def);
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @internal @This allocates a hbrmt_unpack pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_hbrmt_unpack_alloc(struct upipe_mgr *mgr,
+                                              struct uprobe *uprobe,
+                                              uint32_t signature,
+                                              va_list args)
+{
+    struct upipe *upipe = upipe_hbrmt_unpack_alloc_void(mgr, uprobe,
+                                                        signature, args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_hbrmt_unpack *upipe_hbrmt_unpack =
+        upipe_hbrmt_unpack_from_upipe(upipe);
+    upipe_hbrmt_unpack->flow_def_input = NULL;
+    upipe_hbrmt_unpack->codes = -1;
+    upipe_hbrmt_unpack->format = NULL;
+    upipe_hbrmt_unpack->next_uref = NULL;
+    upipe_hbrmt_unpack->frcount = 0;
+    upipe_hbrmt_unpack->expected_seqnum = -1;
+    upipe_hbrmt_unpack->discard = false;
+    upipe_hbrmt_unpack->discontinuity = false;
+    upipe_hbrmt_unpack->lost = 0;
+    upipe_hbrmt_unpack->dropped = 0;
+
+    upipe_hbrmt_unpack_init_urefcount(upipe);
+    upipe_hbrmt_unpack_init_output(upipe);
+
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @This frees a upipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_hbrmt_unpack_free(struct upipe *upipe)
+{
+    struct upipe_hbrmt_unpack *upipe_hbrmt_unpack =
+        upipe_hbrmt_unpack_from_upipe(upipe);
+    upipe_throw_dead(upipe);
+
+    if (upipe_hbrmt_unpack->lost || upipe_hbrmt_unpack->dropped)
+        upipe_notice_va(upipe, "lost %"PRIu64" datagrams, "
+                        "dropped %"PRIu64" frames",
+                        upipe_hbrmt_unpack->lost,
+                        upipe_hbrmt_unpack->dropped);
+    uref_free(upipe_hbrmt_unpack->next_uref);
+    uref_free(upipe_hbrmt_unpack->flow_def_input);
+    upipe_hbrmt_unpack_clean_output(upipe);
+    upipe_hbrmt_unpack_clean_urefcount(upipe);
+    upipe_hbrmt_unpack_free_void(upipe);
+}
+
+/** module manager static descriptor */
+static struct upipe_mgr upipe_hbrmt_unpack_mgr = {
+    .refcount = NULL,
+    .signature = UPIPE_HBRMT_UNPACK_SIGNATURE,
+
+    .upipe_alloc = upipe_hbrmt_unpack_alloc,
+    .upipe_input = upipe_hbrmt_unpack_input,
+    .upipe_control = upipe_hbrmt_unpack_control,
+
+    .upipe_mgr_control = NULL
+};
+
+/** @This returns the management structure for hbrmt_unpack pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_hbrmt_unpack_mgr_alloc(void)
+{
+    return &upipe_hbrmt_unpack_mgr;
+}
@@ -604,6 +604,8 @@ static int  _upipe_fsink_control(struct upipe *upipe, int command, va_list args)
         }
         case UPIPE_FLUSH:
             return upipe_fsink_flush(upipe);
+        case UPIPE_UNCONFINE:
+            return upipe_fsink_unconfine_input(upipe);
 
         case UPIPE_GET_MAX_LENGTH: {
             unsigned int *p = va_arg(args, unsigned int *);
@@ -0,0 +1,1099 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe source module downloading an http object over several
+ * connections
+ *
+ * The first request asks for the first range of the object, and its
+ * Content-Range header gives the length of the object. The rest of the
+ * object is then split into ranges of a fixed size which are fetched by
+ * inner http sources, each on its own connection. The data of the first
+ * range still being fetched is output directly, and the data of the
+ * following ranges is kept until all previous ranges are complete, so at
+ * most twice the number of connections ranges are buffered.
+ *
+ * If a uclock is attached, the number of connections starts at one and is
+ * increased while it improves the throughput, and decreased when the
+ * throughput drops. Otherwise the maximum number of connections is used.
+ *
+ * If the server does not support ranges, the object is fetched on the
+ * first connection only.
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uclock.h>
+#include <upipe/uref.h>
+#include <upipe/uref_block.h>
+#include <upipe/upump.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_void.h>
+#include <upipe/upipe_helper_output.h>
+#include <upipe/upipe_helper_uclock.h>
+#include <upipe/upipe_helper_upump_mgr.h>
+#include <upipe/upipe_helper_upump.h>
+#include <upipe/upipe_helper_output_size.h>
+#include <upipe-modules/upipe_http_source.h>
+#include <upipe-modules/upipe_http_multi_source.h>
+#include <upipe-modules/uref_http_flow.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+
+/** default size of the ranges */
+#define DEFAULT_CHUNK_SIZE (1024 * 1024)
+/** default maximum number of connections */
+#define DEFAULT_MAX_STREAMS 4
+/** number of attempts to fetch a range without progress */
+#define MAX_RETRIES 3
+/** minimum duration of a throughput measurement */
+#define MEASURE_PERIOD (UCLOCK_FREQ / 10)
+
+/** @internal @This is the private context of a range of the object. */
+struct upipe_http_msrc_chunk {
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** offset of the range in the object */
+    uint64_t offset;
+    /** size of the range, or UINT64_MAX until the end of the object */
+    uint64_t size;
+    /** number of octets received */
+    uint64_t received;
+    /** list of received buffers waiting for the previous ranges */
+    struct uchain urefs;
+    /** number of attempts without progress */
+    unsigned int retries;
+    /** connection fetching the range, or NULL */
+    struct upipe_http_msrc_conn *conn;
+};
+
+UBASE_FROM_TO(upipe_http_msrc_chunk, uchain, uchain, uchain)
+
+/** @internal @This is the private context of a connection, it lives as long
+ * as the inner http source. */
+struct upipe_http_msrc_conn {
+    /** refcount management structure */
+    struct urefcount urefcount;
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** pointer to the http multi source, or NULL once it is dead */
+    struct upipe *upipe;
+    /** range being fetched, or NULL once the connection is detached */
+    struct upipe_http_msrc_chunk *chunk;
+    /** number of octets of the range received before the connection */
+    uint64_t start;
+    /** inner http source */
+    struct upipe *src;
+    /** probe for the inner http source */
+    struct uprobe probe;
+    /** pseudo sink receiving the output of the inner http source */
+    struct upipe sink;
+};
+
+UBASE_FROM_TO(upipe_http_msrc_conn, uchain, uchain, uchain)
+UBASE_FROM_TO(upipe_http_msrc_conn, urefcount, urefcount, urefcount)
+UBASE_FROM_TO(upipe_http_msrc_conn, uprobe, probe, probe)
+UBASE_FROM_TO(upipe_http_msrc_conn, upipe, sink, sink)
+
+/** @internal @This is the private context of a http multi source pipe. */
+struct upipe_http_msrc {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** pipe acting as output */
+    struct upipe *output;
+    /** flow definition packet */
+    struct uref *flow_def;
+    /** output state */
+    enum upipe_helper_output_state output_state;
+    /** list of output requests */
+    struct uchain request_list;
+
+    /** uclock structure, if not NULL the connections are adapted */
+    struct uclock *uclock;
+    /** uclock request */
+    struct urequest uclock_request;
+
+    /** upump manager */
+    struct upump_mgr *upump_mgr;
+    /** idler starting new connections */
+    struct upump *upump;
+    /** read size of the inner sources, or 0 */
+    unsigned int output_size;
+
+    /** http url */
+    char *uri;
+    /** size of the ranges */
+    uint64_t chunk_size;
+    /** maximum number of connections */
+    unsigned int max_streams;
+    /** targeted number of connections */
+    unsigned int nb_streams;
+    /** number of open connections */
+    unsigned int nb_conns;
+    /** number of ranges in the list */
+    unsigned int nb_chunks;
+    /** length of the object, or UINT64_MAX if unknown */
+    uint64_t size;
+    /** offset of the next range to create */
+    uint64_t next_offset;
+    /** number of octets output */
+    uint64_t position;
+    /** list of ranges, in order */
+    struct uchain chunks;
+    /** list of connections */
+    struct uchain conns;
+    /** end of stream buffer */
+    struct uref *end;
+
+    /** date of the start of the throughput measurement */
+    uint64_t measure_date;
+    /** octets received since the start of the measurement */
+    uint64_t measure_bytes;
+    /** last measured throughput, in octets per second */
+    uint64_t rate;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+/** @hidden */
+static void upipe_http_msrc_free(struct upipe *upipe);
+
+UPIPE_HELPER_UPIPE(upipe_http_msrc, upipe, UPIPE_HTTP_MSRC_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(upipe_http_msrc, urefcount, upipe_http_msrc_free)
+UPIPE_HELPER_VOID(upipe_http_msrc)
+UPIPE_HELPER_OUTPUT(upipe_http_msrc, output, flow_def, output_state,
+                    request_list)
+UPIPE_HELPER_UCLOCK(upipe_http_msrc, uclock, uclock_request, NULL,
+                    upipe_http_msrc_register_output_request,
+                    upipe_http_msrc_unregister_output_request)
+UPIPE_HELPER_UPUMP_MGR(upipe_http_msrc, upump_mgr)
+UPIPE_HELPER_UPUMP(upipe_http_msrc, upump, upump_mgr)
+UPIPE_HELPER_OUTPUT_SIZE(upipe_http_msrc, output_size)
+
+/** @internal @This is the private context of a http multi source manager. */
+struct upipe_http_msrc_mgr {
+    /** refcount management structure */
+    struct urefcount urefcount;
+    /** manager of the inner http sources */
+    struct upipe_mgr *http_src_mgr;
+    /** public upipe_mgr structure */
+    struct upipe_mgr mgr;
+};
+
+UBASE_FROM_TO(upipe_http_msrc_mgr, upipe_mgr, upipe_mgr, mgr)
+UBASE_FROM_TO(upipe_http_msrc_mgr, urefcount, urefcount, urefcount)
+
+static void upipe_http_msrc_schedule(struct upipe *upipe);
+
+/** @internal @This allocates a range.
+ *
+ * @param offset offset of the range in the object
+ * @param size size of the range
+ * @return pointer to the range, or NULL
+ */
+static struct upipe_http_msrc_chunk *
+    upipe_http_msrc_chunk_alloc(uint64_t offset, uint64_t size)
+{
+    struct upipe_http_msrc_chunk *chunk =
+        malloc(sizeof(struct upipe_http_msrc_chunk));
+    if (unlikely(chunk == NULL))
+        return NULL;
+    uchain_init(&chunk->uchain);
+    chunk->offset = offset;
+    chunk->size = size;
+    chunk->received = 0;
+    ulist_init(&chunk->urefs);
+    chunk->retries = 0;
+    chunk->conn = NULL;
+    return chunk;
+}
+
+/** @internal @This frees a range and its buffers.
+ *
+ * @param chunk pointer to the range
+ */
+static void upipe_http_msrc_chunk_free(struct upipe_http_msrc_chunk *chunk)
+{
+    struct uchain *uchain;
+    while ((uchain = ulist_pop(&chunk->urefs)) != NULL)
+        uref_free(uref_from_uchain(uchain));
+    free(chunk);
+}
+
+/** @internal @This frees a connection once the inner http source is dead.
+ *
+ * @param urefcount pointer to the urefcount of the connection
+ */
+static void upipe_http_msrc_conn_free(struct urefcount *urefcount)
+{
+    struct upipe_http_msrc_conn *conn =
+        upipe_http_msrc_conn_from_urefcount(urefcount);
+    if (conn->upipe != NULL)
+        ulist_delete(&conn->uchain);
+    upipe_clean(&conn->sink);
+    uprobe_clean(&conn->probe);
+    urefcount_clean(&conn->urefcount);
+    free(conn);
+}
+
+/** @internal @This detaches a connection from its range and releases the
+ * inner http source.
+ *
+ * @param upipe description structure of the pipe
+ * @param conn pointer to the connection
+ */
+static void upipe_http_msrc_conn_detach(struct upipe *upipe,
+                                        struct upipe_http_msrc_conn *conn)
+{
+    struct upipe_http_msrc *upipe_http_msrc = upipe_http_msrc_from_upipe(upipe);
+    struct upipe *src = conn->src;
+
+    upipe_http_msrc->nb_conns--;
+    conn->chunk->conn = NULL;
+    conn->chunk = NULL;
+    conn->src = NULL;
+    upipe_release(src);
+    urefcount_release(&conn->urefcount);
+}
+
+/** @internal @This stops all connections and frees all ranges.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_http_msrc_abort(struct upipe *upipe)
+{
+    struct upipe_http_msrc *upipe_http_msrc = upipe_http_msrc_from_upipe(upipe);
+    struct uchain *uchain;
+
+    upipe_http_msrc_set_upump(upipe, NULL);
+    while ((uchain = ulist_pop(&upipe_http_msrc->chunks)) != NULL) {
+        struct upipe_http_msrc_chunk *chunk =
+            upipe_http_msrc_chunk_from_uchain(uchain);
+        if (chunk->conn != NULL)
+            upipe_http_msrc_conn_detach(upipe, chunk->conn);
+        upipe_http_msrc_chunk_free(chunk);
+    }
+    upipe_http_msrc->nb_chunks = 0;
+    uref_free(upipe_http_msrc->end);
+    upipe_http_msrc->end = NULL;
+}
+
+/** @internal @This is called by the idler to start new connections.
+ *
+ * @param upump description structure of the idler
+ */
+static void upipe_http_msrc_idler(struct upump *upump)
+{
+    struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
+    upipe_http_msrc_set_upump(upipe, NULL);
+    upipe_http_msrc_schedule(upipe);
+}
+
+/** @internal @This schedules new connections from the event loop, so that
+ * inner http sources are not allocated from the callbacks of others.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_http_msrc_wake(struct upipe *upipe)
+{
+    struct upipe_http_msrc *upipe_http_msrc = upipe_http_msrc_from_upipe(upipe);
+
+    if (upipe_http_msrc->upump != NULL)
+        return;
+    upipe_http_msrc_check_upump_mgr(upipe);
+    if (unlikely(upipe_http_msrc->upump_mgr == NULL))
+        return;
+
+    struct upump *upump = upump_alloc_idler(upipe_http_msrc->upump_mgr,
+                                            upipe_http_msrc_idler, upipe,
+                                            upipe->refcount);
+    if (unlikely(upump == NULL)) {
+        upipe_throw_fatal(upipe, UBASE_ERR_UPUMP);
+        return;
+    }
+    upipe_http_msrc_set_upump(upipe, upump);
+    upump_start(upump);
+}
+
+/** @internal @This gives up the download.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_http_msrc_fail(struct upipe *upipe)
+{
+    upipe_http_msrc_abort(upipe);
+    upipe_throw_source_end(upipe);
+}
+
+/** @internal @This counts a failed attempt to fetch a range, and schedules
+ * a new one or gives up.
+ *
+ * @param upipe description structure of the pipe
+ * @param chunk pointer to the range
+ * @return false if the download was given up
+ */
+static bool upipe_http_msrc_retry(struct upipe *upipe,
+                                  struct upipe_http_msrc_chunk *chunk)
+{
+    uint64_t offset = chunk->offset + chunk->received;
+
+    if (++chunk->retries > MAX_RETRIES) {
+        upipe_err_va(upipe, "unable to fetch range at %"PRIu64, offset);
+        upipe_http_msrc_fail(upipe);
+        return false;
+    }
+    upipe_dbg_va(upipe, "retrying range at %"PRIu64, offset);
+    upipe_http_msrc_wake(upipe);
+    return true;
+}
+
+/** @internal @This adapts the number of connections to the throughput
+ * measured since the last adaptation.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_http_msrc_adapt(struct upipe *upipe)
+{
+    struct upipe_http_msrc *upipe_http_msrc = upipe_http_msrc_from_upipe(upipe);
+
+    if (upipe_http_msrc->uclock == NULL ||
+        upipe_http_msrc->size == UINT64_MAX)
+        return;
+
+    uint64_t now = uclock_now(upipe_http_msrc->uclock);
+    if (now < upipe_http_msrc->measure_date + MEASURE_PERIOD)
+        return;
+
+    uint64_t rate = upipe_http_msrc->measure_bytes * UCLOCK_FREQ /
+                    (now - upipe_http_msrc->measure_date);
+    uint64_t last_rate = upipe_http_msrc->rate;
+    unsigned int nb_streams = upipe_http_msrc->nb_streams;
+
+    /* keep adding connections while they help */
+    if (rate > last_rate + last_rate / 10) {
+        if (nb_streams < upipe_http_msrc->max_streams)
+            nb_streams++;
+    } else if (rate < last_rate - last_rate / 10) {
+        if (nb_streams > 1)
+            nb_streams--;
+    }
+
+    if (nb_streams != upipe_http_msrc->nb_streams) {
+        upipe_dbg_va(upipe, "%"PRIu64" octets/s, now using %u connections",
+                     rate, nb_streams);
+        upipe_http_msrc->nb_streams = nb_streams;
+    }
+    upipe_http_msrc->rate = rate;
+    upipe_http_msrc->measure_date = now;
+    upipe_http_msrc->measure_bytes = 0;
+}
+
+/** @internal @This outputs the buffers of the first ranges, and frees the
+ * completed ranges.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_http_msrc_flush(struct upipe *upipe)
+{
+    struct upipe_http_msrc *upipe_http_msrc = upipe_http_msrc_from_upipe(upipe);
+    struct uchain *uchain;
+
+    while ((uchain = ulist_peek(&upipe_http_msrc->chunks)) != NULL) {
+        struct upipe_http_msrc_chunk *chunk =
+            upipe_http_msrc_chunk_from_uchain(uchain);
+        struct uchain *uchain_uref;
+        while ((uchain_uref = ulist_pop(&chunk->urefs)) != NULL) {
+            struct uref *uref = uref_from_uchain(uchain_uref);
+            size_t size = 0;
+            uref_block_size(uref, &size);
+            upipe_http_msrc->position += size;
+            upipe_http_msrc_output(upipe, uref, NULL);
+        }
+
+        if (chunk->conn != NULL || chunk->received < chunk->size)
+            break;
+        ulist_delete(uchain);
+        upipe_http_msrc_chunk_free(chunk);
+        upipe_http_msrc->nb_chunks--;
+    }
+}
+
+/** @internal @This handles the end of a connection.
+ *
+ * @param conn pointer to the connection
+ */
+static void upipe_http_msrc_conn_end(struct upipe_http_msrc_conn *conn)
+{
+    struct upipe *upipe = conn->upipe;
+    struct upipe_http_msrc_chunk *chunk = conn->chunk;
+    if (upipe == NULL || chunk == NULL)
+        return;
+
+    struct upipe_http_msrc *upipe_http_msrc = upipe_http_msrc_from_upipe(upipe);
+    uint64_t start = conn->start;
+    upipe_http_msrc_conn_detach(upipe, conn);
+
+    if (chunk->size == UINT64_MAX) {
+        /* ranges are not supported, the object ends here */
+        chunk->size = chunk->received;
+        upipe_http_msrc->size = chunk->received;
+        upipe_http_msrc->next_offset = chunk->received;
+    }
+
+    if (chunk->received < chunk->size) {
+        if (chunk->received > start)
+            chunk->retries = 0;
+        upipe_http_msrc_retry(upipe, chunk);
+        return;
+    }
+
+    upipe_http_msrc_adapt(upipe);
+    upipe_http_msrc_flush(upipe);
+    if (!ulist_empty(&upipe_http_msrc->chunks) ||
+        upipe_http_msrc->next_offset < upipe_http_msrc->size) {
+        upipe_http_msrc_wake(upipe);
+        return;
+    }
+
+    upipe_notice_va(upipe, "downloaded %"PRIu64" octets",
+                    upipe_http_msrc->position);
+    struct uref *end = upipe_http_msrc->end;
+    upipe_http_msrc->end = NULL;
+    if (end != NULL)
+        upipe_http_msrc_output(upipe, end, NULL);
+    upipe_throw_source_end(upipe);
+}
+
+/** @internal @This handles a redirection of the object.
+ *
+ * @param upipe description structure of the pipe
+ * @param uri new uri of the object
+ */
+static void upipe_http_msrc_redirect(struct upipe *upipe, const char *uri)
+{
+    struct upipe_http_msrc *upipe_http_msrc = upipe_http_msrc_from_upipe(upipe);
+
+    if (uri == NULL)
+        return;
+    char *dup = strdup(uri);
+    if (unlikely(dup == NULL)) {
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return;
+    }
+    upipe_notice_va(upipe, "redirected to %s", uri);
+    free(upipe_http_msrc->uri);
+    upipe_http_msrc->uri = dup;
+}
+
+/** @internal @This catches events thrown by the inner http sources.
+ *
+ * @param uprobe pointer to the probe of the connection
+ * @param inner pointer to the inner pipe
+ * @param event event thrown
+ * @param args optional arguments of the event
+ * @return an error code
+ */
+static int upipe_http_msrc_conn_catch(struct uprobe *uprobe,
+                                      struct upipe *inner,
+                                      int event, va_list args)
+{
+    struct upipe_http_msrc_conn *conn = upipe_http_msrc_conn_from_probe(uprobe);
+    struct upipe *upipe = conn->upipe;
+    if (upipe == NULL)
+        return uprobe_throw_next(uprobe, inner, event, args);
+
+    if (event == UPROBE_SOURCE_END) {
+        upipe_http_msrc_conn_end(conn);
+        return UBASE_ERR_NONE;
+    }
+
+    if (event < UPROBE_LOCAL ||
+        ubase_get_signature(args) != UPIPE_HTTP_SRC_SIGNATURE)
+        return upipe_throw_proxy(upipe, inner, event, args);
+
+    switch (event) {
+        case UPROBE_HTTP_SRC_REDIRECT: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_HTTP_SRC_SIGNATURE)
+            const char *uri = va_arg(args, const char *);
+            upipe_http_msrc_redirect(upipe, uri);
+            return UBASE_ERR_NONE;
+        }
+        case UPROBE_HTTP_SRC_ERROR: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_HTTP_SRC_SIGNATURE)
+            unsigned int code = va_arg(args, unsigned int);
+            upipe_warn_va(upipe, "http error %u", code);
+            return UBASE_ERR_NONE;
+        }
+    }
+    return upipe_throw_proxy(upipe, inner, event, args);
+}
+
+/** @internal @This receives data from an inner http source.
+ *
+ * @param sink pseudo sink of the connection
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_http_msrc_sink_input(struct upipe *sink, struct uref *uref,
+                                       struct upump **upump_p)
+{
+    struct upipe_http_msrc_conn *conn = upipe_http_msrc_conn_from_sink(sink);
+    struct upipe *upipe = conn->upipe;
+    struct upipe_http_msrc_chunk *chunk = conn->chunk;
+    size_t size;
+    if (upipe == NULL || chunk == NULL ||
+        !ubase_check(uref_block_size(uref, &size))) {
+        uref_free(uref);
+        return;
+    }
+
+    struct upipe_http_msrc *upipe_http_msrc = upipe_http_msrc_from_upipe(upipe);
+    if (size > chunk->size - chunk->received) {
+        upipe_warn_va(upipe, "range at %"PRIu64" too long", chunk->offset);
+        size = chunk->size - chunk->received;
+        uref_block_resize(uref, 0, size);
+    }
+
+    if (size == 0) {
+        /* keep one end of stream buffer for the real end */
+        if (ubase_check(uref_block_get_end(uref)) &&
+            upipe_http_msrc->end == NULL)
+            upipe_http_msrc->end = uref;
+        else
+            uref_free(uref);
+        return;
+    }
+
+    chunk->received += size;
+    upipe_http_msrc->measure_bytes += size;
+    if (ulist_peek(&upipe_http_msrc->chunks) == &chunk->uchain) {
+        upipe_http_msrc->position += size;
+        upipe_http_msrc_output(upipe, uref, upump_p);
+    } else
+        ulist_add(&chunk->urefs, uref_to_uchain(uref));
+}
+
+/** @internal @This receives the flow definition of an inner http source.
+ *
+ * @param conn pointer to the connection
+ * @param flow_def flow definition packet
+ * @return an error code
+ */
+static int upipe_http_msrc_sink_set_flow_def(struct upipe_http_msrc_conn *conn,
+                                             struct uref *flow_def)
+{
+    struct upipe *upipe = conn->upipe;
+    struct upipe_http_msrc_chunk *chunk = conn->chunk;
+    if (upipe == NULL || chunk == NULL)
+        return UBASE_ERR_NONE;
+
+    struct upipe_http_msrc *upipe_http_msrc = upipe_http_msrc_from_upipe(upipe);
+    uint64_t complete_length;
+    if (!ubase_check(uref_http_get_complete_length(flow_def,
+                                                    &complete_length)))
+        complete_length = UINT64_MAX;
+
+    if (upipe_http_msrc->flow_def != NULL) {
+        if (complete_length != upipe_http_msrc->size) {
+            upipe_warn_va(upipe, "unexpected response for range at %"PRIu64,
+                          chunk->offset);
+            upipe_http_msrc_conn_end(conn);
+        }
+        return UBASE_ERR_NONE;
+    }
+
+    /* first response */
+    struct uref *flow_def_dup = uref_dup(flow_def);
+    UBASE_ALLOC_RETURN(flow_def_dup);
+    upipe_http_msrc_store_flow_def(upipe, flow_def_dup);
+    upipe_http_msrc->size = complete_length;
+
+    if (complete_length == UINT64_MAX) {
+        upipe_warn(upipe, "ranges not supported, using one connection");
+        chunk->size = UINT64_MAX;
+        return UBASE_ERR_NONE;
+    }
+
+    upipe_dbg_va(upipe, "object of %"PRIu64" octets", complete_length);
+    if (chunk->size > complete_length)
+        chunk->size = complete_length;
+    upipe_http_msrc->next_offset = chunk->size;
+    if (upipe_http_msrc->uclock != NULL) {
+        upipe_http_msrc->nb_streams = 1;
+        upipe_http_msrc->measure_date = uclock_now(upipe_http_msrc->uclock);
+        upipe_http_msrc->measure_bytes = 0;
+        upipe_http_msrc->rate = 0;
+    } else
+        upipe_http_msrc->nb_streams = upipe_http_msrc->max_streams;
+    upipe_http_msrc_wake(upipe);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands on the pseudo sink of a
+ * connection.
+ *
+ * @param sink pseudo sink of the connection
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_http_msrc_sink_control(struct upipe *sink,
+                                        int command, va_list args)
+{
+    struct upipe_http_msrc_conn *conn = upipe_http_msrc_conn_from_sink(sink);
+    struct upipe *upipe = conn->upipe;
+
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            return upipe_http_msrc_sink_set_flow_def(conn, flow_def);
+        }
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            if (upipe == NULL)
+                return UBASE_ERR_UNHANDLED;
+            return upipe_http_msrc_alloc_output_proxy(upipe, urequest);
+        }
+        case UPIPE_UNREGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            if (upipe == NULL)
+                return UBASE_ERR_UNHANDLED;
+            return upipe_http_msrc_free_output_proxy(upipe, urequest);
+        }
+    }
+    return UBASE_ERR_UNHANDLED;
+}
+
+/** @internal @This is the manager of the pseudo sinks of the connections. */
+static struct upipe_mgr upipe_http_msrc_sink_mgr = {
+    .refcount = NULL,
+    .signature = UPIPE_HTTP_MSRC_SIGNATURE,
+    .upipe_alloc = NULL,
+    .upipe_input = upipe_http_msrc_sink_input,
+    .upipe_control = upipe_http_msrc_sink_control,
+    .upipe_mgr_control = NULL
+};
+
+/** @internal @This opens a connection to fetch the rest of a range.
+ *
+ * @param upipe description structure of the pipe
+ * @param chunk pointer to the range
+ * @return an error code
+ */
+static int upipe_http_msrc_fetch(struct upipe *upipe,
+                                 struct upipe_http_msrc_chunk *chunk)
+{
+    struct upipe_http_msrc *upipe_http_msrc = upipe_http_msrc_from_upipe(upipe);
+    struct upipe_http_msrc_mgr *upipe_http_msrc_mgr =
+        upipe_http_msrc_mgr_from_upipe_mgr(upipe->mgr);
+
+    struct upipe_http_msrc_conn *conn =
+        malloc(sizeof(struct upipe_http_msrc_conn));
+    UBASE_ALLOC_RETURN(conn);
+    urefcount_init(&conn->urefcount, upipe_http_msrc_conn_free);
+    ulist_add(&upipe_http_msrc->conns, &conn->uchain);
+    conn->upipe = upipe;
+    uprobe_init(&conn->probe, upipe_http_msrc_conn_catch, NULL);
+    conn->probe.refcount = &conn->urefcount;
+    upipe_init(&conn->sink, &upipe_http_msrc_sink_mgr, NULL);
+    conn->sink.refcount = &conn->urefcount;
+
+    uint64_t offset = chunk->offset + chunk->received;
+    conn->src = upipe_void_alloc(upipe_http_msrc_mgr->http_src_mgr,
+            uprobe_pfx_alloc_va(uprobe_use(&conn->probe),
+                                UPROBE_LOG_VERBOSE, "range %"PRIu64,
+                                offset));
+    if (unlikely(conn->src == NULL)) {
+        urefcount_release(&conn->urefcount);
+        return UBASE_ERR_ALLOC;
+    }
+    conn->chunk = chunk;
+    conn->start = chunk->received;
+    chunk->conn = conn;
+    upipe_http_msrc->nb_conns++;
+
+    uint64_t length = chunk->size == UINT64_MAX ? UINT64_MAX :
+                      chunk->size - chunk->received;
+    int err;
+    if (upipe_http_msrc->output_size)
+        upipe_set_output_size(conn->src, upipe_http_msrc->output_size);
+    if (!ubase_check(err = upipe_set_output(conn->src, &conn->sink)) ||
+        !ubase_check(err = upipe_src_set_range(conn->src, offset, length)) ||
+        !ubase_check(err = upipe_set_uri(conn->src, upipe_http_msrc->uri))) {
+        upipe_http_msrc_conn_detach(upipe, conn);
+        return err;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This opens connections for the interrupted ranges and the
+ * next ranges of the object, within the limits.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_http_msrc_schedule(struct upipe *upipe)
+{
+    struct upipe_http_msrc *upipe_http_msrc = upipe_http_msrc_from_upipe(upipe);
+    struct uchain *uchain;
+
+    ulist_foreach (&upipe_http_msrc->chunks, uchain) {
+        if (upipe_http_msrc->nb_conns >= upipe_http_msrc->nb_streams)
+            return;
+        struct upipe_http_msrc_chunk *chunk =
+            upipe_http_msrc_chunk_from_uchain(uchain);
+        if (chunk->conn != NULL || chunk->received >= chunk->size)
+            continue;
+        if (!ubase_check(upipe_http_msrc_fetch(upipe, chunk))) {
+            upipe_http_msrc_retry(upipe, chunk);
+            return;
+        }
+    }
+
+    while (upipe_http_msrc->nb_conns < upipe_http_msrc->nb_streams &&
+           upipe_http_msrc->nb_chunks < 2 * upipe_http_msrc->nb_streams &&
+           upipe_http_msrc->next_offset < upipe_http_msrc->size) {
+        uint64_t offset = upipe_http_msrc->next_offset;
+        uint64_t size = upipe_http_msrc->size - offset;
+        if (size > upipe_http_msrc->chunk_size)
+            size = upipe_http_msrc->chunk_size;
+        struct upipe_http_msrc_chunk *chunk =
+            upipe_http_msrc_chunk_alloc(offset, size);
+        if (unlikely(chunk == NULL)) {
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+        ulist_add(&upipe_http_msrc->chunks, &chunk->uchain);
+        upipe_http_msrc->nb_chunks++;
+        upipe_http_msrc->next_offset += size;
+        if (!ubase_check(upipe_http_msrc_fetch(upipe, chunk))) {
+            upipe_http_msrc_retry(upipe, chunk);
+            return;
+        }
+    }
+}
+
+/** @internal @This allocates a http multi source pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_http_msrc_alloc(struct upipe_mgr *mgr,
+                                           struct uprobe *uprobe,
+                                           uint32_t signature, va_list args)
+{
+    struct upipe *upipe = upipe_http_msrc_alloc_void(mgr, uprobe, signature,
+                                                     args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_http_msrc *upipe_http_msrc = upipe_http_msrc_from_upipe(upipe);
+    upipe_http_msrc_init_urefcount(upipe);
+    upipe_http_msrc_init_output(upipe);
+    upipe_http_msrc_init_uclock(upipe);
+    upipe_http_msrc_init_upump_mgr(upipe);
+    upipe_http_msrc_init_upump(upipe);
+    upipe_http_msrc_init_output_size(upipe, 0);
+    upipe_http_msrc->uri = NULL;
+    upipe_http_msrc->chunk_size = DEFAULT_CHUNK_SIZE;
+    upipe_http_msrc->max_streams = DEFAULT_MAX_STREAMS;
+    upipe_http_msrc->nb_streams = 1;
+    upipe_http_msrc->nb_conns = 0;
+    upipe_http_msrc->nb_chunks = 0;
+    upipe_http_msrc->size = UINT64_MAX;
+    upipe_http_msrc->next_offset = 0;
+    upipe_http_msrc->position = 0;
+    ulist_init(&upipe_http_msrc->chunks);
+    ulist_init(&upipe_http_msrc->conns);
+    upipe_http_msrc->end = NULL;
+    upipe_http_msrc->measure_date = 0;
+    upipe_http_msrc->measure_bytes = 0;
+    upipe_http_msrc->rate = 0;
+
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @internal @This frees a http multi source pipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_http_msrc_free(struct upipe *upipe)
+{
+    struct upipe_http_msrc *upipe_http_msrc = upipe_http_msrc_from_upipe(upipe);
+    struct uchain *uchain, *uchain_tmp;
+
+    upipe_http_msrc_abort(upipe);
+    /* inner sources still dying must not call us back */
+    ulist_delete_foreach (&upipe_http_msrc->conns, uchain, uchain_tmp) {
+        struct upipe_http_msrc_conn *conn =
+            upipe_http_msrc_conn_from_uchain(uchain);
+        ulist_delete(uchain);
+        conn->upipe = NULL;
+    }
+
+    upipe_throw_dead(upipe);
+
+    free(upipe_http_msrc->uri);
+    upipe_http_msrc_clean_output_size(upipe);
+    upipe_http_msrc_clean_upump(upipe);
+    upipe_http_msrc_clean_upump_mgr(upipe);
+    upipe_http_msrc_clean_uclock(upipe);
+    upipe_http_msrc_clean_output(upipe);
+    upipe_http_msrc_clean_urefcount(upipe);
+    upipe_http_msrc_free_void(upipe);
+}
+
+/** @internal @This sets the uri of the object to download.
+ *
+ * @param upipe description structure of the pipe
+ * @param uri uri of the object, or NULL
+ * @return an error code
+ */
+static int upipe_http_msrc_set_uri(struct upipe *upipe, const char *uri)
+{
+    struct upipe_http_msrc *upipe_http_msrc = upipe_http_msrc_from_upipe(upipe);
+
+    upipe_http_msrc_abort(upipe);
+    ubase_clean_str(&upipe_http_msrc->uri);
+    upipe_http_msrc_store_flow_def(upipe, NULL);
+    upipe_http_msrc->nb_streams = 1;
+    upipe_http_msrc->size = UINT64_MAX;
+    upipe_http_msrc->next_offset = 0;
+    upipe_http_msrc->position = 0;
+
+    if (uri == NULL)
+        return UBASE_ERR_NONE;
+
+    upipe_http_msrc->uri = strdup(uri);
+    UBASE_ALLOC_RETURN(upipe_http_msrc->uri);
+
+    /* the first range also gives the length of the object */
+    struct upipe_http_msrc_chunk *chunk =
+        upipe_http_msrc_chunk_alloc(0, upipe_http_msrc->chunk_size);
+    UBASE_ALLOC_RETURN(chunk);
+    ulist_add(&upipe_http_msrc->chunks, &chunk->uchain);
+    upipe_http_msrc->nb_chunks++;
+
+    int err = upipe_http_msrc_fetch(upipe, chunk);
+    if (unlikely(!ubase_check(err))) {
+        upipe_http_msrc_abort(upipe);
+        ubase_clean_str(&upipe_http_msrc->uri);
+    }
+    return err;
+}
+
+/** @internal @This returns the uri of the object.
+ *
+ * @param upipe description structure of the pipe
+ * @param uri_p filled in with the uri
+ * @return an error code
+ */
+static int upipe_http_msrc_get_uri(struct upipe *upipe, const char **uri_p)
+{
+    struct upipe_http_msrc *upipe_http_msrc = upipe_http_msrc_from_upipe(upipe);
+    if (uri_p != NULL)
+        *uri_p = upipe_http_msrc->uri;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the size of the ranges.
+ *
+ * @param upipe description structure of the pipe
+ * @param chunk_size size in octets
+ * @return an error code
+ */
+static int _upipe_http_msrc_set_chunk_size(struct upipe *upipe,
+                                           uint64_t chunk_size)
+{
+    struct upipe_http_msrc *upipe_http_msrc = upipe_http_msrc_from_upipe(upipe);
+    if (!chunk_size)
+        return UBASE_ERR_INVALID;
+    upipe_http_msrc->chunk_size = chunk_size;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the maximum number of connections.
+ *
+ * @param upipe description structure of the pipe
+ * @param max_streams maximum number of connections
+ * @return an error code
+ */
+static int _upipe_http_msrc_set_max_streams(struct upipe *upipe,
+                                            unsigned int max_streams)
+{
+    struct upipe_http_msrc *upipe_http_msrc = upipe_http_msrc_from_upipe(upipe);
+    if (!max_streams)
+        return UBASE_ERR_INVALID;
+    upipe_http_msrc->max_streams = max_streams;
+    if (upipe_http_msrc->nb_streams > max_streams ||
+        (upipe_http_msrc->uclock == NULL &&
+         upipe_http_msrc->size != UINT64_MAX))
+        upipe_http_msrc->nb_streams = max_streams;
+    upipe_http_msrc_wake(upipe);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands on a http multi source pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_http_msrc_control(struct upipe *upipe,
+                                   int command, va_list args)
+{
+    struct upipe_http_msrc *upipe_http_msrc = upipe_http_msrc_from_upipe(upipe);
+
+    switch (command) {
+        case UPIPE_ATTACH_UPUMP_MGR:
+            upipe_http_msrc_set_upump(upipe, NULL);
+            UBASE_RETURN(upipe_http_msrc_attach_upump_mgr(upipe))
+            if (upipe_http_msrc->uri != NULL)
+                upipe_http_msrc_wake(upipe);
+            return UBASE_ERR_NONE;
+        case UPIPE_ATTACH_UCLOCK:
+            upipe_http_msrc_require_uclock(upipe);
+            return UBASE_ERR_NONE;
+
+        case UPIPE_REGISTER_REQUEST:
+        case UPIPE_UNREGISTER_REQUEST:
+        case UPIPE_GET_FLOW_DEF:
+        case UPIPE_GET_OUTPUT:
+        case UPIPE_SET_OUTPUT:
+            return upipe_http_msrc_control_output(upipe, command, args);
+
+        case UPIPE_GET_OUTPUT_SIZE:
+        case UPIPE_SET_OUTPUT_SIZE:
+            return upipe_http_msrc_control_output_size(upipe, command, args);
+
+        case UPIPE_GET_URI: {
+            const char **uri_p = va_arg(args, const char **);
+            return upipe_http_msrc_get_uri(upipe, uri_p);
+        }
+        case UPIPE_SET_URI: {
+            const char *uri = va_arg(args, const char *);
+            return upipe_http_msrc_set_uri(upipe, uri);
+        }
+
+        case UPIPE_SRC_GET_SIZE: {
+            uint64_t *size_p = va_arg(args, uint64_t *);
+            if (upipe_http_msrc->size == UINT64_MAX)
+                return UBASE_ERR_UNHANDLED;
+            *size_p = upipe_http_msrc->size;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_SRC_GET_POSITION: {
+            uint64_t *position_p = va_arg(args, uint64_t *);
+            *position_p = upipe_http_msrc->position;
+            return UBASE_ERR_NONE;
+        }
+
+        case UPIPE_HTTP_MSRC_GET_CHUNK_SIZE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_HTTP_MSRC_SIGNATURE)
+            uint64_t *chunk_size_p = va_arg(args, uint64_t *);
+            *chunk_size_p = upipe_http_msrc->chunk_size;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_HTTP_MSRC_SET_CHUNK_SIZE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_HTTP_MSRC_SIGNATURE)
+            uint64_t chunk_size = va_arg(args, uint64_t);
+            return _upipe_http_msrc_set_chunk_size(upipe, chunk_size);
+        }
+        case UPIPE_HTTP_MSRC_GET_MAX_STREAMS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_HTTP_MSRC_SIGNATURE)
+            unsigned int *max_streams_p = va_arg(args, unsigned int *);
+            *max_streams_p = upipe_http_msrc->max_streams;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_HTTP_MSRC_SET_MAX_STREAMS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_HTTP_MSRC_SIGNATURE)
+            unsigned int max_streams = va_arg(args, unsigned int);
+            return _upipe_http_msrc_set_max_streams(upipe, max_streams);
+        }
+        case UPIPE_HTTP_MSRC_GET_STREAMS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_HTTP_MSRC_SIGNATURE)
+            unsigned int *streams_p = va_arg(args, unsigned int *);
+            *streams_p = upipe_http_msrc->nb_streams;
+            return UBASE_ERR_NONE;
+        }
+
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @internal @This frees a http multi source manager.
+ *
+ * @param urefcount pointer to urefcount structure
+ */
+static void upipe_http_msrc_mgr_free(struct urefcount *urefcount)
+{
+    struct upipe_http_msrc_mgr *upipe_http_msrc_mgr =
+        upipe_http_msrc_mgr_from_urefcount(urefcount);
+    upipe_mgr_release(upipe_http_msrc_mgr->http_src_mgr);
+    urefcount_clean(urefcount);
+    free(upipe_http_msrc_mgr);
+}
+
+/** @This returns the management structure for http multi sources.
+ *
+ * @param http_src_mgr manager of the inner http sources
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_http_msrc_mgr_alloc(struct upipe_mgr *http_src_mgr)
+{
+    assert(http_src_mgr != NULL);
+    struct upipe_http_msrc_mgr *upipe_http_msrc_mgr =
+        malloc(sizeof(struct upipe_http_msrc_mgr));
+    if (unlikely(upipe_http_msrc_mgr == NULL))
+        return NULL;
+
+    memset(upipe_http_msrc_mgr, 0, sizeof(*upipe_http_msrc_mgr));
+    upipe_http_msrc_mgr->http_src_mgr = upipe_mgr_use(http_src_mgr);
+
+    urefcount_init(upipe_http_msrc_mgr_to_urefcount(upipe_http_msrc_mgr),
+                   upipe_http_msrc_mgr_free);
+    upipe_http_msrc_mgr->mgr.refcount =
+        upipe_http_msrc_mgr_to_urefcount(upipe_http_msrc_mgr);
+    upipe_http_msrc_mgr->mgr.signature = UPIPE_HTTP_MSRC_SIGNATURE;
+    upipe_http_msrc_mgr->mgr.upipe_alloc = upipe_http_msrc_alloc;
+    upipe_http_msrc_mgr->mgr.upipe_input = NULL;
+    upipe_http_msrc_mgr->mgr.upipe_control = upipe_http_msrc_control;
+    upipe_http_msrc_mgr->mgr.upipe_mgr_control = NULL;
+    return upipe_http_msrc_mgr_to_upipe_mgr(upipe_http_msrc_mgr);
+}
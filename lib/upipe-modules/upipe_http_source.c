@@ -281,8 +281,10 @@ static void upipe_http_src_close(struct upipe *upipe)
     upipe_http_src_set_upump(upipe, NULL);
     upipe_http_src->request_pending = false;
     upipe_http_src_set_upump_write(upipe, NULL);
-    if (flow_def)
+    if (flow_def) {
         uref_http_delete_content_type(flow_def);
+        uref_http_delete_complete_length(flow_def);
+    }
 }
 
 /** @This frees a upipe.
@@ -365,9 +367,21 @@ static int upipe_http_src_header_value(http_parser *parser,
     }
     else if (!strncasecmp("Content-Type", field.value, field.len)) {
         char content_type[len + 1];
-        snprintf(content_type, len + 1, "%s", at);
+        snprintf(content_type, len + 1, "%.*s", (int)len, at);
         uref_http_set_content_type(flow_def, content_type);
     }
+    else if (!strncasecmp("Content-Range", field.value, field.len)) {
+        /* bytes first-last/complete, complete may be unknown (*) */
+        char content_range[len + 1];
+        snprintf(content_range, len + 1, "%.*s", (int)len, at);
+        const char *complete = strchr(content_range, '/');
+        char *end;
+        if (complete != NULL && complete[1] >= '0' && complete[1] <= '9') {
+            uint64_t length = strtoull(complete + 1, &end, 10);
+            if (*end == '\0')
+                uref_http_set_complete_length(flow_def, length);
+        }
+    }
     return 0;
 }
 
@@ -693,9 +707,10 @@ static int upipe_http_src_send_request(struct upipe *upipe)
         if (upipe_http_src->range.length != (uint64_t)-1) {
             upipe_verbose_va(upipe, "range length: %"PRIu64,
                              upipe_http_src->range.length);
+            /* the last byte position is inclusive */
             request_add(&req, &req_len, "%"PRIu64,
                         upipe_http_src->range.offset +
-                        upipe_http_src->range.length);
+                        upipe_http_src->range.length - 1);
         }
 
         request_add(&req, &req_len, "\r\n");
@@ -1010,7 +1025,7 @@ static int _upipe_http_src_set_position(struct upipe *upipe,
                                         uint64_t offset)
 {
     struct upipe_http_src *upipe_http_src = upipe_http_src_from_upipe(upipe);
-    upipe_http_src->range = HTTP_RANGE(offset, 0);
+    upipe_http_src->range = HTTP_RANGE(offset, -1);
     return UBASE_ERR_NONE;
 }
 
@@ -35,6 +35,7 @@
 #include <upipe/upump.h>
 #include <upipe/upump_blocker.h>
 #include <upipe/upipe.h>
+#include <upipe/utrace.h>
 #include <upipe/upipe_helper_upipe.h>
 #include <upipe/upipe_helper_urefcount.h>
 #include <upipe/upipe_helper_uref_mgr.h>
@@ -159,8 +160,13 @@ static bool upipe_qsink_output(struct upipe *upipe, struct uref *uref,
                                struct upump **upump_p)
 {
     struct upipe_qsink *upipe_qsink = upipe_qsink_from_upipe(upipe);
-    return uqueue_push(&upipe_queue(upipe_qsink->qsrc)->uqueue,
-                       uref_to_uchain(uref));
+    /* the uref belongs to the other thread as soon as it is pushed */
+    uint64_t trace_id = utrace_get_id(uref);
+    if (!uqueue_push(&upipe_queue(upipe_qsink->qsrc)->uqueue,
+                     uref_to_uchain(uref)))
+        return false;
+    utrace_queue(upipe, trace_id, UTRACE_QUEUE_PUSH);
+    return true;
 }
 
 /** @internal @This is called when the queue can be written again.
@@ -220,6 +226,9 @@ static void upipe_qsink_input(struct upipe *upipe, struct uref *uref,
                               struct upump **upump_p)
 {
     struct upipe_qsink *upipe_qsink = upipe_qsink_from_upipe(upipe);
+    /* the buffer will be released in the thread of the queue source */
+    uref_unconfine(uref);
+
     if (!upipe_qsink->flow_def_sent && upipe_qsink->flow_def != NULL) {
         struct uref *flow_def;
         if ((flow_def = uref_dup(upipe_qsink->flow_def)) == NULL)
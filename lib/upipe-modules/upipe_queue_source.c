@@ -40,6 +40,7 @@
 #include <upipe/uref.h>
 #include <upipe/upump.h>
 #include <upipe/upipe.h>
+#include <upipe/utrace.h>
 #include <upipe/upipe_helper_upipe.h>
 #include <upipe/upipe_helper_urefcount.h>
 #include <upipe/upipe_helper_output.h>
@@ -176,8 +177,10 @@ static void upipe_qsrc_worker(struct upump *upump)
     struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
     struct upipe_qsrc *upipe_qsrc = upipe_qsrc_from_upipe(upipe);
     struct uref *uref = uqueue_pop(&upipe_queue(upipe)->uqueue, struct uref *);
-    if (likely(uref != NULL))
+    if (likely(uref != NULL)) {
+        utrace_queue(upipe, utrace_get_id(uref), UTRACE_QUEUE_POP);
         upipe_qsrc_input(upipe, uref, &upipe_qsrc->upump);
+    }
 }
 
 /** @internal @This handles the result of a request.
@@ -0,0 +1,690 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe statistical multiplexing controller
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/uprobe.h>
+#include <upipe/uclock.h>
+#include <upipe/uref.h>
+#include <upipe/uref_attr.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_pic.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_void.h>
+#include <upipe/upipe_helper_subpipe.h>
+#include <upipe/upipe_helper_output.h>
+#include <upipe-modules/upipe_statmux.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <inttypes.h>
+#include <math.h>
+#include <assert.h>
+
+/** default maximum T-STD retention delay (ISO/IEC 13818-1 2.4.2.6) */
+#define DEFAULT_MAX_DELAY UCLOCK_FREQ
+
+/** @internal @This is the private context of a statmux pipe. */
+struct upipe_statmux {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** pool octetrate */
+    uint64_t octetrate;
+    /** padding octetrate measured during the last GOPs */
+    uint64_t padding;
+
+    /** list of subs */
+    struct uchain subs;
+    /** manager to create subs */
+    struct upipe_mgr sub_mgr;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_statmux, upipe, UPIPE_STATMUX_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(upipe_statmux, urefcount, upipe_statmux_free)
+UPIPE_HELPER_VOID(upipe_statmux)
+
+/** @internal @This is the private context of a subpipe of a statmux pipe. */
+struct upipe_statmux_sub {
+    /** refcount management structure */
+    struct urefcount urefcount;
+    /** structure for double-linked lists */
+    struct uchain uchain;
+
+    /** pipe acting as output */
+    struct upipe *output;
+    /** flow definition packet on this output */
+    struct uref *flow_def;
+    /** output state */
+    enum upipe_helper_output_state output_state;
+    /** list of output requests */
+    struct uchain request_list;
+
+    /** true if the quantizer has a logarithmic scale (H.264, HEVC) */
+    bool log_qp;
+    /** octetrate declared in the input flow definition */
+    uint64_t flow_octetrate;
+    /** buffer size declared in the input flow definition */
+    uint64_t flow_buffer_size;
+    /** configured minimum octetrate */
+    uint64_t min_octetrate;
+    /** configured maximum octetrate, or 0 */
+    uint64_t max_octetrate;
+    /** maximum T-STD retention delay */
+    uint64_t max_delay;
+
+    /** DTS of the first picture of the current GOP */
+    uint64_t gop_dts;
+    /** octets in the current GOP */
+    uint64_t gop_octets;
+    /** sum of the quantizers of the current GOP */
+    uint64_t gop_qp;
+    /** number of pictures with a quantizer in the current GOP */
+    uint64_t gop_qp_pics;
+
+    /** smoothed complexity */
+    double complexity;
+    /** statistics exported to the application */
+    struct upipe_statmux_stats stats;
+
+    /** allocation computed by the last round */
+    uint64_t alloc;
+    /** true if the allocation was clamped in the current round */
+    bool clamped;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_statmux_sub, upipe, UPIPE_STATMUX_SUB_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(upipe_statmux_sub, urefcount, upipe_statmux_sub_free)
+UPIPE_HELPER_VOID(upipe_statmux_sub)
+UPIPE_HELPER_OUTPUT(upipe_statmux_sub, output, flow_def, output_state,
+                    request_list)
+
+UPIPE_HELPER_SUBPIPE(upipe_statmux, upipe_statmux_sub, sub, sub_mgr, subs,
+                     uchain)
+
+/** @internal @This returns the maximum octetrate of a service.
+ *
+ * @param sub private structure of the subpipe
+ * @param pool pool octetrate
+ * @return maximum octetrate
+ */
+static uint64_t upipe_statmux_sub_max(struct upipe_statmux_sub *sub,
+                                      uint64_t pool)
+{
+    uint64_t max = pool;
+    if (sub->max_octetrate && sub->max_octetrate < max)
+        max = sub->max_octetrate;
+    return max;
+}
+
+/** @internal @This returns the buffer size to use for a given octetrate.
+ * The buffering delay of the input flow definition is kept, within the
+ * T-STD retention delay.
+ *
+ * @param sub private structure of the subpipe
+ * @param octetrate allocated octetrate
+ * @return buffer size in octets
+ */
+static uint64_t upipe_statmux_sub_buffer_size(struct upipe_statmux_sub *sub,
+                                              uint64_t octetrate)
+{
+    uint64_t buffer_size = sub->max_delay * octetrate / UCLOCK_FREQ;
+    if (sub->flow_octetrate && sub->flow_buffer_size) {
+        uint64_t scaled = (double)sub->flow_buffer_size * octetrate /
+                          sub->flow_octetrate;
+        if (scaled < buffer_size)
+            buffer_size = scaled;
+    }
+    return buffer_size;
+}
+
+/** @internal @This builds the output flow definition, with the allocated
+ * octetrate and buffer size, so that the reservation of the mux input
+ * follows the allocation.
+ *
+ * @param upipe description structure of the subpipe
+ * @param flow_def input flow definition, or NULL to use the current output
+ * flow definition
+ * @return an error code
+ */
+static int upipe_statmux_sub_build_flow_def(struct upipe *upipe,
+                                            struct uref *flow_def)
+{
+    struct upipe_statmux_sub *sub = upipe_statmux_sub_from_upipe(upipe);
+    if (flow_def == NULL)
+        flow_def = sub->flow_def;
+    if (flow_def == NULL)
+        return UBASE_ERR_NONE;
+
+    struct uref *flow_def_dup;
+    if ((flow_def_dup = uref_dup(flow_def)) == NULL)
+        return UBASE_ERR_ALLOC;
+    if (sub->stats.octetrate) {
+        int err = uref_block_flow_set_octetrate(flow_def_dup,
+                                                sub->stats.octetrate);
+        if (ubase_check(err))
+            err = uref_block_flow_set_buffer_size(flow_def_dup,
+                                                  sub->stats.buffer_size);
+        if (unlikely(!ubase_check(err))) {
+            uref_free(flow_def_dup);
+            return err;
+        }
+    }
+    upipe_statmux_sub_store_flow_def(upipe, flow_def_dup);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This applies a new allocation to a subpipe: the output flow
+ * definition is updated and sent right away, and the encoder is asked to
+ * follow.
+ *
+ * @param upipe description structure of the subpipe
+ */
+static void upipe_statmux_sub_realloc(struct upipe *upipe)
+{
+    struct upipe_statmux_sub *sub = upipe_statmux_sub_from_upipe(upipe);
+    uint64_t buffer_size = upipe_statmux_sub_buffer_size(sub, sub->alloc);
+    sub->stats.octetrate = sub->alloc;
+    sub->stats.buffer_size = buffer_size;
+    upipe_verbose_va(upipe,
+            "allocating %"PRIu64" bits/s, buffer %"PRIu64" octets",
+            sub->alloc * 8, buffer_size);
+
+    int err = upipe_statmux_sub_build_flow_def(upipe, NULL);
+    if (unlikely(!ubase_check(err)))
+        upipe_throw_fatal(upipe, err);
+    else if (sub->output != NULL && sub->flow_def != NULL)
+        upipe_statmux_sub_output(upipe, NULL, NULL);
+
+    upipe_throw(upipe, UPROBE_STATMUX_SUB_REALLOC,
+                UPIPE_STATMUX_SUB_SIGNATURE, sub->alloc, buffer_size);
+}
+
+/** @internal @This distributes the pool octetrate between the subpipes
+ * in proportion of their complexity, and throws an event on the subpipes
+ * whose allocation changed.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_statmux_allocate(struct upipe *upipe)
+{
+    struct upipe_statmux *upipe_statmux = upipe_statmux_from_upipe(upipe);
+    uint64_t pool = upipe_statmux->octetrate;
+    if (!pool)
+        return;
+
+    /* services without statistics yet get the mean complexity */
+    double known = 0.;
+    unsigned int nb_known = 0, nb_subs = 0;
+    uint64_t measured = 0;
+    struct uchain *uchain;
+    ulist_foreach (&upipe_statmux->subs, uchain) {
+        struct upipe_statmux_sub *sub = upipe_statmux_sub_from_uchain(uchain);
+        sub->clamped = false;
+        nb_subs++;
+        if (sub->complexity > 0.) {
+            known += sub->complexity;
+            nb_known++;
+        }
+        measured += sub->stats.measured_octetrate;
+    }
+    if (!nb_subs)
+        return;
+    double mean = nb_known ? known / nb_known : 1.;
+
+    upipe_statmux->padding = measured < pool ? pool - measured : 0;
+
+    /* water-filling: clamp the services outside of their range and
+     * distribute the remainder between the others */
+    uint64_t remaining = pool;
+    for ( ; ; ) {
+        double total = 0.;
+        ulist_foreach (&upipe_statmux->subs, uchain) {
+            struct upipe_statmux_sub *sub =
+                upipe_statmux_sub_from_uchain(uchain);
+            if (!sub->clamped)
+                total += sub->complexity > 0. ? sub->complexity : mean;
+        }
+        if (total <= 0.)
+            break;
+
+        bool clamped = false;
+        uint64_t given = 0;
+        ulist_foreach (&upipe_statmux->subs, uchain) {
+            struct upipe_statmux_sub *sub =
+                upipe_statmux_sub_from_uchain(uchain);
+            if (sub->clamped)
+                continue;
+            double weight = sub->complexity > 0. ? sub->complexity : mean;
+            uint64_t share = remaining * weight / total;
+            uint64_t max = upipe_statmux_sub_max(sub, pool);
+            uint64_t min = sub->min_octetrate < max ? sub->min_octetrate : max;
+            if (share < min || share > max) {
+                sub->alloc = share < min ? min : max;
+                sub->clamped = true;
+                given += sub->alloc;
+                clamped = true;
+            } else
+                sub->alloc = share;
+        }
+        if (!clamped)
+            break;
+        remaining = given < remaining ? remaining - given : 0;
+    }
+
+    /* minimum octetrates may not fit in the pool */
+    uint64_t total = 0;
+    ulist_foreach (&upipe_statmux->subs, uchain) {
+        struct upipe_statmux_sub *sub = upipe_statmux_sub_from_uchain(uchain);
+        total += sub->alloc;
+    }
+    if (total > pool) {
+        upipe_warn_va(upipe, "minimum octetrates exceed the pool (%"PRIu64
+                      " > %"PRIu64" bits/s)", total * 8, pool * 8);
+        ulist_foreach (&upipe_statmux->subs, uchain) {
+            struct upipe_statmux_sub *sub =
+                upipe_statmux_sub_from_uchain(uchain);
+            sub->alloc = (double)sub->alloc * pool / total;
+        }
+    }
+
+    /* release octetrate before giving it, so that the reservations of the
+     * mux inputs never exceed the pool */
+    for (int increase = 0; increase < 2; increase++) {
+        ulist_foreach (&upipe_statmux->subs, uchain) {
+            struct upipe_statmux_sub *sub =
+                upipe_statmux_sub_from_uchain(uchain);
+            uint64_t buffer_size =
+                upipe_statmux_sub_buffer_size(sub, sub->alloc);
+            if ((sub->alloc == sub->stats.octetrate &&
+                 buffer_size == sub->stats.buffer_size) ||
+                (sub->alloc > sub->stats.octetrate) != increase)
+                continue;
+            upipe_statmux_sub_realloc(upipe_statmux_sub_to_upipe(sub));
+        }
+    }
+}
+
+/** @internal @This allocates a subpipe of a statmux pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_statmux_sub_alloc(struct upipe_mgr *mgr,
+                                             struct uprobe *uprobe,
+                                             uint32_t signature,
+                                             va_list args)
+{
+    struct upipe *upipe = upipe_statmux_sub_alloc_void(mgr, uprobe, signature,
+                                                       args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_statmux_sub *sub = upipe_statmux_sub_from_upipe(upipe);
+    upipe_statmux_sub_init_urefcount(upipe);
+    upipe_statmux_sub_init_output(upipe);
+    upipe_statmux_sub_init_sub(upipe);
+    sub->log_qp = false;
+    sub->flow_octetrate = 0;
+    sub->flow_buffer_size = 0;
+    sub->min_octetrate = 0;
+    sub->max_octetrate = 0;
+    sub->max_delay = DEFAULT_MAX_DELAY;
+    sub->gop_dts = UINT64_MAX;
+    sub->gop_octets = 0;
+    sub->gop_qp = 0;
+    sub->gop_qp_pics = 0;
+    sub->complexity = 0.;
+    sub->stats.octetrate = 0;
+    sub->stats.buffer_size = 0;
+    sub->stats.measured_octetrate = 0;
+    sub->stats.qp.num = 0;
+    sub->stats.qp.den = 1;
+    sub->stats.complexity = 0;
+    sub->stats.gops = 0;
+    sub->alloc = 0;
+    sub->clamped = false;
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @internal @This closes the current GOP and updates the complexity of
+ * the service.
+ *
+ * @param upipe description structure of the pipe
+ * @param dts DTS of the first picture of the next GOP
+ */
+static void upipe_statmux_sub_end_gop(struct upipe *upipe, uint64_t dts)
+{
+    struct upipe_statmux_sub *sub = upipe_statmux_sub_from_upipe(upipe);
+    uint64_t duration = dts - sub->gop_dts;
+    if (!duration || !sub->gop_octets)
+        return;
+
+    uint64_t octetrate = sub->gop_octets * UCLOCK_FREQ / duration;
+    double qstep = 1.;
+    if (sub->gop_qp_pics) {
+        double qp = (double)sub->gop_qp / sub->gop_qp_pics;
+        /* the quantizer step doubles every 6 QP in H.264 and HEVC */
+        qstep = sub->log_qp ? exp2((qp - 4.) / 6.) : qp;
+    }
+    double complexity = octetrate * qstep;
+    if (sub->complexity > 0.)
+        sub->complexity = (sub->complexity + complexity) / 2.;
+    else
+        sub->complexity = complexity;
+
+    sub->stats.measured_octetrate = octetrate;
+    sub->stats.qp.num = sub->gop_qp;
+    sub->stats.qp.den = sub->gop_qp_pics ? sub->gop_qp_pics : 1;
+    urational_simplify(&sub->stats.qp);
+    sub->stats.complexity = sub->complexity;
+    sub->stats.gops++;
+    upipe_verbose_va(upipe, "GOP at %"PRIu64" bits/s, complexity %"PRIu64,
+                     octetrate * 8, sub->stats.complexity);
+
+    struct upipe_statmux *upipe_statmux =
+        upipe_statmux_from_sub_mgr(upipe->mgr);
+    upipe_statmux_allocate(upipe_statmux_to_upipe(upipe_statmux));
+}
+
+/** @internal @This receives coded pictures.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_statmux_sub_input(struct upipe *upipe, struct uref *uref,
+                                    struct upump **upump_p)
+{
+    struct upipe_statmux_sub *sub = upipe_statmux_sub_from_upipe(upipe);
+    uint64_t dts;
+    if (ubase_check(uref_flow_get_random(uref)) &&
+        ubase_check(uref_clock_get_dts_prog(uref, &dts))) {
+        if (sub->gop_dts != UINT64_MAX && dts > sub->gop_dts)
+            upipe_statmux_sub_end_gop(upipe, dts);
+        sub->gop_dts = dts;
+        sub->gop_octets = 0;
+        sub->gop_qp = 0;
+        sub->gop_qp_pics = 0;
+    }
+
+    size_t size;
+    if (ubase_check(uref_block_size(uref, &size)))
+        sub->gop_octets += size;
+    uint8_t qp;
+    if (ubase_check(uref_pic_get_qp(uref, &qp))) {
+        sub->gop_qp += qp;
+        sub->gop_qp_pics++;
+    }
+
+    upipe_statmux_sub_output(upipe, uref, upump_p);
+}
+
+/** @internal @This sets the input flow definition.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_def flow definition packet
+ * @return an error code
+ */
+static int upipe_statmux_sub_set_flow_def(struct upipe *upipe,
+                                          struct uref *flow_def)
+{
+    struct upipe_statmux_sub *sub = upipe_statmux_sub_from_upipe(upipe);
+    const char *def;
+    if (flow_def == NULL ||
+        !ubase_check(uref_flow_get_def(flow_def, &def)) ||
+        ubase_ncmp(def, "block."))
+        return UBASE_ERR_INVALID;
+
+    sub->log_qp = !ubase_ncmp(def, "block.h264.") ||
+                  !ubase_ncmp(def, "block.hevc.");
+    sub->flow_octetrate = 0;
+    uref_block_flow_get_octetrate(flow_def, &sub->flow_octetrate);
+    sub->flow_buffer_size = 0;
+    uref_block_flow_get_buffer_size(flow_def, &sub->flow_buffer_size);
+    return upipe_statmux_sub_build_flow_def(upipe, flow_def);
+}
+
+/** @internal @This processes control commands on a statmux subpipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_statmux_sub_control(struct upipe *upipe,
+                                     int command, va_list args)
+{
+    struct upipe_statmux_sub *sub = upipe_statmux_sub_from_upipe(upipe);
+    UBASE_HANDLED_RETURN(
+        upipe_statmux_sub_control_output(upipe, command, args));
+    UBASE_HANDLED_RETURN(
+        upipe_statmux_sub_control_super(upipe, command, args));
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            return upipe_statmux_sub_set_flow_def(upipe, flow_def);
+        }
+
+        case UPIPE_STATMUX_SUB_GET_OCTETRATE_RANGE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_STATMUX_SUB_SIGNATURE)
+            uint64_t *min_p = va_arg(args, uint64_t *);
+            uint64_t *max_p = va_arg(args, uint64_t *);
+            *min_p = sub->min_octetrate;
+            *max_p = sub->max_octetrate;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_STATMUX_SUB_SET_OCTETRATE_RANGE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_STATMUX_SUB_SIGNATURE)
+            uint64_t min = va_arg(args, uint64_t);
+            uint64_t max = va_arg(args, uint64_t);
+            if (max && min > max)
+                return UBASE_ERR_INVALID;
+            sub->min_octetrate = min;
+            sub->max_octetrate = max;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_STATMUX_SUB_GET_MAX_DELAY: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_STATMUX_SUB_SIGNATURE)
+            uint64_t *delay_p = va_arg(args, uint64_t *);
+            *delay_p = sub->max_delay;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_STATMUX_SUB_SET_MAX_DELAY: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_STATMUX_SUB_SIGNATURE)
+            sub->max_delay = va_arg(args, uint64_t);
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_STATMUX_SUB_GET_STATS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_STATMUX_SUB_SIGNATURE)
+            struct upipe_statmux_stats *stats =
+                va_arg(args, struct upipe_statmux_stats *);
+            *stats = sub->stats;
+            return UBASE_ERR_NONE;
+        }
+
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This frees a upipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_statmux_sub_free(struct upipe *upipe)
+{
+    struct upipe_statmux *upipe_statmux =
+        upipe_statmux_from_sub_mgr(upipe->mgr);
+    upipe_throw_dead(upipe);
+
+    upipe_statmux_sub_clean_output(upipe);
+    upipe_statmux_sub_clean_sub(upipe);
+    /* give the freed octetrate back to the other services */
+    upipe_statmux_allocate(upipe_statmux_to_upipe(upipe_statmux));
+    upipe_statmux_sub_clean_urefcount(upipe);
+    upipe_statmux_sub_free_void(upipe);
+}
+
+/** @internal @This initializes the output manager for a statmux pipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_statmux_init_sub_mgr(struct upipe *upipe)
+{
+    struct upipe_statmux *upipe_statmux = upipe_statmux_from_upipe(upipe);
+    struct upipe_mgr *sub_mgr = &upipe_statmux->sub_mgr;
+    sub_mgr->refcount = upipe_statmux_to_urefcount(upipe_statmux);
+    sub_mgr->signature = UPIPE_STATMUX_SUB_SIGNATURE;
+    sub_mgr->upipe_alloc = upipe_statmux_sub_alloc;
+    sub_mgr->upipe_input = upipe_statmux_sub_input;
+    sub_mgr->upipe_control = upipe_statmux_sub_control;
+    sub_mgr->upipe_mgr_control = NULL;
+}
+
+/** @internal @This allocates a statmux pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_statmux_alloc(struct upipe_mgr *mgr,
+                                         struct uprobe *uprobe,
+                                         uint32_t signature, va_list args)
+{
+    struct upipe *upipe = upipe_statmux_alloc_void(mgr, uprobe, signature,
+                                                   args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_statmux *upipe_statmux = upipe_statmux_from_upipe(upipe);
+    upipe_statmux_init_urefcount(upipe);
+    upipe_statmux_init_sub_mgr(upipe);
+    upipe_statmux_init_sub_subs(upipe);
+    upipe_statmux->octetrate = 0;
+    upipe_statmux->padding = 0;
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @internal @This processes control commands on a statmux pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_statmux_control(struct upipe *upipe, int command,
+                                 va_list args)
+{
+    struct upipe_statmux *upipe_statmux = upipe_statmux_from_upipe(upipe);
+    UBASE_HANDLED_RETURN(upipe_statmux_control_subs(upipe, command, args));
+    switch (command) {
+        case UPIPE_STATMUX_GET_OCTETRATE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_STATMUX_SIGNATURE)
+            uint64_t *octetrate_p = va_arg(args, uint64_t *);
+            *octetrate_p = upipe_statmux->octetrate;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_STATMUX_SET_OCTETRATE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_STATMUX_SIGNATURE)
+            upipe_statmux->octetrate = va_arg(args, uint64_t);
+            upipe_statmux_allocate(upipe);
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_STATMUX_GET_PADDING: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_STATMUX_SIGNATURE)
+            uint64_t *octetrate_p = va_arg(args, uint64_t *);
+            struct urational *ratio_p = va_arg(args, struct urational *);
+            if (octetrate_p != NULL)
+                *octetrate_p = upipe_statmux->padding;
+            if (ratio_p != NULL) {
+                ratio_p->num = upipe_statmux->padding;
+                ratio_p->den = upipe_statmux->octetrate ?
+                               upipe_statmux->octetrate : 1;
+                urational_simplify(ratio_p);
+            }
+            return UBASE_ERR_NONE;
+        }
+
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This frees a upipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_statmux_free(struct upipe *upipe)
+{
+    upipe_throw_dead(upipe);
+
+    upipe_statmux_clean_sub_subs(upipe);
+    upipe_statmux_clean_urefcount(upipe);
+    upipe_statmux_free_void(upipe);
+}
+
+/** module manager static descriptor */
+static struct upipe_mgr upipe_statmux_mgr = {
+    .refcount = NULL,
+    .signature = UPIPE_STATMUX_SIGNATURE,
+
+    .upipe_alloc = upipe_statmux_alloc,
+    .upipe_input = NULL,
+    .upipe_control = upipe_statmux_control,
+
+    .upipe_mgr_control = NULL
+};
+
+/** @This returns the management structure for all statmux pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_statmux_mgr_alloc(void)
+{
+    return &upipe_statmux_mgr;
+}
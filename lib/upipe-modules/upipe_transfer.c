@@ -352,6 +352,8 @@ static struct upipe *_upipe_xfer_alloc(struct upipe_mgr *mgr,
     uprobe_init(&upipe_xfer->uprobe_remote, upipe_xfer_probe, NULL);
     upipe_xfer->uprobe_remote.refcount =
         upipe_xfer_to_urefcount_probe(upipe_xfer);
+    /* the remote pipe will release its buffers in the other thread */
+    upipe_unconfine(upipe_remote);
     upipe_push_probe(upipe_remote, &upipe_xfer->uprobe_remote);
     upipe_xfer->upipe_remote = upipe_remote;
     upipe_throw_ready(upipe);
@@ -736,3 +736,88 @@ int upipe_udp_open_socket(struct upipe *upipe, const char *_uri, int ttl,
 
     return fd;
 }
+
+/** @internal @This parses the URI of a destination, of the form
+ * host:port[/option...]. Options are ttl=, tos=, dscp=, ifindex= and
+ * ifname=.
+ *
+ * @param upipe description structure of the pipe
+ * @param _uri destination URI
+ * @param default_port port used if the URI does not have one
+ * @param addr filled in with the destination address
+ * @param addrlen_p filled in with the size of the destination address
+ * @param ttl_p filled in with the time-to-live, or 0 for the default
+ * @param tos_p filled in with the type of service, or 0 for the default
+ * @param if_index_p filled in with the output interface, or 0
+ * @return false in case of error
+ */
+bool upipe_udp_parse_dest(struct upipe *upipe, const char *_uri,
+                          uint16_t default_port,
+                          struct sockaddr_storage *addr, socklen_t *addrlen_p,
+                          int *ttl_p, int *tos_p, int *if_index_p)
+{
+    char *uri = strdup(_uri);
+    char *token, *token2;
+    union sockaddru dest;
+
+    if (uri == NULL)
+        return false;
+
+    *ttl_p = *tos_p = *if_index_p = 0;
+    memset(&dest, 0, sizeof(union sockaddru));
+
+    token2 = strchr(uri, '/');
+    if (token2 != NULL)
+        *token2 = '\0';
+
+    if (uri[0] == '\0' || uri[0] == '@' ||
+        !upipe_udp_parse_node_service(upipe, uri, &token, default_port,
+                                      if_index_p, &dest.ss) ||
+        *token != '\0') {
+        upipe_err_va(upipe, "invalid destination %s", _uri);
+        free(uri);
+        return false;
+    }
+
+    while (token2 != NULL) {
+        *token2++ = '\0';
+#define IS_OPTION(option) (!strncasecmp(token2, option, strlen(option)))
+#define ARG_OPTION(option) (token2 + strlen(option))
+        if (IS_OPTION("ttl=")) {
+            *ttl_p = strtol(ARG_OPTION("ttl="), NULL, 0);
+        } else if (IS_OPTION("tos=")) {
+            *tos_p = strtol(ARG_OPTION("tos="), NULL, 0);
+        } else if (IS_OPTION("dscp=")) {
+            *tos_p = strtol(ARG_OPTION("dscp="), NULL, 0) << 2;
+        } else if (IS_OPTION("ifindex=")) {
+            *if_index_p = strtol(ARG_OPTION("ifindex="), NULL, 0);
+        } else if (IS_OPTION("ifname=")) {
+            char *option = config_stropt(ARG_OPTION("ifname="));
+            bool ret = option != NULL &&
+                upipe_udp_get_ifindex(upipe, option, if_index_p);
+            free(option);
+            if (!ret) {
+                free(uri);
+                return false;
+            }
+        } else {
+            upipe_warn_va(upipe, "unrecognized option %s", token2);
+        }
+#undef IS_OPTION
+#undef ARG_OPTION
+        token2 = strchr(token2, '/');
+    }
+    free(uri);
+
+    if (dest.ss.ss_family == AF_INET) {
+        /* required on some architectures */
+        memset(&dest.sin.sin_zero, 0, sizeof(dest.sin.sin_zero));
+        *addrlen_p = sizeof(struct sockaddr_in);
+    } else {
+        if (*if_index_p)
+            dest.sin6.sin6_scope_id = *if_index_p;
+        *addrlen_p = sizeof(struct sockaddr_in6);
+    }
+    memcpy(addr, &dest.ss, *addrlen_p);
+    return true;
+}
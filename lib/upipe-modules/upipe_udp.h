@@ -30,6 +30,7 @@
 
 #include <upipe/upipe.h>
 #include <stdint.h>
+#include <sys/socket.h>
 
 #define IP_HEADER_MINSIZE 20
 #define UDP_HEADER_SIZE 8
@@ -165,3 +166,21 @@ int upipe_udp_open_socket(struct upipe *upipe, const char *_uri, int ttl,
                           bool *use_raw, uint8_t *raw_header);
 
 void udp_raw_set_len(uint8_t *raw_header, uint16_t len);
+
+/** @internal @This parses the URI of a destination, of the form
+ * host:port[/option...]
+ *
+ * @param upipe description structure of the pipe
+ * @param _uri destination URI
+ * @param default_port port used if the URI does not have one
+ * @param addr filled in with the destination address
+ * @param addrlen_p filled in with the size of the destination address
+ * @param ttl_p filled in with the time-to-live, or 0 for the default
+ * @param tos_p filled in with the type of service, or 0 for the default
+ * @param if_index_p filled in with the output interface, or 0
+ * @return false in case of error
+ */
+bool upipe_udp_parse_dest(struct upipe *upipe, const char *_uri,
+                          uint16_t default_port,
+                          struct sockaddr_storage *addr, socklen_t *addrlen_p,
+                          int *ttl_p, int *tos_p, int *if_index_p);
@@ -0,0 +1,860 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe sink module sending udp datagrams to several destinations
+ *
+ * Each buffer is mapped once, and the same iovec is sent to all
+ * destinations from a single socket, in batches of datagrams handed to
+ * sendmmsg(). Per-destination options (time-to-live, type of service,
+ * output interface) are passed as ancillary data.
+ */
+
+#define _GNU_SOURCE
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/uprobe.h>
+#include <upipe/uclock.h>
+#include <upipe/uref.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_flow.h>
+#include <upipe/upump.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_void.h>
+#include <upipe/upipe_helper_upump_mgr.h>
+#include <upipe/upipe_helper_upump.h>
+#include <upipe/upipe_helper_input.h>
+#include <upipe/upipe_helper_uclock.h>
+#include <upipe-modules/upipe_udp_multi_sink.h>
+#include "upipe_udp.h"
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <assert.h>
+
+/** tolerance for late packets */
+#define SYSTIME_TOLERANCE UCLOCK_FREQ
+/** print late packets */
+#define SYSTIME_PRINT (UCLOCK_FREQ / 100)
+/** expected flow definition on all flows */
+#define EXPECTED_FLOW_DEF    "block."
+
+#define UDP_DEFAULT_PORT 1234
+/** maximum number of datagrams per system call */
+#define BATCH_SIZE 128
+
+#ifndef UPIPE_HAVE_SENDMMSG
+/** @hidden */
+struct mmsghdr {
+    struct msghdr msg_hdr;
+    unsigned int msg_len;
+};
+
+/** @internal @This emulates sendmmsg() with one sendmsg() per datagram.
+ *
+ * @param fd socket
+ * @param msgvec array of datagrams
+ * @param vlen number of datagrams
+ * @param flags flags passed to sendmsg()
+ * @return number of datagrams sent, or -1 if the first one failed
+ */
+static int sendmmsg(int fd, struct mmsghdr *msgvec, unsigned int vlen,
+                    int flags)
+{
+    unsigned int i;
+    for (i = 0; i < vlen; i++) {
+        ssize_t ret = sendmsg(fd, &msgvec[i].msg_hdr, flags);
+        if (ret == -1)
+            return i ? i : -1;
+        msgvec[i].msg_len = ret;
+    }
+    return i;
+}
+#endif
+
+/** @hidden */
+static void upipe_udpmsink_watcher(struct upump *upump);
+/** @hidden */
+static bool upipe_udpmsink_output(struct upipe *upipe, struct uref *uref,
+                                  struct upump **upump_p);
+
+/** @internal @This is the description of a destination. */
+struct upipe_udpmsink_dest {
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** destination uri */
+    char *uri;
+    /** destination address */
+    struct sockaddr_storage addr;
+    /** size of the destination address */
+    socklen_t addrlen;
+    /** ancillary data carrying the per-destination options */
+    union {
+        char buf[2 * CMSG_SPACE(sizeof(int)) +
+                 CMSG_SPACE(sizeof(struct in6_pktinfo))];
+        struct cmsghdr align;
+    } control;
+    /** size of the ancillary data */
+    size_t controllen;
+    /** true if the last datagram could not be sent */
+    bool error;
+};
+
+UBASE_FROM_TO(upipe_udpmsink_dest, uchain, uchain, uchain)
+
+/** @internal @This is the private context of a udp multi sink pipe. */
+struct upipe_udpmsink {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** upump manager */
+    struct upump_mgr *upump_mgr;
+    /** write watcher */
+    struct upump *upump;
+
+    /** uclock structure, if not NULL we are in live mode */
+    struct uclock *uclock;
+    /** uclock request */
+    struct urequest uclock_request;
+
+    /** delay applied to systime attribute when uclock is provided */
+    uint64_t latency;
+    /** file descriptor */
+    int fd;
+    /** address family of the socket, or AF_UNSPEC if unknown */
+    int family;
+    /** temporary uref storage */
+    struct uchain urefs;
+    /** nb urefs in storage */
+    unsigned int nb_urefs;
+    /** max urefs in storage */
+    unsigned int max_urefs;
+    /** list of blockers */
+    struct uchain blockers;
+
+    /** list of destinations */
+    struct uchain dests;
+    /** first destination the blocked buffer was not sent to, or NULL */
+    struct uchain *resume;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_udpmsink, upipe, UPIPE_UDPMSINK_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(upipe_udpmsink, urefcount, upipe_udpmsink_free)
+UPIPE_HELPER_VOID(upipe_udpmsink)
+UPIPE_HELPER_UPUMP_MGR(upipe_udpmsink, upump_mgr)
+UPIPE_HELPER_UPUMP(upipe_udpmsink, upump, upump_mgr)
+UPIPE_HELPER_INPUT(upipe_udpmsink, urefs, nb_urefs, max_urefs, blockers,
+                   upipe_udpmsink_output)
+UPIPE_HELPER_UCLOCK(upipe_udpmsink, uclock, uclock_request, NULL,
+                    upipe_throw_provide_request, NULL)
+
+/** @internal @This allocates a udp multi sink pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_udpmsink_alloc(struct upipe_mgr *mgr,
+                                          struct uprobe *uprobe,
+                                          uint32_t signature, va_list args)
+{
+    struct upipe *upipe = upipe_udpmsink_alloc_void(mgr, uprobe, signature,
+                                                    args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_udpmsink *upipe_udpmsink = upipe_udpmsink_from_upipe(upipe);
+    upipe_udpmsink_init_urefcount(upipe);
+    upipe_udpmsink_init_upump_mgr(upipe);
+    upipe_udpmsink_init_upump(upipe);
+    upipe_udpmsink_init_input(upipe);
+    upipe_udpmsink_init_uclock(upipe);
+    upipe_udpmsink->latency = 0;
+    upipe_udpmsink->fd = -1;
+    upipe_udpmsink->family = AF_UNSPEC;
+    ulist_init(&upipe_udpmsink->dests);
+    upipe_udpmsink->resume = NULL;
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** @This starts the watcher waiting for the sink to unblock.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_udpmsink_poll(struct upipe *upipe)
+{
+    struct upipe_udpmsink *upipe_udpmsink = upipe_udpmsink_from_upipe(upipe);
+    if (unlikely(!ubase_check(upipe_udpmsink_check_upump_mgr(upipe)))) {
+        upipe_err_va(upipe, "can't get upump_mgr");
+        upipe_throw_fatal(upipe, UBASE_ERR_UPUMP);
+        return;
+    }
+    struct upump *watcher = upump_alloc_fd_write(upipe_udpmsink->upump_mgr,
+            upipe_udpmsink_watcher, upipe, upipe->refcount,
+            upipe_udpmsink->fd);
+    if (unlikely(watcher == NULL)) {
+        upipe_err_va(upipe, "can't create watcher");
+        upipe_throw_fatal(upipe, UBASE_ERR_UPUMP);
+    } else {
+        upump_set_priority(watcher, UPUMP_PRIORITY_HIGH);
+        upipe_udpmsink_set_upump(upipe, watcher);
+        upump_start(watcher);
+    }
+}
+
+/** @internal @This starts a timer waiting for the date of the next packet.
+ *
+ * @param upipe description structure of the pipe
+ * @param timeout time to wait before waking up
+ */
+static void upipe_udpmsink_wait(struct upipe *upipe, uint64_t timeout)
+{
+    struct upipe_udpmsink *upipe_udpmsink = upipe_udpmsink_from_upipe(upipe);
+    upipe_udpmsink_wait_upump(upipe, timeout, upipe_udpmsink_watcher);
+    if (likely(upipe_udpmsink->upump != NULL))
+        upump_set_priority(upipe_udpmsink->upump, UPUMP_PRIORITY_HIGH);
+}
+
+/** @internal @This sends a buffer to all destinations which have not
+ * received it yet.
+ *
+ * @param upipe description structure of the pipe
+ * @param iovecs buffer to send
+ * @param iovec_count number of elements in iovecs
+ * @return false if the socket is blocked
+ */
+static bool upipe_udpmsink_send(struct upipe *upipe,
+                                struct iovec *iovecs, int iovec_count)
+{
+    struct upipe_udpmsink *upipe_udpmsink = upipe_udpmsink_from_upipe(upipe);
+    struct uchain *uchain = upipe_udpmsink->resume != NULL ?
+                            upipe_udpmsink->resume :
+                            upipe_udpmsink->dests.next;
+    upipe_udpmsink->resume = NULL;
+
+    while (uchain != &upipe_udpmsink->dests) {
+        struct mmsghdr msgs[BATCH_SIZE];
+        unsigned int nb = 0;
+        for (struct uchain *it = uchain;
+             it != &upipe_udpmsink->dests && nb < BATCH_SIZE;
+             it = it->next, nb++) {
+            struct upipe_udpmsink_dest *dest =
+                upipe_udpmsink_dest_from_uchain(it);
+            struct msghdr *msghdr = &msgs[nb].msg_hdr;
+            msghdr->msg_name = &dest->addr;
+            msghdr->msg_namelen = dest->addrlen;
+            msghdr->msg_iov = iovecs;
+            msghdr->msg_iovlen = iovec_count;
+            msghdr->msg_control = dest->controllen ?
+                                  dest->control.buf : NULL;
+            msghdr->msg_controllen = dest->controllen;
+            msghdr->msg_flags = 0;
+        }
+
+        int ret = sendmmsg(upipe_udpmsink->fd, msgs, nb, 0);
+        if (unlikely(ret == -1)) {
+            struct upipe_udpmsink_dest *dest =
+                upipe_udpmsink_dest_from_uchain(uchain);
+            switch (errno) {
+                case EINTR:
+                    continue;
+                case EAGAIN:
+#if EAGAIN != EWOULDBLOCK
+                case EWOULDBLOCK:
+#endif
+                    upipe_udpmsink->resume = uchain;
+                    return false;
+                default:
+                    /* The first datagram of the batch failed, most likely
+                     * because of this destination only: skip it, and do
+                     * not flood the log while it keeps failing. */
+                    if (!dest->error)
+                        upipe_warn_va(upipe, "can't send to %s (%m)",
+                                      dest->uri);
+                    dest->error = true;
+                    uchain = uchain->next;
+                    continue;
+            }
+        }
+
+        for (int i = 0; i < ret; i++) {
+            upipe_udpmsink_dest_from_uchain(uchain)->error = false;
+            uchain = uchain->next;
+        }
+    }
+    return true;
+}
+
+/** @internal @This outputs data to all destinations.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ * @return true if the uref was processed
+ */
+static bool upipe_udpmsink_output(struct upipe *upipe, struct uref *uref,
+                                  struct upump **upump_p)
+{
+    struct upipe_udpmsink *upipe_udpmsink = upipe_udpmsink_from_upipe(upipe);
+    const char *def;
+    if (unlikely(ubase_check(uref_flow_get_def(uref, &def)))) {
+        uint64_t latency = 0;
+        uref_clock_get_latency(uref, &latency);
+        if (latency > upipe_udpmsink->latency)
+            upipe_udpmsink->latency = latency;
+        uref_free(uref);
+        return true;
+    }
+
+    if (unlikely(upipe_udpmsink->fd == -1 ||
+                 ulist_empty(&upipe_udpmsink->dests))) {
+        upipe_verbose(upipe, "dropping buffer without destination");
+        uref_free(uref);
+        return true;
+    }
+
+    if (likely(upipe_udpmsink->uclock == NULL ||
+               upipe_udpmsink->resume != NULL))
+        goto write_buffer;
+
+    uint64_t systime = 0;
+    if (unlikely(!ubase_check(uref_clock_get_cr_sys(uref, &systime)))) {
+        upipe_warn(upipe, "received non-dated buffer");
+        goto write_buffer;
+    }
+
+    uint64_t now = uclock_now(upipe_udpmsink->uclock);
+    systime += upipe_udpmsink->latency;
+    if (unlikely(now < systime)) {
+        upipe_udpmsink_check_upump_mgr(upipe);
+        if (likely(upipe_udpmsink->upump_mgr != NULL)) {
+            upipe_verbose_va(upipe, "sleeping %"PRIu64" (%"PRIu64")",
+                             systime - now, systime);
+            upipe_udpmsink_wait(upipe, systime - now);
+            return false;
+        }
+    } else if (now > systime + SYSTIME_TOLERANCE) {
+        upipe_warn_va(upipe, "dropping late packet %"PRIu64" ms, "
+                      "latency %"PRIu64" ms",
+                      (now - systime) / (UCLOCK_FREQ / 1000),
+                      upipe_udpmsink->latency / (UCLOCK_FREQ / 1000));
+        uref_free(uref);
+        return true;
+    } else if (now > systime + SYSTIME_PRINT)
+        upipe_warn_va(upipe, "outputting late packet %"PRIu64" ms, "
+                      "latency %"PRIu64" ms",
+                      (now - systime) / (UCLOCK_FREQ / 1000),
+                      upipe_udpmsink->latency / (UCLOCK_FREQ / 1000));
+
+write_buffer:;
+    int iovec_count = uref_block_iovec_count(uref, 0, -1);
+    if (unlikely(iovec_count == -1)) {
+        upipe_warn(upipe, "cannot read ubuf buffer");
+        uref_free(uref);
+        return true;
+    }
+    if (unlikely(iovec_count == 0)) {
+        uref_free(uref);
+        return true;
+    }
+
+    struct iovec iovecs[iovec_count];
+    if (unlikely(!ubase_check(uref_block_iovec_read(uref, 0, -1, iovecs)))) {
+        upipe_warn(upipe, "cannot read ubuf buffer");
+        uref_free(uref);
+        return true;
+    }
+
+    bool sent = upipe_udpmsink_send(upipe, iovecs, iovec_count);
+    uref_block_iovec_unmap(uref, 0, -1, iovecs);
+    if (unlikely(!sent)) {
+        upipe_udpmsink_poll(upipe);
+        return false;
+    }
+
+    uref_free(uref);
+    return true;
+}
+
+/** @internal @This is called when the file descriptor can be written again.
+ * Unblock the sink and unqueue all queued buffers.
+ *
+ * @param upump description structure of the watcher
+ */
+static void upipe_udpmsink_watcher(struct upump *upump)
+{
+    struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
+    upipe_udpmsink_set_upump(upipe, NULL);
+    upipe_udpmsink_output_input(upipe);
+    upipe_udpmsink_unblock_input(upipe);
+    if (upipe_udpmsink_check_input(upipe)) {
+        /* All packets have been output, release again the pipe that has been
+         * used in @ref upipe_udpmsink_input. */
+        upipe_release(upipe);
+    }
+}
+
+/** @internal @This receives data.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_udpmsink_input(struct upipe *upipe, struct uref *uref,
+                                 struct upump **upump_p)
+{
+    if (!upipe_udpmsink_check_input(upipe)) {
+        upipe_udpmsink_hold_input(upipe, uref);
+        upipe_udpmsink_block_input(upipe, upump_p);
+    } else if (!upipe_udpmsink_output(upipe, uref, upump_p)) {
+        upipe_udpmsink_hold_input(upipe, uref);
+        upipe_udpmsink_block_input(upipe, upump_p);
+        /* Increment upipe refcount to avoid disappearing before all packets
+         * have been sent. */
+        upipe_use(upipe);
+    }
+}
+
+/** @internal @This sets the input flow definition.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_def flow definition packet
+ * @return an error code
+ */
+static int upipe_udpmsink_set_flow_def(struct upipe *upipe,
+                                       struct uref *flow_def)
+{
+    if (flow_def == NULL)
+        return UBASE_ERR_INVALID;
+    UBASE_RETURN(uref_flow_match_def(flow_def, EXPECTED_FLOW_DEF))
+    flow_def = uref_dup(flow_def);
+    UBASE_ALLOC_RETURN(flow_def)
+    upipe_input(upipe, flow_def, NULL);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the socket shared by all destinations.
+ *
+ * @param upipe description structure of the pipe
+ * @param fd file descriptor, or -1
+ * @return an error code
+ */
+static int _upipe_udpmsink_set_fd(struct upipe *upipe, int fd)
+{
+    struct upipe_udpmsink *upipe_udpmsink = upipe_udpmsink_from_upipe(upipe);
+    upipe_udpmsink_set_upump(upipe, NULL);
+    upipe_udpmsink->fd = fd;
+    upipe_udpmsink->family = AF_UNSPEC;
+
+    struct sockaddr_storage addr;
+    socklen_t addrlen = sizeof(addr);
+    if (fd != -1 &&
+        getsockname(fd, (struct sockaddr *)&addr, &addrlen) != -1)
+        upipe_udpmsink->family = addr.ss_family;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This fills in the ancillary data of a destination.
+ *
+ * @param dest description of the destination
+ * @param ttl time-to-live, or 0 for the socket default
+ * @param tos type of service, or 0 for the socket default
+ * @param if_index output interface, or 0 for the socket default
+ */
+static void upipe_udpmsink_dest_set_options(struct upipe_udpmsink_dest *dest,
+                                            int ttl, int tos, int if_index)
+{
+    bool ipv4 = dest->addr.ss_family == AF_INET;
+    struct msghdr msghdr = {
+        .msg_control = dest->control.buf,
+        .msg_controllen = sizeof(dest->control.buf),
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msghdr);
+    memset(dest->control.buf, 0, sizeof(dest->control.buf));
+    dest->controllen = 0;
+
+    if (ttl) {
+        cmsg->cmsg_level = ipv4 ? IPPROTO_IP : IPPROTO_IPV6;
+        cmsg->cmsg_type = ipv4 ? IP_TTL : IPV6_HOPLIMIT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &ttl, sizeof(int));
+        dest->controllen += CMSG_SPACE(sizeof(int));
+        cmsg = CMSG_NXTHDR(&msghdr, cmsg);
+    }
+
+    if (tos) {
+        cmsg->cmsg_level = ipv4 ? IPPROTO_IP : IPPROTO_IPV6;
+        cmsg->cmsg_type = ipv4 ? IP_TOS : IPV6_TCLASS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &tos, sizeof(int));
+        dest->controllen += CMSG_SPACE(sizeof(int));
+        cmsg = CMSG_NXTHDR(&msghdr, cmsg);
+    }
+
+    if (if_index && ipv4) {
+        struct in_pktinfo pktinfo;
+        memset(&pktinfo, 0, sizeof(pktinfo));
+        pktinfo.ipi_ifindex = if_index;
+        cmsg->cmsg_level = IPPROTO_IP;
+        cmsg->cmsg_type = IP_PKTINFO;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(pktinfo));
+        memcpy(CMSG_DATA(cmsg), &pktinfo, sizeof(pktinfo));
+        dest->controllen += CMSG_SPACE(sizeof(pktinfo));
+    } else if (if_index) {
+        struct in6_pktinfo pktinfo;
+        memset(&pktinfo, 0, sizeof(pktinfo));
+        pktinfo.ipi6_ifindex = if_index;
+        cmsg->cmsg_level = IPPROTO_IPV6;
+        cmsg->cmsg_type = IPV6_PKTINFO;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(pktinfo));
+        memcpy(CMSG_DATA(cmsg), &pktinfo, sizeof(pktinfo));
+        dest->controllen += CMSG_SPACE(sizeof(pktinfo));
+    }
+}
+
+/** @internal @This looks up a destination by address.
+ *
+ * @param upipe description structure of the pipe
+ * @param addr destination address
+ * @param addrlen size of the destination address
+ * @return pointer to the destination, or NULL if not found
+ */
+static struct upipe_udpmsink_dest *
+    upipe_udpmsink_find_dest(struct upipe *upipe,
+                             const struct sockaddr_storage *addr,
+                             socklen_t addrlen)
+{
+    struct upipe_udpmsink *upipe_udpmsink = upipe_udpmsink_from_upipe(upipe);
+    struct uchain *uchain;
+    ulist_foreach (&upipe_udpmsink->dests, uchain) {
+        struct upipe_udpmsink_dest *dest =
+            upipe_udpmsink_dest_from_uchain(uchain);
+        if (dest->addrlen == addrlen && !memcmp(&dest->addr, addr, addrlen))
+            return dest;
+    }
+    return NULL;
+}
+
+/** @internal @This adds a destination, or updates its options.
+ *
+ * @param upipe description structure of the pipe
+ * @param uri destination URI
+ * @return an error code
+ */
+static int _upipe_udpmsink_add_dest(struct upipe *upipe, const char *uri)
+{
+    struct upipe_udpmsink *upipe_udpmsink = upipe_udpmsink_from_upipe(upipe);
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+    int ttl, tos, if_index;
+    if (unlikely(uri == NULL ||
+                 !upipe_udp_parse_dest(upipe, uri, UDP_DEFAULT_PORT,
+                                       &addr, &addrlen,
+                                       &ttl, &tos, &if_index)))
+        return UBASE_ERR_INVALID;
+
+    if (upipe_udpmsink->fd == -1) {
+        int fd = socket(addr.ss_family, SOCK_DGRAM, 0);
+        if (unlikely(fd == -1)) {
+            upipe_err_va(upipe, "unable to open socket (%m)");
+            return UBASE_ERR_EXTERNAL;
+        }
+        upipe_udpmsink->fd = fd;
+        upipe_udpmsink->family = addr.ss_family;
+    } else if (upipe_udpmsink->family != AF_UNSPEC &&
+               upipe_udpmsink->family != addr.ss_family) {
+        upipe_err_va(upipe, "incompatible address type for %s", uri);
+        return UBASE_ERR_INVALID;
+    }
+
+    char *dup = strdup(uri);
+    UBASE_ALLOC_RETURN(dup)
+    struct upipe_udpmsink_dest *dest =
+        upipe_udpmsink_find_dest(upipe, &addr, addrlen);
+    if (dest == NULL) {
+        dest = malloc(sizeof(struct upipe_udpmsink_dest));
+        if (unlikely(dest == NULL)) {
+            free(dup);
+            return UBASE_ERR_ALLOC;
+        }
+        uchain_init(&dest->uchain);
+        memcpy(&dest->addr, &addr, addrlen);
+        dest->addrlen = addrlen;
+        dest->error = false;
+        ulist_add(&upipe_udpmsink->dests, &dest->uchain);
+        upipe_notice_va(upipe, "adding destination %s", uri);
+    } else {
+        upipe_notice_va(upipe, "updating destination %s", uri);
+        free(dest->uri);
+    }
+    dest->uri = dup;
+    upipe_udpmsink_dest_set_options(dest, ttl, tos, if_index);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This frees a destination.
+ *
+ * @param upipe description structure of the pipe
+ * @param dest description of the destination
+ */
+static void upipe_udpmsink_free_dest(struct upipe *upipe,
+                                     struct upipe_udpmsink_dest *dest)
+{
+    struct upipe_udpmsink *upipe_udpmsink = upipe_udpmsink_from_upipe(upipe);
+    if (upipe_udpmsink->resume == &dest->uchain)
+        upipe_udpmsink->resume = dest->uchain.next;
+    ulist_delete(&dest->uchain);
+    free(dest->uri);
+    free(dest);
+}
+
+/** @internal @This removes a destination.
+ *
+ * @param upipe description structure of the pipe
+ * @param uri destination URI
+ * @return an error code
+ */
+static int _upipe_udpmsink_del_dest(struct upipe *upipe, const char *uri)
+{
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+    int ttl, tos, if_index;
+    if (unlikely(uri == NULL ||
+                 !upipe_udp_parse_dest(upipe, uri, UDP_DEFAULT_PORT,
+                                       &addr, &addrlen,
+                                       &ttl, &tos, &if_index)))
+        return UBASE_ERR_INVALID;
+
+    struct upipe_udpmsink_dest *dest =
+        upipe_udpmsink_find_dest(upipe, &addr, addrlen);
+    if (unlikely(dest == NULL)) {
+        upipe_warn_va(upipe, "unknown destination %s", uri);
+        return UBASE_ERR_INVALID;
+    }
+    upipe_notice_va(upipe, "removing destination %s", dest->uri);
+    upipe_udpmsink_free_dest(upipe, dest);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This iterates over the URIs of the destinations.
+ *
+ * @param upipe description structure of the pipe
+ * @param uri_p filled in with the next URI, or NULL at the end
+ * @return an error code
+ */
+static int _upipe_udpmsink_iterate_dest(struct upipe *upipe,
+                                        const char **uri_p)
+{
+    struct upipe_udpmsink *upipe_udpmsink = upipe_udpmsink_from_upipe(upipe);
+    struct uchain *uchain = &upipe_udpmsink->dests;
+    if (*uri_p != NULL) {
+        ulist_foreach (&upipe_udpmsink->dests, uchain) {
+            if (upipe_udpmsink_dest_from_uchain(uchain)->uri == *uri_p)
+                break;
+        }
+        if (unlikely(uchain == &upipe_udpmsink->dests))
+            return UBASE_ERR_INVALID;
+    }
+
+    uchain = uchain->next;
+    *uri_p = uchain != &upipe_udpmsink->dests ?
+             upipe_udpmsink_dest_from_uchain(uchain)->uri : NULL;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This flushes all currently held buffers, and unblocks the
+ * sources.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static int upipe_udpmsink_flush(struct upipe *upipe)
+{
+    struct upipe_udpmsink *upipe_udpmsink = upipe_udpmsink_from_upipe(upipe);
+    if (upipe_udpmsink_flush_input(upipe)) {
+        upipe_udpmsink_set_upump(upipe, NULL);
+        upipe_udpmsink->resume = NULL;
+        /* All packets have been output, release again the pipe that has been
+         * used in @ref upipe_udpmsink_input. */
+        upipe_release(upipe);
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands on a udp multi sink pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int _upipe_udpmsink_control(struct upipe *upipe,
+                                   int command, va_list args)
+{
+    struct upipe_udpmsink *upipe_udpmsink = upipe_udpmsink_from_upipe(upipe);
+
+    switch (command) {
+        case UPIPE_REGISTER_REQUEST:
+        case UPIPE_UNREGISTER_REQUEST:
+            return upipe_control_provide_request(upipe, command, args);
+
+        case UPIPE_ATTACH_UPUMP_MGR:
+            upipe_udpmsink_set_upump(upipe, NULL);
+            return upipe_udpmsink_attach_upump_mgr(upipe);
+        case UPIPE_ATTACH_UCLOCK:
+            upipe_udpmsink_set_upump(upipe, NULL);
+            upipe_udpmsink_require_uclock(upipe);
+            return UBASE_ERR_NONE;
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            return upipe_udpmsink_set_flow_def(upipe, flow_def);
+        }
+
+        case UPIPE_GET_MAX_LENGTH: {
+            unsigned int *p = va_arg(args, unsigned int *);
+            return upipe_udpmsink_get_max_length(upipe, p);
+        }
+        case UPIPE_SET_MAX_LENGTH: {
+            unsigned int max_length = va_arg(args, unsigned int);
+            return upipe_udpmsink_set_max_length(upipe, max_length);
+        }
+
+        case UPIPE_UDPMSINK_GET_FD: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_UDPMSINK_SIGNATURE)
+            int *fd_p = va_arg(args, int *);
+            *fd_p = upipe_udpmsink->fd;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_UDPMSINK_SET_FD: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_UDPMSINK_SIGNATURE)
+            int fd = va_arg(args, int);
+            return _upipe_udpmsink_set_fd(upipe, fd);
+        }
+        case UPIPE_UDPMSINK_ADD_DEST: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_UDPMSINK_SIGNATURE)
+            const char *uri = va_arg(args, const char *);
+            return _upipe_udpmsink_add_dest(upipe, uri);
+        }
+        case UPIPE_UDPMSINK_DEL_DEST: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_UDPMSINK_SIGNATURE)
+            const char *uri = va_arg(args, const char *);
+            return _upipe_udpmsink_del_dest(upipe, uri);
+        }
+        case UPIPE_UDPMSINK_ITERATE_DEST: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_UDPMSINK_SIGNATURE)
+            const char **uri_p = va_arg(args, const char **);
+            return _upipe_udpmsink_iterate_dest(upipe, uri_p);
+        }
+        case UPIPE_FLUSH:
+            return upipe_udpmsink_flush(upipe);
+        case UPIPE_UNCONFINE:
+            return upipe_udpmsink_unconfine_input(upipe);
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @internal @This processes control commands on a udp multi sink pipe, and
+ * checks the status of the pipe afterwards.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_udpmsink_control(struct upipe *upipe,
+                                  int command, va_list args)
+{
+    UBASE_RETURN(_upipe_udpmsink_control(upipe, command, args));
+
+    struct upipe_udpmsink *upipe_udpmsink = upipe_udpmsink_from_upipe(upipe);
+    if (unlikely(!upipe_udpmsink_check_input(upipe) &&
+                 upipe_udpmsink->upump == NULL &&
+                 upipe_udpmsink->fd != -1))
+        upipe_udpmsink_poll(upipe);
+
+    return UBASE_ERR_NONE;
+}
+
+/** @This frees a upipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_udpmsink_free(struct upipe *upipe)
+{
+    struct upipe_udpmsink *upipe_udpmsink = upipe_udpmsink_from_upipe(upipe);
+    upipe_throw_dead(upipe);
+
+    struct uchain *uchain, *uchain_tmp;
+    ulist_delete_foreach (&upipe_udpmsink->dests, uchain, uchain_tmp) {
+        upipe_udpmsink_free_dest(upipe,
+                                 upipe_udpmsink_dest_from_uchain(uchain));
+    }
+    ubase_clean_fd(&upipe_udpmsink->fd);
+    upipe_udpmsink_clean_uclock(upipe);
+    upipe_udpmsink_clean_upump(upipe);
+    upipe_udpmsink_clean_upump_mgr(upipe);
+    upipe_udpmsink_clean_input(upipe);
+    upipe_udpmsink_clean_urefcount(upipe);
+    upipe_udpmsink_free_void(upipe);
+}
+
+/** module manager static descriptor */
+static struct upipe_mgr upipe_udpmsink_mgr = {
+    .refcount = NULL,
+    .signature = UPIPE_UDPMSINK_SIGNATURE,
+
+    .upipe_alloc = upipe_udpmsink_alloc,
+    .upipe_input = upipe_udpmsink_input,
+    .upipe_control = upipe_udpmsink_control,
+
+    .upipe_mgr_control = NULL
+};
+
+/** @This returns the management structure for all udp multi sink pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_udpmsink_mgr_alloc(void)
+{
+    return &upipe_udpmsink_mgr;
+}
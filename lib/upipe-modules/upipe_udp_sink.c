@@ -57,11 +57,27 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <netinet/in.h>
 #include <fcntl.h>
+#include <time.h>
 #include <sys/ioctl.h>
+#include <poll.h>
 #include <errno.h>
 #include <assert.h>
 
+#ifdef __linux__
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+#endif
+
+#if defined(SO_TXTIME) && defined(SCM_TXTIME) && defined(SO_EE_ORIGIN_TXTIME)
+#define HAVE_TXTIME
+#endif
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY) && \
+    defined(SO_EE_ORIGIN_ZEROCOPY)
+#define HAVE_ZEROCOPY
+#endif
+
 /** tolerance for late packets */
 #define SYSTIME_TOLERANCE UCLOCK_FREQ
 /** print late packets */
@@ -71,10 +87,16 @@
 
 #define UDP_DEFAULT_TTL 0
 #define UDP_DEFAULT_PORT 1234
+/** maximum number of buffers waiting for a zero-copy completion */
+#define ZEROCOPY_DEPTH 1024
+/** time to wait for each zero-copy completion before closing, in ms */
+#define ZEROCOPY_FLUSH_TIMEOUT 100
 
 /** @hidden */
 static void upipe_udpsink_watcher(struct upump *upump);
 /** @hidden */
+static void upipe_udpsink_errqueue(struct upump *upump);
+/** @hidden */
 static bool upipe_udpsink_output(struct upipe *upipe, struct uref *uref,
                                  struct upump **upump_p);
 
@@ -87,6 +109,8 @@ struct upipe_udpsink {
     struct upump_mgr *upump_mgr;
     /** write watcher */
     struct upump *upump;
+    /** error queue watcher */
+    struct upump *upump_errqueue;
 
     /** uclock structure, if not NULL we are in live mode */
     struct uclock *uclock;
@@ -97,6 +121,9 @@ struct upipe_udpsink {
     uint64_t latency;
     /** file descriptor */
     int fd;
+    /** true if the socket was given by the application and may be read by
+     * another pipe */
+    bool shared_fd;
     /** socket uri */
     char *uri;
     /** temporary uref storage */
@@ -118,6 +145,23 @@ struct upipe_udpsink {
     /** destination for not-connected socket (size) */
     socklen_t addrlen;
 
+    /** kernel pacing horizon, or 0 if SO_TXTIME is not used */
+    uint64_t txtime_horizon;
+    /** true if MSG_ZEROCOPY is used */
+    bool zerocopy;
+    /** true if MSG_ZEROCOPY is suspended until pending sends complete */
+    bool zerocopy_suspended;
+    /** number of zero-copy sends */
+    uint64_t zerocopy_sent;
+    /** number of zero-copy completions received */
+    uint64_t zerocopy_completed;
+    /** urefs waiting for a zero-copy completion, indexed by sequence */
+    struct uref **zerocopy_urefs;
+    /** sequence number of the oldest pending zero-copy send */
+    uint32_t zerocopy_first;
+    /** sequence number of the next zero-copy send */
+    uint32_t zerocopy_next;
+
     /** public upipe structure */
     struct upipe upipe;
 };
@@ -127,6 +171,7 @@ UPIPE_HELPER_UREFCOUNT(upipe_udpsink, urefcount, upipe_udpsink_free)
 UPIPE_HELPER_VOID(upipe_udpsink)
 UPIPE_HELPER_UPUMP_MGR(upipe_udpsink, upump_mgr)
 UPIPE_HELPER_UPUMP(upipe_udpsink, upump, upump_mgr)
+UPIPE_HELPER_UPUMP(upipe_udpsink, upump_errqueue, upump_mgr)
 UPIPE_HELPER_INPUT(upipe_udpsink, urefs, nb_urefs, max_urefs, blockers, upipe_udpsink_output)
 UPIPE_HELPER_UCLOCK(upipe_udpsink, uclock, uclock_request, NULL, upipe_throw_provide_request, NULL)
 
@@ -151,13 +196,21 @@ static struct upipe *upipe_udpsink_alloc(struct upipe_mgr *mgr,
     upipe_udpsink_init_urefcount(upipe);
     upipe_udpsink_init_upump_mgr(upipe);
     upipe_udpsink_init_upump(upipe);
+    upipe_udpsink_init_upump_errqueue(upipe);
     upipe_udpsink_init_input(upipe);
     upipe_udpsink_init_uclock(upipe);
     upipe_udpsink->latency = 0;
     upipe_udpsink->fd = -1;
+    upipe_udpsink->shared_fd = false;
     upipe_udpsink->uri = NULL;
     upipe_udpsink->raw = false;
     upipe_udpsink->addrlen = 0;
+    upipe_udpsink->txtime_horizon = 0;
+    upipe_udpsink->zerocopy = false;
+    upipe_udpsink->zerocopy_suspended = false;
+    upipe_udpsink->zerocopy_sent = upipe_udpsink->zerocopy_completed = 0;
+    upipe_udpsink->zerocopy_urefs = NULL;
+    upipe_udpsink->zerocopy_first = upipe_udpsink->zerocopy_next = 0;
     upipe_throw_ready(upipe);
     return upipe;
 }
@@ -180,11 +233,271 @@ static void upipe_udpsink_poll(struct upipe *upipe)
         upipe_err_va(upipe, "can't create watcher");
         upipe_throw_fatal(upipe, UBASE_ERR_UPUMP);
     } else {
+        upump_set_priority(watcher, UPUMP_PRIORITY_HIGH);
         upipe_udpsink_set_upump(upipe, watcher);
         upump_start(watcher);
     }
 }
 
+/** @internal @This starts a timer waiting for the date of the next packet.
+ *
+ * @param upipe description structure of the pipe
+ * @param timeout time to wait before waking up
+ */
+static void upipe_udpsink_wait(struct upipe *upipe, uint64_t timeout)
+{
+    struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    upipe_udpsink_wait_upump(upipe, timeout, upipe_udpsink_watcher);
+    if (likely(upipe_udpsink->upump != NULL))
+        upump_set_priority(upipe_udpsink->upump, UPUMP_PRIORITY_HIGH);
+}
+
+/** @internal @This starts the watcher reading the socket error queue, if
+ * zero-copy completions are pending.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_udpsink_poll_errqueue(struct upipe *upipe)
+{
+    struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    if (upipe_udpsink->upump_errqueue != NULL || upipe_udpsink->fd == -1 ||
+        upipe_udpsink->zerocopy_first == upipe_udpsink->zerocopy_next)
+        return;
+
+    upipe_udpsink_check_upump_mgr(upipe);
+    if (unlikely(upipe_udpsink->upump_mgr == NULL))
+        return;
+
+    struct upump *watcher = upump_alloc_fd_read(upipe_udpsink->upump_mgr,
+            upipe_udpsink_errqueue, upipe, upipe->refcount, upipe_udpsink->fd);
+    if (unlikely(watcher == NULL)) {
+        upipe_err_va(upipe, "can't create error queue watcher");
+        upipe_throw_fatal(upipe, UBASE_ERR_UPUMP);
+    } else {
+        upipe_udpsink_set_upump_errqueue(upipe, watcher);
+        upump_start(watcher);
+    }
+}
+
+/** @internal @This releases the urefs of zero-copy sends which have completed.
+ *
+ * @param upipe description structure of the pipe
+ * @param lo sequence number of the first completed send
+ * @param hi sequence number of the last completed send
+ */
+static void upipe_udpsink_zerocopy_complete(struct upipe *upipe,
+                                            uint32_t lo, uint32_t hi)
+{
+    struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    if (unlikely(upipe_udpsink->zerocopy_urefs == NULL))
+        return;
+
+    for (uint32_t i = lo; (int32_t)(hi - i) >= 0; i++) {
+        if ((int32_t)(i - upipe_udpsink->zerocopy_first) < 0 ||
+            (int32_t)(upipe_udpsink->zerocopy_next - i) <= 0)
+            continue;
+        struct uref **uref_p =
+            &upipe_udpsink->zerocopy_urefs[i % ZEROCOPY_DEPTH];
+        if (*uref_p != NULL) {
+            uref_free(*uref_p);
+            *uref_p = NULL;
+            upipe_udpsink->zerocopy_completed++;
+        }
+    }
+
+    /* completions may be reported out of order */
+    while (upipe_udpsink->zerocopy_first != upipe_udpsink->zerocopy_next &&
+           upipe_udpsink->zerocopy_urefs[upipe_udpsink->zerocopy_first %
+                                         ZEROCOPY_DEPTH] == NULL)
+        upipe_udpsink->zerocopy_first++;
+
+    if (upipe_udpsink->zerocopy_first == upipe_udpsink->zerocopy_next &&
+        upipe_udpsink->zerocopy_suspended) {
+        /* the kernel has released the pinned pages, try again */
+        upipe_udpsink->zerocopy_suspended = false;
+        upipe_dbg(upipe, "resuming zero-copy");
+    }
+}
+
+/** @internal @This reads the socket error queue, to report zero-copy
+ * completions and packets dropped by the pacing qdisc. The pending socket
+ * error is cleared, and datagrams sent by the peer are discarded unless
+ * the socket is shared with another pipe, which then reads them, so that the
+ * watcher does not spin.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_udpsink_read_errqueue(struct upipe *upipe)
+{
+    struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+
+    for ( ; ; ) {
+#ifdef __linux__
+        char control[CMSG_SPACE(sizeof(struct sock_extended_err) +
+                                sizeof(struct sockaddr_storage))];
+        struct msghdr msghdr = {
+            .msg_control = control,
+            .msg_controllen = sizeof(control),
+        };
+        if (recvmsg(upipe_udpsink->fd, &msghdr, MSG_ERRQUEUE) == -1) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                upipe_warn_va(upipe, "error queue read error (%m)");
+            break;
+        }
+
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msghdr); cmsg != NULL;
+             cmsg = CMSG_NXTHDR(&msghdr, cmsg)) {
+            if (!(cmsg->cmsg_level == SOL_IP &&
+                  cmsg->cmsg_type == IP_RECVERR) &&
+                !(cmsg->cmsg_level == SOL_IPV6 &&
+                  cmsg->cmsg_type == IPV6_RECVERR))
+                continue;
+
+            struct sock_extended_err serr;
+            memcpy(&serr, CMSG_DATA(cmsg), sizeof(serr));
+            switch (serr.ee_origin) {
+#ifdef HAVE_ZEROCOPY
+                case SO_EE_ORIGIN_ZEROCOPY:
+                    upipe_udpsink_zerocopy_complete(upipe, serr.ee_info,
+                                                    serr.ee_data);
+                    break;
+#endif
+#ifdef HAVE_TXTIME
+                case SO_EE_ORIGIN_TXTIME:
+                    upipe_warn_va(upipe, "packet dropped by qdisc (%s)",
+                                  strerror(serr.ee_errno));
+                    break;
+#endif
+                default:
+                    break;
+            }
+        }
+#else
+        break;
+#endif
+    }
+
+    int error = 0;
+    socklen_t error_len = sizeof(error);
+    if (getsockopt(upipe_udpsink->fd, SOL_SOCKET, SO_ERROR,
+                   &error, &error_len) == 0 && error)
+        upipe_warn_va(upipe, "socket error (%s)", strerror(error));
+
+    if (!upipe_udpsink->shared_fd)
+        while (recv(upipe_udpsink->fd, NULL, 0, MSG_DONTWAIT) != -1 ||
+               errno == EINTR);
+}
+
+/** @internal @This releases all urefs waiting for a zero-copy completion,
+ * after waiting for the kernel to stop reading them. This is called before
+ * the socket is closed or replaced.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_udpsink_zerocopy_flush(struct upipe *upipe)
+{
+    struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    while (upipe_udpsink->fd != -1 &&
+           upipe_udpsink->zerocopy_first != upipe_udpsink->zerocopy_next) {
+        struct pollfd pollfd = { .fd = upipe_udpsink->fd, .events = 0 };
+        int ret = poll(&pollfd, 1, ZEROCOPY_FLUSH_TIMEOUT);
+        if (ret == -1 && errno == EINTR)
+            continue;
+        if (ret <= 0)
+            break;
+        uint32_t first = upipe_udpsink->zerocopy_first;
+        upipe_udpsink_read_errqueue(upipe);
+        if (upipe_udpsink->zerocopy_first == first)
+            break;
+    }
+
+    if (upipe_udpsink->zerocopy_first != upipe_udpsink->zerocopy_next)
+        upipe_warn_va(upipe, "releasing %"PRIu32" buffers still in flight",
+                      upipe_udpsink->zerocopy_next -
+                      upipe_udpsink->zerocopy_first);
+    for (uint32_t i = upipe_udpsink->zerocopy_first;
+         i != upipe_udpsink->zerocopy_next; i++) {
+        struct uref **uref_p =
+            &upipe_udpsink->zerocopy_urefs[i % ZEROCOPY_DEPTH];
+        uref_free(*uref_p);
+        *uref_p = NULL;
+    }
+    upipe_udpsink->zerocopy_first = upipe_udpsink->zerocopy_next = 0;
+    upipe_udpsink->zerocopy_suspended = false;
+}
+
+/** @internal @This is called when the socket error queue is readable, while
+ * zero-copy completions are pending.
+ *
+ * @param upump description structure of the watcher
+ */
+static void upipe_udpsink_errqueue(struct upump *upump)
+{
+    struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
+    struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    upipe_udpsink_read_errqueue(upipe);
+    if (upipe_udpsink->zerocopy_first == upipe_udpsink->zerocopy_next)
+        upipe_udpsink_set_upump_errqueue(upipe, NULL);
+}
+
+/** @internal @This applies the socket options required by the transmission
+ * mode.
+ *
+ * @param upipe description structure of the pipe
+ * @return an error code
+ */
+static int upipe_udpsink_setup_socket(struct upipe *upipe)
+{
+    struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    upipe_udpsink_set_upump_errqueue(upipe, NULL);
+    if (upipe_udpsink->fd == -1)
+        return UBASE_ERR_NONE;
+
+    if (upipe_udpsink->txtime_horizon) {
+#ifdef HAVE_TXTIME
+        struct sock_txtime sock_txtime = {
+            .clockid = CLOCK_MONOTONIC,
+            .flags = SOF_TXTIME_REPORT_ERRORS,
+        };
+        if (setsockopt(upipe_udpsink->fd, SOL_SOCKET, SO_TXTIME,
+                       &sock_txtime, sizeof(sock_txtime)) == -1) {
+            upipe_err_va(upipe, "can't set SO_TXTIME (%m)");
+            upipe_udpsink->txtime_horizon = 0;
+            return UBASE_ERR_EXTERNAL;
+        }
+#else
+        upipe_udpsink->txtime_horizon = 0;
+        return UBASE_ERR_UNHANDLED;
+#endif
+    }
+
+    if (upipe_udpsink->zerocopy) {
+#ifdef HAVE_ZEROCOPY
+        int one = 1;
+        if (setsockopt(upipe_udpsink->fd, SOL_SOCKET, SO_ZEROCOPY,
+                       &one, sizeof(one)) == -1) {
+            upipe_err_va(upipe, "can't set SO_ZEROCOPY (%m)");
+            upipe_udpsink->zerocopy = false;
+            return UBASE_ERR_EXTERNAL;
+        }
+        if (upipe_udpsink->zerocopy_urefs == NULL) {
+            upipe_udpsink->zerocopy_urefs =
+                calloc(ZEROCOPY_DEPTH, sizeof(struct uref *));
+            if (unlikely(upipe_udpsink->zerocopy_urefs == NULL)) {
+                upipe_udpsink->zerocopy = false;
+                return UBASE_ERR_ALLOC;
+            }
+        }
+#else
+        upipe_udpsink->zerocopy = false;
+        return UBASE_ERR_UNHANDLED;
+#endif
+    }
+    return UBASE_ERR_NONE;
+}
+
 /** @internal @This outputs data to the udp sink.
  *
  * @param upipe description structure of the pipe
@@ -212,6 +525,10 @@ static bool upipe_udpsink_output(struct upipe *upipe, struct uref *uref,
         return true;
     }
 
+    /* departure time for the qdisc, in CLOCK_MONOTONIC nanoseconds */
+    uint64_t txtime = 0;
+    /* true if MSG_ZEROCOPY failed for this buffer */
+    bool copy = false;
     if (likely(upipe_udpsink->uclock == NULL))
         goto write_buffer;
 
@@ -223,13 +540,27 @@ static bool upipe_udpsink_output(struct upipe *upipe, struct uref *uref,
 
     uint64_t now = uclock_now(upipe_udpsink->uclock);
     systime += upipe_udpsink->latency;
+    if (upipe_udpsink->txtime_horizon && now < systime &&
+        systime - now <= upipe_udpsink->txtime_horizon) {
+        /* let the qdisc wait for us */
+        struct timespec ts;
+        if (likely(clock_gettime(CLOCK_MONOTONIC, &ts) == 0)) {
+            txtime = (uint64_t)ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec +
+                     (systime - now) * UINT64_C(1000000000) / UCLOCK_FREQ;
+            goto write_buffer;
+        }
+    }
+
     if (unlikely(now < systime)) {
         upipe_udpsink_check_upump_mgr(upipe);
         if (likely(upipe_udpsink->upump_mgr != NULL)) {
+            /* wake up once for all packets in the pacing horizon */
+            uint64_t wait = systime - now;
+            if (wait > upipe_udpsink->txtime_horizon)
+                wait -= upipe_udpsink->txtime_horizon;
             upipe_verbose_va(upipe, "sleeping %"PRIu64" (%"PRIu64")",
-                             systime - now, systime);
-            upipe_udpsink_wait_upump(upipe, systime - now,
-                                     upipe_udpsink_watcher);
+                             wait, systime);
+            upipe_udpsink_wait(upipe, wait);
             return false;
         }
     } else if (now > systime + SYSTIME_TOLERANCE) {
@@ -296,13 +627,56 @@ write_buffer:
             .msg_flags = 0,
         };
 
-        ssize_t ret = sendmsg(upipe_udpsink->fd, &msghdr, 0);
+#ifdef HAVE_TXTIME
+        union {
+            char buf[CMSG_SPACE(sizeof(uint64_t))];
+            struct cmsghdr align;
+        } control;
+        if (txtime) {
+            msghdr.msg_control = control.buf;
+            msghdr.msg_controllen = sizeof(control.buf);
+            struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msghdr);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_TXTIME;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+            memcpy(CMSG_DATA(cmsg), &txtime, sizeof(uint64_t));
+        }
+#endif
+
+        int flags = 0;
+#ifdef HAVE_ZEROCOPY
+        /* the payload must not be released until the kernel is done with
+         * it, so only use MSG_ZEROCOPY if there is room to keep it */
+        if (upipe_udpsink->zerocopy && !upipe_udpsink->zerocopy_suspended &&
+            !copy && !upipe_udpsink->raw &&
+            upipe_udpsink->zerocopy_next - upipe_udpsink->zerocopy_first <
+                ZEROCOPY_DEPTH)
+            flags |= MSG_ZEROCOPY;
+#endif
+
+        ssize_t ret = sendmsg(upipe_udpsink->fd, &msghdr, flags);
         uref_block_iovec_unmap(uref, 0, -1, iovecs);
 
         if (unlikely(ret == -1)) {
             switch (errno) {
                 case EINTR:
                     continue;
+#ifdef HAVE_ZEROCOPY
+                case ENOBUFS:
+                    if (flags & MSG_ZEROCOPY) {
+                        /* out of pinned memory, copy until the pending
+                         * sends complete */
+                        if (upipe_udpsink->zerocopy_first !=
+                            upipe_udpsink->zerocopy_next &&
+                            !upipe_udpsink->zerocopy_suspended) {
+                            upipe_udpsink->zerocopy_suspended = true;
+                            upipe_dbg(upipe, "suspending zero-copy (%m)");
+                        }
+                        copy = true;
+                        continue;
+                    }
+                    break;
+#endif
                 case EAGAIN:
 #if EAGAIN != EWOULDBLOCK
                 case EWOULDBLOCK:
@@ -322,6 +696,17 @@ write_buffer:
              * "port unreachable", and we do not want to kill the application
              * with transient errors. */
         }
+#ifdef HAVE_ZEROCOPY
+        else if (flags & MSG_ZEROCOPY) {
+            /* keep the uref until the completion is reported */
+            upipe_udpsink->zerocopy_urefs[upipe_udpsink->zerocopy_next %
+                                          ZEROCOPY_DEPTH] = uref;
+            upipe_udpsink->zerocopy_next++;
+            upipe_udpsink->zerocopy_sent++;
+            upipe_udpsink_poll_errqueue(upipe);
+            break;
+        }
+#endif
 
         uref_free(uref);
         break;
@@ -337,7 +722,11 @@ write_buffer:
 static void upipe_udpsink_watcher(struct upump *upump)
 {
     struct upipe *upipe = upump_get_opaque(upump, struct upipe *);
+    struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
     upipe_udpsink_set_upump(upipe, NULL);
+    if (upipe_udpsink->txtime_horizon)
+        /* collect the packets dropped by the qdisc once per horizon */
+        upipe_udpsink_read_errqueue(upipe);
     upipe_udpsink_output_input(upipe);
     upipe_udpsink_unblock_input(upipe);
     if (upipe_udpsink_check_input(upipe)) {
@@ -412,13 +801,17 @@ static int _upipe_udpsink_set_uri(struct upipe *upipe, const char *uri)
     struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
     bool use_tcp = false;
 
+    upipe_udpsink_set_upump(upipe, NULL);
+    upipe_udpsink_set_upump_errqueue(upipe, NULL);
+    upipe_udpsink_zerocopy_flush(upipe);
     if (unlikely(upipe_udpsink->fd != -1)) {
         if (likely(upipe_udpsink->uri != NULL))
             upipe_notice_va(upipe, "closing socket %s", upipe_udpsink->uri);
         close(upipe_udpsink->fd);
+        upipe_udpsink->fd = -1;
     }
     ubase_clean_str(&upipe_udpsink->uri);
-    upipe_udpsink_set_upump(upipe, NULL);
+    upipe_udpsink->shared_fd = false;
     if (!upipe_udpsink_check_input(upipe))
         /* Release the pipe used in @ref upipe_udpsink_input. */
         upipe_release(upipe);
@@ -447,7 +840,7 @@ static int _upipe_udpsink_set_uri(struct upipe *upipe, const char *uri)
         /* Use again the pipe that we previously released. */
         upipe_use(upipe);
     upipe_notice_va(upipe, "opening uri %s", upipe_udpsink->uri);
-    return UBASE_ERR_NONE;
+    return upipe_udpsink_setup_socket(upipe);
 }
 
 /** @internal @This flushes all currently held buffers, and unblocks the
@@ -486,6 +879,7 @@ static int _upipe_udpsink_control(struct upipe *upipe,
 
         case UPIPE_ATTACH_UPUMP_MGR:
             upipe_udpsink_set_upump(upipe, NULL);
+            upipe_udpsink_set_upump_errqueue(upipe, NULL);
             return upipe_udpsink_attach_upump_mgr(upipe);
         case UPIPE_ATTACH_UCLOCK:
             upipe_udpsink_set_upump(upipe, NULL);
@@ -523,8 +917,11 @@ static int _upipe_udpsink_control(struct upipe *upipe,
         case UPIPE_UDPSINK_SET_FD: {
             UBASE_SIGNATURE_CHECK(args, UPIPE_UDPSINK_SIGNATURE)
             upipe_udpsink_set_upump(upipe, NULL);
+            upipe_udpsink_set_upump_errqueue(upipe, NULL);
+            upipe_udpsink_zerocopy_flush(upipe);
             upipe_udpsink->fd = va_arg(args, int );
-            return UBASE_ERR_NONE;
+            upipe_udpsink->shared_fd = true;
+            return upipe_udpsink_setup_socket(upipe);
         }
         case UPIPE_UDPSINK_SET_PEER: {
             UBASE_SIGNATURE_CHECK(args, UPIPE_UDPSINK_SIGNATURE)
@@ -533,8 +930,40 @@ static int _upipe_udpsink_control(struct upipe *upipe,
             memcpy(&upipe_udpsink->addr, s, upipe_udpsink->addrlen);
             return UBASE_ERR_NONE;
         }
+        case UPIPE_UDPSINK_GET_TXTIME: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_UDPSINK_SIGNATURE)
+            uint64_t *horizon_p = va_arg(args, uint64_t *);
+            *horizon_p = upipe_udpsink->txtime_horizon;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_UDPSINK_SET_TXTIME: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_UDPSINK_SIGNATURE)
+            upipe_udpsink->txtime_horizon = va_arg(args, uint64_t);
+            return upipe_udpsink_setup_socket(upipe);
+        }
+        case UPIPE_UDPSINK_GET_ZEROCOPY: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_UDPSINK_SIGNATURE)
+            int *zerocopy_p = va_arg(args, int *);
+            *zerocopy_p = upipe_udpsink->zerocopy ? 1 : 0;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_UDPSINK_SET_ZEROCOPY: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_UDPSINK_SIGNATURE)
+            upipe_udpsink->zerocopy = !!va_arg(args, int);
+            return upipe_udpsink_setup_socket(upipe);
+        }
+        case UPIPE_UDPSINK_GET_ZEROCOPY_STATS: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_UDPSINK_SIGNATURE)
+            uint64_t *sent_p = va_arg(args, uint64_t *);
+            uint64_t *completed_p = va_arg(args, uint64_t *);
+            *sent_p = upipe_udpsink->zerocopy_sent;
+            *completed_p = upipe_udpsink->zerocopy_completed;
+            return UBASE_ERR_NONE;
+        }
         case UPIPE_FLUSH:
             return upipe_udpsink_flush(upipe);
+        case UPIPE_UNCONFINE:
+            return upipe_udpsink_unconfine_input(upipe);
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -554,6 +983,7 @@ static int upipe_udpsink_control(struct upipe *upipe, int command, va_list args)
 
     if (unlikely(!upipe_udpsink_check_input(upipe)))
         upipe_udpsink_poll(upipe);
+    upipe_udpsink_poll_errqueue(upipe);
 
     return UBASE_ERR_NONE;
 }
@@ -565,6 +995,7 @@ static int upipe_udpsink_control(struct upipe *upipe, int command, va_list args)
 static void upipe_udpsink_free(struct upipe *upipe)
 {
     struct upipe_udpsink *upipe_udpsink = upipe_udpsink_from_upipe(upipe);
+    upipe_udpsink_zerocopy_flush(upipe);
     if (likely(upipe_udpsink->fd != -1)) {
         if (likely(upipe_udpsink->uri != NULL))
             upipe_notice_va(upipe, "closing socket %s", upipe_udpsink->uri);
@@ -572,8 +1003,10 @@ static void upipe_udpsink_free(struct upipe *upipe)
     }
     upipe_throw_dead(upipe);
 
+    free(upipe_udpsink->zerocopy_urefs);
     free(upipe_udpsink->uri);
     upipe_udpsink_clean_uclock(upipe);
+    upipe_udpsink_clean_upump_errqueue(upipe);
     upipe_udpsink_clean_upump(upipe);
     upipe_udpsink_clean_upump_mgr(upipe);
     upipe_udpsink_clean_input(upipe);
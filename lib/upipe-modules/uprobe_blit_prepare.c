@@ -48,6 +48,8 @@ static int uprobe_blit_prepare_throw(struct uprobe *uprobe,
     return upipe_blit_prepare(upipe, upump_p);
 }
 
+UPROBE_HELPER_EVENTS(uprobe_blit_prepare, UPROBE_LOCAL)
+
 static struct uprobe *uprobe_blit_prepare_init(
     struct uprobe_blit_prepare *uprobe_blit_prepare,
     struct uprobe *next)
@@ -55,6 +57,7 @@ static struct uprobe *uprobe_blit_prepare_init(
     assert(uprobe_blit_prepare);
     struct uprobe *uprobe = uprobe_blit_prepare_to_uprobe(uprobe_blit_prepare);
     uprobe_init(uprobe, uprobe_blit_prepare_throw, next);
+    uprobe_blit_prepare_init_events(uprobe);
     return uprobe;
 }
 
@@ -15,6 +15,8 @@ static int uprobe_http_redir_throw(struct uprobe *uprobe,
     return upipe_set_uri(upipe, uri);
 }
 
+UPROBE_HELPER_EVENTS(uprobe_http_redir, UPROBE_LOCAL)
+
 struct uprobe *uprobe_http_redir_init(
     struct uprobe_http_redir *uprobe_http_redir,
     struct uprobe *next)
@@ -22,6 +24,7 @@ struct uprobe *uprobe_http_redir_init(
     assert(uprobe_http_redir != NULL);
     struct uprobe *uprobe = uprobe_http_redir_to_uprobe(uprobe_http_redir);
     uprobe_init(uprobe, uprobe_http_redir_throw, next);
+    uprobe_http_redir_init_events(uprobe);
     return uprobe;
 }
 
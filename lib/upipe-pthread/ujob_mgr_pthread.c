@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe ujob manager implementation using a pool of pthreads
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/urefcount.h>
+#include <upipe/ujob.h>
+#include <upipe-pthread/ujob_mgr_pthread.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/** @internal @This describes a batch of jobs submitted by a caller. It is
+ * allocated on the stack of the caller. */
+struct ujob_batch {
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** function to call for each job */
+    ujob_cb cb;
+    /** opaque passed to the function */
+    void *opaque;
+    /** number of jobs in the batch */
+    unsigned int nb_jobs;
+    /** index of the next job to start */
+    unsigned int next;
+    /** number of completed jobs */
+    unsigned int done;
+};
+
+UBASE_FROM_TO(ujob_batch, uchain, uchain, uchain)
+
+/** super-set of the ujob_mgr structure with additional local members */
+struct ujob_mgr_pthread {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** mutex protecting the members below */
+    pthread_mutex_t mutex;
+    /** condition signalled when a batch is submitted */
+    pthread_cond_t cond_work;
+    /** condition signalled when a batch is completed */
+    pthread_cond_t cond_done;
+    /** list of batches with jobs left to start */
+    struct uchain batches;
+    /** true if the threads must exit */
+    bool exit;
+    /** number of started threads */
+    unsigned int nb_pthreads;
+    /** started threads */
+    pthread_t *pthreads;
+
+    /** structure exported to modules */
+    struct ujob_mgr mgr;
+};
+
+UBASE_FROM_TO(ujob_mgr_pthread, ujob_mgr, ujob_mgr, mgr)
+UBASE_FROM_TO(ujob_mgr_pthread, urefcount, urefcount, urefcount)
+
+/** @internal @This starts the next job of the first pending batch, and
+ * marks it completed. It must be called with the mutex held, and returns
+ * with the mutex held.
+ *
+ * @param pool description structure of the pool
+ * @param batch batch to pick from
+ */
+static void ujob_mgr_pthread_work(struct ujob_mgr_pthread *pool,
+                                  struct ujob_batch *batch)
+{
+    unsigned int job = batch->next++;
+    if (batch->next == batch->nb_jobs)
+        ulist_delete(ujob_batch_to_uchain(batch));
+    pthread_mutex_unlock(&pool->mutex);
+
+    batch->cb(batch->opaque, job, batch->nb_jobs);
+
+    pthread_mutex_lock(&pool->mutex);
+    if (++batch->done == batch->nb_jobs)
+        pthread_cond_broadcast(&pool->cond_done);
+}
+
+/** @internal @This is the main loop of the worker threads.
+ *
+ * @param arg pointer to the pool
+ * @return NULL
+ */
+static void *ujob_mgr_pthread_thread(void *arg)
+{
+    struct ujob_mgr_pthread *pool = (struct ujob_mgr_pthread *)arg;
+    pthread_mutex_lock(&pool->mutex);
+    for ( ; ; ) {
+        while (!pool->exit && ulist_empty(&pool->batches))
+            pthread_cond_wait(&pool->cond_work, &pool->mutex);
+        if (pool->exit)
+            break;
+
+        struct ujob_batch *batch =
+            ujob_batch_from_uchain(ulist_peek(&pool->batches));
+        ujob_mgr_pthread_work(pool, batch);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+/** @internal @This runs a batch of jobs and waits for their completion.
+ * The calling thread processes its own jobs as long as they are not taken
+ * by a worker, so that it never waits idle behind other batches.
+ *
+ * @param mgr pointer to ujob manager
+ * @param cb function to call for each job
+ * @param opaque opaque passed to the function
+ * @param nb_jobs number of jobs in the batch
+ * @return an error code
+ */
+static int ujob_mgr_pthread_run(struct ujob_mgr *mgr, ujob_cb cb,
+                                void *opaque, unsigned int nb_jobs)
+{
+    struct ujob_mgr_pthread *pool = ujob_mgr_pthread_from_ujob_mgr(mgr);
+    struct ujob_batch batch;
+    uchain_init(ujob_batch_to_uchain(&batch));
+    batch.cb = cb;
+    batch.opaque = opaque;
+    batch.nb_jobs = nb_jobs;
+    batch.next = batch.done = 0;
+
+    pthread_mutex_lock(&pool->mutex);
+    ulist_add(&pool->batches, ujob_batch_to_uchain(&batch));
+    pthread_cond_broadcast(&pool->cond_work);
+
+    while (batch.next < batch.nb_jobs)
+        ujob_mgr_pthread_work(pool, &batch);
+    while (batch.done < batch.nb_jobs)
+        pthread_cond_wait(&pool->cond_done, &pool->mutex);
+    pthread_mutex_unlock(&pool->mutex);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This stops the threads and frees the pool.
+ *
+ * @param urefcount pointer to urefcount
+ */
+static void ujob_mgr_pthread_free(struct urefcount *urefcount)
+{
+    struct ujob_mgr_pthread *pool = ujob_mgr_pthread_from_urefcount(urefcount);
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->exit = true;
+    pthread_cond_broadcast(&pool->cond_work);
+    pthread_mutex_unlock(&pool->mutex);
+    for (unsigned int i = 0; i < pool->nb_pthreads; i++)
+        pthread_join(pool->pthreads[i], NULL);
+
+    pthread_cond_destroy(&pool->cond_done);
+    pthread_cond_destroy(&pool->cond_work);
+    pthread_mutex_destroy(&pool->mutex);
+    urefcount_clean(urefcount);
+    free(pool->pthreads);
+    free(pool);
+}
+
+/** @This allocates a new ujob manager backed by a pool of threads.
+ *
+ * @param nb_threads total number of threads processing jobs, or 0 to use
+ * the number of online processors
+ * @return pointer to ujob manager, or NULL in case of error
+ */
+struct ujob_mgr *ujob_mgr_pthread_alloc(unsigned int nb_threads)
+{
+    if (!nb_threads) {
+        long nb_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nb_threads = nb_cpus > 0 ? nb_cpus : 1;
+    }
+
+    struct ujob_mgr_pthread *pool = malloc(sizeof(struct ujob_mgr_pthread));
+    if (unlikely(pool == NULL))
+        return NULL;
+    pool->pthreads = malloc(sizeof(pthread_t) * nb_threads);
+    if (unlikely(pool->pthreads == NULL)) {
+        free(pool);
+        return NULL;
+    }
+
+    urefcount_init(ujob_mgr_pthread_to_urefcount(pool), ujob_mgr_pthread_free);
+    pool->mgr.refcount = ujob_mgr_pthread_to_urefcount(pool);
+    pool->mgr.ujob_mgr_run = ujob_mgr_pthread_run;
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->cond_work, NULL);
+    pthread_cond_init(&pool->cond_done, NULL);
+    ulist_init(&pool->batches);
+    pool->exit = false;
+    pool->nb_pthreads = 0;
+
+    while (pool->nb_pthreads < nb_threads - 1) {
+        if (pthread_create(&pool->pthreads[pool->nb_pthreads], NULL,
+                           ujob_mgr_pthread_thread, pool))
+            break;
+        pool->nb_pthreads++;
+    }
+    pool->mgr.nb_threads = pool->nb_pthreads + 1;
+    return ujob_mgr_pthread_to_ujob_mgr(pool);
+}
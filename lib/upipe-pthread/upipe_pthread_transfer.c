@@ -32,6 +32,10 @@
 #include <upipe/urefcount.h>
 #include <upipe/ueventfd.h>
 #include <upipe/umutex.h>
+#include <upipe/umem.h>
+#include <upipe/uref.h>
+#include <upipe/uclock.h>
+#include <upipe/uclock_std.h>
 #include <upipe/uprobe.h>
 #include <upipe/uprobe_prefix.h>
 #include <upipe/upump.h>
@@ -53,6 +57,9 @@
 #include <errno.h>
 #include <math.h>
 #include <assert.h>
+#include <alloca.h>
+#include <sched.h>
+#include <sys/mman.h>
 
 /** @internal @This is the private context for pthread. */
 struct upipe_pthread_ctx {
@@ -72,8 +79,156 @@ struct upipe_pthread_ctx {
     struct ueventfd event;
     /** mutual exclusion primitives for access to the event loop */
     struct umutex *mutex;
+
+    /** real-time profile */
+    struct upipe_pthread_rt rt;
+    /** probe used by the watchdog */
+    struct uprobe *watchdog_uprobe;
+    /** clock used by the watchdog */
+    struct uclock *watchdog_uclock;
+    /** date of the last watchdog tick */
+    uint64_t watchdog_last;
+    /** number of iterations exceeding the budget */
+    uint64_t watchdog_stalls;
 };
 
+/** @internal @This touches the given amount of stack, so that the pages are
+ * mapped before the event loop runs.
+ *
+ * @param size number of bytes of stack to pre-fault
+ */
+static void upipe_pthread_prefault(size_t size)
+{
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (page_size <= 0)
+        page_size = 4096;
+    volatile uint8_t *stack = alloca(size);
+    for (size_t i = 0; i < size; i += page_size)
+        stack[i] = 0;
+}
+
+/** @internal @This applies the real-time profile to the current thread.
+ *
+ * @param pthread_ctx private context
+ */
+static void upipe_pthread_apply_rt(struct upipe_pthread_ctx *pthread_ctx)
+{
+    struct upipe_pthread_rt *rt = &pthread_ctx->rt;
+    struct uprobe *uprobe = pthread_ctx->uprobe_pthread_upump_mgr;
+
+    if (rt->priority) {
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = rt->priority;
+        int err = pthread_setschedparam(pthread_self(), rt->policy, &param);
+        if (unlikely(err))
+            uprobe_warn_va(uprobe, NULL,
+                           "unable to set real-time priority %d (%s)",
+                           rt->priority, strerror(err));
+    }
+
+    if (rt->mlock && unlikely(mlockall(MCL_CURRENT | MCL_FUTURE) < 0))
+        uprobe_warn_va(uprobe, NULL, "unable to lock memory (%m)");
+
+    if (rt->stack_prefault)
+        upipe_pthread_prefault(rt->stack_prefault);
+
+    if (rt->umem_mgr != NULL)
+        umem_mgr_prealloc(rt->umem_mgr);
+    if (rt->uref_mgr != NULL && !ubase_check(uref_mgr_prealloc(rt->uref_mgr)))
+        uprobe_warn(uprobe, NULL, "unable to pre-allocate urefs");
+}
+
+/** @internal @This is called periodically to check that the event loop is
+ * not blocked for longer than the budget.
+ *
+ * @param upump description structure of the watchdog timer
+ */
+static void upipe_pthread_watchdog(struct upump *upump)
+{
+    struct upipe_pthread_ctx *pthread_ctx =
+        upump_get_opaque(upump, struct upipe_pthread_ctx *);
+    uint64_t budget = pthread_ctx->rt.budget;
+    uint64_t now = uclock_now(pthread_ctx->watchdog_uclock);
+    uint64_t elapsed = now - pthread_ctx->watchdog_last;
+    pthread_ctx->watchdog_last = now;
+
+    /* the timer fires every budget, so anything later than that is the
+     * duration of the iteration which delayed it */
+    if (elapsed > 2 * budget) {
+        pthread_ctx->watchdog_stalls++;
+        uprobe_warn_va(pthread_ctx->watchdog_uprobe, NULL,
+                       "event loop blocked for about %"PRIu64" us "
+                       "(budget %"PRIu64" us)",
+                       (elapsed - budget) * 1000000 / UCLOCK_FREQ,
+                       budget * 1000000 / UCLOCK_FREQ);
+    }
+}
+
+/** @internal @This allocates the watchdog timer, if a budget was given.
+ *
+ * @param pthread_ctx private context
+ * @param upump_mgr event loop of the thread
+ * @return pointer to the timer, or NULL
+ */
+static struct upump *
+    upipe_pthread_watchdog_alloc(struct upipe_pthread_ctx *pthread_ctx,
+                                 struct upump_mgr *upump_mgr)
+{
+    uint64_t budget = pthread_ctx->rt.budget;
+    if (!budget)
+        return NULL;
+
+    pthread_ctx->watchdog_uclock = uclock_std_alloc(0);
+    if (unlikely(pthread_ctx->watchdog_uclock == NULL)) {
+        uprobe_warn(pthread_ctx->uprobe_pthread_upump_mgr, NULL,
+                    "unable to allocate watchdog clock");
+        return NULL;
+    }
+
+    struct upump *upump = upump_alloc_timer(upump_mgr, upipe_pthread_watchdog,
+                                            pthread_ctx, NULL, budget, budget);
+    if (unlikely(upump == NULL)) {
+        uprobe_warn(pthread_ctx->uprobe_pthread_upump_mgr, NULL,
+                    "unable to allocate watchdog timer");
+        uclock_release(pthread_ctx->watchdog_uclock);
+        pthread_ctx->watchdog_uclock = NULL;
+        return NULL;
+    }
+    upump_set_status(upump, false);
+    upump_set_priority(upump, UPUMP_PRIORITY_HIGH);
+
+    pthread_ctx->watchdog_uprobe =
+        uprobe_use(pthread_ctx->uprobe_pthread_upump_mgr);
+    pthread_ctx->watchdog_last = uclock_now(pthread_ctx->watchdog_uclock);
+    pthread_ctx->watchdog_stalls = 0;
+    upump_start(upump);
+    return upump;
+}
+
+/** @internal @This frees the watchdog timer.
+ *
+ * @param pthread_ctx private context
+ * @param upump description structure of the watchdog timer, or NULL
+ */
+static void upipe_pthread_watchdog_free(struct upipe_pthread_ctx *pthread_ctx,
+                                        struct upump *upump)
+{
+    if (upump == NULL)
+        return;
+
+    upump_stop(upump);
+    upump_free(upump);
+    if (pthread_ctx->watchdog_stalls)
+        uprobe_notice_va(pthread_ctx->watchdog_uprobe, NULL,
+                         "event loop exceeded its budget %"PRIu64" times",
+                         pthread_ctx->watchdog_stalls);
+    uprobe_release(pthread_ctx->watchdog_uprobe);
+    pthread_ctx->watchdog_uprobe = NULL;
+    uclock_release(pthread_ctx->watchdog_uclock);
+    pthread_ctx->watchdog_uclock = NULL;
+}
+
 /** @internal @This is the main function of the new thread.
  *
  * @param mgr pointer to a upipe pthread manager
@@ -93,6 +248,8 @@ static void *upipe_pthread_start(void *_pthread_ctx)
 
     pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
 
+    upipe_pthread_apply_rt(pthread_ctx);
+
     /* spawn the upump manager */
     struct upump_mgr *upump_mgr =
         pthread_ctx->upump_mgr_alloc(pthread_ctx->upump_pool_depth,
@@ -117,6 +274,9 @@ static void *upipe_pthread_start(void *_pthread_ctx)
         uprobe_err_va(pthread_ctx->uprobe_pthread_upump_mgr, NULL,
                       "unable to attach xfer (%s)", ubase_err_str(err));
 
+    struct upump *watchdog = upipe_pthread_watchdog_alloc(pthread_ctx,
+                                                          upump_mgr);
+
     uprobe_release(pthread_ctx->uprobe_pthread_upump_mgr);
     upipe_mgr_release(pthread_ctx->xfer_mgr);
 
@@ -129,6 +289,7 @@ static void *upipe_pthread_start(void *_pthread_ctx)
         uprobe_err_va(pthread_ctx->uprobe_pthread_upump_mgr, NULL,
                       "upump manager couldn't run (%s)", ubase_err_str(err));
 
+    upipe_pthread_watchdog_free(pthread_ctx, watchdog);
     upump_mgr_release(upump_mgr);
 
 upipe_pthread_start_abort:
@@ -150,11 +311,13 @@ static void upipe_pthread_stop(struct upump *upump)
     pthread_join(pthread_ctx->pthread_id, NULL);
     ueventfd_clean(&pthread_ctx->event);
     umutex_release(pthread_ctx->mutex);
+    umem_mgr_release(pthread_ctx->rt.umem_mgr);
+    uref_mgr_release(pthread_ctx->rt.uref_mgr);
     free(pthread_ctx);
 }
 
 /** @This returns a management structure for transfer pipes, using a new
- * pthread. You would need one management structure per target thread.
+ * pthread running with the given real-time profile.
  *
  * @param queue_length maximum length of the internal queue of commands
  * @param msg_pool_depth maximum number of messages in the pool
@@ -167,13 +330,15 @@ static void upipe_pthread_stop(struct upump *upump)
  * @param mutex mutual exclusion pimitives to access the event loop, or NULL
  * @param pthread_id_p reference to created thread ID (may be NULL)
  * @param attr pthread attributes
+ * @param rt real-time profile (copied), or NULL
  * @return pointer to xfer manager
  */
-struct upipe_mgr *upipe_pthread_xfer_mgr_alloc(uint8_t queue_length,
+struct upipe_mgr *upipe_pthread_xfer_mgr_alloc_rt(uint8_t queue_length,
         uint16_t msg_pool_depth, struct uprobe *uprobe_pthread_upump_mgr,
         upump_mgr_alloc upump_mgr_alloc, uint16_t upump_pool_depth,
         uint16_t upump_blocker_pool_depth, struct umutex *mutex,
-        pthread_t *pthread_id_p, const pthread_attr_t *restrict attr)
+        pthread_t *pthread_id_p, const pthread_attr_t *restrict attr,
+        const struct upipe_pthread_rt *rt)
 {
     struct upipe_pthread_ctx *pthread_ctx =
         malloc(sizeof(struct upipe_pthread_ctx));
@@ -207,6 +372,14 @@ struct upipe_mgr *upipe_pthread_xfer_mgr_alloc(uint8_t queue_length,
     pthread_ctx->upump_pool_depth = upump_pool_depth;
     pthread_ctx->upump_blocker_pool_depth = upump_blocker_pool_depth;
     pthread_ctx->mutex = umutex_use(mutex);
+    if (rt != NULL)
+        pthread_ctx->rt = *rt;
+    else
+        upipe_pthread_rt_init(&pthread_ctx->rt);
+    pthread_ctx->rt.umem_mgr = umem_mgr_use(pthread_ctx->rt.umem_mgr);
+    pthread_ctx->rt.uref_mgr = uref_mgr_use(pthread_ctx->rt.uref_mgr);
+    pthread_ctx->watchdog_uprobe = NULL;
+    pthread_ctx->watchdog_uclock = NULL;
 
     if (unlikely(pthread_create(&pthread_ctx->pthread_id, attr,
                                 upipe_pthread_start, pthread_ctx) != 0))
@@ -219,6 +392,8 @@ struct upipe_mgr *upipe_pthread_xfer_mgr_alloc(uint8_t queue_length,
 
 upipe_pthread_xfer_mgr_alloc_err5:
     umutex_release(mutex);
+    umem_mgr_release(pthread_ctx->rt.umem_mgr);
+    uref_mgr_release(pthread_ctx->rt.uref_mgr);
     upipe_mgr_release(pthread_ctx->xfer_mgr);
     upipe_mgr_release(xfer_mgr);
 upipe_pthread_xfer_mgr_alloc_err4:
@@ -231,3 +406,30 @@ upipe_pthread_xfer_mgr_alloc_err1:
     uprobe_release(uprobe_pthread_upump_mgr);
     return NULL;
 }
+
+/** @This returns a management structure for transfer pipes, using a new
+ * pthread. You would need one management structure per target thread.
+ *
+ * @param queue_length maximum length of the internal queue of commands
+ * @param msg_pool_depth maximum number of messages in the pool
+ * @param uprobe_pthread_upump_mgr pointer to optional probe, that will be set
+ * with the created upump_mgr
+ * @param upump_mgr_alloc alloc function provided by the upump manager
+ * @param upump_pool_depth maximum number of upump structures in the pool
+ * @param upump_blocker_pool_depth maximum number of upump_blocker structures in
+ * the pool
+ * @param mutex mutual exclusion pimitives to access the event loop, or NULL
+ * @param pthread_id_p reference to created thread ID (may be NULL)
+ * @param attr pthread attributes
+ * @return pointer to xfer manager
+ */
+struct upipe_mgr *upipe_pthread_xfer_mgr_alloc(uint8_t queue_length,
+        uint16_t msg_pool_depth, struct uprobe *uprobe_pthread_upump_mgr,
+        upump_mgr_alloc upump_mgr_alloc, uint16_t upump_pool_depth,
+        uint16_t upump_blocker_pool_depth, struct umutex *mutex,
+        pthread_t *pthread_id_p, const pthread_attr_t *restrict attr)
+{
+    return upipe_pthread_xfer_mgr_alloc_rt(queue_length, msg_pool_depth,
+            uprobe_pthread_upump_mgr, upump_mgr_alloc, upump_pool_depth,
+            upump_blocker_pool_depth, mutex, pthread_id_p, attr, NULL);
+}
@@ -85,6 +85,8 @@ static int uprobe_pthread_assert_throw(struct uprobe *uprobe,
     return uprobe_throw_next(uprobe, upipe, event, args);
 }
 
+UPROBE_HELPER_EVENTS(uprobe_pthread_assert, UPROBE_NEED_UPUMP_MGR, UPROBE_DEAD)
+
 /** @This initializes an already allocated uprobe_pthread_assert structure.
  *
  * @param uprobe_pthread_assert pointer to the already allocated structure
@@ -100,6 +102,7 @@ struct uprobe *uprobe_pthread_assert_init(
         uprobe_pthread_assert_to_uprobe(uprobe_pthread_assert);
     uprobe_pthread_assert->inited = false;
     uprobe_init(uprobe, uprobe_pthread_assert_throw, next);
+    uprobe_pthread_assert_init_events(uprobe);
     return uprobe;
 }
 
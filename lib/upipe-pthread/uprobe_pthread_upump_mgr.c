@@ -134,6 +134,9 @@ static int uprobe_pthread_upump_mgr_throw(struct uprobe *uprobe,
     return UBASE_ERR_NONE;
 }
 
+UPROBE_HELPER_EVENTS(uprobe_pthread_upump_mgr, UPROBE_NEED_UPUMP_MGR,
+                     UPROBE_FREEZE_UPUMP_MGR, UPROBE_THAW_UPUMP_MGR)
+
 /** @This initializes an already allocated uprobe_pthread_upump_mgr structure.
  *
  * @param uprobe_pthread_upump_mgr pointer to the already allocated structure
@@ -151,6 +154,7 @@ struct uprobe *uprobe_pthread_upump_mgr_init(
                                     uprobe_pthread_upump_mgr_destr) != 0))
         return NULL;
     uprobe_init(uprobe, uprobe_pthread_upump_mgr_throw, next);
+    uprobe_pthread_upump_mgr_init_events(uprobe);
     return uprobe;
 }
 
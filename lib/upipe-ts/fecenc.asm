@@ -0,0 +1,53 @@
+;******************************************************************************
+;* SMPTE 2022-1 FEC SIMD parity
+;* Copyright (C) 2018 OpenHeadend S.A.R.L.
+;*
+;* Permission is hereby granted, free of charge, to any person obtaining
+;* a copy of this software and associated documentation files (the
+;* "Software"), to deal in the Software without restriction, including
+;* without limitation the rights to use, copy, modify, merge, publish,
+;* distribute, sublicense, and/or sell copies of the Software, and to
+;* permit persons to whom the Software is furnished to do so, subject
+;* to the following conditions:
+;*
+;* The above copyright notice and this permission notice shall be
+;* included in all copies or substantial portions of the Software.
+;*
+;* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+;* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+;* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+;* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+;* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+;* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+;* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+;******************************************************************************
+
+%include "x86util.asm"
+
+SECTION .text
+
+%macro fec_xor 0
+
+; fec_xor(uint8_t *dst, const uint8_t *src, int64_t size)
+; size must be a non-zero multiple of mmsize
+cglobal fec_xor, 3, 3, 2, dst, src, size
+    add     dstq, sizeq
+    add     srcq, sizeq
+    neg     sizeq
+
+.loop:
+    movu    m0, [dstq+sizeq]
+    movu    m1, [srcq+sizeq]
+    pxor    m0, m1
+    movu    [dstq+sizeq], m0
+
+    add     sizeq, mmsize
+    jl .loop
+
+    RET
+%endmacro
+
+INIT_XMM sse2
+fec_xor
+INIT_YMM avx2
+fec_xor
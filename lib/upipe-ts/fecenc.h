@@ -0,0 +1,3 @@
+void upipe_fec_xor_c   (uint8_t *dst, const uint8_t *src, int64_t size);
+void upipe_fec_xor_sse2(uint8_t *dst, const uint8_t *src, int64_t size);
+void upipe_fec_xor_avx2(uint8_t *dst, const uint8_t *src, int64_t size);
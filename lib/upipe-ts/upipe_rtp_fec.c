@@ -51,6 +51,7 @@
 #include <upipe/upipe_helper_upipe.h>
 #include <upipe/upipe_helper_upipe.h>
 #include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_urefcount_real.h>
 #include <upipe/upipe_helper_flow_def.h>
 #include <upipe/upipe_helper_output.h>
 #include <upipe/upipe_helper_upump_mgr.h>
@@ -70,6 +71,8 @@
 struct upipe_rtp_fec {
     /** refcount management structure */
     struct urefcount urefcount;
+    /** real refcount management structure */
+    struct urefcount urefcount_real;
 
     /** uclock structure, if not NULL we are in live mode */
     struct uclock *uclock;
@@ -143,7 +146,8 @@ struct upipe_rtp_fec {
 };
 
 UPIPE_HELPER_UPIPE(upipe_rtp_fec, upipe, UPIPE_RTP_FEC_SIGNATURE);
-UPIPE_HELPER_UREFCOUNT(upipe_rtp_fec, urefcount, upipe_rtp_fec_free);
+UPIPE_HELPER_UREFCOUNT(upipe_rtp_fec, urefcount, upipe_rtp_fec_no_ref);
+UPIPE_HELPER_UREFCOUNT_REAL(upipe_rtp_fec, urefcount_real, upipe_rtp_fec_free);
 
 UPIPE_HELPER_OUTPUT(upipe_rtp_fec, output, flow_def, output_state, request_list)
 
@@ -916,7 +920,7 @@ static void upipe_rtp_fec_init_sub_mgr(struct upipe *upipe)
     struct upipe_rtp_fec *upipe_rtp_fec = upipe_rtp_fec_from_upipe(upipe);
     struct upipe_mgr *sub_mgr = &upipe_rtp_fec->sub_mgr;
 
-    sub_mgr->refcount = upipe_rtp_fec_to_urefcount(upipe_rtp_fec);
+    sub_mgr->refcount = upipe_rtp_fec_to_urefcount_real(upipe_rtp_fec);
     sub_mgr->signature = UPIPE_RTP_FEC_INPUT_SIGNATURE;
     sub_mgr->upipe_alloc = NULL;
     sub_mgr->upipe_input = upipe_rtp_fec_sub_input;
@@ -970,6 +974,7 @@ static struct upipe *_upipe_rtp_fec_alloc(struct upipe_mgr *mgr,
     upipe_rtp_fec_init_upump(upipe);
     upipe_rtp_fec_init_uclock(upipe);
     upipe_rtp_fec_init_urefcount(upipe);
+    upipe_rtp_fec_init_urefcount_real(upipe);
     upipe_rtp_fec_init_sub_mgr(upipe);
     upipe_rtp_fec_init_output(upipe);
 
@@ -1098,13 +1103,10 @@ static void upipe_rtp_fec_free(struct upipe *upipe)
 
     upipe_rtp_fec_clear(upipe_rtp_fec);
 
-    upipe_rtp_fec_sub_clean(upipe_rtp_fec_to_main_subpipe(upipe_rtp_fec));
-    upipe_rtp_fec_sub_clean(upipe_rtp_fec_to_col_subpipe(upipe_rtp_fec));
-    upipe_rtp_fec_sub_clean(upipe_rtp_fec_to_row_subpipe(upipe_rtp_fec));
-
     upipe_rtp_fec_clean_uclock(upipe);
     upipe_rtp_fec_clean_upump(upipe);
     upipe_rtp_fec_clean_upump_mgr(upipe);
+    upipe_rtp_fec_clean_urefcount_real(upipe);
     upipe_rtp_fec_clean_urefcount(upipe);
 
     upipe_rtp_fec_clean_output(upipe);
@@ -1113,6 +1115,22 @@ static void upipe_rtp_fec_free(struct upipe *upipe)
     free(upipe_rtp_fec);
 }
 
+/** @internal @This is called when there is no more external reference to the
+ * pipe or its subpipes.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_rtp_fec_no_ref(struct upipe *upipe)
+{
+    struct upipe_rtp_fec *upipe_rtp_fec = upipe_rtp_fec_from_upipe(upipe);
+
+    /* the subpipes hold the real refcount through their manager */
+    upipe_rtp_fec_sub_clean(upipe_rtp_fec_to_main_subpipe(upipe_rtp_fec));
+    upipe_rtp_fec_sub_clean(upipe_rtp_fec_to_col_subpipe(upipe_rtp_fec));
+    upipe_rtp_fec_sub_clean(upipe_rtp_fec_to_row_subpipe(upipe_rtp_fec));
+    upipe_rtp_fec_release_urefcount_real(upipe);
+}
+
 /** module manager static descriptor */
 static struct upipe_mgr upipe_rtp_fec_mgr = {
     .refcount = NULL,
@@ -0,0 +1,691 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe module generating SMPTE 2022-1 FEC streams
+ *
+ * Each input packet is XORed once into the parity buffer of its column,
+ * and of its row if row FEC is enabled, directly from the ubuf segments.
+ * A parity packet is sent as soon as the last packet of its column or row
+ * has been received; spreading the column packets over the next matrix is
+ * left to the scheduler of the output.
+ */
+
+#include <config.h>
+
+#include <upipe/ubase.h>
+#include <upipe/uprobe.h>
+#include <upipe/uref.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_flow.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_urefcount_real.h>
+#include <upipe/upipe_helper_output.h>
+#include <upipe-ts/upipe_rtp_fec_enc.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#include <bitstream/ietf/rtp.h>
+#include <bitstream/smpte/2022_1_fec.h>
+
+#include "fecenc.h"
+
+/** we only accept RTP packets */
+#define EXPECTED_FLOW_DEF "block."
+/** flow definition of the FEC streams */
+#define FEC_FLOW_DEF "block.rtp.fec."
+/** maximum size of an RTP payload */
+#define FEC_PAYLOAD_MAX 1500
+/** maximum number of columns (L) */
+#define FEC_COLS_MAX 20
+/** minimum number of rows (D) */
+#define FEC_ROWS_MIN 4
+/** maximum number of rows (D) */
+#define FEC_ROWS_MAX 20
+/** maximum number of packets in a matrix */
+#define FEC_MATRIX_MAX 100
+/** RTP payload type of FEC packets */
+#define FEC_PT 96
+
+/** @internal @This is the parity of a column or a row. */
+struct upipe_rtp_fec_enc_parity {
+    /** sequence number of the first protected packet */
+    uint16_t snbase;
+    /** number of valid octets in payload */
+    uint16_t size;
+    /** XOR of the payload lengths */
+    uint16_t length_rec;
+    /** XOR of the payload types */
+    uint8_t pt_rec;
+    /** XOR of the timestamps */
+    uint32_t ts_rec;
+    /** XOR of the payloads */
+    uint8_t payload[FEC_PAYLOAD_MAX];
+};
+
+/** @internal @This is the private context of an FEC output subpipe. */
+struct upipe_rtp_fec_enc_output {
+    /** pipe acting as output */
+    struct upipe *output;
+    /** output flow definition packet */
+    struct uref *flow_def;
+    /** output state */
+    enum upipe_helper_output_state output_state;
+    /** list of output requests */
+    struct uchain request_list;
+
+    /** next RTP sequence number */
+    uint16_t seqnum;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_rtp_fec_enc_output, upipe,
+                   UPIPE_RTP_FEC_ENC_OUTPUT_SIGNATURE)
+UPIPE_HELPER_OUTPUT(upipe_rtp_fec_enc_output, output, flow_def, output_state,
+                    request_list)
+
+/** @internal @This is the private context of a rtp_fec_enc pipe. */
+struct upipe_rtp_fec_enc {
+    /** refcount management structure */
+    struct urefcount urefcount;
+    /** real refcount management structure */
+    struct urefcount urefcount_real;
+
+    /** pipe acting as output */
+    struct upipe *output;
+    /** output flow definition packet */
+    struct uref *flow_def;
+    /** output state */
+    enum upipe_helper_output_state output_state;
+    /** list of output requests */
+    struct uchain request_list;
+
+    /** manager of the output subpipes */
+    struct upipe_mgr sub_mgr;
+    /** fec-column subpipe */
+    struct upipe_rtp_fec_enc_output col;
+    /** fec-row subpipe */
+    struct upipe_rtp_fec_enc_output row;
+
+    /** XOR function */
+    void (*fec_xor)(uint8_t *, const uint8_t *, int64_t);
+    /** size granularity of the XOR function */
+    int64_t xor_align;
+
+    /** number of columns (L) */
+    unsigned int cols;
+    /** number of rows (D) */
+    unsigned int rows;
+    /** position of the next packet in the matrix */
+    unsigned int pos;
+    /** expected sequence number of the next packet */
+    uint16_t next_seqnum;
+    /** true if the current row is protected */
+    bool row_active;
+
+    /** parity of the columns */
+    struct upipe_rtp_fec_enc_parity col_parity[FEC_COLS_MAX];
+    /** parity of the current row */
+    struct upipe_rtp_fec_enc_parity row_parity;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_rtp_fec_enc, upipe, UPIPE_RTP_FEC_ENC_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(upipe_rtp_fec_enc, urefcount,
+                       upipe_rtp_fec_enc_no_ref)
+UPIPE_HELPER_UREFCOUNT_REAL(upipe_rtp_fec_enc, urefcount_real,
+                            upipe_rtp_fec_enc_free)
+UPIPE_HELPER_OUTPUT(upipe_rtp_fec_enc, output, flow_def, output_state,
+                    request_list)
+
+UBASE_FROM_TO(upipe_rtp_fec_enc, upipe_mgr, sub_mgr, sub_mgr)
+
+/** @internal @This resets a parity buffer.
+ *
+ * @param parity parity buffer
+ * @param snbase sequence number of the first protected packet
+ */
+static inline void upipe_rtp_fec_enc_parity_reset(
+        struct upipe_rtp_fec_enc_parity *parity, uint16_t snbase)
+{
+    parity->snbase = snbase;
+    parity->size = 0;
+    parity->length_rec = 0;
+    parity->pt_rec = 0;
+    parity->ts_rec = 0;
+}
+
+/** @internal @This prepares a parity buffer to receive a payload, padding
+ * it with zeros if needed.
+ *
+ * @param parity parity buffer
+ * @param rtp RTP header of the packet
+ * @param length size of the payload
+ */
+static inline void upipe_rtp_fec_enc_parity_add(
+        struct upipe_rtp_fec_enc_parity *parity, const uint8_t *rtp,
+        uint16_t length)
+{
+    parity->length_rec ^= length;
+    parity->pt_rec ^= rtp_get_type(rtp);
+    parity->ts_rec ^= rtp_get_timestamp(rtp);
+    if (length > parity->size) {
+        memset(parity->payload + parity->size, 0, length - parity->size);
+        parity->size = length;
+    }
+}
+
+/** @internal @This XORs a buffer into a parity payload.
+ *
+ * @param upipe_rtp_fec_enc private structure of the pipe
+ * @param dst parity payload
+ * @param src source buffer
+ * @param size size of the buffer
+ */
+static inline void upipe_rtp_fec_enc_xor(
+        struct upipe_rtp_fec_enc *upipe_rtp_fec_enc,
+        uint8_t *dst, const uint8_t *src, int64_t size)
+{
+    int64_t simd = size & ~(upipe_rtp_fec_enc->xor_align - 1);
+    if (simd)
+        upipe_rtp_fec_enc->fec_xor(dst, src, simd);
+    if (size > simd)
+        upipe_fec_xor_c(dst + simd, src + simd, size - simd);
+}
+
+/** @internal @This builds a parity packet.
+ *
+ * @param upipe description structure of the output subpipe
+ * @param parity parity buffer
+ * @param offset offset field (L for columns, 1 for rows)
+ * @param na NA field (D for columns, L for rows)
+ * @param d true for row FEC
+ * @param uref last protected packet
+ * @return pointer to the parity packet, or NULL in case of error
+ */
+static struct uref *
+    upipe_rtp_fec_enc_build(struct upipe *upipe,
+                            struct upipe_rtp_fec_enc_parity *parity,
+                            uint8_t offset, uint8_t na, bool d,
+                            struct uref *uref)
+{
+    struct upipe_rtp_fec_enc_output *output =
+        upipe_rtp_fec_enc_output_from_upipe(upipe);
+    int size = RTP_HEADER_SIZE + SMPTE_2022_FEC_HEADER_SIZE + parity->size;
+    struct ubuf *ubuf = ubuf_block_alloc(uref->ubuf->mgr, size);
+    struct uref *fec;
+    if (unlikely(ubuf == NULL || (fec = uref_fork(uref, ubuf)) == NULL)) {
+        ubuf_free(ubuf);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return NULL;
+    }
+
+    uint8_t *buf;
+    if (unlikely(!ubase_check(ubuf_block_write(ubuf, 0, &size, &buf)))) {
+        uref_free(fec);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return NULL;
+    }
+    memset(buf, 0, RTP_HEADER_SIZE + SMPTE_2022_FEC_HEADER_SIZE);
+    rtp_set_hdr(buf);
+    rtp_set_type(buf, FEC_PT);
+    rtp_set_seqnum(buf, output->seqnum++);
+    rtp_set_timestamp(buf, parity->ts_rec);
+
+    /* SMPTE 2022-1 FEC header, E = 1, mask = 0, X = 0, type = 0 */
+    uint8_t *header = buf + RTP_HEADER_SIZE;
+    header[0] = parity->snbase >> 8;
+    header[1] = parity->snbase & 0xff;
+    header[2] = parity->length_rec >> 8;
+    header[3] = parity->length_rec & 0xff;
+    header[4] = 0x80 | (parity->pt_rec & 0x7f);
+    header[8] = parity->ts_rec >> 24;
+    header[9] = (parity->ts_rec >> 16) & 0xff;
+    header[10] = (parity->ts_rec >> 8) & 0xff;
+    header[11] = parity->ts_rec & 0xff;
+    header[12] = d ? 0x40 : 0;
+    header[13] = offset;
+    header[14] = na;
+
+    memcpy(header + SMPTE_2022_FEC_HEADER_SIZE, parity->payload,
+           parity->size);
+    ubuf_block_unmap(ubuf, 0);
+    return fec;
+}
+
+/** @internal @This receives RTP packets.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_rtp_fec_enc_input(struct upipe *upipe, struct uref *uref,
+                                    struct upump **upump_p)
+{
+    struct upipe_rtp_fec_enc *upipe_rtp_fec_enc =
+        upipe_rtp_fec_enc_from_upipe(upipe);
+    size_t uref_size;
+    uint8_t rtp_buffer[RTP_HEADER_SIZE];
+    const uint8_t *rtp;
+    if (unlikely(!upipe_rtp_fec_enc->cols ||
+                 !ubase_check(uref_block_size(uref, &uref_size)) ||
+                 uref_size < RTP_HEADER_SIZE ||
+                 uref_size > RTP_HEADER_SIZE + FEC_PAYLOAD_MAX ||
+                 (rtp = uref_block_peek(uref, 0, RTP_HEADER_SIZE,
+                                        rtp_buffer)) == NULL)) {
+        upipe_rtp_fec_enc_output(upipe, uref, upump_p);
+        return;
+    }
+    uint16_t seqnum = rtp_get_seqnum(rtp);
+    uint16_t length = uref_size - RTP_HEADER_SIZE;
+
+    if (upipe_rtp_fec_enc->pos && seqnum != upipe_rtp_fec_enc->next_seqnum) {
+        upipe_warn_va(upipe, "discontinuity (%"PRIu16" != %"PRIu16"), "
+                      "restarting matrix",
+                      seqnum, upipe_rtp_fec_enc->next_seqnum);
+        upipe_rtp_fec_enc->pos = 0;
+    }
+    upipe_rtp_fec_enc->next_seqnum = seqnum + 1;
+
+    unsigned int col = upipe_rtp_fec_enc->pos % upipe_rtp_fec_enc->cols;
+    unsigned int row = upipe_rtp_fec_enc->pos / upipe_rtp_fec_enc->cols;
+    struct upipe_rtp_fec_enc_parity *col_parity =
+        &upipe_rtp_fec_enc->col_parity[col];
+    struct upipe_rtp_fec_enc_parity *row_parity =
+        &upipe_rtp_fec_enc->row_parity;
+
+    if (!row)
+        upipe_rtp_fec_enc_parity_reset(col_parity, seqnum);
+    if (!col) {
+        upipe_rtp_fec_enc->row_active =
+            upipe_rtp_fec_enc->row.output != NULL;
+        upipe_rtp_fec_enc_parity_reset(row_parity, seqnum);
+    }
+    upipe_rtp_fec_enc_parity_add(col_parity, rtp, length);
+    if (upipe_rtp_fec_enc->row_active)
+        upipe_rtp_fec_enc_parity_add(row_parity, rtp, length);
+    uref_block_peek_unmap(uref, 0, rtp_buffer, rtp);
+
+    /* read the payload once for both parities */
+    int offset = 0;
+    while (offset < length) {
+        const uint8_t *buffer;
+        int size = -1;
+        if (unlikely(!ubase_check(uref_block_read(uref,
+                            RTP_HEADER_SIZE + offset, &size, &buffer)))) {
+            upipe_warn(upipe, "unable to read payload");
+            break;
+        }
+        upipe_rtp_fec_enc_xor(upipe_rtp_fec_enc,
+                              col_parity->payload + offset, buffer, size);
+        if (upipe_rtp_fec_enc->row_active)
+            upipe_rtp_fec_enc_xor(upipe_rtp_fec_enc,
+                                  row_parity->payload + offset, buffer, size);
+        uref_block_unmap(uref, RTP_HEADER_SIZE + offset);
+        offset += size;
+    }
+
+    struct upipe *upipe_col =
+        upipe_rtp_fec_enc_output_to_upipe(&upipe_rtp_fec_enc->col);
+    struct upipe *upipe_row =
+        upipe_rtp_fec_enc_output_to_upipe(&upipe_rtp_fec_enc->row);
+    struct uref *col_fec = NULL, *row_fec = NULL;
+    if (row == upipe_rtp_fec_enc->rows - 1)
+        col_fec = upipe_rtp_fec_enc_build(upipe_col, col_parity,
+                upipe_rtp_fec_enc->cols, upipe_rtp_fec_enc->rows, false, uref);
+    if (col == upipe_rtp_fec_enc->cols - 1 && upipe_rtp_fec_enc->row_active)
+        row_fec = upipe_rtp_fec_enc_build(upipe_row, row_parity,
+                1, upipe_rtp_fec_enc->cols, true, uref);
+
+    if (++upipe_rtp_fec_enc->pos ==
+            upipe_rtp_fec_enc->cols * upipe_rtp_fec_enc->rows)
+        upipe_rtp_fec_enc->pos = 0;
+
+    /* the protected packet goes first */
+    upipe_rtp_fec_enc_output(upipe, uref, upump_p);
+    if (row_fec != NULL)
+        upipe_rtp_fec_enc_output_output(upipe_row, row_fec, upump_p);
+    if (col_fec != NULL)
+        upipe_rtp_fec_enc_output_output(upipe_col, col_fec, upump_p);
+}
+
+/** @internal @This sets the input flow definition.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_def flow definition packet
+ * @return an error code
+ */
+static int upipe_rtp_fec_enc_set_flow_def(struct upipe *upipe,
+                                          struct uref *flow_def)
+{
+    struct upipe_rtp_fec_enc *upipe_rtp_fec_enc =
+        upipe_rtp_fec_enc_from_upipe(upipe);
+    if (flow_def == NULL)
+        return UBASE_ERR_INVALID;
+    UBASE_RETURN(uref_flow_match_def(flow_def, EXPECTED_FLOW_DEF))
+
+    struct uref *flow_def_dup, *col_flow_def, *row_flow_def;
+    if ((flow_def_dup = uref_dup(flow_def)) == NULL)
+        return UBASE_ERR_ALLOC;
+    if ((col_flow_def = uref_sibling_alloc_control(flow_def)) == NULL) {
+        uref_free(flow_def_dup);
+        return UBASE_ERR_ALLOC;
+    }
+    if ((row_flow_def = uref_sibling_alloc_control(flow_def)) == NULL) {
+        uref_free(col_flow_def);
+        uref_free(flow_def_dup);
+        return UBASE_ERR_ALLOC;
+    }
+    if (unlikely(!ubase_check(uref_flow_set_def(col_flow_def,
+                                                FEC_FLOW_DEF)) ||
+                 !ubase_check(uref_flow_set_def(row_flow_def,
+                                                FEC_FLOW_DEF)))) {
+        uref_free(row_flow_def);
+        uref_free(col_flow_def);
+        uref_free(flow_def_dup);
+        return UBASE_ERR_ALLOC;
+    }
+
+    upipe_rtp_fec_enc_store_flow_def(upipe, flow_def_dup);
+    upipe_rtp_fec_enc_output_store_flow_def(
+            upipe_rtp_fec_enc_output_to_upipe(&upipe_rtp_fec_enc->col),
+            col_flow_def);
+    upipe_rtp_fec_enc_output_store_flow_def(
+            upipe_rtp_fec_enc_output_to_upipe(&upipe_rtp_fec_enc->row),
+            row_flow_def);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the size of the FEC matrix.
+ *
+ * @param upipe description structure of the pipe
+ * @param cols number of columns (L)
+ * @param rows number of rows (D)
+ * @return an error code
+ */
+static int _upipe_rtp_fec_enc_set_matrix(struct upipe *upipe,
+                                         unsigned int cols,
+                                         unsigned int rows)
+{
+    struct upipe_rtp_fec_enc *upipe_rtp_fec_enc =
+        upipe_rtp_fec_enc_from_upipe(upipe);
+    if (cols < 1 || cols > FEC_COLS_MAX ||
+        rows < FEC_ROWS_MIN || rows > FEC_ROWS_MAX ||
+        cols * rows > FEC_MATRIX_MAX)
+        return UBASE_ERR_INVALID;
+
+    upipe_dbg_va(upipe, "using %u columns and %u rows", cols, rows);
+    upipe_rtp_fec_enc->cols = cols;
+    upipe_rtp_fec_enc->rows = rows;
+    upipe_rtp_fec_enc->pos = 0;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands on a rtp_fec_enc pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_rtp_fec_enc_control(struct upipe *upipe, int command,
+                                     va_list args)
+{
+    struct upipe_rtp_fec_enc *upipe_rtp_fec_enc =
+        upipe_rtp_fec_enc_from_upipe(upipe);
+    UBASE_HANDLED_RETURN(upipe_rtp_fec_enc_control_output(upipe, command,
+                                                          args));
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            return upipe_rtp_fec_enc_set_flow_def(upipe, flow_def);
+        }
+
+        case UPIPE_RTP_FEC_ENC_GET_COL_SUB: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_RTP_FEC_ENC_SIGNATURE)
+            struct upipe **upipe_p = va_arg(args, struct upipe **);
+            *upipe_p =
+                upipe_rtp_fec_enc_output_to_upipe(&upipe_rtp_fec_enc->col);
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_RTP_FEC_ENC_GET_ROW_SUB: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_RTP_FEC_ENC_SIGNATURE)
+            struct upipe **upipe_p = va_arg(args, struct upipe **);
+            *upipe_p =
+                upipe_rtp_fec_enc_output_to_upipe(&upipe_rtp_fec_enc->row);
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_RTP_FEC_ENC_GET_MATRIX: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_RTP_FEC_ENC_SIGNATURE)
+            unsigned int *cols_p = va_arg(args, unsigned int *);
+            unsigned int *rows_p = va_arg(args, unsigned int *);
+            *cols_p = upipe_rtp_fec_enc->cols;
+            *rows_p = upipe_rtp_fec_enc->rows;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_RTP_FEC_ENC_SET_MATRIX: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_RTP_FEC_ENC_SIGNATURE)
+            unsigned int cols = va_arg(args, unsigned int);
+            unsigned int rows = va_arg(args, unsigned int);
+            return _upipe_rtp_fec_enc_set_matrix(upipe, cols, rows);
+        }
+
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @internal @This processes control commands on an output subpipe.
+ *
+ * @param upipe description structure of the subpipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_rtp_fec_enc_output_control(struct upipe *upipe,
+                                            int command, va_list args)
+{
+    UBASE_HANDLED_RETURN(upipe_rtp_fec_enc_output_control_output(upipe,
+                command, args));
+    switch (command) {
+        case UPIPE_SUB_GET_SUPER: {
+            struct upipe_rtp_fec_enc *upipe_rtp_fec_enc =
+                upipe_rtp_fec_enc_from_sub_mgr(upipe->mgr);
+            struct upipe **p = va_arg(args, struct upipe **);
+            *p = upipe_rtp_fec_enc_to_upipe(upipe_rtp_fec_enc);
+            return UBASE_ERR_NONE;
+        }
+
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @internal @This initializes an output subpipe.
+ *
+ * @param upipe_rtp_fec_enc private structure of the super pipe
+ * @param output private structure of the subpipe
+ * @param uprobe structure used to raise events by the subpipe
+ */
+static void upipe_rtp_fec_enc_output_init(
+        struct upipe_rtp_fec_enc *upipe_rtp_fec_enc,
+        struct upipe_rtp_fec_enc_output *output, struct uprobe *uprobe)
+{
+    struct upipe *upipe = upipe_rtp_fec_enc_output_to_upipe(output);
+    upipe_init(upipe, &upipe_rtp_fec_enc->sub_mgr, uprobe);
+    upipe->refcount = upipe_rtp_fec_enc_to_urefcount(upipe_rtp_fec_enc);
+    upipe_rtp_fec_enc_output_init_output(upipe);
+    output->seqnum = 0;
+    upipe_throw_ready(upipe);
+}
+
+/** @internal @This cleans up an output subpipe.
+ *
+ * @param output private structure of the subpipe
+ */
+static void upipe_rtp_fec_enc_output_clean(
+        struct upipe_rtp_fec_enc_output *output)
+{
+    struct upipe *upipe = upipe_rtp_fec_enc_output_to_upipe(output);
+    upipe_throw_dead(upipe);
+    upipe_rtp_fec_enc_output_clean_output(upipe);
+    upipe_clean(upipe);
+}
+
+/** @internal @This allocates a rtp_fec_enc pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *_upipe_rtp_fec_enc_alloc(struct upipe_mgr *mgr,
+                                              struct uprobe *uprobe,
+                                              uint32_t signature,
+                                              va_list args)
+{
+    if (signature != UPIPE_RTP_FEC_ENC_SIGNATURE) {
+        uprobe_release(uprobe);
+        return NULL;
+    }
+    struct uprobe *uprobe_col = va_arg(args, struct uprobe *);
+    struct uprobe *uprobe_row = va_arg(args, struct uprobe *);
+
+    struct upipe_rtp_fec_enc *upipe_rtp_fec_enc =
+        malloc(sizeof(struct upipe_rtp_fec_enc));
+    if (unlikely(upipe_rtp_fec_enc == NULL)) {
+        uprobe_release(uprobe);
+        uprobe_release(uprobe_col);
+        uprobe_release(uprobe_row);
+        return NULL;
+    }
+
+    struct upipe *upipe = upipe_rtp_fec_enc_to_upipe(upipe_rtp_fec_enc);
+    upipe_init(upipe, mgr, uprobe);
+    upipe_rtp_fec_enc_init_urefcount(upipe);
+    upipe_rtp_fec_enc_init_urefcount_real(upipe);
+    upipe_rtp_fec_enc_init_output(upipe);
+
+    struct upipe_mgr *sub_mgr = &upipe_rtp_fec_enc->sub_mgr;
+    memset(sub_mgr, 0, sizeof(struct upipe_mgr));
+    sub_mgr->refcount =
+        upipe_rtp_fec_enc_to_urefcount_real(upipe_rtp_fec_enc);
+    sub_mgr->signature = UPIPE_RTP_FEC_ENC_OUTPUT_SIGNATURE;
+    sub_mgr->upipe_control = upipe_rtp_fec_enc_output_control;
+
+    upipe_rtp_fec_enc->fec_xor = upipe_fec_xor_c;
+    upipe_rtp_fec_enc->xor_align = 1;
+#if defined(HAVE_X86ASM)
+#if defined(__i686__) || defined(__x86_64__)
+    if (__builtin_cpu_supports("sse2")) {
+        upipe_rtp_fec_enc->fec_xor = upipe_fec_xor_sse2;
+        upipe_rtp_fec_enc->xor_align = 16;
+    }
+
+    if (__builtin_cpu_supports("avx2")) {
+        upipe_rtp_fec_enc->fec_xor = upipe_fec_xor_avx2;
+        upipe_rtp_fec_enc->xor_align = 32;
+    }
+#endif
+#endif
+
+    upipe_rtp_fec_enc->cols = 0;
+    upipe_rtp_fec_enc->rows = 0;
+    upipe_rtp_fec_enc->pos = 0;
+    upipe_rtp_fec_enc->next_seqnum = 0;
+    upipe_rtp_fec_enc->row_active = false;
+    upipe_throw_ready(upipe);
+
+    upipe_rtp_fec_enc_output_init(upipe_rtp_fec_enc, &upipe_rtp_fec_enc->col,
+                                  uprobe_col);
+    upipe_rtp_fec_enc_output_init(upipe_rtp_fec_enc, &upipe_rtp_fec_enc->row,
+                                  uprobe_row);
+    return upipe;
+}
+
+/** @This frees a upipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_rtp_fec_enc_free(struct upipe *upipe)
+{
+    struct upipe_rtp_fec_enc *upipe_rtp_fec_enc =
+        upipe_rtp_fec_enc_from_upipe(upipe);
+    upipe_throw_dead(upipe);
+    upipe_rtp_fec_enc_clean_output(upipe);
+    upipe_rtp_fec_enc_clean_urefcount_real(upipe);
+    upipe_rtp_fec_enc_clean_urefcount(upipe);
+    upipe_clean(upipe);
+    free(upipe_rtp_fec_enc);
+}
+
+/** @internal @This is called when there is no more external reference to the
+ * pipe or its subpipes.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_rtp_fec_enc_no_ref(struct upipe *upipe)
+{
+    struct upipe_rtp_fec_enc *upipe_rtp_fec_enc =
+        upipe_rtp_fec_enc_from_upipe(upipe);
+    upipe_rtp_fec_enc_output_clean(&upipe_rtp_fec_enc->col);
+    upipe_rtp_fec_enc_output_clean(&upipe_rtp_fec_enc->row);
+    upipe_rtp_fec_enc_release_urefcount_real(upipe);
+}
+
+/** module manager static descriptor */
+static struct upipe_mgr upipe_rtp_fec_enc_mgr = {
+    .refcount = NULL,
+    .signature = UPIPE_RTP_FEC_ENC_SIGNATURE,
+
+    .upipe_alloc = _upipe_rtp_fec_enc_alloc,
+    .upipe_input = upipe_rtp_fec_enc_input,
+    .upipe_control = upipe_rtp_fec_enc_control,
+
+    .upipe_mgr_control = NULL
+};
+
+/** @This returns the management structure for rtp_fec_enc pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_rtp_fec_enc_mgr_alloc(void)
+{
+    return &upipe_rtp_fec_enc_mgr;
+}
@@ -2984,6 +2984,7 @@ static void upipe_ts_mux_work_live(struct upipe *upipe, struct upump **upump_p)
                 upipe_throw_fatal(upipe, UBASE_ERR_UPUMP);
                 return;
             }
+            upump_set_priority(upump, UPUMP_PRIORITY_HIGH);
         } else if (next_cr_sys > now) {
             _upipe_ts_mux_watcher(upipe);
             return;
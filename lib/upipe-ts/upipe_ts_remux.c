@@ -0,0 +1,1200 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe module remultiplexing TS packets without PES reassembly
+ *
+ * Payload packets are modified in place (PID, continuity counter and
+ * optionally PCR), so the cost per packet is a table lookup and a few
+ * bit operations. Only the PSI/SI PIDs that must be rewritten (PAT,
+ * PMTs of the selected services, SDT, EIT) are reassembled.
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/uprobe.h>
+#include <upipe/uclock.h>
+#include <upipe/uref.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_flow.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_void.h>
+#include <upipe/upipe_helper_output.h>
+#include <upipe-ts/upipe_ts_remux.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#include <bitstream/mpeg/ts.h>
+#include <bitstream/mpeg/psi.h>
+#include <bitstream/dvb/si.h>
+
+/** we only accept aligned TS packets */
+#define EXPECTED_FLOW_DEF "block.mpegts."
+/** number of PIDs */
+#define MAX_PIDS 8192
+/** PID used to drop packets */
+#define NULL_PID 8191
+/** maximum PCR value, in 27 MHz units */
+#define PCR_MAX (UINT64_C(8589934592) * 300)
+/** smoothing factor of the PCR restamping offset */
+#define RESTAMP_SMOOTHING 256
+/** maximum number of PIDs referenced by a PSI PID */
+#define MAX_REFS (PSI_PRIVATE_MAX_SIZE / 4 + 1)
+/** flag of the references to a PCR PID */
+#define PCR_REF 0x8000
+
+/** @internal @This is the type of an input PID. */
+enum upipe_ts_remux_pid_type {
+    /** packets are dropped */
+    UPIPE_TS_REMUX_PID_DROP = 0,
+    /** packets are forwarded untouched but for the header */
+    UPIPE_TS_REMUX_PID_ES,
+    /** same as ES, but not declared in the PSI (TDT/TOT) */
+    UPIPE_TS_REMUX_PID_PASS,
+    /** PAT sections are rewritten */
+    UPIPE_TS_REMUX_PID_PAT,
+    /** PMT sections are rewritten */
+    UPIPE_TS_REMUX_PID_PMT,
+    /** SDT sections are rewritten */
+    UPIPE_TS_REMUX_PID_SDT,
+    /** EIT sections are filtered */
+    UPIPE_TS_REMUX_PID_EIT,
+    /** CAT sections are rewritten */
+    UPIPE_TS_REMUX_PID_CAT,
+};
+
+/** @internal @This is the section reassembly buffer of a PSI PID. */
+struct upipe_ts_remux_psi {
+    /** number of octets in the buffer */
+    uint16_t used;
+    /** section being reassembled */
+    uint8_t buffer[PSI_PRIVATE_MAX_SIZE + PSI_HEADER_SIZE];
+    /** number of referenced PIDs */
+    unsigned int nb_refs;
+    /** PIDs referenced by the last sections (PMTs for the PAT, ES, PCR and
+     * ECM PIDs for a PMT, EMM PIDs for the CAT), possibly with PCR_REF */
+    uint16_t refs[MAX_REFS];
+};
+
+/** @internal @This is the context of an input PID. */
+struct upipe_ts_remux_pid {
+    /** type of PID */
+    enum upipe_ts_remux_pid_type type;
+    /** output PID */
+    uint16_t out_pid;
+    /** last input continuity counter, or -1 */
+    int8_t last_cc;
+    /** last output continuity counter */
+    uint8_t cc;
+    /** number of PSI sections referencing this PID */
+    unsigned int refs;
+    /** number of selected services using this PID as PCR PID */
+    unsigned int pcr_refs;
+    /** true if pcr_offset is valid */
+    bool pcr_valid;
+    /** offset between restamped PCRs and cr_sys, in 27 MHz units */
+    int64_t pcr_offset;
+    /** section reassembly buffer, for PSI PIDs */
+    struct upipe_ts_remux_psi *psi;
+};
+
+/** @internal @This is the private context of a ts_remux pipe. */
+struct upipe_ts_remux {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** pipe acting as output */
+    struct upipe *output;
+    /** output flow definition packet */
+    struct uref *flow_def;
+    /** output state */
+    enum upipe_helper_output_state output_state;
+    /** list of output requests */
+    struct uchain request_list;
+
+    /** table of input PIDs */
+    struct upipe_ts_remux_pid *pids;
+    /** bitmap of selected services */
+    uint8_t services[65536 / 8];
+    /** number of selected services */
+    unsigned int nb_services;
+    /** output TSID, or -1 */
+    int tsid;
+    /** true if PCRs are restamped */
+    bool restamp;
+    /** incremented at each configuration change to bump table versions */
+    uint8_t generation;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(upipe_ts_remux, upipe, UPIPE_TS_REMUX_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(upipe_ts_remux, urefcount, upipe_ts_remux_free)
+UPIPE_HELPER_VOID(upipe_ts_remux)
+UPIPE_HELPER_OUTPUT(upipe_ts_remux, output, flow_def, output_state,
+                    request_list)
+
+/** @internal @This checks if a service is selected.
+ *
+ * @param upipe_ts_remux private structure of the pipe
+ * @param sid service ID
+ * @return true if the service is selected
+ */
+static inline bool
+    upipe_ts_remux_selected(struct upipe_ts_remux *upipe_ts_remux,
+                            uint16_t sid)
+{
+    return !upipe_ts_remux->nb_services ||
+           (upipe_ts_remux->services[sid / 8] & (1 << (sid % 8)));
+}
+
+/** @internal @This changes the type of an input PID.
+ *
+ * @param upipe description structure of the pipe
+ * @param pid input PID
+ * @param type new type
+ * @return an error code
+ */
+static int upipe_ts_remux_set_type(struct upipe *upipe, uint16_t pid,
+                                   enum upipe_ts_remux_pid_type type)
+{
+    struct upipe_ts_remux *upipe_ts_remux = upipe_ts_remux_from_upipe(upipe);
+    struct upipe_ts_remux_pid *pid_s = &upipe_ts_remux->pids[pid];
+    if (pid_s->type == type)
+        return UBASE_ERR_NONE;
+
+    bool psi = type != UPIPE_TS_REMUX_PID_DROP &&
+               type != UPIPE_TS_REMUX_PID_ES &&
+               type != UPIPE_TS_REMUX_PID_PASS;
+    if (psi && pid_s->psi == NULL) {
+        pid_s->psi = malloc(sizeof (struct upipe_ts_remux_psi));
+        UBASE_ALLOC_RETURN(pid_s->psi);
+        pid_s->psi->used = 0;
+        pid_s->psi->nb_refs = 0;
+    } else if (!psi && pid_s->psi != NULL) {
+        free(pid_s->psi);
+        pid_s->psi = NULL;
+    }
+    pid_s->type = type;
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This references an input PID from the section being
+ * rewritten, so that it is forwarded with the given type.
+ *
+ * @param upipe description structure of the pipe
+ * @param psi reassembly buffer of the PSI PID carrying the section
+ * @param pid referenced input PID
+ * @param type type of the referenced PID
+ * @param pcr true if the PID is referenced as PCR PID
+ * @return false if the PID can't be forwarded
+ */
+static bool upipe_ts_remux_ref(struct upipe *upipe,
+                               struct upipe_ts_remux_psi *psi, uint16_t pid,
+                               enum upipe_ts_remux_pid_type type, bool pcr)
+{
+    struct upipe_ts_remux *upipe_ts_remux = upipe_ts_remux_from_upipe(upipe);
+    if (pid >= NULL_PID)
+        return false;
+    struct upipe_ts_remux_pid *pid_s = &upipe_ts_remux->pids[pid];
+    if (pid_s->out_pid == NULL_PID)
+        return false;
+
+    uint16_t ref = pcr ? pid | PCR_REF : pid;
+    for (unsigned int i = 0; i < psi->nb_refs; i++)
+        if (psi->refs[i] == ref)
+            return true;
+    if (unlikely(psi->nb_refs >= MAX_REFS)) {
+        upipe_warn_va(upipe, "too many PIDs referenced, ignoring PID %"PRIu16,
+                      pid);
+        return false;
+    }
+
+    if (pid_s->type != type) {
+        if (pid_s->type != UPIPE_TS_REMUX_PID_DROP)
+            return false;
+        for (unsigned int i = 0; i < MAX_PIDS; i++) {
+            struct upipe_ts_remux_pid *other = &upipe_ts_remux->pids[i];
+            if (other->type != UPIPE_TS_REMUX_PID_DROP &&
+                other->out_pid == pid_s->out_pid) {
+                upipe_warn_va(upipe, "PID %"PRIu16" would be output on "
+                              "PID %"PRIu16" already used by PID %u", pid,
+                              pid_s->out_pid, i);
+                return false;
+            }
+        }
+        if (!ubase_check(upipe_ts_remux_set_type(upipe, pid, type)))
+            return false;
+    }
+
+    psi->refs[psi->nb_refs++] = ref;
+    pid_s->refs++;
+    if (pcr)
+        pid_s->pcr_refs++;
+    return true;
+}
+
+/** @internal @This releases a reference to an input PID, and drops it if
+ * it is no longer referenced.
+ *
+ * @param upipe description structure of the pipe
+ * @param ref reference to release, possibly with PCR_REF
+ */
+static void upipe_ts_remux_unref(struct upipe *upipe, uint16_t ref)
+{
+    struct upipe_ts_remux *upipe_ts_remux = upipe_ts_remux_from_upipe(upipe);
+    uint16_t pid = ref & ~PCR_REF;
+    struct upipe_ts_remux_pid *pid_s = &upipe_ts_remux->pids[pid];
+    if (ref & PCR_REF)
+        pid_s->pcr_refs--;
+    if (--pid_s->refs)
+        return;
+
+    if (pid_s->type == UPIPE_TS_REMUX_PID_PMT)
+        for (unsigned int i = 0; i < pid_s->psi->nb_refs; i++)
+            upipe_ts_remux_unref(upipe, pid_s->psi->refs[i]);
+    upipe_ts_remux_set_type(upipe, pid, UPIPE_TS_REMUX_PID_DROP);
+    pid_s->last_cc = -1;
+}
+
+/** @internal @This references the ECM or EMM PIDs of the CA descriptors
+ * of a descriptor list, and remaps them.
+ *
+ * @param upipe description structure of the pipe
+ * @param psi reassembly buffer of the PSI PID carrying the section
+ * @param descl rewritten descriptor list
+ * @param length size of the descriptor list
+ */
+static void upipe_ts_remux_ref_ca(struct upipe *upipe,
+                                  struct upipe_ts_remux_psi *psi,
+                                  uint8_t *descl, uint16_t length)
+{
+    struct upipe_ts_remux *upipe_ts_remux = upipe_ts_remux_from_upipe(upipe);
+    uint8_t *desc;
+    for (int i = 0; (desc = descl_get_desc(descl, length, i)) != NULL; i++) {
+        if (desc_get_tag(desc) != 0x9 || !desc09_validate(desc))
+            continue;
+        uint16_t pid = desc09_get_pid(desc);
+        if (upipe_ts_remux_ref(upipe, psi, pid, UPIPE_TS_REMUX_PID_ES, false))
+            desc09_set_pid(desc, upipe_ts_remux->pids[pid].out_pid);
+    }
+}
+
+/** @internal @This resets the PIDs discovered in the PSI, after a
+ * configuration change. They will be set up again with the next PAT and
+ * PMTs.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_ts_remux_reset(struct upipe *upipe)
+{
+    struct upipe_ts_remux *upipe_ts_remux = upipe_ts_remux_from_upipe(upipe);
+    for (unsigned int pid = 0; pid < MAX_PIDS; pid++) {
+        struct upipe_ts_remux_pid *pid_s = &upipe_ts_remux->pids[pid];
+        pid_s->refs = 0;
+        pid_s->pcr_refs = 0;
+        if (pid_s->type == UPIPE_TS_REMUX_PID_ES ||
+            pid_s->type == UPIPE_TS_REMUX_PID_PMT)
+            upipe_ts_remux_set_type(upipe, pid, UPIPE_TS_REMUX_PID_DROP);
+        else if (pid_s->psi != NULL)
+            pid_s->psi->nb_refs = 0;
+    }
+    upipe_ts_remux->generation++;
+}
+
+/** @internal @This allocates a ts_remux pipe.
+ *
+ * @param mgr common management structure
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to upipe or NULL in case of allocation error
+ */
+static struct upipe *upipe_ts_remux_alloc(struct upipe_mgr *mgr,
+                                          struct uprobe *uprobe,
+                                          uint32_t signature, va_list args)
+{
+    struct upipe *upipe = upipe_ts_remux_alloc_void(mgr, uprobe, signature,
+                                                    args);
+    if (unlikely(upipe == NULL))
+        return NULL;
+
+    struct upipe_ts_remux *upipe_ts_remux = upipe_ts_remux_from_upipe(upipe);
+    upipe_ts_remux->pids = malloc(sizeof (struct upipe_ts_remux_pid) *
+                                  MAX_PIDS);
+    if (unlikely(upipe_ts_remux->pids == NULL)) {
+        upipe_ts_remux_free_void(upipe);
+        return NULL;
+    }
+
+    upipe_ts_remux_init_urefcount(upipe);
+    upipe_ts_remux_init_output(upipe);
+    for (unsigned int pid = 0; pid < MAX_PIDS; pid++) {
+        struct upipe_ts_remux_pid *pid_s = &upipe_ts_remux->pids[pid];
+        pid_s->type = UPIPE_TS_REMUX_PID_DROP;
+        pid_s->out_pid = pid;
+        pid_s->last_cc = -1;
+        pid_s->cc = 0xf;
+        pid_s->refs = 0;
+        pid_s->pcr_refs = 0;
+        pid_s->pcr_valid = false;
+        pid_s->pcr_offset = 0;
+        pid_s->psi = NULL;
+    }
+    memset(upipe_ts_remux->services, 0, sizeof (upipe_ts_remux->services));
+    upipe_ts_remux->nb_services = 0;
+    upipe_ts_remux->tsid = -1;
+    upipe_ts_remux->restamp = false;
+    upipe_ts_remux->generation = 0;
+    upipe_throw_ready(upipe);
+
+    if (unlikely(!ubase_check(upipe_ts_remux_set_type(upipe, PAT_PID,
+                        UPIPE_TS_REMUX_PID_PAT)) ||
+                 !ubase_check(upipe_ts_remux_set_type(upipe, SDT_PID,
+                        UPIPE_TS_REMUX_PID_SDT)) ||
+                 !ubase_check(upipe_ts_remux_set_type(upipe, EIT_PID,
+                        UPIPE_TS_REMUX_PID_EIT)) ||
+                 !ubase_check(upipe_ts_remux_set_type(upipe, CAT_PID,
+                        UPIPE_TS_REMUX_PID_CAT)))) {
+        upipe_release(upipe);
+        return NULL;
+    }
+    /* TDT and TOT are forwarded as is */
+    upipe_ts_remux->pids[TDT_PID].type = UPIPE_TS_REMUX_PID_PASS;
+    return upipe;
+}
+
+/** @internal @This outputs a section, split into TS packets.
+ *
+ * @param upipe description structure of the pipe
+ * @param pid_s input PID the section was received on
+ * @param section section to send
+ * @param uref input packet carrying the end of the input section
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_ts_remux_send_section(struct upipe *upipe,
+                                        struct upipe_ts_remux_pid *pid_s,
+                                        const uint8_t *section,
+                                        struct uref *uref,
+                                        struct upump **upump_p)
+{
+    uint16_t section_size = psi_get_length(section) + PSI_HEADER_SIZE;
+    uint16_t offset = 0;
+    while (offset < section_size) {
+        struct ubuf *ubuf = ubuf_block_alloc(uref->ubuf->mgr, TS_SIZE);
+        struct uref *output;
+        if (unlikely(ubuf == NULL ||
+                     (output = uref_fork(uref, ubuf)) == NULL)) {
+            ubuf_free(ubuf);
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+
+        uint8_t *ts;
+        int size = -1;
+        if (unlikely(!ubase_check(ubuf_block_write(ubuf, 0, &size, &ts)))) {
+            uref_free(output);
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+        ts_init(ts);
+        ts_set_pid(ts, pid_s->out_pid);
+        ts_set_payload(ts);
+        pid_s->cc = (pid_s->cc + 1) & 0xf;
+        ts_set_cc(ts, pid_s->cc);
+
+        uint8_t *payload = ts + TS_HEADER_SIZE;
+        if (!offset) {
+            ts_set_unitstart(ts);
+            *payload++ = 0; /* pointer_field */
+        }
+        uint16_t length = TS_SIZE - (payload - ts);
+        if (length > section_size - offset)
+            length = section_size - offset;
+        memcpy(payload, section + offset, length);
+        memset(payload + length, 0xff, TS_SIZE - (payload + length - ts));
+        offset += length;
+        ubuf_block_unmap(ubuf, 0);
+
+        upipe_ts_remux_output(upipe, output, upump_p);
+    }
+}
+
+/** @internal @This sets the version of a rewritten section.
+ *
+ * @param upipe description structure of the pipe
+ * @param out rewritten section
+ * @param section input section
+ */
+static void upipe_ts_remux_set_version(struct upipe *upipe, uint8_t *out,
+                                       const uint8_t *section)
+{
+    struct upipe_ts_remux *upipe_ts_remux = upipe_ts_remux_from_upipe(upipe);
+    psi_set_version(out, (psi_get_version(section) +
+                          upipe_ts_remux->generation) & 0x1f);
+}
+
+/** @internal @This rewrites a PAT section, keeping the selected services.
+ *
+ * @param upipe description structure of the pipe
+ * @param psi reassembly buffer of the PID
+ * @param section input section
+ * @param out filled in with the rewritten section
+ * @return an error code
+ */
+static int upipe_ts_remux_rewrite_pat(struct upipe *upipe,
+                                      struct upipe_ts_remux_psi *psi,
+                                      const uint8_t *section, uint8_t *out)
+{
+    struct upipe_ts_remux *upipe_ts_remux = upipe_ts_remux_from_upipe(upipe);
+    if (!pat_validate(section))
+        return UBASE_ERR_INVALID;
+
+    memcpy(out, section, PAT_HEADER_SIZE);
+    if (upipe_ts_remux->tsid >= 0)
+        pat_set_tsid(out, upipe_ts_remux->tsid);
+    upipe_ts_remux_set_version(upipe, out, section);
+
+    uint8_t *w = out + PAT_HEADER_SIZE;
+    const uint8_t *program;
+    for (int i = 0; (program = pat_get_program(section, i)) != NULL; i++) {
+        uint16_t sid = patn_get_program(program);
+        uint16_t pmt_pid = patn_get_pid(program);
+        /* the NIT is not forwarded */
+        if (!sid || !upipe_ts_remux_selected(upipe_ts_remux, sid))
+            continue;
+        if (!upipe_ts_remux_ref(upipe, psi, pmt_pid, UPIPE_TS_REMUX_PID_PMT,
+                                false))
+            continue;
+
+        patn_init(w);
+        patn_set_program(w, sid);
+        patn_set_pid(w, upipe_ts_remux->pids[pmt_pid].out_pid);
+        w += PAT_PROGRAM_SIZE;
+    }
+    pat_set_length(out, w - out - PAT_HEADER_SIZE);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This rewrites a PMT section, remapping the PIDs and
+ * enabling the elementary streams and their ECMs.
+ *
+ * @param upipe description structure of the pipe
+ * @param psi reassembly buffer of the PID
+ * @param section input section
+ * @param out filled in with the rewritten section
+ * @return an error code
+ */
+static int upipe_ts_remux_rewrite_pmt(struct upipe *upipe,
+                                      struct upipe_ts_remux_psi *psi,
+                                      const uint8_t *section, uint8_t *out)
+{
+    struct upipe_ts_remux *upipe_ts_remux = upipe_ts_remux_from_upipe(upipe);
+    if (!pmt_validate(section) ||
+        !upipe_ts_remux_selected(upipe_ts_remux,
+                                 psi_get_tableidext(section)))
+        return UBASE_ERR_INVALID;
+
+    size_t header_size = PMT_HEADER_SIZE + pmt_get_desclength(section);
+    memcpy(out, section, header_size);
+    upipe_ts_remux_set_version(upipe, out, section);
+    upipe_ts_remux_ref_ca(upipe, psi, out + PMT_HEADER_SIZE,
+                          pmt_get_desclength(section));
+
+    uint16_t pcr_pid = pmt_get_pcrpid(section);
+    if (pcr_pid != NULL_PID) {
+        struct upipe_ts_remux_pid *pcr = &upipe_ts_remux->pids[pcr_pid];
+        pmt_set_pcrpid(out, pcr->out_pid);
+        upipe_ts_remux_ref(upipe, psi, pcr_pid, UPIPE_TS_REMUX_PID_ES, true);
+    }
+
+    uint8_t *w = out + header_size;
+    const uint8_t *es;
+    for (int i = 0; (es = pmt_get_es(section, i)) != NULL; i++) {
+        uint16_t pid = pmtn_get_pid(es);
+        if (!upipe_ts_remux_ref(upipe, psi, pid, UPIPE_TS_REMUX_PID_ES, false))
+            continue;
+
+        size_t es_size = PMT_ES_SIZE + pmtn_get_desclength(es);
+        memcpy(w, es, es_size);
+        pmtn_set_pid(w, upipe_ts_remux->pids[pid].out_pid);
+        upipe_ts_remux_ref_ca(upipe, psi, w + PMT_ES_SIZE,
+                              pmtn_get_desclength(es));
+        w += es_size;
+    }
+    pmt_set_length(out, w - out - PMT_HEADER_SIZE);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This rewrites a CAT section, remapping the EMM PIDs and
+ * enabling them.
+ *
+ * @param upipe description structure of the pipe
+ * @param psi reassembly buffer of the PID
+ * @param section input section
+ * @param out filled in with the rewritten section
+ * @return an error code
+ */
+static int upipe_ts_remux_rewrite_cat(struct upipe *upipe,
+                                      struct upipe_ts_remux_psi *psi,
+                                      const uint8_t *section, uint8_t *out)
+{
+    if (psi_get_tableid(section) != CAT_TABLE_ID || !cat_validate(section))
+        return UBASE_ERR_INVALID;
+
+    memcpy(out, section, psi_get_length(section) + PSI_HEADER_SIZE);
+    upipe_ts_remux_set_version(upipe, out, section);
+    upipe_ts_remux_ref_ca(upipe, psi, cat_get_descl(out),
+                          cat_get_desclength(out));
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This rewrites an SDT section, keeping the selected services.
+ *
+ * @param upipe description structure of the pipe
+ * @param section input section
+ * @param out filled in with the rewritten section
+ * @return an error code
+ */
+static int upipe_ts_remux_rewrite_sdt(struct upipe *upipe,
+                                      const uint8_t *section, uint8_t *out)
+{
+    struct upipe_ts_remux *upipe_ts_remux = upipe_ts_remux_from_upipe(upipe);
+    /* SDT other and BAT are not forwarded */
+    if (psi_get_tableid(section) != SDT_TABLE_ID_ACTUAL ||
+        !sdt_validate(section))
+        return UBASE_ERR_INVALID;
+
+    memcpy(out, section, SDT_HEADER_SIZE);
+    if (upipe_ts_remux->tsid >= 0)
+        sdt_set_tsid(out, upipe_ts_remux->tsid);
+    upipe_ts_remux_set_version(upipe, out, section);
+
+    uint8_t *w = out + SDT_HEADER_SIZE;
+    const uint8_t *service;
+    for (int i = 0; (service = sdt_get_service(section, i)) != NULL; i++) {
+        if (!upipe_ts_remux_selected(upipe_ts_remux, sdtn_get_sid(service)))
+            continue;
+        size_t service_size = SDT_SERVICE_SIZE + sdtn_get_desclength(service);
+        memcpy(w, service, service_size);
+        w += service_size;
+    }
+    sdt_set_length(out, w - out - SDT_HEADER_SIZE);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This filters an EIT section, keeping the present/following
+ * and schedule tables of the selected services.
+ *
+ * @param upipe description structure of the pipe
+ * @param section input section
+ * @param out filled in with the rewritten section
+ * @return an error code
+ */
+static int upipe_ts_remux_rewrite_eit(struct upipe *upipe,
+                                      const uint8_t *section, uint8_t *out)
+{
+    struct upipe_ts_remux *upipe_ts_remux = upipe_ts_remux_from_upipe(upipe);
+    uint8_t table_id = psi_get_tableid(section);
+    if ((table_id != EIT_TABLE_ID_PF_ACTUAL &&
+         (table_id < EIT_TABLE_ID_SCHED_ACTUAL_FIRST ||
+          table_id > EIT_TABLE_ID_SCHED_ACTUAL_LAST)) ||
+        !eit_validate(section) ||
+        !upipe_ts_remux_selected(upipe_ts_remux,
+                                 psi_get_tableidext(section)))
+        return UBASE_ERR_INVALID;
+
+    memcpy(out, section, psi_get_length(section) + PSI_HEADER_SIZE);
+    if (upipe_ts_remux->tsid >= 0)
+        eit_set_tsid(out, upipe_ts_remux->tsid);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This handles a complete input section.
+ *
+ * @param upipe description structure of the pipe
+ * @param pid_s input PID
+ * @param uref input packet carrying the end of the section
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_ts_remux_handle_section(struct upipe *upipe,
+                                          struct upipe_ts_remux_pid *pid_s,
+                                          struct uref *uref,
+                                          struct upump **upump_p)
+{
+    const uint8_t *section = pid_s->psi->buffer;
+    if (unlikely(!psi_validate(section) || !psi_get_syntax(section) ||
+                 !psi_check_crc(section))) {
+        upipe_warn(upipe, "invalid section received");
+        return;
+    }
+    if (!psi_get_current(section))
+        return;
+
+    /* the first section of a table lists again all referenced PIDs; the
+     * PIDs it no longer references are dropped once it is rewritten */
+    struct upipe_ts_remux_psi *psi = pid_s->psi;
+    bool first = !psi_get_section(section);
+    uint16_t old_refs[MAX_REFS];
+    unsigned int nb_old_refs = 0;
+    if (first) {
+        nb_old_refs = psi->nb_refs;
+        memcpy(old_refs, psi->refs, nb_old_refs * sizeof (uint16_t));
+        psi->nb_refs = 0;
+    }
+
+    uint8_t out[PSI_PRIVATE_MAX_SIZE + PSI_HEADER_SIZE];
+    int err;
+    switch (pid_s->type) {
+        case UPIPE_TS_REMUX_PID_PAT:
+            err = upipe_ts_remux_rewrite_pat(upipe, psi, section, out);
+            break;
+        case UPIPE_TS_REMUX_PID_PMT:
+            err = upipe_ts_remux_rewrite_pmt(upipe, psi, section, out);
+            break;
+        case UPIPE_TS_REMUX_PID_CAT:
+            err = upipe_ts_remux_rewrite_cat(upipe, psi, section, out);
+            break;
+        case UPIPE_TS_REMUX_PID_SDT:
+            err = upipe_ts_remux_rewrite_sdt(upipe, section, out);
+            break;
+        case UPIPE_TS_REMUX_PID_EIT:
+            err = upipe_ts_remux_rewrite_eit(upipe, section, out);
+            break;
+        default:
+            err = UBASE_ERR_INVALID;
+            break;
+    }
+    if (!ubase_check(err)) {
+        /* the rewrite functions fail before referencing any PID */
+        if (first) {
+            memcpy(psi->refs, old_refs, nb_old_refs * sizeof (uint16_t));
+            psi->nb_refs = nb_old_refs;
+        }
+        return;
+    }
+    for (unsigned int i = 0; i < nb_old_refs; i++)
+        upipe_ts_remux_unref(upipe, old_refs[i]);
+
+    psi_set_crc(out);
+    upipe_ts_remux_send_section(upipe, pid_s, out, uref, upump_p);
+}
+
+/** @internal @This appends data to the section being reassembled.
+ *
+ * @param upipe description structure of the pipe
+ * @param pid_s input PID
+ * @param data pointer to data
+ * @param length size of data
+ * @param uref input packet
+ * @param upump_p reference to pump that generated the buffer
+ * @return number of octets consumed
+ */
+static size_t upipe_ts_remux_append(struct upipe *upipe,
+                                    struct upipe_ts_remux_pid *pid_s,
+                                    const uint8_t *data, size_t length,
+                                    struct uref *uref, struct upump **upump_p)
+{
+    struct upipe_ts_remux_psi *psi = pid_s->psi;
+    size_t need = psi->used < PSI_HEADER_SIZE ?
+        PSI_HEADER_SIZE - psi->used :
+        PSI_HEADER_SIZE + psi_get_length(psi->buffer) - psi->used;
+    if (need > length)
+        need = length;
+    memcpy(psi->buffer + psi->used, data, need);
+    psi->used += need;
+    if (psi->used < PSI_HEADER_SIZE)
+        return need;
+
+    if (unlikely(psi_get_length(psi->buffer) > PSI_PRIVATE_MAX_SIZE)) {
+        upipe_warn(upipe, "invalid section length");
+        psi->used = 0;
+        return length;
+    }
+    if (psi->used == PSI_HEADER_SIZE + psi_get_length(psi->buffer)) {
+        upipe_ts_remux_handle_section(upipe, pid_s, uref, upump_p);
+        psi->used = 0;
+    }
+    return need;
+}
+
+/** @internal @This reassembles sections from a PSI packet.
+ *
+ * @param upipe description structure of the pipe
+ * @param pid_s input PID
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_ts_remux_input_psi(struct upipe *upipe,
+                                     struct upipe_ts_remux_pid *pid_s,
+                                     struct uref *uref,
+                                     struct upump **upump_p)
+{
+    struct upipe_ts_remux_psi *psi = pid_s->psi;
+    const uint8_t *ts;
+    int size = -1;
+    if (unlikely(!ubase_check(uref_block_read(uref, 0, &size, &ts)))) {
+        uref_free(uref);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return;
+    }
+    if (unlikely(size < TS_SIZE || !ts_has_payload(ts))) {
+        uref_block_unmap(uref, 0);
+        uref_free(uref);
+        return;
+    }
+
+    uint8_t cc = ts_get_cc(ts);
+    if (pid_s->last_cc != -1) {
+        if (ts_check_duplicate(cc, pid_s->last_cc)) {
+            uref_block_unmap(uref, 0);
+            uref_free(uref);
+            return;
+        }
+        if (ts_check_discontinuity(cc, pid_s->last_cc))
+            psi->used = 0;
+    }
+    pid_s->last_cc = cc;
+
+    size_t offset = TS_HEADER_SIZE;
+    if (ts_has_adaptation(ts))
+        offset += 1 + ts[TS_HEADER_SIZE];
+    const uint8_t *payload = ts + offset;
+    size_t length = offset < TS_SIZE ? TS_SIZE - offset : 0;
+
+    if (ts_get_unitstart(ts) && length) {
+        uint8_t pointer = *payload++;
+        length--;
+        if (unlikely(pointer > length)) {
+            upipe_warn(upipe, "invalid pointer field");
+            psi->used = 0;
+            length = 0;
+        } else {
+            if (psi->used)
+                upipe_ts_remux_append(upipe, pid_s, payload, pointer,
+                                      uref, upump_p);
+            psi->used = 0;
+            payload += pointer;
+            length -= pointer;
+            /* a new section starts right here */
+            while (length && *payload != 0xff) {
+                size_t consumed = upipe_ts_remux_append(upipe, pid_s,
+                        payload, length, uref, upump_p);
+                payload += consumed;
+                length -= consumed;
+                if (psi->used)
+                    break;
+            }
+        }
+    } else if (psi->used)
+        upipe_ts_remux_append(upipe, pid_s, payload, length, uref, upump_p);
+
+    uref_block_unmap(uref, 0);
+    uref_free(uref);
+}
+
+/** @internal @This replaces the first octets of a shared packet with a
+ * private copy, so that they can be rewritten while the rest of the packet
+ * still references the shared buffer.
+ *
+ * @param uref uref structure
+ * @param header_size number of octets to copy
+ * @param block_size size of the packet
+ * @return an error code
+ */
+static int upipe_ts_remux_splice(struct uref *uref, size_t header_size,
+                                 size_t block_size)
+{
+    struct ubuf *header = ubuf_block_alloc(uref->ubuf->mgr, header_size);
+    UBASE_ALLOC_RETURN(header);
+    uint8_t *buffer;
+    int size = -1;
+    if (unlikely(!ubase_check(ubuf_block_write(header, 0, &size,
+                                               &buffer)))) {
+        ubuf_free(header);
+        return UBASE_ERR_ALLOC;
+    }
+    uref_block_extract(uref, 0, header_size, buffer);
+    ubuf_block_unmap(header, 0);
+
+    struct ubuf *payload = uref_detach_ubuf(uref);
+    if (header_size < block_size) {
+        if (unlikely(!ubase_check(ubuf_block_resize(payload, header_size,
+                                                    -1)))) {
+            ubuf_free(payload);
+            ubuf_free(header);
+            return UBASE_ERR_INVALID;
+        }
+        ubuf_block_append(header, payload);
+    } else
+        ubuf_free(payload);
+    uref_attach_ubuf(uref, header);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This forwards a payload packet, rewriting its header.
+ *
+ * @param upipe description structure of the pipe
+ * @param pid_s input PID
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_ts_remux_input_es(struct upipe *upipe,
+                                    struct upipe_ts_remux_pid *pid_s,
+                                    struct uref *uref,
+                                    struct upump **upump_p)
+{
+    struct upipe_ts_remux *upipe_ts_remux = upipe_ts_remux_from_upipe(upipe);
+    size_t block_size;
+    if (unlikely(!ubase_check(uref_block_size(uref, &block_size)) ||
+                 block_size < TS_SIZE)) {
+        uref_free(uref);
+        return;
+    }
+
+    uint8_t *ts;
+    int size = -1;
+    int err = uref_block_write(uref, 0, &size, &ts);
+    if (ubase_check(err) && size < TS_SIZE) {
+        uref_block_unmap(uref, 0);
+        err = UBASE_ERR_INVALID;
+    }
+    if (!ubase_check(err)) {
+        /* the packet is shared, for instance split from a datagram by
+         * ts_check or duplicated, or segmented: only copy the header */
+        uint8_t header[TS_HEADER_SIZE + 1];
+        uref_block_extract(uref, 0, TS_HEADER_SIZE + 1, header);
+        size_t header_size = TS_HEADER_SIZE;
+        if (pid_s->pcr_refs && upipe_ts_remux->restamp &&
+            ts_has_adaptation(header))
+            header_size += 1 + header[TS_HEADER_SIZE];
+        if (header_size > TS_SIZE)
+            header_size = TS_SIZE;
+
+        size = -1;
+        if (unlikely(!ubase_check(upipe_ts_remux_splice(uref, header_size,
+                                                         block_size)) ||
+                     !ubase_check(uref_block_write(uref, 0, &size, &ts)))) {
+            uref_free(uref);
+            upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+            return;
+        }
+    }
+
+    uint8_t cc = ts_get_cc(ts);
+    if (ts_has_payload(ts)) {
+        /* duplicate packets keep their duplicate counter */
+        if (pid_s->last_cc == -1 || !ts_check_duplicate(cc, pid_s->last_cc))
+            pid_s->cc = (pid_s->cc + 1) & 0xf;
+        pid_s->last_cc = cc;
+    }
+    ts_set_cc(ts, pid_s->cc);
+    ts_set_pid(ts, pid_s->out_pid);
+
+    uint64_t cr_sys;
+    if (unlikely(pid_s->pcr_refs && upipe_ts_remux->restamp &&
+                 ts_has_adaptation(ts) &&
+                 ts[TS_HEADER_SIZE] + TS_HEADER_SIZE + 1 >=
+                     TS_HEADER_SIZE_PCR &&
+                 tsaf_has_pcr(ts) &&
+                 ubase_check(uref_clock_get_cr_sys(uref, &cr_sys)))) {
+        int64_t pcr = tsaf_get_pcr(ts) * 300 + tsaf_get_pcrext(ts);
+        int64_t now = cr_sys / (UCLOCK_FREQ / 27000000);
+        int64_t offset = pcr - now;
+        if (!pid_s->pcr_valid || tsaf_has_discontinuity(ts)) {
+            pid_s->pcr_offset = offset;
+            pid_s->pcr_valid = true;
+        } else {
+            /* follow the drift of the input clock, not its jitter */
+            int64_t diff = offset - pid_s->pcr_offset;
+            if (diff > (int64_t)PCR_MAX / 2)
+                diff -= PCR_MAX;
+            else if (diff < -(int64_t)PCR_MAX / 2)
+                diff += PCR_MAX;
+            pid_s->pcr_offset += diff / RESTAMP_SMOOTHING;
+        }
+        pcr = (now + pid_s->pcr_offset) % (int64_t)PCR_MAX;
+        if (pcr < 0)
+            pcr += PCR_MAX;
+        tsaf_set_pcr(ts, pcr / 300);
+        tsaf_set_pcrext(ts, pcr % 300);
+    }
+
+    uref_block_unmap(uref, 0);
+    upipe_ts_remux_output(upipe, uref, upump_p);
+}
+
+/** @internal @This receives TS packets.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure
+ * @param upump_p reference to pump that generated the buffer
+ */
+static void upipe_ts_remux_input(struct upipe *upipe, struct uref *uref,
+                                 struct upump **upump_p)
+{
+    struct upipe_ts_remux *upipe_ts_remux = upipe_ts_remux_from_upipe(upipe);
+    uint8_t buffer[TS_HEADER_SIZE];
+    const uint8_t *ts_header = uref_block_peek(uref, 0, TS_HEADER_SIZE,
+                                               buffer);
+    if (unlikely(ts_header == NULL)) {
+        upipe_warn(upipe, "invalid TS packet");
+        uref_free(uref);
+        return;
+    }
+    uint16_t pid = ts_get_pid(ts_header);
+    uref_block_peek_unmap(uref, 0, buffer, ts_header);
+
+    struct upipe_ts_remux_pid *pid_s = &upipe_ts_remux->pids[pid];
+    switch (pid_s->type) {
+        case UPIPE_TS_REMUX_PID_ES:
+        case UPIPE_TS_REMUX_PID_PASS:
+            if (likely(pid_s->out_pid != NULL_PID)) {
+                upipe_ts_remux_input_es(upipe, pid_s, uref, upump_p);
+                return;
+            }
+            break;
+        case UPIPE_TS_REMUX_PID_PAT:
+        case UPIPE_TS_REMUX_PID_PMT:
+        case UPIPE_TS_REMUX_PID_SDT:
+        case UPIPE_TS_REMUX_PID_EIT:
+        case UPIPE_TS_REMUX_PID_CAT:
+            upipe_ts_remux_input_psi(upipe, pid_s, uref, upump_p);
+            return;
+        default:
+            break;
+    }
+    uref_free(uref);
+}
+
+/** @internal @This sets the input flow definition.
+ *
+ * @param upipe description structure of the pipe
+ * @param flow_def flow definition packet
+ * @return an error code
+ */
+static int upipe_ts_remux_set_flow_def(struct upipe *upipe,
+                                       struct uref *flow_def)
+{
+    if (flow_def == NULL)
+        return UBASE_ERR_INVALID;
+    UBASE_RETURN(uref_flow_match_def(flow_def, EXPECTED_FLOW_DEF))
+    struct uref *flow_def_dup;
+    if ((flow_def_dup = uref_dup(flow_def)) == NULL)
+        return UBASE_ERR_ALLOC;
+    upipe_ts_remux_store_flow_def(upipe, flow_def_dup);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This selects or deselects a service.
+ *
+ * @param upipe description structure of the pipe
+ * @param sid service ID
+ * @param select true to select the service
+ * @return an error code
+ */
+static int upipe_ts_remux_select(struct upipe *upipe, unsigned int sid,
+                                 bool select)
+{
+    struct upipe_ts_remux *upipe_ts_remux = upipe_ts_remux_from_upipe(upipe);
+    if (!sid || sid > UINT16_MAX)
+        return UBASE_ERR_INVALID;
+
+    uint8_t mask = 1 << (sid % 8);
+    bool selected = upipe_ts_remux->services[sid / 8] & mask;
+    if (selected == select)
+        return UBASE_ERR_NONE;
+
+    if (select) {
+        upipe_ts_remux->services[sid / 8] |= mask;
+        upipe_ts_remux->nb_services++;
+    } else {
+        upipe_ts_remux->services[sid / 8] &= ~mask;
+        upipe_ts_remux->nb_services--;
+    }
+    upipe_dbg_va(upipe, "%s service %u", select ? "selecting" : "deselecting",
+                 sid);
+    upipe_ts_remux_reset(upipe);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This sets the output PID of an input PID.
+ *
+ * @param upipe description structure of the pipe
+ * @param pid input PID
+ * @param out_pid output PID
+ * @return an error code
+ */
+static int upipe_ts_remux_set_pid_map(struct upipe *upipe, unsigned int pid,
+                                      unsigned int out_pid)
+{
+    struct upipe_ts_remux *upipe_ts_remux = upipe_ts_remux_from_upipe(upipe);
+    if (pid >= NULL_PID || out_pid > NULL_PID)
+        return UBASE_ERR_INVALID;
+
+    struct upipe_ts_remux_pid *pid_s = &upipe_ts_remux->pids[pid];
+    if (pid_s->out_pid == out_pid)
+        return UBASE_ERR_NONE;
+    if (out_pid != NULL_PID) {
+        /* PIDs that are not remapped only conflict once forwarded */
+        for (unsigned int i = 0; i < MAX_PIDS; i++) {
+            if (i != pid && i != upipe_ts_remux->pids[i].out_pid &&
+                upipe_ts_remux->pids[i].out_pid == out_pid) {
+                upipe_warn_va(upipe, "PID %u is already mapped to %u", i,
+                              out_pid);
+                return UBASE_ERR_INVALID;
+            }
+        }
+    }
+    upipe_dbg_va(upipe, "mapping PID %u to %u", pid, out_pid);
+    pid_s->out_pid = out_pid;
+    upipe_ts_remux_reset(upipe);
+    return UBASE_ERR_NONE;
+}
+
+/** @internal @This processes control commands on a ts_remux pipe.
+ *
+ * @param upipe description structure of the pipe
+ * @param command type of command to process
+ * @param args arguments of the command
+ * @return an error code
+ */
+static int upipe_ts_remux_control(struct upipe *upipe, int command,
+                                  va_list args)
+{
+    struct upipe_ts_remux *upipe_ts_remux = upipe_ts_remux_from_upipe(upipe);
+    UBASE_HANDLED_RETURN(upipe_ts_remux_control_output(upipe, command, args));
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            return upipe_ts_remux_set_flow_def(upipe, flow_def);
+        }
+
+        case UPIPE_TS_REMUX_ADD_SERVICE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_REMUX_SIGNATURE)
+            unsigned int sid = va_arg(args, unsigned int);
+            return upipe_ts_remux_select(upipe, sid, true);
+        }
+        case UPIPE_TS_REMUX_DEL_SERVICE: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_REMUX_SIGNATURE)
+            unsigned int sid = va_arg(args, unsigned int);
+            return upipe_ts_remux_select(upipe, sid, false);
+        }
+        case UPIPE_TS_REMUX_GET_PID_MAP: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_REMUX_SIGNATURE)
+            unsigned int pid = va_arg(args, unsigned int);
+            unsigned int *out_pid_p = va_arg(args, unsigned int *);
+            if (pid >= MAX_PIDS)
+                return UBASE_ERR_INVALID;
+            *out_pid_p = upipe_ts_remux->pids[pid].out_pid;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_TS_REMUX_SET_PID_MAP: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_REMUX_SIGNATURE)
+            unsigned int pid = va_arg(args, unsigned int);
+            unsigned int out_pid = va_arg(args, unsigned int);
+            return upipe_ts_remux_set_pid_map(upipe, pid, out_pid);
+        }
+        case UPIPE_TS_REMUX_GET_TSID: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_REMUX_SIGNATURE)
+            int *tsid_p = va_arg(args, int *);
+            *tsid_p = upipe_ts_remux->tsid;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_TS_REMUX_SET_TSID: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_REMUX_SIGNATURE)
+            int tsid = va_arg(args, int);
+            if (tsid > UINT16_MAX)
+                return UBASE_ERR_INVALID;
+            upipe_ts_remux->tsid = tsid < 0 ? -1 : tsid;
+            upipe_ts_remux->generation++;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_TS_REMUX_GET_RESTAMP: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_REMUX_SIGNATURE)
+            int *restamp_p = va_arg(args, int *);
+            *restamp_p = upipe_ts_remux->restamp ? 1 : 0;
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_TS_REMUX_SET_RESTAMP: {
+            UBASE_SIGNATURE_CHECK(args, UPIPE_TS_REMUX_SIGNATURE)
+            upipe_ts_remux->restamp = va_arg(args, int) != 0;
+            for (unsigned int pid = 0; pid < MAX_PIDS; pid++)
+                upipe_ts_remux->pids[pid].pcr_valid = false;
+            return UBASE_ERR_NONE;
+        }
+
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** @This frees a upipe.
+ *
+ * @param upipe description structure of the pipe
+ */
+static void upipe_ts_remux_free(struct upipe *upipe)
+{
+    struct upipe_ts_remux *upipe_ts_remux = upipe_ts_remux_from_upipe(upipe);
+    upipe_throw_dead(upipe);
+
+    for (unsigned int pid = 0; pid < MAX_PIDS; pid++)
+        free(upipe_ts_remux->pids[pid].psi);
+    free(upipe_ts_remux->pids);
+    upipe_ts_remux_clean_output(upipe);
+    upipe_ts_remux_clean_urefcount(upipe);
+    upipe_ts_remux_free_void(upipe);
+}
+
+/** module manager static descriptor */
+static struct upipe_mgr upipe_ts_remux_mgr = {
+    .refcount = NULL,
+    .signature = UPIPE_TS_REMUX_SIGNATURE,
+
+    .upipe_alloc = upipe_ts_remux_alloc,
+    .upipe_input = upipe_ts_remux_input,
+    .upipe_control = upipe_ts_remux_control,
+
+    .upipe_mgr_control = NULL
+};
+
+/** @This returns the management structure for all ts_remux pipes.
+ *
+ * @return pointer to manager
+ */
+struct upipe_mgr *upipe_ts_remux_mgr_alloc(void)
+{
+    return &upipe_ts_remux_mgr;
+}
@@ -43,6 +43,7 @@
 #include <upipe/upipe_helper_ubuf_mgr.h>
 #include <upipe/upipe_helper_output.h>
 #include <upipe/upipe_helper_input.h>
+#include <upipe/upipe_helper_ujob_mgr.h>
 
 #include <stdlib.h>
 #include <stdbool.h>
@@ -97,6 +98,9 @@ struct upipe_v210dec {
     /** list of blockers (used during udeal) */
     struct uchain blockers;
 
+    /** ujob manager to unpack bands of lines in parallel */
+    struct ujob_mgr *ujob_mgr;
+
     /** output type **/
     enum v210dec_output_type output_type;
 
@@ -128,6 +132,7 @@ UPIPE_HELPER_UBUF_MGR(upipe_v210dec, ubuf_mgr, flow_format, ubuf_mgr_request,
                       upipe_v210dec_register_output_request,
                       upipe_v210dec_unregister_output_request)
 UPIPE_HELPER_INPUT(upipe_v210dec, urefs, nb_urefs, max_urefs, blockers, upipe_v210dec_handle)
+UPIPE_HELPER_UJOB_MGR(upipe_v210dec, ujob_mgr)
 
 // TODO: handle endianness
 
@@ -191,89 +196,62 @@ static void v210dec_setup_asm(struct upipe *upipe, bool assembly)
 #endif
 }
 
-/** @internal @This handles data.
- *
- * @param upipe description structure of the pipe
- * @param uref uref structure describing the picture
- * @param upump_p reference to pump that generated the buffer
- * @return false if the input must be blocked
- */
-static bool upipe_v210dec_handle(struct upipe *upipe, struct uref *uref,
-                             struct upump **upump_p)
-{
-    struct upipe_v210dec *v210dec = upipe_v210dec_from_upipe(upipe);
-    const char *def;
-    if (unlikely(ubase_check(uref_flow_get_def(uref, &def)))) {
-        upipe_v210dec_store_flow_def(upipe, NULL);
-        upipe_v210dec_require_ubuf_mgr(upipe, uref);
-        return true;
-    }
-
-    if (v210dec->flow_def == NULL)
-        return false;
-
-    size_t input_hsize, input_vsize;
-    if (!ubase_check(uref_pic_size(uref, &input_hsize, &input_vsize, NULL))) {
-        upipe_warn(upipe, "invalid buffer received");
-        uref_free(uref);
-        return true;
-    }
-
+/** @internal @This is the context of a picture being unpacked. */
+struct upipe_v210dec_frame {
+    /** private structure of the pipe */
+    struct upipe_v210dec *v210dec;
+    /** mapped input plane */
     const uint8_t *input_plane;
+    /** stride of the input plane */
     size_t input_stride;
-    if (unlikely(!ubase_check(uref_pic_plane_read(uref, v210_chroma_str,
-                        0, 0, -1, -1, &input_plane)) ||
-                 !ubase_check(uref_pic_plane_size(uref, v210_chroma_str,
-                      &input_stride, 0, 0, 0)))) {
-        upipe_warn(upipe, "invalid buffer received");
-        uref_free(uref);
-        return true;
-    }
-
-    uint64_t output_hsize;
-    if (unlikely(!ubase_check(uref_pic_flow_get_hsize(v210dec->flow_def, &output_hsize)))) {
-        upipe_warn(upipe, "could not find output picture size");
-        uref_free(uref);
-        return true;
-    }
-
+    /** output picture width */
+    size_t output_hsize;
+    /** picture height */
+    size_t vsize;
+    /** mapped output planes */
     uint8_t *output_planes[3];
+    /** strides of the output planes */
     size_t output_strides[3];
-    struct ubuf *ubuf = ubuf_pic_alloc(v210dec->ubuf_mgr, output_hsize, input_vsize);
-    if (unlikely(!ubuf)) {
-        // TODO free allocated memory
-        uref_free(uref);
-        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
-        return true;
-    }
-
-    for (int i = 0; i < 3; i++) {
-        const char *chroma = v210dec->output_chroma_map[i];
+};
 
-        if (unlikely(!ubase_check(ubuf_pic_plane_write(ubuf, chroma,
-                            0, 0, -1, -1,
-                            &output_planes[i])) ||
-                     !ubase_check(ubuf_pic_plane_size(ubuf, chroma,
-                             &output_strides[i],
-                             0, 0, 0)))) {
-            // TODO free allocated memory`
-            upipe_warn(upipe, "invalid buffer received");
-            ubuf_free(ubuf);
-            uref_free(uref);
-            return true;
-        }
-    }
+/** @internal @This unpacks a band of lines.
+ *
+ * The vector kernels store whole registers past the end of the line, which
+ * would overwrite the first line of the next band when the planes have no
+ * padding, so the last line of every band but the final one is unpacked
+ * with the C kernels.
+ *
+ * @param opaque pointer to struct upipe_v210dec_frame
+ * @param line first line of the band
+ * @param lines number of lines in the band
+ */
+static void upipe_v210dec_unpack_band(void *opaque, size_t line, size_t lines)
+{
+    struct upipe_v210dec_frame *frame = opaque;
+    struct upipe_v210dec *v210dec = frame->v210dec;
+    size_t input_stride = frame->input_stride;
+    size_t *output_strides = frame->output_strides;
+    size_t output_hsize = frame->output_hsize;
+    const uint8_t *input_plane = frame->input_plane + line * input_stride;
+    uint8_t *output_planes[3];
+    for (int i = 0; i < 3; i++)
+        output_planes[i] = frame->output_planes[i] + line * output_strides[i];
+    /* line unpacked with the C kernels, or lines if there is none */
+    size_t exact = line + lines < frame->vsize ? lines - 1 : lines;
 
     switch (v210dec->output_type) {
         case V2D_OUTPUT_PLANAR_8: {
-            for (int h = 0; h < input_vsize; h++) {
+            for (int h = 0; h < lines; h++) {
                 uint8_t *y = output_planes[0];
                 uint8_t *u = output_planes[1];
                 uint8_t *v = output_planes[2];
                 const uint32_t *src = (uint32_t*)input_plane;
 
                 int w = (output_hsize / 6) * 6;
-                v210dec->v210_to_planar_8(src, y, u, v, w);
+                if (h == exact)
+                    upipe_v210_to_planar_8_c(src, y, u, v, w);
+                else
+                    v210dec->v210_to_planar_8(src, y, u, v, w);
 
                 y += w;
                 u += w >> 1;
@@ -303,14 +281,17 @@ static bool upipe_v210dec_handle(struct upipe *upipe, struct uref *uref,
         } break;
 
         case V2D_OUTPUT_PLANAR_10: {
-            for (int h = 0; h < input_vsize; h++) {
+            for (int h = 0; h < lines; h++) {
                 uint16_t *y = (uint16_t*)output_planes[0];
                 uint16_t *u = (uint16_t*)output_planes[1];
                 uint16_t *v = (uint16_t*)output_planes[2];
                 const uint32_t *src = (uint32_t*)input_plane;
 
                 int w = (output_hsize / 6) * 6;
-                v210dec->v210_to_planar_10(src, y, u, v, w);
+                if (h == exact)
+                    upipe_v210_to_planar_10_c(src, y, u, v, w);
+                else
+                    v210dec->v210_to_planar_10(src, y, u, v, w);
 
                 y += w;
                 u += w >> 1;
@@ -343,6 +324,90 @@ static bool upipe_v210dec_handle(struct upipe *upipe, struct uref *uref,
         default:
             assert(0);
     }
+}
+
+/** @internal @This handles data.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref structure describing the picture
+ * @param upump_p reference to pump that generated the buffer
+ * @return false if the input must be blocked
+ */
+static bool upipe_v210dec_handle(struct upipe *upipe, struct uref *uref,
+                             struct upump **upump_p)
+{
+    struct upipe_v210dec *v210dec = upipe_v210dec_from_upipe(upipe);
+    const char *def;
+    if (unlikely(ubase_check(uref_flow_get_def(uref, &def)))) {
+        upipe_v210dec_store_flow_def(upipe, NULL);
+        upipe_v210dec_check_ujob_mgr(upipe);
+        upipe_v210dec_require_ubuf_mgr(upipe, uref);
+        return true;
+    }
+
+    if (v210dec->flow_def == NULL)
+        return false;
+
+    size_t input_hsize, input_vsize;
+    if (!ubase_check(uref_pic_size(uref, &input_hsize, &input_vsize, NULL))) {
+        upipe_warn(upipe, "invalid buffer received");
+        uref_free(uref);
+        return true;
+    }
+
+    const uint8_t *input_plane;
+    size_t input_stride;
+    if (unlikely(!ubase_check(uref_pic_plane_read(uref, v210_chroma_str,
+                        0, 0, -1, -1, &input_plane)) ||
+                 !ubase_check(uref_pic_plane_size(uref, v210_chroma_str,
+                      &input_stride, 0, 0, 0)))) {
+        upipe_warn(upipe, "invalid buffer received");
+        uref_free(uref);
+        return true;
+    }
+
+    uint64_t output_hsize;
+    if (unlikely(!ubase_check(uref_pic_flow_get_hsize(v210dec->flow_def, &output_hsize)))) {
+        upipe_warn(upipe, "could not find output picture size");
+        uref_free(uref);
+        return true;
+    }
+
+    struct upipe_v210dec_frame frame;
+    uint8_t **output_planes = frame.output_planes;
+    size_t *output_strides = frame.output_strides;
+    frame.v210dec = v210dec;
+    struct ubuf *ubuf = ubuf_pic_alloc(v210dec->ubuf_mgr, output_hsize, input_vsize);
+    if (unlikely(!ubuf)) {
+        // TODO free allocated memory
+        uref_free(uref);
+        upipe_throw_fatal(upipe, UBASE_ERR_ALLOC);
+        return true;
+    }
+
+    for (int i = 0; i < 3; i++) {
+        const char *chroma = v210dec->output_chroma_map[i];
+
+        if (unlikely(!ubase_check(ubuf_pic_plane_write(ubuf, chroma,
+                            0, 0, -1, -1,
+                            &output_planes[i])) ||
+                     !ubase_check(ubuf_pic_plane_size(ubuf, chroma,
+                             &output_strides[i],
+                             0, 0, 0)))) {
+            // TODO free allocated memory`
+            upipe_warn(upipe, "invalid buffer received");
+            ubuf_free(ubuf);
+            uref_free(uref);
+            return true;
+        }
+    }
+
+    frame.input_plane = input_plane;
+    frame.input_stride = input_stride;
+    frame.output_hsize = output_hsize;
+    frame.vsize = input_vsize;
+    upipe_v210dec_run_bands(upipe, input_vsize, 1, upipe_v210dec_unpack_band,
+                            &frame);
 
     uref_pic_plane_unmap(uref, v210_chroma_str, 0, 0, -1, -1);
     for (int i = 0; i < 3; i++)
@@ -616,6 +681,7 @@ static struct upipe *upipe_v210dec_alloc(struct upipe_mgr *manager,
     upipe_v210dec_init_ubuf_mgr(upipe);
     upipe_v210dec_init_output(upipe);
     upipe_v210dec_init_input(upipe);
+    upipe_v210dec_init_ujob_mgr(upipe);
 
     uref_free(flow_def);
     upipe_throw_ready(upipe);
@@ -630,6 +696,7 @@ static void upipe_v210dec_free(struct upipe *upipe)
 {
     upipe_throw_dead(upipe);
     upipe_v210dec_clean_input(upipe);
+    upipe_v210dec_clean_ujob_mgr(upipe);
     upipe_v210dec_clean_output(upipe);
     upipe_v210dec_clean_ubuf_mgr(upipe);
     upipe_v210dec_clean_urefcount(upipe);
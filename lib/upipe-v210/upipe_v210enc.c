@@ -43,6 +43,7 @@
 #include <upipe/upipe_helper_ubuf_mgr.h>
 #include <upipe/upipe_helper_output.h>
 #include <upipe/upipe_helper_input.h>
+#include <upipe/upipe_helper_ujob_mgr.h>
 
 #include <stdlib.h>
 #include <stdbool.h>
@@ -99,6 +100,9 @@ struct upipe_v210enc {
     /** list of blockers (used during udeal) */
     struct uchain blockers;
 
+    /** ujob manager to pack bands of lines in parallel */
+    struct ujob_mgr *ujob_mgr;
+
     /** input bit depth **/
     int input_bit_depth;
 
@@ -131,6 +135,7 @@ UPIPE_HELPER_UBUF_MGR(upipe_v210enc, ubuf_mgr, flow_format, ubuf_mgr_request,
                       upipe_v210enc_register_output_request,
                       upipe_v210enc_unregister_output_request)
 UPIPE_HELPER_INPUT(upipe_v210enc, urefs, nb_urefs, max_urefs, blockers, upipe_v210enc_handle)
+UPIPE_HELPER_UJOB_MGR(upipe_v210enc, ujob_mgr)
 
 #define CLIP(v) ubase_clip(v, 4, 1019)
 #define CLIP8(v) ubase_clip(v, 1, 254)
@@ -161,6 +166,129 @@ static inline void wl32(uint8_t *dst, uint32_t u)
         dst += 4;                       \
     } while (0)
 
+/** @internal @This is the context of a picture being packed. */
+struct upipe_v210enc_frame {
+    /** private structure of the pipe */
+    struct upipe_v210enc *upipe_v210enc;
+    /** mapped input planes */
+    const uint8_t *input_planes[UPIPE_V210_MAX_PLANES + 1];
+    /** strides of the input planes */
+    int input_strides[UPIPE_V210_MAX_PLANES + 1];
+    /** input picture width */
+    size_t input_hsize;
+    /** mapped output plane */
+    uint8_t *output_plane;
+    /** stride of the output plane */
+    size_t output_stride;
+};
+
+/** @internal @This packs a band of lines.
+ *
+ * @param opaque pointer to struct upipe_v210enc_frame
+ * @param line first line of the band
+ * @param lines number of lines in the band
+ */
+static void upipe_v210enc_pack_band(void *opaque, size_t line, size_t lines)
+{
+    struct upipe_v210enc_frame *frame = opaque;
+    struct upipe_v210enc *upipe_v210enc = frame->upipe_v210enc;
+    const uint8_t * const *input_planes = frame->input_planes;
+    const int *input_strides = frame->input_strides;
+    size_t input_hsize = frame->input_hsize;
+    size_t stride = frame->output_stride;
+    int line_padding = stride - ((input_hsize * 8 + 11) / 12) * 4;
+    uint8_t *dst = frame->output_plane + line * stride;
+    int h, w;
+    if (upipe_v210enc->input_bit_depth == 10) {
+        const uint16_t *y = (const uint16_t *)
+            (input_planes[0] + line * input_strides[0]);
+        const uint16_t *u = (const uint16_t *)
+            (input_planes[1] + line * input_strides[1]);
+        const uint16_t *v = (const uint16_t *)
+            (input_planes[2] + line * input_strides[2]);
+        for (h = 0; h < lines; h++) {
+            uint32_t val = 0;
+            w = (input_hsize / 6) * 6;
+            upipe_v210enc->pack_line_10(y, u, v, dst, w);
+
+            y += w;
+            u += w >> 1;
+            v += w >> 1;
+            dst += (w / 6) * 16;
+            if (w < input_hsize - 1) {
+                WRITE_PIXELS(u, y, v);
+
+                val = CLIP(*y++);
+                if (w == input_hsize - 2) {
+                    wl32(dst, val);
+                    dst += 4;
+                }
+            }
+            if (w < input_hsize - 3) {
+                val |= (CLIP(*u++) << 10) | (CLIP(*y++) << 20);
+                wl32(dst, val);
+                dst += 4;
+
+                val = CLIP(*v++) | (CLIP(*y++) << 10);
+                wl32(dst, val);
+                dst += 4;
+            }
+
+            memset(dst, 0, line_padding);
+            dst += line_padding;
+            y += input_strides[0] / 2 - input_hsize;
+            u += input_strides[1] / 2 - input_hsize / 2;
+            v += input_strides[2] / 2 - input_hsize / 2;
+        }
+    }
+    else {
+        const uint8_t *y = input_planes[0] + line * input_strides[0];
+        const uint8_t *u = input_planes[1] + line * input_strides[1];
+        const uint8_t *v = input_planes[2] + line * input_strides[2];
+        for (h = 0; h < lines; h++) {
+            uint32_t val = 0;
+            w = (input_hsize / 12) * 12;
+            upipe_v210enc->pack_line_8(y, u, v, dst, w);
+
+            y += w;
+            u += w >> 1;
+            v += w >> 1;
+            dst += (w / 12) * 32;
+
+            for (; w < input_hsize - 5; w += 6) {
+                WRITE_PIXELS8(u, y, v);
+                WRITE_PIXELS8(y, u, y);
+                WRITE_PIXELS8(v, y, u);
+                WRITE_PIXELS8(y, v, y);
+            }
+            if (w < input_hsize - 1) {
+                WRITE_PIXELS8(u, y, v);
+
+                val = CLIP8(*y++) << 2;
+                if (w == input_hsize - 2) {
+                    wl32(dst, val);
+                    dst += 4;
+                }
+            }
+            if (w < input_hsize - 3) {
+                val |= (CLIP8(*u++) << 12) | (CLIP8(*y++) << 22);
+                wl32(dst, val);
+                dst += 4;
+
+                val = (CLIP8(*v++) << 2) | (CLIP8(*y++) << 12);
+                wl32(dst, val);
+                dst += 4;
+            }
+            memset(dst, 0, line_padding);
+            dst += line_padding;
+
+            y += input_strides[0] - input_hsize;
+            u += input_strides[1] - input_hsize / 2;
+            v += input_strides[2] - input_hsize / 2;
+        }
+    }
+}
+
 /** @internal @This handles data.
  *
  * @param upipe description structure of the pipe
@@ -175,6 +303,7 @@ static bool upipe_v210enc_handle(struct upipe *upipe, struct uref *uref,
     const char *def;
     if (unlikely(ubase_check(uref_flow_get_def(uref, &def)))) {
         upipe_v210enc_store_flow_def(upipe, NULL);
+        upipe_v210enc_check_ujob_mgr(upipe);
         upipe_v210enc_require_ubuf_mgr(upipe, uref);
         return true;
     }
@@ -203,8 +332,10 @@ static bool upipe_v210enc_handle(struct upipe *upipe, struct uref *uref,
     }
 
     /* map input */
-    const uint8_t *input_planes[UPIPE_V210_MAX_PLANES + 1];
-    int input_strides[UPIPE_V210_MAX_PLANES + 1];
+    struct upipe_v210enc_frame frame;
+    const uint8_t **input_planes = frame.input_planes;
+    int *input_strides = frame.input_strides;
+    frame.upipe_v210enc = upipe_v210enc;
     int i;
     for (i = 0; i < UPIPE_V210_MAX_PLANES &&
                 upipe_v210enc->input_chroma_map[i] != NULL; i++) {
@@ -241,11 +372,10 @@ static bool upipe_v210enc_handle(struct upipe *upipe, struct uref *uref,
     }
 
     /* map output */
-    uint8_t *output_plane;
     size_t stride;
     if (unlikely(!ubase_check(ubuf_pic_plane_write(ubuf,
                                        upipe_v210enc->output_chroma_map,
-                                       0, 0, -1, -1, &output_plane)) ||
+                                       0, 0, -1, -1, &frame.output_plane)) ||
                  !ubase_check(ubuf_pic_plane_size(ubuf,
                                        upipe_v210enc->output_chroma_map,
                                        &stride, NULL, NULL, NULL)))) {
@@ -256,94 +386,10 @@ static bool upipe_v210enc_handle(struct upipe *upipe, struct uref *uref,
     }
 
     /* Do v210 packing */
-    int line_padding = stride - ((input_hsize * 8 + 11) / 12) * 4;
-    uint8_t *dst = output_plane;
-    int h, w;
-    if (upipe_v210enc->input_bit_depth == 10) {
-        const uint16_t *y = (const uint16_t *)input_planes[0];
-        const uint16_t *u = (const uint16_t *)input_planes[1];
-        const uint16_t *v = (const uint16_t *)input_planes[2];
-        for (h = 0; h < input_vsize; h++) {
-            uint32_t val = 0;
-            w = (input_hsize / 6) * 6;
-            upipe_v210enc->pack_line_10(y, u, v, dst, w);
-
-            y += w;
-            u += w >> 1;
-            v += w >> 1;
-            dst += (w / 6) * 16;
-            if (w < input_hsize - 1) {
-                WRITE_PIXELS(u, y, v);
-
-                val = CLIP(*y++);
-                if (w == input_hsize - 2) {
-                    wl32(dst, val);
-                    dst += 4;
-                }
-            }
-            if (w < input_hsize - 3) {
-                val |= (CLIP(*u++) << 10) | (CLIP(*y++) << 20);
-                wl32(dst, val);
-                dst += 4;
-
-                val = CLIP(*v++) | (CLIP(*y++) << 10);
-                wl32(dst, val);
-                dst += 4;
-            }
-
-            memset(dst, 0, line_padding);
-            dst += line_padding;
-            y += input_strides[0] / 2 - input_hsize;
-            u += input_strides[1] / 2 - input_hsize / 2;
-            v += input_strides[2] / 2 - input_hsize / 2;
-        }
-    }
-    else {
-        const uint8_t *y = input_planes[0];
-        const uint8_t *u = input_planes[1];
-        const uint8_t *v = input_planes[2];
-        for (h = 0; h < input_vsize; h++) {
-            uint32_t val = 0;
-            w = (input_hsize / 12) * 12;
-            upipe_v210enc->pack_line_8(y, u, v, dst, w);
-
-            y += w;
-            u += w >> 1;
-            v += w >> 1;
-            dst += (w / 12) * 32;
-
-            for (; w < input_hsize - 5; w += 6) {
-                WRITE_PIXELS8(u, y, v);
-                WRITE_PIXELS8(y, u, y);
-                WRITE_PIXELS8(v, y, u);
-                WRITE_PIXELS8(y, v, y);
-            }
-            if (w < input_hsize - 1) {
-                WRITE_PIXELS8(u, y, v);
-
-                val = CLIP8(*y++) << 2;
-                if (w == input_hsize - 2) {
-                    wl32(dst, val);
-                    dst += 4;
-                }
-            }
-            if (w < input_hsize - 3) {
-                val |= (CLIP8(*u++) << 12) | (CLIP8(*y++) << 22);
-                wl32(dst, val);
-                dst += 4;
-
-                val = (CLIP8(*v++) << 2) | (CLIP8(*y++) << 12);
-                wl32(dst, val);
-                dst += 4;
-            }
-            memset(dst, 0, line_padding);
-            dst += line_padding;
-
-            y += input_strides[0] - input_hsize;
-            u += input_strides[1] - input_hsize / 2;
-            v += input_strides[2] - input_hsize / 2;
-        }
-    }
+    frame.input_hsize = input_hsize;
+    frame.output_stride = stride;
+    upipe_v210enc_run_bands(upipe, input_vsize, 1, upipe_v210enc_pack_band,
+                            &frame);
 
     /* unmap pictures */
     for (i = 0; i < UPIPE_V210_MAX_PLANES &&
@@ -602,6 +648,7 @@ static struct upipe *upipe_v210enc_alloc(struct upipe_mgr *mgr,
     upipe_v210enc_init_ubuf_mgr(upipe);
     upipe_v210enc_init_output(upipe);
     upipe_v210enc_init_input(upipe);
+    upipe_v210enc_init_ujob_mgr(upipe);
 
     upipe_throw_ready(upipe);
     return upipe;
@@ -615,6 +662,7 @@ static void upipe_v210enc_free(struct upipe *upipe)
 {
     upipe_throw_dead(upipe);
     upipe_v210enc_clean_input(upipe);
+    upipe_v210enc_clean_ujob_mgr(upipe);
     upipe_v210enc_clean_output(upipe);
     upipe_v210enc_clean_ubuf_mgr(upipe);
     upipe_v210enc_clean_urefcount(upipe);
@@ -75,6 +75,13 @@
 #define EXPECTED_FLOW "pic."
 #define OUT_FLOW "block.h264.pic."
 #define OUT_FLOW_MPEG2 "block.mpeg2video.pic."
+/** v210 plane, as output by upipe_v210enc */
+#define V210_CHROMA "u10y10v10y10u10y10v10y10u10y10v10y10"
+
+/* 10-bit 4:2:2 input (planar or v210) needs a libx264 encoding in 10 bits */
+#if defined(X264_CSP_V210) && (X264_BIT_DEPTH == 0 || X264_BIT_DEPTH == 10)
+# define UPIPE_X264_HIGH_DEPTH
+#endif
 
 /** @internal upipe_x264 private structure */
 struct upipe_x264 {
@@ -141,6 +148,12 @@ struct upipe_x264 {
     /** list of output requests */
     struct uchain request_list;
 
+    /** x264 colorspace of the input pictures */
+    int input_csp;
+    /** number of planes of the input pictures */
+    int nb_planes;
+    /** chroma of the planes of the input pictures */
+    const char *const *chromas;
     /** input SAR */
     struct urational sar;
     /** input overscan */
@@ -226,6 +239,62 @@ static void upipe_x264_log(void *_upipe, int loglevel,
     free(string);
 }
 
+/** @internal @This checks if a picture format may be fed directly to
+ * x264, and returns the matching x264 colorspace.
+ *
+ * @param flow_def flow definition packet
+ * @param nb_planes_p filled in with the number of planes (may be NULL)
+ * @param chromas_p filled in with the chroma of the planes (may be NULL)
+ * @return x264 colorspace, or X264_CSP_NONE if the format is not supported
+ */
+static int upipe_x264_check_format(struct uref *flow_def, int *nb_planes_p,
+                                   const char *const **chromas_p)
+{
+    static const char *const chromas_8[] = { "y8", "u8", "v8" };
+#ifdef UPIPE_X264_HIGH_DEPTH
+    static const char *const chromas_10[] = { "y10l", "u10l", "v10l" };
+    static const char *const chromas_v210[] = { V210_CHROMA };
+#endif
+    const char *const *chromas;
+    int nb_planes, csp;
+    uint8_t macropixel;
+
+    if (!ubase_check(uref_pic_flow_get_macropixel(flow_def, &macropixel)))
+        return X264_CSP_NONE;
+
+    if (macropixel == 1 &&
+        ubase_check(uref_pic_flow_check_chroma(flow_def, 1, 1, 1, "y8")) &&
+        ubase_check(uref_pic_flow_check_chroma(flow_def, 2, 2, 1, "u8")) &&
+        ubase_check(uref_pic_flow_check_chroma(flow_def, 2, 2, 1, "v8"))) {
+        csp = X264_CSP_I420;
+        chromas = chromas_8;
+        nb_planes = 3;
+#ifdef UPIPE_X264_HIGH_DEPTH
+    } else if (macropixel == 1 &&
+        ubase_check(uref_pic_flow_check_chroma(flow_def, 1, 1, 2, "y10l")) &&
+        ubase_check(uref_pic_flow_check_chroma(flow_def, 2, 1, 2, "u10l")) &&
+        ubase_check(uref_pic_flow_check_chroma(flow_def, 2, 1, 2, "v10l"))) {
+        csp = X264_CSP_I422 | X264_CSP_HIGH_DEPTH;
+        chromas = chromas_10;
+        nb_planes = 3;
+    } else if (macropixel == 6 &&
+        ubase_check(uref_pic_flow_check_chroma(flow_def, 1, 1, 16,
+                                               V210_CHROMA))) {
+        /* x264 unpacks v210 while copying to its internal frame */
+        csp = X264_CSP_V210 | X264_CSP_HIGH_DEPTH;
+        chromas = chromas_v210;
+        nb_planes = 1;
+#endif
+    } else
+        return X264_CSP_NONE;
+
+    if (nb_planes_p != NULL)
+        *nb_planes_p = nb_planes;
+    if (chromas_p != NULL)
+        *chromas_p = chromas;
+    return csp;
+}
+
 /** @internal @This checks whether mpeg2 encoding is enabled
  * @param upipe description structure of the pipe
  * @return true if mpeg2 enabled
@@ -404,6 +473,9 @@ static struct upipe *upipe_x264_alloc(struct upipe_mgr *mgr,
     upipe_x264->flow_def_requested = NULL;
     upipe_x264->headers_requested = false;
     upipe_x264->encaps_requested = UREF_H26X_ENCAPS_ANNEXB;
+    upipe_x264->input_csp = X264_CSP_I420;
+    upipe_x264->nb_planes = 0;
+    upipe_x264->chromas = NULL;
     upipe_x264->sar.num = upipe_x264->sar.den = 1;
     upipe_x264->overscan = 0; /* undef */
     upipe_x264->mpeg2_ar = 1;
@@ -454,6 +526,12 @@ static bool upipe_x264_open(struct upipe *upipe, int width, int height)
     }
     params->i_width = width;
     params->i_height = height;
+    params->i_csp =
+        (upipe_x264->input_csp & X264_CSP_MASK) == X264_CSP_I420 ?
+        X264_CSP_I420 : X264_CSP_I422;
+#if X264_BUILD >= 153
+    params->i_bitdepth = upipe_x264->input_csp & X264_CSP_HIGH_DEPTH ? 10 : 8;
+#endif
     if (!ubase_check(uref_pic_get_progressive(upipe_x264->flow_def_input)))
         params->b_interlaced = true;
 
@@ -781,6 +859,10 @@ static bool upipe_x264_handle(struct upipe *upipe, struct uref *uref,
                 upipe_x264->overscan = overscan ? 2 : 1;
         }
 
+        upipe_x264->input_csp =
+            upipe_x264_check_format(uref, &upipe_x264->nb_planes,
+                                    &upipe_x264->chromas);
+
         uref = upipe_x264_store_flow_def_input(upipe, uref);
         if (uref != NULL) {
             uref_pic_flow_clear_format(uref);
@@ -789,7 +871,7 @@ static bool upipe_x264_handle(struct upipe *upipe, struct uref *uref,
         return true;
     }
 
-    static const char *const chromas[] = {"y8", "u8", "v8"};
+    const char *const *chromas = upipe_x264->chromas;
     size_t width, height;
     x264_picture_t pic;
     x264_nal_t *nals;
@@ -805,7 +887,7 @@ static bool upipe_x264_handle(struct upipe *upipe, struct uref *uref,
 
     if (likely(uref)) {
         pic.opaque = uref;
-        pic.img.i_csp = X264_CSP_I420;
+        pic.img.i_csp = upipe_x264->input_csp;
 
         uref_pic_size(uref, &width, &height, NULL);
 
@@ -878,7 +960,7 @@ static bool upipe_x264_handle(struct upipe *upipe, struct uref *uref,
         }
 
         /* map */
-        for (i = 0; i < 3; i++) {
+        for (i = 0; i < upipe_x264->nb_planes; i++) {
             size_t stride;
             const uint8_t *plane;
             if (unlikely(!ubase_check(uref_pic_plane_size(uref, chromas[i], &stride,
@@ -887,6 +969,8 @@ static bool upipe_x264_handle(struct upipe *upipe, struct uref *uref,
                                               &plane)))) {
                 upipe_err_va(upipe, "Could not read origin chroma %s",
                              chromas[i]);
+                while (--i >= 0)
+                    uref_pic_plane_unmap(uref, chromas[i], 0, 0, -1, -1);
                 uref_free(uref);
                 return true;
             }
@@ -901,7 +985,7 @@ static bool upipe_x264_handle(struct upipe *upipe, struct uref *uref,
                                   &nals, &nals_num, &pic, &pic);
 
         /* unmap */
-        for (i = 0; i < 3; i++) {
+        for (i = 0; i < upipe_x264->nb_planes; i++) {
             uref_pic_plane_unmap(uref, chromas[i], 0, 0, -1, -1);
         }
         ubuf_free(uref_detach_ubuf(uref));
@@ -1030,6 +1114,9 @@ static bool upipe_x264_handle(struct upipe *upipe, struct uref *uref,
     if (pic.b_keyframe) {
         uref_flow_set_random(uref);
     }
+    /* export the quantizer for rate control (statmux) */
+    if (pic.i_qpplus1 > 0)
+        uref_pic_set_qp(uref, pic.i_qpplus1 - 1);
 
     if (upipe_x264->flow_def == NULL)
         upipe_x264_build_flow_def(upipe);
@@ -1128,14 +1215,13 @@ static int upipe_x264_set_flow_def(struct upipe *upipe,
     if (flow_def == NULL)
         return UBASE_ERR_INVALID;
 
-    /* We only accept YUV420P for the moment. */
-    uint8_t macropixel;
-    if (unlikely(!ubase_check(uref_flow_match_def(flow_def, EXPECTED_FLOW)) ||
-                 !ubase_check(uref_pic_flow_get_macropixel(flow_def, &macropixel)) ||
-                 macropixel != 1 ||
-                 !ubase_check(uref_pic_flow_check_chroma(flow_def, 1, 1, 1, "y8")) ||
-                 !ubase_check(uref_pic_flow_check_chroma(flow_def, 2, 2, 1, "u8")) ||
-                 !ubase_check(uref_pic_flow_check_chroma(flow_def, 2, 2, 1, "v8"))))
+    /* We accept YUV420P, and 10-bit 4:2:2 (planar or v210) if libx264
+     * supports it, except in MPEG-2 mode which is 8-bit 4:2:0 only. */
+    if (unlikely(!ubase_check(uref_flow_match_def(flow_def, EXPECTED_FLOW))))
+        return UBASE_ERR_INVALID;
+    int csp = upipe_x264_check_format(flow_def, NULL, NULL);
+    if (unlikely(csp == X264_CSP_NONE ||
+                 (upipe_x264_mpeg2_enabled(upipe) && csp != X264_CSP_I420)))
         return UBASE_ERR_INVALID;
 
     /* Extract relevant attributes to flow def check. */
@@ -1214,12 +1300,19 @@ static int _upipe_x264_provide_flow_format(struct upipe *upipe,
 {
     struct uref *flow_format = uref_dup(request->uref);
     UBASE_ALLOC_RETURN(flow_format);
-    uref_pic_flow_clear_format(flow_format);
-    uref_pic_flow_set_macropixel(flow_format, 1);
-    uref_pic_flow_set_planes(flow_format, 0);
-    uref_pic_flow_add_plane(flow_format, 1, 1, 1, "y8");
-    uref_pic_flow_add_plane(flow_format, 2, 2, 1, "u8");
-    uref_pic_flow_add_plane(flow_format, 2, 2, 1, "v8");
+
+    /* keep the proposed format if x264 can read it directly, so that no
+     * conversion is inserted upstream */
+    int csp = upipe_x264_check_format(flow_format, NULL, NULL);
+    if (csp == X264_CSP_NONE ||
+        (upipe_x264_mpeg2_enabled(upipe) && csp != X264_CSP_I420)) {
+        uref_pic_flow_clear_format(flow_format);
+        uref_pic_flow_set_macropixel(flow_format, 1);
+        uref_pic_flow_set_planes(flow_format, 0);
+        uref_pic_flow_add_plane(flow_format, 1, 1, 1, "y8");
+        uref_pic_flow_add_plane(flow_format, 2, 2, 1, "u8");
+        uref_pic_flow_add_plane(flow_format, 2, 2, 1, "v8");
+    }
     return urequest_provide_flow_format(request, flow_format);
 }
 
@@ -87,6 +87,8 @@ struct ubuf_block_mem_mgr {
     struct upool ubuf_pool;
     /** ubuf shared pool */
     struct upool shared_pool;
+    /** true if new shared buffers are thread-confined */
+    bool confined;
     /** umem allocator */
     struct umem_mgr *umem_mgr;
 
@@ -101,7 +103,8 @@ UBASE_FROM_TO(ubuf_block_mem_mgr, ubuf_mgr, ubuf_mgr, mgr)
 UBASE_FROM_TO(ubuf_block_mem_mgr, urefcount, urefcount, urefcount)
 UBASE_FROM_TO(ubuf_block_mem_mgr, upool, ubuf_pool, ubuf_pool)
 
-UBUF_MEM_MGR_HELPER_POOL(ubuf_block_mem, ubuf_pool, shared_pool, shared)
+UBUF_MEM_MGR_HELPER_POOL(ubuf_block_mem, ubuf_pool, shared_pool, shared,
+                         confined)
 
 /** @This allocates a ubuf, a shared structure and a umem buffer.
  *
@@ -287,6 +290,13 @@ static int ubuf_block_mem_control(struct ubuf *ubuf, int command, va_list args)
             int size = va_arg(args, int);
             return ubuf_block_mem_splice(ubuf, new_ubuf_p, offset, size);
         }
+        case UBUF_UNCONFINE: {
+            struct ubuf_block_mem *block_mem = ubuf_block_mem_from_ubuf(ubuf);
+            ubuf_mem_shared_unconfine(block_mem->shared);
+            struct ubuf_block *block = ubuf_block_from_ubuf(ubuf);
+            return block->next_ubuf != NULL ?
+                   ubuf_unconfine(block->next_ubuf) : UBASE_ERR_NONE;
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -385,6 +395,12 @@ static int ubuf_block_mem_mgr_control(struct ubuf_mgr *mgr,
             ubuf_block_mem_mgr_vacuum_pool(mgr);
             return UBASE_ERR_NONE;
         }
+        case UBUF_MGR_CONFINE: {
+            struct ubuf_block_mem_mgr *block_mem_mgr =
+                ubuf_block_mem_mgr_from_ubuf_mgr(mgr);
+            block_mem_mgr->confined = true;
+            return UBASE_ERR_NONE;
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -450,6 +466,7 @@ struct ubuf_mgr *ubuf_block_mem_mgr_alloc(uint16_t ubuf_pool_depth,
     block_mem_mgr->mgr.ubuf_free = ubuf_block_mem_free;
     block_mem_mgr->mgr.ubuf_mgr_control = ubuf_block_mem_mgr_control;
 
+    block_mem_mgr->confined = false;
     ubuf_block_mem_mgr_init_pool(ubuf_block_mem_mgr_to_ubuf_mgr(block_mem_mgr),
             ubuf_pool_depth, shared_pool_depth, block_mem_mgr->upool_extra,
             ubuf_block_mem_alloc_inner, ubuf_block_mem_free_inner);
@@ -51,6 +51,8 @@ void *ubuf_mem_shared_alloc_inner(struct upool *upool)
     if (unlikely(shared == NULL))
         return NULL;
     uatomic_init(&shared->refcount, 1);
+    shared->confined_refcount = 1;
+    shared->confined = false;
     shared->pool = upool;
     return shared;
 }
@@ -98,6 +98,8 @@ struct ubuf_pic_mem_mgr {
     struct upool ubuf_pool;
     /** ubuf shared pool */
     struct upool shared_pool;
+    /** true if new shared buffers are thread-confined */
+    bool confined;
     /** umem allocator */
     struct umem_mgr *umem_mgr;
 
@@ -112,7 +114,8 @@ UBASE_FROM_TO(ubuf_pic_mem_mgr, ubuf_mgr, ubuf_mgr, common_mgr.mgr)
 UBASE_FROM_TO(ubuf_pic_mem_mgr, urefcount, urefcount, urefcount)
 UBASE_FROM_TO(ubuf_pic_mem_mgr, upool, ubuf_pool, ubuf_pool)
 
-UBUF_MEM_MGR_HELPER_POOL(ubuf_pic_mem, ubuf_pool, shared_pool, shared)
+UBUF_MEM_MGR_HELPER_POOL(ubuf_pic_mem, ubuf_pool, shared_pool, shared,
+                         confined)
 
 /** @This allocates a ubuf, a shared structure and a umem buffer.
  *
@@ -369,6 +372,11 @@ static int ubuf_pic_mem_control(struct ubuf *ubuf, int command, va_list args)
             struct ubuf **even = va_arg(args, struct ubuf **);
             return ubuf_pic_common_split_fields(ubuf, odd, even);
         }
+        case UBUF_UNCONFINE: {
+            struct ubuf_pic_mem *pic_mem = ubuf_pic_mem_from_ubuf(ubuf);
+            ubuf_mem_shared_unconfine(pic_mem->shared);
+            return UBASE_ERR_NONE;
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -515,6 +523,12 @@ static int ubuf_pic_mem_mgr_control(struct ubuf_mgr *mgr,
             ubuf_pic_mem_mgr_vacuum_pool(mgr);
             return UBASE_ERR_NONE;
         }
+        case UBUF_MGR_CONFINE: {
+            struct ubuf_pic_mem_mgr *pic_mgr =
+                ubuf_pic_mem_mgr_from_ubuf_mgr(mgr);
+            pic_mgr->confined = true;
+            return UBASE_ERR_NONE;
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -600,6 +614,7 @@ struct ubuf_mgr *ubuf_pic_mem_mgr_alloc(uint16_t ubuf_pool_depth,
     mgr->ubuf_free = ubuf_pic_mem_free;
     mgr->ubuf_mgr_control = ubuf_pic_mem_mgr_control;
 
+    pic_mgr->confined = false;
     ubuf_pic_mem_mgr_init_pool(ubuf_pic_mem_mgr_to_ubuf_mgr(pic_mgr),
             ubuf_pool_depth, shared_pool_depth, pic_mgr->upool_extra,
             ubuf_pic_mem_alloc_inner, ubuf_pic_mem_free_inner);
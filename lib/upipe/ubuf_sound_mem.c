@@ -80,6 +80,8 @@ struct ubuf_sound_mem_mgr {
     struct upool ubuf_pool;
     /** ubuf shared pool */
     struct upool shared_pool;
+    /** true if new shared buffers are thread-confined */
+    bool confined;
     /** umem allocator */
     struct umem_mgr *umem_mgr;
 
@@ -94,7 +96,8 @@ UBASE_FROM_TO(ubuf_sound_mem_mgr, ubuf_mgr, ubuf_mgr, common_mgr.mgr)
 UBASE_FROM_TO(ubuf_sound_mem_mgr, urefcount, urefcount, urefcount)
 UBASE_FROM_TO(ubuf_sound_mem_mgr, upool, ubuf_pool, ubuf_pool)
 
-UBUF_MEM_MGR_HELPER_POOL(ubuf_sound_mem, ubuf_pool, shared_pool, shared)
+UBUF_MEM_MGR_HELPER_POOL(ubuf_sound_mem, ubuf_pool, shared_pool, shared,
+                         confined)
 
 /** @This allocates a ubuf, a shared structure and a umem buffer.
  *
@@ -303,6 +306,11 @@ static int ubuf_sound_mem_control(struct ubuf *ubuf, int command, va_list args)
             return _ubuf_sound_mem_get_shared(ubuf, channel, shared_p,
                                               offset_p, size_p);
         }
+        case UBUF_UNCONFINE: {
+            struct ubuf_sound_mem *sound_mem = ubuf_sound_mem_from_ubuf(ubuf);
+            ubuf_mem_shared_unconfine(sound_mem->shared);
+            return UBASE_ERR_NONE;
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -432,6 +440,12 @@ static int ubuf_sound_mem_mgr_control(struct ubuf_mgr *mgr,
             ubuf_sound_mem_mgr_vacuum_pool(mgr);
             return UBASE_ERR_NONE;
         }
+        case UBUF_MGR_CONFINE: {
+            struct ubuf_sound_mem_mgr *sound_mgr =
+                ubuf_sound_mem_mgr_from_ubuf_mgr(mgr);
+            sound_mgr->confined = true;
+            return UBASE_ERR_NONE;
+        }
         default:
             return UBASE_ERR_UNHANDLED;
     }
@@ -493,6 +507,7 @@ struct ubuf_mgr *ubuf_sound_mem_mgr_alloc(uint16_t ubuf_pool_depth,
     mgr->ubuf_free = ubuf_sound_mem_free;
     mgr->ubuf_mgr_control = ubuf_sound_mem_mgr_control;
 
+    sound_mgr->confined = false;
     ubuf_sound_mem_mgr_init_pool(ubuf_sound_mem_mgr_to_ubuf_mgr(sound_mgr),
             ubuf_pool_depth, shared_pool_depth, sound_mgr->upool_extra,
             ubuf_sound_mem_alloc_inner, ubuf_sound_mem_free_inner);
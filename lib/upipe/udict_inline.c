@@ -608,6 +608,18 @@ static void udict_inline_mgr_vacuum(struct udict_mgr *mgr)
     upool_vacuum(&inline_mgr->udict_pool);
 }
 
+/** @internal @This fills the pools of an existing udict manager up to their
+ * configured depth.
+ *
+ * @param mgr pointer to udict manager
+ */
+static void udict_inline_mgr_prealloc(struct udict_mgr *mgr)
+{
+    struct udict_inline_mgr *inline_mgr = udict_inline_mgr_from_udict_mgr(mgr);
+    upool_prealloc(&inline_mgr->udict_pool);
+    umem_mgr_prealloc(inline_mgr->umem_mgr);
+}
+
 /** @This processes control commands on a udict_std_mgr.
  *
  * @param mgr pointer to a udict_mgr structure
@@ -622,6 +634,9 @@ static int udict_inline_mgr_control(struct udict_mgr *mgr,
         case UDICT_MGR_VACUUM:
             udict_inline_mgr_vacuum(mgr);
             return UBASE_ERR_NONE;
+        case UDICT_MGR_PREALLOC:
+            udict_inline_mgr_prealloc(mgr);
+            return UBASE_ERR_NONE;
         default:
             return UBASE_ERR_UNHANDLED;
     }
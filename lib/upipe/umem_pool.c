@@ -28,9 +28,11 @@
 #include <upipe/ulifo.h>
 #include <upipe/umem.h>
 #include <upipe/umem_pool.h>
+#include <upipe/uatomic.h>
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 #include <assert.h>
 
 /** @This defines the private data structures of the umem pool manager. */
@@ -45,6 +47,12 @@ struct umem_pool_mgr {
     size_t pool0_size;
     /** number of pools of buffers */
     size_t nb_pools;
+    /** set to 1 once statistics were retrieved, to start counting */
+    uatomic_uint32_t stats;
+    /** number of allocations served from each pool */
+    uatomic_uint32_t *hits;
+    /** number of allocations forwarded to malloc() for each pool */
+    uatomic_uint32_t *misses;
     /** buffer pools */
     struct ulifo pools[];
 };
@@ -91,8 +99,12 @@ static bool umem_pool_alloc(struct umem_mgr *mgr, struct umem *umem,
     unsigned int pool = umem_pool_find(mgr, size, &real_size);
     uint8_t *buffer = NULL;
 
-    if (likely(pool < pool_mgr->nb_pools))
+    if (likely(pool < pool_mgr->nb_pools)) {
         buffer = ulifo_pop(&pool_mgr->pools[pool], uint8_t *);
+        if (unlikely(uatomic_load(&pool_mgr->stats)))
+            uatomic_fetch_add(buffer != NULL ? &pool_mgr->hits[pool] :
+                              &pool_mgr->misses[pool], 1);
+    }
     if (unlikely(buffer == NULL))
         buffer = malloc(real_size);
     if (unlikely(buffer == NULL))
@@ -165,6 +177,53 @@ static void umem_pool_mgr_vacuum(struct umem_mgr *mgr)
     }
 }
 
+/** @This fills all pools with buffers, written to so that their pages are
+ * mapped.
+ *
+ * @param mgr pointer to umem manager
+ */
+static void umem_pool_mgr_prealloc(struct umem_mgr *mgr)
+{
+    struct umem_pool_mgr *pool_mgr = umem_pool_mgr_from_umem_mgr(mgr);
+
+    for (unsigned int i = 0; i < pool_mgr->nb_pools; i++) {
+        size_t size = pool_mgr->pool0_size << i;
+        for ( ; ; ) {
+            uint8_t *buffer = malloc(size);
+            if (unlikely(buffer == NULL))
+                return;
+            memset(buffer, 0, size);
+            if (!ulifo_push(&pool_mgr->pools[i], buffer)) {
+                free(buffer);
+                break;
+            }
+        }
+    }
+}
+
+/** @This retrieves statistics about a pool. The counters are only
+ * maintained after the first call, so that allocations do not pay for them
+ * when they are not used.
+ *
+ * @param mgr pointer to umem manager
+ * @param index index of the pool
+ * @param stats filled in with the statistics of the pool
+ * @return false if there is no such pool
+ */
+static bool umem_pool_mgr_stats(struct umem_mgr *mgr, unsigned int index,
+                                struct umem_stats *stats)
+{
+    struct umem_pool_mgr *pool_mgr = umem_pool_mgr_from_umem_mgr(mgr);
+    if (index >= pool_mgr->nb_pools)
+        return false;
+
+    uatomic_store(&pool_mgr->stats, 1);
+    stats->size = pool_mgr->pool0_size << index;
+    stats->hits = uatomic_load(&pool_mgr->hits[index]);
+    stats->misses = uatomic_load(&pool_mgr->misses[index]);
+    return true;
+}
+
 /** @This frees a umem manager.
  *
  * @param urefcount pointer to urefcount
@@ -174,8 +233,12 @@ static void umem_pool_mgr_free(struct urefcount *urefcount)
     struct umem_pool_mgr *pool_mgr = umem_pool_mgr_from_urefcount(urefcount);
     umem_pool_mgr_vacuum(umem_pool_mgr_to_umem_mgr(pool_mgr));
 
-    for (unsigned int i = 0; i < pool_mgr->nb_pools; i++)
+    for (unsigned int i = 0; i < pool_mgr->nb_pools; i++) {
         ulifo_clean(&pool_mgr->pools[i]);
+        uatomic_clean(&pool_mgr->hits[i]);
+        uatomic_clean(&pool_mgr->misses[i]);
+    }
+    uatomic_clean(&pool_mgr->stats);
 
     urefcount_clean(urefcount);
     free(pool_mgr);
@@ -195,7 +258,8 @@ static void umem_pool_mgr_free(struct urefcount *urefcount)
 struct umem_mgr *umem_pool_mgr_alloc(size_t pool0_size, size_t nb_pools, ...)
 {
     size_t alloc_size = sizeof(struct umem_pool_mgr) +
-                        sizeof(struct ulifo) * nb_pools;
+                        sizeof(struct ulifo) * nb_pools +
+                        2 * sizeof(uatomic_uint32_t) * nb_pools;
     unsigned int pools_depths[nb_pools];
     va_list args;
     va_start(args, nb_pools);
@@ -212,13 +276,20 @@ struct umem_mgr *umem_pool_mgr_alloc(size_t pool0_size, size_t nb_pools, ...)
 
     pool_mgr->pool0_size = pool0_size;
     pool_mgr->nb_pools = nb_pools;
+    uatomic_init(&pool_mgr->stats, 0);
 
     void *extra = (void *)pool_mgr + sizeof(struct umem_pool_mgr) +
                   sizeof(struct ulifo) * nb_pools;
+    pool_mgr->hits = extra;
+    extra += sizeof(uatomic_uint32_t) * nb_pools;
+    pool_mgr->misses = extra;
+    extra += sizeof(uatomic_uint32_t) * nb_pools;
 
     for (unsigned int i = 0; i < nb_pools; i++) {
         ulifo_init(&pool_mgr->pools[i], pools_depths[i], extra);
         extra += ulifo_sizeof(pools_depths[i]);
+        uatomic_init(&pool_mgr->hits[i], 0);
+        uatomic_init(&pool_mgr->misses[i], 0);
     }
 
     urefcount_init(umem_pool_mgr_to_urefcount(pool_mgr), umem_pool_mgr_free);
@@ -227,6 +298,8 @@ struct umem_mgr *umem_pool_mgr_alloc(size_t pool0_size, size_t nb_pools, ...)
     pool_mgr->mgr.umem_realloc = umem_pool_realloc;
     pool_mgr->mgr.umem_free = umem_pool_free;
     pool_mgr->mgr.umem_mgr_vacuum = umem_pool_mgr_vacuum;
+    pool_mgr->mgr.umem_mgr_prealloc = umem_pool_mgr_prealloc;
+    pool_mgr->mgr.umem_mgr_stats = umem_pool_mgr_stats;
 
     return umem_pool_mgr_to_umem_mgr(pool_mgr);
 }
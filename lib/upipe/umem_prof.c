@@ -0,0 +1,291 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe accounting memory allocator
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/urefcount.h>
+#include <upipe/uclock.h>
+#include <upipe/umutex.h>
+#include <upipe/umem.h>
+#include <upipe/umem_prof.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+/** @This defines the private data structures of the accounting umem
+ * manager. */
+struct umem_prof_mgr {
+    /** refcount management structure */
+    struct urefcount urefcount;
+    /** umem manager to which requests are forwarded */
+    struct umem_mgr *umem_mgr;
+    /** clock used to compute lifetimes, or NULL */
+    struct uclock *uclock;
+
+    /** mutex protecting the statistics, or NULL */
+    struct umutex *mutex;
+    /** statistics, lifetime excepted */
+    struct umem_prof_stats stats;
+    /** sum of the allocation dates of all buffers */
+    uint64_t alloc_dates;
+    /** sum of the release dates of released buffers */
+    uint64_t free_dates;
+
+    /** common management structure */
+    struct umem_mgr mgr;
+};
+
+UBASE_FROM_TO(umem_prof_mgr, umem_mgr, umem_mgr, mgr)
+UBASE_FROM_TO(umem_prof_mgr, urefcount, urefcount, urefcount)
+
+/** @internal @This returns the size class of a buffer.
+ *
+ * @param size size of the buffer
+ * @return size class
+ */
+static unsigned int umem_prof_size(size_t size)
+{
+    unsigned int i;
+    for (i = 0; i < UMEM_PROF_SIZES - 1; i++)
+        if (size <= ((size_t)UMEM_PROF_SIZE0 << i))
+            break;
+    return i;
+}
+
+/** @internal @This returns the current date, or 0 if there is no clock.
+ *
+ * @param prof_mgr pointer to the accounting manager
+ * @return current date
+ */
+static inline uint64_t umem_prof_now(struct umem_prof_mgr *prof_mgr)
+{
+    return prof_mgr->uclock != NULL ? uclock_now(prof_mgr->uclock) : 0;
+}
+
+/** @This allocates a new umem buffer space.
+ *
+ * @param mgr management structure
+ * @param umem caller-allocated structure, filled in with the required pointer
+ * and size (previous content is discarded)
+ * @param size requested size of the umem
+ * @return false if the memory couldn't be allocated (umem left untouched)
+ */
+static bool umem_prof_alloc(struct umem_mgr *mgr, struct umem *umem,
+                            size_t size)
+{
+    struct umem_prof_mgr *prof_mgr = umem_prof_mgr_from_umem_mgr(mgr);
+    if (unlikely(!umem_alloc(prof_mgr->umem_mgr, umem, size)))
+        return false;
+    /* releases and reallocations must come back here */
+    umem->mgr = mgr;
+
+    umutex_lock(prof_mgr->mutex);
+    uint64_t now = umem_prof_now(prof_mgr);
+    struct umem_prof_stats *stats = &prof_mgr->stats;
+    stats->allocs++;
+    stats->bytes += size;
+    stats->live++;
+    stats->live_bytes += size;
+    if (stats->live_bytes > stats->peak_bytes)
+        stats->peak_bytes = stats->live_bytes;
+    stats->sizes[umem_prof_size(size)]++;
+    prof_mgr->alloc_dates += now;
+    umutex_unlock(prof_mgr->mutex);
+    return true;
+}
+
+/** @This resizes a umem.
+ *
+ * @param umem caller-allocated structure, previously successfully passed to
+ * @ref umem_alloc, and filled in with the new pointer and size
+ * @param new_size new requested size of the umem
+ * @return false if the memory couldn't be allocated (umem left untouched)
+ */
+static bool umem_prof_realloc(struct umem *umem, size_t new_size)
+{
+    struct umem_mgr *mgr = umem->mgr;
+    struct umem_prof_mgr *prof_mgr = umem_prof_mgr_from_umem_mgr(mgr);
+    size_t old_size = umem->size;
+
+    umem->mgr = prof_mgr->umem_mgr;
+    bool ret = umem_realloc(umem, new_size);
+    umem->mgr = mgr;
+    if (unlikely(!ret))
+        return false;
+
+    umutex_lock(prof_mgr->mutex);
+    struct umem_prof_stats *stats = &prof_mgr->stats;
+    stats->reallocs++;
+    if (new_size > old_size)
+        stats->bytes += new_size - old_size;
+    stats->live_bytes += new_size;
+    stats->live_bytes -= old_size;
+    if (stats->live_bytes > stats->peak_bytes)
+        stats->peak_bytes = stats->live_bytes;
+    umutex_unlock(prof_mgr->mutex);
+    return true;
+}
+
+/** @This frees a umem.
+ *
+ * @param umem pointer to umem
+ */
+static void umem_prof_free(struct umem *umem)
+{
+    struct umem_prof_mgr *prof_mgr = umem_prof_mgr_from_umem_mgr(umem->mgr);
+    size_t size = umem->size;
+
+    umem->mgr = prof_mgr->umem_mgr;
+    umem_free(umem);
+
+    umutex_lock(prof_mgr->mutex);
+    uint64_t now = umem_prof_now(prof_mgr);
+    struct umem_prof_stats *stats = &prof_mgr->stats;
+    stats->live--;
+    stats->live_bytes -= size;
+    prof_mgr->free_dates += now;
+    umutex_unlock(prof_mgr->mutex);
+}
+
+/** @This instructs the underlying umem manager to release all structures
+ * currently kept in pools.
+ *
+ * @param mgr pointer to umem manager
+ */
+static void umem_prof_mgr_vacuum(struct umem_mgr *mgr)
+{
+    struct umem_prof_mgr *prof_mgr = umem_prof_mgr_from_umem_mgr(mgr);
+    umem_mgr_vacuum(prof_mgr->umem_mgr);
+}
+
+/** @This instructs the underlying umem manager to fill all its pools.
+ *
+ * @param mgr pointer to umem manager
+ */
+static void umem_prof_mgr_prealloc(struct umem_mgr *mgr)
+{
+    struct umem_prof_mgr *prof_mgr = umem_prof_mgr_from_umem_mgr(mgr);
+    umem_mgr_prealloc(prof_mgr->umem_mgr);
+}
+
+/** @This retrieves statistics about a size class of the underlying umem
+ * manager.
+ *
+ * @param mgr pointer to umem manager
+ * @param index index of the size class
+ * @param stats filled in with the statistics of the size class
+ * @return false if there is no such size class
+ */
+static bool umem_prof_mgr_stats(struct umem_mgr *mgr, unsigned int index,
+                                struct umem_stats *stats)
+{
+    struct umem_prof_mgr *prof_mgr = umem_prof_mgr_from_umem_mgr(mgr);
+    return umem_mgr_stats(prof_mgr->umem_mgr, index, stats);
+}
+
+/** @This frees a umem manager.
+ *
+ * @param urefcount pointer to urefcount
+ */
+static void umem_prof_mgr_free(struct urefcount *urefcount)
+{
+    struct umem_prof_mgr *prof_mgr = umem_prof_mgr_from_urefcount(urefcount);
+    umem_mgr_release(prof_mgr->umem_mgr);
+    uclock_release(prof_mgr->uclock);
+    umutex_release(prof_mgr->mutex);
+    urefcount_clean(urefcount);
+    free(prof_mgr);
+}
+
+/** @This allocates a new instance of the accounting umem manager.
+ *
+ * @param umem_mgr umem manager to which requests are forwarded
+ * @param uclock clock used to compute buffer lifetimes, or NULL
+ * @param mutex mutex protecting the statistics, or NULL if all buffers are
+ * allocated and released in the same thread
+ * @return pointer to manager, or NULL in case of error
+ */
+struct umem_mgr *umem_prof_mgr_alloc(struct umem_mgr *umem_mgr,
+                                     struct uclock *uclock,
+                                     struct umutex *mutex)
+{
+    assert(umem_mgr != NULL);
+    struct umem_prof_mgr *prof_mgr = malloc(sizeof(struct umem_prof_mgr));
+    if (unlikely(prof_mgr == NULL))
+        return NULL;
+
+    prof_mgr->umem_mgr = umem_mgr_use(umem_mgr);
+    prof_mgr->uclock = uclock_use(uclock);
+    prof_mgr->mutex = umutex_use(mutex);
+    memset(&prof_mgr->stats, 0, sizeof(prof_mgr->stats));
+    prof_mgr->alloc_dates = 0;
+    prof_mgr->free_dates = 0;
+
+    urefcount_init(umem_prof_mgr_to_urefcount(prof_mgr), umem_prof_mgr_free);
+    prof_mgr->mgr.refcount = umem_prof_mgr_to_urefcount(prof_mgr);
+    prof_mgr->mgr.umem_alloc = umem_prof_alloc;
+    prof_mgr->mgr.umem_realloc = umem_prof_realloc;
+    prof_mgr->mgr.umem_free = umem_prof_free;
+    prof_mgr->mgr.umem_mgr_vacuum = umem_prof_mgr_vacuum;
+    prof_mgr->mgr.umem_mgr_prealloc = umem_prof_mgr_prealloc;
+    prof_mgr->mgr.umem_mgr_stats = umem_prof_mgr_stats;
+
+    return umem_prof_mgr_to_umem_mgr(prof_mgr);
+}
+
+/** @This retrieves the statistics of an accounting umem manager.
+ *
+ * @param mgr pointer to a manager allocated by @ref umem_prof_mgr_alloc
+ * @param stats filled in with the statistics
+ */
+void umem_prof_mgr_get_stats(struct umem_mgr *mgr,
+                             struct umem_prof_stats *stats)
+{
+    struct umem_prof_mgr *prof_mgr = umem_prof_mgr_from_umem_mgr(mgr);
+
+    umutex_lock(prof_mgr->mutex);
+    umem_prof_mgr_get_stats_locked(mgr, stats);
+    umutex_unlock(prof_mgr->mutex);
+}
+
+/** @This retrieves the statistics of an accounting umem manager, when the
+ * caller already holds the mutex given to @ref umem_prof_mgr_alloc.
+ *
+ * @param mgr pointer to a manager allocated by @ref umem_prof_mgr_alloc
+ * @param stats filled in with the statistics
+ */
+void umem_prof_mgr_get_stats_locked(struct umem_mgr *mgr,
+                                    struct umem_prof_stats *stats)
+{
+    struct umem_prof_mgr *prof_mgr = umem_prof_mgr_from_umem_mgr(mgr);
+
+    uint64_t now = umem_prof_now(prof_mgr);
+    *stats = prof_mgr->stats;
+    /* sums wrap around, but the difference is the total lifetime */
+    stats->lifetime = prof_mgr->free_dates + stats->live * now -
+                      prof_mgr->alloc_dates;
+}
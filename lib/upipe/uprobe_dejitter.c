@@ -288,6 +288,8 @@ void uprobe_dejitter_set(struct uprobe *uprobe, bool enabled,
         uprobe_dejitter->deviation = DEFAULT_INITIAL_DEVIATION;
 }
 
+UPROBE_HELPER_EVENTS(uprobe_dejitter, UPROBE_CLOCK_REF, UPROBE_CLOCK_TS)
+
 /** @This initializes an already allocated uprobe_dejitter structure.
  *
  * @param uprobe_pfx pointer to the already allocated structure
@@ -306,6 +308,7 @@ struct uprobe *uprobe_dejitter_init(struct uprobe_dejitter *uprobe_dejitter,
     uprobe_dejitter->last_print = 0;
     uprobe_dejitter_set(uprobe, enabled, deviation);
     uprobe_init(uprobe, uprobe_dejitter_throw, next);
+    uprobe_dejitter_init_events(uprobe);
     return uprobe;
 }
 
@@ -72,6 +72,8 @@ static int uprobe_loglevel_throw(struct uprobe *uprobe,
     return UBASE_ERR_NONE;
 }
 
+UPROBE_HELPER_EVENTS(uprobe_loglevel, UPROBE_LOG)
+
 struct uprobe *uprobe_loglevel_init(struct uprobe_loglevel *uprobe_loglevel,
                                     struct uprobe *next,
                                     enum uprobe_log_level min_level)
@@ -79,6 +81,7 @@ struct uprobe *uprobe_loglevel_init(struct uprobe_loglevel *uprobe_loglevel,
     assert(uprobe_loglevel);
     struct uprobe *uprobe = uprobe_loglevel_to_uprobe(uprobe_loglevel);
     uprobe_init(uprobe, uprobe_loglevel_throw, next);
+    uprobe_loglevel_init_events(uprobe);
     ulist_init(&uprobe_loglevel->patterns);
     uprobe_loglevel->min_level = min_level;
     return uprobe;
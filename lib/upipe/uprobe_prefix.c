@@ -66,6 +66,8 @@ static int uprobe_pfx_throw(struct uprobe *uprobe, struct upipe *upipe,
     return uprobe_throw(uprobe->next, upipe, event, ulog);
 }
 
+UPROBE_HELPER_EVENTS(uprobe_pfx, UPROBE_LOG)
+
 /** @This initializes an already allocated uprobe_pfx structure.
  *
  * @param uprobe_pfx pointer to the already allocated structure
@@ -91,6 +93,7 @@ struct uprobe *uprobe_pfx_init(struct uprobe_pfx *uprobe_pfx,
         uprobe_pfx->name = NULL;
     uprobe_pfx->min_level = min_level;
     uprobe_init(uprobe, uprobe_pfx_throw, next);
+    uprobe_pfx_init_events(uprobe);
     return uprobe;
 }
 
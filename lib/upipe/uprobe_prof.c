@@ -0,0 +1,398 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short probe attributing the time spent in the probe hierarchy to pipe
+ * types and events, to profile the construction and teardown of pipelines
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/uclock.h>
+#include <upipe/urequest.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_prof.h>
+#include <upipe/uprobe_helper_alloc.h>
+#include <upipe/upipe.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <inttypes.h>
+
+/** @This is the process-wide probe accounting the cost of pipes. */
+struct uprobe *upipe_prof_uprobe = NULL;
+
+/** @This defines the kinds of accounted operations. */
+enum uprobe_prof_kind {
+    /** event thrown by a pipe */
+    UPROBE_PROF_EVENT,
+    /** allocation of a pipe */
+    UPROBE_PROF_ALLOC,
+    /** control command sent to a pipe */
+    UPROBE_PROF_CONTROL,
+    /** release of the last reference to a pipe */
+    UPROBE_PROF_RELEASE
+};
+
+/** @This is the counter of an operation on a type of pipe. */
+struct uprobe_prof_counter {
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** signature of the pipe manager */
+    uint32_t signature;
+    /** kind of operation */
+    enum uprobe_prof_kind kind;
+    /** event or control command, or 0 */
+    int event;
+    /** request type for provide_request events, or -1 */
+    int request;
+    /** number of operations */
+    uint64_t count;
+    /** time spent, excluding nested operations */
+    uint64_t total;
+    /** longest time spent for an operation */
+    uint64_t max;
+};
+
+UBASE_FROM_TO(uprobe_prof_counter, uchain, uchain, uchain)
+
+/** @internal @This accounts an operation.
+ *
+ * @param uprobe_prof pointer to probe
+ * @param signature signature of the pipe manager
+ * @param kind kind of operation
+ * @param event event or control command, or 0
+ * @param request request type, or -1
+ * @param duration time spent processing the operation
+ */
+static void uprobe_prof_account(struct uprobe_prof *uprobe_prof,
+                                uint32_t signature, enum uprobe_prof_kind kind,
+                                int event, int request, uint64_t duration)
+{
+    struct uprobe_prof_counter *counter = NULL;
+    struct uchain *uchain;
+    ulist_foreach (&uprobe_prof->counters, uchain) {
+        struct uprobe_prof_counter *c = uprobe_prof_counter_from_uchain(uchain);
+        if (c->signature == signature && c->kind == kind &&
+            c->event == event && c->request == request) {
+            counter = c;
+            break;
+        }
+    }
+
+    if (unlikely(counter == NULL)) {
+        counter = malloc(sizeof(struct uprobe_prof_counter));
+        if (unlikely(counter == NULL))
+            return;
+        uchain_init(uprobe_prof_counter_to_uchain(counter));
+        counter->signature = signature;
+        counter->kind = kind;
+        counter->event = event;
+        counter->request = request;
+        counter->count = 0;
+        counter->total = 0;
+        counter->max = 0;
+        ulist_add(&uprobe_prof->counters,
+                  uprobe_prof_counter_to_uchain(counter));
+    }
+
+    counter->count++;
+    counter->total += duration;
+    if (duration > counter->max)
+        counter->max = duration;
+}
+
+/** @internal @This starts timing an operation.
+ *
+ * @param uprobe_prof pointer to probe
+ * @param nested_p filled in with the time spent in the enclosing operation
+ * by nested operations so far
+ * @return start date
+ */
+static uint64_t uprobe_prof_start(struct uprobe_prof *uprobe_prof,
+                                  uint64_t *nested_p)
+{
+    *nested_p = uprobe_prof->nested;
+    uprobe_prof->nested = 0;
+    return uclock_now(uprobe_prof->uclock);
+}
+
+/** @internal @This stops timing an operation and accounts it, excluding the
+ * time spent in nested operations.
+ *
+ * @param uprobe_prof pointer to probe
+ * @param start date returned by @ref uprobe_prof_start
+ * @param nested value returned by @ref uprobe_prof_start
+ * @param signature signature of the pipe manager
+ * @param kind kind of operation
+ * @param event event or control command, or 0
+ * @param request request type, or -1
+ */
+static void uprobe_prof_stop(struct uprobe_prof *uprobe_prof,
+                             uint64_t start, uint64_t nested,
+                             uint32_t signature, enum uprobe_prof_kind kind,
+                             int event, int request)
+{
+    uint64_t duration = uclock_now(uprobe_prof->uclock) - start;
+    uprobe_prof_account(uprobe_prof, signature, kind, event, request,
+                        duration > uprobe_prof->nested ?
+                        duration - uprobe_prof->nested : 0);
+    uprobe_prof->nested = nested + duration;
+}
+
+/** @internal @This catches events thrown by pipes.
+ *
+ * @param uprobe pointer to probe
+ * @param upipe pointer to pipe throwing the event
+ * @param event event thrown
+ * @param args optional event-specific parameters
+ * @return an error code
+ */
+static int uprobe_prof_throw(struct uprobe *uprobe, struct upipe *upipe,
+                             int event, va_list args)
+{
+    struct uprobe_prof *uprobe_prof = uprobe_prof_from_uprobe(uprobe);
+    if (upipe == NULL || upipe->mgr == NULL || uprobe_prof->uclock == NULL)
+        return uprobe_throw_next(uprobe, upipe, event, args);
+
+    /* the pipe may be freed by the next probes */
+    uint32_t signature = upipe->mgr->signature;
+    int request = -1;
+    if (event == UPROBE_PROVIDE_REQUEST) {
+        va_list args_copy;
+        va_copy(args_copy, args);
+        struct urequest *urequest = va_arg(args_copy, struct urequest *);
+        va_end(args_copy);
+        request = urequest->type;
+    }
+
+    uint64_t nested;
+    uint64_t start = uprobe_prof_start(uprobe_prof, &nested);
+    int err = uprobe_throw_next(uprobe, upipe, event, args);
+    uprobe_prof_stop(uprobe_prof, start, nested, signature, UPROBE_PROF_EVENT,
+                     event, request);
+    return err;
+}
+
+/** @This allocates a pipe and accounts the time spent.
+ *
+ * @param mgr management structure for this pipe type
+ * @param uprobe structure used to raise events
+ * @param signature signature of the pipe allocator
+ * @param args optional arguments
+ * @return pointer to allocated pipe, or NULL in case of failure
+ */
+struct upipe *upipe_prof_alloc_va(struct upipe_mgr *mgr,
+                                  struct uprobe *uprobe,
+                                  uint32_t signature, va_list args)
+{
+    struct uprobe_prof *uprobe_prof =
+        uprobe_prof_from_uprobe(upipe_prof_uprobe);
+    uint64_t nested;
+    uint64_t start = uprobe_prof_start(uprobe_prof, &nested);
+    struct upipe *upipe = mgr->upipe_alloc(mgr, uprobe, signature, args);
+    uprobe_prof_stop(uprobe_prof, start, nested, mgr->signature,
+                     UPROBE_PROF_ALLOC, 0, -1);
+    return upipe;
+}
+
+/** @This sends a control command to a pipe and accounts the time spent.
+ *
+ * @param upipe description structure of the pipe
+ * @param command control command to send
+ * @param args optional read or write parameters
+ * @return an error code
+ */
+int upipe_prof_control_va(struct upipe *upipe, int command, va_list args)
+{
+    struct uprobe_prof *uprobe_prof =
+        uprobe_prof_from_uprobe(upipe_prof_uprobe);
+    uint32_t signature = upipe->mgr->signature;
+    uint64_t nested;
+    uint64_t start = uprobe_prof_start(uprobe_prof, &nested);
+    int err = upipe->mgr->upipe_control(upipe, command, args);
+    uprobe_prof_stop(uprobe_prof, start, nested, signature,
+                     UPROBE_PROF_CONTROL, command, -1);
+    return err;
+}
+
+/** @This releases a pipe and accounts the time spent if it is freed.
+ *
+ * @param upipe description structure of the pipe
+ */
+void upipe_prof_release(struct upipe *upipe)
+{
+    if (upipe == NULL)
+        return;
+    if (upipe->refcount == NULL || upipe->mgr == NULL ||
+        !urefcount_single(upipe->refcount)) {
+        urefcount_release(upipe->refcount);
+        return;
+    }
+
+    struct uprobe_prof *uprobe_prof =
+        uprobe_prof_from_uprobe(upipe_prof_uprobe);
+    /* the pipe is freed */
+    uint32_t signature = upipe->mgr->signature;
+    uint64_t nested;
+    uint64_t start = uprobe_prof_start(uprobe_prof, &nested);
+    urefcount_release(upipe->refcount);
+    uprobe_prof_stop(uprobe_prof, start, nested, signature,
+                     UPROBE_PROF_RELEASE, 0, -1);
+}
+
+/** @This initializes an already allocated uprobe_prof structure.
+ *
+ * @param uprobe_prof pointer to the already allocated structure
+ * @param next next probe to test if this one doesn't catch the event
+ * @param uclock clock used to timestamp events
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_prof_init(struct uprobe_prof *uprobe_prof,
+                                struct uprobe *next, struct uclock *uclock)
+{
+    assert(uprobe_prof != NULL);
+    struct uprobe *uprobe = uprobe_prof_to_uprobe(uprobe_prof);
+    uprobe_prof->uclock = uclock_use(uclock);
+    ulist_init(&uprobe_prof->counters);
+    uprobe_prof->nested = 0;
+    uprobe_init(uprobe, uprobe_prof_throw, next);
+    return uprobe;
+}
+
+/** @This cleans a uprobe_prof structure.
+ *
+ * @param uprobe_prof structure to clean
+ */
+void uprobe_prof_clean(struct uprobe_prof *uprobe_prof)
+{
+    assert(uprobe_prof != NULL);
+    struct uprobe *uprobe = uprobe_prof_to_uprobe(uprobe_prof);
+    if (upipe_prof_uprobe == uprobe)
+        upipe_prof_uprobe = NULL;
+    uprobe_prof_reset(uprobe);
+    uclock_release(uprobe_prof->uclock);
+    uprobe_clean(uprobe);
+}
+
+#define ARGS_DECL struct uprobe *next, struct uclock *uclock
+#define ARGS next, uclock
+UPROBE_HELPER_ALLOC(uprobe_prof)
+#undef ARGS
+#undef ARGS_DECL
+
+/** @This logs the accumulated counters, by pipe type and event, with the
+ * notice level.
+ *
+ * @param uprobe pointer to probe
+ */
+void uprobe_prof_report(struct uprobe *uprobe)
+{
+    struct uprobe_prof *uprobe_prof = uprobe_prof_from_uprobe(uprobe);
+    struct uchain *uchain;
+    ulist_foreach (&uprobe_prof->counters, uchain) {
+        struct uprobe_prof_counter *counter =
+            uprobe_prof_counter_from_uchain(uchain);
+        char signature[4];
+        memcpy(signature, &counter->signature, sizeof(signature));
+        uint64_t total = counter->total * 1000000 / UCLOCK_FREQ;
+        uint64_t max = counter->max * 1000000 / UCLOCK_FREQ;
+
+        switch (counter->kind) {
+            case UPROBE_PROF_EVENT: {
+                const char *event = uprobe_event_str(counter->event);
+                const char *request = counter->request == -1 ? NULL :
+                                      urequest_type_str(counter->request);
+                uprobe_notice_va(uprobe, NULL,
+                    "%.4s %s%s%s: %"PRIu64" events, %"PRIu64" us "
+                    "(max %"PRIu64" us)",
+                    signature,
+                    event != NULL ? event : "local event",
+                    counter->request == -1 ? "" : " ",
+                    counter->request == -1 ? "" :
+                    (request != NULL ? request : "local request"),
+                    counter->count, total, max);
+                break;
+            }
+            case UPROBE_PROF_ALLOC:
+                uprobe_notice_va(uprobe, NULL,
+                    "%.4s allocation: %"PRIu64" pipes, %"PRIu64" us "
+                    "(max %"PRIu64" us)",
+                    signature, counter->count, total, max);
+                break;
+            case UPROBE_PROF_CONTROL: {
+                const char *command = upipe_command_str(NULL, counter->event);
+                uprobe_notice_va(uprobe, NULL,
+                    "%.4s command %s: %"PRIu64" commands, %"PRIu64" us "
+                    "(max %"PRIu64" us)",
+                    signature, command != NULL ? command : "local",
+                    counter->count, total, max);
+                break;
+            }
+            case UPROBE_PROF_RELEASE:
+                uprobe_notice_va(uprobe, NULL,
+                    "%.4s release: %"PRIu64" pipes, %"PRIu64" us "
+                    "(max %"PRIu64" us)",
+                    signature, counter->count, total, max);
+                break;
+        }
+    }
+}
+
+/** @This resets the accumulated counters.
+ *
+ * @param uprobe pointer to probe
+ */
+void uprobe_prof_reset(struct uprobe *uprobe)
+{
+    struct uprobe_prof *uprobe_prof = uprobe_prof_from_uprobe(uprobe);
+    struct uchain *uchain;
+    while ((uchain = ulist_pop(&uprobe_prof->counters)) != NULL)
+        free(uprobe_prof_counter_from_uchain(uchain));
+    uprobe_prof->nested = 0;
+}
+
+/** @This enables or disables the accounting of the allocation, control
+ * commands and release of all pipes by a probe.
+ *
+ * @param uprobe pointer to probe
+ * @param enable true to enable the accounting
+ * @return an error code
+ */
+int uprobe_prof_set_pipes(struct uprobe *uprobe, bool enable)
+{
+    struct uprobe_prof *uprobe_prof = uprobe_prof_from_uprobe(uprobe);
+    if (!enable) {
+        if (upipe_prof_uprobe == uprobe)
+            upipe_prof_uprobe = NULL;
+        return UBASE_ERR_NONE;
+    }
+
+    if (uprobe_prof->uclock == NULL)
+        return UBASE_ERR_INVALID;
+    if (upipe_prof_uprobe != NULL && upipe_prof_uprobe != uprobe)
+        return UBASE_ERR_BUSY;
+    upipe_prof_uprobe = uprobe;
+    return UBASE_ERR_NONE;
+}
@@ -38,6 +38,7 @@
 #include <upipe/uref.h>
 #include <upipe/uref_flow.h>
 #include <upipe/uref_program_flow.h>
+#include <upipe/uref_flow_hash.h>
 #include <upipe/uprobe.h>
 #include <upipe/uprobe_helper_uprobe.h>
 #include <upipe/uprobe_select_flows.h>
@@ -60,6 +61,14 @@ struct uprobe_selflow {
 
     /** type of flows to filter */
     enum uprobe_selflow_type type;
+    /** pre-hashed "void." prefix */
+    struct uref_flow_hash_key key_void;
+    /** pre-hashed "pic" component */
+    struct uref_flow_hash_key key_pic;
+    /** pre-hashed "sub" component */
+    struct uref_flow_hash_key key_sub;
+    /** pre-hashed "sound" component */
+    struct uref_flow_hash_key key_sound;
     /** probe to give to subpipes */
     struct uprobe *subprobe;
     /** user configuration */
@@ -109,12 +118,47 @@ UBASE_FROM_TO(uprobe_selflow_sub, urefcount, urefcount, urefcount)
 /** @internal @This checks if a flow definition matches our flow type.
  *
  * @param uprobe pointer to probe
- * @param def flow definition string
+ * @param flow_def flow definition packet
  * @return true if the flow matches
  */
-static bool uprobe_selflow_check_def(struct uprobe *uprobe, const char *def)
+static bool uprobe_selflow_check_def(struct uprobe *uprobe,
+                                     struct uref *flow_def)
 {
     struct uprobe_selflow *uprobe_selflow = uprobe_selflow_from_uprobe(uprobe);
+    struct uref_flow_hash hash;
+    if (unlikely(!ubase_check(uref_flow_hash_init_uref(&hash, flow_def))))
+        return false;
+    const char *def = hash.def;
+    if (likely(uref_flow_hash_complete(&hash))) {
+        int pic;
+        switch (uprobe_selflow->type) {
+            case UPROBE_SELFLOW_VOID:
+                return uref_flow_hash_match(&hash, &uprobe_selflow->key_void);
+            case UPROBE_SELFLOW_PIC:
+                pic = uref_flow_hash_find(&hash, &uprobe_selflow->key_pic, 0);
+                return pic >= 0 &&
+                       uref_flow_hash_find(&hash, &uprobe_selflow->key_sub,
+                                           pic + 1) != pic + 1;
+            case UPROBE_SELFLOW_SOUND:
+                return uref_flow_hash_find(&hash, &uprobe_selflow->key_sound,
+                                           0) >= 0;
+            case UPROBE_SELFLOW_SUBPIC:
+                for (pic = uref_flow_hash_find(&hash,
+                                               &uprobe_selflow->key_pic, 0);
+                     pic >= 0;
+                     pic = uref_flow_hash_find(&hash,
+                                               &uprobe_selflow->key_pic,
+                                               pic + 1))
+                    if (uref_flow_hash_find(&hash, &uprobe_selflow->key_sub,
+                                            pic + 1) == pic + 1)
+                        return true;
+                return false;
+            default:
+                return false;
+        }
+    }
+
+    /* flow definition too deep to be fully hashed */
     switch (uprobe_selflow->type) {
         case UPROBE_SELFLOW_VOID:
             return !ubase_ncmp(def, "void.");
@@ -331,6 +375,8 @@ static void uprobe_selflow_sub_free(struct urefcount *urefcount)
     free(sub);
 }
 
+UPROBE_HELPER_EVENTS(uprobe_selflow_sub, UPROBE_SOURCE_END)
+
 /** @internal @This allocates a subprobe for a flow.
  *
  * @param next next probe to test if this one doesn't catch the event
@@ -351,6 +397,7 @@ static struct uprobe *uprobe_selflow_sub_alloc(struct uprobe *next,
 
     struct uprobe *uprobe = uprobe_selflow_sub_to_uprobe(sub);
     uprobe_init(uprobe, uprobe_selflow_sub_throw, next);
+    uprobe_selflow_sub_init_events(uprobe);
 
     uchain_init(&sub->uchain);
     sub->uprobe_selflow = uprobe_selflow;
@@ -387,12 +434,7 @@ static int uprobe_selflow_throw(struct uprobe *uprobe, struct upipe *upipe,
     while (ubase_check(upipe_split_iterate(upipe, &flow_def)) &&
            flow_def != NULL) {
         uint64_t flow_id;
-        const char *def;
         UBASE_RETURN(uref_flow_get_id(flow_def, &flow_id))
-        UBASE_RETURN(uref_flow_get_def(flow_def, &def))
-
-        if (!uprobe_selflow_check_def(uprobe, def))
-            continue;
 
         /* Try to find a sub with that flow id. */
         struct uprobe_selflow_sub *sub = NULL;
@@ -408,6 +450,9 @@ static int uprobe_selflow_throw(struct uprobe *uprobe, struct upipe *upipe,
         }
 
         if (sub == NULL) {
+            if (!uprobe_selflow_check_def(uprobe, flow_def))
+                continue;
+
             /* Create a sub. */
             struct uprobe *uprobe_selflow_sub =
                 uprobe_selflow_sub_alloc(uprobe_use(uprobe_selflow->subprobe),
@@ -425,6 +470,9 @@ static int uprobe_selflow_throw(struct uprobe *uprobe, struct upipe *upipe,
         sub->flow_def = uref_dup(flow_def);
         if (unlikely(sub->flow_def == NULL))
             return UBASE_ERR_ALLOC;
+        /* hash the copy once for the pipes it is given to */
+        struct uref_flow_hash hash;
+        uref_flow_hash_cache_uref(&hash, sub->flow_def);
 
         if (!strcmp(uprobe_selflow->flows, "auto")) {
             uprobe_selflow->has_selection = true;
@@ -497,6 +545,8 @@ static void uprobe_selflow_free(struct urefcount *urefcount)
     free(uprobe_selflow);
 }
 
+UPROBE_HELPER_EVENTS(uprobe_selflow, UPROBE_SPLIT_UPDATE)
+
 /** @This allocates a new uprobe_selflow structure.
  *
  * @param next next probe to test if this one doesn't catch the event
@@ -519,8 +569,13 @@ struct uprobe *uprobe_selflow_alloc(struct uprobe *next,
         return NULL;
     struct uprobe *uprobe = uprobe_selflow_to_uprobe(uprobe_selflow);
     uprobe_init(uprobe, uprobe_selflow_throw, next);
+    uprobe_selflow_init_events(uprobe);
     uprobe_selflow->subprobe = subprobe;
     uprobe_selflow->type = type;
+    uref_flow_hash_key_init(&uprobe_selflow->key_void, "void.");
+    uref_flow_hash_key_init(&uprobe_selflow->key_pic, "pic");
+    uref_flow_hash_key_init(&uprobe_selflow->key_sub, "sub");
+    uref_flow_hash_key_init(&uprobe_selflow->key_sound, "sound");
     uprobe_selflow->has_selection = false;
     uprobe_selflow->flows = NULL;
     ulist_init(&uprobe_selflow->subs);
@@ -53,6 +53,8 @@ static int catch_source_mgr(struct uprobe *uprobe, struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+UPROBE_HELPER_EVENTS(uprobe_source_mgr, UPROBE_NEED_SOURCE_MGR)
+
 /** @This initializes an already allocated uprobe_source_mgr structure.
  *
  * @param uprobe_source_mgr pointer to the already allocated structure
@@ -67,6 +69,7 @@ uprobe_source_mgr_init(struct uprobe_source_mgr *uprobe_source_mgr,
 {
     struct uprobe *uprobe = uprobe_source_mgr_to_uprobe(uprobe_source_mgr);
     uprobe_init(uprobe, catch_source_mgr, next);
+    uprobe_source_mgr_init_events(uprobe);
     uprobe_source_mgr->source_mgr = upipe_mgr_use(source_mgr);
     return uprobe;
 }
@@ -191,6 +191,8 @@ static int uprobe_stdio_throw(struct uprobe *uprobe, struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+UPROBE_HELPER_EVENTS(uprobe_stdio, UPROBE_LOG)
+
 /** @This initializes an already allocated uprobe_stdio structure.
  *
  * @param uprobe_stdio pointer to the already allocated structure
@@ -209,6 +211,7 @@ struct uprobe *uprobe_stdio_init(struct uprobe_stdio *uprobe_stdio,
     uprobe_stdio->min_level = min_level;
     uprobe_stdio->colored = isatty(fileno(stream));
     uprobe_init(uprobe, uprobe_stdio_throw, next);
+    uprobe_stdio_init_events(uprobe);
     return uprobe;
 }
 
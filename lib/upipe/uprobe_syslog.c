@@ -97,6 +97,8 @@ static int uprobe_syslog_throw(struct uprobe *uprobe, struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+UPROBE_HELPER_EVENTS(uprobe_syslog, UPROBE_LOG)
+
 /** @This initializes an already allocated uprobe_syslog structure.
  *
  * @param uprobe_syslog pointer to the already allocated structure
@@ -130,6 +132,7 @@ struct uprobe *uprobe_syslog_init(struct uprobe_syslog *uprobe_syslog,
         openlog(uprobe_syslog->ident, option, facility);
 
     uprobe_init(uprobe, uprobe_syslog_throw, next);
+    uprobe_syslog_init_events(uprobe);
     return uprobe;
 }
 
@@ -88,6 +88,8 @@ static int uprobe_ubuf_mem_throw(struct uprobe *uprobe, struct upipe *upipe,
     return urequest_provide_ubuf_mgr(urequest, ubuf_mgr, uref);
 }
 
+UPROBE_HELPER_EVENTS(uprobe_ubuf_mem, UPROBE_PROVIDE_REQUEST)
+
 /** @This initializes an already allocated uprobe_ubuf_mem structure.
  *
  * @param uprobe_ubuf_mem pointer to the already allocated structure
@@ -109,6 +111,7 @@ struct uprobe *uprobe_ubuf_mem_init(struct uprobe_ubuf_mem *uprobe_ubuf_mem,
     uprobe_ubuf_mem->ubuf_pool_depth = ubuf_pool_depth;
     uprobe_ubuf_mem->shared_pool_depth = shared_pool_depth;
     uprobe_init(uprobe, uprobe_ubuf_mem_throw, next);
+    uprobe_ubuf_mem_init_events(uprobe);
     return uprobe;
 }
 
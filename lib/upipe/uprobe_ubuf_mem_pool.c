@@ -31,6 +31,7 @@
 #include <upipe/umem.h>
 #include <upipe/ubuf.h>
 #include <upipe/ubuf_mem.h>
+#include <upipe/uref_flow_hash.h>
 #include <upipe/uprobe.h>
 #include <upipe/uprobe_ubuf_mem_pool.h>
 #include <upipe/uprobe_helper_alloc.h>
@@ -45,6 +46,9 @@
 struct uprobe_ubuf_mem_pool_element {
     /** pointer to ubuf manager */
     struct ubuf_mgr *ubuf_mgr;
+    /** hash of the first component of the flow definition (block, pic,
+     * sound) */
+    uint64_t kind;
     /** pointer to next element */
     uatomic_ptr_t next;
 };
@@ -87,15 +91,32 @@ static int uprobe_ubuf_mem_pool_throw(struct uprobe *uprobe,
     if (urequest->type == UREQUEST_FLOW_FORMAT)
         return urequest_provide_flow_format(urequest, uref);
 
+    /* managers of another kind of buffers are skipped without querying */
+    struct uref_flow_hash hash;
+    uint64_t kind = 0;
+    if (ubase_check(uref_flow_hash_init_uref(&hash, uref)) && hash.depth)
+        kind = hash.component[0];
+
+    /* pipes of a same pipeline usually ask for the same manager */
+    struct uprobe_ubuf_mem_pool_element *elem =
+        uatomic_ptr_load_ptr(&uprobe_ubuf_mem_pool->last,
+                             struct uprobe_ubuf_mem_pool_element *);
+    if (elem != NULL && elem->kind == kind &&
+        ubase_check(ubuf_mgr_check(elem->ubuf_mgr, uref)))
+        return urequest_provide_ubuf_mgr(urequest,
+                    ubuf_mgr_use(elem->ubuf_mgr), uref);
+
     uatomic_ptr_t *elem_p = &uprobe_ubuf_mem_pool->first;
-    struct uprobe_ubuf_mem_pool_element *elem;
 
     for ( ; ; ) {
         while ((elem = uatomic_ptr_load_ptr(elem_p,
                             struct uprobe_ubuf_mem_pool_element *)) != NULL) {
-            if (ubase_check(ubuf_mgr_check(elem->ubuf_mgr, uref)))
+            if (elem->kind == kind &&
+                ubase_check(ubuf_mgr_check(elem->ubuf_mgr, uref))) {
+                uatomic_ptr_store(&uprobe_ubuf_mem_pool->last, elem);
                 return urequest_provide_ubuf_mgr(urequest,
                             ubuf_mgr_use(elem->ubuf_mgr), uref);
+            }
             elem_p = &elem->next;
         }
 
@@ -114,10 +135,14 @@ static int uprobe_ubuf_mem_pool_throw(struct uprobe *uprobe,
             return urequest_provide_ubuf_mgr(urequest, ubuf_mgr, uref);
 
         new_elem->ubuf_mgr = ubuf_mgr;
+        new_elem->kind = kind;
         uatomic_ptr_init(&new_elem->next, NULL);
-        if (likely(uatomic_ptr_compare_exchange_ptr(elem_p, &elem, new_elem)))
+        if (likely(uatomic_ptr_compare_exchange_ptr(elem_p, &elem,
+                                                    new_elem))) {
+            uatomic_ptr_store(&uprobe_ubuf_mem_pool->last, new_elem);
             return urequest_provide_ubuf_mgr(urequest, ubuf_mgr_use(ubuf_mgr),
                                              uref);
+        }
 
         /* retry */
         ubuf_mgr_release(new_elem->ubuf_mgr);
@@ -126,6 +151,8 @@ static int uprobe_ubuf_mem_pool_throw(struct uprobe *uprobe,
     }
 }
 
+UPROBE_HELPER_EVENTS(uprobe_ubuf_mem_pool, UPROBE_PROVIDE_REQUEST)
+
 /** @This initializes an already allocated uprobe_ubuf_mem_pool structure.
  *
  * @param uprobe_ubuf_mem_pool pointer to the already allocated structure
@@ -147,7 +174,9 @@ struct uprobe *
     uprobe_ubuf_mem_pool->ubuf_pool_depth = ubuf_pool_depth;
     uprobe_ubuf_mem_pool->shared_pool_depth = shared_pool_depth;
     uatomic_ptr_init(&uprobe_ubuf_mem_pool->first, NULL);
+    uatomic_ptr_init(&uprobe_ubuf_mem_pool->last, NULL);
     uprobe_init(uprobe, uprobe_ubuf_mem_pool_throw, next);
+    uprobe_ubuf_mem_pool_init_events(uprobe);
     return uprobe;
 }
 
@@ -159,6 +188,7 @@ struct uprobe *
  */
 void uprobe_ubuf_mem_pool_vacuum(struct uprobe_ubuf_mem_pool *uprobe_ubuf_mem_pool)
 {
+    uatomic_ptr_store(&uprobe_ubuf_mem_pool->last, NULL);
     struct uprobe_ubuf_mem_pool_element *elem =
         uatomic_ptr_load_ptr(&uprobe_ubuf_mem_pool->first,
                              struct uprobe_ubuf_mem_pool_element *);
@@ -185,6 +215,7 @@ void uprobe_ubuf_mem_pool_clean(struct uprobe_ubuf_mem_pool *uprobe_ubuf_mem_poo
     assert(uprobe_ubuf_mem_pool != NULL);
     uprobe_ubuf_mem_pool_vacuum(uprobe_ubuf_mem_pool);
     uatomic_ptr_clean(&uprobe_ubuf_mem_pool->first);
+    uatomic_ptr_clean(&uprobe_ubuf_mem_pool->last);
     umem_mgr_release(uprobe_ubuf_mem_pool->umem_mgr);
     struct uprobe *uprobe = uprobe_ubuf_mem_pool_to_uprobe(uprobe_ubuf_mem_pool);
     uprobe_clean(uprobe);
@@ -65,6 +65,8 @@ static int uprobe_uclock_throw(struct uprobe *uprobe, struct upipe *upipe,
                                    uclock_use(uprobe_uclock->uclock));
 }
 
+UPROBE_HELPER_EVENTS(uprobe_uclock, UPROBE_PROVIDE_REQUEST)
+
 /** @This initializes an already allocated uprobe_uclock structure.
  *
  * @param uprobe_uclock pointer to the already allocated structure
@@ -80,6 +82,7 @@ struct uprobe *uprobe_uclock_init(struct uprobe_uclock *uprobe_uclock,
     struct uprobe *uprobe = uprobe_uclock_to_uprobe(uprobe_uclock);
     uprobe_uclock->uclock = uclock_use(uclock);
     uprobe_init(uprobe, uprobe_uclock_throw, next);
+    uprobe_uclock_init_events(uprobe);
     return uprobe;
 }
 
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short probe catching need_ujob_mgr events and providing a given ujob
+ * manager
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ujob.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_ujob_mgr.h>
+#include <upipe/uprobe_helper_alloc.h>
+#include <upipe/upipe.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+/** @internal @This catches events thrown by pipes.
+ *
+ * @param uprobe pointer to probe
+ * @param upipe pointer to pipe throwing the event
+ * @param event event thrown
+ * @param args optional event-specific parameters
+ * @return an error code
+ */
+static int uprobe_ujob_mgr_throw(struct uprobe *uprobe, struct upipe *upipe,
+                                 int event, va_list args)
+{
+    struct uprobe_ujob_mgr *uprobe_ujob_mgr =
+        uprobe_ujob_mgr_from_uprobe(uprobe);
+    if (event != UPROBE_NEED_UJOB_MGR || uprobe_ujob_mgr->ujob_mgr == NULL)
+        return uprobe_throw_next(uprobe, upipe, event, args);
+
+    struct ujob_mgr **ujob_mgr_p = va_arg(args, struct ujob_mgr **);
+    *ujob_mgr_p = ujob_mgr_use(uprobe_ujob_mgr->ujob_mgr);
+    return UBASE_ERR_NONE;
+}
+
+UPROBE_HELPER_EVENTS(uprobe_ujob_mgr, UPROBE_NEED_UJOB_MGR)
+
+/** @This initializes an already allocated uprobe_ujob_mgr structure.
+ *
+ * @param uprobe_ujob_mgr pointer to the already allocated structure
+ * @param next next probe to test if this one doesn't catch the event
+ * @param ujob_mgr ujob manager to provide to pipes
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_ujob_mgr_init(struct uprobe_ujob_mgr *uprobe_ujob_mgr,
+                                    struct uprobe *next,
+                                    struct ujob_mgr *ujob_mgr)
+{
+    assert(uprobe_ujob_mgr != NULL);
+    struct uprobe *uprobe = uprobe_ujob_mgr_to_uprobe(uprobe_ujob_mgr);
+    uprobe_ujob_mgr->ujob_mgr = ujob_mgr_use(ujob_mgr);
+    uprobe_init(uprobe, uprobe_ujob_mgr_throw, next);
+    uprobe_ujob_mgr_init_events(uprobe);
+    return uprobe;
+}
+
+/** @This cleans a uprobe_ujob_mgr structure.
+ *
+ * @param uprobe_ujob_mgr structure to clean
+ */
+void uprobe_ujob_mgr_clean(struct uprobe_ujob_mgr *uprobe_ujob_mgr)
+{
+    assert(uprobe_ujob_mgr != NULL);
+    struct uprobe *uprobe = uprobe_ujob_mgr_to_uprobe(uprobe_ujob_mgr);
+    ujob_mgr_release(uprobe_ujob_mgr->ujob_mgr);
+    uprobe_clean(uprobe);
+}
+
+#define ARGS_DECL struct uprobe *next, struct ujob_mgr *ujob_mgr
+#define ARGS next, ujob_mgr
+UPROBE_HELPER_ALLOC(uprobe_ujob_mgr)
+#undef ARGS
+#undef ARGS_DECL
+
+/** @This changes the ujob_mgr set by this probe.
+ *
+ * @param uprobe pointer to probe
+ * @param ujob_mgr new ujob manager to provide to pipes
+ */
+void uprobe_ujob_mgr_set(struct uprobe *uprobe, struct ujob_mgr *ujob_mgr)
+{
+    struct uprobe_ujob_mgr *uprobe_ujob_mgr =
+        uprobe_ujob_mgr_from_uprobe(uprobe);
+    ujob_mgr_release(uprobe_ujob_mgr->ujob_mgr);
+    uprobe_ujob_mgr->ujob_mgr = ujob_mgr_use(ujob_mgr);
+}
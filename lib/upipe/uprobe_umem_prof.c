@@ -0,0 +1,400 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short probe catching provide_request events asking for a ubuf manager,
+ * and attributing the buffer allocations to the requesting pipes
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/ulist.h>
+#include <upipe/uclock.h>
+#include <upipe/umutex.h>
+#include <upipe/umem.h>
+#include <upipe/umem_prof.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_mem.h>
+#include <upipe/upump.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_umem_prof.h>
+#include <upipe/uprobe_helper_alloc.h>
+#include <upipe/upipe.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <inttypes.h>
+
+/** @This is the account of the allocations of a pipe. */
+struct uprobe_umem_prof_account {
+    /** structure for double-linked lists */
+    struct uchain uchain;
+    /** pipe, or NULL if it is dead */
+    struct upipe *upipe;
+    /** signature of the pipe manager */
+    uint32_t signature;
+    /** accounting umem manager given to the pipe */
+    struct umem_mgr *umem_mgr;
+    /** number of allocations at the time of the last report */
+    uint64_t last_allocs;
+};
+
+UBASE_FROM_TO(uprobe_umem_prof_account, uchain, uchain, uchain)
+
+/** @internal @This returns the account of a pipe.
+ *
+ * @param uprobe_umem_prof pointer to probe
+ * @param upipe pipe
+ * @return pointer to account, or NULL
+ */
+static struct uprobe_umem_prof_account *
+    uprobe_umem_prof_find(struct uprobe_umem_prof *uprobe_umem_prof,
+                          struct upipe *upipe)
+{
+    struct uchain *uchain;
+    ulist_foreach (&uprobe_umem_prof->accounts, uchain) {
+        struct uprobe_umem_prof_account *account =
+            uprobe_umem_prof_account_from_uchain(uchain);
+        if (account->upipe == upipe)
+            return account;
+    }
+    return NULL;
+}
+
+/** @internal @This returns the account of a pipe, creating it if needed.
+ *
+ * @param uprobe_umem_prof pointer to probe
+ * @param upipe pipe
+ * @return pointer to account, or NULL in case of allocation error
+ */
+static struct uprobe_umem_prof_account *
+    uprobe_umem_prof_account(struct uprobe_umem_prof *uprobe_umem_prof,
+                             struct upipe *upipe)
+{
+    struct uprobe_umem_prof_account *account =
+        uprobe_umem_prof_find(uprobe_umem_prof, upipe);
+    if (account != NULL)
+        return account;
+
+    account = malloc(sizeof(struct uprobe_umem_prof_account));
+    if (unlikely(account == NULL))
+        return NULL;
+    account->umem_mgr = umem_prof_mgr_alloc(uprobe_umem_prof->umem_mgr,
+                                            uprobe_umem_prof->uclock,
+                                            uprobe_umem_prof->mutex);
+    if (unlikely(account->umem_mgr == NULL)) {
+        free(account);
+        return NULL;
+    }
+    uchain_init(&account->uchain);
+    account->upipe = upipe;
+    account->signature = upipe->mgr != NULL ? upipe->mgr->signature : 0;
+    account->last_allocs = 0;
+    ulist_add(&uprobe_umem_prof->accounts, &account->uchain);
+    return account;
+}
+
+/** @internal @This deletes an account.
+ *
+ * @param account pointer to account
+ */
+static void uprobe_umem_prof_account_free(
+        struct uprobe_umem_prof_account *account)
+{
+    ulist_delete(&account->uchain);
+    umem_mgr_release(account->umem_mgr);
+    free(account);
+}
+
+/** @internal @This catches events thrown by pipes.
+ *
+ * @param uprobe pointer to probe
+ * @param upipe pointer to pipe throwing the event
+ * @param event event thrown
+ * @param args optional event-specific parameters
+ * @return an error code
+ */
+static int uprobe_umem_prof_throw(struct uprobe *uprobe, struct upipe *upipe,
+                                  int event, va_list args)
+{
+    struct uprobe_umem_prof *uprobe_umem_prof =
+        uprobe_umem_prof_from_uprobe(uprobe);
+
+    if (upipe == NULL)
+        return uprobe_throw_next(uprobe, upipe, event, args);
+
+    if (event == UPROBE_DEAD) {
+        umutex_lock(uprobe_umem_prof->mutex);
+        struct uprobe_umem_prof_account *account =
+            uprobe_umem_prof_find(uprobe_umem_prof, upipe);
+        if (account != NULL) {
+            struct umem_prof_stats stats;
+            umem_prof_mgr_get_stats_locked(account->umem_mgr, &stats);
+            /* keep the account if buffers outlive the pipe, or if there is
+             * something left to report */
+            if (!stats.live && stats.allocs == account->last_allocs)
+                uprobe_umem_prof_account_free(account);
+            else
+                account->upipe = NULL;
+        }
+        umutex_unlock(uprobe_umem_prof->mutex);
+        return uprobe_throw_next(uprobe, upipe, event, args);
+    }
+
+    if (event != UPROBE_PROVIDE_REQUEST)
+        return uprobe_throw_next(uprobe, upipe, event, args);
+
+    va_list args_copy;
+    va_copy(args_copy, args);
+    struct urequest *urequest = va_arg(args_copy, struct urequest *);
+    va_end(args_copy);
+
+    if (urequest->type != UREQUEST_UBUF_MGR)
+        return uprobe_throw_next(uprobe, upipe, event, args);
+
+    umutex_lock(uprobe_umem_prof->mutex);
+    struct uprobe_umem_prof_account *account =
+        uprobe_umem_prof_account(uprobe_umem_prof, upipe);
+    struct umem_mgr *umem_mgr =
+        account != NULL ? umem_mgr_use(account->umem_mgr) : NULL;
+    umutex_unlock(uprobe_umem_prof->mutex);
+    if (unlikely(umem_mgr == NULL))
+        return UBASE_ERR_ALLOC;
+
+    struct uref *uref = uref_dup(urequest->uref);
+    if (unlikely(uref == NULL)) {
+        umem_mgr_release(umem_mgr);
+        return UBASE_ERR_ALLOC;
+    }
+
+    struct ubuf_mgr *ubuf_mgr =
+        ubuf_mem_mgr_alloc_from_flow_def(uprobe_umem_prof->ubuf_pool_depth,
+                                         uprobe_umem_prof->shared_pool_depth,
+                                         umem_mgr, uref);
+    umem_mgr_release(umem_mgr);
+    if (ubuf_mgr == NULL) {
+        uref_free(uref);
+        return uprobe_throw_next(uprobe, upipe, event, args);
+    }
+
+    return urequest_provide_ubuf_mgr(urequest, ubuf_mgr, uref);
+}
+
+UPROBE_HELPER_EVENTS(uprobe_umem_prof, UPROBE_DEAD, UPROBE_PROVIDE_REQUEST)
+
+/** @This initializes an already allocated uprobe_umem_prof structure.
+ *
+ * @param uprobe_umem_prof pointer to the already allocated structure
+ * @param next next probe to test if this one doesn't catch the event
+ * @param umem_mgr memory allocator to use for buffers
+ * @param ubuf_pool_depth maximum number of ubuf structures in the pool
+ * @param shared_pool_depth maximum number of shared structures in the pool
+ * @param uclock clock used to compute buffer lifetimes, or NULL
+ * @param mutex mutex protecting the statistics, or NULL
+ * @return pointer to uprobe, or NULL in case of error
+ */
+struct uprobe *uprobe_umem_prof_init(struct uprobe_umem_prof *uprobe_umem_prof,
+                                     struct uprobe *next,
+                                     struct umem_mgr *umem_mgr,
+                                     uint16_t ubuf_pool_depth,
+                                     uint16_t shared_pool_depth,
+                                     struct uclock *uclock,
+                                     struct umutex *mutex)
+{
+    assert(uprobe_umem_prof != NULL);
+    assert(umem_mgr != NULL);
+    struct uprobe *uprobe = uprobe_umem_prof_to_uprobe(uprobe_umem_prof);
+    uprobe_umem_prof->umem_mgr = umem_mgr_use(umem_mgr);
+    uprobe_umem_prof->ubuf_pool_depth = ubuf_pool_depth;
+    uprobe_umem_prof->shared_pool_depth = shared_pool_depth;
+    uprobe_umem_prof->uclock = uclock_use(uclock);
+    uprobe_umem_prof->mutex = umutex_use(mutex);
+    ulist_init(&uprobe_umem_prof->accounts);
+    uprobe_umem_prof->pools = NULL;
+    uprobe_umem_prof->nb_pools = 0;
+    uprobe_umem_prof->upump = NULL;
+    uprobe_init(uprobe, uprobe_umem_prof_throw, next);
+    uprobe_umem_prof_init_events(uprobe);
+
+    /* start the counters of the allocator */
+    struct umem_stats stats;
+    umem_mgr_stats(umem_mgr, 0, &stats);
+    return uprobe;
+}
+
+/** @This cleans a uprobe_umem_prof structure.
+ *
+ * @param uprobe_umem_prof structure to clean
+ */
+void uprobe_umem_prof_clean(struct uprobe_umem_prof *uprobe_umem_prof)
+{
+    assert(uprobe_umem_prof != NULL);
+    struct uprobe *uprobe = uprobe_umem_prof_to_uprobe(uprobe_umem_prof);
+    uprobe_umem_prof_set_period(uprobe, NULL, 0);
+
+    struct uchain *uchain, *uchain_tmp;
+    ulist_delete_foreach (&uprobe_umem_prof->accounts, uchain, uchain_tmp)
+        uprobe_umem_prof_account_free(
+                uprobe_umem_prof_account_from_uchain(uchain));
+    free(uprobe_umem_prof->pools);
+    uclock_release(uprobe_umem_prof->uclock);
+    umutex_release(uprobe_umem_prof->mutex);
+    umem_mgr_release(uprobe_umem_prof->umem_mgr);
+    uprobe_clean(uprobe);
+}
+
+#define ARGS_DECL struct uprobe *next, struct umem_mgr *umem_mgr, uint16_t ubuf_pool_depth, uint16_t shared_pool_depth, struct uclock *uclock, struct umutex *mutex
+#define ARGS next, umem_mgr, ubuf_pool_depth, shared_pool_depth, uclock, mutex
+UPROBE_HELPER_ALLOC(uprobe_umem_prof)
+#undef ARGS
+#undef ARGS_DECL
+
+/** @internal @This logs the hit ratio of a pool since the last report.
+ *
+ * @param uprobe pointer to probe
+ * @param index index of the pool
+ * @param stats current statistics of the pool
+ */
+static void uprobe_umem_prof_report_pool(struct uprobe *uprobe,
+                                         unsigned int index,
+                                         const struct umem_stats *stats)
+{
+    struct uprobe_umem_prof *uprobe_umem_prof =
+        uprobe_umem_prof_from_uprobe(uprobe);
+    if (index >= uprobe_umem_prof->nb_pools) {
+        struct umem_stats *pools = realloc(uprobe_umem_prof->pools,
+                                           (index + 1) * sizeof(*pools));
+        if (unlikely(pools == NULL))
+            return;
+        memset(pools + uprobe_umem_prof->nb_pools, 0,
+               (index + 1 - uprobe_umem_prof->nb_pools) * sizeof(*pools));
+        uprobe_umem_prof->pools = pools;
+        uprobe_umem_prof->nb_pools = index + 1;
+    }
+
+    struct umem_stats *last = &uprobe_umem_prof->pools[index];
+    /* counters wrap around */
+    uint32_t hits = stats->hits - last->hits;
+    uint32_t misses = stats->misses - last->misses;
+    *last = *stats;
+    if (!hits && !misses)
+        return;
+
+    uprobe_notice_va(uprobe, NULL,
+                     "pool %zu octets: %"PRIu32" hits, %"PRIu32" misses "
+                     "(%"PRIu64"%% hits)", stats->size, hits, misses,
+                     (uint64_t)hits * 100 / ((uint64_t)hits + misses));
+}
+
+/** @This logs the allocations attributed to each pipe, and the hit ratio of
+ * each pool of the memory allocator since the last report, with the notice
+ * level. Accounts of dead pipes are deleted once all their buffers are
+ * released.
+ *
+ * @param uprobe pointer to probe
+ */
+void uprobe_umem_prof_report(struct uprobe *uprobe)
+{
+    struct uprobe_umem_prof *uprobe_umem_prof =
+        uprobe_umem_prof_from_uprobe(uprobe);
+    struct uchain *uchain, *uchain_tmp;
+    umutex_lock(uprobe_umem_prof->mutex);
+    ulist_delete_foreach (&uprobe_umem_prof->accounts, uchain, uchain_tmp) {
+        struct uprobe_umem_prof_account *account =
+            uprobe_umem_prof_account_from_uchain(uchain);
+        struct umem_prof_stats stats;
+        umem_prof_mgr_get_stats_locked(account->umem_mgr, &stats);
+
+        unsigned int size = 0;
+        for (unsigned int i = 1; i < UMEM_PROF_SIZES; i++)
+            if (stats.sizes[i] > stats.sizes[size])
+                size = i;
+        char signature[4];
+        memcpy(signature, &account->signature, sizeof(signature));
+
+        uprobe_notice_va(uprobe, NULL,
+            "%.4s %p%s: %"PRIu64" allocations (+%"PRIu64"), "
+            "%"PRIu64" reallocations, %"PRIu64" octets, mostly %s %zu, "
+            "%"PRIu64" live (%"PRIu64" octets, peak %"PRIu64"), "
+            "mean lifetime %"PRIu64" us",
+            signature, account->upipe,
+            account->upipe == NULL ? " (dead)" : "",
+            stats.allocs, stats.allocs - account->last_allocs,
+            stats.reallocs, stats.bytes,
+            size == UMEM_PROF_SIZES - 1 ? ">" : "<=",
+            (size_t)UMEM_PROF_SIZE0 <<
+                (size == UMEM_PROF_SIZES - 1 ? size - 1 : size),
+            stats.live, stats.live_bytes, stats.peak_bytes,
+            stats.allocs ?
+                stats.lifetime / stats.allocs * 1000000 / UCLOCK_FREQ : 0);
+        account->last_allocs = stats.allocs;
+        if (account->upipe == NULL && !stats.live)
+            uprobe_umem_prof_account_free(account);
+    }
+
+    struct umem_stats stats;
+    for (unsigned int i = 0;
+         umem_mgr_stats(uprobe_umem_prof->umem_mgr, i, &stats); i++)
+        uprobe_umem_prof_report_pool(uprobe, i, &stats);
+    umutex_unlock(uprobe_umem_prof->mutex);
+}
+
+/** @internal @This is called periodically to log a report.
+ *
+ * @param upump description structure of the timer
+ */
+static void uprobe_umem_prof_timer(struct upump *upump)
+{
+    struct uprobe *uprobe = upump_get_opaque(upump, struct uprobe *);
+    uprobe_umem_prof_report(uprobe);
+}
+
+/** @This starts logging a report periodically.
+ *
+ * @param uprobe pointer to probe
+ * @param upump_mgr pump manager of the thread of the probe, or NULL to stop
+ * the periodic reports
+ * @param period period of the reports, in units of a 27 MHz clock
+ * @return an error code
+ */
+int uprobe_umem_prof_set_period(struct uprobe *uprobe,
+                                struct upump_mgr *upump_mgr, uint64_t period)
+{
+    struct uprobe_umem_prof *uprobe_umem_prof =
+        uprobe_umem_prof_from_uprobe(uprobe);
+    if (uprobe_umem_prof->upump != NULL) {
+        upump_stop(uprobe_umem_prof->upump);
+        upump_free(uprobe_umem_prof->upump);
+        uprobe_umem_prof->upump = NULL;
+    }
+    if (upump_mgr == NULL || !period)
+        return UBASE_ERR_NONE;
+
+    uprobe_umem_prof->upump =
+        upump_alloc_timer(upump_mgr, uprobe_umem_prof_timer, uprobe,
+                          uprobe->refcount, period, period);
+    if (unlikely(uprobe_umem_prof->upump == NULL))
+        return UBASE_ERR_UPUMP;
+    upump_start(uprobe_umem_prof->upump);
+    return UBASE_ERR_NONE;
+}
@@ -72,6 +72,9 @@ static int uprobe_upump_mgr_throw(struct uprobe *uprobe, struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+UPROBE_HELPER_EVENTS(uprobe_upump_mgr, UPROBE_NEED_UPUMP_MGR,
+                     UPROBE_FREEZE_UPUMP_MGR, UPROBE_THAW_UPUMP_MGR)
+
 /** @This initializes an already allocated uprobe_upump_mgr structure.
  *
  * @param uprobe_upump_mgr pointer to the already allocated structure
@@ -88,6 +91,7 @@ struct uprobe *uprobe_upump_mgr_init(struct uprobe_upump_mgr *uprobe_upump_mgr,
     uprobe_upump_mgr->upump_mgr = upump_mgr_use(upump_mgr);
     uprobe_upump_mgr->frozen = false;
     uprobe_init(uprobe, uprobe_upump_mgr_throw, next);
+    uprobe_upump_mgr_init_events(uprobe);
     return uprobe;
 }
 
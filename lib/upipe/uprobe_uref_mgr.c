@@ -65,6 +65,8 @@ static int uprobe_uref_mgr_throw(struct uprobe *uprobe, struct upipe *upipe,
                                      uref_mgr_use(uprobe_uref_mgr->uref_mgr));
 }
 
+UPROBE_HELPER_EVENTS(uprobe_uref_mgr, UPROBE_PROVIDE_REQUEST)
+
 /** @This initializes an already allocated uprobe_uref_mgr structure.
  *
  * @param uprobe_uref_mgr pointer to the already allocated structure
@@ -80,6 +82,7 @@ struct uprobe *uprobe_uref_mgr_init(struct uprobe_uref_mgr *uprobe_uref_mgr,
     struct uprobe *uprobe = uprobe_uref_mgr_to_uprobe(uprobe_uref_mgr);
     uprobe_uref_mgr->uref_mgr = uref_mgr_use(uref_mgr);
     uprobe_init(uprobe, uprobe_uref_mgr_throw, next);
+    uprobe_uref_mgr_init_events(uprobe);
     return uprobe;
 }
 
@@ -117,6 +117,18 @@ static void uref_std_mgr_vacuum(struct uref_mgr *mgr)
     upool_vacuum(&std_mgr->uref_pool);
 }
 
+/** @internal @This fills the pools of an existing uref standard manager, and
+ * of its udict manager, up to their configured depth.
+ *
+ * @param mgr pointer to a uref manager
+ */
+static void uref_std_mgr_prealloc(struct uref_mgr *mgr)
+{
+    struct uref_std_mgr *std_mgr = uref_std_mgr_from_uref_mgr(mgr);
+    upool_prealloc(&std_mgr->uref_pool);
+    udict_mgr_prealloc(mgr->udict_mgr);
+}
+
 /** @This processes control commands on a uref_std_mgr.
  *
  * @param mgr pointer to a uref_mgr structure
@@ -130,6 +142,9 @@ static int uref_std_mgr_control(struct uref_mgr *mgr, int command, va_list args)
         case UREF_MGR_VACUUM:
             uref_std_mgr_vacuum(mgr);
             return UBASE_ERR_NONE;
+        case UREF_MGR_PREALLOC:
+            uref_std_mgr_prealloc(mgr);
+            return UBASE_ERR_NONE;
         default:
             return UBASE_ERR_UNHANDLED;
     }
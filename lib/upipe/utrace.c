@@ -0,0 +1,369 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short Upipe sampled tracing of urefs across pipes and threads
+ */
+
+#include <upipe/ubase.h>
+#include <upipe/uatomic.h>
+#include <upipe/uref.h>
+#include <upipe/uref_trace.h>
+#include <upipe/upipe.h>
+#include <upipe/utrace.h>
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/** default number of events per thread */
+#define UTRACE_DEFAULT_SIZE 16384
+
+/** @This is a recorded event. */
+struct utrace_record {
+    /** monotonic date in nanoseconds */
+    uint64_t date;
+    /** trace ID */
+    uint64_t id;
+    /** pipe (only used as an identifier) */
+    const void *upipe;
+    /** signature of the pipe */
+    uint32_t signature;
+    /** type of event */
+    uint32_t event;
+};
+
+/** @This is the ring buffer of a thread. It is only written by its thread,
+ * and may be read concurrently by @ref utrace_export. */
+struct utrace_buffer {
+    /** next buffer in the list */
+    struct utrace_buffer *next;
+    /** thread number */
+    unsigned int tid;
+    /** last trace ID allocated by the thread */
+    uint32_t last_id;
+    /** number of events in the ring */
+    unsigned int size;
+    /** number of events written since the allocation */
+    uatomic_uint32_t written;
+    /** ring of events */
+    struct utrace_record records[];
+};
+
+/** sampling period, or 0 if disabled */
+unsigned int utrace_sampling = 0;
+
+/** protects the list of buffers */
+static pthread_mutex_t utrace_lock = PTHREAD_MUTEX_INITIALIZER;
+/** list of buffers */
+static struct utrace_buffer *utrace_buffers = NULL;
+/** number of events per buffer */
+static unsigned int utrace_size = UTRACE_DEFAULT_SIZE;
+/** number of threads which allocated a buffer */
+static unsigned int utrace_tids = 0;
+/** incremented by @ref utrace_clean to invalidate thread buffers */
+static unsigned int utrace_generation = 0;
+
+/** buffer of the current thread */
+static __thread struct utrace_buffer *utrace_local = NULL;
+/** generation of the buffer of the current thread */
+static __thread unsigned int utrace_local_generation = 0;
+/** urefs to skip before the next sampled one in the current thread */
+static __thread unsigned int utrace_countdown = 0;
+
+/** @internal @This returns the monotonic date.
+ *
+ * @return date in nanoseconds
+ */
+static uint64_t utrace_now(void)
+{
+    struct timespec ts;
+    if (unlikely(clock_gettime(CLOCK_MONOTONIC, &ts) == -1))
+        return 0;
+    return (uint64_t)ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+/** @internal @This returns the buffer of the current thread, and allocates
+ * it if needed.
+ *
+ * @return pointer to buffer, or NULL in case of allocation error
+ */
+static struct utrace_buffer *utrace_buffer(void)
+{
+    if (likely(utrace_local != NULL &&
+               utrace_local_generation == utrace_generation))
+        return utrace_local;
+
+    pthread_mutex_lock(&utrace_lock);
+    unsigned int size = utrace_size;
+    struct utrace_buffer *buffer = malloc(sizeof(struct utrace_buffer) +
+            size * sizeof(struct utrace_record));
+    if (unlikely(buffer == NULL)) {
+        pthread_mutex_unlock(&utrace_lock);
+        return NULL;
+    }
+    buffer->tid = ++utrace_tids;
+    buffer->last_id = 0;
+    buffer->size = size;
+    uatomic_init(&buffer->written, 0);
+    buffer->next = utrace_buffers;
+    utrace_buffers = buffer;
+    utrace_local = buffer;
+    utrace_local_generation = utrace_generation;
+    pthread_mutex_unlock(&utrace_lock);
+    return buffer;
+}
+
+/** @This records a trace event in the buffer of the current thread.
+ *
+ * @param upipe description structure of the pipe
+ * @param id trace ID
+ * @param event type of event
+ */
+void utrace_record(struct upipe *upipe, uint64_t id, enum utrace_event event)
+{
+    struct utrace_buffer *buffer = utrace_buffer();
+    if (unlikely(buffer == NULL))
+        return;
+
+    uint32_t written = uatomic_load(&buffer->written);
+    struct utrace_record *record = &buffer->records[written % buffer->size];
+    record->date = utrace_now();
+    record->id = id;
+    record->upipe = upipe;
+    record->signature = upipe->mgr != NULL ? upipe->mgr->signature : 0;
+    record->event = event;
+    /* publish the record to the reader */
+    uatomic_store(&buffer->written, written + 1);
+}
+
+/** @This returns the trace ID of a uref.
+ *
+ * @param uref uref structure
+ * @return trace ID, or 0 if the uref is not traced
+ */
+uint64_t utrace_uref_id(struct uref *uref)
+{
+    uint64_t id;
+    if (likely(!ubase_check(uref_trace_get_sampled(uref))) ||
+        unlikely(!ubase_check(uref_trace_get_id(uref, &id))))
+        return 0;
+    return id;
+}
+
+/** @This decides whether a uref entering a pipe is traced, and records the
+ * entry.
+ *
+ * @param upipe description structure of the pipe
+ * @param uref uref entering the pipe
+ * @return trace ID, or 0 if the uref is not traced
+ */
+uint64_t utrace_input_sample(struct upipe *upipe, struct uref *uref)
+{
+    uint64_t id;
+    if (ubase_check(uref_trace_get_seen(uref)))
+        id = utrace_uref_id(uref);
+    else if (uref->ubuf == NULL)
+        /* flow definitions and events are not sampled */
+        return 0;
+    else {
+        uref_trace_set_seen(uref);
+        if (likely(utrace_countdown)) {
+            utrace_countdown--;
+            return 0;
+        }
+        utrace_countdown = utrace_sampling - 1;
+
+        struct utrace_buffer *buffer = utrace_buffer();
+        if (unlikely(buffer == NULL))
+            return 0;
+        id = ((uint64_t)buffer->tid << 32) | ++buffer->last_id;
+        if (unlikely(!ubase_check(uref_trace_set_id(uref, id))))
+            return 0;
+        uref_trace_set_sampled(uref);
+    }
+
+    if (id)
+        utrace_record(upipe, id, UTRACE_INPUT_ENTER);
+    return id;
+}
+
+/** @This starts tracing.
+ *
+ * @param sampling one uref in sampling is traced (must not be 0)
+ * @param size number of events kept in the buffer of each thread, or 0 for
+ * the default
+ * @return an error code
+ */
+int utrace_start(unsigned int sampling, unsigned int size)
+{
+    if (unlikely(!sampling))
+        return UBASE_ERR_INVALID;
+    pthread_mutex_lock(&utrace_lock);
+    utrace_size = size ? size : UTRACE_DEFAULT_SIZE;
+    pthread_mutex_unlock(&utrace_lock);
+    utrace_sampling = sampling;
+    return UBASE_ERR_NONE;
+}
+
+/** @This stops tracing. */
+void utrace_stop(void)
+{
+    utrace_sampling = 0;
+}
+
+/** @internal @This prints the name of a pipe from its signature.
+ *
+ * @param file file to write to
+ * @param signature signature of the pipe
+ */
+static void utrace_export_name(FILE *file, uint32_t signature)
+{
+    /* signatures are defined with UBASE_FOURCC, in memory order */
+    char name[5];
+    memcpy(name, &signature, 4);
+    for (int i = 0; i < 4; i++)
+        if (!isprint((unsigned char)name[i]) || name[i] == '"' ||
+            name[i] == '\\')
+            name[i] = '?';
+    name[4] = '\0';
+    fprintf(file, "\"%s\"", name);
+}
+
+/** @internal @This exports the events of a buffer.
+ *
+ * @param file file to write to
+ * @param buffer thread buffer
+ * @param pid process ID
+ * @param first_p true if no event was written yet
+ * @return false in case of allocation error
+ */
+static bool utrace_export_buffer(FILE *file, struct utrace_buffer *buffer,
+                                 int pid, bool *first_p)
+{
+    uint32_t end = uatomic_load(&buffer->written);
+    uint32_t begin = end > buffer->size ? end - buffer->size : 0;
+    struct utrace_record *records =
+        malloc((end - begin) * sizeof(struct utrace_record));
+    if (unlikely(records == NULL && end != begin))
+        return false;
+    for (uint32_t i = begin; i != end; i++)
+        records[i - begin] = buffer->records[i % buffer->size];
+
+    /* drop the events that were overwritten while copying */
+    uint32_t written = uatomic_load(&buffer->written);
+    uint32_t first = written - begin > buffer->size ?
+                     written - buffer->size : begin;
+
+    fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+            "\"tid\":%u,\"args\":{\"name\":\"upipe thread %u\"}}",
+            *first_p ? "" : ",\n", pid, buffer->tid, buffer->tid);
+    *first_p = false;
+
+    unsigned int depth = 0;
+    for (uint32_t i = first; i != end; i++) {
+        struct utrace_record *record = &records[i - begin];
+        fprintf(file, ",\n{\"pid\":%d,\"tid\":%u,\"ts\":%"PRIu64".%03u,",
+                pid, buffer->tid, record->date / 1000,
+                (unsigned int)(record->date % 1000));
+        switch (record->event) {
+            case UTRACE_INPUT_ENTER:
+                depth++;
+                fprintf(file, "\"ph\":\"B\",\"name\":");
+                utrace_export_name(file, record->signature);
+                break;
+            case UTRACE_INPUT_EXIT:
+                if (!depth) {
+                    /* the entry was overwritten, replace with a marker */
+                    fprintf(file, "\"ph\":\"i\",\"s\":\"t\",\"name\":\"exit\"}");
+                    continue;
+                }
+                depth--;
+                fprintf(file, "\"ph\":\"E\"}");
+                continue;
+            case UTRACE_QUEUE_PUSH:
+                fprintf(file, "\"ph\":\"X\",\"dur\":0,\"name\":\"push\"");
+                break;
+            case UTRACE_QUEUE_POP:
+                fprintf(file, "\"ph\":\"X\",\"dur\":0,\"name\":\"pop\"");
+                break;
+        }
+        /* flow events bind the slices of the same uref together */
+        fprintf(file, ",\"cat\":\"upipe\",\"bind_id\":\"0x%"PRIx64"\","
+                "\"flow_in\":true,\"flow_out\":true,"
+                "\"args\":{\"pipe\":\"%p\",\"uref\":\"0x%"PRIx64"\"}}",
+                record->id, record->upipe, record->id);
+    }
+
+    free(records);
+    return true;
+}
+
+/** @This writes the recorded events to a file in the Chrome trace event
+ * JSON format.
+ *
+ * @param file file to write to
+ * @return an error code
+ */
+int utrace_export(FILE *file)
+{
+    int pid = getpid();
+    bool first = true;
+    int err = UBASE_ERR_NONE;
+
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    pthread_mutex_lock(&utrace_lock);
+    for (struct utrace_buffer *buffer = utrace_buffers; buffer != NULL;
+         buffer = buffer->next)
+        if (unlikely(!utrace_export_buffer(file, buffer, pid, &first))) {
+            err = UBASE_ERR_ALLOC;
+            break;
+        }
+    pthread_mutex_unlock(&utrace_lock);
+    fprintf(file, "\n]}\n");
+
+    if (ubase_check(err) && ferror(file))
+        err = UBASE_ERR_EXTERNAL;
+    return err;
+}
+
+/** @This frees the buffers of all threads. */
+void utrace_clean(void)
+{
+    pthread_mutex_lock(&utrace_lock);
+    while (utrace_buffers != NULL) {
+        struct utrace_buffer *buffer = utrace_buffers;
+        utrace_buffers = buffer->next;
+        uatomic_clean(&buffer->written);
+        free(buffer);
+    }
+    utrace_tids = 0;
+    utrace_generation++;
+    pthread_mutex_unlock(&utrace_lock);
+}
@@ -28,6 +28,7 @@
  */
 
 #include <upipe/ubase.h>
+#include <upipe/ulist.h>
 #include <upipe/urefcount.h>
 #include <upipe/uclock.h>
 #include <upipe/umutex.h>
@@ -49,6 +50,8 @@ struct upump_ev_mgr {
     struct ev_loop *ev_loop;
     /** true if the loop has to be destroyed at the end */
     bool destroy;
+    /** list of running timers of high priority */
+    struct uchain high_timers;
 
     /** common structure */
     struct upump_common_mgr common_mgr;
@@ -65,6 +68,10 @@ UBASE_FROM_TO(upump_ev_mgr, urefcount, urefcount, urefcount)
 struct upump_ev {
     /** type of event to watch */
     int event;
+    /** priority class */
+    int priority;
+    /** structure for the list of running timers of high priority */
+    struct uchain uchain;
 
     /** ev private structure */
     union {
@@ -79,6 +86,34 @@ struct upump_ev {
 };
 
 UBASE_FROM_TO(upump_ev, upump, upump, common.upump)
+UBASE_FROM_TO(upump_ev, uchain, uchain, uchain)
+
+/** @internal @This checks if a pump must be postponed because a timer of
+ * high priority is overdue. Only level-triggered pumps (idlers and file
+ * descriptors) may be postponed, as they are dispatched again on the next
+ * iteration of the loop, after the timer.
+ *
+ * @param upump_ev pointer to upump_ev
+ * @return true if the pump must be postponed
+ */
+static bool upump_ev_postpone(struct upump_ev *upump_ev)
+{
+    struct upump_ev_mgr *ev_mgr =
+        upump_ev_mgr_from_upump_mgr(upump_ev->common.upump.mgr);
+    if (likely(ulist_empty(&ev_mgr->high_timers)) ||
+        upump_ev->priority >= UPUMP_PRIORITY_HIGH)
+        return false;
+
+    ev_now_update(ev_mgr->ev_loop);
+    struct uchain *uchain;
+    ulist_foreach (&ev_mgr->high_timers, uchain) {
+        struct upump_ev *timer = upump_ev_from_uchain(uchain);
+        if (ev_is_active(&timer->ev_timer) &&
+            ev_timer_remaining(ev_mgr->ev_loop, &timer->ev_timer) <= 0.)
+            return true;
+    }
+    return false;
+}
 
 /** @This dispatches an event to a pump for type ev_io.
  *
@@ -90,6 +125,8 @@ static void upump_ev_dispatch_io(struct ev_loop *ev_loop,
                                  struct ev_io *ev_io, int revents)
 {
     struct upump_ev *upump_ev = container_of(ev_io, struct upump_ev, ev_io);
+    if (upump_ev_postpone(upump_ev))
+        return;
     struct upump *upump = upump_ev_to_upump(upump_ev);
     upump_common_dispatch(upump);
 }
@@ -119,6 +156,8 @@ static void upump_ev_dispatch_idle(struct ev_loop *ev_loop,
                                    struct ev_idle *ev_idle, int revents)
 {
     struct upump_ev *upump_ev = container_of(ev_idle, struct upump_ev, ev_idle);
+    if (upump_ev_postpone(upump_ev))
+        return;
     struct upump *upump = upump_ev_to_upump(upump_ev);
     upump_common_dispatch(upump);
 }
@@ -189,6 +228,8 @@ static struct upump *upump_ev_alloc(struct upump_mgr *mgr,
             return NULL;
     }
     upump_ev->event = event;
+    upump_ev->priority = UPUMP_PRIORITY_NORMAL;
+    uchain_init(&upump_ev->uchain);
 
     upump_common_init(upump);
 
@@ -211,6 +252,9 @@ static void upump_ev_real_start(struct upump *upump, bool status)
             break;
         case UPUMP_TYPE_TIMER:
             ev_timer_start(ev_mgr->ev_loop, &upump_ev->ev_timer);
+            if (upump_ev->priority >= UPUMP_PRIORITY_HIGH &&
+                !ulist_is_in(&upump_ev->uchain))
+                ulist_add(&ev_mgr->high_timers, &upump_ev->uchain);
             break;
         case UPUMP_TYPE_FD_READ:
         case UPUMP_TYPE_FD_WRITE:
@@ -244,6 +288,8 @@ static void upump_ev_real_stop(struct upump *upump, bool status)
             break;
         case UPUMP_TYPE_TIMER:
             ev_timer_stop(ev_mgr->ev_loop, &upump_ev->ev_timer);
+            if (ulist_is_in(&upump_ev->uchain))
+                ulist_delete(&upump_ev->uchain);
             break;
         case UPUMP_TYPE_FD_READ:
         case UPUMP_TYPE_FD_WRITE:
@@ -273,6 +319,9 @@ static void upump_ev_real_restart(struct upump *upump, bool status)
             ev_timer_again(ev_mgr->ev_loop, &upump_ev->ev_timer);
             if (!active && !status)
                 ev_unref(ev_mgr->ev_loop);
+            if (upump_ev->priority >= UPUMP_PRIORITY_HIGH &&
+                !ulist_is_in(&upump_ev->uchain))
+                ulist_add(&ev_mgr->high_timers, &upump_ev->uchain);
             break;
         }
         default:
@@ -280,6 +329,27 @@ static void upump_ev_real_restart(struct upump *upump, bool status)
     }
 }
 
+/** @This sets the priority of a pump, which must be inactive in libev.
+ *
+ * @param upump description structure of the pump
+ * @param priority priority class
+ */
+static void upump_ev_set_priority(struct upump *upump, int priority)
+{
+    struct upump_ev *upump_ev = upump_ev_from_upump(upump);
+    bool status = upump_ev->common.status;
+    /* all watchers share the same header */
+    bool active = ev_is_active(&upump_ev->ev_idle);
+
+    if (active)
+        upump_ev_real_stop(upump, status);
+    upump_ev->priority = priority;
+    ev_set_priority(&upump_ev->ev_idle,
+                    ubase_clip(priority, EV_MINPRI, EV_MAXPRI));
+    if (active)
+        upump_ev_real_start(upump, status);
+}
+
 /** @This released the memory space previously used by a pump.
  * Please note that the pump must be stopped before.
  *
@@ -353,6 +423,16 @@ static int upump_ev_control(struct upump *upump, int command, va_list args)
             upump_common_set_status(upump, status);
             return UBASE_ERR_NONE;
         }
+        case UPUMP_GET_PRIORITY: {
+            int *priority_p = va_arg(args, int *);
+            *priority_p = upump_ev_from_upump(upump)->priority;
+            return UBASE_ERR_NONE;
+        }
+        case UPUMP_SET_PRIORITY: {
+            int priority = va_arg(args, int);
+            upump_ev_set_priority(upump, priority);
+            return UBASE_ERR_NONE;
+        }
         case UPUMP_ALLOC_BLOCKER: {
             struct upump_blocker **p = va_arg(args, struct upump_blocker **);
             *p = upump_common_blocker_alloc(upump);
@@ -492,6 +572,7 @@ struct upump_mgr *upump_ev_mgr_alloc(struct ev_loop *ev_loop,
 
     ev_mgr->ev_loop = ev_loop;
     ev_mgr->destroy = false;
+    ulist_init(&ev_mgr->high_timers);
     return mgr;
 }
 
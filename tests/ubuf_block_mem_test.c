@@ -38,6 +38,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <assert.h>
 
 #define UBUF_POOL_DEPTH     1
@@ -46,6 +47,22 @@
 #define UBUF_ALIGN          16
 #define UBUF_ALIGN_OFFSET   0
 #define UBUF_SIZE           188
+#define UBUF_DUP_LOOPS      100000
+
+/** measures the cost of a dup/free cycle, in nanoseconds */
+static double bench_dup(struct ubuf *ubuf)
+{
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < UBUF_DUP_LOOPS; i++) {
+        struct ubuf *dup = ubuf_dup(ubuf);
+        assert(dup != NULL);
+        ubuf_free(dup);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return ((end.tv_sec - start.tv_sec) * 1e9 +
+            (end.tv_nsec - start.tv_nsec)) / UBUF_DUP_LOOPS;
+}
 
 int main(int argc, char **argv)
 {
@@ -312,6 +329,32 @@ int main(int argc, char **argv)
     ubuf_free(ubuf1);
     ubuf_free(ubuf2);
 
+    /* test thread-confined buffers */
+    ubuf1 = ubuf_block_alloc(mgr, UBUF_SIZE);
+    assert(ubuf1 != NULL);
+    double atomic_ns = bench_dup(ubuf1);
+    ubuf_free(ubuf1);
+
+    ubase_assert(ubuf_mgr_confine(mgr));
+    ubuf1 = ubuf_block_alloc(mgr, UBUF_SIZE);
+    assert(ubuf1 != NULL);
+    double confined_ns = bench_dup(ubuf1);
+    printf("dup/free: %.1f ns atomic, %.1f ns confined\n",
+           atomic_ns, confined_ns);
+
+    ubuf2 = ubuf_dup(ubuf1);
+    assert(ubuf2 != NULL);
+    assert(!ubase_check(ubuf_control(ubuf1, UBUF_SINGLE)));
+    ubase_assert(ubuf_block_append(ubuf2, ubuf_block_alloc(mgr, UBUF_SIZE)));
+    ubase_assert(ubuf_unconfine(ubuf2));
+    ubuf_free(ubuf2);
+    ubase_assert(ubuf_control(ubuf1, UBUF_SINGLE));
+    ubuf2 = ubuf_dup(ubuf1);
+    assert(ubuf2 != NULL);
+    ubuf_free(ubuf1);
+    ubase_assert(ubuf_control(ubuf2, UBUF_SINGLE));
+    ubuf_free(ubuf2);
+
     ubuf_mgr_release(mgr);
     umem_mgr_release(umem_mgr);
     return 0;
@@ -224,9 +224,29 @@ int main(int argc, char **argv)
     assert(r[0] == 'l');
 
     ubuf_free(ubuf_block);
-    ubuf_mgr_release(block_mgr);
     ubuf_free(ubuf1);
 
+    /* thread-confined buffers, shared with a block mapping a plane */
+    ubase_assert(ubuf_mgr_confine(mgr));
+    ubuf1 = ubuf_sound_alloc(mgr, 32);
+    assert(ubuf1 != NULL);
+    ubuf2 = ubuf_dup(ubuf1);
+    assert(ubuf2 != NULL);
+    ubuf_block = ubuf_block_mem_alloc_from_sound(block_mgr, ubuf1, "lr");
+    assert(ubuf_block != NULL);
+    assert(!ubase_check(ubuf_sound_plane_write_uint8_t(ubuf1, "lr", 0, -1,
+                                                       &w)));
+    ubase_assert(ubuf_unconfine(ubuf_block));
+    ubuf_free(ubuf2);
+    assert(!ubase_check(ubuf_sound_plane_write_uint8_t(ubuf1, "lr", 0, -1,
+                                                       &w)));
+    ubuf_free(ubuf_block);
+    ubase_assert(ubuf_sound_plane_write_uint8_t(ubuf1, "lr", 0, -1, &w));
+    ubase_assert(ubuf_sound_plane_unmap(ubuf1, "lr", 0, -1));
+    ubase_assert(ubuf_unconfine(ubuf1));
+    ubuf_free(ubuf1);
+
+    ubuf_mgr_release(block_mgr);
     ubuf_mgr_release(mgr);
     umem_mgr_release(umem_mgr);
     return 0;
@@ -48,6 +48,7 @@
 #define UPUMP_BLOCKER_POOL 1
 #define NB_LOOPS 1000
 #define NB_TIMEOUTS 10
+#define NB_WAITS 100
 
 static const long nsec_timeouts[NB_TIMEOUTS] = {
     0, 1000000, 5000000, 0, 50000, 0, 0, 10000000, 5000, 0
@@ -120,6 +121,18 @@ static void *test_thread(void *_thread)
     return NULL;
 }
 
+static void *test_wait_thread(void *unused)
+{
+    /* no event loop, like a manager freeing resources */
+    for (int i = 0; i < NB_WAITS; i++) {
+        udeal_wait(&udeal);
+        counter++;
+        udeal_release(&udeal);
+        sched_yield();
+    }
+    return NULL;
+}
+
 int main(int argc, char **argv)
 {
     if (argc > 1)
@@ -132,11 +145,14 @@ int main(int argc, char **argv)
     threads[1].thread = 1;
     assert(pthread_create(&threads[0].id, NULL, test_thread, &threads[0]) == 0);
     assert(pthread_create(&threads[1].id, NULL, test_thread, &threads[1]) == 0);
+    pthread_t wait_id;
+    assert(pthread_create(&wait_id, NULL, test_wait_thread, NULL) == 0);
 
     assert(!pthread_join(threads[0].id, NULL));
     assert(!pthread_join(threads[1].id, NULL));
+    assert(!pthread_join(wait_id, NULL));
 
-    assert(counter == nb_loops);
+    assert(counter == nb_loops + NB_WAITS);
     udeal_clean(&udeal);
 
     return 0;
@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for ujob_mgr_pthread implementation
+ */
+
+#undef NDEBUG
+
+#include <upipe/ubase.h>
+#include <upipe/ujob.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_ujob_mgr.h>
+#include <upipe/upipe.h>
+#include <upipe-pthread/ujob_mgr_pthread.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <assert.h>
+
+#define NB_THREADS 4
+#define NB_JOBS 37
+#define NB_LINES 1080
+#define ALIGN 2
+#define BENCH_WIDTH 3840
+#define BENCH_HEIGHT 2160
+#define BENCH_LOOPS 20
+
+static unsigned int jobs[NB_JOBS];
+static unsigned int lines[NB_LINES];
+
+/** job counting its executions */
+static void test_job(void *opaque, unsigned int job, unsigned int nb_jobs)
+{
+    assert(opaque == jobs);
+    assert(nb_jobs == NB_JOBS);
+    assert(job < NB_JOBS);
+    jobs[job]++;
+}
+
+/** band counting the executions of its lines */
+static void test_band(void *opaque, size_t line, size_t nb_lines)
+{
+    assert(opaque == lines);
+    assert(line % ALIGN == 0);
+    assert(line + nb_lines <= NB_LINES);
+    for (size_t i = line; i < line + nb_lines; i++)
+        lines[i]++;
+}
+
+/** picture processed by the benchmark */
+struct bench_pic {
+    const uint8_t *in;
+    uint8_t *out;
+};
+
+/** band computing the mean of two consecutive lines, like a deinterlacer */
+static void bench_band(void *opaque, size_t line, size_t nb_lines)
+{
+    struct bench_pic *pic = opaque;
+    for (size_t i = line; i < line + nb_lines; i++) {
+        const uint8_t *s1 = pic->in + i * BENCH_WIDTH;
+        const uint8_t *s2 = i + 1 < BENCH_HEIGHT ? s1 + BENCH_WIDTH : s1;
+        uint8_t *d = pic->out + i * BENCH_WIDTH;
+        for (size_t j = 0; j < BENCH_WIDTH; j++)
+            d[j] = (s1[j] + s2[j]) >> 1;
+    }
+}
+
+/** returns a monotonic date in microseconds */
+static uint64_t bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/** runs the benchmark with the given ujob manager */
+static void bench(struct ujob_mgr *ujob_mgr, unsigned int nb_threads,
+                  struct bench_pic *pic)
+{
+    uint64_t start = bench_now();
+    for (int i = 0; i < BENCH_LOOPS; i++)
+        ubase_assert(ujob_mgr_run_bands(ujob_mgr, BENCH_HEIGHT, 1,
+                                        bench_band, pic));
+    uint64_t duration = bench_now() - start;
+    printf("%ux%u blend, %u thread(s): %"PRIu64" us/frame\n",
+           BENCH_WIDTH, BENCH_HEIGHT, nb_threads, duration / BENCH_LOOPS);
+}
+
+/** helper phony pipe to test uprobe_ujob_mgr */
+static struct upipe *uprobe_test_alloc(struct upipe_mgr *mgr,
+                                       struct uprobe *uprobe,
+                                       uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    return upipe;
+}
+
+/** helper phony pipe to test uprobe_ujob_mgr */
+static void uprobe_test_free(struct upipe *upipe)
+{
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe to test uprobe_ujob_mgr */
+static struct upipe_mgr uprobe_test_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = uprobe_test_alloc,
+    .upipe_input = NULL,
+    .upipe_control = NULL
+};
+
+int main(int argc, char **argv)
+{
+    struct ujob_mgr *ujob_mgr = ujob_mgr_pthread_alloc(NB_THREADS);
+    assert(ujob_mgr != NULL);
+    assert(ujob_mgr->nb_threads == NB_THREADS);
+
+    /* every job runs exactly once */
+    for (int i = 0; i < 10; i++) {
+        memset(jobs, 0, sizeof(jobs));
+        ubase_assert(ujob_mgr_run(ujob_mgr, test_job, jobs, NB_JOBS));
+        for (int j = 0; j < NB_JOBS; j++)
+            assert(jobs[j] == 1);
+    }
+
+    /* bands cover every line exactly once */
+    memset(lines, 0, sizeof(lines));
+    ubase_assert(ujob_mgr_run_bands(ujob_mgr, NB_LINES, ALIGN,
+                                    test_band, lines));
+    for (int i = 0; i < NB_LINES; i++)
+        assert(lines[i] == 1);
+
+    /* without manager, bands are run sequentially */
+    memset(lines, 0, sizeof(lines));
+    ubase_assert(ujob_mgr_run_bands(NULL, NB_LINES, ALIGN, test_band, lines));
+    for (int i = 0; i < NB_LINES; i++)
+        assert(lines[i] == 1);
+
+    /* the probe provides the manager to pipes */
+    struct uprobe *uprobe = uprobe_stdio_alloc(NULL, stdout,
+                                               UPROBE_LOG_VERBOSE);
+    assert(uprobe != NULL);
+    uprobe = uprobe_ujob_mgr_alloc(uprobe, ujob_mgr);
+    assert(uprobe != NULL);
+    struct upipe *upipe = upipe_void_alloc(&uprobe_test_mgr,
+                                           uprobe_use(uprobe));
+    assert(upipe != NULL);
+    struct ujob_mgr *m = NULL;
+    ubase_assert(upipe_throw_need_ujob_mgr(upipe, &m));
+    assert(m == ujob_mgr);
+    ujob_mgr_release(m);
+    uprobe_test_free(upipe);
+
+    /* scaling of a 4K picture */
+    uint8_t *in = malloc(BENCH_WIDTH * BENCH_HEIGHT);
+    uint8_t *out = malloc(BENCH_WIDTH * BENCH_HEIGHT);
+    assert(in != NULL && out != NULL);
+    for (int i = 0; i < BENCH_WIDTH * BENCH_HEIGHT; i++)
+        in[i] = i;
+    struct bench_pic pic = { .in = in, .out = out };
+    bench(NULL, 1, &pic);
+    for (unsigned int nb_threads = 2; nb_threads <= NB_THREADS;
+         nb_threads *= 2) {
+        struct ujob_mgr *bench_mgr = ujob_mgr_pthread_alloc(nb_threads);
+        assert(bench_mgr != NULL);
+        bench(bench_mgr, nb_threads, &pic);
+        ujob_mgr_release(bench_mgr);
+    }
+    free(in);
+    free(out);
+
+    ujob_mgr_release(ujob_mgr);
+    uprobe_release(uprobe);
+    return 0;
+}
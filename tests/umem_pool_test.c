@@ -87,6 +87,26 @@ int main(int argc, char **argv)
     umem_free(&umem);
     printf("Passed 6\n");
 
+    umem_mgr_release(mgr);
+
+    mgr = umem_pool_mgr_alloc(32, 2, 4, 4);
+    assert(mgr != NULL);
+    umem_mgr_prealloc(mgr);
+    /* start the counters */
+    struct umem_stats stats;
+    assert(umem_mgr_stats(mgr, 1, &stats));
+    assert(stats.hits == 0);
+    struct umem umems[4];
+    for (int i = 0; i < 4; i++)
+        assert(umem_alloc(mgr, &umems[i], 64));
+    assert(umem_mgr_stats(mgr, 1, &stats));
+    assert(stats.size == 64);
+    assert(stats.hits == 4);
+    assert(stats.misses == 0);
+    for (int i = 0; i < 4; i++)
+        umem_free(&umems[i]);
+    printf("Passed 7\n");
+
     umem_mgr_release(mgr);
     return 0;
 }
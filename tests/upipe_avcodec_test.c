@@ -54,6 +54,7 @@
 #include <upipe/uref_sound_flow.h>
 #include <upipe/uref_dump.h>
 #include <upipe/upump.h>
+#include <upipe/ulist.h>
 #include <upump-ev/upump_ev.h>
 #include <upipe-av/upipe_av.h>
 #include <upipe-av/upipe_avcodec_decode.h>
@@ -71,6 +72,7 @@ UREF_ATTR_INT(xflow, num, "x.f.num", flow num)
 #include <stdbool.h>
 #include <assert.h>
 #include <pthread.h>
+#include <time.h>
 
 #define UPUMP_POOL 0
 #define UPUMP_BLOCKER_POOL 0
@@ -86,6 +88,8 @@ UREF_ATTR_INT(xflow, num, "x.f.num", flow num)
 #define THREAD_FRAMES_LIMIT (FRAMES_LIMIT / 8)
 #define WIDTH 120
 #define HEIGHT 90
+#define SWITCH_NUM          4
+#define SWITCH_PACKETS      25
 #define STREAM stdout
 
 enum uprobe_log_level loglevel = UPROBE_LOG_VERBOSE;
@@ -164,6 +168,85 @@ static int catch_avcenc(struct uprobe *uprobe, struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/** encoded packets used for the decoder switch test */
+static struct uchain packets;
+/** flow definition of the encoded packets */
+static struct uref *packets_flow_def = NULL;
+/** number of decoded pictures */
+static unsigned int nb_pics = 0;
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    return upipe;
+}
+
+/** helper phony pipe storing encoded packets */
+static void capture_input(struct upipe *upipe, struct uref *uref,
+                          struct upump **upump_p)
+{
+    ulist_add(&packets, uref_to_uchain(uref));
+}
+
+/** helper phony pipe counting decoded pictures */
+static void count_input(struct upipe *upipe, struct uref *uref,
+                        struct upump **upump_p)
+{
+    nb_pics++;
+    uref_free(uref);
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            if (upipe->mgr->upipe_input == capture_input) {
+                uref_free(packets_flow_def);
+                packets_flow_def = uref_dup(flow_def);
+            }
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_throw_dead(upipe);
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe storing encoded packets */
+static struct upipe_mgr capture_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc,
+    .upipe_input = capture_input,
+    .upipe_control = test_control
+};
+
+/** helper phony pipe counting decoded pictures */
+static struct upipe_mgr count_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc,
+    .upipe_input = count_input,
+    .upipe_control = test_control
+};
+
 /* fill picture with some stuff */
 static void fill_pic(struct ubuf *ubuf)
 {
@@ -395,6 +478,101 @@ int main(int argc, char **argv)
     upipe_release(avcenc);
     printf("Everything good so far, cleaning\n");
 
+    /* decoder switch test: encode packets once, then measure the time to
+     * the first decoded picture for a new decoder, without and with the
+     * pool of warm contexts */
+    ulist_init(&packets);
+    flow = uref_pic_flow_alloc_def(uref_mgr, 1);
+    assert(flow != NULL);
+    ubase_assert(uref_pic_flow_add_plane(flow, 1, 1, 1, "y8"));
+    ubase_assert(uref_pic_flow_add_plane(flow, 2, 2, 1, "u8"));
+    ubase_assert(uref_pic_flow_add_plane(flow, 2, 2, 1, "v8"));
+    ubase_assert(uref_pic_flow_set_hsize(flow, WIDTH));
+    ubase_assert(uref_pic_flow_set_vsize(flow, HEIGHT));
+    ubase_assert(uref_pic_flow_set_fps(flow, fps));
+    struct uref *output_flow = uref_dup(flow);
+    assert(output_flow != NULL);
+    ubase_assert(uref_flow_set_def(output_flow, "block.mpeg2video.pic."));
+    avcenc = upipe_flow_alloc(upipe_avcenc_mgr,
+        uprobe_pfx_alloc(uprobe_use(logger), loglevel, "avcenc switch"),
+        output_flow);
+    assert(avcenc != NULL);
+    uref_free(output_flow);
+    ubase_assert(upipe_set_flow_def(avcenc, flow));
+    uref_free(flow);
+    struct upipe *capture = upipe_void_alloc(&capture_mgr,
+                                             uprobe_use(logger));
+    assert(capture != NULL);
+    ubase_assert(upipe_set_output(avcenc, capture));
+    for (i = 0; i < SWITCH_PACKETS; i++) {
+        pic = uref_pic_alloc(uref_mgr, pic_mgr, WIDTH, HEIGHT);
+        assert(pic != NULL);
+        fill_pic(pic->ubuf);
+        upipe_input(avcenc, pic, NULL);
+    }
+    upipe_release(avcenc);
+    test_free(capture);
+    assert(packets_flow_def != NULL);
+    assert(!ulist_empty(&packets));
+
+    struct upipe *count = upipe_void_alloc(&count_mgr, uprobe_use(logger));
+    assert(count != NULL);
+    unsigned int pool_size;
+    for (i = 0; i < 2 * SWITCH_NUM; i++) {
+        /* the last cold decoder fills the pool for the next ones */
+        bool warm = i >= SWITCH_NUM;
+        if (i == SWITCH_NUM - 1) {
+            unsigned int pool_depth;
+            ubase_assert(upipe_avcdec_mgr_set_pool(upipe_avcdec_mgr, 1,
+                                                   NULL));
+            ubase_assert(upipe_avcdec_mgr_get_pool_depth(upipe_avcdec_mgr,
+                                                         &pool_depth));
+            assert(pool_depth == 1);
+        }
+
+        struct timespec begin, end;
+        clock_gettime(CLOCK_MONOTONIC, &begin);
+        nb_pics = 0;
+        struct upipe *avcdec = upipe_void_alloc(upipe_avcdec_mgr,
+            uprobe_pfx_alloc_va(uprobe_use(logger), loglevel,
+                                "avcdec switch %d", i));
+        assert(avcdec != NULL);
+        ubase_assert(upipe_set_output(avcdec, count));
+        ubase_assert(upipe_set_flow_def(avcdec, packets_flow_def));
+        struct uchain *uchain;
+        ulist_foreach (&packets, uchain) {
+            upipe_input(avcdec, uref_dup(uref_from_uchain(uchain)), NULL);
+            if (nb_pics)
+                break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        assert(nb_pics);
+        /* a warm decoder took the context released by the previous one */
+        ubase_assert(upipe_avcdec_mgr_get_pool_size(upipe_avcdec_mgr,
+                                                    &pool_size));
+        assert(pool_size == 0);
+        printf("%s switch %d: first picture after %"PRId64" us\n",
+               warm ? "warm" : "cold", i,
+               (int64_t)(end.tv_sec - begin.tv_sec) * 1000000 +
+               (end.tv_nsec - begin.tv_nsec) / 1000);
+        upipe_release(avcdec);
+        ubase_assert(upipe_avcdec_mgr_get_pool_size(upipe_avcdec_mgr,
+                                                    &pool_size));
+        assert(pool_size == (i >= SWITCH_NUM - 1 ? 1 : 0));
+    }
+    test_free(count);
+    ubase_assert(upipe_mgr_vacuum(upipe_avcdec_mgr));
+    ubase_assert(upipe_avcdec_mgr_get_pool_size(upipe_avcdec_mgr,
+                                                &pool_size));
+    assert(pool_size == 0);
+
+    struct uchain *uchain, *uchain_tmp;
+    ulist_delete_foreach (&packets, uchain, uchain_tmp) {
+        ulist_delete(uchain);
+        uref_free(uref_from_uchain(uchain));
+    }
+    uref_free(packets_flow_def);
+
     /* clean managers and probes */
     upipe_mgr_release(upipe_avcdec_mgr);
     upipe_mgr_release(upipe_avcenc_mgr);
@@ -76,9 +76,12 @@
 static struct uprobe *logger;
 static struct upipe *upipe_avfsrc;
 static struct upipe *upipe_avfsink;
+static bool src_stalled = false;
+static bool sink_stalled = false;
 
 static void usage(const char *argv0) {
-    fprintf(stdout, "Usage: %s <source file> <sink file>\n", argv0);
+    fprintf(stdout, "Usage: %s [-b <I/O buffer>] <source file> <sink file>\n",
+            argv0);
     exit(EXIT_FAILURE);
 }
 
@@ -86,6 +89,37 @@ static void usage(const char *argv0) {
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
                  int event, va_list args)
 {
+    if (event >= UPROBE_LOCAL) {
+        uint32_t signature = ubase_get_signature(args);
+        if (signature == UPIPE_AVFSRC_SIGNATURE) {
+            switch (event) {
+                case UPROBE_AVFSRC_STALLED:
+                    assert(!src_stalled);
+                    src_stalled = true;
+                    return UBASE_ERR_NONE;
+                case UPROBE_AVFSRC_RESUMED:
+                    assert(src_stalled);
+                    src_stalled = false;
+                    return UBASE_ERR_NONE;
+            }
+        } else if (signature == UPIPE_AVFSINK_SIGNATURE) {
+            switch (event) {
+                case UPROBE_AVFSINK_TS_OFFSET:
+                    return UBASE_ERR_NONE;
+                case UPROBE_AVFSINK_STALLED:
+                    assert(!sink_stalled);
+                    sink_stalled = true;
+                    return UBASE_ERR_NONE;
+                case UPROBE_AVFSINK_RESUMED:
+                    assert(sink_stalled);
+                    sink_stalled = false;
+                    return UBASE_ERR_NONE;
+            }
+        }
+        assert(0);
+        return UBASE_ERR_UNHANDLED;
+    }
+
     switch (event) {
         default:
             assert(0);
@@ -140,6 +174,18 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe,
 int main(int argc, char *argv[])
 {
     const char *src_url, *sink_url;
+    uint64_t io_buffer = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:")) != -1) {
+        switch (opt) {
+            case 'b':
+                io_buffer = strtoull(optarg, NULL, 0);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
 
     if (optind >= argc -1)
         usage(argv[0]);
@@ -176,6 +222,7 @@ int main(int argc, char *argv[])
     upipe_avfsink = upipe_void_alloc(upipe_avfsink_mgr,
             uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "avfsink"));
     assert(upipe_avfsink != NULL);
+    ubase_assert(upipe_avfsink_set_io_buffer(upipe_avfsink, io_buffer));
     ubase_assert(upipe_set_uri(upipe_avfsink, sink_url));
 
     struct upipe_mgr *upipe_avfsrc_mgr = upipe_avfsrc_mgr_alloc();
@@ -183,11 +230,13 @@ int main(int argc, char *argv[])
     upipe_avfsrc = upipe_void_alloc(upipe_avfsrc_mgr,
             uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "avfsrc"));
     assert(upipe_avfsrc != NULL);
+    ubase_assert(upipe_avfsrc_set_io_buffer(upipe_avfsrc, io_buffer));
     ubase_assert(upipe_set_uri(upipe_avfsrc, src_url));
 
     upump_mgr_run(upump_mgr, NULL);
 
     upipe_mgr_release(upipe_avfsrc_mgr); // nop
+    assert(!src_stalled);
 
     uint64_t duration;
     ubase_assert(upipe_avfsink_get_duration(upipe_avfsink, &duration));
@@ -195,6 +244,7 @@ int main(int argc, char *argv[])
 
     upipe_release(upipe_avfsink);
     upipe_mgr_release(upipe_avfsink_mgr); // nop
+    assert(!sink_stalled);
 
     upipe_av_clean();
 
@@ -0,0 +1,17 @@
+#!/bin/sh
+
+set -e
+
+srcdir="$1"
+
+TMP="`mktemp -d tmp.XXXXXXXXXX`"
+cleanup() { rm -rf "$TMP"; }
+trap cleanup EXIT
+
+# blocking I/O
+"$srcdir"/valgrind_wrapper.sh "$srcdir" ./upipe_avformat_test "$srcdir"/upipe_ts_test.ts "$TMP"/test.ts
+test -s "$TMP"/test.ts
+
+# I/O threads, with a buffer small enough to stall
+"$srcdir"/valgrind_wrapper.sh "$srcdir" ./upipe_avformat_test -b 4096 "$srcdir"/upipe_ts_test.ts "$TMP"/test_aio.ts
+test -s "$TMP"/test_aio.ts
@@ -23,6 +23,11 @@
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+/** @file
+ * @short unit tests for ebur128 pipe, using the EBU Tech 3341 and 3342
+ * minimum requirements test signals
+ */
+
 #undef NDEBUG
 
 #include <upipe/uprobe.h>
@@ -37,12 +42,13 @@
 #include <upipe/uref.h>
 #include <upipe/uref_std.h>
 #include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
 #include <upipe/uref_sound.h>
 #include <upipe/uref_sound_flow.h>
 #include <upipe/uref_clock.h>
 #include <upipe/ubuf_sound_mem.h>
 #include <upipe-ebur128/upipe_ebur128.h>
-#include <upipe-modules/upipe_null.h>
 
 #include <stdio.h>
 #include <string.h>
@@ -54,16 +60,21 @@
 #define UDICT_POOL_DEPTH    5
 #define UREF_POOL_DEPTH     5
 #define UBUF_POOL_DEPTH     0
-#define ITERATIONS          200
 #define RATE                48000
 #define SAMPLES             1024
-#define DURATION            SAMPLES * UCLOCK_FREQ / RATE
 #define CHANNELS            2
-#define FREQ                440
-#define STEP                (2. * M_PI * FREQ / RATE)
-#define UPROBE_LOG_LEVEL    UPROBE_LOG_VERBOSE
+#define FREQ                1000
+#define UPROBE_LOG_LEVEL    UPROBE_LOG_DEBUG
 #define ALIGN               0
 
+static struct uref_mgr *uref_mgr;
+static struct ubuf_mgr *interleaved_mgr;
+static struct ubuf_mgr *planar_mgr;
+static struct uprobe *logger;
+
+/** last measurements */
+static double momentary, shortterm, global, lra, truepeak;
+
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
                  int event, va_list args)
@@ -80,10 +91,216 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe,
     return UBASE_ERR_NONE;
 }
 
+/*
+ * testing pipe
+ */
+
+struct test {
+    struct upipe upipe;
+    struct urefcount urefcount;
+};
+
+UPIPE_HELPER_UPIPE(test, upipe, 0);
+UPIPE_HELPER_UREFCOUNT(test, urefcount, test_free);
+
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct test *ctx = malloc(sizeof(struct test));
+    assert(ctx);
+    upipe_init(&ctx->upipe, mgr, uprobe);
+    test_init_urefcount(&ctx->upipe);
+    upipe_throw_ready(&ctx->upipe);
+    return &ctx->upipe;
+}
+
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    ubase_assert(uref_ebur128_get_momentary(uref, &momentary));
+    ubase_assert(uref_ebur128_get_shortterm(uref, &shortterm));
+    ubase_assert(uref_ebur128_get_global(uref, &global));
+    ubase_assert(uref_ebur128_get_lra(uref, &lra));
+    ubase_assert(uref_ebur128_get_truepeak(uref, &truepeak));
+    uref_free(uref);
+}
+
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+            return UBASE_ERR_NONE;
+        case UPIPE_REGISTER_REQUEST:
+        case UPIPE_UNREGISTER_REQUEST:
+            return upipe_control_provide_request(upipe, command, args);
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+static void test_free(struct upipe *upipe)
+{
+    struct test *ctx = test_from_upipe(upipe);
+    upipe_throw_dead(upipe);
+    test_clean_urefcount(upipe);
+    upipe_clean(upipe);
+    free(ctx);
+}
+
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .signature = 0,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** segment of a test signal */
+struct segment {
+    /** level of the sine in dBFS */
+    double level;
+    /** duration in seconds */
+    double duration;
+};
+
+/** allocates an ebur128 pipe for a stereo signal */
+static struct upipe *measure_alloc(const char *def, bool planar,
+                                   bool true_peak)
+{
+    struct upipe *r128 = upipe_void_alloc(upipe_ebur128_mgr_alloc(),
+        uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "r128"));
+    assert(r128 != NULL);
+    ubase_assert(upipe_ebur128_set_true_peak(r128, true_peak));
+    bool enabled;
+    ubase_assert(upipe_ebur128_get_true_peak(r128, &enabled));
+    assert(enabled == true_peak);
+
+    uint8_t sample_size = !strcmp(def, "s16.") ? 2 : 4;
+    struct uref *flow = uref_sound_flow_alloc_def(uref_mgr, def, CHANNELS,
+            planar ? sample_size : sample_size * CHANNELS);
+    assert(flow != NULL);
+    if (planar) {
+        ubase_assert(uref_sound_flow_add_plane(flow, "l"));
+        ubase_assert(uref_sound_flow_add_plane(flow, "r"));
+    } else
+        ubase_assert(uref_sound_flow_add_plane(flow, "lr"));
+    ubase_assert(uref_sound_flow_set_rate(flow, RATE));
+    ubase_assert(upipe_set_flow_def(r128, flow));
+    uref_free(flow);
+
+    struct upipe *sink = upipe_void_alloc(&test_mgr,
+        uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "sink"));
+    assert(sink != NULL);
+    ubase_assert(upipe_set_output(r128, sink));
+    upipe_release(sink);
+    return r128;
+}
+
+/** feeds a sine to an ebur128 pipe */
+static void measure_sine(struct upipe *r128, const char *def, bool planar,
+                         double freq, double phase0,
+                         const struct segment *segments, int nb_segments)
+{
+    static uint64_t pts = UCLOCK_FREQ;
+    double step = 2. * M_PI * freq / RATE;
+    uint64_t n = 0;
+
+    for (int s = 0; s < nb_segments; s++) {
+        double amplitude = pow(10., segments[s].level / 20.);
+        uint64_t end = n + segments[s].duration * RATE + .5;
+        while (n < end) {
+            int samples = end - n < SAMPLES ? end - n : SAMPLES;
+            struct uref *uref = uref_sound_alloc(uref_mgr,
+                    planar ? planar_mgr : interleaved_mgr, samples);
+            assert(uref != NULL);
+            const char *channel;
+            int c = 0;
+            uref_sound_foreach_plane(uref, channel) {
+                void *buf;
+                ubase_assert(uref_sound_plane_write_void(uref, channel,
+                                                         0, -1, &buf));
+                int stride = planar ? 1 : CHANNELS;
+                for (int j = 0; j < samples; j++) {
+                    double val = amplitude * sin(step * (n + j) + phase0);
+                    for (int k = 0; k < (planar ? 1 : CHANNELS); k++) {
+                        if (!strcmp(def, "s16."))
+                            ((int16_t *)buf)[j * stride + k] =
+                                lrint(val * INT16_MAX);
+                        else
+                            ((float *)buf)[j * stride + k] = val;
+                    }
+                }
+                uref_sound_plane_unmap(uref, channel, 0, -1);
+                c++;
+            }
+            assert(c == (planar ? CHANNELS : 1));
+            uref_clock_set_pts_sys(uref, pts);
+            pts += samples * UCLOCK_FREQ / RATE;
+            upipe_input(r128, uref, NULL);
+            n += samples;
+        }
+    }
+}
+
+/** feeds a -23 dBFS sine to a single channel of an interleaved layout, and
+ * returns the integrated loudness */
+static double measure_layout(struct umem_mgr *umem_mgr, uint8_t channels,
+                             uint8_t channel)
+{
+    struct ubuf_mgr *ubuf_mgr = ubuf_sound_mem_mgr_alloc(UBUF_POOL_DEPTH,
+            UBUF_POOL_DEPTH, umem_mgr, 4 * channels, ALIGN);
+    assert(ubuf_mgr != NULL);
+    ubase_assert(ubuf_sound_mem_mgr_add_plane(ubuf_mgr, "all"));
+
+    struct upipe *r128 = upipe_void_alloc(upipe_ebur128_mgr_alloc(),
+        uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "r128"));
+    assert(r128 != NULL);
+    struct uref *flow = uref_sound_flow_alloc_def(uref_mgr, "f32.", channels,
+                                                  4 * channels);
+    assert(flow != NULL);
+    ubase_assert(uref_sound_flow_add_plane(flow, "all"));
+    ubase_assert(uref_sound_flow_set_rate(flow, RATE));
+    ubase_assert(upipe_set_flow_def(r128, flow));
+    uref_free(flow);
+    struct upipe *sink = upipe_void_alloc(&test_mgr,
+        uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "sink"));
+    assert(sink != NULL);
+    ubase_assert(upipe_set_output(r128, sink));
+    upipe_release(sink);
+
+    double amplitude = pow(10., -23. / 20.);
+    double step = 2. * M_PI * FREQ / RATE;
+    uint64_t pts = UCLOCK_FREQ;
+    for (uint64_t n = 0; n < 5 * RATE; n += SAMPLES) {
+        struct uref *uref = uref_sound_alloc(uref_mgr, ubuf_mgr, SAMPLES);
+        assert(uref != NULL);
+        float *buf;
+        ubase_assert(uref_sound_plane_write_float(uref, "all", 0, -1, &buf));
+        memset(buf, 0, SAMPLES * channels * sizeof(float));
+        for (int j = 0; j < SAMPLES; j++)
+            buf[j * channels + channel] = amplitude * sin(step * (n + j));
+        uref_sound_plane_unmap(uref, "all", 0, -1);
+        uref_clock_set_pts_sys(uref, pts);
+        pts += SAMPLES * UCLOCK_FREQ / RATE;
+        upipe_input(r128, uref, NULL);
+    }
+    upipe_release(r128);
+    ubuf_mgr_release(ubuf_mgr);
+    return global;
+}
+
+/** checks a measurement against a target and a tolerance */
+static void check(const char *name, double value, double target,
+                  double below, double above)
+{
+    printf("%s: %.2f (expected %.1f)\n", name, value, target);
+    assert(value >= target - below && value <= target + above);
+}
+
 int main(int argc, char **argv)
 {
     printf("Compiled %s %s - %s\n", __DATE__, __TIME__, __FILE__);
-    int i, j, k;
 
     /* uref and mem management */
     struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
@@ -91,86 +308,112 @@ int main(int argc, char **argv)
     struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
                                                          umem_mgr, -1, -1);
     assert(udict_mgr != NULL);
-    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH,
-                                                   udict_mgr, 0);
+    uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr, 0);
     assert(uref_mgr != NULL);
 
     /* sound */
-    struct ubuf_mgr *sound_mgr = ubuf_sound_mem_mgr_alloc(UBUF_POOL_DEPTH,
-                                             UBUF_POOL_DEPTH, umem_mgr, 4, ALIGN);
-    assert(sound_mgr);
-    ubase_assert(ubuf_sound_mem_mgr_add_plane(sound_mgr, "lr"));
+    interleaved_mgr = ubuf_sound_mem_mgr_alloc(UBUF_POOL_DEPTH,
+            UBUF_POOL_DEPTH, umem_mgr, 4 * CHANNELS, ALIGN);
+    assert(interleaved_mgr);
+    ubase_assert(ubuf_sound_mem_mgr_add_plane(interleaved_mgr, "lr"));
+    planar_mgr = ubuf_sound_mem_mgr_alloc(UBUF_POOL_DEPTH,
+            UBUF_POOL_DEPTH, umem_mgr, 2, ALIGN);
+    assert(planar_mgr);
+    ubase_assert(ubuf_sound_mem_mgr_add_plane(planar_mgr, "l"));
+    ubase_assert(ubuf_sound_mem_mgr_add_plane(planar_mgr, "r"));
 
     /* uprobe stuff */
     struct uprobe uprobe;
     uprobe_init(&uprobe, catch, NULL);
-    struct uprobe *logger = uprobe_stdio_alloc(&uprobe, stdout,
-                                               UPROBE_LOG_LEVEL);
+    logger = uprobe_stdio_alloc(&uprobe, stdout, UPROBE_LOG_LEVEL);
     assert(logger != NULL);
     logger = uprobe_ubuf_mem_alloc(logger, umem_mgr, UBUF_POOL_DEPTH,
-                                                     UBUF_POOL_DEPTH);
+                                   UBUF_POOL_DEPTH);
     assert(logger != NULL);
 
-    /* build r128 pipe */
-    struct upipe_mgr *upipe_ebur128_mgr = upipe_ebur128_mgr_alloc();
-    assert(upipe_ebur128_mgr);
-    struct upipe *r128 = upipe_void_alloc(upipe_ebur128_mgr,
-        uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "r128"));
-    assert(r128);
+    /* Tech 3341 case 1: -23 dBFS 1 kHz sine */
+    static const struct segment case1[] = { { -23, 20 } };
+    struct upipe *r128 = measure_alloc("f32.", false, false);
+    measure_sine(r128, "f32.", false, FREQ, 0, case1, 1);
+    check("case 1 momentary", momentary, -23, .1, .1);
+    check("case 1 short-term", shortterm, -23, .1, .1);
+    check("case 1 integrated", global, -23, .1, .1);
+    upipe_release(r128);
 
-    struct uref *flow = uref_sound_flow_alloc_def(uref_mgr, "s16.", CHANNELS,
-                                                  2 * CHANNELS);
-    ubase_assert(uref_sound_flow_add_plane(flow, "lr"));
-    ubase_assert(uref_sound_flow_set_rate(flow, RATE));
-    ubase_assert(upipe_set_flow_def(r128, flow));
+    /* Tech 3341 case 2: -33 dBFS 1 kHz sine */
+    static const struct segment case2[] = { { -33, 20 } };
+    r128 = measure_alloc("f32.", false, false);
+    measure_sine(r128, "f32.", false, FREQ, 0, case2, 1);
+    check("case 2 momentary", momentary, -33, .1, .1);
+    check("case 2 short-term", shortterm, -33, .1, .1);
+    check("case 2 integrated", global, -33, .1, .1);
+    upipe_release(r128);
 
-    struct upipe *null = upipe_void_alloc_output(r128,
-        upipe_null_mgr_alloc(),
-        uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "null"));
-    assert(null);
-    upipe_release(null);
-    upipe_null_dump_dict(null, true);
+    /* Tech 3341 case 3: relative gate */
+    static const struct segment case3[] = {
+        { -36, 10 }, { -23, 60 }, { -36, 10 }
+    };
+    r128 = measure_alloc("f32.", false, false);
+    measure_sine(r128, "f32.", false, FREQ, 0, case3, 3);
+    check("case 3 integrated", global, -23, .1, .1);
+    upipe_release(r128);
 
-    uref_free(flow);
+    /* Tech 3341 case 4: absolute and relative gates */
+    static const struct segment case4[] = {
+        { -72, 10 }, { -36, 10 }, { -23, 60 }, { -36, 10 }, { -72, 10 }
+    };
+    r128 = measure_alloc("f32.", false, false);
+    measure_sine(r128, "f32.", false, FREQ, 0, case4, 5);
+    check("case 4 integrated", global, -23, .1, .1);
+    upipe_release(r128);
 
-    printf("packets duration : %"PRIu64"\n", DURATION);
-
-    /* now send reference urefs */
-    double phase = 0;
-    for (i=0; i < ITERATIONS; i++) {
-        struct uref *uref = uref_sound_alloc(uref_mgr, sound_mgr, SAMPLES);
-        assert(uref);
-        const char *channel;
-        int16_t *sample = NULL;
-        uref_sound_foreach_plane(uref, channel) {
-            uref_sound_plane_write_int16_t(uref, channel, 0, -1, &sample);
-            memset(sample, 0, 2 * CHANNELS * SAMPLES);
-            #if 1
-            for (j=0; j < SAMPLES; j++) {
-                int16_t val = sin(phase) * INT16_MAX;
-                for (k=0; k < CHANNELS; k++) {
-                    sample[CHANNELS*j+k] = val;
-                }
-                phase += STEP;
-                if (phase >= 2. * M_PI) {
-                    phase = 0;
-                }
-            }
-            #endif
-            uref_sound_plane_unmap(uref, channel, 0, -1);
-        }
+    /* Tech 3341 case 5: gating with a non-integer number of blocks */
+    static const struct segment case5[] = {
+        { -26, 20 }, { -20, 20.1 }, { -26, 20 }
+    };
+    r128 = measure_alloc("f32.", false, false);
+    measure_sine(r128, "f32.", false, FREQ, 0, case5, 3);
+    check("case 5 integrated", global, -23, .1, .1);
+    upipe_release(r128);
 
-        uref_clock_set_pts_sys(uref, UCLOCK_FREQ + i * DURATION);
-        uref_clock_set_duration(uref, DURATION);
-        upipe_input(r128, uref, NULL);
-    }
+    /* Tech 3342 case 1: loudness range, with planar 16 bits samples */
+    static const struct segment lra1[] = { { -20, 20 }, { -30, 20 } };
+    r128 = measure_alloc("s16.", true, false);
+    measure_sine(r128, "s16.", true, FREQ, 0, lra1, 2);
+    check("lra case 1", lra, 10, 1, 1);
+    upipe_release(r128);
 
-    /* release pipe */
+    /* Tech 3342 case 2: loudness range */
+    static const struct segment lra2[] = { { -20, 20 }, { -15, 20 } };
+    r128 = measure_alloc("s16.", true, false);
+    measure_sine(r128, "s16.", true, FREQ, 0, lra2, 2);
+    check("lra case 2", lra, 5, 1, 1);
     upipe_release(r128);
 
+    /* true peak: fs/4 sine sampled at +/-45 degrees, sample peak -3 dBFS */
+    static const struct segment tp[] = { { 0, 1 } };
+    r128 = measure_alloc("f32.", false, true);
+    measure_sine(r128, "f32.", false, RATE / 4, M_PI / 4, tp, 1);
+    check("true peak", truepeak, 0, .4, .2);
+    upipe_release(r128);
+
+    r128 = measure_alloc("f32.", false, false);
+    measure_sine(r128, "f32.", false, RATE / 4, M_PI / 4, tp, 1);
+    check("sample peak", truepeak, -3.01, .1, .1);
+    upipe_release(r128);
+
+    /* default channel layouts of libebur128: surround channels are weighted
+     * by 1.41 (+1.5 dB), and the LFE channel is ignored */
+    check("4 channels, L", measure_layout(umem_mgr, 4, 0), -26, .1, .1);
+    check("4 channels, Ls", measure_layout(umem_mgr, 4, 2), -24.5, .1, .1);
+    check("5 channels, C", measure_layout(umem_mgr, 5, 2), -26, .1, .1);
+    check("5 channels, Ls", measure_layout(umem_mgr, 5, 3), -24.5, .1, .1);
+    check("6 channels, Rs", measure_layout(umem_mgr, 6, 5), -24.5, .1, .1);
+    assert(isinf(measure_layout(umem_mgr, 6, 3)));
+
     /* release managers */
-    upipe_mgr_release(upipe_ebur128_mgr); // no-op
-    ubuf_mgr_release(sound_mgr);
+    ubuf_mgr_release(interleaved_mgr);
+    ubuf_mgr_release(planar_mgr);
     uref_mgr_release(uref_mgr);
     umem_mgr_release(umem_mgr);
     udict_mgr_release(udict_mgr);
@@ -76,6 +76,7 @@ static int catch(struct uprobe *uprobe, struct upipe *upipe,
         case UPROBE_READY:
         case UPROBE_DEAD:
         case UPROBE_NEW_FLOW_DEF:
+        case UPROBE_NEED_UJOB_MGR:
             break;
     }
     return UBASE_ERR_NONE;
@@ -49,6 +49,7 @@
 #include <upipe/uref_clock.h>
 #include <upipe/uref_block.h>
 #include <upipe/uref_block_flow.h>
+#include <upipe/uref_pic.h>
 #include <upipe/uref_dump.h>
 #include <upipe/ubuf.h>
 #include <upipe/ubuf_block_mem.h>
@@ -63,6 +64,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <bitstream/mpeg/h264.h>
 
@@ -80,6 +82,13 @@ static enum uref_h26x_encaps need_encaps = UREF_H26X_ENCAPS_ANNEXB;
 static struct uref *last_output = NULL;
 static struct uref *last_flow_def = NULL;
 
+/** SEI carrying A/53 captions */
+static const uint8_t h264_sei_a53[] = {
+    0x00, 0x00, 0x01, 0x06, 0x04, 0x11,
+    0xb5, 0x00, 0x31, 'G', 'A', '9', '4', 0x03, 0x42, 0xff,
+    0xfc, 0x94, 0x20, 0xfd, 0x80, 0x80, 0xff, 0x80
+};
+
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
                  int event, va_list args)
@@ -124,6 +133,8 @@ static void test_input(struct upipe *upipe, struct uref *uref,
     assert(systime_rap == 42);
     assert(pts_orig == 27000000);
     assert(dts_orig == 27000000);
+    /* all pictures have nal_ref_idc != 0 */
+    assert(!ubase_check(uref_pic_get_discardable(uref)));
     size_t size;
     ubase_assert(uref_block_size(uref, &size));
     upipe_dbg_va(upipe, "size: %zu", size);
@@ -142,8 +153,19 @@ static void test_input(struct upipe *upipe, struct uref *uref,
             assert(size == sizeof(h264_headers) + sizeof(h264_pic) + AUD_SIZE + 3);
             break;
         case 6:
+        case 7:
             assert(size == sizeof(h264_pic) + AUD_SIZE + SPS_PPS_SIZE + 4 * 2);
             break;
+        case 8: {
+            assert(size == sizeof(h264_headers) + sizeof(h264_sei_a53) +
+                           sizeof(h264_pic) + AUD_SIZE);
+            const uint8_t *cc_data;
+            size_t cc_size;
+            ubase_assert(uref_pic_get_cea_708(uref, &cc_data, &cc_size));
+            assert(cc_size == 6);
+            assert(!memcmp(cc_data, h264_sei_a53 + 16, cc_size));
+            break;
+        }
         default:
             assert(0);
             break;
@@ -412,6 +434,68 @@ int main(int argc, char **argv)
     assert(nb_packets == 7);
     upipe_release(h264f);
 
+    /* captions are not extracted by default */
+    h264f = upipe_void_alloc(h264f_mgr,
+                   uprobe_pfx_alloc(uprobe_use(uprobe), UPROBE_LOG_VERBOSE,
+                                    "h264f 8"));
+    assert(h264f != NULL);
+    ubase_assert(upipe_set_output(h264f, sink));
+    ubase_assert(upipe_set_flow_def(h264f, flow_def));
+
+    ubuf = ubuf_block_alloc_from_opaque(ubuf_mgr, h264_pic, sizeof(h264_pic));
+    assert(ubuf != NULL);
+    uref = uref_alloc(uref_mgr);
+    assert(uref != NULL);
+    uref_attach_ubuf(uref, ubuf);
+    uref_clock_set_dts_orig(uref, 27000000);
+    uref_clock_set_dts_pts_delay(uref, 0);
+    uref_clock_set_cr_sys(uref, 84);
+    uref_clock_set_rap_sys(uref, 42);
+    upipe_input(h264f, uref, NULL);
+    assert(nb_packets == 8);
+    const uint8_t *cc_data;
+    size_t cc_size;
+    assert(!ubase_check(uref_pic_get_cea_708(last_output, &cc_data,
+                                             &cc_size)));
+    upipe_release(h264f);
+
+    /* captions extraction */
+    uref_flow_delete_headers(flow_def);
+    h264f = upipe_void_alloc(h264f_mgr,
+                   uprobe_pfx_alloc(uprobe_use(uprobe), UPROBE_LOG_VERBOSE,
+                                    "h264f 9"));
+    assert(h264f != NULL);
+    bool captions;
+    ubase_assert(upipe_h264f_get_captions(h264f, &captions));
+    assert(!captions);
+    ubase_assert(upipe_h264f_set_captions(h264f, true));
+    ubase_assert(upipe_h264f_get_captions(h264f, &captions));
+    assert(captions);
+    ubase_assert(upipe_set_output(h264f, sink));
+    ubase_assert(upipe_set_flow_def(h264f, flow_def));
+
+    ubuf1 = ubuf_block_alloc_from_opaque(ubuf_mgr, h264_headers,
+                                         sizeof(h264_headers));
+    assert(ubuf1 != NULL);
+    ubuf2 = ubuf_block_alloc_from_opaque(ubuf_mgr, h264_sei_a53,
+                                         sizeof(h264_sei_a53));
+    assert(ubuf2 != NULL);
+    ubuf_block_append(ubuf1, ubuf2);
+    ubuf2 = ubuf_block_alloc_from_opaque(ubuf_mgr, h264_pic,
+                                         sizeof(h264_pic));
+    assert(ubuf2 != NULL);
+    ubuf_block_append(ubuf1, ubuf2);
+    uref = uref_alloc(uref_mgr);
+    assert(uref != NULL);
+    uref_attach_ubuf(uref, ubuf1);
+    uref_clock_set_dts_orig(uref, 27000000);
+    uref_clock_set_dts_pts_delay(uref, 0);
+    uref_clock_set_cr_sys(uref, 84);
+    uref_clock_set_rap_sys(uref, 42);
+    upipe_input(h264f, uref, NULL);
+    assert(nb_packets == 9);
+    upipe_release(h264f);
+
     uref_free(flow_def);
     uref_free(last_output);
     uref_free(last_flow_def);
@@ -0,0 +1,314 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/** @file
+ * @short unit tests for H265 video framer module
+ * This only checks the extraction of A/53 captions, on a handcrafted
+ * 64x64 stream made of a VPS, an SPS, a PPS and an IDR slice header.
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_uref_mgr.h>
+#include <upipe/uprobe_ubuf_mem.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/uref.h>
+#include <upipe/uref_std.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_pic.h>
+#include <upipe/uref_pic_flow.h>
+#include <upipe/uref_dump.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/upipe.h>
+#include <upipe-framers/upipe_h265_framer.h>
+#include <upipe-framers/uref_h26x_flow.h>
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define UPROBE_LOG_LEVEL UPROBE_LOG_VERBOSE
+#define UDICT_POOL_DEPTH 0
+#define UREF_POOL_DEPTH 0
+#define UBUF_POOL_DEPTH 0
+#define UBUF_SHARED_POOL_DEPTH 0
+#define AUD_SIZE 6
+
+static unsigned int nb_packets = 0;
+static size_t expected_size = 0;
+static const uint8_t *expected_cc = NULL;
+static size_t expected_cc_size = 0;
+
+/** VPS, SPS (64x64, 60000/1001 fps) and PPS */
+static const uint8_t h265_headers[] = {
+    0x00, 0x00, 0x00, 0x01, 0x40, 0x01, 0x0c, 0x01, 0xff, 0xff, 0x01, 0x60,
+    0x00, 0x00, 0x03, 0x00, 0x90, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00,
+    0x5d, 0xf0, 0x24, 0x00, 0x00, 0x00, 0x01, 0x42, 0x01, 0x01, 0x01, 0x60,
+    0x00, 0x00, 0x03, 0x00, 0x90, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00,
+    0x5d, 0xa0, 0x20, 0x81, 0x05, 0x97, 0xeb, 0xc2, 0x20, 0x10, 0x00, 0x00,
+    0x3e, 0x90, 0x00, 0x0e, 0xa6, 0x00, 0x80, 0x00, 0x00, 0x00, 0x01, 0x44,
+    0x01, 0xc0, 0x71, 0x80, 0x12,
+};
+
+/** prefix SEI carrying A/53 captions */
+static const uint8_t h265_sei_a53[] = {
+    0x00, 0x00, 0x01, 0x4e, 0x01, 0x04, 0x11,
+    0xb5, 0x00, 0x31, 'G', 'A', '9', '4', 0x03, 0x42, 0xff,
+    0xfc, 0x94, 0x20, 0xfd, 0x80, 0x80, 0xff, 0x80
+};
+
+/** IDR slice (only the header is meaningful) */
+static const uint8_t h265_pic[] = {
+    0x00, 0x00, 0x01, 0x26, 0x01, 0xae, 0xbd, 0x70, 0x45, 0xf9, 0x0a, 0x67,
+    0x0c, 0xa2,
+};
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+        case UPROBE_SYNC_ACQUIRED:
+        case UPROBE_SYNC_LOST:
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    assert(uref != NULL);
+    upipe_dbg_va(upipe, "frame: %u", nb_packets);
+    uref_dump(uref, upipe->uprobe);
+    size_t size;
+    ubase_assert(uref_block_size(uref, &size));
+    assert(size == expected_size);
+    ubase_assert(uref_pic_get_key(uref));
+
+    const uint8_t *cc_data;
+    size_t cc_size;
+    if (expected_cc == NULL)
+        assert(!ubase_check(uref_pic_get_cea_708(uref, &cc_data, &cc_size)));
+    else {
+        ubase_assert(uref_pic_get_cea_708(uref, &cc_data, &cc_size));
+        assert(cc_size == expected_cc_size);
+        assert(!memcmp(cc_data, expected_cc, cc_size));
+    }
+    uref_free(uref);
+    nb_packets++;
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            uint64_t hsize, vsize;
+            ubase_assert(uref_pic_flow_get_hsize(flow_def, &hsize));
+            ubase_assert(uref_pic_flow_get_vsize(flow_def, &vsize));
+            assert(hsize == 64);
+            assert(vsize == 64);
+            return UBASE_ERR_NONE;
+        }
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            if (urequest->type == UREQUEST_FLOW_FORMAT) {
+                struct uref *uref = uref_dup(urequest->uref);
+                assert(uref != NULL);
+                return urequest_provide_flow_format(urequest, uref);
+            }
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** helper to send an access unit made of the given buffers */
+static void test_send(struct upipe *h265f, struct uref_mgr *uref_mgr,
+                      struct ubuf_mgr *ubuf_mgr, bool sei)
+{
+    struct ubuf *ubuf = ubuf_block_alloc_from_opaque(ubuf_mgr, h265_headers,
+                                                     sizeof(h265_headers));
+    assert(ubuf != NULL);
+    struct ubuf *ubuf2;
+    if (sei) {
+        ubuf2 = ubuf_block_alloc_from_opaque(ubuf_mgr, h265_sei_a53,
+                                             sizeof(h265_sei_a53));
+        assert(ubuf2 != NULL);
+        ubuf_block_append(ubuf, ubuf2);
+    }
+    ubuf2 = ubuf_block_alloc_from_opaque(ubuf_mgr, h265_pic, sizeof(h265_pic));
+    assert(ubuf2 != NULL);
+    ubuf_block_append(ubuf, ubuf2);
+
+    struct uref *uref = uref_alloc(uref_mgr);
+    assert(uref != NULL);
+    uref_attach_ubuf(uref, ubuf);
+    uref_clock_set_dts_orig(uref, 27000000);
+    uref_clock_set_dts_pts_delay(uref, 0);
+    upipe_input(h265f, uref, NULL);
+}
+
+int main(int argc, char **argv)
+{
+    /* structures managers */
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
+                                                   0);
+    assert(uref_mgr != NULL);
+    struct ubuf_mgr *ubuf_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH,
+                                                         UBUF_POOL_DEPTH,
+                                                         umem_mgr, 0, 0, -1, 0);
+    assert(ubuf_mgr != NULL);
+
+    /* probes */
+    struct uprobe uprobe_s;
+    uprobe_init(&uprobe_s, catch, NULL);
+    struct uprobe *uprobe;
+    uprobe = uprobe_stdio_alloc(&uprobe_s, stdout, UPROBE_LOG_LEVEL);
+    assert(uprobe != NULL);
+    uprobe = uprobe_uref_mgr_alloc(uprobe, uref_mgr);
+    assert(uprobe != NULL);
+    uprobe = uprobe_ubuf_mem_alloc(uprobe, umem_mgr, UBUF_POOL_DEPTH,
+                                   UBUF_SHARED_POOL_DEPTH);
+    assert(uprobe != NULL);
+
+    struct upipe *sink = upipe_void_alloc(&test_mgr, uprobe_use(uprobe));
+    assert(sink != NULL);
+
+    struct uref *flow_def = uref_block_flow_alloc_def(uref_mgr, "hevc.pic.");
+    assert(flow_def != NULL);
+    ubase_assert(uref_h26x_flow_set_encaps(flow_def,
+                                           UREF_H26X_ENCAPS_ANNEXB));
+    ubase_assert(uref_flow_set_complete(flow_def));
+
+    struct upipe_mgr *h265f_mgr = upipe_h265f_mgr_alloc();
+    assert(h265f_mgr != NULL);
+
+    /* captions are not extracted by default */
+    struct upipe *h265f = upipe_void_alloc(h265f_mgr,
+                   uprobe_pfx_alloc(uprobe_use(uprobe), UPROBE_LOG_VERBOSE,
+                                    "h265f 1"));
+    assert(h265f != NULL);
+    bool captions;
+    ubase_assert(upipe_h265f_get_captions(h265f, &captions));
+    assert(!captions);
+    ubase_assert(upipe_set_output(h265f, sink));
+    ubase_assert(upipe_set_flow_def(h265f, flow_def));
+
+    expected_size = sizeof(h265_headers) + sizeof(h265_sei_a53) +
+                    sizeof(h265_pic) + AUD_SIZE;
+    test_send(h265f, uref_mgr, ubuf_mgr, true);
+    assert(nb_packets == 1);
+    upipe_release(h265f);
+
+    /* captions extraction */
+    h265f = upipe_void_alloc(h265f_mgr,
+                   uprobe_pfx_alloc(uprobe_use(uprobe), UPROBE_LOG_VERBOSE,
+                                    "h265f 2"));
+    assert(h265f != NULL);
+    ubase_assert(upipe_h265f_set_captions(h265f, true));
+    ubase_assert(upipe_h265f_get_captions(h265f, &captions));
+    assert(captions);
+    ubase_assert(upipe_set_output(h265f, sink));
+    ubase_assert(upipe_set_flow_def(h265f, flow_def));
+
+    expected_cc = h265_sei_a53 + 17;
+    expected_cc_size = 6;
+    test_send(h265f, uref_mgr, ubuf_mgr, true);
+    assert(nb_packets == 2);
+
+    /* captions are only attached to the access unit carrying them */
+    expected_size = sizeof(h265_headers) + sizeof(h265_pic) + AUD_SIZE;
+    expected_cc = NULL;
+    test_send(h265f, uref_mgr, ubuf_mgr, false);
+    assert(nb_packets == 3);
+    upipe_release(h265f);
+
+    uref_free(flow_def);
+    test_free(sink);
+
+    upipe_mgr_release(h265f_mgr);
+    uref_mgr_release(uref_mgr);
+    ubuf_mgr_release(ubuf_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(uprobe);
+    uprobe_clean(&uprobe_s);
+
+    return 0;
+}
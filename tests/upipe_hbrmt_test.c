@@ -0,0 +1,368 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for SMPTE 2022-6 pack and unpack modules
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_ubuf_mem.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_pic.h>
+#include <upipe/uref_pic_flow.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_std.h>
+#include <upipe/upipe.h>
+#include <upipe-hbrmt/upipe_hbrmt_pack.h>
+#include <upipe-hbrmt/upipe_hbrmt_unpack.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include <bitstream/ietf/rtp.h>
+
+#define UDICT_POOL_DEPTH 10
+#define UREF_POOL_DEPTH 10
+#define UBUF_POOL_DEPTH 10
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+
+/* 720p50 */
+#define FRAME_SIZE (1980 * 750 * 2 * 10 / 8)
+#define PAYLOAD_SIZE 1376
+#define DATAGRAM_SIZE (12 + 8 + PAYLOAD_SIZE)
+#define NB_DATAGRAMS ((FRAME_SIZE + PAYLOAD_SIZE - 1) / PAYLOAD_SIZE)
+#define BENCH_FRAMES 50
+
+static struct uref_mgr *uref_mgr;
+static struct ubuf_mgr *ubuf_mgr;
+
+/** datagrams output by the pack pipe */
+static struct uref *datagrams[NB_DATAGRAMS];
+static unsigned int nb_datagrams = 0;
+/** last frame output by the unpack pipe */
+static struct uref *frame = NULL;
+static unsigned int nb_frames = 0;
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    return upipe;
+}
+
+/** helper phony pipe collecting datagrams */
+static void datagram_input(struct upipe *upipe, struct uref *uref,
+                           struct upump **upump_p)
+{
+    assert(nb_datagrams < NB_DATAGRAMS);
+    datagrams[nb_datagrams++] = uref;
+}
+
+/** helper phony pipe collecting frames */
+static void frame_input(struct upipe *upipe, struct uref *uref,
+                        struct upump **upump_p)
+{
+    uref_free(frame);
+    frame = uref;
+    nb_frames++;
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+            return UBASE_ERR_NONE;
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr datagram_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc,
+    .upipe_input = datagram_input,
+    .upipe_control = test_control
+};
+
+/** helper phony pipe */
+static struct upipe_mgr frame_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc,
+    .upipe_input = frame_input,
+    .upipe_control = test_control
+};
+
+/** @This allocates a frame filled with a pattern. */
+static struct uref *alloc_frame(uint8_t seed)
+{
+    struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr, FRAME_SIZE);
+    assert(uref != NULL);
+    uint8_t *buffer;
+    int size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+    assert(size == FRAME_SIZE);
+    for (int i = 0; i < size; i++)
+        buffer[i] = i * 7 + seed;
+    uref_block_unmap(uref, 0);
+    return uref;
+}
+
+/** @This checks the content of the last reassembled frame. */
+static void check_frame(uint8_t seed)
+{
+    assert(frame != NULL);
+    size_t size;
+    ubase_assert(uref_block_size(frame, &size));
+    assert(size == FRAME_SIZE);
+    uint8_t *buffer = malloc(FRAME_SIZE);
+    assert(buffer != NULL);
+    ubase_assert(uref_block_extract(frame, 0, FRAME_SIZE, buffer));
+    for (int i = 0; i < FRAME_SIZE; i++)
+        assert(buffer[i] == (uint8_t)(i * 7 + seed));
+    free(buffer);
+}
+
+/** @This checks the datagrams of a frame. */
+static void check_datagrams(uint8_t frcount, uint16_t seqnum)
+{
+    assert(nb_datagrams == NB_DATAGRAMS);
+    for (int i = 0; i < NB_DATAGRAMS; i++) {
+        size_t size;
+        ubase_assert(uref_block_size(datagrams[i], &size));
+        assert(size == DATAGRAM_SIZE);
+        uint8_t header[12 + 8];
+        ubase_assert(uref_block_extract(datagrams[i], 0, sizeof(header),
+                                        header));
+        assert(rtp_check_hdr(header));
+        assert(rtp_get_type(header) == 98);
+        assert(rtp_get_seqnum(header) == (uint16_t)(seqnum + i));
+        assert(rtp_check_marker(header) == (i == NB_DATAGRAMS - 1));
+        /* F set, frame count, 720p, 50 Hz, 4:2:2 10 bits */
+        assert(header[12] == 0x08);
+        assert(header[13] == frcount);
+        assert(header[16] == 0x03);
+        assert(header[17] == 0x01);
+        assert(header[18] == 0x21);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr, 0);
+    assert(uref_mgr != NULL);
+    ubuf_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH, UBUF_POOL_DEPTH,
+                                        umem_mgr, 0, 0, -1, 0);
+    assert(ubuf_mgr != NULL);
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *uprobe_stdio = uprobe_stdio_alloc(&uprobe, stdout,
+                                                     UPROBE_LOG_LEVEL);
+    assert(uprobe_stdio != NULL);
+    uprobe_stdio = uprobe_ubuf_mem_alloc(uprobe_stdio, umem_mgr,
+                                         UBUF_POOL_DEPTH, UBUF_POOL_DEPTH);
+    assert(uprobe_stdio != NULL);
+
+    struct upipe *datagram_sink = upipe_void_alloc(&datagram_mgr,
+                                                   uprobe_use(uprobe_stdio));
+    assert(datagram_sink != NULL);
+    struct upipe *frame_sink = upipe_void_alloc(&frame_mgr,
+                                                uprobe_use(uprobe_stdio));
+    assert(frame_sink != NULL);
+
+    struct upipe_mgr *upipe_hbrmt_pack_mgr = upipe_hbrmt_pack_mgr_alloc();
+    assert(upipe_hbrmt_pack_mgr != NULL);
+    struct upipe *pack = upipe_void_alloc(upipe_hbrmt_pack_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "pack"));
+    assert(pack != NULL);
+    struct uref *flow_def = uref_block_flow_alloc_def(uref_mgr, "");
+    assert(flow_def != NULL);
+    ubase_assert(uref_pic_flow_set_hsize(flow_def, 1280));
+    ubase_assert(uref_pic_flow_set_vsize(flow_def, 720));
+    struct urational fps = { .num = 50, .den = 1 };
+    ubase_assert(uref_pic_flow_set_fps(flow_def, fps));
+    ubase_assert(uref_pic_set_progressive(flow_def));
+    ubase_assert(upipe_set_flow_def(pack, flow_def));
+    uref_free(flow_def);
+    ubase_assert(upipe_set_output(pack, datagram_sink));
+
+    struct upipe_mgr *upipe_hbrmt_unpack_mgr = upipe_hbrmt_unpack_mgr_alloc();
+    assert(upipe_hbrmt_unpack_mgr != NULL);
+    struct upipe *unpack = upipe_void_alloc(upipe_hbrmt_unpack_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "unpack"));
+    assert(unpack != NULL);
+    flow_def = uref_block_flow_alloc_def(uref_mgr, "");
+    assert(flow_def != NULL);
+    ubase_assert(upipe_set_flow_def(unpack, flow_def));
+    uref_free(flow_def);
+    ubase_assert(upipe_set_output(unpack, frame_sink));
+
+    /* loopback */
+    upipe_input(pack, alloc_frame(0), NULL);
+    check_datagrams(0, 0);
+    for (int i = 0; i < NB_DATAGRAMS; i++)
+        upipe_input(unpack, datagrams[i], NULL);
+    nb_datagrams = 0;
+    assert(nb_frames == 1);
+    check_frame(0);
+    assert(!ubase_check(uref_flow_get_discontinuity(frame)));
+
+    struct uref *unpack_flow_def;
+    ubase_assert(upipe_get_flow_def(unpack, &unpack_flow_def));
+    uint64_t vsize;
+    ubase_assert(uref_pic_flow_get_vsize(unpack_flow_def, &vsize));
+    assert(vsize == 720);
+    ubase_assert(uref_pic_get_progressive(unpack_flow_def));
+
+    /* lost datagram */
+    upipe_input(pack, alloc_frame(1), NULL);
+    check_datagrams(1, NB_DATAGRAMS);
+    for (int i = 0; i < NB_DATAGRAMS; i++) {
+        if (i == NB_DATAGRAMS / 2)
+            uref_free(datagrams[i]);
+        else
+            upipe_input(unpack, datagrams[i], NULL);
+    }
+    nb_datagrams = 0;
+    assert(nb_frames == 1);
+
+    /* recovery */
+    upipe_input(pack, alloc_frame(2), NULL);
+    check_datagrams(2, 2 * NB_DATAGRAMS);
+    for (int i = 0; i < NB_DATAGRAMS; i++)
+        upipe_input(unpack, datagrams[i], NULL);
+    nb_datagrams = 0;
+    assert(nb_frames == 2);
+    check_frame(2);
+    ubase_assert(uref_flow_get_discontinuity(frame));
+
+    /* lost marker and start of the next frame: both frames are dropped,
+     * and the unpacker resyncs after the next marker */
+    upipe_input(pack, alloc_frame(3), NULL);
+    for (int i = 0; i < NB_DATAGRAMS - 1; i++)
+        upipe_input(unpack, datagrams[i], NULL);
+    uref_free(datagrams[NB_DATAGRAMS - 1]);
+    nb_datagrams = 0;
+    upipe_input(pack, alloc_frame(4), NULL);
+    uref_free(datagrams[0]);
+    for (int i = 1; i < NB_DATAGRAMS; i++)
+        upipe_input(unpack, datagrams[i], NULL);
+    nb_datagrams = 0;
+    assert(nb_frames == 2);
+    upipe_input(pack, alloc_frame(5), NULL);
+    for (int i = 0; i < NB_DATAGRAMS; i++)
+        upipe_input(unpack, datagrams[i], NULL);
+    nb_datagrams = 0;
+    assert(nb_frames == 3);
+    check_frame(5);
+    ubase_assert(uref_flow_get_discontinuity(frame));
+
+    /* throughput */
+    struct uref *bench_frame = alloc_frame(6);
+    clock_t start = clock();
+    for (int j = 0; j < BENCH_FRAMES; j++) {
+        upipe_input(pack, uref_dup(bench_frame), NULL);
+        for (int i = 0; i < NB_DATAGRAMS; i++)
+            upipe_input(unpack, datagrams[i], NULL);
+        nb_datagrams = 0;
+    }
+    double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+    uref_free(bench_frame);
+    assert(nb_frames == 3 + BENCH_FRAMES);
+    check_frame(6);
+    if (elapsed > 0)
+        printf("packed and unpacked %.0f datagrams/s (%.2f Gbit/s)\n",
+               BENCH_FRAMES * NB_DATAGRAMS / elapsed,
+               BENCH_FRAMES * FRAME_SIZE * 8 / elapsed / 1e9);
+
+    uref_free(frame);
+    upipe_release(pack);
+    upipe_release(unpack);
+    test_free(datagram_sink);
+    test_free(frame_sink);
+
+    uref_mgr_release(uref_mgr);
+    ubuf_mgr_release(ubuf_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(uprobe_stdio);
+
+    return 0;
+}
@@ -0,0 +1,461 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for http multi source pipes
+ *
+ * A local http server adds latency to every request and limits the
+ * throughput of every connection.
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_uref_mgr.h>
+#include <upipe/uprobe_upump_mgr.h>
+#include <upipe/uprobe_uclock.h>
+#include <upipe/uprobe_ubuf_mem.h>
+#include <upipe/uclock.h>
+#include <upipe/uclock_std.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/uref.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_std.h>
+#include <upipe/upump.h>
+#include <upump-ev/upump_ev.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe-modules/upipe_http_source.h>
+#include <upipe-modules/upipe_http_multi_source.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define UDICT_POOL_DEPTH 10
+#define UREF_POOL_DEPTH 10
+#define UBUF_POOL_DEPTH 10
+#define UPUMP_POOL 1
+#define UPUMP_BLOCKER_POOL 1
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+#define OBJECT_SIZE (1024 * 1024 + 12345)
+#define CHUNK_SIZE (64 * 1024)
+#define MAX_STREAMS 4
+#define LATENCY 20000
+#define BLOCK_SIZE 16384
+#define BLOCK_INTERVAL 2000
+
+static uint16_t port;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int nb_conns = 0;
+static unsigned int max_conns = 0;
+static unsigned int nb_requests = 0;
+static bool source_end = false;
+
+/** @This returns the content of the object. */
+static uint8_t object_byte(uint64_t offset)
+{
+    return offset % 251;
+}
+
+/** @This writes a buffer to a socket. */
+static void server_write(int fd, const void *buf, size_t len)
+{
+    while (len) {
+        ssize_t ret = send(fd, buf, len, MSG_NOSIGNAL);
+        if (ret <= 0)
+            return;
+        buf = (const uint8_t *)buf + ret;
+        len -= ret;
+    }
+}
+
+/** @This serves one request, the path /object supports ranges, /norange
+ * does not, /redirect redirects to /object, and others are not found. */
+static void *server_conn(void *arg)
+{
+    int fd = (intptr_t)arg;
+    char request[4096];
+    size_t len = 0;
+    while (len < sizeof(request) - 1) {
+        ssize_t ret = recv(fd, request + len, sizeof(request) - 1 - len, 0);
+        if (ret <= 0)
+            break;
+        len += ret;
+        request[len] = '\0';
+        if (strstr(request, "\r\n\r\n") != NULL)
+            break;
+    }
+    request[len] = '\0';
+
+    pthread_mutex_lock(&lock);
+    nb_requests++;
+    if (++nb_conns > max_conns)
+        max_conns = nb_conns;
+    pthread_mutex_unlock(&lock);
+
+    usleep(LATENCY);
+
+    char header[512];
+    uint64_t first = 0, last = OBJECT_SIZE - 1;
+    if (strncmp(request, "GET /object ", 12) &&
+        strncmp(request, "GET /norange ", 13) &&
+        strncmp(request, "GET /redirect ", 14)) {
+        snprintf(header, sizeof(header), "HTTP/1.1 404 Not Found\r\n"
+                 "Content-Length: 0\r\nConnection: close\r\n\r\n");
+        server_write(fd, header, strlen(header));
+        last = 0;
+    } else if (!strncmp(request, "GET /redirect ", 14)) {
+        snprintf(header, sizeof(header), "HTTP/1.1 302 Found\r\n"
+                 "Location: http://127.0.0.1:%u/object\r\n"
+                 "Content-Length: 0\r\nConnection: close\r\n\r\n", port);
+        server_write(fd, header, strlen(header));
+        last = 0;
+    } else if (!strncmp(request, "GET /norange ", 13)) {
+        snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\n"
+                 "Content-Length: %u\r\nConnection: close\r\n\r\n",
+                 OBJECT_SIZE);
+        server_write(fd, header, strlen(header));
+    } else {
+        const char *range = strstr(request, "Range: bytes=");
+        assert(range != NULL);
+        assert(sscanf(range, "Range: bytes=%"SCNu64"-%"SCNu64,
+                      &first, &last) >= 1);
+        if (last >= OBJECT_SIZE)
+            last = OBJECT_SIZE - 1;
+        assert(first <= last);
+        snprintf(header, sizeof(header), "HTTP/1.1 206 Partial Content\r\n"
+                 "Content-Length: %"PRIu64"\r\n"
+                 "Content-Range: bytes %"PRIu64"-%"PRIu64"/%u\r\n"
+                 "Connection: close\r\n\r\n",
+                 last - first + 1, first, last, OBJECT_SIZE);
+        server_write(fd, header, strlen(header));
+    }
+
+    if (last) {
+        uint8_t block[BLOCK_SIZE];
+        for (uint64_t offset = first; offset <= last; ) {
+            if (offset != first)
+                usleep(BLOCK_INTERVAL);
+            size_t size = last + 1 - offset;
+            if (size > BLOCK_SIZE)
+                size = BLOCK_SIZE;
+            for (size_t i = 0; i < size; i++)
+                block[i] = object_byte(offset + i);
+            server_write(fd, block, size);
+            offset += size;
+        }
+    }
+
+    pthread_mutex_lock(&lock);
+    nb_conns--;
+    pthread_mutex_unlock(&lock);
+    close(fd);
+    return NULL;
+}
+
+/** @This accepts connections. */
+static void *server(void *arg)
+{
+    int fd = (intptr_t)arg;
+    for ( ; ; ) {
+        int conn = accept(fd, NULL, NULL);
+        if (conn < 0)
+            return NULL;
+        pthread_t thread;
+        assert(!pthread_create(&thread, NULL, server_conn,
+                               (void *)(intptr_t)conn));
+        pthread_detach(thread);
+    }
+}
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_SOURCE_END:
+            if (upipe->mgr->signature == UPIPE_HTTP_MSRC_SIGNATURE)
+                source_end = true;
+            break;
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** helper phony pipe */
+struct test_pipe {
+    uint64_t received;
+    bool end;
+    struct upipe upipe;
+};
+
+/** helper phony pipe */
+UPIPE_HELPER_UPIPE(test_pipe, upipe, 0);
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct test_pipe *test_pipe = malloc(sizeof(struct test_pipe));
+    assert(test_pipe != NULL);
+    test_pipe->received = 0;
+    test_pipe->end = false;
+    upipe_init(&test_pipe->upipe, mgr, uprobe);
+    upipe_throw_ready(&test_pipe->upipe);
+    return &test_pipe->upipe;
+}
+
+/** helper phony pipe, checking the data is received in order */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    struct test_pipe *test_pipe = test_pipe_from_upipe(upipe);
+    assert(!test_pipe->end);
+    if (ubase_check(uref_block_get_end(uref)))
+        test_pipe->end = true;
+
+    int offset = 0, size = -1;
+    const uint8_t *buffer;
+    while (ubase_check(uref_block_read(uref, offset, &size, &buffer))) {
+        if (!size)
+            break;
+        for (int i = 0; i < size; i++)
+            assert(buffer[i] == object_byte(test_pipe->received + i));
+        uref_block_unmap(uref, offset);
+        test_pipe->received += size;
+        offset += size;
+        size = -1;
+    }
+    uref_free(uref);
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+            return UBASE_ERR_NONE;
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    struct test_pipe *test_pipe = test_pipe_from_upipe(upipe);
+    upipe_throw_dead(upipe);
+    upipe_clean(upipe);
+    free(test_pipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .signature = 0,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** @This downloads an object and checks it.
+ *
+ * @param path path of the object on the server
+ * @param found true if the object exists
+ * @param uclock clock to attach to adapt the connections, or NULL
+ * @param logger probe hierarchy
+ * @param upump_mgr event loop
+ * @param mgr http multi source manager
+ * @return maximum number of parallel connections
+ */
+static unsigned int test_download(const char *path, bool found,
+                                  bool uclock,
+                                  struct uprobe *logger,
+                                  struct upump_mgr *upump_mgr,
+                                  struct upipe_mgr *mgr)
+{
+    struct upipe *sink = upipe_void_alloc(&test_mgr, uprobe_use(logger));
+    assert(sink != NULL);
+
+    struct upipe *upipe = upipe_void_alloc(mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "msrc"));
+    assert(upipe != NULL);
+    ubase_assert(upipe_set_output(upipe, sink));
+    ubase_assert(upipe_http_msrc_set_chunk_size(upipe, CHUNK_SIZE));
+    ubase_assert(upipe_http_msrc_set_max_streams(upipe, MAX_STREAMS));
+    ubase_nassert(upipe_http_msrc_set_max_streams(upipe, 0));
+    if (uclock)
+        ubase_assert(upipe_attach_uclock(upipe));
+
+    char uri[64];
+    snprintf(uri, sizeof(uri), "http://127.0.0.1:%u%s", port, path);
+    nb_requests = 0;
+    max_conns = 0;
+    source_end = false;
+    ubase_assert(upipe_set_uri(upipe, uri));
+
+    upump_mgr_run(upump_mgr, NULL);
+
+    assert(source_end);
+    struct test_pipe *test_pipe = test_pipe_from_upipe(sink);
+    assert(test_pipe->received == (found ? OBJECT_SIZE : 0));
+    assert(test_pipe->end == found);
+
+    uint64_t size, position;
+    if (found) {
+        ubase_assert(upipe_src_get_size(upipe, &size));
+        assert(size == OBJECT_SIZE);
+    } else
+        ubase_nassert(upipe_src_get_size(upipe, &size));
+    ubase_assert(upipe_src_get_position(upipe, &position));
+    assert(position == test_pipe->received);
+    unsigned int streams;
+    ubase_assert(upipe_http_msrc_get_streams(upipe, &streams));
+    assert(streams >= 1 && streams <= MAX_STREAMS);
+    fprintf(stdout, "%s: %u requests, %u connections at most, %u streams\n",
+            path, nb_requests, max_conns, streams);
+
+    upipe_release(upipe);
+    test_free(sink);
+    return max_conns;
+}
+
+int main(int argc, char *argv[])
+{
+    /* local http server */
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(fd >= 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    assert(!bind(fd, (struct sockaddr *)&addr, sizeof(addr)));
+    assert(!listen(fd, 16));
+    socklen_t addrlen = sizeof(addr);
+    assert(!getsockname(fd, (struct sockaddr *)&addr, &addrlen));
+    port = ntohs(addr.sin_port);
+    pthread_t thread;
+    assert(!pthread_create(&thread, NULL, server, (void *)(intptr_t)fd));
+
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
+                                                   0);
+    assert(uref_mgr != NULL);
+    struct upump_mgr *upump_mgr = upump_ev_mgr_alloc_default(UPUMP_POOL,
+            UPUMP_BLOCKER_POOL);
+    assert(upump_mgr != NULL);
+    struct uclock *uclock = uclock_std_alloc(0);
+    assert(uclock != NULL);
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *logger = uprobe_stdio_alloc(&uprobe, stdout,
+                                               UPROBE_LOG_LEVEL);
+    assert(logger != NULL);
+    logger = uprobe_uref_mgr_alloc(logger, uref_mgr);
+    assert(logger != NULL);
+    logger = uprobe_upump_mgr_alloc(logger, upump_mgr);
+    assert(logger != NULL);
+    logger = uprobe_uclock_alloc(logger, uclock);
+    assert(logger != NULL);
+    logger = uprobe_ubuf_mem_alloc(logger, umem_mgr, UBUF_POOL_DEPTH,
+                                   UBUF_POOL_DEPTH);
+    assert(logger != NULL);
+
+    struct upipe_mgr *http_src_mgr = upipe_http_src_mgr_alloc();
+    assert(http_src_mgr != NULL);
+    struct upipe_mgr *mgr = upipe_http_msrc_mgr_alloc(http_src_mgr);
+    assert(mgr != NULL);
+    upipe_mgr_release(http_src_mgr);
+
+    /* fixed number of connections */
+    assert(test_download("/object", true, false, logger, upump_mgr, mgr) >
+           1);
+    assert(nb_requests == (OBJECT_SIZE + CHUNK_SIZE - 1) / CHUNK_SIZE);
+
+    /* adapted number of connections */
+    test_download("/object", true, true, logger, upump_mgr, mgr);
+
+    /* server without ranges */
+    assert(test_download("/norange", true, false, logger, upump_mgr, mgr) ==
+           1);
+    assert(nb_requests == 1);
+
+    /* redirection */
+    assert(test_download("/redirect", true, false, logger, upump_mgr, mgr) >
+           1);
+    assert(nb_requests == 1 + (OBJECT_SIZE + CHUNK_SIZE - 1) / CHUNK_SIZE);
+
+    /* missing object */
+    test_download("/missing", false, false, logger, upump_mgr, mgr);
+    assert(nb_requests == 4);
+
+    upipe_mgr_release(mgr);
+
+    shutdown(fd, SHUT_RDWR);
+    close(fd);
+    assert(!pthread_join(thread, NULL));
+
+    upump_mgr_release(upump_mgr);
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uclock_release(uclock);
+    uprobe_release(logger);
+    uprobe_clean(&uprobe);
+
+    return 0;
+}
@@ -44,6 +44,7 @@
 #include <upipe/uref_flow.h>
 #include <upipe/uref_block.h>
 #include <upipe/uref_block_flow.h>
+#include <upipe/uref_pic.h>
 #include <upipe/uref_clock.h>
 #include <upipe/uref_std.h>
 #include <upipe/uref_dump.h>
@@ -109,6 +110,8 @@ static void test_input(struct upipe *upipe, struct uref *uref,
     uref_clock_get_rap_sys(uref, &systime_rap);
     uref_clock_get_pts_orig(uref, &pts_orig);
     uref_clock_get_dts_orig(uref, &dts_orig);
+    /* there are no B pictures */
+    assert(!ubase_check(uref_pic_get_discardable(uref)));
     switch (nb_packets) {
         case 0:
         case 2:
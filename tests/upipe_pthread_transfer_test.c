@@ -0,0 +1,280 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for the real-time profile of pthread transfer managers
+ */
+
+#undef NDEBUG
+
+#include <upipe/ubase.h>
+#include <upipe/uatomic.h>
+#include <upipe/uclock.h>
+#include <upipe/ulog.h>
+#include <upipe/urefcount.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/uref.h>
+#include <upipe/uref_std.h>
+#include <upipe/upump.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/upipe.h>
+#include <upump-ev/upump_ev.h>
+#include <upipe-modules/upipe_transfer.h>
+#include <upipe-pthread/uprobe_pthread_upump_mgr.h>
+#include <upipe-pthread/upipe_pthread_transfer.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <assert.h>
+
+#define UDICT_POOL_DEPTH 1
+#define UREF_POOL_DEPTH 1
+#define UPUMP_POOL 1
+#define UPUMP_BLOCKER_POOL 1
+#define XFER_QUEUE 255
+#define XFER_POOL 1
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+
+/** thread in which the pipe was attached */
+static pthread_t attached_thread_id;
+/** true if the pipe was attached */
+static bool attached = false;
+/** duration of the attach command, in microseconds */
+static unsigned int attach_delay = 0;
+/** number of warnings about the scheduling priority */
+static uatomic_uint32_t nb_priority_warnings;
+/** number of warnings about a blocked event loop */
+static uatomic_uint32_t nb_blocked_warnings;
+/** number of notices about the budget at the end of the thread */
+static uatomic_uint32_t nb_budget_notices;
+
+/** definition of our uprobe, counting the messages of the thread */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    if (event == UPROBE_LOG) {
+        va_list args_copy;
+        va_copy(args_copy, args);
+        struct ulog *ulog = va_arg(args_copy, struct ulog *);
+        va_end(args_copy);
+
+        if (ulog->level == UPROBE_LOG_WARNING &&
+            strstr(ulog->msg, "real-time priority") != NULL)
+            uatomic_fetch_add(&nb_priority_warnings, 1);
+        else if (ulog->level == UPROBE_LOG_WARNING &&
+                 strstr(ulog->msg, "event loop blocked") != NULL)
+            uatomic_fetch_add(&nb_blocked_warnings, 1);
+        else if (ulog->level == UPROBE_LOG_NOTICE &&
+                 strstr(ulog->msg, "exceeded its budget") != NULL)
+            uatomic_fetch_add(&nb_budget_notices, 1);
+    }
+    return uprobe_throw_next(uprobe, upipe, event, args);
+}
+
+/** helper phony pipe */
+struct test_pipe {
+    struct urefcount urefcount;
+    struct upipe upipe;
+};
+
+/** helper phony pipe */
+static void test_free(struct urefcount *urefcount)
+{
+    struct test_pipe *test_pipe =
+        container_of(urefcount, struct test_pipe, urefcount);
+    urefcount_clean(&test_pipe->urefcount);
+    upipe_clean(&test_pipe->upipe);
+    free(test_pipe);
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr,
+                                struct uprobe *uprobe, uint32_t signature,
+                                va_list args)
+{
+    struct test_pipe *test_pipe = malloc(sizeof(struct test_pipe));
+    assert(test_pipe != NULL);
+    upipe_init(&test_pipe->upipe, mgr, uprobe);
+    urefcount_init(&test_pipe->urefcount, test_free);
+    test_pipe->upipe.refcount = &test_pipe->urefcount;
+    return &test_pipe->upipe;
+}
+
+/** helper timer keeping the event loop alive after a blocking command */
+static void test_timer(struct upump *upump)
+{
+    upump_stop(upump);
+    upump_free(upump);
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_UNCONFINE:
+            return UBASE_ERR_UNHANDLED;
+        case UPIPE_ATTACH_UPUMP_MGR: {
+            attached_thread_id = pthread_self();
+            attached = true;
+            if (!attach_delay)
+                return UBASE_ERR_NONE;
+
+            /* block the event loop, then leave it running long enough for
+             * the watchdog to notice */
+            usleep(attach_delay);
+            struct upump_mgr *upump_mgr = NULL;
+            ubase_assert(upipe_throw_need_upump_mgr(upipe, &upump_mgr));
+            assert(upump_mgr != NULL);
+            struct upump *upump = upump_alloc_timer(upump_mgr, test_timer,
+                                                    NULL, NULL,
+                                                    UCLOCK_FREQ / 20, 0);
+            assert(upump != NULL);
+            upump_start(upump);
+            upump_mgr_release(upump_mgr);
+            return UBASE_ERR_NONE;
+        }
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc,
+    .upipe_input = NULL,
+    .upipe_control = test_control
+};
+
+/** @This transfers a phony pipe to a new thread with the given real-time
+ * profile, and waits for the thread to exit.
+ *
+ * @param upump_mgr event loop of the main thread
+ * @param logger probe hierarchy, including a pthread upump_mgr probe
+ * @param rt real-time profile
+ */
+static void test_rt(struct upump_mgr *upump_mgr, struct uprobe *logger,
+                    const struct upipe_pthread_rt *rt)
+{
+    pthread_t thread_id;
+    attached = false;
+    uatomic_store(&nb_priority_warnings, 0);
+    uatomic_store(&nb_blocked_warnings, 0);
+    uatomic_store(&nb_budget_notices, 0);
+
+    struct upipe_mgr *upipe_xfer_mgr =
+        upipe_pthread_xfer_mgr_alloc_rt(XFER_QUEUE, XFER_POOL,
+                                        uprobe_use(logger),
+                                        upump_ev_mgr_alloc_loop,
+                                        UPUMP_POOL, UPUMP_BLOCKER_POOL,
+                                        NULL, &thread_id, NULL, rt);
+    assert(upipe_xfer_mgr != NULL);
+
+    struct upipe *upipe_test = upipe_void_alloc(&test_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "test"));
+    assert(upipe_test != NULL);
+
+    struct upipe *upipe_handle = upipe_xfer_alloc(upipe_xfer_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "xfer"),
+            upipe_test);
+    assert(upipe_handle != NULL);
+    ubase_assert(upipe_attach_upump_mgr(upipe_handle));
+    upipe_release(upipe_handle);
+    upipe_mgr_release(upipe_xfer_mgr);
+
+    /* returns when the thread has been joined */
+    upump_mgr_run(upump_mgr, NULL);
+
+    assert(attached);
+    assert(pthread_equal(attached_thread_id, thread_id));
+    assert(!pthread_equal(attached_thread_id, pthread_self()));
+}
+
+int main(int argc, char **argv)
+{
+    struct upump_mgr *upump_mgr =
+        upump_ev_mgr_alloc_default(UPUMP_POOL, UPUMP_BLOCKER_POOL);
+    assert(upump_mgr != NULL);
+
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr =
+        uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr, 0);
+    assert(uref_mgr != NULL);
+
+    uatomic_init(&nb_priority_warnings, 0);
+    uatomic_init(&nb_blocked_warnings, 0);
+    uatomic_init(&nb_budget_notices, 0);
+
+    struct uprobe *logger = uprobe_stdio_alloc(NULL, stdout,
+                                               UPROBE_LOG_LEVEL);
+    assert(logger != NULL);
+    logger = uprobe_alloc(catch, logger);
+    assert(logger != NULL);
+    logger = uprobe_pthread_upump_mgr_alloc(logger);
+    assert(logger != NULL);
+    ubase_assert(uprobe_pthread_upump_mgr_set(logger, upump_mgr));
+
+    /* a priority out of range is always refused, so the thread must warn
+     * and go on with the default scheduling */
+    struct upipe_pthread_rt rt;
+    upipe_pthread_rt_init(&rt);
+    rt.priority = sched_get_priority_max(rt.policy) + 1;
+    rt.stack_prefault = 64 * 1024;
+    rt.umem_mgr = umem_mgr;
+    rt.uref_mgr = uref_mgr;
+    attach_delay = 0;
+    test_rt(upump_mgr, logger, &rt);
+    assert(uatomic_load(&nb_priority_warnings) == 1);
+    assert(uatomic_load(&nb_blocked_warnings) == 0);
+    assert(uatomic_load(&nb_budget_notices) == 0);
+
+    /* a command blocking the event loop for ten budgets must trigger the
+     * watchdog */
+    upipe_pthread_rt_init(&rt);
+    rt.budget = UCLOCK_FREQ / 100;
+    attach_delay = 100000;
+    test_rt(upump_mgr, logger, &rt);
+    assert(uatomic_load(&nb_priority_warnings) == 0);
+    assert(uatomic_load(&nb_blocked_warnings) >= 1);
+    assert(uatomic_load(&nb_budget_notices) == 1);
+
+    uprobe_release(logger);
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    upump_mgr_release(upump_mgr);
+    return 0;
+}
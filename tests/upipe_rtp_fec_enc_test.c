@@ -0,0 +1,369 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for SMPTE 2022-1 FEC generator, against upipe_rtp_fec
+ */
+
+#undef NDEBUG
+
+#include <upipe/uclock.h>
+#include <upipe/uclock_std.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_uclock.h>
+#include <upipe/uprobe_upump_mgr.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_std.h>
+#include <upipe/upump.h>
+#include <upipe/upipe.h>
+#include <upump-ev/upump_ev.h>
+#include <upipe-ts/upipe_rtp_fec.h>
+#include <upipe-ts/upipe_rtp_fec_enc.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#include <bitstream/ietf/rtp.h>
+#include <bitstream/mpeg/ts.h>
+
+#define UDICT_POOL_DEPTH 0
+#define UREF_POOL_DEPTH 0
+#define UBUF_POOL_DEPTH 0
+#define UPUMP_POOL 0
+#define UPUMP_BLOCKER_POOL 0
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+#define COLS 5
+#define ROWS 4
+#define NB_PACKETS 400
+#define PAYLOAD_SIZE (7 * TS_SIZE)
+#define PT 33
+#define FIRST_CHECKED (3 * COLS * ROWS)
+
+/** sequence numbers dropped on the lossy link, each in a different row
+ * and column */
+static const uint16_t dropped[] = { 103, 167, 231 };
+
+static struct upipe *rtp_fec_main = NULL;
+static struct upipe *rtp_fec = NULL;
+static struct upipe *rtp_fec_enc = NULL;
+static unsigned int nb_dropped = 0;
+static unsigned int nb_received = 0;
+static int last_seqnum = -1;
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe simulating a lossy link */
+static void loss_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    uint8_t buffer[RTP_HEADER_SIZE];
+    const uint8_t *rtp = uref_block_peek(uref, 0, RTP_HEADER_SIZE, buffer);
+    assert(rtp != NULL);
+    uint16_t seqnum = rtp_get_seqnum(rtp);
+    uref_block_peek_unmap(uref, 0, buffer, rtp);
+
+    for (int i = 0; i < UBASE_ARRAY_SIZE(dropped); i++)
+        if (seqnum == dropped[i]) {
+            nb_dropped++;
+            uref_free(uref);
+            return;
+        }
+    upipe_input(rtp_fec_main, uref, upump_p);
+}
+
+/** helper phony pipe simulating a lossy link */
+static int loss_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            return upipe_set_flow_def(rtp_fec_main, flow_def);
+        }
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe simulating a lossy link */
+static struct upipe_mgr loss_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc,
+    .upipe_input = loss_input,
+    .upipe_control = loss_control
+};
+
+/** helper phony pipe checking the recovered stream */
+static void sink_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    size_t size;
+    ubase_assert(uref_block_size(uref, &size));
+    assert(size == RTP_HEADER_SIZE + PAYLOAD_SIZE);
+
+    uint8_t buffer[RTP_HEADER_SIZE + PAYLOAD_SIZE];
+    const uint8_t *rtp = uref_block_peek(uref, 0, size, buffer);
+    assert(rtp != NULL);
+    uint16_t seqnum = rtp_get_seqnum(rtp);
+    assert(rtp_get_type(rtp) == PT);
+    assert(rtp_get_timestamp(rtp) == seqnum * 90);
+    for (int i = 0; i < PAYLOAD_SIZE; i++)
+        assert(rtp[RTP_HEADER_SIZE + i] == (uint8_t)(seqnum + i));
+    uref_block_peek_unmap(uref, 0, buffer, rtp);
+    uref_free(uref);
+
+    /* the receiver needs a few matrices to lock */
+    if (seqnum < FIRST_CHECKED)
+        return;
+    assert(seqnum == (last_seqnum == -1 ? FIRST_CHECKED : last_seqnum + 1));
+    last_seqnum = seqnum;
+    nb_received++;
+}
+
+/** helper phony pipe checking the recovered stream */
+static int sink_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe checking the recovered stream */
+static struct upipe_mgr sink_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc,
+    .upipe_input = sink_input,
+    .upipe_control = sink_control
+};
+
+/** stops the test once the FEC receiver has flushed its buffer */
+static void stop(struct upump *upump)
+{
+    uint64_t recovered, lost;
+    ubase_assert(upipe_rtp_fec_get_packets_recovered(rtp_fec, &recovered));
+    ubase_assert(upipe_rtp_fec_get_packets_lost(rtp_fec, &lost));
+    assert(recovered == UBASE_ARRAY_SIZE(dropped));
+    assert(!lost);
+
+    /* the generator holds the FEC subpipes of the receiver */
+    upipe_release(rtp_fec_enc);
+    upipe_release(rtp_fec);
+    upump_stop(upump);
+}
+
+int main(int argc, char *argv[])
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
+                                                   0);
+    assert(uref_mgr != NULL);
+    struct ubuf_mgr *ubuf_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH,
+                                                         UBUF_POOL_DEPTH,
+                                                         umem_mgr, 0, 0, -1, 0);
+    assert(ubuf_mgr != NULL);
+    struct upump_mgr *upump_mgr = upump_ev_mgr_alloc_default(UPUMP_POOL,
+            UPUMP_BLOCKER_POOL);
+    assert(upump_mgr != NULL);
+    struct uclock *uclock = uclock_std_alloc(0);
+    assert(uclock != NULL);
+
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *logger = uprobe_stdio_alloc(&uprobe, stdout,
+                                               UPROBE_LOG_LEVEL);
+    assert(logger != NULL);
+    logger = uprobe_upump_mgr_alloc(logger, upump_mgr);
+    assert(logger != NULL);
+    logger = uprobe_uclock_alloc(logger, uclock);
+    assert(logger != NULL);
+
+    /* receiver */
+    struct upipe_mgr *upipe_rtp_fec_mgr = upipe_rtp_fec_mgr_alloc();
+    assert(upipe_rtp_fec_mgr != NULL);
+    rtp_fec = upipe_rtp_fec_alloc(upipe_rtp_fec_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "fec"),
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "main"),
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "col"),
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "row"));
+    assert(rtp_fec != NULL);
+    ubase_assert(upipe_rtp_fec_set_pt(rtp_fec, PT));
+    ubase_assert(upipe_attach_uclock(rtp_fec));
+    struct upipe *rtp_fec_col, *rtp_fec_row;
+    ubase_assert(upipe_rtp_fec_get_main_sub(rtp_fec, &rtp_fec_main));
+    ubase_assert(upipe_rtp_fec_get_col_sub(rtp_fec, &rtp_fec_col));
+    ubase_assert(upipe_rtp_fec_get_row_sub(rtp_fec, &rtp_fec_row));
+
+    struct upipe *sink = upipe_void_alloc(&sink_mgr, uprobe_use(logger));
+    assert(sink != NULL);
+    ubase_assert(upipe_set_output(rtp_fec, sink));
+
+    /* generator */
+    struct upipe_mgr *upipe_rtp_fec_enc_mgr = upipe_rtp_fec_enc_mgr_alloc();
+    assert(upipe_rtp_fec_enc_mgr != NULL);
+    rtp_fec_enc = upipe_rtp_fec_enc_alloc(
+            upipe_rtp_fec_enc_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "fec enc"),
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "enc col"),
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                             "enc row"));
+    assert(rtp_fec_enc != NULL);
+    ubase_nassert(upipe_rtp_fec_enc_set_matrix(rtp_fec_enc, 21, 4));
+    ubase_nassert(upipe_rtp_fec_enc_set_matrix(rtp_fec_enc, 5, 3));
+    ubase_nassert(upipe_rtp_fec_enc_set_matrix(rtp_fec_enc, 10, 11));
+    ubase_assert(upipe_rtp_fec_enc_set_matrix(rtp_fec_enc, COLS, ROWS));
+    unsigned int cols, rows;
+    ubase_assert(upipe_rtp_fec_enc_get_matrix(rtp_fec_enc, &cols, &rows));
+    assert(cols == COLS);
+    assert(rows == ROWS);
+
+    struct uref *uref = uref_block_flow_alloc_def(uref_mgr, "rtp.");
+    assert(uref != NULL);
+    ubase_assert(upipe_set_flow_def(rtp_fec_enc, uref));
+    uref_free(uref);
+
+    struct upipe *loss = upipe_void_alloc(&loss_mgr, uprobe_use(logger));
+    assert(loss != NULL);
+    ubase_assert(upipe_set_output(rtp_fec_enc, loss));
+    struct upipe *rtp_fec_enc_col, *rtp_fec_enc_row;
+    ubase_assert(upipe_rtp_fec_enc_get_col_sub(rtp_fec_enc,
+                                               &rtp_fec_enc_col));
+    ubase_assert(upipe_rtp_fec_enc_get_row_sub(rtp_fec_enc,
+                                               &rtp_fec_enc_row));
+    ubase_assert(upipe_set_output(rtp_fec_enc_col, rtp_fec_col));
+    ubase_assert(upipe_set_output(rtp_fec_enc_row, rtp_fec_row));
+
+    /* all packets are dated in the past, 100 us apart */
+    uint64_t now = uclock_now(uclock);
+    for (unsigned int i = 0; i < NB_PACKETS; i++) {
+        uref = uref_block_alloc(uref_mgr, ubuf_mgr,
+                                RTP_HEADER_SIZE + PAYLOAD_SIZE);
+        assert(uref != NULL);
+        uint8_t *buffer;
+        int size = -1;
+        ubase_assert(uref_block_write(uref, 0, &size, &buffer));
+        memset(buffer, 0, RTP_HEADER_SIZE);
+        rtp_set_hdr(buffer);
+        rtp_set_type(buffer, PT);
+        rtp_set_seqnum(buffer, i);
+        rtp_set_timestamp(buffer, i * 90);
+        for (int j = 0; j < PAYLOAD_SIZE; j++)
+            buffer[RTP_HEADER_SIZE + j] = i + j;
+        uref_block_unmap(uref, 0);
+        uref_clock_set_date_sys(uref,
+                now - (NB_PACKETS - i) * UCLOCK_FREQ / 10000, UREF_DATE_CR);
+        upipe_input(rtp_fec_enc, uref, NULL);
+    }
+    assert(nb_dropped == UBASE_ARRAY_SIZE(dropped));
+
+    struct upump *upump = upump_alloc_timer(upump_mgr, stop, NULL, NULL,
+                                            UCLOCK_FREQ / 2, 0);
+    assert(upump != NULL);
+    upump_start(upump);
+    upump_mgr_run(upump_mgr, NULL);
+    upump_free(upump);
+
+    assert(nb_received == NB_PACKETS - FIRST_CHECKED);
+
+    upipe_mgr_release(upipe_rtp_fec_enc_mgr); // nop
+    upipe_mgr_release(upipe_rtp_fec_mgr); // nop
+    test_free(loss);
+    test_free(sink);
+
+    upump_mgr_release(upump_mgr);
+    uclock_release(uclock);
+    uref_mgr_release(uref_mgr);
+    ubuf_mgr_release(ubuf_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(logger);
+    uprobe_clean(&uprobe);
+
+    return 0;
+}
@@ -0,0 +1,294 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for statmux pipe
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uclock.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_pic.h>
+#include <upipe/uref_std.h>
+#include <upipe/upipe.h>
+#include <upipe-modules/upipe_statmux.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#define UDICT_POOL_DEPTH 0
+#define UREF_POOL_DEPTH 0
+#define UBUF_POOL_DEPTH 0
+#define UPROBE_LOG_LEVEL UPROBE_LOG_VERBOSE
+#define POOL_OCTETRATE 1000000
+#define FLOW_OCTETRATE 500000
+#define FLOW_BUFFER_SIZE 450000
+#define FRAME_SIZE 1000
+#define GOP_SIZE 25
+#define FRAME_DURATION (UCLOCK_FREQ / GOP_SIZE)
+
+static unsigned int nb_packets = 0;
+static unsigned int nb_reallocs = 0;
+
+/** phony mux input */
+struct test_sink {
+    /** octetrate of the last flow definition */
+    uint64_t octetrate;
+    /** buffer size of the last flow definition */
+    uint64_t buffer_size;
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+static struct test_sink sinks[2];
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+            break;
+        case UPROBE_STATMUX_SUB_REALLOC: {
+            unsigned int signature = va_arg(args, unsigned int);
+            assert(signature == UPIPE_STATMUX_SUB_SIGNATURE);
+            uint64_t octetrate = va_arg(args, uint64_t);
+            uint64_t buffer_size = va_arg(args, uint64_t);
+            assert(octetrate <= POOL_OCTETRATE);
+            assert(buffer_size <= octetrate);
+            nb_reallocs++;
+            break;
+        }
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct test_sink *sink = va_arg(args, struct test_sink *);
+    sink->octetrate = 0;
+    sink->buffer_size = 0;
+    upipe_init(&sink->upipe, mgr, uprobe);
+    return &sink->upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    assert(uref != NULL);
+    uref_free(uref);
+    nb_packets++;
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    struct test_sink *sink = container_of(upipe, struct test_sink, upipe);
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF: {
+            struct uref *flow_def = va_arg(args, struct uref *);
+            ubase_assert(uref_block_flow_get_octetrate(flow_def,
+                                                       &sink->octetrate));
+            ubase_assert(uref_block_flow_get_buffer_size(flow_def,
+                                                         &sink->buffer_size));
+            /* the reservations of the mux inputs fit in the pool */
+            assert(sinks[0].octetrate + sinks[1].octetrate <= POOL_OCTETRATE);
+            return UBASE_ERR_NONE;
+        }
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_clean(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** sends a coded picture to a statmux subpipe */
+static void send_pic(struct upipe *upipe, struct uref_mgr *uref_mgr,
+                     struct ubuf_mgr *ubuf_mgr, unsigned int num, uint8_t qp)
+{
+    struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr, FRAME_SIZE);
+    assert(uref != NULL);
+    uref_clock_set_dts_prog(uref, (uint64_t)num * FRAME_DURATION);
+    if (!(num % GOP_SIZE))
+        uref_flow_set_random(uref);
+    ubase_assert(uref_pic_set_qp(uref, qp));
+    upipe_input(upipe, uref, NULL);
+}
+
+int main(int argc, char *argv[])
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
+                                                   0);
+    assert(uref_mgr != NULL);
+    struct ubuf_mgr *ubuf_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH,
+                                                         UBUF_POOL_DEPTH,
+                                                         umem_mgr, 0, 0,
+                                                         -1, 0);
+    assert(ubuf_mgr != NULL);
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *uprobe_stdio = uprobe_stdio_alloc(&uprobe, stdout,
+                                                     UPROBE_LOG_LEVEL);
+    assert(uprobe_stdio != NULL);
+
+
+    struct upipe_mgr *upipe_statmux_mgr = upipe_statmux_mgr_alloc();
+    assert(upipe_statmux_mgr != NULL);
+    struct upipe *upipe_statmux = upipe_void_alloc(upipe_statmux_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "statmux"));
+    assert(upipe_statmux != NULL);
+    ubase_assert(upipe_statmux_set_octetrate(upipe_statmux, POOL_OCTETRATE));
+    uint64_t octetrate;
+    ubase_assert(upipe_statmux_get_octetrate(upipe_statmux, &octetrate));
+    assert(octetrate == POOL_OCTETRATE);
+
+    struct uref *flow_def = uref_block_flow_alloc_def(uref_mgr, "h264.pic.");
+    assert(flow_def != NULL);
+    ubase_assert(uref_block_flow_set_octetrate(flow_def, FLOW_OCTETRATE));
+    ubase_assert(uref_block_flow_set_buffer_size(flow_def, FLOW_BUFFER_SIZE));
+
+    struct upipe *subs[2];
+    for (int i = 0; i < 2; i++) {
+        subs[i] = upipe_void_alloc_sub(upipe_statmux,
+                uprobe_pfx_alloc_va(uprobe_use(uprobe_stdio),
+                                    UPROBE_LOG_LEVEL, "sub %d", i));
+        assert(subs[i] != NULL);
+        struct upipe *upipe_sink = upipe_alloc(&test_mgr,
+                uprobe_use(uprobe_stdio), 0, &sinks[i]);
+        assert(upipe_sink != NULL);
+        ubase_assert(upipe_set_flow_def(subs[i], flow_def));
+        ubase_assert(upipe_set_output(subs[i], upipe_sink));
+        uint64_t max_delay;
+        ubase_assert(upipe_statmux_sub_get_max_delay(subs[i], &max_delay));
+        assert(max_delay == UCLOCK_FREQ);
+    }
+    uref_free(flow_def);
+
+    /* sub 0 is 4 times as complex as sub 1 (QP 34 vs. 22) */
+    for (unsigned int num = 0; num <= GOP_SIZE * 2; num++) {
+        send_pic(subs[0], uref_mgr, ubuf_mgr, num, 34);
+        send_pic(subs[1], uref_mgr, ubuf_mgr, num, 22);
+    }
+    assert(nb_packets == (GOP_SIZE * 2 + 1) * 2);
+    assert(nb_reallocs >= 4);
+
+    struct upipe_statmux_stats stats[2];
+    for (int i = 0; i < 2; i++) {
+        ubase_assert(upipe_statmux_sub_get_stats(subs[i], &stats[i]));
+        assert(stats[i].gops == 2);
+        assert(stats[i].measured_octetrate == FRAME_SIZE * GOP_SIZE);
+        /* the buffering delay of the flow definition is kept */
+        assert(stats[i].buffer_size == stats[i].octetrate * 9 / 10);
+        assert(sinks[i].octetrate == stats[i].octetrate);
+        assert(sinks[i].buffer_size == stats[i].buffer_size);
+    }
+    assert(stats[0].qp.num == 34 && stats[0].qp.den == 1);
+    assert(stats[1].qp.num == 22 && stats[1].qp.den == 1);
+    /* the complex service gets more than its static reservation */
+    assert(stats[0].octetrate == POOL_OCTETRATE * 4 / 5);
+    assert(stats[1].octetrate == POOL_OCTETRATE / 5);
+
+    uint64_t padding;
+    struct urational ratio;
+    ubase_assert(upipe_statmux_get_padding(upipe_statmux, &padding, &ratio));
+    assert(padding == POOL_OCTETRATE - 2 * FRAME_SIZE * GOP_SIZE);
+    assert(ratio.num == 19 && ratio.den == 20);
+
+    /* guarantee a minimum to the easy service */
+    ubase_assert(upipe_statmux_sub_set_octetrate_range(subs[1], 300000, 0));
+    ubase_assert(upipe_statmux_set_octetrate(upipe_statmux, POOL_OCTETRATE));
+    for (int i = 0; i < 2; i++)
+        ubase_assert(upipe_statmux_sub_get_stats(subs[i], &stats[i]));
+    assert(stats[0].octetrate == POOL_OCTETRATE - 300000);
+    assert(stats[1].octetrate == 300000);
+    for (int i = 0; i < 2; i++)
+        assert(sinks[i].octetrate == stats[i].octetrate);
+
+    /* the remaining service gets the whole pool */
+    /* the mux input of the released service goes away with it */
+    sinks[1].octetrate = 0;
+    upipe_release(subs[1]);
+    test_free(&sinks[1].upipe);
+    ubase_assert(upipe_statmux_sub_get_stats(subs[0], &stats[0]));
+    assert(stats[0].octetrate == POOL_OCTETRATE);
+    assert(sinks[0].octetrate == POOL_OCTETRATE);
+
+    upipe_release(subs[0]);
+    test_free(&sinks[0].upipe);
+    upipe_release(upipe_statmux);
+    upipe_mgr_release(upipe_statmux_mgr); // nop
+
+    ubuf_mgr_release(ubuf_mgr);
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(uprobe_stdio);
+    uprobe_clean(&uprobe);
+
+    return 0;
+}
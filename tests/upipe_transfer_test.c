@@ -92,6 +92,10 @@ static struct upipe *test_alloc(struct upipe_mgr *mgr,
 static int test_control(struct upipe *upipe, int command, va_list args)
 {
     switch (command) {
+        case UPIPE_UNCONFINE:
+            /* sent before the pipe is moved to the other thread */
+            assert(!transferred);
+            return UBASE_ERR_UNHANDLED;
         case UPIPE_ATTACH_UPUMP_MGR: {
             transferred = true;
             assert(pthread_equal(pthread_self(), xfer_thread_id));
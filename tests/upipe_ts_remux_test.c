@@ -0,0 +1,483 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for TS remux module
+ */
+
+#undef NDEBUG
+
+#include <upipe/uclock.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/uref.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_std.h>
+#include <upipe/upipe.h>
+#include <upipe-ts/upipe_ts_remux.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#include <bitstream/mpeg/ts.h>
+#include <bitstream/mpeg/psi.h>
+
+#define UDICT_POOL_DEPTH 0
+#define UREF_POOL_DEPTH 0
+#define UBUF_POOL_DEPTH 0
+#define UPROBE_LOG_LEVEL UPROBE_LOG_VERBOSE
+
+static unsigned int nb_pat = 0;
+static unsigned int nb_pmt = 0;
+static unsigned int nb_cat = 0;
+static unsigned int nb_es = 0;
+static unsigned int nb_es2 = 0;
+static unsigned int nb_ecm = 0;
+static unsigned int nb_emm = 0;
+static unsigned int pmt_nb_es = 0;
+static uint16_t pmt_ecm_pid = 0;
+static uint8_t last_cc = 0;
+static const uint8_t *last_payload = NULL;
+
+/** returns the PID of a CA descriptor */
+static uint16_t ca_get_pid(const uint8_t *desc)
+{
+    assert(desc[0] == 0x9);
+    return ((desc[4] & 0x1f) << 8) | desc[5];
+}
+
+/** writes a CA descriptor */
+static void ca_init(uint8_t *desc, uint16_t pid)
+{
+    desc[0] = 0x9;
+    desc[1] = 4;
+    desc[2] = 0x01;
+    desc[3] = 0x00;
+    desc[4] = 0xe0 | (pid >> 8);
+    desc[5] = pid & 0xff;
+}
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    assert(uref != NULL);
+    size_t block_size;
+    ubase_assert(uref_block_size(uref, &block_size));
+    assert(block_size == TS_SIZE);
+    uint8_t ts[TS_SIZE];
+    ubase_assert(uref_block_extract(uref, 0, TS_SIZE, ts));
+    int size = -1;
+    ubase_assert(uref_block_read(uref, TS_HEADER_SIZE, &size, &last_payload));
+    uref_block_unmap(uref, TS_HEADER_SIZE);
+    switch (ts_get_pid(ts)) {
+        case 0: {
+            const uint8_t *pat = ts + TS_HEADER_SIZE + 1;
+            assert(ts_get_unitstart(ts));
+            assert(psi_validate(pat));
+            assert(psi_check_crc(pat));
+            assert(pat_get_tsid(pat) == 42);
+            assert(pat_get_program(pat, 0) != NULL);
+            assert(pat_get_program(pat, 1) == NULL);
+            assert(patn_get_program(pat_get_program(pat, 0)) == 1);
+            assert(patn_get_pid(pat_get_program(pat, 0)) == 0x100);
+            nb_pat++;
+            break;
+        }
+        case 1: {
+            uint8_t *cat = ts + TS_HEADER_SIZE + 1;
+            assert(psi_validate(cat));
+            assert(psi_check_crc(cat));
+            assert(cat_get_desclength(cat) == 6);
+            assert(ca_get_pid(cat_get_descl(cat)) == 0x120);
+            nb_cat++;
+            break;
+        }
+        case 0x100: {
+            uint8_t *pmt = ts + TS_HEADER_SIZE + 1;
+            assert(psi_validate(pmt));
+            assert(psi_check_crc(pmt));
+            assert(pmt_get_pcrpid(pmt) == 0x301);
+            assert(pmtn_get_pid(pmt_get_es(pmt, 0)) == 0x301);
+            pmt_nb_es = 0;
+            while (pmt_get_es(pmt, pmt_nb_es) != NULL)
+                pmt_nb_es++;
+            pmt_ecm_pid = pmt_get_desclength(pmt) ?
+                ca_get_pid(descs_get_desc(pmt_get_descs(pmt), 0)) : 0;
+            nb_pmt++;
+            break;
+        }
+        case 0x301:
+            assert(ts_get_cc(ts) == (uint8_t)((last_cc + 1) & 0xf));
+            last_cc = ts_get_cc(ts);
+            nb_es++;
+            break;
+        case 0x102:
+            nb_es2++;
+            break;
+        case 0x110:
+            nb_ecm++;
+            break;
+        case 0x120:
+            nb_emm++;
+            break;
+        default:
+            assert(0);
+    }
+    uref_free(uref);
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+            return UBASE_ERR_NONE;
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe to test upipe_ts_remux */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** allocates a TS packet */
+static struct uref *ts_alloc(struct uref_mgr *uref_mgr,
+                             struct ubuf_mgr *ubuf_mgr, uint16_t pid,
+                             uint8_t cc, uint8_t **ts_p)
+{
+    struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr, TS_SIZE);
+    assert(uref != NULL);
+    int size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, ts_p));
+    assert(size == TS_SIZE);
+    ts_init(*ts_p);
+    ts_set_pid(*ts_p, pid);
+    ts_set_cc(*ts_p, cc);
+    ts_set_payload(*ts_p);
+    memset(*ts_p + TS_HEADER_SIZE, 0xff, TS_SIZE - TS_HEADER_SIZE);
+    return uref;
+}
+
+/** allocates a TS packet containing a PMT, with an optional second
+ * elementary stream and an optional ECM PID */
+static struct uref *pmt_alloc(struct uref_mgr *uref_mgr,
+                              struct ubuf_mgr *ubuf_mgr, uint16_t program,
+                              uint16_t pid, uint8_t version, uint16_t es_pid,
+                              uint16_t es2_pid, uint16_t ecm_pid)
+{
+    uint8_t *ts;
+    struct uref *uref = ts_alloc(uref_mgr, ubuf_mgr, pid, 0, &ts);
+    ts_set_unitstart(ts);
+    ts[TS_HEADER_SIZE] = 0;
+    uint8_t *pmt = ts + TS_HEADER_SIZE + 1;
+    uint16_t desclength = ecm_pid ? 6 : 0;
+    unsigned int nb_es = es2_pid ? 2 : 1;
+    pmt_init(pmt);
+    pmt_set_length(pmt, desclength + nb_es * PMT_ES_SIZE);
+    pmt_set_program(pmt, program);
+    psi_set_version(pmt, version);
+    psi_set_current(pmt);
+    pmt_set_pcrpid(pmt, es_pid);
+    pmt_set_desclength(pmt, desclength);
+    if (ecm_pid)
+        ca_init(descs_get_desc(pmt_get_descs(pmt), 0), ecm_pid);
+    for (unsigned int i = 0; i < nb_es; i++) {
+        uint8_t *pmt_es = pmt_get_es(pmt, i);
+        pmtn_init(pmt_es);
+        pmtn_set_pid(pmt_es, i ? es2_pid : es_pid);
+        pmtn_set_streamtype(pmt_es, PMT_STREAMTYPE_VIDEO_MPEG2);
+        pmtn_set_desclength(pmt_es, 0);
+    }
+    psi_set_crc(pmt);
+    uref_block_unmap(uref, 0);
+    return uref;
+}
+
+/** sends an empty packet on the given PID */
+static void es_send(struct upipe *upipe, struct uref_mgr *uref_mgr,
+                    struct ubuf_mgr *ubuf_mgr, uint16_t pid, uint8_t cc)
+{
+    uint8_t *ts;
+    struct uref *uref = ts_alloc(uref_mgr, ubuf_mgr, pid, cc, &ts);
+    uref_block_unmap(uref, 0);
+    upipe_input(upipe, uref, NULL);
+}
+
+int main(int argc, char *argv[])
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
+                                                   0);
+    assert(uref_mgr != NULL);
+    struct ubuf_mgr *ubuf_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH,
+                                                         UBUF_POOL_DEPTH,
+                                                         umem_mgr, 0, 0, -1, 0);
+    assert(ubuf_mgr != NULL);
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *uprobe_stdio = uprobe_stdio_alloc(&uprobe, stdout,
+                                                     UPROBE_LOG_LEVEL);
+    assert(uprobe_stdio != NULL);
+
+    struct uref *uref;
+    uref = uref_block_flow_alloc_def(uref_mgr, "mpegts.");
+    assert(uref != NULL);
+
+    struct upipe *upipe_sink = upipe_void_alloc(&test_mgr,
+                                                uprobe_use(uprobe_stdio));
+    assert(upipe_sink != NULL);
+
+    struct upipe_mgr *upipe_ts_remux_mgr = upipe_ts_remux_mgr_alloc();
+    assert(upipe_ts_remux_mgr != NULL);
+    struct upipe *upipe_ts_remux = upipe_void_alloc(upipe_ts_remux_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe_stdio), UPROBE_LOG_LEVEL,
+                             "ts remux"));
+    assert(upipe_ts_remux != NULL);
+    ubase_assert(upipe_set_flow_def(upipe_ts_remux, uref));
+    ubase_assert(upipe_set_output(upipe_ts_remux, upipe_sink));
+    uref_free(uref);
+
+    ubase_assert(upipe_ts_remux_add_service(upipe_ts_remux, 1));
+    ubase_assert(upipe_ts_remux_set_pid_map(upipe_ts_remux, 0x101, 0x301));
+    ubase_assert(upipe_ts_remux_set_tsid(upipe_ts_remux, 42));
+    unsigned int out_pid;
+    ubase_assert(upipe_ts_remux_get_pid_map(upipe_ts_remux, 0x101,
+                                            &out_pid));
+    assert(out_pid == 0x301);
+
+    /* PAT with two programs */
+    uint8_t *ts;
+    uref = ts_alloc(uref_mgr, ubuf_mgr, 0, 0, &ts);
+    ts_set_unitstart(ts);
+    ts[TS_HEADER_SIZE] = 0;
+    uint8_t *pat = ts + TS_HEADER_SIZE + 1;
+    pat_init(pat);
+    pat_set_length(pat, 2 * PAT_PROGRAM_SIZE);
+    pat_set_tsid(pat, 1);
+    psi_set_version(pat, 0);
+    psi_set_current(pat);
+    psi_set_section(pat, 0);
+    psi_set_lastsection(pat, 0);
+    uint8_t *pat_program = pat_get_program(pat, 0);
+    patn_init(pat_program);
+    patn_set_program(pat_program, 1);
+    patn_set_pid(pat_program, 0x100);
+    pat_program = pat_get_program(pat, 1);
+    patn_init(pat_program);
+    patn_set_program(pat_program, 2);
+    patn_set_pid(pat_program, 0x200);
+    psi_set_crc(pat);
+    uref_block_unmap(uref, 0);
+    upipe_input(upipe_ts_remux, uref, NULL);
+    assert(nb_pat == 1);
+
+    upipe_input(upipe_ts_remux, pmt_alloc(uref_mgr, ubuf_mgr, 1, 0x100, 0,
+                                          0x101, 0, 0), NULL);
+    upipe_input(upipe_ts_remux, pmt_alloc(uref_mgr, ubuf_mgr, 2, 0x200, 0,
+                                          0x201, 0, 0), NULL);
+    assert(nb_pmt == 1);
+    assert(pmt_nb_es == 1);
+
+    last_cc = 0xf;
+    for (int i = 0; i < 4; i++) {
+        /* input continuity counters are discontinuous on purpose */
+        uref = ts_alloc(uref_mgr, ubuf_mgr, 0x101, 3 * i, &ts);
+        uref_block_unmap(uref, 0);
+        upipe_input(upipe_ts_remux, uref, NULL);
+        uref = ts_alloc(uref_mgr, ubuf_mgr, 0x201, i, &ts);
+        uref_block_unmap(uref, 0);
+        upipe_input(upipe_ts_remux, uref, NULL);
+    }
+    assert(nb_es == 4);
+
+    /* duplicate packet */
+    uref = ts_alloc(uref_mgr, ubuf_mgr, 0x101, 9, &ts);
+    uref_block_unmap(uref, 0);
+    last_cc--;
+    upipe_input(upipe_ts_remux, uref, NULL);
+    assert(nb_es == 5);
+
+    /* packets split from a datagram share their buffer */
+    uref = uref_block_alloc(uref_mgr, ubuf_mgr, 3 * TS_SIZE);
+    assert(uref != NULL);
+    int size = -1;
+    ubase_assert(uref_block_write(uref, 0, &size, &ts));
+    assert(size == 3 * TS_SIZE);
+    for (int i = 0; i < 3; i++) {
+        uint8_t *p = ts + i * TS_SIZE;
+        ts_init(p);
+        ts_set_pid(p, 0x101);
+        ts_set_cc(p, 10 + i);
+        ts_set_payload(p);
+        memset(p + TS_HEADER_SIZE, 0xff, TS_SIZE - TS_HEADER_SIZE);
+    }
+    uref_block_unmap(uref, 0);
+    struct uref *datagram = uref_dup(uref);
+    assert(datagram != NULL);
+    for (int i = 0; i < 3; i++) {
+        struct uref *next = i < 2 ? uref_block_split(uref, TS_SIZE) : NULL;
+        assert(i == 2 || next != NULL);
+        upipe_input(upipe_ts_remux, uref, NULL);
+        /* only the header is copied */
+        assert(last_payload == ts + i * TS_SIZE + TS_HEADER_SIZE);
+        uref = next;
+    }
+    assert(nb_es == 8);
+
+    /* the shared buffer is left untouched */
+    for (int i = 0; i < 3; i++) {
+        const uint8_t *p;
+        size = TS_SIZE;
+        ubase_assert(uref_block_read(datagram, i * TS_SIZE, &size, &p));
+        assert(size == TS_SIZE);
+        assert(ts_get_pid(p) == 0x101);
+        assert(ts_get_cc(p) == 10 + i);
+        uref_block_unmap(datagram, i * TS_SIZE);
+    }
+    uref_free(datagram);
+
+    /* two input PIDs can't be mapped to the same output PID */
+    ubase_nassert(upipe_ts_remux_set_pid_map(upipe_ts_remux, 0x201, 0x301));
+
+    /* new PMT version with a second elementary stream and an ECM PID */
+    upipe_input(upipe_ts_remux, pmt_alloc(uref_mgr, ubuf_mgr, 1, 0x100, 1,
+                                          0x101, 0x102, 0x110), NULL);
+    assert(nb_pmt == 2);
+    assert(pmt_nb_es == 2);
+    assert(pmt_ecm_pid == 0x110);
+    es_send(upipe_ts_remux, uref_mgr, ubuf_mgr, 0x102, 0);
+    es_send(upipe_ts_remux, uref_mgr, ubuf_mgr, 0x110, 0);
+    assert(nb_es2 == 1);
+    assert(nb_ecm == 1);
+
+    /* CAT with an EMM PID */
+    uref = ts_alloc(uref_mgr, ubuf_mgr, 1, 0, &ts);
+    ts_set_unitstart(ts);
+    ts[TS_HEADER_SIZE] = 0;
+    uint8_t *cat = ts + TS_HEADER_SIZE + 1;
+    cat_init(cat);
+    cat_set_length(cat, 6);
+    psi_set_version(cat, 0);
+    psi_set_current(cat);
+    ca_init(cat_get_descl(cat), 0x120);
+    psi_set_crc(cat);
+    uref_block_unmap(uref, 0);
+    upipe_input(upipe_ts_remux, uref, NULL);
+    assert(nb_cat == 1);
+    es_send(upipe_ts_remux, uref_mgr, ubuf_mgr, 0x120, 0);
+    assert(nb_emm == 1);
+
+    /* the PIDs removed from the next PMT version are no longer forwarded */
+    upipe_input(upipe_ts_remux, pmt_alloc(uref_mgr, ubuf_mgr, 1, 0x100, 2,
+                                          0x101, 0, 0), NULL);
+    assert(nb_pmt == 3);
+    assert(pmt_nb_es == 1);
+    assert(pmt_ecm_pid == 0);
+    es_send(upipe_ts_remux, uref_mgr, ubuf_mgr, 0x102, 1);
+    es_send(upipe_ts_remux, uref_mgr, ubuf_mgr, 0x110, 1);
+    es_send(upipe_ts_remux, uref_mgr, ubuf_mgr, 0x120, 1);
+    es_send(upipe_ts_remux, uref_mgr, ubuf_mgr, 0x101, 13);
+    assert(nb_es2 == 1);
+    assert(nb_ecm == 1);
+    assert(nb_emm == 2);
+    assert(nb_es == 9);
+
+    upipe_release(upipe_ts_remux);
+    upipe_mgr_release(upipe_ts_remux_mgr); // nop
+
+    test_free(upipe_sink);
+
+    uref_mgr_release(uref_mgr);
+    ubuf_mgr_release(ubuf_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(uprobe_stdio);
+    uprobe_clean(&uprobe);
+
+    return 0;
+}
@@ -0,0 +1,301 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short benchmark for udp fan-out
+ * This program measures the CPU cost of sending every packet of a stream to
+ * several destinations on the loopback interface, either with one udp sink
+ * per destination behind a dup pipe, or with a single udp multi sink. The
+ * cost is expressed per input packet and per datagram sent.
+ *
+ * Usage: upipe_udp_multi_sink_bench [-n <packets>] [<destinations>...]
+ * Without destinations, fan-outs of 1, 10 and 100 are measured.
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/uref.h>
+#include <upipe/uref_std.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/upipe.h>
+#include <upipe-modules/upipe_dup.h>
+#include <upipe-modules/upipe_udp_sink.h>
+#include <upipe-modules/upipe_udp_multi_sink.h>
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <assert.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define UPROBE_LOG_LEVEL UPROBE_LOG_WARNING
+#define UDICT_POOL_DEPTH 10
+#define UREF_POOL_DEPTH 10
+#define UBUF_POOL_DEPTH 10
+/** size of the packets (7 TS packets) */
+#define PACKET_SIZE 1316
+/** default number of packets */
+#define DEFAULT_PACKETS 20000
+/** maximum number of destinations */
+#define MAX_DESTS 1000
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        case UPROBE_FATAL:
+        case UPROBE_ERROR:
+            assert(0);
+            break;
+        default:
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @This returns the CPU time consumed by the process.
+ *
+ * @return CPU time in nanoseconds
+ */
+static uint64_t cpu_time(void)
+{
+    struct timespec ts;
+    int err = clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    assert(err == 0);
+    return (uint64_t)ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+/** @This opens a receiving socket on the loopback interface. Datagrams are
+ * never read, and are dropped by the kernel when the buffer is full.
+ *
+ * @param port_p filled in with the bound port
+ * @return file descriptor
+ */
+static int open_receiver(uint16_t *port_p)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    assert(fd != -1);
+    struct sockaddr_in sin;
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int err = bind(fd, (struct sockaddr *)&sin, sizeof(sin));
+    assert(err == 0);
+    socklen_t len = sizeof(sin);
+    err = getsockname(fd, (struct sockaddr *)&sin, &len);
+    assert(err == 0);
+    *port_p = ntohs(sin.sin_port);
+    return fd;
+}
+
+/** @This sends packets to a pipe and prints the cost.
+ *
+ * @param upipe pipe to feed
+ * @param name name of the configuration
+ * @param nb_dests number of destinations
+ * @param uref_mgr uref manager
+ * @param ubuf_mgr block ubuf manager
+ * @param packets number of packets to send
+ */
+static void bench(struct upipe *upipe, const char *name,
+                  unsigned int nb_dests, struct uref_mgr *uref_mgr,
+                  struct ubuf_mgr *ubuf_mgr, unsigned int packets)
+{
+    uint64_t begin = cpu_time();
+    for (unsigned int i = 0; i < packets; i++) {
+        struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr,
+                                             PACKET_SIZE);
+        assert(uref != NULL);
+        uint8_t *w;
+        int w_size = -1;
+        ubase_assert(uref_block_write(uref, 0, &w_size, &w));
+        memset(w, i, w_size);
+        ubase_assert(uref_block_unmap(uref, 0));
+        upipe_input(upipe, uref, NULL);
+    }
+    uint64_t elapsed = cpu_time() - begin;
+
+    printf("%-10s %4u dests %8u packets %8.3f s CPU %10.2f us/packet "
+           "%8.3f us/datagram\n", name, nb_dests, packets,
+           (double)elapsed / 1000000000., elapsed / 1000. / packets,
+           elapsed / 1000. / packets / nb_dests);
+}
+
+/** @This measures both configurations for a number of destinations.
+ *
+ * @param nb_dests number of destinations
+ * @param uprobe probe hierarchy
+ * @param uref_mgr uref manager
+ * @param ubuf_mgr block ubuf manager
+ * @param packets number of packets to send
+ */
+static void bench_fanout(unsigned int nb_dests, struct uprobe *uprobe,
+                         struct uref_mgr *uref_mgr,
+                         struct ubuf_mgr *ubuf_mgr, unsigned int packets)
+{
+    int fds[nb_dests];
+    uint16_t ports[nb_dests];
+    struct upipe *outputs[nb_dests];
+    struct upipe *sinks[nb_dests];
+    char uri[64];
+    for (unsigned int i = 0; i < nb_dests; i++)
+        fds[i] = open_receiver(&ports[i]);
+
+    struct uref *flow_def = uref_block_flow_alloc_def(uref_mgr, "mpegts.");
+    assert(flow_def != NULL);
+
+    /* one udp sink per destination */
+    struct upipe_mgr *upipe_dup_mgr = upipe_dup_mgr_alloc();
+    assert(upipe_dup_mgr != NULL);
+    struct upipe *dup = upipe_void_alloc(upipe_dup_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe), UPROBE_LOG_LEVEL, "dup"));
+    assert(dup != NULL);
+    ubase_assert(upipe_set_flow_def(dup, flow_def));
+    struct upipe_mgr *upipe_udpsink_mgr = upipe_udpsink_mgr_alloc();
+    assert(upipe_udpsink_mgr != NULL);
+    for (unsigned int i = 0; i < nb_dests; i++) {
+        outputs[i] = upipe_void_alloc_sub(dup,
+                uprobe_pfx_alloc(uprobe_use(uprobe), UPROBE_LOG_LEVEL,
+                                 "dup output"));
+        assert(outputs[i] != NULL);
+        sinks[i] = upipe_void_alloc_output(outputs[i], upipe_udpsink_mgr,
+                uprobe_pfx_alloc(uprobe_use(uprobe), UPROBE_LOG_LEVEL,
+                                 "udp sink"));
+        assert(sinks[i] != NULL);
+        snprintf(uri, sizeof(uri), "127.0.0.1:%u", ports[i]);
+        ubase_assert(upipe_set_uri(sinks[i], uri));
+    }
+    bench(dup, "udp sink", nb_dests, uref_mgr, ubuf_mgr, packets);
+    upipe_release(dup);
+    for (unsigned int i = 0; i < nb_dests; i++) {
+        upipe_release(outputs[i]);
+        upipe_release(sinks[i]);
+    }
+    upipe_mgr_release(upipe_dup_mgr);
+    upipe_mgr_release(upipe_udpsink_mgr);
+
+    /* single udp multi sink */
+    struct upipe_mgr *upipe_udpmsink_mgr = upipe_udpmsink_mgr_alloc();
+    assert(upipe_udpmsink_mgr != NULL);
+    struct upipe *udpmsink = upipe_void_alloc(upipe_udpmsink_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe), UPROBE_LOG_LEVEL,
+                             "udp multi sink"));
+    assert(udpmsink != NULL);
+    ubase_assert(upipe_set_flow_def(udpmsink, flow_def));
+    for (unsigned int i = 0; i < nb_dests; i++) {
+        snprintf(uri, sizeof(uri), "127.0.0.1:%u", ports[i]);
+        ubase_assert(upipe_udpmsink_add_dest(udpmsink, uri));
+    }
+    bench(udpmsink, "multi sink", nb_dests, uref_mgr, ubuf_mgr, packets);
+    upipe_release(udpmsink);
+    upipe_mgr_release(upipe_udpmsink_mgr);
+
+    uref_free(flow_def);
+    for (unsigned int i = 0; i < nb_dests; i++)
+        close(fds[i]);
+}
+
+/** @This prints the usage and exits.
+ *
+ * @param argv0 name of the program
+ */
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "Usage: %s [-n <packets>] [<destinations>...]\n", argv0);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int packets = DEFAULT_PACKETS;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+            case 'n':
+                packets = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    /* structures managers */
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
+                                                   0);
+    assert(uref_mgr != NULL);
+    struct ubuf_mgr *ubuf_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH,
+                                                         UBUF_POOL_DEPTH,
+                                                         umem_mgr, 0, 0, -1, 0);
+    assert(ubuf_mgr != NULL);
+
+    /* probes */
+    struct uprobe uprobe_s;
+    uprobe_init(&uprobe_s, catch, NULL);
+    struct uprobe *uprobe = uprobe_stdio_alloc(&uprobe_s, stderr,
+                                               UPROBE_LOG_LEVEL);
+    assert(uprobe != NULL);
+
+    if (optind < argc) {
+        for (int i = optind; i < argc; i++) {
+            unsigned int nb_dests = strtoul(argv[i], NULL, 10);
+            if (!nb_dests || nb_dests > MAX_DESTS)
+                usage(argv[0]);
+            bench_fanout(nb_dests, uprobe, uref_mgr, ubuf_mgr, packets);
+        }
+    } else {
+        static const unsigned int fanouts[] = { 1, 10, 100 };
+        for (int i = 0; i < UBASE_ARRAY_SIZE(fanouts); i++)
+            bench_fanout(fanouts[i], uprobe, uref_mgr, ubuf_mgr, packets);
+    }
+
+    uprobe_release(uprobe);
+    uprobe_clean(&uprobe_s);
+    ubuf_mgr_release(ubuf_mgr);
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    return 0;
+}
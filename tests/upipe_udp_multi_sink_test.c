@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for udp multi sink pipes
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/uref.h>
+#include <upipe/uref_std.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/upipe.h>
+#include <upipe-modules/upipe_udp_multi_sink.h>
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define UDICT_POOL_DEPTH 0
+#define UREF_POOL_DEPTH 0
+#define UBUF_POOL_DEPTH 0
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+#define NB_DESTS 3
+#define NB_PACKETS 10
+#define BUF_SIZE 256
+#define FORMAT "This is packet number %d"
+
+static struct uref_mgr *uref_mgr;
+static struct ubuf_mgr *ubuf_mgr;
+static int counter = 0;
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @This opens a receiving socket on the loopback interface.
+ *
+ * @param port_p filled in with the bound port
+ * @return file descriptor
+ */
+static int open_receiver(uint16_t *port_p)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    assert(fd != -1);
+    struct sockaddr_in sin;
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(bind(fd, (struct sockaddr *)&sin, sizeof(sin)) == 0);
+    socklen_t len = sizeof(sin);
+    assert(getsockname(fd, (struct sockaddr *)&sin, &len) == 0);
+    *port_p = ntohs(sin.sin_port);
+
+    int one = 1;
+    assert(setsockopt(fd, IPPROTO_IP, IP_RECVTTL, &one, sizeof(one)) == 0);
+    assert(setsockopt(fd, IPPROTO_IP, IP_RECVTOS, &one, sizeof(one)) == 0);
+    return fd;
+}
+
+/** @This sends packets to the sink. */
+static void send_packets(struct upipe *upipe)
+{
+    for (int i = 0; i < NB_PACKETS; i++) {
+        struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr, BUF_SIZE);
+        assert(uref != NULL);
+        uint8_t *buf;
+        int size = -1;
+        ubase_assert(uref_block_write(uref, 0, &size, &buf));
+        assert(size == BUF_SIZE);
+        memset(buf, 0, size);
+        snprintf((char *)buf, BUF_SIZE, FORMAT, counter + i);
+        uref_block_unmap(uref, 0);
+        upipe_input(upipe, uref, NULL);
+    }
+}
+
+/** @This checks the packets received by a socket.
+ *
+ * @param fd receiving socket
+ * @param nb expected number of packets
+ * @param ttl expected time-to-live, or 0 for any
+ * @param tos expected type of service
+ */
+static void check_packets(int fd, int nb, int ttl, int tos)
+{
+    for (int i = 0; i < nb; i++) {
+        char buf[BUF_SIZE + 1], str[BUF_SIZE];
+        char control[2 * CMSG_SPACE(sizeof(int))];
+        struct iovec iovec = { .iov_base = buf, .iov_len = sizeof(buf) };
+        struct msghdr msghdr = {
+            .msg_iov = &iovec,
+            .msg_iovlen = 1,
+            .msg_control = control,
+            .msg_controllen = sizeof(control),
+        };
+        assert(recvmsg(fd, &msghdr, MSG_DONTWAIT) == BUF_SIZE);
+        snprintf(str, sizeof(str), FORMAT, counter + i);
+        assert(!strcmp(str, buf));
+
+        bool got_ttl = false, got_tos = false;
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msghdr); cmsg != NULL;
+             cmsg = CMSG_NXTHDR(&msghdr, cmsg)) {
+            if (cmsg->cmsg_level != IPPROTO_IP)
+                continue;
+            if (cmsg->cmsg_type == IP_TTL) {
+                int value;
+                memcpy(&value, CMSG_DATA(cmsg), sizeof(value));
+                assert(!ttl || value == ttl);
+                got_ttl = true;
+            } else if (cmsg->cmsg_type == IP_TOS) {
+                assert(*(uint8_t *)CMSG_DATA(cmsg) == tos);
+                got_tos = true;
+            }
+        }
+        assert(got_ttl && got_tos);
+    }
+    char buf[BUF_SIZE];
+    assert(recv(fd, buf, sizeof(buf), MSG_DONTWAIT) == -1);
+}
+
+/** @This counts the destinations of the sink.
+ *
+ * @param upipe description structure of the pipe
+ * @return number of destinations
+ */
+static int count_dests(struct upipe *upipe)
+{
+    const char *uri = NULL;
+    int nb = 0;
+    while (ubase_check(upipe_udpmsink_iterate_dest(upipe, &uri)) &&
+           uri != NULL)
+        nb++;
+    return nb;
+}
+
+int main(int argc, char *argv[])
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr, 0);
+    assert(uref_mgr != NULL);
+    ubuf_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH, UBUF_POOL_DEPTH,
+                                        umem_mgr, 0, 0, -1, 0);
+    assert(ubuf_mgr != NULL);
+
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *logger = uprobe_stdio_alloc(&uprobe, stdout,
+                                               UPROBE_LOG_LEVEL);
+    assert(logger != NULL);
+
+    struct upipe_mgr *upipe_udpmsink_mgr = upipe_udpmsink_mgr_alloc();
+    assert(upipe_udpmsink_mgr != NULL);
+    struct upipe *udpmsink = upipe_void_alloc(upipe_udpmsink_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                             "udp multi sink"));
+    assert(udpmsink != NULL);
+    struct uref *flow_def = uref_block_flow_alloc_def(uref_mgr, "mpegts.");
+    assert(flow_def != NULL);
+    ubase_assert(upipe_set_flow_def(udpmsink, flow_def));
+    uref_free(flow_def);
+
+    /* no destination */
+    int fd;
+    ubase_assert(upipe_udpmsink_get_fd(udpmsink, &fd));
+    assert(fd == -1);
+    send_packets(udpmsink);
+    counter += NB_PACKETS;
+
+    int fds[NB_DESTS];
+    uint16_t ports[NB_DESTS];
+    char uri[64];
+    for (int i = 0; i < NB_DESTS; i++)
+        fds[i] = open_receiver(&ports[i]);
+    snprintf(uri, sizeof(uri), "127.0.0.1:%u/ttl=5", ports[0]);
+    ubase_assert(upipe_udpmsink_add_dest(udpmsink, uri));
+    snprintf(uri, sizeof(uri), "127.0.0.1:%u/ttl=7/dscp=8", ports[1]);
+    ubase_assert(upipe_udpmsink_add_dest(udpmsink, uri));
+    snprintf(uri, sizeof(uri), "127.0.0.1:%u", ports[2]);
+    ubase_assert(upipe_udpmsink_add_dest(udpmsink, uri));
+    assert(count_dests(udpmsink) == NB_DESTS);
+    ubase_assert(upipe_udpmsink_get_fd(udpmsink, &fd));
+    assert(fd != -1);
+
+    /* invalid or incompatible destinations */
+    ubase_nassert(upipe_udpmsink_add_dest(udpmsink, "@127.0.0.1:1234"));
+    ubase_nassert(upipe_udpmsink_add_dest(udpmsink, "[::1]:1234"));
+    assert(count_dests(udpmsink) == NB_DESTS);
+
+    send_packets(udpmsink);
+    check_packets(fds[0], NB_PACKETS, 5, 0);
+    check_packets(fds[1], NB_PACKETS, 7, 0x20);
+    check_packets(fds[2], NB_PACKETS, 0, 0);
+    counter += NB_PACKETS;
+
+    /* remove a destination, and update another one */
+    snprintf(uri, sizeof(uri), "127.0.0.1:%u", ports[1]);
+    ubase_assert(upipe_udpmsink_del_dest(udpmsink, uri));
+    ubase_nassert(upipe_udpmsink_del_dest(udpmsink, uri));
+    snprintf(uri, sizeof(uri), "127.0.0.1:%u/ttl=9", ports[0]);
+    ubase_assert(upipe_udpmsink_add_dest(udpmsink, uri));
+    assert(count_dests(udpmsink) == NB_DESTS - 1);
+
+    send_packets(udpmsink);
+    check_packets(fds[0], NB_PACKETS, 9, 0);
+    check_packets(fds[1], 0, 0, 0);
+    check_packets(fds[2], NB_PACKETS, 0, 0);
+    counter += NB_PACKETS;
+
+    upipe_release(udpmsink);
+    for (int i = 0; i < NB_DESTS; i++)
+        close(fds[i]);
+
+    ubuf_mgr_release(ubuf_mgr);
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(logger);
+    uprobe_clean(&uprobe);
+    return 0;
+}
@@ -51,6 +51,7 @@
 #include <upipe/uref_block.h>
 #include <upipe/uref_flow.h>
 #include <upipe/uref_block_flow.h>
+#include <upipe/uref_clock.h>
 #include <upipe/uref_std.h>
 #include <upipe/upump.h>
 #include <upump-ev/upump_ev.h>
@@ -80,6 +81,9 @@
 #define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
 #define BUF_SIZE 256
 #define FORMAT "This is packet number %d"
+#define TXTIME_PACKETS 50
+#define TXTIME_INTERVAL (UCLOCK_FREQ / 1000)
+#define TXTIME_HORIZON (UCLOCK_FREQ / 100)
 
 /* FIXME: uncomment or remove */
 /*static void usage(const char *argv0) {
@@ -101,7 +105,11 @@ struct upump *write_pump;
 struct addrinfo hints, *servinfo, *p;
 struct upipe *upipe_udpsrc;
 struct upipe *upipe_udpsink;
+struct upipe *upipe_udpsink_txtime;
+struct uclock *uclock;
 static int counter = 0;
+static uint64_t txtime_first = UINT64_MAX, txtime_last = 0, txtime_prev = 0;
+static uint64_t txtime_max_interval = 0;
 
 /** definition of our uprobe */
 static int catch(struct uprobe *uprobe, struct upipe *upipe,
@@ -160,9 +168,22 @@ static void test_input(struct upipe *upipe, struct uref *uref,
         udpsrc_test->counter++;
         uref_block_peek_unmap(uref, 0, buf, rbuf);
     }
+    if (udpsrc_test->counter > 210) {
+        /* paced packets: record arrival dates */
+        uint64_t systime;
+        ubase_assert(uref_clock_get_cr_sys(uref, &systime));
+        if (txtime_first == UINT64_MAX)
+            txtime_first = systime;
+        else if (systime - txtime_prev > txtime_max_interval)
+            txtime_max_interval = systime - txtime_prev;
+        txtime_prev = txtime_last = systime;
+    }
     if (udpsrc_test->counter == 110 || udpsrc_test->counter == 210) {
         upipe_set_uri(upipe_udpsrc, NULL);
     }
+    if (udpsrc_test->counter == 210 + TXTIME_PACKETS)
+        /* the sink is kept open to wait for zero-copy completions */
+        upipe_set_uri(upipe_udpsrc, NULL);
 
     uref_free(uref);
 }
@@ -249,6 +270,29 @@ static void genpackets2(struct upump *upump)
     }
 }
 
+/* packet generator for kernel pacing */
+static void genpackets3(struct upump *upump)
+{
+    struct uref *uref;
+    uint8_t *buf;
+    int i, size = -1;
+    uint64_t now = uclock_now(uclock);
+
+    upump_stop(write_pump);
+    for (i = 0; i < TXTIME_PACKETS; i++) {
+        uref = uref_block_alloc(uref_mgr, ubuf_mgr, BUF_SIZE);
+        uref_block_write(uref, 0, &size, &buf);
+        assert(size == BUF_SIZE);
+        memset(buf, 0, size);
+        snprintf((char *)buf, BUF_SIZE, FORMAT, counter);
+        uref_block_unmap(uref, 0);
+        uref_clock_set_cr_sys(uref, now + 2 * TXTIME_HORIZON +
+                                    i * TXTIME_INTERVAL);
+        counter++;
+        upipe_input(upipe_udpsink_txtime, uref, NULL);
+    }
+}
+
 int main(int argc, char *argv[])
 {
     char udp_uri[512], port_str[8];
@@ -269,7 +313,7 @@ int main(int argc, char *argv[])
     struct upump_mgr *upump_mgr = upump_ev_mgr_alloc_default(UPUMP_POOL,
             UPUMP_BLOCKER_POOL);
     assert(upump_mgr != NULL);
-    struct uclock *uclock = uclock_std_alloc(0);
+    uclock = uclock_std_alloc(0);
     assert(uclock != NULL);
     struct uprobe uprobe;
     uprobe_init(&uprobe, catch, NULL);
@@ -372,10 +416,73 @@ int main(int argc, char *argv[])
     /* fire again */
     upump_mgr_run(upump_mgr, NULL);
 
-    /* release */
     upump_free(write_pump);
+
+    /* now test kernel pacing */
+    upipe_udpsink_txtime = upipe_void_alloc(upipe_udpsink_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                             "udp sink txtime"));
+    assert(upipe_udpsink_txtime != NULL);
+    flow_def = uref_block_flow_alloc_def(uref_mgr, "bar");
+    ubase_assert(upipe_set_flow_def(upipe_udpsink_txtime, flow_def));
+    uref_free(flow_def);
+    ubase_assert(upipe_attach_uclock(upipe_udpsink_txtime));
+
+    for (i=0; i < 10; i++) {
+        port = ((rand() % 40000) + 1024);
+        snprintf(udp_uri, sizeof(udp_uri), "@127.0.0.1:%d", port);
+        printf("Trying uri: %s ...\n", udp_uri);
+        if (( ret = ubase_check(upipe_set_uri(upipe_udpsrc, udp_uri)) )) {
+            break;
+        }
+    }
+    assert(ret);
+    ubase_assert(upipe_set_uri(upipe_udpsink_txtime, udp_uri+1));
+
+    if (ubase_check(upipe_udpsink_set_txtime(upipe_udpsink_txtime,
+                                             TXTIME_HORIZON))) {
+        uint64_t horizon;
+        ubase_assert(upipe_udpsink_get_txtime(upipe_udpsink_txtime,
+                                              &horizon));
+        assert(horizon == TXTIME_HORIZON);
+        /* zero-copy is optional as it depends on the kernel */
+        bool zerocopy =
+            ubase_check(upipe_udpsink_set_zerocopy(upipe_udpsink_txtime,
+                                                   true));
+
+        write_pump = upump_alloc_idler(upump_mgr, genpackets3, NULL, NULL);
+        assert(write_pump);
+        upump_start(write_pump);
+
+        upump_mgr_run(upump_mgr, NULL);
+        upump_free(write_pump);
+
+        assert(udpsrc_test_from_upipe(udpsrc_test)->counter ==
+               210 + TXTIME_PACKETS);
+        printf("paced %d packets over %"PRIu64" us, max interval %"PRIu64
+               " us\n", TXTIME_PACKETS,
+               (txtime_last - txtime_first) / (UCLOCK_FREQ / 1000000),
+               txtime_max_interval / (UCLOCK_FREQ / 1000000));
+        /* without a pacing qdisc, packets leave once per horizon */
+        assert(txtime_last - txtime_first + TXTIME_HORIZON >=
+               (TXTIME_PACKETS - 1) * TXTIME_INTERVAL);
+
+        /* the event loop only ends once every buffer was released */
+        uint64_t sent, completed;
+        ubase_assert(upipe_udpsink_get_zerocopy_stats(upipe_udpsink_txtime,
+                                                      &sent, &completed));
+        printf("zero-copy: %"PRIu64" sent, %"PRIu64" completed\n",
+               sent, completed);
+        if (zerocopy)
+            assert(sent > 0);
+        assert(completed == sent);
+    } else
+        printf("SO_TXTIME is not supported, skipping\n");
+
+    /* release */
     upipe_release(upipe_udpsrc);
     upipe_release(upipe_udpsink);
+    upipe_release(upipe_udpsink_txtime);
     test_free(udpsrc_test);
     upipe_mgr_release(upipe_udpsrc_mgr); /* nop */
     upump_mgr_release(upump_mgr);
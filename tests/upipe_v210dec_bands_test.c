@@ -0,0 +1,308 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for v210 decoder run in bands on several threads
+ */
+
+#undef NDEBUG
+
+#include <upipe/ubuf_pic_mem.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ujob.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/upipe.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_ubuf_mem.h>
+#include <upipe/uprobe_ujob_mgr.h>
+#include <upipe/uref.h>
+#include <upipe/uref_pic.h>
+#include <upipe/uref_pic_flow.h>
+#include <upipe/uref_std.h>
+#include <upipe-pthread/ujob_mgr_pthread.h>
+#include <upipe-v210/upipe_v210dec.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define UDICT_POOL_DEPTH    0
+#define UREF_POOL_DEPTH     0
+#define UBUF_POOL_DEPTH     0
+#define UPROBE_LOG_LEVEL UPROBE_LOG_VERBOSE
+#define NB_THREADS 4
+
+/* no padding between lines, so that overstores hit the next line */
+#define UBUF_ALIGN 16
+#define TEST_WIDTH 1920
+#define TEST_HEIGHT 1080
+
+static const char *v210_chroma = "u10y10v10y10u10y10v10y10u10y10v10y10";
+
+/** last picture output by the decoder */
+static struct uref *output = NULL;
+
+/* fill picture with pseudo-random samples */
+static void fill_in(struct uref *uref)
+{
+    size_t stride;
+    uint8_t *buffer;
+    unsigned int seed = 42;
+    ubase_assert(uref_pic_plane_write(uref, v210_chroma, 0, 0, -1, -1,
+                                      &buffer));
+    ubase_assert(uref_pic_plane_size(uref, v210_chroma, &stride,
+                                     NULL, NULL, NULL));
+    for (int y = 0; y < TEST_HEIGHT; y++) {
+        uint8_t *dst = buffer + y * stride;
+        for (int x = 0; x < TEST_WIDTH / 6 * 4; x++) {
+            uint32_t val = 0;
+            for (int i = 0; i < 3; i++) {
+                seed = seed * 1103515245 + 12345;
+                val |= (4 + (seed >> 16) % 1016) << (10 * i);
+            }
+            dst[0] = val;
+            dst[1] = val >> 8;
+            dst[2] = val >> 16;
+            dst[3] = val >> 24;
+            dst += 4;
+        }
+    }
+    uref_pic_plane_unmap(uref, v210_chroma, 0, 0, -1, -1);
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe);
+    upipe_init(upipe, mgr, uprobe);
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_throw_dead(upipe);
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    assert(output == NULL);
+    output = uref;
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+            return UBASE_ERR_NONE;
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .signature = 0,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+        case UPROBE_NEED_UJOB_MGR:
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** decodes the picture and returns the output */
+static struct uref *decode(struct uprobe *uprobe, struct uref *in_flow_def,
+                           struct uref *out_flow_def, struct uref *pic)
+{
+    struct upipe_mgr *upipe_v210dec_mgr = upipe_v210dec_mgr_alloc();
+    assert(upipe_v210dec_mgr);
+    struct upipe *v210dec = upipe_flow_alloc(upipe_v210dec_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe), UPROBE_LOG_LEVEL, "v210dec"),
+            out_flow_def);
+    assert(v210dec);
+    upipe_mgr_release(upipe_v210dec_mgr);
+
+    struct upipe *test = upipe_void_alloc(&test_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe), UPROBE_LOG_LEVEL, "test"));
+    assert(test);
+    ubase_assert(upipe_set_output(v210dec, test));
+    ubase_assert(upipe_set_flow_def(v210dec, in_flow_def));
+
+    upipe_input(v210dec, uref_dup(pic), NULL);
+    upipe_release(v210dec);
+    test_free(test);
+
+    struct uref *uref = output;
+    assert(uref != NULL);
+    output = NULL;
+    return uref;
+}
+
+/** checks that two outputs are identical */
+static void compare(struct uref *uref1, struct uref *uref2)
+{
+    const char *chroma;
+    uref_pic_foreach_plane(uref1, chroma) {
+        const uint8_t *buffer1, *buffer2;
+        size_t stride1, stride2;
+        uint8_t hsub, vsub, macropixel_size;
+        ubase_assert(uref_pic_plane_read(uref1, chroma, 0, 0, -1, -1,
+                                         &buffer1));
+        ubase_assert(uref_pic_plane_read(uref2, chroma, 0, 0, -1, -1,
+                                         &buffer2));
+        ubase_assert(uref_pic_plane_size(uref1, chroma, &stride1,
+                                         &hsub, &vsub, &macropixel_size));
+        ubase_assert(uref_pic_plane_size(uref2, chroma, &stride2,
+                                         NULL, NULL, NULL));
+        size_t size = TEST_WIDTH / hsub * macropixel_size;
+        for (int y = 0; y < TEST_HEIGHT / vsub; y++)
+            assert(!memcmp(buffer1 + y * stride1, buffer2 + y * stride2,
+                           size));
+        uref_pic_plane_unmap(uref1, chroma, 0, 0, -1, -1);
+        uref_pic_plane_unmap(uref2, chroma, 0, 0, -1, -1);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+            umem_mgr, -1, -1);
+    assert(udict_mgr);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH,
+            udict_mgr, 0);
+    assert(uref_mgr);
+    struct ubuf_mgr *pic_mgr = ubuf_pic_mem_mgr_alloc(UBUF_POOL_DEPTH,
+            UBUF_POOL_DEPTH, umem_mgr, 1, 0, 0, 0, 0, UBUF_ALIGN, 0);
+    assert(pic_mgr);
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(pic_mgr, v210_chroma, 1, 1, 16));
+
+    struct uref *pic = uref_pic_alloc(uref_mgr, pic_mgr,
+                                      TEST_WIDTH, TEST_HEIGHT);
+    assert(pic);
+    fill_in(pic);
+
+    struct uref *in_flow_def = uref_pic_flow_alloc_def(uref_mgr, 6);
+    assert(in_flow_def);
+    ubase_assert(uref_pic_flow_add_plane(in_flow_def, 1, 1, 16, v210_chroma));
+    ubase_assert(uref_pic_flow_set_hsize(in_flow_def, TEST_WIDTH));
+    ubase_assert(uref_pic_flow_set_vsize(in_flow_def, TEST_HEIGHT));
+    ubase_assert(uref_pic_flow_set_align(in_flow_def, UBUF_ALIGN));
+
+    struct uref *out_flow_8 = uref_pic_flow_alloc_def(uref_mgr, 1);
+    assert(out_flow_8);
+    ubase_assert(uref_pic_flow_add_plane(out_flow_8, 1, 1, 1, "y8"));
+    ubase_assert(uref_pic_flow_add_plane(out_flow_8, 2, 1, 1, "u8"));
+    ubase_assert(uref_pic_flow_add_plane(out_flow_8, 2, 1, 1, "v8"));
+    ubase_assert(uref_pic_flow_set_hsize(out_flow_8, TEST_WIDTH));
+    ubase_assert(uref_pic_flow_set_vsize(out_flow_8, TEST_HEIGHT));
+    ubase_assert(uref_pic_flow_set_align(out_flow_8, UBUF_ALIGN));
+
+    struct uref *out_flow_10 = uref_pic_flow_alloc_def(uref_mgr, 1);
+    assert(out_flow_10);
+    ubase_assert(uref_pic_flow_add_plane(out_flow_10, 1, 1, 2, "y10l"));
+    ubase_assert(uref_pic_flow_add_plane(out_flow_10, 2, 1, 2, "u10l"));
+    ubase_assert(uref_pic_flow_add_plane(out_flow_10, 2, 1, 2, "v10l"));
+    ubase_assert(uref_pic_flow_set_hsize(out_flow_10, TEST_WIDTH));
+    ubase_assert(uref_pic_flow_set_vsize(out_flow_10, TEST_HEIGHT));
+    ubase_assert(uref_pic_flow_set_align(out_flow_10, UBUF_ALIGN));
+
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *logger = uprobe_stdio_alloc(&uprobe, stdout,
+                                               UPROBE_LOG_LEVEL);
+    assert(logger);
+    logger = uprobe_ubuf_mem_alloc(logger, umem_mgr, UBUF_POOL_DEPTH,
+                                   UBUF_POOL_DEPTH);
+    assert(logger);
+
+    struct ujob_mgr *ujob_mgr = ujob_mgr_pthread_alloc(NB_THREADS);
+    assert(ujob_mgr);
+    struct uprobe *logger_bands = uprobe_ujob_mgr_alloc(uprobe_use(logger),
+                                                        ujob_mgr);
+    assert(logger_bands);
+    ujob_mgr_release(ujob_mgr);
+
+    /* the bands must produce the same pixels as a single thread */
+    struct uref *out_flows[] = { out_flow_8, out_flow_10 };
+    for (int i = 0; i < 2; i++) {
+        struct uref *sequential = decode(logger, in_flow_def,
+                                         out_flows[i], pic);
+        struct uref *parallel = decode(logger_bands, in_flow_def,
+                                       out_flows[i], pic);
+        compare(sequential, parallel);
+        uref_free(sequential);
+        uref_free(parallel);
+    }
+
+    uref_free(pic);
+    uref_free(in_flow_def);
+    uref_free(out_flow_8);
+    uref_free(out_flow_10);
+
+    ubuf_mgr_release(pic_mgr);
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(logger_bands);
+    uprobe_release(logger);
+    uprobe_clean(&uprobe);
+    return 0;
+}
@@ -0,0 +1,275 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short benchmark for the video detect pipe
+ * This program measures the CPU cost of the analysis of one video channel,
+ * for SD and HD pictures. The cost is expressed per picture and as the
+ * share of a core needed by a 25 fps channel.
+ *
+ * Usage: upipe_video_detect_bench [-n <pictures>] [-s <step>]
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uclock.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_pic_mem.h>
+#include <upipe/uref.h>
+#include <upipe/uref_pic.h>
+#include <upipe/uref_pic_flow.h>
+#include <upipe/uref_std.h>
+#include <upipe/upipe.h>
+#include <upipe-filters/upipe_video_detect.h>
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <time.h>
+#include <assert.h>
+
+#define UPROBE_LOG_LEVEL UPROBE_LOG_WARNING
+#define UDICT_POOL_DEPTH 10
+#define UREF_POOL_DEPTH 10
+#define UBUF_POOL_DEPTH 10
+/** default number of pictures */
+#define DEFAULT_PICTURES 1000
+/** number of distinct pictures sent in turn */
+#define NB_PICS 8
+/** frame rate of the channel */
+#define FPS 25
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        case UPROBE_FATAL:
+        case UPROBE_ERROR:
+            assert(0);
+            break;
+        default:
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    uref_free(uref);
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+        case UPIPE_REGISTER_REQUEST:
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** @This returns the CPU time consumed by the process.
+ *
+ * @return CPU time in nanoseconds
+ */
+static uint64_t cpu_time(void)
+{
+    struct timespec ts;
+    int err = clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    assert(err == 0);
+    return (uint64_t)ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+/** @This sends pictures to a video detect pipe and prints the cost.
+ *
+ * @param uprobe probe hierarchy
+ * @param uref_mgr uref manager
+ * @param ubuf_mgr picture ubuf manager
+ * @param hsize width of the pictures
+ * @param vsize height of the pictures
+ * @param step vertical subsampling step
+ * @param pictures number of pictures to send
+ */
+static void bench(struct uprobe *uprobe, struct uref_mgr *uref_mgr,
+                  struct ubuf_mgr *ubuf_mgr, size_t hsize, size_t vsize,
+                  unsigned int step, unsigned int pictures)
+{
+    /* the pictures are prepared beforehand, so that only the analysis is
+     * measured */
+    struct uref *pics[NB_PICS];
+    for (int i = 0; i < NB_PICS; i++) {
+        pics[i] = uref_pic_alloc(uref_mgr, ubuf_mgr, hsize, vsize);
+        assert(pics[i] != NULL);
+        uint8_t *buffer;
+        size_t stride;
+        ubase_assert(uref_pic_plane_write(pics[i], "y8", 0, 0, -1, -1,
+                                          &buffer));
+        ubase_assert(uref_pic_plane_size(pics[i], "y8", &stride,
+                                         NULL, NULL, NULL));
+        for (size_t y = 0; y < vsize; y++)
+            for (size_t x = 0; x < hsize; x++)
+                buffer[y * stride + x] = (uint8_t)(x * 37 + y * 11 + i * 3);
+        uref_pic_plane_unmap(pics[i], "y8", 0, 0, -1, -1);
+    }
+
+    struct upipe *sink = upipe_void_alloc(&test_mgr, uprobe_use(uprobe));
+    assert(sink != NULL);
+    struct upipe_mgr *upipe_vdet_mgr = upipe_vdet_mgr_alloc();
+    assert(upipe_vdet_mgr != NULL);
+    struct upipe *vdet = upipe_void_alloc(upipe_vdet_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe), UPROBE_LOG_LEVEL, "vdet"));
+    assert(vdet != NULL);
+    ubase_assert(upipe_set_output(vdet, sink));
+    ubase_assert(upipe_vdet_set_step(vdet, step));
+
+    struct uref *flow_def = uref_pic_flow_alloc_def(uref_mgr, 1);
+    assert(flow_def != NULL);
+    ubase_assert(uref_pic_flow_add_plane(flow_def, 1, 1, 1, "y8"));
+    struct urational fps = { .num = FPS, .den = 1 };
+    ubase_assert(uref_pic_flow_set_fps(flow_def, fps));
+    ubase_assert(upipe_set_flow_def(vdet, flow_def));
+    uref_free(flow_def);
+
+    uint64_t begin = cpu_time();
+    for (unsigned int i = 0; i < pictures; i++) {
+        struct uref *uref = uref_dup(pics[i % NB_PICS]);
+        assert(uref != NULL);
+        upipe_input(vdet, uref, NULL);
+    }
+    uint64_t elapsed = cpu_time() - begin;
+
+    printf("%4zux%-4zu step %u %8u pictures %8.3f s CPU %10.2f us/picture "
+           "%6.2f %% of a core at %u fps\n", hsize, vsize, step, pictures,
+           (double)elapsed / 1000000000., elapsed / 1000. / pictures,
+           elapsed / 10000000. / pictures * FPS, FPS);
+
+    upipe_release(vdet);
+    test_free(sink);
+    for (int i = 0; i < NB_PICS; i++)
+        uref_free(pics[i]);
+}
+
+/** @This prints the usage and exits.
+ *
+ * @param argv0 name of the program
+ */
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "Usage: %s [-n <pictures>] [-s <step>]\n", argv0);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int pictures = DEFAULT_PICTURES;
+    unsigned int step = 4;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        switch (opt) {
+            case 'n':
+                pictures = strtoul(optarg, NULL, 10);
+                break;
+            case 's':
+                step = strtoul(optarg, NULL, 10);
+                if (!step)
+                    usage(argv[0]);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    /* structures managers */
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
+                                                   0);
+    assert(uref_mgr != NULL);
+    struct ubuf_mgr *ubuf_mgr = ubuf_pic_mem_mgr_alloc(UBUF_POOL_DEPTH,
+                                                       UBUF_POOL_DEPTH,
+                                                       umem_mgr, 1,
+                                                       0, 0, 0, 0, 0, 0);
+    assert(ubuf_mgr != NULL);
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(ubuf_mgr, "y8", 1, 1, 1));
+
+    /* probes */
+    struct uprobe uprobe_s;
+    uprobe_init(&uprobe_s, catch, NULL);
+    struct uprobe *uprobe = uprobe_stdio_alloc(&uprobe_s, stderr,
+                                               UPROBE_LOG_LEVEL);
+    assert(uprobe != NULL);
+
+    bench(uprobe, uref_mgr, ubuf_mgr, 720, 576, step, pictures);
+    bench(uprobe, uref_mgr, ubuf_mgr, 1920, 1080, step, pictures);
+
+    uprobe_release(uprobe);
+    uprobe_clean(&uprobe_s);
+    ubuf_mgr_release(ubuf_mgr);
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    return 0;
+}
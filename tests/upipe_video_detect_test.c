@@ -0,0 +1,268 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for video detect pipes
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uclock.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_pic_mem.h>
+#include <upipe/uref.h>
+#include <upipe/uref_pic.h>
+#include <upipe/uref_pic_flow.h>
+#include <upipe/uref_std.h>
+#include <upipe/upipe.h>
+#include <upipe-filters/upipe_video_detect.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+#define UDICT_POOL_DEPTH 5
+#define UREF_POOL_DEPTH 5
+#define UBUF_POOL_DEPTH 5
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+#define WIDTH 96
+#define HEIGHT 64
+#define FRAME_DURATION (UCLOCK_FREQ / 25)
+
+static struct uref_mgr *uref_mgr;
+static struct ubuf_mgr *ubuf_mgr;
+static int black = 0, freeze = 0, scene = 0;
+static int black_events = 0, freeze_events = 0;
+static struct uref *last = NULL;
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_LOG:
+        case UPROBE_NEW_FLOW_DEF:
+            break;
+        case UPROBE_VDET_BLACK:
+        case UPROBE_VDET_FREEZE: {
+            assert(va_arg(args, unsigned int) == UPIPE_VIDEO_DETECT_SIGNATURE);
+            struct uref *uref = va_arg(args, struct uref *);
+            assert(uref != NULL);
+            int state = va_arg(args, int);
+            if (event == UPROBE_VDET_BLACK) {
+                assert(state != black);
+                black = state;
+                black_events++;
+            } else {
+                assert(state != freeze);
+                freeze = state;
+                freeze_events++;
+            }
+            break;
+        }
+        case UPROBE_VDET_SCENE_CHANGE: {
+            assert(va_arg(args, unsigned int) == UPIPE_VIDEO_DETECT_SIGNATURE);
+            assert(va_arg(args, struct uref *) != NULL);
+            scene++;
+            break;
+        }
+        default:
+            assert(0);
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    uref_free(last);
+    last = uref;
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+        case UPIPE_REGISTER_REQUEST:
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** @This sends a picture with a flat luma or a pattern.
+ *
+ * @param vdet video detect pipe
+ * @param flat flat luma value, or -1
+ * @param offset offset of the pattern
+ */
+static void send_pic(struct upipe *vdet, int flat, uint8_t offset)
+{
+    struct uref *uref = uref_pic_alloc(uref_mgr, ubuf_mgr, WIDTH, HEIGHT);
+    assert(uref != NULL);
+    uint8_t *buffer;
+    size_t stride;
+    ubase_assert(uref_pic_plane_write(uref, "y8", 0, 0, -1, -1, &buffer));
+    ubase_assert(uref_pic_plane_size(uref, "y8", &stride, NULL, NULL, NULL));
+    for (int y = 0; y < HEIGHT; y++)
+        for (int x = 0; x < WIDTH; x++)
+            buffer[y * stride + x] = flat >= 0 ? flat :
+                                     (uint8_t)(x * 37 + y * 11 + offset);
+    uref_pic_plane_unmap(uref, "y8", 0, 0, -1, -1);
+    upipe_input(vdet, uref, NULL);
+}
+
+int main(int argc, char **argv)
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr, 0);
+    assert(uref_mgr != NULL);
+    ubuf_mgr = ubuf_pic_mem_mgr_alloc(UBUF_POOL_DEPTH, UBUF_POOL_DEPTH,
+                                      umem_mgr, 1, 0, 0, 0, 0, 0, 0);
+    assert(ubuf_mgr != NULL);
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(ubuf_mgr, "y8", 1, 1, 1));
+
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *logger = uprobe_stdio_alloc(&uprobe, stdout,
+                                               UPROBE_LOG_LEVEL);
+    assert(logger != NULL);
+
+    struct upipe *sink = upipe_void_alloc(&test_mgr, uprobe_use(logger));
+    assert(sink != NULL);
+
+    struct upipe_mgr *upipe_vdet_mgr = upipe_vdet_mgr_alloc();
+    assert(upipe_vdet_mgr != NULL);
+    struct upipe *vdet = upipe_void_alloc(upipe_vdet_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "vdet"));
+    assert(vdet != NULL);
+    ubase_assert(upipe_set_output(vdet, sink));
+
+    struct uref *flow_def = uref_pic_flow_alloc_def(uref_mgr, 1);
+    assert(flow_def != NULL);
+    ubase_assert(uref_pic_flow_add_plane(flow_def, 1, 1, 1, "y8"));
+    struct urational fps = { .num = 25, .den = 1 };
+    ubase_assert(uref_pic_flow_set_fps(flow_def, fps));
+    ubase_assert(upipe_set_flow_def(vdet, flow_def));
+    uref_free(flow_def);
+
+    ubase_assert(upipe_vdet_set_black(vdet, 32, 980, 3 * FRAME_DURATION));
+    ubase_assert(upipe_vdet_set_freeze(vdet, 128, 3 * FRAME_DURATION));
+    ubase_assert(upipe_vdet_set_step(vdet, 2));
+    ubase_nassert(upipe_vdet_set_step(vdet, 0));
+
+    /* black */
+    uint64_t value;
+    for (int i = 0; i < 4; i++) {
+        send_pic(vdet, 16, 0);
+        assert(black == (i >= 2));
+        ubase_assert(uref_vdet_get_luma(last, &value));
+        assert(value == 16);
+    }
+    assert(!freeze);
+    assert(!scene);
+
+    /* end of black and scene change */
+    send_pic(vdet, -1, 0);
+    assert(!black);
+    assert(black_events == 2);
+    assert(scene == 1);
+    ubase_assert(uref_vdet_get_hist(last, &value));
+    assert(value >= 400);
+
+    /* freeze */
+    for (int i = 0; i < 3; i++) {
+        send_pic(vdet, -1, 0);
+        assert(freeze == (i >= 2));
+        ubase_assert(uref_vdet_get_sad(last, &value));
+        assert(value == 0);
+    }
+
+    /* the output pictures are not kept by the pipe */
+    uint8_t *buffer;
+    ubase_assert(uref_pic_plane_write(last, "y8", 0, 0, -1, -1, &buffer));
+    uref_pic_plane_unmap(last, "y8", 0, 0, -1, -1);
+
+    /* end of freeze, without scene change */
+    send_pic(vdet, -1, 100);
+    assert(!freeze);
+    assert(freeze_events == 2);
+    assert(scene == 1);
+    ubase_assert(uref_vdet_get_sad(last, &value));
+    assert(value > 128);
+
+    uref_free(last);
+    upipe_release(vdet);
+    test_free(sink);
+
+    ubuf_mgr_release(ubuf_mgr);
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(logger);
+    uprobe_clean(&uprobe);
+    return 0;
+}
@@ -0,0 +1,276 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for video quality pipes
+ */
+
+#undef NDEBUG
+
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_pic_mem.h>
+#include <upipe/uref.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_pic.h>
+#include <upipe/uref_pic_flow.h>
+#include <upipe/uref_std.h>
+#include <upipe/upipe.h>
+#include <upipe-filters/upipe_video_quality.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <assert.h>
+
+#define UDICT_POOL_DEPTH 5
+#define UREF_POOL_DEPTH 5
+#define UBUF_POOL_DEPTH 5
+#define UPROBE_LOG_LEVEL UPROBE_LOG_DEBUG
+#define WIDTH 64
+#define HEIGHT 48
+
+static struct uref_mgr *uref_mgr;
+static struct ubuf_mgr *ubuf_mgr;
+static unsigned int nb_windows = 0;
+static struct uref *last = NULL;
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_LOG:
+        case UPROBE_NEW_FLOW_DEF:
+            break;
+        case UPROBE_VQUAL_WINDOW: {
+            assert(va_arg(args, unsigned int) ==
+                   UPIPE_VIDEO_QUALITY_SIGNATURE);
+            struct uref *uref = va_arg(args, struct uref *);
+            assert(uref != NULL);
+            double avg;
+            ubase_assert(uref_vqual_get_psnr_avg(uref, &avg, 0));
+            ubase_assert(uref_vqual_get_ssim_avg(uref, &avg, 0));
+            nb_windows++;
+            break;
+        }
+        default:
+            assert(0);
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    uref_free(last);
+    last = uref;
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+        case UPIPE_REGISTER_REQUEST:
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** @This sends a picture with a pattern.
+ *
+ * @param upipe pipe to send the picture to
+ * @param pts program PTS of the picture
+ * @param offset offset added to the luma pattern
+ */
+static void send_pic(struct upipe *upipe, uint64_t pts, uint8_t offset)
+{
+    struct uref *uref = uref_pic_alloc(uref_mgr, ubuf_mgr, WIDTH, HEIGHT);
+    assert(uref != NULL);
+    const char *chroma = NULL;
+    while (ubase_check(uref_pic_iterate_plane(uref, &chroma)) &&
+           chroma != NULL) {
+        uint8_t *buffer;
+        size_t stride;
+        uint8_t hsub, vsub;
+        ubase_assert(uref_pic_plane_size(uref, chroma, &stride, &hsub, &vsub,
+                                         NULL));
+        ubase_assert(uref_pic_plane_write(uref, chroma, 0, 0, -1, -1,
+                                          &buffer));
+        for (int y = 0; y < HEIGHT / vsub; y++)
+            for (int x = 0; x < WIDTH / hsub; x++)
+                buffer[y * stride + x] = (x * 3 + y * 5) % 200 +
+                    (hsub == 1 ? offset : 0);
+        uref_pic_plane_unmap(uref, chroma, 0, 0, -1, -1);
+    }
+    uref_clock_set_pts_prog(uref, pts);
+    upipe_input(upipe, uref, NULL);
+}
+
+int main(int argc, char **argv)
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr, 0);
+    assert(uref_mgr != NULL);
+    ubuf_mgr = ubuf_pic_mem_mgr_alloc(UBUF_POOL_DEPTH, UBUF_POOL_DEPTH,
+                                      umem_mgr, 1, 0, 0, 0, 0, 0, 0);
+    assert(ubuf_mgr != NULL);
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(ubuf_mgr, "y8", 1, 1, 1));
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(ubuf_mgr, "u8", 2, 2, 1));
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(ubuf_mgr, "v8", 2, 2, 1));
+
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *logger = uprobe_stdio_alloc(&uprobe, stdout,
+                                               UPROBE_LOG_LEVEL);
+    assert(logger != NULL);
+
+    struct upipe *sink = upipe_void_alloc(&test_mgr, uprobe_use(logger));
+    assert(sink != NULL);
+
+    struct upipe_mgr *upipe_vqual_mgr = upipe_vqual_mgr_alloc();
+    assert(upipe_vqual_mgr != NULL);
+    struct upipe *vqual = upipe_void_alloc(upipe_vqual_mgr,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "vqual"));
+    assert(vqual != NULL);
+    ubase_assert(upipe_set_output(vqual, sink));
+    struct upipe *ref = upipe_void_alloc_sub(vqual,
+            uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL, "ref"));
+    assert(ref != NULL);
+
+    struct uref *flow_def = uref_pic_flow_alloc_def(uref_mgr, 1);
+    assert(flow_def != NULL);
+    ubase_assert(uref_pic_flow_add_plane(flow_def, 1, 1, 1, "y8"));
+    ubase_assert(uref_pic_flow_add_plane(flow_def, 2, 2, 1, "u8"));
+    ubase_assert(uref_pic_flow_add_plane(flow_def, 2, 2, 1, "v8"));
+    ubase_assert(upipe_set_flow_def(vqual, flow_def));
+    ubase_assert(upipe_set_flow_def(ref, flow_def));
+    uref_free(flow_def);
+
+    ubase_nassert(upipe_vqual_set_window(vqual, 0));
+    ubase_assert(upipe_vqual_set_window(vqual, 2));
+
+    /* identical pictures */
+    double psnr, ssim, avg;
+    send_pic(ref, 1, 0);
+    send_pic(vqual, 1, 0);
+    for (uint8_t plane = 0; plane < 3; plane++) {
+        ubase_assert(uref_vqual_get_psnr(last, &psnr, plane));
+        assert(psnr == 100.);
+        ubase_assert(uref_vqual_get_ssim(last, &ssim, plane));
+        assert(fabs(ssim - 1.) < 1e-9);
+    }
+    assert(nb_windows == 0);
+
+    /* distorted luma */
+    send_pic(ref, 2, 0);
+    send_pic(vqual, 2, 2);
+    ubase_assert(uref_vqual_get_psnr(last, &psnr, 0));
+    assert(fabs(psnr - 10. * log10(255. * 255. / 4.)) < 1e-9);
+    ubase_assert(uref_vqual_get_psnr_avg(last, &avg, 0));
+    assert(fabs(avg - (psnr + 100.) / 2.) < 1e-9);
+    ubase_assert(uref_vqual_get_ssim(last, &ssim, 0));
+    assert(ssim < 1. && ssim > .9);
+    ubase_assert(uref_vqual_get_psnr(last, &psnr, 1));
+    assert(psnr == 100.);
+    assert(nb_windows == 1);
+
+    /* unmatched reference pictures are dropped */
+    send_pic(ref, 3, 0);
+    send_pic(ref, 4, 0);
+    send_pic(vqual, 4, 2);
+    ubase_assert(uref_vqual_get_psnr(last, &psnr, 0));
+    assert(fabs(psnr - 10. * log10(255. * 255. / 4.)) < 1e-9);
+    ubase_assert(uref_vqual_get_psnr_avg(last, &avg, 0));
+    assert(avg == psnr);
+
+    /* subsampling */
+    ubase_assert(upipe_vqual_set_step(vqual, 3));
+    send_pic(ref, 5, 0);
+    send_pic(vqual, 5, 2);
+    ubase_assert(uref_vqual_get_psnr(last, &psnr, 0));
+    assert(fabs(psnr - 10. * log10(255. * 255. / 4.)) < 1e-9);
+    ubase_assert(uref_vqual_get_ssim(last, &ssim, 1));
+    assert(fabs(ssim - 1.) < 1e-9);
+    assert(nb_windows == 2);
+
+    /* no reference */
+    send_pic(vqual, 6, 0);
+    ubase_nassert(uref_vqual_get_psnr(last, &psnr, 0));
+
+    uref_free(last);
+    upipe_release(ref);
+    upipe_release(vqual);
+    test_free(sink);
+
+    ubuf_mgr_release(ubuf_mgr);
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(logger);
+    uprobe_clean(&uprobe);
+    return 0;
+}
@@ -119,6 +119,10 @@ static int test_control(struct upipe *upipe, int command, va_list args)
 {
     struct test_pipe *test_pipe = container_of(upipe, struct test_pipe, upipe);
     switch (command) {
+        case UPIPE_UNCONFINE:
+            /* sent before the pipe is moved to the other thread */
+            assert(!transferred);
+            return UBASE_ERR_UNHANDLED;
         case UPIPE_ATTACH_UPUMP_MGR: {
             upipe_dbg(upipe, "attached");
             transferred = true;
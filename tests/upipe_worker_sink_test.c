@@ -128,6 +128,7 @@ static int test_control(struct upipe *upipe, int command, va_list args)
             return UBASE_ERR_NONE;
         }
         case UPIPE_GET_OUTPUT:
+        case UPIPE_UNCONFINE:
             return UBASE_ERR_UNHANDLED;
         default:
             assert(0);
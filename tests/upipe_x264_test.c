@@ -280,6 +280,25 @@ int main(int argc, char **argv)
     upipe_release(x264);
     test_free(x264_test);
 
+    /* MPEG-2 mode only accepts 8-bit 4:2:0 */
+    x264 = upipe_void_alloc(upipe_x264_mgr,
+                    uprobe_pfx_alloc(uprobe_use(logger), UPROBE_LOG_LEVEL,
+                                     "x264 mpeg2"));
+    assert(x264);
+    if (ubase_check(upipe_x264_set_default_mpeg2(x264))) {
+        flow_def = uref_pic_flow_alloc_def(uref_mgr, 1);
+        assert(flow_def);
+        ubase_assert(uref_pic_flow_add_plane(flow_def, 1, 1, 2, "y10l"));
+        ubase_assert(uref_pic_flow_add_plane(flow_def, 2, 1, 2, "u10l"));
+        ubase_assert(uref_pic_flow_add_plane(flow_def, 2, 1, 2, "v10l"));
+        ubase_assert(uref_pic_flow_set_hsize(flow_def, WIDTH));
+        ubase_assert(uref_pic_flow_set_vsize(flow_def, HEIGHT));
+        ubase_assert(uref_pic_flow_set_fps(flow_def, fps));
+        assert(!ubase_check(upipe_set_flow_def(x264, flow_def)));
+        uref_free(flow_def);
+    }
+    upipe_release(x264);
+
     /* clean everything */
     upipe_mgr_release(upipe_x264_mgr); // noop
     ubuf_mgr_release(pic_mgr);
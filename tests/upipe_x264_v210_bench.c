@@ -0,0 +1,381 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short benchmark for v210 input in the x264 module
+ * This program encodes the same v210 pictures twice: once through
+ * upipe_v210dec converting to planar 10-bit 4:2:2, and once fed directly to
+ * upipe_x264. It prints the CPU time spent per picture in both cases.
+ *
+ * Usage: upipe_x264_v210_bench [-w <width>] [-h <height>] [-n <pictures>]
+ *                              [-p <preset>]
+ */
+
+#undef NDEBUG
+
+#include <upipe/uclock.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_ubuf_mem.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_pic.h>
+#include <upipe/ubuf_pic_mem.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/uref.h>
+#include <upipe/uref_std.h>
+#include <upipe/uref_clock.h>
+#include <upipe/uref_pic.h>
+#include <upipe/uref_pic_flow.h>
+#include <upipe/uref_block.h>
+#include <upipe/upipe.h>
+#include <upipe-v210/upipe_v210dec.h>
+#include <upipe-x264/upipe_x264.h>
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <assert.h>
+
+#define UPROBE_LOG_LEVEL UPROBE_LOG_WARNING
+#define UDICT_POOL_DEPTH 10
+#define UREF_POOL_DEPTH 10
+#define UBUF_POOL_DEPTH 10
+#define UBUF_ALIGN 32
+/** v210 plane */
+#define V210_CHROMA "u10y10v10y10u10y10v10y10u10y10v10y10"
+/** number of distinct source pictures */
+#define NB_SOURCES 4
+/** default picture size */
+#define DEFAULT_WIDTH 1920
+#define DEFAULT_HEIGHT 1080
+/** default number of encoded pictures */
+#define DEFAULT_PICTURES 100
+/** default x264 preset */
+#define DEFAULT_PRESET "ultrafast"
+
+static unsigned int nb_pics = 0;
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+        case UPROBE_NEED_UJOB_MGR:
+        case UPROBE_LOG:
+            break;
+        default:
+            assert(0);
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** helper phony pipe */
+static struct upipe *test_alloc(struct upipe_mgr *mgr, struct uprobe *uprobe,
+                                uint32_t signature, va_list args)
+{
+    struct upipe *upipe = malloc(sizeof(struct upipe));
+    assert(upipe != NULL);
+    upipe_init(upipe, mgr, uprobe);
+    return upipe;
+}
+
+/** helper phony pipe */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    if (uref->ubuf != NULL)
+        nb_pics++;
+    uref_free(uref);
+}
+
+/** helper phony pipe */
+static int test_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+            return UBASE_ERR_NONE;
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            if (urequest->type == UREQUEST_FLOW_FORMAT) {
+                struct uref *uref = uref_dup(urequest->uref);
+                assert(uref != NULL);
+                return urequest_provide_flow_format(urequest, uref);
+            }
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        default:
+            assert(0);
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** helper phony pipe */
+static void test_free(struct upipe *upipe)
+{
+    upipe_clean(upipe);
+    free(upipe);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test_mgr = {
+    .refcount = NULL,
+    .upipe_alloc = test_alloc,
+    .upipe_input = test_input,
+    .upipe_control = test_control
+};
+
+/** @This returns the CPU time consumed by the process.
+ *
+ * @return CPU time in nanoseconds
+ */
+static uint64_t cpu_time(void)
+{
+    struct timespec ts;
+    int err = clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    assert(err == 0);
+    return (uint64_t)ts.tv_sec * UINT64_C(1000000000) + ts.tv_nsec;
+}
+
+/** @This fills a v210 picture with a moving pattern.
+ *
+ * @param uref picture to fill
+ * @param counter picture number
+ */
+static void fill_v210(struct uref *uref, int counter)
+{
+    size_t hsize, vsize, stride;
+    ubase_assert(uref_pic_size(uref, &hsize, &vsize, NULL));
+    ubase_assert(uref_pic_plane_size(uref, V210_CHROMA, &stride,
+                                     NULL, NULL, NULL));
+    uint8_t *buffer;
+    ubase_assert(uref_pic_plane_write(uref, V210_CHROMA, 0, 0, -1, -1,
+                                      &buffer));
+
+    /* 4 words for 6 pixels */
+    size_t words = (hsize + 5) / 6 * 4;
+    for (size_t y = 0; y < vsize; y++) {
+        uint32_t *line = (uint32_t *)(buffer + y * stride);
+        for (size_t x = 0; x < words; x++) {
+            uint32_t s0 = 64 + (x * 3 + y + counter * 8) % 876;
+            uint32_t s1 = 64 + (x * 3 + 1 + y * 2 + counter * 4) % 876;
+            uint32_t s2 = 64 + (x * 3 + 2 + y * 3 + counter * 2) % 876;
+            line[x] = s0 | (s1 << 10) | (s2 << 20);
+        }
+    }
+    ubase_assert(uref_pic_plane_unmap(uref, V210_CHROMA, 0, 0, -1, -1));
+}
+
+/** @This encodes the pictures and prints the cost.
+ *
+ * @param uprobe probe hierarchy
+ * @param flow_def v210 flow definition
+ * @param planar_def planar flow definition, or NULL to feed x264 directly
+ * @param preset x264 preset
+ * @param sources source pictures
+ * @param pictures number of pictures to encode
+ * @return CPU time per picture in nanoseconds
+ */
+static uint64_t bench(struct uprobe *uprobe, struct uref *flow_def,
+                      struct uref *planar_def, const char *preset,
+                      struct uref **sources, unsigned int pictures)
+{
+    const char *name = planar_def != NULL ? "v210dec" : "direct";
+    struct upipe *sink = upipe_void_alloc(&test_mgr, uprobe_use(uprobe));
+    assert(sink != NULL);
+
+    struct upipe_mgr *x264_mgr = upipe_x264_mgr_alloc();
+    assert(x264_mgr != NULL);
+    struct upipe *x264 = upipe_void_alloc(x264_mgr,
+            uprobe_pfx_alloc(uprobe_use(uprobe), UPROBE_LOG_LEVEL, "x264"));
+    assert(x264 != NULL);
+    upipe_mgr_release(x264_mgr);
+    ubase_assert(upipe_x264_set_default_preset(x264, preset, NULL));
+    ubase_assert(upipe_set_output(x264, sink));
+
+    struct upipe *input = x264;
+    if (planar_def != NULL) {
+        struct upipe_mgr *v210dec_mgr = upipe_v210dec_mgr_alloc();
+        assert(v210dec_mgr != NULL);
+        input = upipe_flow_alloc(v210dec_mgr,
+                uprobe_pfx_alloc(uprobe_use(uprobe), UPROBE_LOG_LEVEL,
+                                 "v210dec"), planar_def);
+        assert(input != NULL);
+        upipe_mgr_release(v210dec_mgr);
+        ubase_assert(upipe_set_output(input, x264));
+        upipe_release(x264);
+    }
+    ubase_assert(upipe_set_flow_def(input, flow_def));
+
+    nb_pics = 0;
+    uint64_t begin = cpu_time();
+    for (unsigned int i = 0; i < pictures; i++) {
+        struct uref *pic = uref_dup(sources[i % NB_SOURCES]);
+        assert(pic != NULL);
+        uref_clock_set_pts_prog(pic, (uint64_t)(i + 1) * UCLOCK_FREQ / 25);
+        upipe_input(input, pic, NULL);
+    }
+    upipe_release(input);
+    uint64_t elapsed = cpu_time() - begin;
+
+    printf("%-8s %6u pictures %8.3f s CPU %8.3f ms/picture\n",
+           name, nb_pics, (double)elapsed / 1000000000.,
+           elapsed / 1000000. / pictures);
+
+    test_free(sink);
+    return elapsed / pictures;
+}
+
+/** @This prints the usage and exits.
+ *
+ * @param argv0 name of the program
+ */
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "Usage: %s [-w <width>] [-h <height>] [-n <pictures>] "
+            "[-p <preset>]\n", argv0);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int width = DEFAULT_WIDTH, height = DEFAULT_HEIGHT;
+    unsigned int pictures = DEFAULT_PICTURES;
+    const char *preset = DEFAULT_PRESET;
+    int opt;
+    while ((opt = getopt(argc, argv, "w:h:n:p:")) != -1) {
+        switch (opt) {
+            case 'w':
+                width = strtoul(optarg, NULL, 10);
+                break;
+            case 'h':
+                height = strtoul(optarg, NULL, 10);
+                break;
+            case 'n':
+                pictures = strtoul(optarg, NULL, 10);
+                break;
+            case 'p':
+                preset = optarg;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (!width || !height || !pictures)
+        usage(argv[0]);
+
+    /* structures managers */
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
+                                                   0);
+    assert(uref_mgr != NULL);
+    struct ubuf_mgr *v210_mgr = ubuf_pic_mem_mgr_alloc(UBUF_POOL_DEPTH,
+            UBUF_POOL_DEPTH, umem_mgr, 6, 0, 0, 0, 0, UBUF_ALIGN, 0);
+    assert(v210_mgr != NULL);
+    ubase_assert(ubuf_pic_mem_mgr_add_plane(v210_mgr, V210_CHROMA, 1, 1, 16));
+
+    /* probes */
+    struct uprobe uprobe_s;
+    uprobe_init(&uprobe_s, catch, NULL);
+    struct uprobe *uprobe;
+    uprobe = uprobe_stdio_alloc(&uprobe_s, stderr, UPROBE_LOG_LEVEL);
+    assert(uprobe != NULL);
+    uprobe = uprobe_ubuf_mem_alloc(uprobe, umem_mgr, UBUF_POOL_DEPTH,
+                                   UBUF_POOL_DEPTH);
+    assert(uprobe != NULL);
+
+    /* flow definitions */
+    struct urational fps = { .num = 25, .den = 1 };
+    struct uref *flow_def = uref_pic_flow_alloc_def(uref_mgr, 6);
+    assert(flow_def != NULL);
+    ubase_assert(uref_pic_flow_add_plane(flow_def, 1, 1, 16, V210_CHROMA));
+    ubase_assert(uref_pic_flow_set_align(flow_def, UBUF_ALIGN));
+    ubase_assert(uref_pic_flow_set_hsize(flow_def, width));
+    ubase_assert(uref_pic_flow_set_vsize(flow_def, height));
+    ubase_assert(uref_pic_flow_set_fps(flow_def, fps));
+    ubase_assert(uref_pic_set_progressive(flow_def));
+
+    struct uref *planar_def = uref_pic_flow_alloc_def(uref_mgr, 1);
+    assert(planar_def != NULL);
+    ubase_assert(uref_pic_flow_add_plane(planar_def, 1, 1, 2, "y10l"));
+    ubase_assert(uref_pic_flow_add_plane(planar_def, 2, 1, 2, "u10l"));
+    ubase_assert(uref_pic_flow_add_plane(planar_def, 2, 1, 2, "v10l"));
+
+    /* check that this libx264 takes 10-bit 4:2:2 at all */
+    struct upipe_mgr *x264_mgr = upipe_x264_mgr_alloc();
+    assert(x264_mgr != NULL);
+    struct upipe *x264 = upipe_void_alloc(x264_mgr, uprobe_use(uprobe));
+    assert(x264 != NULL);
+    upipe_mgr_release(x264_mgr);
+    bool supported = ubase_check(upipe_set_flow_def(x264, flow_def));
+    upipe_release(x264);
+
+    if (supported) {
+        struct uref *sources[NB_SOURCES];
+        for (int i = 0; i < NB_SOURCES; i++) {
+            sources[i] = uref_pic_alloc(uref_mgr, v210_mgr, width, height);
+            assert(sources[i] != NULL);
+            fill_v210(sources[i], i);
+        }
+
+        uint64_t planar = bench(uprobe, flow_def, planar_def, preset,
+                                sources, pictures);
+        uint64_t direct = bench(uprobe, flow_def, NULL, preset,
+                                sources, pictures);
+        printf("direct v210 input saves %.3f ms/picture (%.1f %%)\n",
+               ((double)planar - direct) / 1000000.,
+               ((double)planar - direct) * 100. / planar);
+
+        for (int i = 0; i < NB_SOURCES; i++)
+            uref_free(sources[i]);
+    } else
+        printf("libx264 was not built with 10-bit 4:2:2 support\n");
+
+    uref_free(planar_def);
+    uref_free(flow_def);
+    ubuf_mgr_release(v210_mgr);
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    uprobe_release(uprobe);
+    uprobe_clean(&uprobe_s);
+
+    return 0;
+}
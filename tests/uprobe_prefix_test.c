@@ -32,11 +32,31 @@
 #include <upipe/uprobe.h>
 #include <upipe/uprobe_stdio.h>
 #include <upipe/uprobe_prefix.h>
+#include <upipe/uprobe_helper_uprobe.h>
 
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
 
+static unsigned int nb_events = 0;
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    assert(event == UPROBE_NEW_RAP);
+    nb_events++;
+    return UBASE_ERR_NONE;
+}
+
+/** probe declaring its events with the helper */
+struct uprobe_test {
+    struct uprobe uprobe;
+};
+
+UPROBE_HELPER_UPROBE(uprobe_test, uprobe)
+UPROBE_HELPER_EVENTS(uprobe_test, UPROBE_LOG, UPROBE_NEW_RAP, UPROBE_LOCAL + 1)
+
 int main(int argc, char **argv)
 {
     struct uprobe *uprobe2 = uprobe_stdio_alloc(NULL, stdout, UPROBE_LOG_DEBUG);
@@ -61,5 +81,29 @@ int main(int argc, char **argv)
     uprobe_release(uprobe1);
 
     uprobe_release(uprobe2);
+
+    /* events not handled by the probes go straight to the last one */
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    assert(uprobe.events == UPROBE_EVENTS_ALL);
+    uprobe2 = uprobe_stdio_alloc(&uprobe, stdout, UPROBE_LOG_DEBUG);
+    assert(uprobe2 != NULL);
+    assert(!(uprobe2->events & uprobe_event_mask(UPROBE_NEW_RAP)));
+    uprobe1 = uprobe_pfx_alloc(uprobe2, UPROBE_LOG_DEBUG, "pfx");
+    assert(uprobe1 != NULL);
+    assert(uprobe1->events == uprobe_event_mask(UPROBE_LOG));
+    ubase_assert(uprobe_throw(uprobe1, NULL, UPROBE_NEW_RAP, NULL));
+    assert(nb_events == 1);
+    uprobe_release(uprobe1);
+    uprobe_clean(&uprobe);
+
+    /* masks computed by the helper, local events sharing the last bit */
+    struct uprobe_test test;
+    uprobe_init(uprobe_test_to_uprobe(&test), catch, NULL);
+    uprobe_test_init_events(uprobe_test_to_uprobe(&test));
+    assert(test.uprobe.events == (uprobe_event_mask(UPROBE_LOG) |
+                                  uprobe_event_mask(UPROBE_NEW_RAP) |
+                                  uprobe_event_mask(UPROBE_LOCAL)));
+    uprobe_clean(uprobe_test_to_uprobe(&test));
     return 0;
 }
@@ -0,0 +1,393 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests and benchmark for the profiling probe, building and
+ * tearing down a large synthetic graph
+ */
+
+#undef NDEBUG
+
+#include <upipe/ubase.h>
+#include <upipe/uclock.h>
+#include <upipe/uclock_std.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_stdio.h>
+#include <upipe/uprobe_prof.h>
+#include <upipe/uprobe_uref_mgr.h>
+#include <upipe/uprobe_ubuf_mem_pool.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/uref.h>
+#include <upipe/uref_std.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/uref_pic_flow.h>
+#include <upipe/uref_sound_flow.h>
+#include <upipe/upipe.h>
+#include <upipe/upipe_helper_upipe.h>
+#include <upipe/upipe_helper_urefcount.h>
+#include <upipe/upipe_helper_flow.h>
+#include <upipe/upipe_helper_void.h>
+#include <upipe/upipe_helper_output.h>
+#include <upipe/upipe_helper_uref_mgr.h>
+#include <upipe/upipe_helper_ubuf_mgr.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#define UDICT_POOL_DEPTH 5
+#define UREF_POOL_DEPTH 5
+#define UBUF_POOL_DEPTH 5
+#define UPROBE_LOG_LEVEL UPROBE_LOG_NOTICE
+/** default number of channels in the graph */
+#define NB_CHANNELS 300
+/** number of elementary streams per channel */
+#define NB_STREAMS 3
+
+#define TEST_SRC_SIGNATURE UBASE_FOURCC('t','s','r','c')
+#define TEST_SINK_SIGNATURE UBASE_FOURCC('t','s','n','k')
+
+static unsigned int nb_packets = 0;
+static unsigned int nb_alloc_reports = 0;
+static unsigned int nb_release_reports = 0;
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_READY:
+        case UPROBE_DEAD:
+        case UPROBE_NEW_FLOW_DEF:
+        case UPROBE_LOG:
+            break;
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** counts the report lines of pipe allocations and releases */
+static int catch_report(struct uprobe *uprobe, struct upipe *upipe,
+                        int event, va_list args)
+{
+    if (event == UPROBE_LOG) {
+        va_list args_copy;
+        va_copy(args_copy, args);
+        struct ulog *ulog = va_arg(args_copy, struct ulog *);
+        va_end(args_copy);
+        if (strstr(ulog->msg, "tsrc allocation: ") != NULL ||
+            strstr(ulog->msg, "tsnk allocation: ") != NULL)
+            nb_alloc_reports++;
+        else if (strstr(ulog->msg, "tsrc release: ") != NULL ||
+                 strstr(ulog->msg, "tsnk release: ") != NULL)
+            nb_release_reports++;
+    }
+    return uprobe_throw_next(uprobe, upipe, event, args);
+}
+
+/** source pipe requesting managers like a demux output */
+struct test_src {
+    /** refcount management structure */
+    struct urefcount urefcount;
+
+    /** uref manager */
+    struct uref_mgr *uref_mgr;
+    /** uref manager request */
+    struct urequest uref_mgr_request;
+    /** ubuf manager */
+    struct ubuf_mgr *ubuf_mgr;
+    /** flow format packet */
+    struct uref *flow_format;
+    /** ubuf manager request */
+    struct urequest ubuf_mgr_request;
+
+    /** output pipe */
+    struct upipe *output;
+    /** flow_definition packet */
+    struct uref *flow_def;
+    /** output state */
+    enum upipe_helper_output_state output_state;
+    /** list of output requests */
+    struct uchain request_list;
+
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+/** source pipe */
+static int test_src_check(struct upipe *upipe, struct uref *flow_format);
+
+UPIPE_HELPER_UPIPE(test_src, upipe, TEST_SRC_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(test_src, urefcount, test_src_free)
+UPIPE_HELPER_FLOW(test_src, NULL)
+UPIPE_HELPER_OUTPUT(test_src, output, flow_def, output_state, request_list)
+UPIPE_HELPER_UREF_MGR(test_src, uref_mgr, uref_mgr_request, test_src_check,
+                      test_src_register_output_request,
+                      test_src_unregister_output_request)
+UPIPE_HELPER_UBUF_MGR(test_src, ubuf_mgr, flow_format, ubuf_mgr_request,
+                      test_src_check,
+                      test_src_register_output_request,
+                      test_src_unregister_output_request)
+
+/** source pipe */
+static struct upipe *test_src_alloc(struct upipe_mgr *mgr,
+                                    struct uprobe *uprobe,
+                                    uint32_t signature, va_list args)
+{
+    struct uref *flow_def;
+    struct upipe *upipe = test_src_alloc_flow(mgr, uprobe, signature, args,
+                                              &flow_def);
+    assert(upipe != NULL);
+    test_src_init_urefcount(upipe);
+    test_src_init_uref_mgr(upipe);
+    test_src_init_ubuf_mgr(upipe);
+    test_src_init_output(upipe);
+    upipe_throw_ready(upipe);
+
+    test_src_require_uref_mgr(upipe);
+    test_src_require_ubuf_mgr(upipe, flow_def);
+    return upipe;
+}
+
+/** source pipe */
+static int test_src_check(struct upipe *upipe, struct uref *flow_format)
+{
+    if (flow_format != NULL)
+        test_src_store_flow_def(upipe, flow_format);
+    return UBASE_ERR_NONE;
+}
+
+/** source pipe */
+static void test_src_work(struct upipe *upipe)
+{
+    struct test_src *test_src = test_src_from_upipe(upipe);
+    assert(test_src->uref_mgr != NULL);
+    assert(test_src->ubuf_mgr != NULL);
+    struct uref *uref = uref_alloc(test_src->uref_mgr);
+    assert(uref != NULL);
+    test_src_output(upipe, uref, NULL);
+}
+
+/** source pipe */
+static int test_src_control(struct upipe *upipe, int command, va_list args)
+{
+    UBASE_HANDLED_RETURN(test_src_control_ubuf_mgr(upipe, command, args));
+    UBASE_HANDLED_RETURN(test_src_control_output(upipe, command, args));
+    return UBASE_ERR_UNHANDLED;
+}
+
+/** source pipe */
+static void test_src_free(struct upipe *upipe)
+{
+    upipe_throw_dead(upipe);
+    test_src_clean_output(upipe);
+    test_src_clean_ubuf_mgr(upipe);
+    test_src_clean_uref_mgr(upipe);
+    test_src_clean_urefcount(upipe);
+    test_src_free_flow(upipe);
+}
+
+/** source pipe */
+static struct upipe_mgr test_src_mgr = {
+    .refcount = NULL,
+    .signature = TEST_SRC_SIGNATURE,
+    .upipe_alloc = test_src_alloc,
+    .upipe_input = NULL,
+    .upipe_control = test_src_control
+};
+
+/** sink pipe */
+struct test_sink {
+    /** refcount management structure */
+    struct urefcount urefcount;
+    /** public upipe structure */
+    struct upipe upipe;
+};
+
+UPIPE_HELPER_UPIPE(test_sink, upipe, TEST_SINK_SIGNATURE)
+UPIPE_HELPER_UREFCOUNT(test_sink, urefcount, test_sink_free)
+UPIPE_HELPER_VOID(test_sink)
+
+/** sink pipe */
+static struct upipe *test_sink_alloc(struct upipe_mgr *mgr,
+                                     struct uprobe *uprobe,
+                                     uint32_t signature, va_list args)
+{
+    struct upipe *upipe = test_sink_alloc_void(mgr, uprobe, signature, args);
+    assert(upipe != NULL);
+    test_sink_init_urefcount(upipe);
+    upipe_throw_ready(upipe);
+    return upipe;
+}
+
+/** sink pipe */
+static void test_sink_input(struct upipe *upipe, struct uref *uref,
+                            struct upump **upump_p)
+{
+    uref_free(uref);
+    nb_packets++;
+}
+
+/** sink pipe */
+static int test_sink_control(struct upipe *upipe, int command, va_list args)
+{
+    switch (command) {
+        case UPIPE_SET_FLOW_DEF:
+            return UBASE_ERR_NONE;
+        case UPIPE_REGISTER_REQUEST: {
+            struct urequest *urequest = va_arg(args, struct urequest *);
+            return upipe_throw_provide_request(upipe, urequest);
+        }
+        case UPIPE_UNREGISTER_REQUEST:
+            return UBASE_ERR_NONE;
+        default:
+            return UBASE_ERR_UNHANDLED;
+    }
+}
+
+/** sink pipe */
+static void test_sink_free(struct upipe *upipe)
+{
+    upipe_throw_dead(upipe);
+    test_sink_clean_urefcount(upipe);
+    test_sink_free_void(upipe);
+}
+
+/** sink pipe */
+static struct upipe_mgr test_sink_mgr = {
+    .refcount = NULL,
+    .signature = TEST_SINK_SIGNATURE,
+    .upipe_alloc = test_sink_alloc,
+    .upipe_input = test_sink_input,
+    .upipe_control = test_sink_control
+};
+
+/** allocates the flow definition of an elementary stream */
+static struct uref *alloc_flow_def(struct uref_mgr *uref_mgr, unsigned int es)
+{
+    struct uref *flow_def;
+    switch (es % NB_STREAMS) {
+        case 0:
+            flow_def = uref_pic_flow_alloc_def(uref_mgr, 1);
+            assert(flow_def != NULL);
+            ubase_assert(uref_pic_flow_add_plane(flow_def, 1, 1, 1, "y8"));
+            break;
+        case 1:
+            flow_def = uref_sound_flow_alloc_def(uref_mgr, "s16.", 2, 4);
+            assert(flow_def != NULL);
+            ubase_assert(uref_sound_flow_add_plane(flow_def, "lr"));
+            break;
+        default:
+            flow_def = uref_block_flow_alloc_def(uref_mgr, "mpeg2video.");
+            assert(flow_def != NULL);
+            break;
+    }
+    return flow_def;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int nb_channels = NB_CHANNELS;
+    if (argc > 1)
+        nb_channels = strtoul(argv[1], NULL, 0);
+
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
+                                                   0);
+    assert(uref_mgr != NULL);
+    struct uclock *uclock = uclock_std_alloc(0);
+    assert(uclock != NULL);
+
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *logger = uprobe_stdio_alloc(&uprobe, stdout,
+                                               UPROBE_LOG_LEVEL);
+    assert(logger != NULL);
+    logger = uprobe_uref_mgr_alloc(logger, uref_mgr);
+    assert(logger != NULL);
+    logger = uprobe_ubuf_mem_pool_alloc(logger, umem_mgr, UBUF_POOL_DEPTH,
+                                        UBUF_POOL_DEPTH);
+    assert(logger != NULL);
+    struct uprobe uprobe_report;
+    uprobe_init(&uprobe_report, catch_report, logger);
+    struct uprobe *uprobe_prof = uprobe_prof_alloc(&uprobe_report, uclock);
+    assert(uprobe_prof != NULL);
+    ubase_assert(uprobe_prof_set_pipes(uprobe_prof, true));
+
+    unsigned int nb_pipes = nb_channels * NB_STREAMS;
+    struct upipe **sources = malloc(sizeof(struct upipe *) * nb_pipes);
+    struct upipe **sinks = malloc(sizeof(struct upipe *) * nb_pipes);
+    assert(sources != NULL);
+    assert(sinks != NULL);
+
+    uint64_t start = uclock_now(uclock);
+    for (unsigned int i = 0; i < nb_pipes; i++) {
+        sinks[i] = upipe_void_alloc(&test_sink_mgr, uprobe_use(uprobe_prof));
+        assert(sinks[i] != NULL);
+        struct uref *flow_def = alloc_flow_def(uref_mgr, i);
+        sources[i] = upipe_flow_alloc(&test_src_mgr, uprobe_use(uprobe_prof),
+                                      flow_def);
+        uref_free(flow_def);
+        assert(sources[i] != NULL);
+        ubase_assert(upipe_set_output(sources[i], sinks[i]));
+        test_src_work(sources[i]);
+    }
+    uint64_t built = uclock_now(uclock);
+    assert(nb_packets == nb_pipes);
+
+    for (unsigned int i = 0; i < nb_pipes; i++) {
+        upipe_release(sources[i]);
+        upipe_release(sinks[i]);
+    }
+    uint64_t end = uclock_now(uclock);
+
+    printf("%u pipes built in %"PRIu64" us, released in %"PRIu64" us\n",
+           nb_pipes * 2, (built - start) * 1000000 / UCLOCK_FREQ,
+           (end - built) * 1000000 / UCLOCK_FREQ);
+    uprobe_prof_report(uprobe_prof);
+    assert(nb_alloc_reports == 2);
+    assert(nb_release_reports == 2);
+    ubase_assert(uprobe_prof_set_pipes(uprobe_prof, false));
+
+    free(sources);
+    free(sinks);
+    uprobe_release(uprobe_prof);
+    uprobe_clean(&uprobe_report);
+    uprobe_clean(&uprobe);
+    uclock_release(uclock);
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    return 0;
+}
@@ -0,0 +1,312 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for the accounting umem manager and uprobe_umem_prof
+ */
+
+#undef NDEBUG
+
+#include <upipe/ubase.h>
+#include <upipe/uclock.h>
+#include <upipe/ulog.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/umem_pool.h>
+#include <upipe/umem_prof.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block.h>
+#include <upipe/uref.h>
+#include <upipe/uref_std.h>
+#include <upipe/uref_block_flow.h>
+#include <upipe/urequest.h>
+#include <upipe/uprobe.h>
+#include <upipe/uprobe_umem_prof.h>
+#include <upipe/upipe.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#define UDICT_POOL_DEPTH 0
+#define UREF_POOL_DEPTH 0
+#define UBUF_POOL_DEPTH 0
+#define TEST_PIPE1_SIGNATURE UBASE_FOURCC('t','s','t','1')
+#define TEST_PIPE2_SIGNATURE UBASE_FOURCC('t','s','t','2')
+
+/** current date of the phony clock */
+static uint64_t now = 0;
+/** last logged messages */
+static char logs[16][512];
+/** number of logged messages */
+static unsigned int nb_logs = 0;
+
+/** phony clock */
+static uint64_t test_now(struct uclock *uclock)
+{
+    return now;
+}
+
+/** phony clock */
+static struct uclock test_uclock = {
+    .refcount = NULL,
+    .uclock_now = test_now,
+    .uclock_to_real = NULL,
+    .uclock_from_real = NULL
+};
+
+/** definition of our uprobe */
+static int catch(struct uprobe *uprobe, struct upipe *upipe,
+                 int event, va_list args)
+{
+    switch (event) {
+        default:
+            assert(0);
+            break;
+        case UPROBE_DEAD:
+            break;
+        case UPROBE_LOG: {
+            struct ulog *ulog = va_arg(args, struct ulog *);
+            if (ulog->level != UPROBE_LOG_NOTICE)
+                break;
+            assert(nb_logs < 16);
+            snprintf(logs[nb_logs++], sizeof(logs[0]), "%s", ulog->msg);
+            break;
+        }
+    }
+    return UBASE_ERR_NONE;
+}
+
+/** @This checks that a message was logged.
+ *
+ * @param prefix beginning of the message
+ * @param needle string to find in the message
+ */
+static void test_log(const char *prefix, const char *needle)
+{
+    for (unsigned int i = 0; i < nb_logs; i++)
+        if (!strncmp(logs[i], prefix, strlen(prefix))) {
+            assert(strstr(logs[i], needle) != NULL);
+            return;
+        }
+    assert(0);
+}
+
+/** phony pipes */
+struct test_pipe {
+    /** ubuf manager received from the probe */
+    struct ubuf_mgr *ubuf_mgr;
+    /** public structure */
+    struct upipe upipe;
+};
+
+UBASE_FROM_TO(test_pipe, upipe, upipe, upipe)
+
+/** helper phony pipe */
+static int test_provide_ubuf_mgr(struct urequest *urequest, va_list args)
+{
+    struct test_pipe *test = urequest_get_opaque(urequest, struct test_pipe *);
+    struct ubuf_mgr *ubuf_mgr = va_arg(args, struct ubuf_mgr *);
+    struct uref *flow_format = va_arg(args, struct uref *);
+    assert(ubuf_mgr != NULL);
+    ubuf_mgr_release(test->ubuf_mgr);
+    test->ubuf_mgr = ubuf_mgr;
+    uref_free(flow_format);
+    return UBASE_ERR_NONE;
+}
+
+/** helper phony pipe */
+static struct upipe_mgr test1_mgr = {
+    .refcount = NULL,
+    .signature = TEST_PIPE1_SIGNATURE
+};
+
+/** helper phony pipe */
+static struct upipe_mgr test2_mgr = {
+    .refcount = NULL,
+    .signature = TEST_PIPE2_SIGNATURE
+};
+
+/** @This initializes a phony pipe and requests a ubuf manager.
+ *
+ * @param test phony pipe
+ * @param mgr phony pipe manager
+ * @param uprobe probe to use
+ * @param flow_def flow definition of the request
+ */
+static void test_init(struct test_pipe *test, struct upipe_mgr *mgr,
+                      struct uprobe *uprobe, struct uref *flow_def)
+{
+    upipe_init(&test->upipe, mgr, uprobe_use(uprobe));
+    test->ubuf_mgr = NULL;
+
+    struct urequest request;
+    urequest_init_ubuf_mgr(&request, uref_dup(flow_def),
+                           test_provide_ubuf_mgr, NULL);
+    urequest_set_opaque(&request, test);
+    ubase_assert(upipe_throw_provide_request(&test->upipe, &request));
+    urequest_clean(&request);
+    assert(test->ubuf_mgr != NULL);
+}
+
+/** @This releases a phony pipe.
+ *
+ * @param test phony pipe
+ */
+static void test_clean(struct test_pipe *test)
+{
+    upipe_throw_dead(&test->upipe);
+    ubuf_mgr_release(test->ubuf_mgr);
+    upipe_clean(&test->upipe);
+}
+
+int main(int argc, char **argv)
+{
+    struct umem_mgr *umem_mgr = umem_pool_mgr_alloc(32, 2, 1, 1);
+    assert(umem_mgr != NULL);
+    /* start the pool counters */
+    struct umem_stats pool_stats;
+    assert(umem_mgr_stats(umem_mgr, 0, &pool_stats));
+
+    /* accounting manager */
+    struct umem_mgr *prof_mgr = umem_prof_mgr_alloc(umem_mgr, &test_uclock,
+                                                 NULL);
+    assert(prof_mgr != NULL);
+    struct umem umem;
+    assert(umem_alloc(prof_mgr, &umem, 20));
+    assert(umem.mgr == prof_mgr);
+    now += 10;
+    umem_free(&umem);
+    assert(umem_alloc(prof_mgr, &umem, 20));
+    now += 10;
+    assert(umem_realloc(&umem, 50));
+    assert(umem.mgr == prof_mgr);
+    assert(umem_size(&umem) == 50);
+
+    struct umem_prof_stats stats;
+    umem_prof_mgr_get_stats(prof_mgr, &stats);
+    assert(stats.allocs == 2);
+    assert(stats.reallocs == 1);
+    assert(stats.bytes == 70);
+    assert(stats.live == 1);
+    assert(stats.live_bytes == 50);
+    assert(stats.peak_bytes == 50);
+    assert(stats.lifetime == 20);
+    assert(stats.sizes[0] == 2);
+
+    assert(umem_mgr_stats(prof_mgr, 0, &pool_stats));
+    assert(pool_stats.size == 32);
+    assert(pool_stats.hits == 1);
+    assert(pool_stats.misses == 1);
+    assert(umem_mgr_stats(prof_mgr, 1, &pool_stats));
+    assert(pool_stats.size == 64);
+    assert(pool_stats.hits == 0);
+    assert(pool_stats.misses == 1);
+    assert(!umem_mgr_stats(prof_mgr, 2, &pool_stats));
+
+    now += 10;
+    umem_free(&umem);
+    umem_prof_mgr_get_stats(prof_mgr, &stats);
+    assert(stats.live == 0);
+    assert(stats.live_bytes == 0);
+    assert(stats.peak_bytes == 50);
+    assert(stats.lifetime == 30);
+    umem_mgr_release(prof_mgr);
+
+    /* attribution to pipes */
+    struct umem_mgr *udict_umem_mgr = umem_alloc_mgr_alloc();
+    assert(udict_umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         udict_umem_mgr,
+                                                         -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr,
+                                                   0);
+    assert(uref_mgr != NULL);
+    struct uref *flow_def = uref_block_flow_alloc_def(uref_mgr, NULL);
+    assert(flow_def != NULL);
+
+    struct uprobe uprobe;
+    uprobe_init(&uprobe, catch, NULL);
+    struct uprobe *uprobe_umem_prof =
+        uprobe_umem_prof_alloc(uprobe_use(&uprobe), umem_mgr,
+                               UBUF_POOL_DEPTH, UBUF_POOL_DEPTH, NULL, NULL);
+    assert(uprobe_umem_prof != NULL);
+
+    struct test_pipe test1, test2;
+    test_init(&test1, &test1_mgr, uprobe_umem_prof, flow_def);
+    test_init(&test2, &test2_mgr, uprobe_umem_prof, flow_def);
+
+    for (unsigned int i = 0; i < 3; i++) {
+        struct ubuf *ubuf = ubuf_block_alloc(test1.ubuf_mgr, 42);
+        assert(ubuf != NULL);
+        ubuf_free(ubuf);
+    }
+    struct ubuf *ubuf = ubuf_block_alloc(test2.ubuf_mgr, 4096);
+    assert(ubuf != NULL);
+
+    uprobe_umem_prof_report(uprobe_umem_prof);
+    test_log("tst1", "3 allocations (+3)");
+    test_log("tst1", " 0 live");
+    test_log("tst2", "1 allocations (+1)");
+    test_log("tst2", " 1 live");
+    test_log("pool 32 octets", "1 hits, 1 misses (50% hits)");
+    test_log("pool 64 octets", "3 hits, 1 misses (75% hits)");
+
+    test_clean(&test2);
+    nb_logs = 0;
+    uprobe_umem_prof_report(uprobe_umem_prof);
+    test_log("tst1", "3 allocations (+0)");
+    test_log("tst2", "(dead): 1 allocations (+0)");
+    test_log("tst2", " 1 live");
+    assert(nb_logs == 2);
+    ubuf_free(ubuf);
+
+    /* last report of the dead pipe */
+    nb_logs = 0;
+    uprobe_umem_prof_report(uprobe_umem_prof);
+    test_log("tst2", "(dead): 1 allocations (+0)");
+    test_log("tst2", " 0 live");
+    assert(nb_logs == 2);
+    nb_logs = 0;
+    uprobe_umem_prof_report(uprobe_umem_prof);
+    assert(nb_logs == 1);
+
+    /* pipes without live buffers are forgotten as soon as they die */
+    test_clean(&test1);
+    nb_logs = 0;
+    uprobe_umem_prof_report(uprobe_umem_prof);
+    assert(nb_logs == 0);
+    uprobe_release(uprobe_umem_prof);
+    uprobe_clean(&uprobe);
+
+    uref_free(flow_def);
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(udict_umem_mgr);
+    umem_mgr_release(umem_mgr);
+    return 0;
+}
@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests measuring the jitter of a pacing timer under synthetic
+ * load, with and without priority classes in the ev event loop
+ */
+
+#undef NDEBUG
+
+#include <upipe/ubase.h>
+#include <upipe/uclock.h>
+#include <upipe/uclock_std.h>
+#include <upipe/upump.h>
+#include <upump-ev/upump_ev.h>
+
+#include <stdio.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#define UPUMP_POOL 1
+#define UPUMP_BLOCKER_POOL 1
+/** number of pumps of bulk work */
+#define NB_BULK 8
+/** duration of the work of a bulk pump */
+#define BULK_DURATION (UCLOCK_FREQ / 1000)
+/** period of the pacing timer */
+#define PERIOD (UCLOCK_FREQ / 100)
+/** number of ticks to measure */
+#define NB_TICKS 30
+
+static struct uclock *uclock;
+static struct upump_mgr *upump_mgr;
+static struct upump *bulk[NB_BULK];
+static struct upump *timer = NULL;
+static int timer_priority;
+static uint64_t due;
+static unsigned int ticks;
+static uint64_t total_lateness, max_lateness;
+static unsigned int bulk_runs, bulk_runs_before_timer;
+
+/** pumps simulating a bulk work which is always ready */
+static void bulk_cb(struct upump *upump)
+{
+    bulk_runs++;
+    uint64_t end = uclock_now(uclock) + BULK_DURATION;
+    while (uclock_now(uclock) < end);
+}
+
+static void timer_cb(struct upump *upump);
+
+/** arms the pacing timer for the next due date */
+static void timer_arm(void)
+{
+    uint64_t now = uclock_now(uclock);
+    if (timer != NULL) {
+        upump_stop(timer);
+        upump_free(timer);
+    }
+    timer = upump_alloc_timer(upump_mgr, timer_cb, NULL, NULL,
+                              due > now ? due - now : 0, 0);
+    assert(timer != NULL);
+    ubase_assert(upump_set_priority(timer, timer_priority));
+    upump_start(timer);
+}
+
+/** pacing timer, measuring its lateness */
+static void timer_cb(struct upump *upump)
+{
+    uint64_t now = uclock_now(uclock);
+    if (now < due) {
+        /* the loop time may be stale */
+        timer_arm();
+        return;
+    }
+
+    uint64_t lateness = now - due;
+    total_lateness += lateness;
+    if (lateness > max_lateness)
+        max_lateness = lateness;
+
+    if (++ticks >= NB_TICKS) {
+        for (unsigned int i = 0; i < NB_BULK; i++)
+            upump_stop(bulk[i]);
+        upump_stop(timer);
+        return;
+    }
+    due += PERIOD;
+    timer_arm();
+}
+
+/** timer checking the order of dispatch */
+static void order_cb(struct upump *upump)
+{
+    bulk_runs_before_timer = bulk_runs;
+    for (unsigned int i = 0; i < NB_BULK; i++)
+        upump_stop(bulk[i]);
+    upump_stop(upump);
+}
+
+/** @This runs the loop with a timer falling due during the first bulk
+ * callback, and returns the number of bulk callbacks run before the timer.
+ *
+ * @param priority priority of the timer
+ * @param fd file descriptor always ready for reading
+ * @return number of bulk callbacks run before the timer
+ */
+static unsigned int test_order(int priority, int fd)
+{
+    for (unsigned int i = 0; i < NB_BULK; i++) {
+        bulk[i] = upump_alloc_fd_read(upump_mgr, bulk_cb, NULL, NULL, fd);
+        assert(bulk[i] != NULL);
+        upump_start(bulk[i]);
+    }
+    struct upump *upump = upump_alloc_timer(upump_mgr, order_cb, NULL, NULL,
+                                            BULK_DURATION / 2, 0);
+    assert(upump != NULL);
+    ubase_assert(upump_set_priority(upump, priority));
+    upump_start(upump);
+    bulk_runs = 0;
+
+    upump_mgr_run(upump_mgr, NULL);
+
+    for (unsigned int i = 0; i < NB_BULK; i++)
+        upump_free(bulk[i]);
+    upump_free(upump);
+
+    printf("priority %d: %u bulk callbacks before the timer\n",
+           priority, bulk_runs_before_timer);
+    return bulk_runs_before_timer;
+}
+
+/** @This runs the loop and prints the lateness of a pacing timer. The
+ * figures depend on the load of the machine and are not checked.
+ *
+ * @param priority priority of the pacing timer
+ * @param fd file descriptor always ready for reading
+ */
+static void test_run(int priority, int fd)
+{
+    for (unsigned int i = 0; i < NB_BULK; i++) {
+        bulk[i] = upump_alloc_fd_read(upump_mgr, bulk_cb, NULL, NULL, fd);
+        assert(bulk[i] != NULL);
+        upump_start(bulk[i]);
+    }
+    timer_priority = priority;
+    ticks = 0;
+    total_lateness = max_lateness = 0;
+    due = uclock_now(uclock) + PERIOD;
+    timer_arm();
+
+    upump_mgr_run(upump_mgr, NULL);
+
+    for (unsigned int i = 0; i < NB_BULK; i++)
+        upump_free(bulk[i]);
+    upump_free(timer);
+    timer = NULL;
+
+    printf("priority %d: mean lateness %"PRIu64" us, max %"PRIu64" us\n",
+           priority, total_lateness / NB_TICKS * 1000000 / UCLOCK_FREQ,
+           max_lateness * 1000000 / UCLOCK_FREQ);
+}
+
+int main(int argc, char **argv)
+{
+    uclock = uclock_std_alloc(0);
+    assert(uclock != NULL);
+    upump_mgr = upump_ev_mgr_alloc_default(UPUMP_POOL, UPUMP_BLOCKER_POOL);
+    assert(upump_mgr != NULL);
+
+    /* a pipe with unread data is always ready for reading */
+    int pipefd[2];
+    assert(pipe(pipefd) != -1);
+    assert(write(pipefd[1], "", 1) == 1);
+
+    /* priority control */
+    struct upump *upump = upump_alloc_fd_read(upump_mgr, bulk_cb, NULL, NULL,
+                                              pipefd[0]);
+    assert(upump != NULL);
+    int priority;
+    ubase_assert(upump_get_priority(upump, &priority));
+    assert(priority == UPUMP_PRIORITY_NORMAL);
+    upump_start(upump);
+    ubase_assert(upump_set_priority(upump, UPUMP_PRIORITY_LOW));
+    ubase_assert(upump_get_priority(upump, &priority));
+    assert(priority == UPUMP_PRIORITY_LOW);
+    upump_stop(upump);
+    upump_free(upump);
+
+    /* pending bulk pumps are postponed as soon as the timer is overdue */
+    test_order(UPUMP_PRIORITY_NORMAL, pipefd[0]);
+    assert(test_order(UPUMP_PRIORITY_HIGH, pipefd[0]) <= 1);
+
+    test_run(UPUMP_PRIORITY_NORMAL, pipefd[0]);
+    test_run(UPUMP_PRIORITY_HIGH, pipefd[0]);
+
+    close(pipefd[0]);
+    close(pipefd[1]);
+    upump_mgr_release(upump_mgr);
+    uclock_release(uclock);
+    return 0;
+}
@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for hashed flow definitions
+ */
+
+#undef NDEBUG
+
+#include <upipe/ubase.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/uref.h>
+#include <upipe/uref_std.h>
+#include <upipe/uref_flow.h>
+#include <upipe/uref_flow_hash.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define UDICT_POOL_DEPTH 1
+#define UREF_POOL_DEPTH 1
+
+/** checks that the hashed prefix match is the same as a string match */
+static void check_match(const char *def, const char *prefix)
+{
+    struct uref_flow_hash hash;
+    struct uref_flow_hash_key key;
+    uref_flow_hash_init(&hash, def);
+    uref_flow_hash_key_init(&key, prefix);
+    assert(uref_flow_hash_match(&hash, &key) == !ubase_ncmp(def, prefix));
+}
+
+int main(int argc, char **argv)
+{
+    static const char *defs[] = {
+        "block.", "block.h264.", "block.h264.pic.", "block.mpeg2video.pic.",
+        "block.mpeg2video.pic.sub.", "pic.", "pic.sub.", "sound.s16.",
+        "void.", "block.aac.sound.", "block.aac_latm.sound.",
+        "a.b.c.d.e.f.g.h.i.j.", "block.h26"
+    };
+    static const char *prefixes[] = {
+        "block.", "block.h264.", "block.mpeg2video.",
+        "block.mpeg2video.pic.", "pic.", "pic.sub.", "sound.", "void.",
+        "block.aac.", "block.aac_latm.", "a.b.c.d.e.f.g.h.i.", "blocks."
+    };
+    for (int i = 0; i < UBASE_ARRAY_SIZE(defs); i++)
+        for (int j = 0; j < UBASE_ARRAY_SIZE(prefixes); j++)
+            check_match(defs[i], prefixes[j]);
+
+    struct uref_flow_hash hash;
+    struct uref_flow_hash_key pic, sub, sound;
+    uref_flow_hash_key_init(&pic, "pic");
+    uref_flow_hash_key_init(&sub, "sub");
+    uref_flow_hash_key_init(&sound, "sound");
+
+    uref_flow_hash_init(&hash, "block.mpeg2video.pic.sub.");
+    assert(hash.depth == 4);
+    assert(uref_flow_hash_complete(&hash));
+    assert(uref_flow_hash_find(&hash, &pic, 0) == 2);
+    assert(uref_flow_hash_find(&hash, &sub, 0) == 3);
+    assert(uref_flow_hash_find(&hash, &pic, 3) == -1);
+    assert(uref_flow_hash_find(&hash, &sound, 0) == -1);
+
+    uref_flow_hash_init(&hash, "pict.subs.");
+    assert(uref_flow_hash_find(&hash, &pic, 0) == -1);
+    assert(uref_flow_hash_find(&hash, &sub, 0) == -1);
+
+    uref_flow_hash_init(&hash, "block.h26");
+    assert(hash.depth == 1);
+    assert(!uref_flow_hash_complete(&hash));
+
+    uref_flow_hash_init(&hash, "a.b.c.d.e.f.g.h.i.j.");
+    assert(hash.depth == UREF_FLOW_HASH_DEPTH);
+    assert(!uref_flow_hash_complete(&hash));
+
+    uref_flow_hash_init(&hash, "");
+    assert(hash.depth == 0);
+    assert(uref_flow_hash_complete(&hash));
+
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    struct uref_mgr *uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH,
+                                                   udict_mgr, 0);
+    assert(uref_mgr != NULL);
+
+    struct uref *flow_def = uref_alloc_control(uref_mgr);
+    assert(flow_def != NULL);
+    ubase_assert(uref_flow_set_def(flow_def, "block.mpeg2video.pic.sub."));
+    const uint8_t *cache;
+    size_t size;
+    ubase_assert(uref_flow_hash_init_uref(&hash, flow_def));
+    assert(!ubase_check(uref_flow_get_hash(flow_def, &cache, &size)));
+    ubase_assert(uref_flow_hash_cache_uref(&hash, flow_def));
+    ubase_assert(uref_flow_get_hash(flow_def, &cache, &size));
+
+    /* the cache is carried by copies */
+    struct uref *dup = uref_dup(flow_def);
+    assert(dup != NULL);
+    struct uref_flow_hash cached;
+    ubase_assert(uref_flow_hash_init_uref(&cached, dup));
+    assert(cached.depth == 4);
+    assert(!memcmp(cached.prefix, hash.prefix, sizeof(hash.prefix)));
+    assert(!memcmp(cached.component, hash.component,
+                   sizeof(hash.component)));
+    assert(!memcmp(cached.end, hash.end, sizeof(hash.end)));
+    assert(uref_flow_hash_find(&cached, &sub, 0) == 3);
+
+    /* and ignored once the flow definition changes */
+    ubase_assert(uref_flow_set_def(dup, "block.mpeg2video.sound."));
+    ubase_assert(uref_flow_get_hash(dup, &cache, &size));
+    ubase_assert(uref_flow_hash_init_uref(&cached, dup));
+    assert(cached.depth == 3);
+    assert(uref_flow_hash_find(&cached, &sub, 0) == -1);
+    assert(uref_flow_hash_find(&cached, &sound, 0) == 2);
+    ubase_assert(uref_flow_set_def(dup, "block.mpeg2video.pic.sum."));
+    ubase_assert(uref_flow_hash_init_uref(&cached, dup));
+    assert(uref_flow_hash_find(&cached, &sub, 0) == -1);
+    ubase_assert(uref_flow_hash_cache_uref(&cached, dup));
+    assert(!strcmp(cached.def, "block.mpeg2video.pic.sum."));
+    assert(uref_flow_hash_find(&cached, &pic, 0) == 2);
+
+    uref_free(dup);
+    uref_free(flow_def);
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    return 0;
+}
@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2018 OpenHeadend S.A.R.L.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/** @file
+ * @short unit tests for sampled uref tracing
+ */
+
+#undef NDEBUG
+
+#include <upipe/ubase.h>
+#include <upipe/umem.h>
+#include <upipe/umem_alloc.h>
+#include <upipe/udict.h>
+#include <upipe/udict_inline.h>
+#include <upipe/ubuf.h>
+#include <upipe/ubuf_block_mem.h>
+#include <upipe/uref.h>
+#include <upipe/uref_std.h>
+#include <upipe/uref_block.h>
+#include <upipe/uref_trace.h>
+#include <upipe/upipe.h>
+#include <upipe/utrace.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#define UDICT_POOL_DEPTH 5
+#define UREF_POOL_DEPTH 5
+#define UBUF_POOL_DEPTH 5
+#define TEST_RELAY_SIGNATURE UBASE_FOURCC('r','e','l','y')
+#define TEST_SINK_SIGNATURE UBASE_FOURCC('s','i','n','k')
+
+static struct uref_mgr *uref_mgr;
+static struct ubuf_mgr *ubuf_mgr;
+
+/** phony pipes */
+struct test_pipe {
+    /** output */
+    struct upipe *output;
+    /** trace ID of the last uref */
+    uint64_t last_id;
+    /** number of traced urefs */
+    unsigned int traced;
+    /** public structure */
+    struct upipe upipe;
+};
+
+UBASE_FROM_TO(test_pipe, upipe, upipe, upipe)
+
+/** helper phony pipe */
+static void test_init(struct test_pipe *test, struct upipe_mgr *mgr,
+                      struct upipe *output)
+{
+    upipe_init(&test->upipe, mgr, NULL);
+    test->output = output;
+    test->last_id = 0;
+    test->traced = 0;
+}
+
+/** helper phony pipe, forwarding a duplicate of the uref */
+static void test_input(struct upipe *upipe, struct uref *uref,
+                       struct upump **upump_p)
+{
+    struct test_pipe *test = test_pipe_from_upipe(upipe);
+    test->last_id = utrace_get_id(uref);
+    if (test->last_id)
+        test->traced++;
+    if (test->output != NULL) {
+        struct uref *dup = uref_dup(uref);
+        assert(dup != NULL);
+        upipe_input(test->output, dup, upump_p);
+        assert(test_pipe_from_upipe(test->output)->last_id == test->last_id);
+    }
+    uref_free(uref);
+}
+
+/** helper phony pipe */
+static struct upipe_mgr relay_mgr = {
+    .refcount = NULL,
+    .signature = TEST_RELAY_SIGNATURE,
+    .upipe_input = test_input
+};
+
+/** helper phony pipe */
+static struct upipe_mgr sink_mgr = {
+    .refcount = NULL,
+    .signature = TEST_SINK_SIGNATURE,
+    .upipe_input = test_input
+};
+
+/** @This sends urefs to a relay and a sink.
+ *
+ * @param nb number of urefs to send
+ * @return number of traced urefs
+ */
+static unsigned int test_send(unsigned int nb)
+{
+    struct test_pipe sink, relay;
+    test_init(&sink, &sink_mgr, NULL);
+    test_init(&relay, &relay_mgr, &sink.upipe);
+
+    for (unsigned int i = 0; i < nb; i++) {
+        struct uref *uref = uref_block_alloc(uref_mgr, ubuf_mgr, 42);
+        assert(uref != NULL);
+        upipe_input(&relay.upipe, uref, NULL);
+    }
+    /* flow definitions are never sampled */
+    struct uref *flow_def = uref_alloc(uref_mgr);
+    assert(flow_def != NULL);
+    upipe_input(&relay.upipe, flow_def, NULL);
+    assert(relay.last_id == 0);
+
+    assert(relay.traced == sink.traced);
+    upipe_clean(&relay.upipe);
+    upipe_clean(&sink.upipe);
+    return relay.traced;
+}
+
+/** thread sending urefs */
+static void *test_thread(void *arg)
+{
+    unsigned int *traced = arg;
+    *traced = test_send(8);
+    return NULL;
+}
+
+/** @This exports the trace and counts occurrences of a string.
+ *
+ * @param needles strings to count
+ * @param counts filled in with the number of occurrences
+ * @param nb number of strings
+ */
+static void test_export(const char *const *needles, unsigned int *counts,
+                        unsigned int nb)
+{
+    FILE *file = tmpfile();
+    assert(file != NULL);
+    ubase_assert(utrace_export(file));
+    long size = ftell(file);
+    assert(size > 0);
+    rewind(file);
+    char *buffer = malloc(size + 1);
+    assert(buffer != NULL);
+    assert(fread(buffer, 1, size, file) == size);
+    buffer[size] = '\0';
+    fclose(file);
+
+    assert(!strncmp(buffer, "{\"displayTimeUnit\"", 18));
+    assert(!strcmp(buffer + size - 3, "]}\n"));
+    for (unsigned int i = 0; i < nb; i++) {
+        counts[i] = 0;
+        for (const char *p = strstr(buffer, needles[i]); p != NULL;
+             p = strstr(p + 1, needles[i]))
+            counts[i]++;
+    }
+    free(buffer);
+}
+
+int main(int argc, char **argv)
+{
+    struct umem_mgr *umem_mgr = umem_alloc_mgr_alloc();
+    assert(umem_mgr != NULL);
+    struct udict_mgr *udict_mgr = udict_inline_mgr_alloc(UDICT_POOL_DEPTH,
+                                                         umem_mgr, -1, -1);
+    assert(udict_mgr != NULL);
+    uref_mgr = uref_std_mgr_alloc(UREF_POOL_DEPTH, udict_mgr, 0);
+    assert(uref_mgr != NULL);
+    ubuf_mgr = ubuf_block_mem_mgr_alloc(UBUF_POOL_DEPTH, UBUF_POOL_DEPTH,
+                                        umem_mgr, 0, 0, -1, 0);
+    assert(ubuf_mgr != NULL);
+
+    static const char *const needles[] = {
+        "\"thread_name\"", "\"ph\":\"B\"", "\"ph\":\"E\"", "\"rely\"",
+        "\"sink\""
+    };
+    unsigned int counts[5];
+
+    /* disabled */
+    ubase_nassert(utrace_start(0, 0));
+    assert(test_send(10) == 0);
+    test_export(needles, counts, 5);
+    assert(counts[0] == 0);
+
+    /* one in 4, in two threads */
+    ubase_assert(utrace_start(4, 0));
+    assert(test_send(100) == 25);
+    unsigned int thread_traced;
+    pthread_t thread;
+    assert(!pthread_create(&thread, NULL, test_thread, &thread_traced));
+    assert(!pthread_join(thread, NULL));
+    assert(thread_traced == 2);
+
+    test_export(needles, counts, 5);
+    assert(counts[0] == 2);
+    assert(counts[1] == 2 * 27);
+    assert(counts[2] == 2 * 27);
+    assert(counts[3] == 27);
+    assert(counts[4] == 27);
+    utrace_stop();
+    utrace_clean();
+
+    /* ring overflow keeps the last events */
+    ubase_assert(utrace_start(1, 6));
+    assert(test_send(10) == 10);
+    utrace_stop();
+    assert(test_send(10) == 0);
+    test_export(needles, counts, 5);
+    assert(counts[0] == 1);
+    assert(counts[1] + counts[2] <= 6);
+    assert(counts[2] <= counts[1] + 1);
+    utrace_clean();
+
+    ubuf_mgr_release(ubuf_mgr);
+    uref_mgr_release(uref_mgr);
+    udict_mgr_release(udict_mgr);
+    umem_mgr_release(umem_mgr);
+    return 0;
+}